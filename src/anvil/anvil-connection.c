@@ -463,7 +463,8 @@ anvil_connection_request(struct anvil_connection *conn,
 		connect_limit_disconnect(connect_limit, pid, &key, conn_guid);
 	} else if (strcmp(cmd, "CONNECT-DUMP") == 0) {
 		anvil_global_connect_dump_count++;
-		connect_limit_dump(connect_limit, conn->conn.output);
+		/* optional parameter: username mask */
+		connect_limit_dump(connect_limit, conn->conn.output, args[0]);
 	} else if (strcmp(cmd, "KICK-USER") == 0) {
 		if (args[0] == NULL) {
 			*error_r = "KICK-USER: Not enough parameters";
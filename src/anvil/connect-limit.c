@@ -9,6 +9,7 @@
 #include "str-table.h"
 #include "strescape.h"
 #include "ostream.h"
+#include "wildcard-match.h"
 #include "connect-limit.h"
 
 struct process {
@@ -566,13 +567,42 @@ void connect_limit_disconnect_pid(struct connect_limit *limit, pid_t pid)
 		connect_limit_process_free(limit, process);
 }
 
-void connect_limit_dump(struct connect_limit *limit, struct ostream *output)
+static void
+connect_limit_dump_session(string_t *str, const struct session *session)
+{
+	unsigned int alt_idx;
+
+	str_truncate(str, 0);
+	str_printfa(str, "%lu\t", (unsigned long)session->process->pid);
+	str_append_tabescaped(str, session->userip->username);
+	str_append_c(str, '\t');
+	str_append_tabescaped(str, session->service);
+	str_append_c(str, '\t');
+	if (session->userip->ip.family != 0)
+		str_append(str, net_ip2addr(&session->userip->ip));
+	str_append_c(str, '\t');
+	str_append_tabescaped(str, guid_128_to_string(session->conn_guid));
+	str_append_c(str, '\t');
+	if (session->dest_ip.family != 0)
+		str_append(str, net_ip2addr(&session->dest_ip));
+	for (alt_idx = 0; alt_idx < session->alt_usernames_count; alt_idx++) {
+		str_append_c(str, '\t');
+		if (session->alt_usernames[alt_idx].alt_username != NULL) {
+			str_append_tabescaped(str,
+				session->alt_usernames[alt_idx].alt_username);
+		}
+	}
+	str_append_c(str, '\n');
+}
+
+void connect_limit_dump(struct connect_limit *limit, struct ostream *output,
+			const char *username_mask)
 {
 	struct hash_iterate_context *iter;
 	struct session *session;
 	const uint8_t *conn_guid;
+	char *username;
 	const struct alt_username_field *alt_field;
-	unsigned int alt_idx;
 	string_t *str = str_new(default_pool, 256);
 	ssize_t ret = 0;
 
@@ -585,35 +615,36 @@ void connect_limit_dump(struct connect_limit *limit, struct ostream *output)
 	str_append_c(str, '\n');
 	o_stream_nsend(output, str_data(str), str_len(str));
 
-	/* Send all sessions */
-	iter = hash_table_iterate_init(limit->session_hash);
-	while (ret >= 0 &&
-	       hash_table_iterate(iter, limit->session_hash,
-				  &conn_guid, &session)) T_BEGIN {
-		str_truncate(str, 0);
-		str_printfa(str, "%lu\t", (unsigned long)session->process->pid);
-		str_append_tabescaped(str, session->userip->username);
-		str_append_c(str, '\t');
-		str_append_tabescaped(str, session->service);
-		str_append_c(str, '\t');
-		if (session->userip->ip.family != 0)
-			str_append(str, net_ip2addr(&session->userip->ip));
-		str_append_c(str, '\t');
-		str_append_tabescaped(str, guid_128_to_string(session->conn_guid));
-		str_append_c(str, '\t');
-		if (session->dest_ip.family != 0)
-			str_append(str, net_ip2addr(&session->dest_ip));
-		for (alt_idx = 0; alt_idx < session->alt_usernames_count; alt_idx++) {
-			str_append_c(str, '\t');
-			if (session->alt_usernames[alt_idx].alt_username != NULL) {
-				str_append_tabescaped(str,
-					session->alt_usernames[alt_idx].alt_username);
-			}
+	if (username_mask != NULL) {
+		/* Send only the matching users' sessions. There are usually
+		   far fewer users than sessions, and non-matching users'
+		   sessions don't need to be looked at at all. */
+		iter = hash_table_iterate_init(limit->user_hash);
+		while (ret >= 0 &&
+		       hash_table_iterate(iter, limit->user_hash,
+					  &username, &session)) {
+			if (!wildcard_match_icase(username, username_mask))
+				continue;
+			for (; session != NULL && ret >= 0;
+			     session = session->user_next) T_BEGIN {
+				connect_limit_dump_session(str, session);
+				ret = o_stream_send(output, str_data(str),
+						    str_len(str));
+			} T_END;
 		}
-		str_append_c(str, '\n');
-		ret = o_stream_send(output, str_data(str), str_len(str));
-	} T_END;
-	hash_table_iterate_deinit(&iter);
+		hash_table_iterate_deinit(&iter);
+	} else {
+		/* Send all sessions */
+		iter = hash_table_iterate_init(limit->session_hash);
+		while (ret >= 0 &&
+		       hash_table_iterate(iter, limit->session_hash,
+					  &conn_guid, &session)) T_BEGIN {
+			connect_limit_dump_session(str, session);
+			ret = o_stream_send(output, str_data(str),
+					    str_len(str));
+		} T_END;
+		hash_table_iterate_deinit(&iter);
+	}
 	o_stream_nsend(output, "\n", 1);
 	str_free(&str);
 }
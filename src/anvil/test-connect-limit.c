@@ -24,13 +24,13 @@ static guid_128_t session3_guid = {
 #define SESSION3_HEX "300000000000000000000000000000f3"
 
 static void
-test_session_dump(struct connect_limit *limit, const char *expected_altnames,
-		  const char *expected_dump)
+test_session_dump_mask(struct connect_limit *limit, const char *username_mask,
+		       const char *expected_altnames, const char *expected_dump)
 {
 	string_t *str = str_new(default_pool, 128);
 	struct ostream *output = o_stream_create_buffer(str);
 
-	connect_limit_dump(limit, output);
+	connect_limit_dump(limit, output, username_mask);
 	if (str_len(str) == 1) {
 		test_assert_strcmp("", expected_dump);
 		o_stream_destroy(&output);
@@ -71,6 +71,13 @@ test_session_dump(struct connect_limit *limit, const char *expected_altnames,
 	str_free(&str);
 }
 
+static void
+test_session_dump(struct connect_limit *limit, const char *expected_altnames,
+		  const char *expected_dump)
+{
+	test_session_dump_mask(limit, NULL, expected_altnames, expected_dump);
+}
+
 static void test_connect_limit(void)
 {
 	struct connect_limit *limit;
@@ -152,6 +159,16 @@ static void test_connect_limit(void)
 	test_session_dump(limit, "altkey1\taltkey2\taltkey3\taltkey4",
 			  TEST_SESSION1_STR TEST_SESSION2_STR TEST_SESSION3_STR);
 
+	/* dump with username mask */
+	test_session_dump_mask(limit, "USER2",
+			       "altkey1\taltkey2\taltkey3\taltkey4",
+			       TEST_SESSION3_STR);
+	test_session_dump_mask(limit, "user*",
+			       "altkey1\taltkey2\taltkey3\taltkey4",
+			       TEST_SESSION1_STR TEST_SESSION2_STR TEST_SESSION3_STR);
+	test_session_dump_mask(limit, "nonexistent",
+			       "altkey1\taltkey2\taltkey3\taltkey4", "");
+
 	/* test user iteration for user1 */
 	struct connect_limit_iter *iter =
 		connect_limit_iter_begin(limit, "user1", NULL);
@@ -286,7 +303,7 @@ static void test_sessions_compare(struct connect_limit *limit,
 	string_t *str = str_new(default_pool, 10240);
 	struct ostream *output = o_stream_create_buffer(str);
 	o_stream_set_no_error_handling(output, TRUE);
-	connect_limit_dump(limit, output);
+	connect_limit_dump(limit, output, NULL);
 	o_stream_unref(&output);
 
 	struct istream *input =
@@ -3,14 +3,23 @@
 #include "auth-common.h"
 #include "lib-signals.h"
 #include "hash.h"
+#include "istream.h"
+#include "ostream.h"
 #include "str.h"
 #include "strescape.h"
 #include "var-expand.h"
+#include "master-interface.h"
 #include "auth-request.h"
 #include "auth-cache.h"
 #include "auth-common.h"
 
+#include <stdio.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define AUTH_CACHE_FILE_HEADER "AUTH-CACHE\t1"
+#define AUTH_CACHE_PERSIST_FNAME "auth-cache"
 
 struct auth_cache {
 	HASH_TABLE(char *, struct auth_cache_node *) hash;
@@ -18,7 +27,7 @@ struct auth_cache {
 	struct event *event;
 
 	size_t max_size, size_left;
-	unsigned int ttl_secs, neg_ttl_secs;
+	unsigned int ttl_secs, neg_ttl_secs, stale_secs;
 
 	unsigned int hit_count, miss_count;
 	unsigned int pos_entries, neg_entries;
@@ -247,6 +256,12 @@ struct auth_cache *auth_cache_new(size_t max_size, unsigned int ttl_secs,
 	return cache;
 }
 
+void auth_cache_set_stale_secs(struct auth_cache *cache,
+			       unsigned int stale_secs)
+{
+	cache->stale_secs = stale_secs;
+}
+
 void auth_cache_free(struct auth_cache **_cache)
 {
 	struct auth_cache *cache = *_cache;
@@ -418,21 +433,34 @@ auth_cache_lookup(struct auth_cache *cache, const struct auth_request *request,
 	return value;
 }
 
-void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
-		       const char *key, const char *value, bool last_success)
+const char *
+auth_cache_lookup_derived(struct auth_cache *cache,
+			  const struct auth_request *request, const char *key)
 {
-        struct auth_cache_node *node;
-	size_t data_size, alloc_size, key_len, value_len = strlen(value);
-	char *hash_key;
+	struct auth_cache_node *node;
 
-	if (*value == '\0' && cache->neg_ttl_secs == 0) {
-		/* we're not caching negative entries */
-		return;
+	key = auth_request_expand_cache_key(request, key,
+					    request->fields.translated_username);
+	node = hash_table_lookup(cache->hash, key);
+	if (node == NULL || node->created < time(NULL) - (time_t)cache->ttl_secs)
+		return NULL;
+
+	if (node != cache->head) {
+		auth_cache_node_unlink(cache, node);
+		auth_cache_node_link_head(cache, node);
 	}
+	return node->data + strlen(node->data) + 1;
+}
 
-	key = auth_request_expand_cache_key(request, key, request->fields.translated_username);
-	key_len = strlen(key);
+static void
+auth_cache_insert_node(struct auth_cache *cache, const char *key,
+		       const char *value, time_t created, bool last_success)
+{
+	struct auth_cache_node *node;
+	size_t data_size, alloc_size, key_len, value_len = strlen(value);
+	char *hash_key;
 
+	key_len = strlen(key);
 	data_size = key_len + 1 + value_len + 1;
 	alloc_size = sizeof(struct auth_cache_node) + data_size;
 
@@ -448,7 +476,7 @@ void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
 
 	/* @UNSAFE */
 	node = i_malloc(alloc_size);
-	node->created = time(NULL);
+	node->created = created;
 	node->alloc_size = alloc_size;
 	node->last_success = last_success;
 	memcpy(node->data, key, key_len);
@@ -469,6 +497,55 @@ void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
 	}
 }
 
+bool auth_cache_node_use_stale(struct auth_cache *cache,
+			       struct auth_cache_node *node)
+{
+	const char *value = node->data + strlen(node->data) + 1;
+	time_t stale_limit = time(NULL) -
+		(time_t)(cache->ttl_secs + cache->stale_secs);
+
+	if (cache->stale_secs == 0 || node->refreshing ||
+	    *value == '\0' || !node->last_success ||
+	    node->created < stale_limit)
+		return FALSE;
+
+	node->refreshing = TRUE;
+	/* auth_cache_lookup() counted this as a miss */
+	i_assert(cache->miss_count > 0);
+	cache->miss_count--;
+	cache->hit_count++;
+	if (node != cache->head) {
+		auth_cache_node_unlink(cache, node);
+		auth_cache_node_link_head(cache, node);
+	}
+	return TRUE;
+}
+
+void auth_cache_refresh_finished(struct auth_cache *cache,
+				 const struct auth_request *request,
+				 const char *key)
+{
+	struct auth_cache_node *node;
+
+	key = auth_request_expand_cache_key(request, key,
+					    request->fields.translated_username);
+	node = hash_table_lookup(cache->hash, key);
+	if (node != NULL)
+		node->refreshing = FALSE;
+}
+
+void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
+		       const char *key, const char *value, bool last_success)
+{
+	if (*value == '\0' && cache->neg_ttl_secs == 0) {
+		/* we're not caching negative entries */
+		return;
+	}
+
+	key = auth_request_expand_cache_key(request, key, request->fields.translated_username);
+	auth_cache_insert_node(cache, key, value, time(NULL), last_success);
+}
+
 void auth_cache_remove(struct auth_cache *cache,
 		       const struct auth_request *request, const char *key)
 {
@@ -481,3 +558,138 @@ void auth_cache_remove(struct auth_cache *cache,
 
 	auth_cache_node_destroy(cache, node);
 }
+
+const char *auth_cache_persist_path(const char *state_dir)
+{
+	return t_strconcat(state_dir, "/"MASTER_AUTH_STATE_DIR_NAME"/"
+			   AUTH_CACHE_PERSIST_FNAME, NULL);
+}
+
+int auth_cache_save(struct auth_cache *cache, const char *path,
+		    const char *config_hash)
+{
+	struct auth_cache_node *node;
+	struct ostream *output;
+	const char *temp_path, *value;
+	mode_t old_mask;
+	int fd, ret = 0;
+
+	temp_path = t_strconcat(path, ".tmp", NULL);
+
+	/* the values contain password hashes */
+	old_mask = umask(0);
+	fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	umask(old_mask);
+	if (fd == -1) {
+		e_error(cache->event, "open(%s) failed: %m", temp_path);
+		return -1;
+	}
+
+	output = o_stream_create_fd_autoclose(&fd, IO_BLOCK_SIZE);
+	o_stream_cork(output);
+	o_stream_nsend_str(output, t_strdup_printf(
+		AUTH_CACHE_FILE_HEADER"\t%s\n", config_hash));
+	/* write the oldest entries first, so loading preserves the LRU order */
+	for (node = cache->tail; node != NULL; node = node->next) T_BEGIN {
+		string_t *str = t_str_new(128);
+
+		value = node->data + strlen(node->data) + 1;
+		str_printfa(str, "%ld\t%c\t", (long)node->created,
+			    node->last_success ? '1' : '0');
+		str_append_tabescaped(str, node->data);
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, value);
+		str_append_c(str, '\n');
+		o_stream_nsend(output, str_data(str), str_len(str));
+	} T_END;
+	if (o_stream_finish(output) < 0) {
+		e_error(cache->event, "write(%s) failed: %s", temp_path,
+			o_stream_get_error(output));
+		ret = -1;
+	}
+	o_stream_destroy(&output);
+
+	if (ret == 0 && rename(temp_path, path) < 0) {
+		e_error(cache->event, "rename(%s, %s) failed: %m",
+			temp_path, path);
+		ret = -1;
+	}
+	if (ret < 0)
+		i_unlink_if_exists(temp_path);
+	return ret;
+}
+
+static bool
+auth_cache_load_line(struct auth_cache *cache, const char *line, time_t now)
+{
+	const char *const *args = t_strsplit_tabescaped(line);
+	unsigned int ttl_secs;
+	long created;
+
+	if (str_array_length(args) != 4 ||
+	    str_to_long(args[0], &created) < 0 ||
+	    (args[1][0] != '0' && args[1][0] != '1') || args[2][0] == '\0')
+		return FALSE;
+
+	ttl_secs = args[3][0] == '\0' ? cache->neg_ttl_secs : cache->ttl_secs;
+	if ((time_t)created >= now - (time_t)ttl_secs &&
+	    (time_t)created <= now) {
+		auth_cache_insert_node(cache, args[2], args[3],
+				       (time_t)created, args[1][0] == '1');
+	}
+	return TRUE;
+}
+
+int auth_cache_load(struct auth_cache *cache, const char *path,
+		    const char *config_hash)
+{
+	struct istream *input;
+	const char *line;
+	time_t now = time(NULL);
+	unsigned int count, line_num = 1;
+	int ret = 0;
+
+	input = i_stream_create_file(path, IO_BLOCK_SIZE);
+	line = i_stream_read_next_line(input);
+	if (line == NULL) {
+		if (input->stream_errno != 0 && input->stream_errno != ENOENT) {
+			e_error(cache->event, "read(%s) failed: %s", path,
+				i_stream_get_error(input));
+			ret = -1;
+		}
+		i_stream_destroy(&input);
+		return ret;
+	}
+	if (strcmp(line, t_strdup_printf(AUTH_CACHE_FILE_HEADER"\t%s",
+					 config_hash)) != 0) {
+		/* cache keys refer to the passdbs/userdbs by their IDs, so
+		   the entries can't be used with different configuration */
+		e_debug(cache->event, "Ignoring %s: Configuration has changed",
+			path);
+		i_stream_destroy(&input);
+		return 0;
+	}
+
+	while ((line = i_stream_read_next_line(input)) != NULL) T_BEGIN {
+		line_num++;
+		/* don't log the line itself - it contains password hashes */
+		if (!auth_cache_load_line(cache, line, now)) {
+			e_error(cache->event, "%s: Corrupted line %u",
+				path, line_num);
+			ret = -1;
+		}
+	} T_END;
+	if (input->stream_errno != 0) {
+		e_error(cache->event, "read(%s) failed: %s", path,
+			i_stream_get_error(input));
+		ret = -1;
+	}
+	i_stream_destroy(&input);
+
+	/* the loaded entries aren't new inserts */
+	count = hash_table_count(cache->hash);
+	cache->pos_entries = cache->neg_entries = 0;
+	cache->pos_size = cache->neg_size = 0;
+	e_debug(cache->event, "Loaded %u cache entries from %s", count, path);
+	return ret < 0 ? -1 : (int)count;
+}
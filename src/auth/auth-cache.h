@@ -6,9 +6,11 @@ struct auth_cache_node {
 
 	time_t created;
 	/* Total number of bytes used by this node */
-	uint32_t alloc_size:31;
+	uint32_t alloc_size:30;
 	/* TRUE if the user gave the correct password the last time. */
 	bool last_success:1;
+	/* TRUE if the expired entry is already being refreshed */
+	bool refreshing:1;
 
 	char data[]; /* key \0 value \0 */
 };
@@ -26,6 +28,10 @@ char *auth_cache_parse_key(pool_t pool, const char *query);
    neg_ttl_secs specifies the TTL for negative entries. */
 struct auth_cache *auth_cache_new(size_t max_size, unsigned int ttl_secs,
 				  unsigned int neg_ttl_secs);
+/* Allow using successful positive entries for stale_secs after their TTL
+   has expired, while they're being refreshed. */
+void auth_cache_set_stale_secs(struct auth_cache *cache,
+			       unsigned int stale_secs);
 void auth_cache_free(struct auth_cache **cache);
 
 /* Clear the cache. Returns how many entries were removed. */
@@ -41,6 +47,24 @@ const char *
 auth_cache_lookup(struct auth_cache *cache, const struct auth_request *request,
 		  const char *key, struct auth_cache_node **node_r,
 		  bool *expired_r, bool *neg_expired_r);
+/* Returns TRUE if the expired node returned by auth_cache_lookup() can still
+   be used while it's refreshed. The caller is expected to start the refresh
+   then. This is done only once for each node. */
+bool auth_cache_node_use_stale(struct auth_cache *cache,
+			       struct auth_cache_node *node);
+/* The refresh started after auth_cache_node_use_stale() has finished or
+   was aborted. If it didn't replace the node, the node can be used stale
+   and refreshed again. */
+void auth_cache_refresh_finished(struct auth_cache *cache,
+				 const struct auth_request *request,
+				 const char *key);
+/* Look up an entry containing a value derived from another entry, such as
+   credentials generated from a cached plaintext password. Expired entries
+   aren't returned, and the lookup isn't counted in the hit/miss statistics.
+   The returned value can't be used after any other auth_cache_*() calls. */
+const char *
+auth_cache_lookup_derived(struct auth_cache *cache,
+			  const struct auth_request *request, const char *key);
 /* Insert key => value into cache. "" value means negative cache entry. */
 void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
 		       const char *key, const char *value, bool last_success);
@@ -50,4 +74,20 @@ void auth_cache_remove(struct auth_cache *cache,
 		       const struct auth_request *request,
 		       const char *key);
 
+/* Returns the path where the cache is saved: under the state_dir
+   subdirectory that master creates writable for the auth process. */
+const char *auth_cache_persist_path(const char *state_dir);
+/* Write all the cache entries to the given file, so they can be loaded back
+   after the auth process is restarted. config_hash identifies the
+   passdb/userdb configuration the cache keys were created with.
+   Returns 0 on success, -1 on error. */
+int auth_cache_save(struct auth_cache *cache, const char *path,
+		    const char *config_hash);
+/* Load the entries written by auth_cache_save(). Nothing is loaded if the
+   file doesn't exist or config_hash is different. Entries whose TTL has
+   already expired are skipped. Returns the number of entries in the cache
+   afterwards, or -1 on error. */
+int auth_cache_load(struct auth_cache *cache, const char *path,
+		    const char *config_hash);
+
 #endif
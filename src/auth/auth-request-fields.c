@@ -129,6 +129,30 @@ void auth_request_export(struct auth_request *request, string_t *dest)
 		auth_request_export_fields(dest, fields->userdb_reply, "userdb_");
 }
 
+void auth_request_import_request(struct auth_request *dest,
+				 struct auth_request *src)
+{
+	const char *const *args, *key, *value;
+	string_t *str = t_str_new(256);
+
+	auth_request_export(src, str);
+	for (args = t_strsplit_tabescaped(str_c(str)); *args != NULL; args++) {
+		value = strchr(*args, '=');
+		if (value == NULL)
+			(void)auth_request_import(dest, *args, "");
+		else {
+			key = t_strdup_until(*args, value++);
+			(void)auth_request_import(dest, key, value);
+		}
+	}
+	/* the lookup results aren't wanted */
+	auth_fields_reset(dest->fields.extra_fields);
+	if (dest->fields.userdb_reply != NULL)
+		auth_fields_reset(dest->fields.userdb_reply);
+	dest->fields.translated_username =
+		p_strdup(dest->pool, src->fields.translated_username);
+}
+
 bool auth_request_import_info(struct auth_request *request,
 			      const char *key, const char *value)
 {
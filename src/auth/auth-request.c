@@ -379,6 +379,12 @@ void auth_request_unref(struct auth_request **_request)
 
 	i_assert(array_count(&request->authdb_event) == 0);
 
+	if (request->passdb_cache_refresh && passdb_cache != NULL) {
+		/* allow refreshing the entry again if this refresh failed
+		   or was aborted before the cache was updated */
+		auth_cache_refresh_finished(passdb_cache, request,
+					    request->passdb->cache_key);
+	}
 	if (request->handler_pending_reply)
 		auth_request_handler_abort(request);
 
@@ -987,7 +993,12 @@ auth_request_verify_plain_callback_finish(enum passdb_result result,
 			"Failed to expand override_fields: %s", error);
 		result = PASSDB_RESULT_INTERNAL_FAILURE;
 	}
-	if ((ret = auth_request_handle_passdb_callback(&result, request)) == 0) {
+	ret = auth_request_handle_passdb_callback(&result, request);
+	if (ret == 0 && request->passdb_cache_refresh) {
+		/* only this passdb's cache entry is being refreshed */
+		ret = 1;
+	}
+	if (ret == 0) {
 		/* try next passdb */
 		auth_request_verify_plain(request, request->mech_password,
 			request->private_callback.verify_plain);
@@ -1144,12 +1155,38 @@ void auth_request_verify_plain(struct auth_request *request,
 	}
 }
 
+static void
+auth_request_passdb_verify_plain(struct auth_request *request,
+				 const char *password)
+{
+	struct auth_passdb *passdb = request->passdb;
+	const char *error;
+
+	if (passdb->passdb->iface.verify_plain == NULL) {
+		/* we're deinitializing and just want to get rid of this
+		   request */
+		auth_request_verify_plain_callback(
+			PASSDB_RESULT_INTERNAL_FAILURE, request);
+	} else if (passdb->passdb->blocking) {
+		passdb_blocking_verify_plain(request);
+	} else if (passdb_template_export(passdb->default_fields_tmpl,
+					  request, &error) < 0) {
+		e_error(authdb_event(request),
+			"Failed to expand default_fields: %s", error);
+		auth_request_verify_plain_callback(
+			PASSDB_RESULT_INTERNAL_FAILURE, request);
+	} else {
+		passdb->passdb->iface.verify_plain(
+			request, password, auth_request_verify_plain_callback);
+	}
+}
+
 void auth_request_default_verify_plain_continue(
 	struct auth_request *request, verify_plain_callback_t *callback)
 {
 	struct auth_passdb *passdb;
 	enum passdb_result result;
-	const char *cache_key, *error;
+	const char *cache_key;
 	const char *password = request->mech_password;
 
 	i_assert(request->state == AUTH_REQUEST_STATE_MECH_CONTINUE);
@@ -1193,24 +1230,40 @@ void auth_request_default_verify_plain_continue(
 	   even possible?), make sure wanted_credentials_scheme is cleared
 	   so passdbs don't think we're doing a credentials lookup. */
 	request->wanted_credentials_scheme = NULL;
+	auth_request_passdb_verify_plain(request, password);
+}
 
-	if (passdb->passdb->iface.verify_plain == NULL) {
-		/* we're deinitializing and just want to get rid of this
-		   request */
-		auth_request_verify_plain_callback(
-			PASSDB_RESULT_INTERNAL_FAILURE, request);
-	} else if (passdb->passdb->blocking) {
-		passdb_blocking_verify_plain(request);
-	} else if (passdb_template_export(passdb->default_fields_tmpl,
-					  request, &error) < 0) {
-		e_error(authdb_event(request),
-			"Failed to expand default_fields: %s", error);
-		auth_request_verify_plain_callback(
-			PASSDB_RESULT_INTERNAL_FAILURE, request);
-	} else {
-		passdb->passdb->iface.verify_plain(
-			request, password, auth_request_verify_plain_callback);
-	}
+static void
+auth_request_passdb_refresh_callback(enum passdb_result result,
+				     struct auth_request *request)
+{
+	e_debug(authdb_event(request),
+		"cache: Background refresh finished: %s",
+		passdb_result_to_string(result));
+	auth_request_unref(&request);
+}
+
+void auth_request_passdb_refresh_verify_plain(struct auth_request *request)
+{
+	struct auth_request *refresh;
+
+	/* Verify the password with a copy of the request. Its result is
+	   saved to the cache, but it doesn't affect the original request,
+	   which is already using the expired cache entry. */
+	refresh = auth_request_new_dummy(auth_event);
+	auth_request_import_request(refresh, request);
+	refresh->mech_password = p_strdup(refresh->pool, request->mech_password);
+	auth_request_init(refresh);
+	refresh->passdb = request->passdb;
+	refresh->passdb_cache_refresh = TRUE;
+	refresh->private_callback.verify_plain =
+		auth_request_passdb_refresh_callback;
+
+	e_debug(authdb_event(request),
+		"cache: Using expired entry while refreshing it");
+	auth_request_passdb_lookup_begin(refresh);
+	auth_request_set_state(refresh, AUTH_REQUEST_STATE_PASSDB);
+	auth_request_passdb_verify_plain(refresh, refresh->mech_password);
 }
 
 static void
@@ -236,6 +236,8 @@ struct auth_request {
 	bool final_resp_sent:1;
 
 	bool event_finished_sent:1;
+	/* This is a background refresh of an expired passdb cache entry */
+	bool passdb_cache_refresh:1;
 
 	/* ... mechanism specific data ... */
 };
@@ -273,6 +275,10 @@ bool auth_request_import_auth(struct auth_request *request,
 			      const char *key, const char *value);
 bool auth_request_import_master(struct auth_request *request,
 				const char *key, const char *value);
+/* Copy the request fields to dest, except for the passdb/userdb lookup
+   results. */
+void auth_request_import_request(struct auth_request *dest,
+				 struct auth_request *src);
 
 void auth_request_initial(struct auth_request *request);
 void auth_request_continue(struct auth_request *request,
@@ -388,6 +394,9 @@ void auth_request_userdb_callback(enum userdb_result result,
 				  struct auth_request *request);
 void auth_request_default_verify_plain_continue(
 	struct auth_request *request, verify_plain_callback_t *callback);
+/* Refresh the request's expired passdb cache entry in the background by
+   verifying the password again with a copy of the request. */
+void auth_request_passdb_refresh_verify_plain(struct auth_request *request);
 
 void auth_request_refresh_last_access(struct auth_request *request);
 void auth_str_append(string_t *dest, const char *key, const char *value);
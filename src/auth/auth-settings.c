@@ -228,7 +228,9 @@ static const struct setting_define auth_setting_defines[] = {
 	DEF(SIZE, cache_size),
 	DEF(TIME, cache_ttl),
 	DEF(TIME, cache_negative_ttl),
+	DEF(TIME, cache_stale_ttl),
 	DEF(BOOL, cache_verify_password_with_worker),
+	DEF(BOOL, cache_persist),
 	DEF(STR, username_chars),
 	DEF(STR_HIDDEN, username_translation),
 	DEF(STR, username_format),
@@ -302,7 +304,9 @@ static const struct auth_settings auth_default_settings = {
 	.cache_size = 0,
 	.cache_ttl = 60*60,
 	.cache_negative_ttl = 60*60,
+	.cache_stale_ttl = 0,
 	.cache_verify_password_with_worker = FALSE,
+	.cache_persist = FALSE,
 	.username_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890.-_@",
 	.username_translation = "",
 	.username_format = "%Lu",
@@ -47,7 +47,9 @@ struct auth_settings {
 	uoff_t cache_size;
 	unsigned int cache_ttl;
 	unsigned int cache_negative_ttl;
+	unsigned int cache_stale_ttl;
 	bool cache_verify_password_with_worker;
+	bool cache_persist;
 	const char *username_chars;
 	const char *username_translation;
 	const char *username_format;
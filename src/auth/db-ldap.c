@@ -124,6 +124,7 @@ static struct setting_def setting_defs[] = {
 	DEF_STR(iterate_filter),
 	DEF_STR(default_pass_scheme),
 	DEF_BOOL(blocking),
+	DEF_INT(connections),
 
 	{ 0, NULL, 0 }
 };
@@ -159,7 +160,8 @@ static struct ldap_settings default_ldap_settings = {
 	.iterate_attrs = "uid=user",
 	.iterate_filter = "(objectClass=posixAccount)",
 	.default_pass_scheme = "crypt",
-	.blocking = FALSE
+	.blocking = FALSE,
+	.connections = 1
 };
 
 static struct ldap_connection *ldap_connections = NULL;
@@ -425,6 +427,7 @@ static bool db_ldap_request_queue_next(struct ldap_connection *conn)
 		/* success */
 		i_assert(request->msgid != -1);
 		request->send_count++;
+		request->send_time = ioloop_timeval;
 		conn->pending_count++;
 		return TRUE;
 	} else if (ret < 0) {
@@ -459,11 +462,36 @@ db_ldap_check_hanging(struct ldap_connection *conn)
 	}
 }
 
+static struct ldap_connection *
+db_ldap_pool_get_conn(struct ldap_connection *conn)
+{
+	struct ldap_connection *pool_conn, *best_conn = conn;
+	unsigned int count, best_count;
+
+	if (!array_is_created(&conn->pool_conns))
+		return conn;
+
+	/* use the connection with the fewest queued requests */
+	best_count = aqueue_count(conn->request_queue);
+	array_foreach_elem(&conn->pool_conns, pool_conn) {
+		if (best_count == 0)
+			break;
+		count = aqueue_count(pool_conn->request_queue);
+		if (count < best_count) {
+			best_conn = pool_conn;
+			best_count = count;
+		}
+	}
+	return best_conn;
+}
+
 void db_ldap_request(struct ldap_connection *conn,
 		     struct ldap_request *request)
 {
 	i_assert(request->auth_request != NULL);
 
+	conn = db_ldap_pool_get_conn(conn);
+
 	request->msgid = -1;
 	request->create_time = ioloop_time;
 
@@ -765,6 +793,33 @@ static int db_ldap_search_next_subsearch(struct ldap_connection *conn,
 	return 0;
 }
 
+static void
+db_ldap_request_finished(struct ldap_connection *conn,
+			 struct ldap_request *request)
+{
+	long long usecs = timeval_diff_usecs(&ioloop_timeval,
+					     &request->send_time);
+
+	if (usecs < 0)
+		usecs = 0;
+	conn->finished_count++;
+	conn->finished_usecs += usecs;
+
+	struct event_passthrough *e =
+		event_create_passthrough(conn->event)->
+		set_name("ldap_request_finished")->
+		add_int("latency_usecs", usecs)->
+		add_int("pending_count", conn->pending_count)->
+		add_int("queued_count", aqueue_count(conn->request_queue) -
+			conn->pending_count)->
+		add_int("avg_latency_usecs",
+			conn->finished_usecs / conn->finished_count);
+	e_debug(e->event(), "Request finished in %lld usecs "
+		"(%u pending, %"PRIu64" usecs average latency)",
+		usecs, conn->pending_count,
+		conn->finished_usecs / conn->finished_count);
+}
+
 static bool
 db_ldap_handle_request_result(struct ldap_connection *conn,
 			      struct ldap_request *request, unsigned int idx,
@@ -855,6 +910,7 @@ db_ldap_handle_request_result(struct ldap_connection *conn,
 	if (final_result) {
 		conn->pending_count--;
 		aqueue_delete(conn->request_queue, idx);
+		db_ldap_request_finished(conn, request);
 	}
 
 	T_BEGIN {
@@ -1304,6 +1360,8 @@ void db_ldap_connect_delayed(struct ldap_connection *conn)
 
 void db_ldap_enable_input(struct ldap_connection *conn, bool enable)
 {
+	struct ldap_connection *pool_conn;
+
 	if (!enable) {
 		io_remove(&conn->io);
 	} else {
@@ -1311,6 +1369,12 @@ void db_ldap_enable_input(struct ldap_connection *conn, bool enable)
 			conn->io = io_add(conn->fd, IO_READ, ldap_input, conn);
 			ldap_input(conn);
 		}
+		/* the input may have been disabled for the pool connection
+		   where the request was actually sent */
+		if (array_is_created(&conn->pool_conns)) {
+			array_foreach_elem(&conn->pool_conns, pool_conn)
+				db_ldap_enable_input(pool_conn, TRUE);
+		}
 	}
 }
 
@@ -2011,6 +2075,39 @@ static struct ldap_connection *ldap_conn_find(const char *config_path)
 	return NULL;
 }
 
+static void db_ldap_pool_init(struct ldap_connection *conn)
+{
+	struct ldap_connection *pool_conn;
+	pool_t pool;
+
+	/* The settings and attribute maps are used from the first connection,
+	   which is freed only after the pool connections. The pool
+	   connections are connected only when requests are sent to them. */
+	event_add_int(conn->event, "ldap_connection", 0);
+	i_array_init(&conn->pool_conns, conn->set.connections - 1);
+	for (unsigned int i = 1; i < conn->set.connections; i++) {
+		pool = pool_alloconly_create("ldap_connection", 256);
+		pool_conn = p_new(pool, struct ldap_connection, 1);
+		pool_conn->pool = pool;
+		pool_conn->refcount = 1;
+		pool_conn->conn_state = LDAP_CONN_STATE_DISCONNECTED;
+		pool_conn->default_bind_msgid = -1;
+		pool_conn->fd = -1;
+		pool_conn->config_path = conn->config_path;
+		pool_conn->set = conn->set;
+
+		pool_conn->event = event_create(auth_event);
+		event_add_int(pool_conn->event, "ldap_connection", i);
+		event_set_append_log_prefix(pool_conn->event, t_strdup_printf(
+			"ldap(%s #%u): ", conn->config_path, i));
+
+		i_array_init(&pool_conn->request_array, 512);
+		pool_conn->request_queue =
+			aqueue_init(&pool_conn->request_array.arr);
+		array_push_back(&conn->pool_conns, &pool_conn);
+	}
+}
+
 struct ldap_connection *db_ldap_init(const char *config_path, bool userdb)
 {
 	struct ldap_connection *conn;
@@ -2087,6 +2184,9 @@ struct ldap_connection *db_ldap_init(const char *config_path, bool userdb)
 		env_put("LDAPRC", conn->set.ldaprc_path);
 	}
 
+	if (conn->set.connections == 0)
+		i_fatal("LDAP %s: connections must be at least 1", config_path);
+
         if (deref2str(conn->set.deref, &conn->set.ldap_deref) < 0)
 		i_fatal("LDAP %s: Unknown deref option '%s'", config_path, conn->set.deref);
 	if (scope2str(conn->set.scope, &conn->set.ldap_scope) < 0)
@@ -2103,9 +2203,25 @@ struct ldap_connection *db_ldap_init(const char *config_path, bool userdb)
         ldap_connections = conn;
 
 	db_ldap_init_ld(conn);
+	if (conn->set.connections > 1)
+		db_ldap_pool_init(conn);
 	return conn;
 }
 
+static void db_ldap_conn_free(struct ldap_connection *conn)
+{
+	db_ldap_abort_requests(conn, UINT_MAX, 0, FALSE, "Shutting down");
+	i_assert(conn->pending_count == 0);
+	db_ldap_conn_close(conn);
+	i_assert(conn->to == NULL);
+
+	array_free(&conn->request_array);
+	aqueue_deinit(&conn->request_queue);
+
+	event_unref(&conn->event);
+	pool_unref(&conn->pool);
+}
+
 void db_ldap_unref(struct ldap_connection **_conn)
 {
         struct ldap_connection *conn = *_conn;
@@ -2123,16 +2239,14 @@ void db_ldap_unref(struct ldap_connection **_conn)
 		}
 	}
 
-	db_ldap_abort_requests(conn, UINT_MAX, 0, FALSE, "Shutting down");
-	i_assert(conn->pending_count == 0);
-	db_ldap_conn_close(conn);
-	i_assert(conn->to == NULL);
+	if (array_is_created(&conn->pool_conns)) {
+		struct ldap_connection *pool_conn;
 
-	array_free(&conn->request_array);
-	aqueue_deinit(&conn->request_queue);
-
-	event_unref(&conn->event);
-	pool_unref(&conn->pool);
+		array_foreach_elem(&conn->pool_conns, pool_conn)
+			db_ldap_conn_free(pool_conn);
+		array_free(&conn->pool_conns);
+	}
+	db_ldap_conn_free(conn);
 }
 
 #ifndef BUILTIN_LDAP
@@ -67,6 +67,7 @@ struct ldap_settings {
 
 	const char *default_pass_scheme;
 	bool blocking;
+	unsigned int connections;
 
 	/* ... */
 	int ldap_deref, ldap_scope, ldap_tls_require_cert_parsed;
@@ -103,6 +104,8 @@ struct ldap_request {
 	int msgid;
 	/* timestamp when request was created */
 	time_t create_time;
+	/* timestamp when request was last sent to LDAP server */
+	struct timeval send_time;
 
 	/* Number of times this request has been sent to LDAP server. This
 	   increases when LDAP gets disconnected and reconnect send the request
@@ -183,6 +186,13 @@ struct ldap_connection {
 	/* Timestamp when we last received a reply */
 	time_t last_reply_stamp;
 
+	/* Additional connections using the same settings (connections
+	   setting). Only the first connection has these. Requests are
+	   dispatched to the connection with the fewest queued requests. */
+	ARRAY(struct ldap_connection *) pool_conns;
+	/* Number of finished requests and their total latency */
+	uint64_t finished_count, finished_usecs;
+
 	char **pass_attr_names, **user_attr_names, **iterate_attr_names;
 	ARRAY_TYPE(ldap_field) pass_attr_map, user_attr_map, iterate_attr_map;
 	bool userdb_used;
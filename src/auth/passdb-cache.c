@@ -3,14 +3,22 @@
 #include "auth-common.h"
 #include "str.h"
 #include "strescape.h"
+#include "hex-binary.h"
+#include "md5.h"
 #include "restrict-process-size.h"
+#include "master-service.h"
+#include "master-service-settings.h"
 #include "auth-worker-connection.h"
 #include "password-scheme.h"
 #include "passdb.h"
 #include "passdb-cache.h"
 #include "passdb-blocking.h"
+#include "userdb.h"
 
 struct auth_cache *passdb_cache = NULL;
+static char *passdb_cache_persist_path = NULL;
+/* passdbs and userdbs are already deinitialized when the cache is saved */
+static char *passdb_cache_persist_config_hash = NULL;
 
 static void
 passdb_cache_log_hit(struct auth_request *request, const char *value)
@@ -29,17 +37,23 @@ passdb_cache_log_hit(struct auth_request *request, const char *value)
 static bool
 passdb_cache_lookup(struct auth_request *request, const char *key,
 		    bool use_expired, struct auth_cache_node **node_r,
-		    const char **value_r, bool *neg_expired_r)
+		    const char **value_r, bool *neg_expired_r, bool *stale_r)
 {
 	const char *value;
 	bool expired;
 
 	request->passdb_cache_result = AUTH_REQUEST_CACHE_MISS;
+	if (stale_r != NULL)
+		*stale_r = FALSE;
 
 	/* value = password \t ... */
 	value = auth_cache_lookup(passdb_cache, request, key, node_r,
 				  &expired, neg_expired_r);
-	if (value == NULL || (expired && !use_expired)) {
+	if (value != NULL && expired && !use_expired && stale_r != NULL &&
+	    auth_cache_node_use_stale(passdb_cache, *node_r)) {
+		/* use the expired entry while it's being refreshed */
+		*stale_r = TRUE;
+	} else if (value == NULL || (expired && !use_expired)) {
 		e_debug(authdb_event(request),
 			value == NULL ? "cache miss" :
 			"cache expired");
@@ -52,22 +66,55 @@ passdb_cache_lookup(struct auth_request *request, const char *key,
 	return TRUE;
 }
 
+struct passdb_cache_verify_context {
+	struct auth_request *request;
+	/* the cache entry is expired and should be refreshed after a
+	   successful verification */
+	bool stale;
+};
+
 static bool
 passdb_cache_verify_plain_callback(struct auth_worker_connection *conn ATTR_UNUSED,
 				   const char *const *args,
 				   void *context)
 {
-	struct auth_request *request = context;
+	struct passdb_cache_verify_context *ctx = context;
+	struct auth_request *request = ctx->request;
 	enum passdb_result result;
 
 	result = passdb_blocking_auth_worker_reply_parse(request, args);
-	if (result != PASSDB_RESULT_OK)
+	if (result != PASSDB_RESULT_OK) {
 		auth_fields_rollback(request->fields.extra_fields);
+		if (ctx->stale) {
+			/* allow the next successful login to refresh it */
+			auth_cache_refresh_finished(passdb_cache, request,
+						    request->passdb->cache_key);
+		}
+	} else if (ctx->stale) {
+		auth_request_passdb_refresh_verify_plain(request);
+	}
 	auth_request_verify_plain_callback_finish(result, request);
 	auth_request_unref(&request);
 	return TRUE;
 }
 
+static bool
+passdb_cache_verify_with_worker(struct auth_request *request,
+				const char *cached_pw)
+{
+	const char *scheme;
+
+	if (!request->set->cache_verify_password_with_worker)
+		return FALSE;
+
+	/* Verifying cheap schemes is faster here than the roundtrip to the
+	   worker. Slow schemes always go to the workers, even when they are
+	   backlogged: verifying them here would block all the other requests
+	   in this process. */
+	scheme = password_get_scheme(&cached_pw);
+	return scheme != NULL && password_scheme_is_slow(scheme);
+}
+
 bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 			       const char *password,
 			       enum passdb_result *result_r, bool use_expired)
@@ -75,13 +122,13 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 	const char *value, *cached_pw, *scheme, *const *list;
 	struct auth_cache_node *node;
 	enum passdb_result ret;
-	bool neg_expired;
+	bool neg_expired, stale;
 
 	if (passdb_cache == NULL || key == NULL)
 		return FALSE;
 
 	if (!passdb_cache_lookup(request, key, use_expired,
-				 &node, &value, &neg_expired))
+				 &node, &value, &neg_expired, &stale))
 		return FALSE;
 
 	if (*value == '\0') {
@@ -100,7 +147,8 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 		e_info(authdb_event(request),
 		       "Cached NULL password access");
 		ret = PASSDB_RESULT_OK;
-	} else if (request->set->cache_verify_password_with_worker) {
+	} else if (passdb_cache_verify_with_worker(request, cached_pw)) {
+		struct passdb_cache_verify_context *ctx;
 		string_t *str;
 
 		str = t_str_new(128);
@@ -118,8 +166,11 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 		   If verification fails, roll back fields. */
 		auth_request_set_fields(request, list + 1, NULL);
 		auth_fields_snapshot(request->fields.extra_fields);
+		ctx = p_new(request->pool, struct passdb_cache_verify_context, 1);
+		ctx->request = request;
+		ctx->stale = stale;
 		auth_worker_call(request->pool, request->fields.user, str_c(str),
-				 passdb_cache_verify_plain_callback, request);
+				 passdb_cache_verify_plain_callback, ctx);
 		return TRUE;
 	} else {
 		scheme = password_get_scheme(&cached_pw);
@@ -136,14 +187,23 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 			   b) negative TTL reached, use it for password
 			   mismatches too. */
 			node->last_success = FALSE;
+			if (stale)
+				node->refreshing = FALSE;
 			return FALSE;
 		}
 	}
 	node->last_success = ret == PASSDB_RESULT_OK;
+	if (stale && ret != PASSDB_RESULT_OK) {
+		/* allow the next successful login to refresh it */
+		node->refreshing = FALSE;
+	}
 
 	/* save the extra_fields only after we know we're using the
 	   cached data */
 	auth_request_set_fields(request, list + 1, NULL);
+	/* the node can't be accessed anymore after this */
+	if (stale && ret == PASSDB_RESULT_OK)
+		auth_request_passdb_refresh_verify_plain(request);
 
 	*result_r = ret;
 
@@ -165,7 +225,7 @@ bool passdb_cache_lookup_credentials(struct auth_request *request,
 		return FALSE;
 
 	if (!passdb_cache_lookup(request, key, use_expired,
-				 &node, &value, &neg_expired))
+				 &node, &value, &neg_expired, NULL))
 		return FALSE;
 
 	if (*value == '\0') {
@@ -186,6 +246,20 @@ bool passdb_cache_lookup_credentials(struct auth_request *request,
 	return TRUE;
 }
 
+static const char *passdb_cache_config_hash(void)
+{
+	unsigned char passdb_md5[MD5_RESULTLEN];
+	unsigned char userdb_md5[MD5_RESULTLEN];
+	string_t *str = t_str_new(MD5_RESULTLEN*4 + 1);
+
+	passdbs_generate_md5(passdb_md5);
+	userdbs_generate_md5(userdb_md5);
+	binary_to_hex_append(str, passdb_md5, sizeof(passdb_md5));
+	str_append_c(str, '-');
+	binary_to_hex_append(str, userdb_md5, sizeof(userdb_md5));
+	return str_c(str);
+}
+
 void passdb_cache_init(const struct auth_settings *set)
 {
 	rlim_t limit;
@@ -202,10 +276,31 @@ void passdb_cache_init(const struct auth_settings *set)
 	}
 	passdb_cache = auth_cache_new(set->cache_size, set->cache_ttl,
 				      set->cache_negative_ttl);
+	auth_cache_set_stale_secs(passdb_cache, set->cache_stale_ttl);
+
+	if (set->cache_persist) {
+		/* keep the cache warm over auth process restarts, e.g.
+		   doveadm reload */
+		const struct master_service_settings *service_set =
+			master_service_get_service_settings(master_service);
+
+		passdb_cache_persist_path = i_strdup(
+			auth_cache_persist_path(service_set->state_dir));
+		passdb_cache_persist_config_hash =
+			i_strdup(passdb_cache_config_hash());
+		(void)auth_cache_load(passdb_cache, passdb_cache_persist_path,
+				      passdb_cache_persist_config_hash);
+	}
 }
 
 void passdb_cache_deinit(void)
 {
+	if (passdb_cache_persist_path != NULL) {
+		(void)auth_cache_save(passdb_cache, passdb_cache_persist_path,
+				      passdb_cache_persist_config_hash);
+		i_free(passdb_cache_persist_path);
+		i_free(passdb_cache_persist_config_hash);
+	}
 	if (passdb_cache != NULL)
 		auth_cache_free(&passdb_cache);
 }
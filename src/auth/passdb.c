@@ -2,8 +2,12 @@
 
 #include "auth-common.h"
 #include "array.h"
+#include "hex-binary.h"
+#include "sha2.h"
 #include "password-scheme.h"
+#include "auth-cache.h"
 #include "auth-worker-connection.h"
+#include "passdb-cache.h"
 #include "passdb.h"
 
 static ARRAY(struct passdb_module_interface *) passdb_interfaces;
@@ -54,6 +58,78 @@ void passdb_unregister_module(struct passdb_module_interface *iface)
 	i_panic("passdb_unregister_module(%s): Not registered", iface->name);
 }
 
+static const char *
+passdb_generated_credentials_hash(const char *plaintext,
+				  const unsigned char *credentials, size_t size)
+{
+	struct sha256_ctx ctx;
+	unsigned char digest[SHA256_RESULTLEN];
+
+	sha256_init(&ctx);
+	sha256_loop(&ctx, credentials, size);
+	sha256_loop(&ctx, "", 1);
+	sha256_loop(&ctx, plaintext, strlen(plaintext));
+	sha256_result(&ctx, digest);
+	return binary_to_hex(digest, sizeof(digest));
+}
+
+static bool
+passdb_generate_credentials(struct auth_request *auth_request,
+			    const char *plaintext,
+			    const struct password_generate_params *params,
+			    const char *wanted_scheme,
+			    const unsigned char **credentials_r,
+			    size_t *size_r)
+{
+	const char *cache_key = NULL, *value, *p, *hash;
+
+	/* Generating slow schemes (e.g. SCRAM) from the plaintext password
+	   takes as long as verifying them. The result is salted, so it can't
+	   be recreated later, but it stays valid as long as the password
+	   doesn't change. Cache the generated credentials together with a
+	   hash binding them to the plaintext password. */
+	if (passdb_cache != NULL && auth_request->passdb != NULL &&
+	    auth_request->passdb->cache_key != NULL &&
+	    password_scheme_is_slow(wanted_scheme)) {
+		cache_key = t_strconcat(auth_request->passdb->cache_key,
+					"\t", t_str_ucase(wanted_scheme), NULL);
+		value = auth_cache_lookup_derived(passdb_cache, auth_request,
+						  cache_key);
+		if (value != NULL && (p = strchr(value, '\t')) != NULL) {
+			hash = passdb_generated_credentials_hash(plaintext,
+				(const unsigned char *)p + 1, strlen(p + 1));
+			if (strlen(hash) == (size_t)(p - value) &&
+			    mem_equals_timing_safe(hash, value, p - value)) {
+				e_debug(authdb_event(auth_request),
+					"cache hit: Using cached %s credentials",
+					wanted_scheme);
+				*credentials_r = (const unsigned char *)
+					t_strdup(p + 1);
+				*size_r = strlen(p + 1);
+				return TRUE;
+			}
+		}
+	}
+
+	if (!password_generate(plaintext, params, wanted_scheme,
+			       credentials_r, size_r))
+		return FALSE;
+
+	/* the credentials are saved as a tab-separated string */
+	if (cache_key != NULL &&
+	    memchr(*credentials_r, '\t', *size_r) == NULL &&
+	    memchr(*credentials_r, '\0', *size_r) == NULL) {
+		hash = passdb_generated_credentials_hash(plaintext,
+							 *credentials_r,
+							 *size_r);
+		value = t_strdup_printf("%s\t%s", hash,
+			t_strndup(*credentials_r, *size_r));
+		auth_cache_insert(passdb_cache, auth_request, cache_key,
+				  value, TRUE);
+	}
+	return TRUE;
+}
+
 bool passdb_get_credentials(struct auth_request *auth_request,
 			    const char *input, const char *input_scheme,
 			    const unsigned char **credentials_r, size_t *size_r)
@@ -121,8 +197,9 @@ bool passdb_get_credentials(struct auth_request *auth_request,
 				"Generating %s from user '%s', password '%s'",
 				wanted_scheme, pwd_gen_params.user, plaintext);
 		}
-		if (!password_generate(plaintext, &pwd_gen_params,
-				       wanted_scheme, credentials_r, size_r)) {
+		if (!passdb_generate_credentials(auth_request, plaintext,
+						 &pwd_gen_params, wanted_scheme,
+						 credentials_r, size_r)) {
 			e_error(authdb_event(auth_request),
 				"Requested unknown scheme %s", wanted_scheme);
 			return FALSE;
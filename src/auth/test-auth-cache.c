@@ -2,6 +2,9 @@
 
 #include "lib.h"
 #include "str.h"
+#include "istream.h"
+#include "ostream.h"
+#include "unlink-directory.h"
 #include "auth-request.h"
 #include "auth-cache.h"
 #include "test-common.h"
@@ -23,20 +26,26 @@ struct event *auth_event;
 
 struct var_expand_table *
 auth_request_get_var_expand_table_full(const struct auth_request *auth_request ATTR_UNUSED,
-				       const char *username ATTR_UNUSED,
+				       const char *username,
 				       auth_request_escape_func_t *escape_func ATTR_UNUSED,
 				       unsigned int *count ATTR_UNUSED)
 {
-	i_unreached();
+	struct var_expand_table *table = t_new(struct var_expand_table, 3);
+
+	table[0].key = '!';
+	table[0].value = "1";
+	table[1].key = 'u';
+	table[1].value = username;
+	return table;
 }
 
 int auth_request_var_expand_with_table(string_t *dest, const char *str,
 				       const struct auth_request *auth_request ATTR_UNUSED,
-				       const struct var_expand_table *table ATTR_UNUSED,
+				       const struct var_expand_table *table,
 				       auth_request_escape_func_t *escape_func ATTR_UNUSED,
-				       const char **error_r ATTR_UNUSED)
+				       const char **error_r)
 {
-	return var_expand(dest, str, auth_request_var_expand_static_tab, error_r);
+	return var_expand(dest, str, table, error_r);
 }
 
 static void test_auth_cache_parse_key(void)
@@ -74,12 +83,224 @@ static void test_auth_cache_parse_key(void)
 	test_end();
 }
 
+#define TEST_CACHE_FILENAME ".test-auth-cache"
+
+static void test_auth_cache_write_file(const char *data)
+{
+	struct ostream *output =
+		o_stream_create_file(TEST_CACHE_FILENAME, 0, 0600, 0);
+	o_stream_nsend_str(output, data);
+	test_assert(o_stream_finish(output) == 1);
+	o_stream_destroy(&output);
+}
+
+static void test_auth_cache_persist(void)
+{
+	struct auth_cache *cache;
+	struct istream *input;
+	const char *line;
+	long now = (long)time(NULL);
+
+	test_begin("auth cache persist");
+	test_auth_cache_write_file(t_strdup_printf(
+		"AUTH-CACHE\t1\tconfighash\n"
+		"%ld\t0\tP1\\tnegative\t\n"
+		"%ld\t1\tP1\\tuser1\t{PLAIN}pw1\\tfoo=bar\n"
+		"%ld\t1\tP1\\texpired\t{PLAIN}pw2\n"
+		"%ld\t0\tP1\\tuser2\t{PLAIN}pw3\n",
+		now - 10, now - 20, now - 7200, now));
+	cache = auth_cache_new(1024*1024, 3600, 60);
+
+	/* different configuration */
+	test_assert(auth_cache_load(cache, TEST_CACHE_FILENAME, "other") == 0);
+	/* the expired entry is skipped */
+	test_assert(auth_cache_load(cache, TEST_CACHE_FILENAME,
+				    "confighash") == 3);
+	test_assert(auth_cache_save(cache, TEST_CACHE_FILENAME,
+				    "confighash") == 0);
+	auth_cache_free(&cache);
+
+	/* the entries are saved in the same order */
+	input = i_stream_create_file(TEST_CACHE_FILENAME, SIZE_MAX);
+	test_assert_strcmp(i_stream_read_next_line(input),
+			   "AUTH-CACHE\t1\tconfighash");
+	line = i_stream_read_next_line(input);
+	test_assert_strcmp(line, t_strdup_printf("%ld\t0\tP1\\tnegative\t",
+						 now - 10));
+	line = i_stream_read_next_line(input);
+	test_assert_strcmp(line, t_strdup_printf(
+		"%ld\t1\tP1\\tuser1\t{PLAIN}pw1\\tfoo=bar", now - 20));
+	line = i_stream_read_next_line(input);
+	test_assert_strcmp(line, t_strdup_printf(
+		"%ld\t0\tP1\\tuser2\t{PLAIN}pw3", now));
+	test_assert(i_stream_read_next_line(input) == NULL);
+	i_stream_destroy(&input);
+
+	/* corrupted file */
+	test_auth_cache_write_file("AUTH-CACHE\t1\tconfighash\nfoo\n");
+	cache = auth_cache_new(1024*1024, 3600, 60);
+	test_expect_error_string("Corrupted line 2");
+	test_assert(auth_cache_load(cache, TEST_CACHE_FILENAME,
+				    "confighash") == -1);
+	test_expect_no_more_errors();
+	auth_cache_free(&cache);
+
+	i_unlink(TEST_CACHE_FILENAME);
+	/* missing file isn't an error */
+	cache = auth_cache_new(1024*1024, 3600, 60);
+	test_assert(auth_cache_load(cache, TEST_CACHE_FILENAME,
+				    "confighash") == 0);
+	auth_cache_free(&cache);
+	test_end();
+}
+
+static void test_auth_cache_persist_state_dir(void)
+{
+	struct auth_cache *cache;
+	const char *state_dir = ".test-auth-state";
+	const char *auth_dir = t_strconcat(state_dir, "/auth", NULL);
+	const char *path, *error;
+	struct stat st;
+	long now = (long)time(NULL);
+
+	test_begin("auth cache persist to state_dir");
+	/* create the directories the same way master does */
+	(void)unlink_directory(state_dir, UNLINK_DIRECTORY_FLAG_RMDIR, &error);
+	if (mkdir(state_dir, 0755) < 0)
+		i_fatal("mkdir(%s) failed: %m", state_dir);
+	if (mkdir(auth_dir, 0700) < 0)
+		i_fatal("mkdir(%s) failed: %m", auth_dir);
+
+	path = auth_cache_persist_path(state_dir);
+	test_assert_strcmp(path, t_strconcat(auth_dir, "/auth-cache", NULL));
+
+	test_auth_cache_write_file(t_strdup_printf(
+		"AUTH-CACHE\t1\tconfighash\n"
+		"%ld\t1\tP1\\tuser1\t{PLAIN}pw1\n"
+		"%ld\t0\tP1\\tuser2\t{PLAIN}pw2\n", now - 10, now));
+	cache = auth_cache_new(1024*1024, 3600, 60);
+	test_assert(auth_cache_load(cache, TEST_CACHE_FILENAME,
+				    "confighash") == 2);
+	test_assert(auth_cache_save(cache, path, "confighash") == 0);
+	auth_cache_free(&cache);
+	i_unlink(TEST_CACHE_FILENAME);
+
+	/* the temporary file was renamed over the real one */
+	test_assert(stat(path, &st) == 0);
+	test_assert(stat(t_strconcat(path, ".tmp", NULL), &st) < 0 &&
+		    errno == ENOENT);
+
+	cache = auth_cache_new(1024*1024, 3600, 60);
+	test_assert(auth_cache_load(cache, path, "confighash") == 2);
+	/* saving again replaces the file */
+	test_assert(auth_cache_save(cache, path, "confighash") == 0);
+	auth_cache_free(&cache);
+
+	cache = auth_cache_new(1024*1024, 3600, 60);
+	test_assert(auth_cache_load(cache, path, "confighash") == 2);
+	auth_cache_free(&cache);
+
+	if (unlink_directory(state_dir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", state_dir, error);
+	test_end();
+}
+
+static void
+test_auth_cache_insert_aged(struct auth_cache *cache, const char *user,
+			    const char *value, bool last_success,
+			    unsigned int age_secs)
+{
+	struct auth_request request = {
+		.fields = { .translated_username = user },
+	};
+	struct auth_cache_node *node;
+	bool expired, neg_expired;
+
+	auth_cache_insert(cache, &request, "%u", value, last_success);
+	test_assert(auth_cache_lookup(cache, &request, "%u", &node,
+				      &expired, &neg_expired) != NULL);
+	node->created -= age_secs;
+}
+
+static void test_auth_cache_stale(void)
+{
+	struct auth_request user1 = {
+		.fields = { .translated_username = "user1" },
+	};
+	struct auth_request user2 = {
+		.fields = { .translated_username = "user2" },
+	};
+	struct auth_request user3 = {
+		.fields = { .translated_username = "user3" },
+	};
+	struct auth_request user4 = {
+		.fields = { .translated_username = "user4" },
+	};
+	struct auth_cache *cache;
+	struct auth_cache_node *node;
+	const char *value;
+	bool expired, neg_expired;
+
+	test_begin("auth cache stale");
+	cache = auth_cache_new(1024*1024, 50, 50);
+	auth_cache_set_stale_secs(cache, 900);
+	test_auth_cache_insert_aged(cache, "user1", "{PLAIN}pw1", TRUE, 100);
+	test_auth_cache_insert_aged(cache, "user2", "{PLAIN}pw2", FALSE, 100);
+	test_auth_cache_insert_aged(cache, "user3", "{PLAIN}pw3", TRUE, 1000);
+
+	/* expired entry is served stale and refreshed only once */
+	value = auth_cache_lookup(cache, &user1, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert_strcmp(value, "{PLAIN}pw1");
+	test_assert(expired);
+	test_assert(auth_cache_node_use_stale(cache, node));
+	test_assert(node->refreshing);
+	value = auth_cache_lookup(cache, &user1, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert(value != NULL && expired);
+	test_assert(!auth_cache_node_use_stale(cache, node));
+
+	/* failed refresh allows serving it stale and refreshing again */
+	auth_cache_refresh_finished(cache, &user1, "%u");
+	test_assert(!node->refreshing);
+	test_assert(auth_cache_node_use_stale(cache, node));
+
+	/* successful refresh replaces the node */
+	auth_cache_insert(cache, &user1, "%u", "{PLAIN}pw1new", TRUE);
+	auth_cache_refresh_finished(cache, &user1, "%u");
+	value = auth_cache_lookup(cache, &user1, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert_strcmp(value, "{PLAIN}pw1new");
+	test_assert(!expired);
+	test_assert(!node->refreshing);
+
+	/* last authentication failed */
+	value = auth_cache_lookup(cache, &user2, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert(value != NULL && expired);
+	test_assert(!auth_cache_node_use_stale(cache, node));
+
+	/* expired longer than stale_secs ago */
+	value = auth_cache_lookup(cache, &user3, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert(value != NULL && expired);
+	test_assert(!auth_cache_node_use_stale(cache, node));
+
+	/* the node was already removed from the cache */
+	auth_cache_refresh_finished(cache, &user4, "%u");
+	auth_cache_free(&cache);
+	test_end();
+}
+
 int main(void)
 {
 	lib_init();
 	auth_event = event_create(NULL);
 	static void (*const test_functions[])(void) = {
 		test_auth_cache_parse_key,
+		test_auth_cache_persist,
+		test_auth_cache_persist_state_dir,
+		test_auth_cache_stale,
 		NULL
 	};
 	int ret = test_run(test_functions);
@@ -69,6 +69,7 @@ struct dsync_cmd_context {
 	const char *virtual_all_box;
 	guid_128_t mailbox_guid;
 	const char *state_input, *rawlog_path;
+	const char *state_checkpoint_path;
 	ARRAY_TYPE(const_string) exclude_mailboxes;
 	ARRAY_TYPE(const_string) namespace_prefixes;
 	time_t sync_since_timestamp;
@@ -652,6 +653,41 @@ static void dsync_errors_finish(struct dsync_cmd_context *ctx)
 	i_close_fd(&ctx->fd_err);
 }
 
+static void
+cmd_dsync_state_checkpoint(const char *state, void *context)
+{
+	struct dsync_cmd_context *ctx = context;
+	struct event *event = ctx->ctx.cctx->event;
+	const char *temp_path;
+	int fd;
+
+	/* write to a temp file and rename, so an interrupted write can't
+	   corrupt the previous checkpoint */
+	temp_path = t_strconcat(ctx->state_checkpoint_path, ".tmp", NULL);
+	fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1) {
+		e_error(event, "open(%s) failed: %m", temp_path);
+		return;
+	}
+	if (write_full(fd, t_strconcat(state, "\n", NULL),
+		       strlen(state) + 1) < 0) {
+		e_error(event, "write(%s) failed: %m", temp_path);
+		i_close_fd(&fd);
+		i_unlink(temp_path);
+		return;
+	}
+	if (close(fd) < 0) {
+		e_error(event, "close(%s) failed: %m", temp_path);
+		i_unlink(temp_path);
+		return;
+	}
+	if (rename(temp_path, ctx->state_checkpoint_path) < 0) {
+		e_error(event, "rename(%s, %s) failed: %m",
+			temp_path, ctx->state_checkpoint_path);
+		i_unlink(temp_path);
+	}
+}
+
 static int
 cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 {
@@ -692,6 +728,12 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 	set.lock_timeout_secs = ctx->lock_timeout;
 	set.import_commit_msgs_interval = ctx->import_commit_msgs_interval;
 	set.state = ctx->state_input;
+	if (ctx->state_checkpoint_path != NULL) {
+		set.state_checkpoint_callback = cmd_dsync_state_checkpoint;
+		set.state_checkpoint_context = ctx;
+		set.state_checkpoint_interval_secs =
+			doveadm_settings->dsync_state_checkpoint_interval;
+	}
 	set.mailbox_alt_char = doveadm_settings->dsync_alt_char[0];
 	if (*doveadm_settings->dsync_hashed_headers == '\0') {
 		e_error(cctx->event, "dsync_hashed_headers must not be empty");
@@ -700,6 +742,17 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 	}
 	set.hashed_headers =
 		t_strsplit_spaces(doveadm_settings->dsync_hashed_headers, " ,");
+	if (*doveadm_settings->dsync_compression != '\0') {
+		const char *error;
+
+		if (!dsync_ibc_stream_compression_is_supported(
+				doveadm_settings->dsync_compression, &error)) {
+			e_error(cctx->event, "dsync_compression: %s", error);
+			ctx->ctx.exit_code = EX_USAGE;
+			return -1;
+		}
+		set.compression = doveadm_settings->dsync_compression;
+	}
 	if (array_count(&ctx->exclude_mailboxes) > 0) {
 		/* array is NULL-terminated in init() */
 		set.exclude_mailboxes = array_front(&ctx->exclude_mailboxes);
@@ -1174,6 +1227,8 @@ static void cmd_dsync_preinit(struct doveadm_mail_cmd_context *_ctx)
 	(void)doveadm_cmd_param_str(cctx, "rawlog", &ctx->rawlog_path);
 	ctx->reverse_backup = doveadm_cmd_param_flag(cctx, "reverse-sync");
 
+	(void)doveadm_cmd_param_str(cctx, "state-checkpoint",
+				    &ctx->state_checkpoint_path);
 	if (doveadm_cmd_param_str(cctx, "state", &ctx->state_input) &&
 	    *ctx->state_input != '\0' &&
 	    ctx->sync_type != DSYNC_BRAIN_SYNC_TYPE_FULL)
@@ -1346,6 +1401,7 @@ DOVEADM_CMD_PARAM('N', "all-namespaces", CMD_PARAM_BOOL, 0) \
 DOVEADM_CMD_PARAM('x', "exclude-mailbox", CMD_PARAM_ARRAY, 0) \
 DOVEADM_CMD_PARAM('a', "all-mailbox", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('s', "state", CMD_PARAM_STR, 0) \
+DOVEADM_CMD_PARAM('\0', "state-checkpoint", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('t', "sync-since-time", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('e', "sync-until-time", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('O', "sync-flags", CMD_PARAM_STR, 0) \
@@ -1358,7 +1414,8 @@ DOVEADM_CMD_PARAM('\0', "destination", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONA
 #define DSYNC_COMMON_USAGE \
 	"[-l <secs>] [-r <rawlog path>] " \
 	"[-m <mailbox>] [-g <mailbox guid>] [-n <namespace> | -N] " \
-	"[-x <exclude>] [-a <all mailbox>] [-s <state>] [-T <secs>] " \
+	"[-x <exclude>] [-a <all mailbox>] [-s <state>] " \
+	"[--state-checkpoint <path>] [-T <secs>] " \
 	"[-t <start date>] [-e <end date>] [-O <sync flag>] [-I <max size>] " \
 	"-d|<dest>"
 
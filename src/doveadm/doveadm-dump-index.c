@@ -468,6 +468,7 @@ static void dump_cache_hdr(struct mail_cache *cache)
 	hdr = cache->hdr;
 	printf("major version ........ = %u\n", hdr->major_version);
 	printf("minor version ........ = %u\n", hdr->minor_version);
+	printf("flags ................ = 0x%x\n", hdr->flags);
 	printf("indexid .............. = %u (%s)\n", hdr->indexid, unixdate2str(hdr->indexid));
 	printf("file_seq ............. = %u (%s) (%d purges)\n",
 	       hdr->file_seq, unixdate2str(hdr->file_seq),
@@ -584,6 +585,12 @@ static void dump_cache(struct mail_cache_view *cache_view, unsigned int seq)
 
 		str_truncate(str, 0);
 		str_printfa(str, "    - %s: ", field->name);
+		if (iter_field.compressed) {
+			str_printfa(str, "(compressed, %u bytes)", size);
+			fwrite(str_data(str), 1, str_len(str), stdout);
+			putchar('\n');
+			continue;
+		}
 		switch (field->type) {
 		case MAIL_CACHE_FIELD_FIXED_SIZE:
 			if (size == sizeof(uint32_t)) {
@@ -79,8 +79,10 @@ static const struct setting_define doveadm_setting_defines[] = {
 	DEF(STR, doveadm_api_key),
 	DEF(STR, dsync_features),
 	DEF(UINT, dsync_commit_msgs_interval),
+	DEF(TIME, dsync_state_checkpoint_interval),
 	DEF(STR, doveadm_http_rawlog_dir),
 	DEF(STR_HIDDEN, dsync_hashed_headers),
+	DEF(STR, dsync_compression),
 
 	{ .type = SET_STRLIST, .key = "plugin",
 	  .offset = offsetof(struct doveadm_settings, plugin_envs) },
@@ -107,7 +109,9 @@ const struct doveadm_settings doveadm_default_settings = {
 	.dsync_remote_cmd = "ssh -l%{login} %{host} doveadm dsync-server -u%u -U",
 	.dsync_features = "",
 	.dsync_hashed_headers = "Date Message-ID",
+	.dsync_compression = "",
 	.dsync_commit_msgs_interval = 100,
+	.dsync_state_checkpoint_interval = 60,
 	.doveadm_api_key = "",
 	.doveadm_http_rawlog_dir = "",
 
@@ -206,12 +206,13 @@ int who_parse_args(struct who_context *ctx, const char *alt_username_field,
 	return 0;
 }
 
-struct doveadm_who_iter *doveadm_who_iter_init(const char *anvil_path)
+struct doveadm_who_iter *
+doveadm_who_iter_init(const char *anvil_path, const char *username_mask)
 {
 #define ANVIL_HANDSHAKE "VERSION\tanvil-client\t2\t0\n\n"
-#define ANVIL_CMD ANVIL_HANDSHAKE"CONNECT-DUMP\n"
 	struct doveadm_who_iter *iter;
 	const char *line;
+	string_t *cmd;
 	int fd;
 	pool_t pool;
 
@@ -220,9 +221,20 @@ struct doveadm_who_iter *doveadm_who_iter_init(const char *anvil_path)
 	iter->pool = pool;
 	iter->line_pool = pool_alloconly_create("doveadm who line", 256);
 
+	/* Let anvil filter the sessions by username already. The lines are
+	   still filtered afterwards, since older anvil versions ignore the
+	   mask and return all sessions. */
+	cmd = t_str_new(128);
+	str_append(cmd, ANVIL_HANDSHAKE"CONNECT-DUMP");
+	if (username_mask != NULL) {
+		str_append_c(cmd, '\t');
+		str_append_tabescaped(cmd, username_mask);
+	}
+	str_append_c(cmd, '\n');
+
 	fd = doveadm_connect(anvil_path);
 	net_set_nonblock(fd, FALSE);
-	if (write(fd, ANVIL_CMD, strlen(ANVIL_CMD)) < 0) {
+	if (write(fd, str_data(cmd), str_len(cmd)) < 0) {
 		iter->error = p_strdup_printf(iter->pool,
 					      "write(%s) failed: %m", anvil_path);
 		i_close_fd(&fd);
@@ -389,6 +401,14 @@ static void who_print(struct who_context *ctx)
 	hash_table_iterate_deinit(&iter);
 }
 
+const char *who_filter_get_username_mask(const struct who_filter *filter)
+{
+	/* with passdb-field the mask is matched against the alt username */
+	if (filter->alt_username_field != NULL)
+		return NULL;
+	return filter->username;
+}
+
 bool who_line_filter_match(const struct who_line *line,
 			   const struct who_filter *filter)
 {
@@ -471,7 +491,9 @@ static void cmd_who(struct doveadm_cmd_context *cctx)
 	}
 
 	doveadm_print_init(DOVEADM_PRINT_TYPE_TABLE);
-	struct doveadm_who_iter *iter = doveadm_who_iter_init(ctx.anvil_path);
+	struct doveadm_who_iter *iter =
+		doveadm_who_iter_init(ctx.anvil_path,
+				      who_filter_get_username_mask(&ctx.filter));
 	struct who_line who_line;
 	if (!separate_connections) {
 		while (doveadm_who_iter_next(iter, &who_line))
@@ -44,7 +44,14 @@ int who_parse_args(struct who_context *ctx, const char *alt_username_field,
 bool who_line_filter_match(const struct who_line *line,
 			   const struct who_filter *filter);
 
-struct doveadm_who_iter *doveadm_who_iter_init(const char *anvil_path);
+/* Returns the username mask that anvil can use to filter the sessions, or
+   NULL if all sessions need to be returned. */
+const char *who_filter_get_username_mask(const struct who_filter *filter);
+
+/* Iterate sessions in anvil. If username_mask is non-NULL, anvil returns only
+   the sessions of users matching it. */
+struct doveadm_who_iter *
+doveadm_who_iter_init(const char *anvil_path, const char *username_mask);
 /* Returns TRUE if ok, FALSE if filter can never match anything. */
 bool doveadm_who_iter_init_filter(struct doveadm_who_iter *iter,
 				  struct who_filter *filter);
@@ -363,6 +363,8 @@ void dsync_brain_sync_mailbox_deinit(struct dsync_brain *brain)
 	i_assert(brain->box != NULL);
 
 	array_push_back(&brain->remote_mailbox_states, &brain->mailbox_state);
+	if (brain->master_brain)
+		dsync_brain_state_checkpoint(brain, FALSE);
 	if (brain->box_exporter != NULL) {
 		const char *errstr;
 
@@ -109,6 +109,11 @@ struct dsync_brain {
 
 	const char *const *hashed_headers;
 
+	dsync_brain_state_checkpoint_callback_t *state_checkpoint_callback;
+	void *state_checkpoint_context;
+	unsigned int state_checkpoint_interval_secs;
+	time_t last_state_checkpoint;
+
 	bool master_brain:1;
 	bool mail_requests:1;
 	bool backup_send:1;
@@ -161,5 +166,6 @@ bool dsync_brain_slave_recv_mailbox(struct dsync_brain *brain);
 int dsync_brain_sync_mailbox_open(struct dsync_brain *brain,
 				  const struct dsync_mailbox *remote_dsync_box);
 bool dsync_brain_sync_mails(struct dsync_brain *brain);
+void dsync_brain_state_checkpoint(struct dsync_brain *brain, bool force);
 
 #endif
@@ -4,6 +4,7 @@
 #include "array.h"
 #include "hash.h"
 #include "hostpid.h"
+#include "ioloop.h"
 #include "str.h"
 #include "file-create-locked.h"
 #include "process-title.h"
@@ -243,6 +244,11 @@ dsync_brain_master_init(struct mail_user *user, struct dsync_ibc *ibc,
 	brain->import_commit_msgs_interval = set->import_commit_msgs_interval;
 	brain->hashed_headers =
 		(const char*const*)p_strarray_dup(brain->pool, set->hashed_headers);
+	brain->state_checkpoint_callback = set->state_checkpoint_callback;
+	brain->state_checkpoint_context = set->state_checkpoint_context;
+	brain->state_checkpoint_interval_secs =
+		set->state_checkpoint_interval_secs;
+	brain->last_state_checkpoint = ioloop_time;
 	dsync_brain_set_flags(brain, flags);
 
 	if (set->virtual_all_box != NULL)
@@ -281,6 +287,7 @@ dsync_brain_master_init(struct mail_user *user, struct dsync_ibc *ibc,
 	ibc_set.hdr_hash_v2 = TRUE;
 	ibc_set.lock_timeout = set->lock_timeout_secs;
 	ibc_set.hashed_headers = set->hashed_headers;
+	ibc_set.compression = set->compression;
 	/* reverse the backup direction for the slave */
 	ibc_set.brain_flags = flags & ENUM_NEGATE(DSYNC_BRAIN_FLAG_BACKUP_SEND |
 						  DSYNC_BRAIN_FLAG_BACKUP_RECV);
@@ -669,6 +676,8 @@ static bool dsync_brain_finish(struct dsync_brain *brain)
 	if (require_full_resync)
 		brain->require_full_resync = TRUE;
 	brain->state = DSYNC_STATE_DONE;
+	/* the last checkpoint may have been skipped because of the interval */
+	dsync_brain_state_checkpoint(brain, TRUE);
 	return TRUE;
 }
 
@@ -822,6 +831,54 @@ void dsync_brain_get_state(struct dsync_brain *brain, string_t *output)
 	dsync_mailbox_states_export(brain->mailbox_states, output);
 }
 
+void dsync_brain_state_checkpoint(struct dsync_brain *brain, bool force)
+{
+	HASH_TABLE_TYPE(dsync_mailbox_state) states;
+	struct hash_iterate_context *iter;
+	struct dsync_mailbox_node *node;
+	struct dsync_mailbox_state *state;
+	uint8_t *guid;
+
+	if (brain->state_checkpoint_callback == NULL ||
+	    brain->failed || brain->require_full_resync)
+		return;
+	if (!force && ioloop_time - brain->last_state_checkpoint <
+	    (time_t)brain->state_checkpoint_interval_secs)
+		return;
+	brain->last_state_checkpoint = ioloop_time;
+
+	/* Same as dsync_brain_get_state(), but don't modify the states that
+	   the rest of this sync is still using. Mailboxes that haven't been
+	   synced yet keep their original state. */
+	T_BEGIN {
+		string_t *output = t_str_new(256);
+
+		hash_table_create(&states, pool_datastack_create(), 0,
+				  guid_128_hash, guid_128_cmp);
+		iter = hash_table_iterate_init(brain->mailbox_states);
+		while (hash_table_iterate(iter, brain->mailbox_states,
+					  &guid, &state)) {
+			node = dsync_mailbox_tree_lookup_guid(
+				brain->local_mailbox_tree, guid);
+			if (node != NULL &&
+			    node->existence == DSYNC_MAILBOX_NODE_EXISTS)
+				hash_table_insert(states, guid, state);
+		}
+		hash_table_iterate_deinit(&iter);
+		array_foreach_modifiable(&brain->remote_mailbox_states, state) {
+			guid = state->mailbox_guid;
+			hash_table_update(states, guid, state);
+		}
+
+		dsync_mailbox_states_export(states, output);
+		hash_table_destroy(&states);
+		e_debug(brain->event, "Checkpointed %u mailbox states",
+			array_count(&brain->remote_mailbox_states));
+		brain->state_checkpoint_callback(str_c(output),
+			brain->state_checkpoint_context);
+	} T_END;
+}
+
 enum dsync_brain_sync_type dsync_brain_get_sync_type(struct dsync_brain *brain)
 {
 	return brain->sync_type;
@@ -54,6 +54,9 @@ enum dsync_brain_sync_type {
 	DSYNC_BRAIN_SYNC_TYPE_STATE
 };
 
+typedef void dsync_brain_state_checkpoint_callback_t(const char *state,
+						     void *context);
+
 struct dsync_brain_settings {
 	const char *process_title_prefix;
 	/* Sync only these namespaces */
@@ -83,6 +86,9 @@ struct dsync_brain_settings {
 	const char *sync_flag;
 	/* Headers to hash (defaults to Date, Message-ID) */
 	const char *const *hashed_headers;
+	/* If non-empty, compress the dsync stream with this algorithm if
+	   the remote supports it */
+	const char *compression;
 
 	/* If non-zero, use dsync lock file for this user */
 	unsigned int lock_timeout_secs;
@@ -91,6 +97,14 @@ struct dsync_brain_settings {
 	unsigned int import_commit_msgs_interval;
 	/* Input state for DSYNC_BRAIN_SYNC_TYPE_STATE */
 	const char *state;
+	/* If set, this is called with the current sync state string after
+	   a mailbox has been successfully synced, but at most once per
+	   state_checkpoint_interval_secs. It's also called once more with the
+	   final state when the sync finishes successfully. The state can be
+	   used to resume an interrupted sync. */
+	dsync_brain_state_checkpoint_callback_t *state_checkpoint_callback;
+	void *state_checkpoint_context;
+	unsigned int state_checkpoint_interval_secs;
 };
 
 #define DSYNC_LIST_CONTEXT(obj) \
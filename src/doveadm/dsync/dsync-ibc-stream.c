@@ -11,6 +11,7 @@
 #include "str.h"
 #include "strescape.h"
 #include "master-service.h"
+#include "compression.h"
 #include "mail-cache.h"
 #include "mail-storage-private.h"
 #include "dsync-serializer.h"
@@ -56,6 +57,8 @@ enum item_type {
 };
 
 #define END_OF_LIST_LINE "."
+/* "Z<algorithm>" line means that the rest of the stream is compressed */
+#define COMPRESS_CHR 'Z'
 static const struct {
 	/* full human readable name of the item */
 	const char *name;
@@ -79,7 +82,7 @@ static const struct {
 	  	"no_mail_sync no_backup_overwrite purge_remote "
 		"no_notify sync_since_timestamp sync_max_size sync_flags sync_until_timestamp "
 		"virtual_all_box empty_hdr_workaround "
-		"hashed_headers alt_char"
+		"hashed_headers alt_char compression"
 	},
 	{ .name = "mailbox_state",
 	  .chr = 'S',
@@ -163,12 +166,16 @@ struct dsync_ibc_stream {
 	struct dsync_mailbox_attribute *cur_attr;
 	char value_output_last;
 
+	/* Compression used for output, NULL if not compressed */
+	const struct compression_handler *output_compress_handler;
+
 	enum item_type last_recv_item, last_sent_item;
 	bool last_recv_item_eol:1;
 	bool last_sent_item_eol:1;
 
 	bool version_received:1;
 	bool handshake_received:1;
+	bool input_compressed:1;
 	bool has_pending_data:1;
 	bool finish_received:1;
 	bool done_received:1;
@@ -312,6 +319,78 @@ static int dsync_ibc_stream_output(struct dsync_ibc_stream *ibc)
 	return ret;
 }
 
+static bool
+dsync_ibc_stream_compression_lookup(const char *name,
+				    const struct compression_handler **handler_r,
+				    const char **error_r)
+{
+	int ret;
+
+	/* gz and bz2 streams can't be flushed without finishing them */
+	if (strcmp(name, "deflate") != 0 && strcmp(name, "zstd") != 0) {
+		*error_r = t_strdup_printf(
+			"Compression can't be used for streaming: %s", name);
+		return FALSE;
+	}
+	if ((ret = compression_lookup_handler(name, handler_r)) <= 0) {
+		*error_r = t_strdup_printf("%s: %s", ret == 0 ?
+			"Support not compiled in" : "Unknown compression", name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+bool dsync_ibc_stream_compression_is_supported(const char *name,
+					       const char **error_r)
+{
+	const struct compression_handler *handler;
+
+	return dsync_ibc_stream_compression_lookup(name, &handler, error_r);
+}
+
+static void
+dsync_ibc_stream_compress_output(struct dsync_ibc_stream *ibc,
+				 const struct compression_handler *handler)
+{
+	struct ostream *old_output = ibc->output;
+	bool corked = o_stream_is_corked(old_output);
+
+	i_assert(ibc->value_output == NULL);
+	i_assert(ibc->output_compress_handler == NULL);
+
+	/* tell the remote where the compression starts */
+	o_stream_nsend_str(old_output, t_strdup_printf("%c%s\n",
+			   COMPRESS_CHR, handler->name));
+	if (corked)
+		o_stream_uncork(old_output);
+
+	ibc->output = handler->create_ostream(old_output,
+					      handler->get_default_level());
+	o_stream_unref(&old_output);
+	o_stream_set_no_error_handling(ibc->output, TRUE);
+	o_stream_set_flush_callback(ibc->output, dsync_ibc_stream_output, ibc);
+	if (corked)
+		o_stream_cork(ibc->output);
+	ibc->output_compress_handler = handler;
+}
+
+static void
+dsync_ibc_stream_decompress_input(struct dsync_ibc_stream *ibc,
+				  const struct compression_handler *handler)
+{
+	struct istream *old_input = ibc->input;
+
+	i_assert(ibc->value_input == NULL);
+
+	/* the rest of the already buffered input is compressed */
+	io_remove(&ibc->io);
+	ibc->input = handler->create_istream(old_input);
+	i_stream_unref(&old_input);
+	ibc->io = io_add_istream(ibc->input, dsync_ibc_stream_input, ibc);
+	io_set_pending(ibc->io);
+	ibc->input_compressed = TRUE;
+}
+
 static void dsync_ibc_stream_timeout(struct dsync_ibc_stream *ibc)
 {
 	i_error("dsync(%s): I/O has stalled, no activity for %u seconds (%s)",
@@ -456,6 +535,8 @@ dsync_ibc_input_error(struct dsync_ibc_stream *ibc,
 	}
 	va_end(args);
 
+	/* make the caller stop instead of waiting for more input */
+	ibc->ibc.failed = TRUE;
 	dsync_ibc_stream_stop(ibc);
 }
 
@@ -581,6 +662,35 @@ dsync_ibc_stream_handshake(struct dsync_ibc_stream *ibc, const char *line)
 	return FALSE;
 }
 
+/* Returns 1 if line was the compression marker, 0 if it wasn't, -1 if the
+   marker was invalid and the stream was stopped. */
+static int
+dsync_ibc_stream_compress_marker(struct dsync_ibc_stream *ibc, const char *line)
+{
+	const struct compression_handler *handler;
+	const char *error;
+
+	if (line[0] != COMPRESS_CHR)
+		return 0;
+
+	/* the remote only starts compressing if we asked for it or we've
+	   started compressing ourself. */
+	if (ibc->input_compressed) {
+		dsync_ibc_input_error(ibc, NULL,
+			"Remote started compression twice");
+		return -1;
+	}
+	if (!dsync_ibc_stream_compression_lookup(line + 1, &handler, &error)) {
+		dsync_ibc_input_error(ibc, NULL,
+			"Remote started compression: %s", error);
+		return -1;
+	}
+	dsync_ibc_stream_decompress_input(ibc, handler);
+	if (ibc->output_compress_handler == NULL)
+		dsync_ibc_stream_compress_output(ibc, handler);
+	return 1;
+}
+
 static enum dsync_ibc_recv_ret
 dsync_ibc_stream_input_next(struct dsync_ibc_stream *ibc, enum item_type item,
 			    struct dsync_deserializer_decoder **decoder_r)
@@ -588,6 +698,7 @@ dsync_ibc_stream_input_next(struct dsync_ibc_stream *ibc, enum item_type item,
 	enum item_type line_item = ITEM_NONE;
 	const char *line, *error;
 	unsigned int i;
+	int ret;
 
 	i_assert(ibc->value_input == NULL);
 
@@ -596,7 +707,11 @@ dsync_ibc_stream_input_next(struct dsync_ibc_stream *ibc, enum item_type item,
 	do {
 		if (dsync_ibc_stream_next_line(ibc, &line) <= 0)
 			return DSYNC_IBC_RECV_RET_TRYAGAIN;
-	} while (!dsync_ibc_stream_handshake(ibc, line));
+		if (!dsync_ibc_stream_handshake(ibc, line))
+			ret = 1;
+		else if ((ret = dsync_ibc_stream_compress_marker(ibc, line)) < 0)
+			return DSYNC_IBC_RECV_RET_TRYAGAIN;
+	} while (ret > 0);
 
 	ibc->last_recv_item = item;
 	ibc->last_recv_item_eol = FALSE;
@@ -748,6 +863,10 @@ dsync_ibc_stream_send_handshake(struct dsync_ibc *_ibc,
 		dsync_serializer_encode_add(encoder, "no_notify", "");
 	if ((set->brain_flags & DSYNC_BRAIN_FLAG_EMPTY_HDR_WORKAROUND) != 0)
 		dsync_serializer_encode_add(encoder, "empty_hdr_workaround", "");
+	if (set->compression != NULL && set->compression[0] != '\0') {
+		dsync_serializer_encode_add(encoder, "compression",
+					    set->compression);
+	}
 	/* this can be NULL in slave */
 	string_t *str2 = t_str_new(32);
 	if (set->hashed_headers != NULL) {
@@ -886,6 +1005,25 @@ dsync_ibc_stream_recv_handshake(struct dsync_ibc *_ibc,
 		set->hashed_headers = (const char*const*)p_strsplit_tabescaped(pool, value);
 	set->hdr_hash_v2 = ibc->minor_version >= DSYNC_PROTOCOL_MINOR_HAVE_HDR_HASH_V2;
 	set->hdr_hash_v3 = ibc->minor_version >= DSYNC_PROTOCOL_MINOR_HAVE_HDR_HASH_V3;
+	if (dsync_deserializer_decode_try(decoder, "compression", &value) &&
+	    value[0] != '\0') {
+		const struct compression_handler *handler;
+		const char *error;
+
+		/* Remote wants the stream to be compressed. It decompresses
+		   our output after the compression marker, and replies with
+		   its own marker to compress its output. Older versions
+		   ignore this field, so the stream stays uncompressed. */
+		if (!dsync_ibc_stream_compression_lookup(value, &handler,
+							 &error)) {
+			i_warning("dsync(%s): Remote requested compression, "
+				  "but not compressing: %s", ibc->name, error);
+		} else {
+			set->compression = p_strdup(pool, value);
+			if (ibc->output_compress_handler == NULL)
+				dsync_ibc_stream_compress_output(ibc, handler);
+		}
+	}
 
 	*set_r = set;
 	return DSYNC_IBC_RECV_RET_OK;
@@ -66,6 +66,9 @@ struct dsync_ibc_settings {
 	const char *sync_flags;
 	/* Hashed headers */
 	const char *const *hashed_headers;
+	/* If non-empty, ask the remote to compress the stream with this
+	   lib-compression algorithm. Ignored by the pipe IBC. */
+	const char *compression;
 
 	char alt_char;
 	enum dsync_brain_sync_type sync_type;
@@ -81,6 +84,11 @@ struct dsync_ibc *
 dsync_ibc_init_stream(struct istream *input, struct ostream *output,
 		      const char *name, const char *temp_path_prefix,
 		      unsigned int timeout_secs);
+/* Returns TRUE if the compression algorithm can be used for the stream IBC.
+   It must support flushing the output without finishing the stream. On
+   failure error_r is set. */
+bool dsync_ibc_stream_compression_is_supported(const char *name,
+					       const char **error_r);
 void dsync_ibc_deinit(struct dsync_ibc **ibc);
 
 /* I/O callback is called whenever new data is available. It's also called on
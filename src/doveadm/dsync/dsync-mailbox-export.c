@@ -536,7 +536,9 @@ dsync_mailbox_export_init(struct mailbox *box,
 
 	p_array_init(&exporter->requested_uids, pool, 16);
 	p_array_init(&exporter->search_uids, pool, 16);
-	hash_table_create(&exporter->export_guids, pool, 0, str_hash, strcmp);
+	hash_table_create_flags(&exporter->export_guids, pool, 0,
+				str_hash, strcmp,
+				HASH_TABLE_FLAG_OPEN_ADDRESSING);
 	p_array_init(&exporter->expunged_seqs, pool, 16);
 	p_array_init(&exporter->expunged_guids, pool, 16);
 
@@ -267,8 +267,11 @@ dsync_mailbox_import_init(struct mailbox *box,
 	if ((flags & DSYNC_MAILBOX_IMPORT_FLAG_NO_NOTIFY) != 0)
 		importer->transaction_flags |= MAILBOX_TRANSACTION_FLAG_NO_NOTIFY;
 
-	hash_table_create(&importer->import_guids, pool, 0, str_hash, strcmp);
-	hash_table_create_direct(&importer->import_uids, pool, 0);
+	hash_table_create_flags(&importer->import_guids, pool, 0,
+				str_hash, strcmp,
+				HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	hash_table_create_direct_flags(&importer->import_uids, pool, 0,
+				       HASH_TABLE_FLAG_OPEN_ADDRESSING);
 	i_array_init(&importer->maybe_expunge_uids, 16);
 	i_array_init(&importer->maybe_saves, 128);
 	i_array_init(&importer->newmails, 128);
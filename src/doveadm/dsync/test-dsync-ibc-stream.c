@@ -0,0 +1,225 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "buffer.h"
+#include "fd-util.h"
+#include "istream.h"
+#include "ostream.h"
+#include "write-full.h"
+#include "dsync-ibc.h"
+#include "test-common.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define TEST_IBC_TIMEOUT_SECS 10
+
+struct test_ibc {
+	struct istream *input;
+	struct ostream *output;
+	/* output is written here if fd_out is -1 */
+	buffer_t *output_buf;
+	struct dsync_ibc *ibc;
+};
+
+static void test_ibc_io(void *context ATTR_UNUSED)
+{
+	io_loop_stop(current_ioloop);
+}
+
+static void
+test_ibc_init(struct test_ibc *test, const char *name, int fd_in, int fd_out)
+{
+	i_zero(test);
+	test->input = i_stream_create_fd(fd_in, SIZE_MAX);
+	if (fd_out != -1)
+		test->output = o_stream_create_fd(fd_out, SIZE_MAX);
+	else {
+		test->output_buf = buffer_create_dynamic(default_pool, 1024);
+		test->output = o_stream_create_buffer(test->output_buf);
+	}
+	test->ibc = dsync_ibc_init_stream(test->input, test->output, name,
+					  ".test-dsync-ibc",
+					  TEST_IBC_TIMEOUT_SECS);
+	dsync_ibc_set_io_callback(test->ibc, test_ibc_io, NULL);
+}
+
+static void test_ibc_deinit(struct test_ibc *test)
+{
+	dsync_ibc_deinit(&test->ibc);
+	i_stream_destroy(&test->input);
+	o_stream_destroy(&test->output);
+	buffer_free(&test->output_buf);
+}
+
+static void
+test_ibc_send_handshake(struct test_ibc *test, const char *compression)
+{
+	struct dsync_ibc_settings set = {
+		.hostname = "localhost",
+		.compression = compression,
+	};
+
+	dsync_ibc_send_handshake(test->ibc, &set);
+}
+
+static enum dsync_ibc_recv_ret
+test_ibc_recv_handshake(struct test_ibc *test, const char **compression_r)
+{
+	const struct dsync_ibc_settings *set;
+	enum dsync_ibc_recv_ret ret;
+
+	while ((ret = dsync_ibc_recv_handshake(test->ibc, &set)) ==
+	       DSYNC_IBC_RECV_RET_TRYAGAIN && !dsync_ibc_has_failed(test->ibc))
+		io_loop_run(current_ioloop);
+	if (ret == DSYNC_IBC_RECV_RET_OK)
+		*compression_r = t_strdup(set->compression);
+	return ret;
+}
+
+static enum dsync_ibc_recv_ret
+test_ibc_recv_finish(struct test_ibc *test, const char **error_r)
+{
+	enum dsync_ibc_recv_ret ret;
+	enum mail_error mail_error;
+	bool require_full_resync;
+
+	*error_r = NULL;
+	while ((ret = dsync_ibc_recv_finish(test->ibc, error_r, &mail_error,
+					    &require_full_resync)) ==
+	       DSYNC_IBC_RECV_RET_TRYAGAIN && !dsync_ibc_has_failed(test->ibc))
+		io_loop_run(current_ioloop);
+	if (ret == DSYNC_IBC_RECV_RET_OK)
+		*error_r = t_strdup(*error_r);
+	return ret;
+}
+
+static void
+test_dsync_ibc_stream_sync(const char *compression,
+			   const char *expected_compression)
+{
+	struct test_ibc client, server;
+	const char *value;
+	int fd[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0)
+		i_fatal("socketpair() failed: %m");
+	fd_set_nonblock(fd[0], TRUE);
+	fd_set_nonblock(fd[1], TRUE);
+	test_ibc_init(&client, "client", fd[0], fd[0]);
+	test_ibc_init(&server, "server", fd[1], fd[1]);
+
+	/* only the requesting side asks for compression */
+	test_ibc_send_handshake(&client, compression);
+	test_ibc_send_handshake(&server, NULL);
+	test_assert(test_ibc_recv_handshake(&server, &value) ==
+		    DSYNC_IBC_RECV_RET_OK);
+	test_assert_strcmp(value, expected_compression);
+	test_assert(test_ibc_recv_handshake(&client, &value) ==
+		    DSYNC_IBC_RECV_RET_OK);
+
+	/* the server's reply is compressed, after which the client
+	   compresses its own output */
+	dsync_ibc_send_finish(server.ibc, "server", 0, FALSE);
+	test_assert(test_ibc_recv_finish(&client, &value) ==
+		    DSYNC_IBC_RECV_RET_OK);
+	test_assert_strcmp(value, "server");
+	dsync_ibc_send_finish(client.ibc, "client", 0, FALSE);
+	test_assert(test_ibc_recv_finish(&server, &value) ==
+		    DSYNC_IBC_RECV_RET_OK);
+	test_assert_strcmp(value, "client");
+	test_assert(!dsync_ibc_has_failed(client.ibc));
+	test_assert(!dsync_ibc_has_failed(server.ibc));
+
+	test_ibc_deinit(&client);
+	test_ibc_deinit(&server);
+	i_close_fd(&fd[0]);
+	i_close_fd(&fd[1]);
+}
+
+static void test_dsync_ibc_stream_uncompressed(void)
+{
+	test_begin("dsync ibc stream uncompressed");
+	test_dsync_ibc_stream_sync(NULL, NULL);
+	test_end();
+}
+
+static void test_dsync_ibc_stream_compressed(void)
+{
+	test_begin("dsync ibc stream compressed");
+	test_dsync_ibc_stream_sync("deflate", "deflate");
+	test_end();
+}
+
+static void test_dsync_ibc_stream_compression_unsupported(void)
+{
+	test_begin("dsync ibc stream compression unsupported by remote");
+	/* the remote doesn't compress, but the sync still works */
+	test_expect_error_string("Remote requested compression, "
+				 "but not compressing");
+	test_dsync_ibc_stream_sync("bz2", NULL);
+	test_expect_no_more_errors();
+	test_end();
+}
+
+static void test_dsync_ibc_stream_invalid_marker(void)
+{
+	struct test_ibc client, server;
+	const char *value;
+	int fd[2], client_fd[2];
+
+	test_begin("dsync ibc stream invalid compression marker");
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0)
+		i_fatal("socketpair() failed: %m");
+	if (pipe(client_fd) < 0)
+		i_fatal("pipe() failed: %m");
+	fd_set_nonblock(fd[1], TRUE);
+	fd_set_nonblock(client_fd[0], TRUE);
+	test_ibc_init(&server, "server", fd[1], fd[1]);
+
+	/* write the client's handshake followed by a marker with an
+	   unsupported algorithm */
+	test_ibc_init(&client, "client", client_fd[0], -1);
+	test_ibc_send_handshake(&client, NULL);
+	if (write_full(fd[0], client.output_buf->data,
+		       client.output_buf->used) < 0 ||
+	    write_full(fd[0], "Zbogus\n", 7) < 0)
+		i_fatal("write() failed: %m");
+
+	test_assert(test_ibc_recv_handshake(&server, &value) ==
+		    DSYNC_IBC_RECV_RET_OK);
+	test_expect_error_string("Remote started compression");
+	test_assert(test_ibc_recv_finish(&server, &value) ==
+		    DSYNC_IBC_RECV_RET_TRYAGAIN);
+	test_expect_no_more_errors();
+	test_assert(dsync_ibc_has_failed(server.ibc));
+
+	test_ibc_deinit(&client);
+	test_ibc_deinit(&server);
+	i_close_fd(&fd[0]);
+	i_close_fd(&fd[1]);
+	i_close_fd(&client_fd[0]);
+	i_close_fd(&client_fd[1]);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_dsync_ibc_stream_uncompressed,
+		test_dsync_ibc_stream_compressed,
+		test_dsync_ibc_stream_compression_unsupported,
+		test_dsync_ibc_stream_invalid_marker,
+		NULL
+	};
+	struct ioloop *ioloop;
+	int ret;
+
+	lib_init();
+	ioloop = io_loop_create();
+	ret = test_run(test_functions);
+	io_loop_destroy(&ioloop);
+	lib_deinit();
+	return ret;
+}
@@ -249,36 +249,34 @@ static void client_destroy(struct client *client)
 
 static int client_run_url(struct client *client)
 {
-	const unsigned char *data;
-	size_t size;
-	ssize_t ret = 0;
-
-	while (i_stream_read_more(client->msg_part_input, &data, &size) > 0) {
-		if (client->conn.output == NULL ||
-		    (ret = o_stream_send(client->conn.output, data, size)) < 0)
-			break;
-		i_stream_skip(client->msg_part_input, ret);
-
-		if (o_stream_get_buffer_used_size(client->conn.output) >= 4096) {
-			if ((ret = o_stream_flush(client->conn.output)) < 0)
-				break;
-			if (ret == 0)
-				return 0;
-		}
-	}
-
-	if (client->conn.output == NULL || client->conn. output->closed ||
-	    ret < 0) {
+	if (client->conn.output == NULL || client->conn.output->closed) {
 		imap_msgpart_url_free(&client->url);
 		return -1;
 	}
 
-	if (client->msg_part_input->eof) {
+	/* this allows using sendfile() when the part is a plain file range */
+	switch (o_stream_send_istream(client->conn.output,
+				      client->msg_part_input)) {
+	case OSTREAM_SEND_ISTREAM_RESULT_FINISHED:
 		o_stream_nsend(client->conn.output, "\n", 1);
 		imap_msgpart_url_free(&client->url);
 		return 1;
+	case OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT:
+	case OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT:
+		return 0;
+	case OSTREAM_SEND_ISTREAM_RESULT_ERROR_INPUT:
+		e_error(client->event, "read(%s) failed: %s",
+			i_stream_get_name(client->msg_part_input),
+			i_stream_get_error(client->msg_part_input));
+		break;
+	case OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT:
+		e_debug(client->event, "write(%s) failed: %s",
+			o_stream_get_name(client->conn.output),
+			o_stream_get_error(client->conn.output));
+		break;
 	}
-	return 0;
+	imap_msgpart_url_free(&client->url);
+	return -1;
 }
 
 static void ATTR_FORMAT(2, 3)
@@ -376,12 +376,14 @@ bool cmd_fetch(struct client_command_context *cmd)
 	}
 
 	cmd_fetch_set_reason_codes(cmd, ctx);
+	ctx->rate_limit = TRUE;
 	imap_fetch_begin(ctx, client->mailbox, search_args);
 	mail_search_args_unref(&search_args);
 
 	if (imap_fetch_more(ctx, cmd) == 0) {
 		/* unfinished */
-		cmd->state = CLIENT_COMMAND_STATE_WAIT_OUTPUT;
+		if (cmd->state != CLIENT_COMMAND_STATE_WAIT_EXTERNAL)
+			cmd->state = CLIENT_COMMAND_STATE_WAIT_OUTPUT;
 
 		cmd->func = cmd_fetch_continue;
 		cmd->context = ctx;
@@ -3,10 +3,14 @@
 #include "imap-common.h"
 #include "istream.h"
 #include "ostream.h"
+#include "buffer.h"
 #include "crc32.h"
+#include "time-util.h"
 #include "mail-storage-settings.h"
+#include "mailbox-watch.h"
 #include "imap-commands.h"
 #include "imap-keepalive.h"
+#include "imap-state.h"
 #include "imap-sync.h"
 
 struct cmd_idle_context {
@@ -16,12 +20,22 @@ struct cmd_idle_context {
 	struct imap_sync_context *sync_ctx;
 	struct timeout *keepalive_to, *to_hibernate;
 
+	/* imap_hibernate_in_process: The selected mailbox is freed and its
+	   state is kept here while waiting for changes in fd_notify. */
+	buffer_t *hibernate_state;
+	int fd_notify;
+	struct io *io_notify;
+	struct timeval hibernate_start_time;
+
 	bool manual_cork:1;
 	bool sync_pending:1;
 };
 
 static void idle_add_keepalive_timeout(struct cmd_idle_context *ctx);
+static void idle_add_hibernate_timeout(struct cmd_idle_context *ctx);
 static bool cmd_idle_continue(struct client_command_context *cmd);
+static bool
+idle_unhibernate_in_process(struct cmd_idle_context *ctx, const char *reason);
 
 static void
 idle_finish(struct cmd_idle_context *ctx, bool done_ok, bool free_cmd)
@@ -31,6 +45,18 @@ idle_finish(struct cmd_idle_context *ctx, bool done_ok, bool free_cmd)
 	timeout_remove(&ctx->keepalive_to);
 	timeout_remove(&ctx->to_hibernate);
 
+	if (ctx->hibernate_state != NULL) {
+		if (ctx->cmd->cancel || client->disconnected) {
+			io_remove(&ctx->io_notify);
+			i_close_fd(&ctx->fd_notify);
+			buffer_free(&ctx->hibernate_state);
+		} else {
+			/* the mailbox must be selected again after IDLE */
+			(void)idle_unhibernate_in_process(ctx, done_ok ?
+				"idle_done" : "idle_bad_reply");
+		}
+	}
+
 	if (ctx->sync_ctx != NULL) {
 		/* we're here only in connection failure cases */
 		(void)imap_sync_deinit(ctx->sync_ctx, ctx->cmd);
@@ -172,6 +198,108 @@ static void idle_add_keepalive_timeout(struct cmd_idle_context *ctx)
 	ctx->keepalive_to = timeout_add(interval, keepalive_timeout, ctx);
 }
 
+static bool
+idle_unhibernate_in_process(struct cmd_idle_context *ctx, const char *reason)
+{
+	struct client *client = ctx->client;
+	struct timeval end_time;
+	const char *error;
+	int ret;
+
+	i_assert(client->mailbox == NULL);
+
+	io_remove(&ctx->io_notify);
+	i_close_fd(&ctx->fd_notify);
+
+	/* This reopens the mailbox and sends the changes to the client */
+	ret = imap_state_import_mailbox_view(client,
+					     ctx->hibernate_state->data,
+					     ctx->hibernate_state->used,
+					     &error);
+	buffer_free(&ctx->hibernate_state);
+	i_gettimeofday(&end_time);
+
+	struct event_passthrough *e =
+		event_create_passthrough(client->event)->
+		set_name("imap_client_unhibernated")->
+		add_str("reason", reason)->
+		add_str("in_process", "yes")->
+		add_int("hibernation_usecs",
+			timeval_diff_usecs(&end_time,
+					   &ctx->hibernate_start_time))->
+		add_int("unhibernation_usecs",
+			timeval_diff_usecs(&end_time, &ioloop_timeval));
+	if (ret <= 0) {
+		e->add_str("error", error);
+		e_error(e->event(), "Couldn't unhibernate imap client: %s",
+			error);
+		client_disconnect_with_error(client,
+			"Failed to reopen the selected mailbox");
+		return FALSE;
+	}
+	e->add_str("mailbox", mailbox_get_vname(client->mailbox));
+	e_debug(e->event(), "Unhibernated in-process because of %s", reason);
+	mailbox_notify_changes(client->mailbox, idle_callback, ctx);
+	imap_refresh_proctitle();
+	return TRUE;
+}
+
+static void idle_notify_input(struct cmd_idle_context *ctx)
+{
+	struct client *client = ctx->client;
+
+	o_stream_cork(client->output);
+	if (idle_unhibernate_in_process(ctx, "mailbox_changes")) {
+		/* allow hibernating again */
+		i_assert(ctx->to_hibernate == NULL);
+		idle_add_hibernate_timeout(ctx);
+	}
+	o_stream_uncork(client->output);
+}
+
+static bool
+idle_hibernate_in_process(struct cmd_idle_context *ctx, const char **error_r)
+{
+	struct client *client = ctx->client;
+	struct mailbox *box = client->mailbox;
+	buffer_t *state;
+	int ret;
+
+	if (box == NULL) {
+		*error_r = "No mailbox selected";
+		return FALSE;
+	}
+
+	state = buffer_create_dynamic(default_pool, 256);
+	ret = imap_state_export_mailbox_view(client, state, error_r);
+	if (ret > 0) {
+		ctx->fd_notify = mailbox_watch_extract_notify_fd(box, error_r);
+		if (ctx->fd_notify == -1)
+			ret = 0;
+	}
+	if (ret <= 0) {
+		buffer_free(&state);
+		return FALSE;
+	}
+
+	e_debug(event_create_passthrough(client->event)->
+		set_name("imap_client_hibernated")->
+		add_str("mailbox", mailbox_get_vname(box))->
+		add_str("in_process", "yes")->event(),
+		"Hibernating in-process in mailbox %s", mailbox_get_vname(box));
+
+	mailbox_notify_changes_stop(box);
+	client->mailbox = NULL;
+	mailbox_free(&box);
+
+	ctx->hibernate_state = state;
+	ctx->hibernate_start_time = ioloop_timeval;
+	ctx->io_notify = io_add(ctx->fd_notify, IO_READ,
+				idle_notify_input, ctx);
+	imap_refresh_proctitle();
+	return TRUE;
+}
+
 static void idle_hibernate_timeout(struct cmd_idle_context *ctx)
 {
 	struct client *client = ctx->client;
@@ -180,7 +308,15 @@ static void idle_hibernate_timeout(struct cmd_idle_context *ctx)
 	i_assert(ctx->sync_ctx == NULL);
 	i_assert(!ctx->sync_pending);
 
-	if (imap_client_hibernate(&client, &reason)) {
+	if (client->set->imap_hibernate_in_process) {
+		/* either hibernated or failed - in both cases there's no need
+		   for the timeout anymore */
+		if (!idle_hibernate_in_process(ctx, &reason)) {
+			e_debug(client->event, "Couldn't hibernate imap client "
+				"in-process: %s", reason);
+		}
+		timeout_remove(&ctx->to_hibernate);
+	} else if (imap_client_hibernate(&client, &reason)) {
 		/* client may be destroyed now */
 	} else {
 		/* failed - don't bother retrying */
@@ -251,7 +387,7 @@ static bool cmd_idle_continue(struct client_command_context *cmd)
 		   so we return here instead of doing everything twice. */
 		return idle_sync_now(client->mailbox, ctx);
 	}
-	if (ctx->to_hibernate == NULL)
+	if (ctx->to_hibernate == NULL && ctx->hibernate_state == NULL)
 		idle_add_hibernate_timeout(ctx);
 	cmd->state = CLIENT_COMMAND_STATE_WAIT_INPUT;
 
@@ -282,6 +418,7 @@ bool cmd_idle(struct client_command_context *cmd)
 	ctx = p_new(cmd->pool, struct cmd_idle_context, 1);
 	ctx->cmd = cmd;
 	ctx->client = client;
+	ctx->fd_notify = -1;
 	idle_add_keepalive_timeout(ctx);
 	idle_add_hibernate_timeout(ctx);
 
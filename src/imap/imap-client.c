@@ -141,6 +141,8 @@ struct client *client_create(int fd_in, int fd_out,
 	client->command_pool =
 		pool_alloconly_create(MEMPOOL_GROWING"client command", 1024*2);
 	client->user = user;
+	/* sum up the mail transaction stats for imap_command_finished events */
+	user->trans_stats_enabled = TRUE;
 	client->notify_count_changes = TRUE;
 	client->notify_flag_changes = TRUE;
 	p_array_init(&client->enabled_features, client->pool, 8);
@@ -1026,6 +1028,15 @@ void client_command_free(struct client_command_context **_cmd)
 	event_add_int(cmd->event, "lock_wait_usecs", cmd->stats.lock_wait_usecs);
 	event_add_int(cmd->event, "net_in_bytes", cmd->stats.bytes_in);
 	event_add_int(cmd->event, "net_out_bytes", cmd->stats.bytes_out);
+	event_add_int_nonzero(cmd->event, "mail_open_lookups",
+			      cmd->stats.trans.open_lookup_count);
+	event_add_int_nonzero(cmd->event, "mail_stat_lookups",
+			      cmd->stats.trans.stat_lookup_count +
+			      cmd->stats.trans.fstat_lookup_count);
+	event_add_int_nonzero(cmd->event, "mail_cache_hits",
+			      cmd->stats.trans.cache_hit_count);
+	event_add_int_nonzero(cmd->event, "mail_cache_misses",
+			      cmd->stats.trans.cache_miss_count);
 
 	if (cmd->name != NULL) {
 		string_t *str = t_str_new(128);
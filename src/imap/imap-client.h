@@ -72,12 +72,16 @@ struct client_command_stats {
 	uint64_t lock_wait_usecs;
 	/* how many bytes of client input/output command has used */
 	uint64_t bytes_in, bytes_out;
+	/* mailbox transaction stats (cache lookups, files read, etc.) of the
+	   transactions finished while running this command */
+	struct mailbox_transaction_stats trans;
 };
 
 struct client_command_stats_start {
 	struct timeval timeval;
 	uint64_t lock_wait_usecs;
 	uint64_t bytes_in, bytes_out;
+	struct mailbox_transaction_stats trans;
 };
 
 struct client_command_context {
@@ -208,6 +212,10 @@ struct client {
 	/* For imap_logout_format statistics: */
 	unsigned int fetch_hdr_count, fetch_body_count;
 	uint64_t fetch_hdr_bytes, fetch_body_bytes;
+	/* imap_fetch_rate_limit token bucket. Tokens are bytes, and they go
+	   negative when a large mail is sent. */
+	struct timeval fetch_rate_limit_last_refill;
+	int64_t fetch_rate_limit_tokens;
 	unsigned int deleted_count, expunged_count, trashed_count;
 	unsigned int autoexpunged_count, append_count;
 
@@ -164,6 +164,27 @@ void command_stats_start(struct client_command_context *cmd)
 	cmd->stats_start.lock_wait_usecs = file_lock_wait_get_total_usecs();
 	cmd->stats_start.bytes_in = i_stream_get_absolute_offset(cmd->client->input);
 	cmd->stats_start.bytes_out = cmd->client->output->offset;
+	mailbox_transaction_get_total_stats(&cmd->stats_start.trans);
+}
+
+static void
+command_trans_stats_flush(struct mailbox_transaction_stats *stats,
+			  const struct mailbox_transaction_stats *start)
+{
+	struct mailbox_transaction_stats now;
+
+	mailbox_transaction_get_total_stats(&now);
+	stats->open_lookup_count +=
+		now.open_lookup_count - start->open_lookup_count;
+	stats->stat_lookup_count +=
+		now.stat_lookup_count - start->stat_lookup_count;
+	stats->fstat_lookup_count +=
+		now.fstat_lookup_count - start->fstat_lookup_count;
+	/* files_read_* aren't included. They're counted only when the mail
+	   streams are wrapped, which trans_stats_enabled doesn't do. */
+	stats->cache_hit_count += now.cache_hit_count - start->cache_hit_count;
+	stats->cache_miss_count +=
+		now.cache_miss_count - start->cache_miss_count;
 }
 
 void command_stats_flush(struct client_command_context *cmd)
@@ -178,6 +199,7 @@ void command_stats_flush(struct client_command_context *cmd)
 		cmd->stats_start.bytes_in;
 	cmd->stats.bytes_out += cmd->client->prev_output_size +
 		cmd->client->output->offset - cmd->stats_start.bytes_out;
+	command_trans_stats_flush(&cmd->stats.trans, &cmd->stats_start.trans);
 	/* allow flushing multiple times */
 	command_stats_start(cmd);
 }
@@ -6,6 +6,7 @@
 #include "istream.h"
 #include "ostream.h"
 #include "str.h"
+#include "time-util.h"
 #include "message-size.h"
 #include "imap-date.h"
 #include "imap-utf7.h"
@@ -486,6 +487,50 @@ static bool imap_fetch_cur_failed(struct imap_fetch_context *ctx)
 	return TRUE;
 }
 
+static bool imap_fetch_rate_limit_reached(struct imap_fetch_context *ctx)
+{
+	struct client *client = ctx->client;
+	uoff_t rate = client->set->imap_fetch_rate_limit;
+	uoff_t offset = client->output->offset;
+	double refill;
+
+	io_loop_time_refresh();
+	if (client->fetch_rate_limit_last_refill.tv_sec == 0)
+		client->fetch_rate_limit_tokens = rate;
+	else {
+		refill = timeval_diff_usecs(&ioloop_timeval,
+			&client->fetch_rate_limit_last_refill) *
+			(double)rate / 1000000;
+		if (refill > 0) {
+			client->fetch_rate_limit_tokens =
+				I_MIN((double)rate,
+				      client->fetch_rate_limit_tokens + refill);
+		}
+	}
+	client->fetch_rate_limit_last_refill = ioloop_timeval;
+
+	if (ctx->rate_limit_output_offset != 0 &&
+	    offset > ctx->rate_limit_output_offset) {
+		client->fetch_rate_limit_tokens -=
+			offset - ctx->rate_limit_output_offset;
+	}
+	ctx->rate_limit_output_offset = offset;
+
+	if (client->fetch_rate_limit_tokens >= 0)
+		return FALSE;
+	ctx->rate_limit_wait_msecs =
+		(-client->fetch_rate_limit_tokens * 1000 + rate - 1) / rate;
+	return TRUE;
+}
+
+static void imap_fetch_rate_limit_timeout(struct imap_fetch_context *ctx)
+{
+	timeout_remove(&ctx->to_rate_limit);
+	/* continue via client_output() */
+	ctx->rate_limit_cmd->state = CLIENT_COMMAND_STATE_WAIT_OUTPUT;
+	o_stream_set_flush_pending(ctx->client->output, TRUE);
+}
+
 static int imap_fetch_more_int(struct imap_fetch_context *ctx, bool cancel)
 {
 	struct imap_fetch_state *state = &ctx->state;
@@ -533,6 +578,11 @@ static int imap_fetch_more_int(struct imap_fetch_context *ctx, bool cancel)
 			if (cancel)
 				return 1;
 
+			if (ctx->rate_limit &&
+			    ctx->client->set->imap_fetch_rate_limit > 0 &&
+			    imap_fetch_rate_limit_reached(ctx))
+				return 0;
+
 			if (!mailbox_search_next(state->search_ctx,
 						 &state->cur_mail))
 				break;
@@ -614,9 +664,26 @@ int imap_fetch_more(struct imap_fetch_context *ctx,
 	i_assert(ctx->client->output_cmd_lock == NULL ||
 		 ctx->client->output_cmd_lock == cmd);
 
+	if (ctx->to_rate_limit != NULL) {
+		if (!cmd->cancel)
+			return 0;
+		timeout_remove(&ctx->to_rate_limit);
+	}
+
 	ret = imap_fetch_more_int(ctx, cmd->cancel);
 	if (ret < 0)
 		ctx->state.failed = TRUE;
+	if (ctx->rate_limit_wait_msecs > 0) {
+		/* imap_fetch_rate_limit reached - wait without blocking
+		   other commands or clients */
+		i_assert(ret == 0);
+		cmd->state = CLIENT_COMMAND_STATE_WAIT_EXTERNAL;
+		ctx->rate_limit_cmd = cmd;
+		ctx->to_rate_limit = timeout_add(ctx->rate_limit_wait_msecs,
+						 imap_fetch_rate_limit_timeout,
+						 ctx);
+		ctx->rate_limit_wait_msecs = 0;
+	}
 	if (ctx->state.line_partial) {
 		/* nothing can be sent until FETCH is finished */
 		ctx->client->output_cmd_lock = cmd;
@@ -663,6 +730,7 @@ int imap_fetch_end(struct imap_fetch_context *ctx)
 		}
 	}
 	ctx->client->output_cmd_lock = NULL;
+	timeout_remove(&ctx->to_rate_limit);
 
 	str_free(&state->cur_str);
 
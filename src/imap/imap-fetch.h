@@ -95,6 +95,13 @@ struct imap_fetch_context {
 	enum mail_error error;
 	const char *errstr;
 
+	/* imap_fetch_rate_limit state: client output offset when the tokens
+	   were last updated, and the timeout waiting for more tokens */
+	uoff_t rate_limit_output_offset;
+	unsigned int rate_limit_wait_msecs;
+	struct timeout *to_rate_limit;
+	struct client_command_context *rate_limit_cmd;
+
 	bool initialized:1;
 	bool failures:1;
 	bool flags_have_handler:1;
@@ -102,6 +109,8 @@ struct imap_fetch_context {
 	bool flags_show_only_seen_changes:1;
 	/* HEADER.FIELDS or HEADER.FIELDS.NOT is fetched */
 	bool fetch_header_fields:1;
+	/* Apply imap_fetch_rate_limit to this FETCH */
+	bool rate_limit:1;
 };
 
 void imap_fetch_handlers_register(const struct imap_fetch_handler *handlers,
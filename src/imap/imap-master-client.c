@@ -223,9 +223,11 @@ imap_master_client_input_args(struct connection *conn, const char *const *args,
 	enum client_create_flags create_flags = CLIENT_CREATE_FLAG_UNHIBERNATED;
 	struct mail_storage_service_input input;
 	struct imap_master_input master_input;
+	struct timeval start_time, end_time;
 	const char *error = NULL, *reason;
 	int ret;
 
+	i_gettimeofday(&start_time);
 	if (imap_master_client_parse_input(args, pool, &create_flags,
 					   &input, &master_input, &error) < 0) {
 		e_error(conn->event, "imap-master: Failed to parse client input: %s", error);
@@ -310,9 +312,16 @@ imap_master_client_input_args(struct connection *conn, const char *const *args,
 
 	struct event_reason *event_reason =
 		event_reason_begin("imap:unhibernate");
+	struct timeval import_start_time;
+	i_gettimeofday(&import_start_time);
 	ret = imap_state_import_internal(imap_client, master_input.state->data,
 					 master_input.state->used, &error);
 	event_reason_end(&event_reason);
+	i_gettimeofday(&end_time);
+	event_add_int(event, "state_import_usecs",
+		      timeval_diff_usecs(&end_time, &import_start_time));
+	event_add_int(event, "unhibernation_usecs",
+		      timeval_diff_usecs(&end_time, &start_time));
 
 	if (ret <= 0) {
 		error = t_strdup_printf("Failed to import client state: %s", error);
@@ -333,8 +342,10 @@ imap_master_client_input_args(struct connection *conn, const char *const *args,
 		imap_state_import_idle_cmd_tag(imap_client, master_input.tag);
 
 	e_debug(event, "imap-master: Unhibernated because %s "
-		"(hibernated for %llu.%06llu secs)", reason,
-		hibernation_usecs/1000000, hibernation_usecs%1000000);
+		"(hibernated for %llu.%06llu secs, unhibernation took "
+		"%lld usecs)", reason,
+		hibernation_usecs/1000000, hibernation_usecs%1000000,
+		timeval_diff_usecs(&end_time, &start_time));
 	event_unref(&event);
 
 	/* make sure all pending input gets handled */
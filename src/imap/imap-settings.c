@@ -68,9 +68,11 @@ static const struct setting_define imap_setting_defines[] = {
 	DEF(STR, imap_logout_format),
 	DEF(STR, imap_id_send),
 	DEF(ENUM, imap_fetch_failure),
+	DEF(SIZE, imap_fetch_rate_limit),
 	DEF(BOOL, imap_metadata),
 	DEF(BOOL, imap_literal_minus),
 	DEF(TIME, imap_hibernate_timeout),
+	DEF(BOOL, imap_hibernate_in_process),
 
 	DEF(STR, imap_urlauth_host),
 	DEF(IN_PORT, imap_urlauth_port),
@@ -95,6 +97,7 @@ static const struct imap_settings imap_default_settings = {
 		"body_count=%{fetch_body_count} body_bytes=%{fetch_body_bytes}",
 	.imap_id_send = "name *",
 	.imap_fetch_failure = "disconnect-immediately:disconnect-after:no-after",
+	.imap_fetch_rate_limit = 0,
 	.imap_metadata = FALSE,
 	.imap_literal_minus = FALSE,
 #ifdef DOVECOT_PRO_EDITION
@@ -102,6 +105,7 @@ static const struct imap_settings imap_default_settings = {
 #else
 	.imap_hibernate_timeout = 0,
 #endif
+	.imap_hibernate_in_process = FALSE,
 
 	.imap_urlauth_host = "",
 	.imap_urlauth_port = 143
@@ -32,9 +32,11 @@ struct imap_settings {
 	const char *imap_logout_format;
 	const char *imap_id_send;
 	const char *imap_fetch_failure;
+	uoff_t imap_fetch_rate_limit;
 	bool imap_metadata;
 	bool imap_literal_minus;
 	unsigned int imap_hibernate_timeout;
+	bool imap_hibernate_in_process;
 
 	/* imap urlauth: */
 	const char *imap_urlauth_host;
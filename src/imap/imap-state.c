@@ -143,41 +143,25 @@ int imap_state_import_external(struct client *client,
 	return imap_state_import(client, FALSE, data, size, error_r);
 }
 
-static int
+static void
 imap_state_export_mailbox_mails(buffer_t *dest, struct mailbox *box,
-				const char **error_r)
+				uint32_t messages_count)
 {
-	struct mailbox_transaction_context *trans;
-	struct mail_search_args *search_args;
-	struct mail_search_context *search_ctx;
-	struct mail *mail;
 	ARRAY_TYPE(seq_range) recent_uids;
-	uint32_t crc = 0;
-	int ret = 1;
-
-	search_args = mail_search_build_init();
-	mail_search_build_add_all(search_args);
-
-	trans = mailbox_transaction_begin(box, 0,
-				"unhibernate imap_state_export_mailbox_mails");
-	search_ctx = mailbox_search_init(trans, search_args, NULL, 0, NULL);
-	mail_search_args_unref(&search_args);
+	uint32_t seq, uid, crc = 0;
 
+	/* The UIDs are read directly from the index view. There's no need
+	   to go through mail search and mail objects for this. */
 	t_array_init(&recent_uids, 8);
-	while (mailbox_search_next(search_ctx, &mail)) {
-		crc = crc32_data_more(crc, &mail->uid, sizeof(mail->uid));
-		if ((mail_get_flags(mail) & MAIL_RECENT) != 0)
-			seq_range_array_add(&recent_uids, mail->uid);
-	}
-	if (mailbox_search_deinit(&search_ctx) < 0) {
-		*error_r = mailbox_get_last_internal_error(box, NULL);
-		ret = -1;
+	for (seq = 1; seq <= messages_count; seq++) {
+		mail_index_lookup_uid(box->view, seq, &uid);
+		crc = crc32_data_more(crc, &uid, sizeof(uid));
+		if (mailbox_recent_flags_have_uid(box, uid))
+			seq_range_array_add(&recent_uids, uid);
 	}
-	(void)mailbox_transaction_commit(&trans);
 
 	numpack_encode(dest, crc);
 	export_seq_range(dest, &recent_uids);
-	return ret;
 }
 
 static uint32_t
@@ -237,7 +221,8 @@ imap_state_export_mailbox(buffer_t *dest, struct client *client,
 	/* we're now basically done, but just in case there's a bug add a
 	   checksum of the currently existing UIDs and verify it when
 	   importing. this also writes the list of recent UIDs. */
-	return imap_state_export_mailbox_mails(dest, box, error_r);
+	imap_state_export_mailbox_mails(dest, box, status.messages);
+	return 1;
 }
 
 int imap_state_export_base(struct client *client, bool internal,
@@ -322,18 +307,13 @@ import_send_expunges(struct client *client,
 		     unsigned int *expunge_count_r,
 		     const char **error_r)
 {
-	struct mailbox_transaction_context *trans;
-	struct mail_search_args *search_args;
-	struct mail_search_context *search_ctx;
-	struct mail *mail;
-	uint32_t crc = 0, seq, expunged_uid;
+	uint32_t crc = 0, seq, expunged_uid, cur_seq, uid;
 	ARRAY_TYPE(seq_range) uids_filter, expunged_uids;
 	ARRAY_TYPE(uint32_t) expunged_seqs;
 	struct seq_range_iter iter;
 	const uint32_t *seqs;
 	unsigned int i, expunge_count, n = 0;
 	string_t *str;
-	int ret = 0;
 
 	*expunge_count_r = 0;
 
@@ -361,19 +341,12 @@ import_send_expunges(struct client *client,
 	}
 	seq_range_array_iter_init(&iter, &expunged_uids);
 
-	search_args = mail_search_build_init();
-	mail_search_build_add_all(search_args);
-
-	trans = mailbox_transaction_begin(client->mailbox, 0,
-					  "unhibernate import_send_expunges");
-	search_ctx = mailbox_search_init(trans, search_args, NULL, 0, NULL);
-	mail_search_args_unref(&search_args);
-
 	/* find sequence numbers for the expunged UIDs */
 	t_array_init(&expunged_seqs, array_count(&expunged_uids)+1); seq = 0;
-	while (mailbox_search_next(search_ctx, &mail)) {
+	for (cur_seq = 1; cur_seq <= client->messages_count; cur_seq++) {
+		mail_index_lookup_uid(client->mailbox->view, cur_seq, &uid);
 		while (seq_range_array_iter_nth(&iter, n, &expunged_uid) &&
-		       expunged_uid < mail->uid && seq < state->messages) {
+		       expunged_uid < uid && seq < state->messages) {
 			seq++; n++;
 			array_push_back(&expunged_seqs, &seq);
 			crc = crc32_data_more(crc, &expunged_uid,
@@ -381,7 +354,7 @@ import_send_expunges(struct client *client,
 		}
 		if (seq == state->messages)
 			break;
-		crc = crc32_data_more(crc, &mail->uid, sizeof(mail->uid));
+		crc = crc32_data_more(crc, &uid, sizeof(uid));
 		if (++seq == state->messages)
 			break;
 	}
@@ -393,18 +366,12 @@ import_send_expunges(struct client *client,
 				      sizeof(expunged_uid));
 	}
 
-	if (mailbox_search_deinit(&search_ctx) < 0) {
-		*error_r = mailbox_get_last_internal_error(client->mailbox, NULL);
-		ret = -1;
-	} else if (seq != state->messages) {
+	if (seq != state->messages) {
 		*error_r = t_strdup_printf("Message count mismatch after "
 					   "handling expunges (%u != %u)",
 					   seq, state->messages);
-		ret = -1;
-	}
-	(void)mailbox_transaction_commit(&trans);
-	if (ret < 0)
 		return -1;
+	}
 
 	seqs = array_get(&expunged_seqs, &expunge_count);
 	if (client->messages_count + expunge_count < state->messages) {
@@ -442,6 +409,7 @@ import_send_expunges(struct client *client,
 static int
 import_send_flag_changes(struct client *client,
 			 const struct mailbox_import_state *state,
+			 uint64_t highest_modseq,
 			 unsigned int *flag_change_count_r)
 {
 	struct imap_fetch_context *fetch_ctx;
@@ -453,6 +421,10 @@ import_send_flag_changes(struct client *client,
 	*flag_change_count_r = 0;
 	if (state->messages == 0)
 		return 0;
+	if (highest_modseq == state->highest_modseq) {
+		/* nothing has changed since hibernation */
+		return 0;
+	}
 
 	t_array_init(&old_uids, 1);
 	seq_range_array_add_range(&old_uids, 1, state->uidnext-1);
@@ -665,7 +637,8 @@ import_state_mailbox_open(struct client *client,
 	} else {
 		client_send_mailbox_flags(client, TRUE);
 	}
-	if (import_send_flag_changes(client, state, &flag_change_count) < 0) {
+	if (import_send_flag_changes(client, state, status.highest_modseq,
+				     &flag_change_count) < 0) {
 		*error_r = "Couldn't send flag changes";
 		return -1;
 	}
@@ -708,6 +681,46 @@ import_state_mailbox(struct client *client, const unsigned char *data,
 	return ret;
 }
 
+int imap_state_export_mailbox_view(struct client *client, buffer_t *dest,
+				   const char **error_r)
+{
+	i_assert(client->mailbox != NULL);
+
+	if (array_is_created(&client->search_updates) &&
+	    array_count(&client->search_updates) > 0) {
+		*error_r = "CONTEXT=SEARCH updates not supported currently";
+		return 0;
+	}
+	if (client->notify_ctx != NULL) {
+		*error_r = "NOTIFY not supported currently";
+		return 0;
+	}
+	return imap_state_export_mailbox(dest, client, client->mailbox,
+					 error_r);
+}
+
+int imap_state_import_mailbox_view(struct client *client,
+				   const unsigned char *data, size_t size,
+				   const char **error_r)
+{
+	ssize_t ret;
+
+	if (size == 0 || data[0] != IMAP_STATE_TYPE_MAILBOX) {
+		*error_r = "Not a mailbox state";
+		return 0;
+	}
+	ret = import_state_mailbox(client, data+1, size-1, error_r);
+	if (ret < 0)
+		return -1;
+	if (ret == 0)
+		return 0;
+	if ((size_t)ret != size-1) {
+		*error_r = "Trailing data after mailbox state";
+		return 0;
+	}
+	return 1;
+}
+
 static ssize_t
 import_state_compress(struct client *client, const unsigned char *data,
 		      size_t size, const char **error_r)
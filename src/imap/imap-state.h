@@ -16,6 +16,17 @@ int imap_state_import_external(struct client *client,
 			       const unsigned char *data, size_t size,
 			       const char **error_r);
 
+/* Export only the selected mailbox's view: its name, UIDs, modseq and
+   keywords. The mailbox can then be freed and later reopened with
+   imap_state_import_mailbox_view(), which sends the changes that happened in
+   the meantime to the client. Return values are the same as for
+   imap_state_export_internal() and imap_state_import_internal(). */
+int imap_state_export_mailbox_view(struct client *client, buffer_t *dest,
+				   const char **error_r);
+int imap_state_import_mailbox_view(struct client *client,
+				   const unsigned char *data, size_t size,
+				   const char **error_r);
+
 /* INTERNAL API: Note that the "internal" flag specifies whether we're doing
    the import/export from/to another Dovecot component or an untrusted
    IMAP client. */
@@ -353,6 +353,19 @@ static void main_stdio_run(const char *username)
 	/* client may be destroyed now */
 }
 
+static void client_prefetch_inbox(struct client *client)
+{
+	struct mail_namespace *ns;
+	struct mailbox *box;
+
+	/* Clients usually SELECT INBOX soon after login. Start reading its
+	   index files into memory while waiting for the command. */
+	ns = mail_namespace_find_inbox(client->user->namespaces);
+	box = mailbox_alloc(ns->list, "INBOX", 0);
+	mailbox_prefetch_index(box);
+	mailbox_free(&box);
+}
+
 static void
 login_request_finished(const struct login_server_request *request,
 		       const char *username, const char *const *extra_fields)
@@ -426,6 +439,7 @@ login_request_finished(const struct login_server_request *request,
 		return;
 	}
 
+	client_prefetch_inbox(client);
 	client_add_input_finalize(client);
 	/* client may be destroyed now */
 }
@@ -576,6 +590,8 @@ int main(int argc, char *argv[])
 	storage_service =
 		mail_storage_service_init(master_service,
 					  storage_service_flags);
+	if (!IS_STANDALONE())
+		mail_storage_service_preload_modules(storage_service);
 	master_service_init_finish(master_service);
 	/* NOTE: login_set.*_socket_path are now invalid due to data stack
 	   having been freed */
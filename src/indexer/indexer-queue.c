@@ -2,8 +2,10 @@
 
 #include "lib.h"
 #include "array.h"
+#include "ioloop.h"
 #include "llist.h"
 #include "hash.h"
+#include "time-util.h"
 #include "wildcard-match.h"
 #include "indexer-queue.h"
 
@@ -16,6 +18,8 @@ struct indexer_queue {
 	/* username -> indexer_request */
 	HASH_TABLE(char *, struct indexer_request *) users;
 	struct indexer_request *head, *tail;
+	/* queued requests in the order they were queued */
+	struct indexer_request *age_head, *age_tail;
 };
 
 struct indexer_queue_iter {
@@ -83,6 +87,29 @@ indexer_queue_lookup(struct indexer_queue *queue,
 	return hash_table_lookup(queue->requests, &lookup_request);
 }
 
+static void
+indexer_queue_age_add(struct indexer_queue *queue,
+		      struct indexer_request *request)
+{
+	i_assert(!request->in_age_list);
+
+	request->queued_time = ioloop_timeval;
+	DLLIST2_APPEND_FULL(&queue->age_head, &queue->age_tail, request,
+			    age_prev, age_next);
+	request->in_age_list = TRUE;
+}
+
+static void
+indexer_queue_age_remove(struct indexer_queue *queue,
+			 struct indexer_request *request)
+{
+	if (!request->in_age_list)
+		return;
+	DLLIST2_REMOVE_FULL(&queue->age_head, &queue->age_tail, request,
+			    age_prev, age_next);
+	request->in_age_list = FALSE;
+}
+
 static void request_add_context(struct indexer_request *request, void *context)
 {
 	if (context == NULL)
@@ -147,6 +174,7 @@ indexer_queue_append_request(struct indexer_queue *queue, bool append,
 		DLLIST2_APPEND(&queue->head, &queue->tail, request);
 	else
 		DLLIST2_PREPEND(&queue->head, &queue->tail, request);
+	indexer_queue_age_add(queue, request);
 	return request;
 }
 
@@ -185,6 +213,20 @@ void indexer_queue_append_optimize(struct indexer_queue *queue,
 
 struct indexer_request *indexer_queue_request_peek(struct indexer_queue *queue)
 {
+	struct indexer_request *request = queue->age_head;
+
+	if (request != NULL &&
+	    timeval_diff_msecs(&ioloop_timeval, &request->queued_time) >=
+	    INDEXER_QUEUE_MAX_WAIT_MSECS) {
+		/* the oldest request has waited too long behind higher
+		   priority requests. It's promoted only once, even if it
+		   already happens to be at the head. */
+		indexer_queue_age_remove(queue, request);
+		if (request != queue->head) {
+			DLLIST2_REMOVE(&queue->head, &queue->tail, request);
+			DLLIST2_PREPEND(&queue->head, &queue->tail, request);
+		}
+	}
 	return queue->head;
 }
 
@@ -195,6 +237,7 @@ void indexer_queue_request_remove(struct indexer_queue *queue)
 	i_assert(request != NULL);
 
 	DLLIST2_REMOVE(&queue->head, &queue->tail, request);
+	indexer_queue_age_remove(queue, request);
 }
 
 static void indexer_queue_request_status_int(struct indexer_queue *queue,
@@ -222,7 +265,13 @@ void indexer_queue_move_head_to_tail(struct indexer_queue *queue)
 {
 	struct indexer_request *request = queue->head;
 
-	indexer_queue_request_remove(queue);
+	i_assert(request != NULL);
+
+	/* The request has had its turn, so it must not be promoted back to
+	   the head for its age. Otherwise it would keep coming back while
+	   its user is busy and block the other users' requests. */
+	indexer_queue_age_remove(queue, request);
+	DLLIST2_REMOVE(&queue->head, &queue->tail, request);
 	DLLIST2_APPEND(&queue->head, &queue->tail, request);
 }
 
@@ -258,6 +307,7 @@ void indexer_queue_request_finish(struct indexer_queue *queue,
 			DLLIST2_PREPEND(&queue->head, &queue->tail, request);
 		else
 			DLLIST2_APPEND(&queue->head, &queue->tail, request);
+		indexer_queue_age_add(queue, request);
 		request->reindex_head = FALSE;
 		request->reindex_tail = FALSE;
 		return;
@@ -293,6 +343,7 @@ indexer_queue_request_cancel(struct indexer_queue *queue,
 	*_request = NULL;
 	request->reindex_head = request->reindex_tail = FALSE;
 	DLLIST2_REMOVE(&queue->head, &queue->tail, request);
+	indexer_queue_age_remove(queue, request);
 	indexer_queue_request_finish(queue, &request, INDEXER_STATE_FAILED);
 }
 
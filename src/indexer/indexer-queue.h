@@ -3,6 +3,8 @@
 
 #include "indexer.h"
 
+#define INDEXER_QUEUE_MAX_WAIT_MSECS (60*1000)
+
 typedef void
 indexer_queue_callback_t(const struct indexer_status *status, void *context);
 
@@ -18,6 +20,8 @@ struct indexer_request {
 	struct indexer_request *prev, *next;
 	/* Linked list of the same username's requests */
 	struct indexer_request *user_prev, *user_next;
+	/* Linked list of queued requests in the order they were queued */
+	struct indexer_request *age_prev, *age_next;
 
 	char *username;
 	char *mailbox;
@@ -25,6 +29,8 @@ struct indexer_request {
 	unsigned int max_recent_msgs;
 
 	enum indexer_request_type type;
+	/* When the request was added (back) to the queue */
+	struct timeval queued_time;
 
 	/* currently indexing this mailbox */
 	bool working:1;
@@ -33,6 +39,9 @@ struct indexer_request {
 	   working.) */
 	bool reindex_head:1;
 	bool reindex_tail:1;
+	/* request is in the age list, i.e. it hasn't yet been moved to the
+	   head of the queue for waiting too long */
+	bool in_age_list:1;
 
 	/* when working finished, call this number of contexts and leave the
 	   rest to the reindexing. */
@@ -65,7 +74,9 @@ void indexer_queue_cancel_all(struct indexer_queue *queue);
 bool indexer_queue_is_empty(struct indexer_queue *queue);
 unsigned int indexer_queue_count(struct indexer_queue *queue);
 
-/* Return the next request from the queue, without removing it. */
+/* Return the next request from the queue, without removing it. A request
+   that has waited longer than INDEXER_QUEUE_MAX_WAIT_MSECS is first moved to
+   the head of the queue, so prepended requests can't starve it forever. */
 struct indexer_request *indexer_queue_request_peek(struct indexer_queue *queue);
 /* Remove the next request from the queue. You must call
    indexer_queue_request_finish() to free its memory. */
@@ -4,6 +4,7 @@
 #include "buffer.h"
 #include "settings-parser.h"
 #include "service-settings.h"
+#include "indexer-settings.h"
 
 struct service_settings indexer_service_settings = {
 	.name = "indexer",
@@ -40,3 +41,43 @@ const struct setting_keyvalue indexer_service_settings_defaults[] = {
 
 	{ NULL, NULL }
 };
+
+#undef DEF
+#define DEF(type, name) \
+	SETTING_DEFINE_STRUCT_##type(#name, name, struct indexer_settings)
+
+static const struct setting_define indexer_setting_defines[] = {
+	DEF(UINT, indexer_max_workers_per_user),
+
+	SETTING_DEFINE_LIST_END
+};
+
+static const struct indexer_settings indexer_default_settings = {
+	.indexer_max_workers_per_user = 1,
+};
+
+/* <settings checks> */
+static bool
+indexer_settings_check(void *_set, pool_t pool ATTR_UNUSED,
+		       const char **error_r)
+{
+	struct indexer_settings *set = _set;
+
+	if (set->indexer_max_workers_per_user == 0) {
+		*error_r = "indexer_max_workers_per_user must not be 0";
+		return FALSE;
+	}
+	return TRUE;
+}
+/* </settings checks> */
+
+const struct setting_parser_info indexer_setting_parser_info = {
+	.name = "indexer",
+
+	.defines = indexer_setting_defines,
+	.defaults = &indexer_default_settings,
+
+	.struct_size = sizeof(struct indexer_settings),
+	.pool_offset1 = 1 + offsetof(struct indexer_settings, pool),
+	.check_func = indexer_settings_check,
+};
@@ -0,0 +1,13 @@
+#ifndef INDEXER_SETTINGS_H
+#define INDEXER_SETTINGS_H
+
+struct indexer_settings {
+	pool_t pool;
+	/* Maximum number of indexer-workers indexing different mailboxes of
+	   the same user at the same time. */
+	unsigned int indexer_max_workers_per_user;
+};
+
+extern const struct setting_parser_info indexer_setting_parser_info;
+
+#endif
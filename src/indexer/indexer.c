@@ -2,15 +2,23 @@
 
 #include "lib.h"
 #include "ioloop.h"
+#include "time-util.h"
 #include "restrict-access.h"
 #include "process-title.h"
 #include "master-service.h"
 #include "master-service-settings.h"
+#include "settings.h"
+#include "indexer-settings.h"
 #include "indexer-client.h"
 #include "indexer-queue.h"
 #include "worker-connection.h"
 
+static struct event_category event_category_indexer = {
+	.name = "indexer",
+};
+
 static const struct master_service_settings *set;
+static const struct indexer_settings *indexer_set;
 static struct indexer_queue *queue;
 
 static void worker_status_callback(const struct indexer_status *status,
@@ -47,20 +55,33 @@ static bool worker_send_request(struct indexer_request *request)
 		return FALSE;
 	indexer_queue_request_remove(queue);
 	indexer_queue_request_work(request);
+
+	long long wait_msecs =
+		timeval_diff_msecs(&ioloop_timeval, &request->queued_time);
+	struct event_passthrough *e =
+		event_create_passthrough(
+			worker_connections_get_request_event(request))->
+		add_category(&event_category_indexer)->
+		set_name("indexer_request_started")->
+		add_str("user", request->username)->
+		add_str("mailbox", request->mailbox)->
+		add_int("queue_depth", indexer_queue_count(queue))->
+		add_int("wait_msecs", wait_msecs);
+	e_debug(e->event(), "Started indexing %s (waited %lld ms)",
+		request->mailbox, wait_msecs);
 	return TRUE;
 }
 
 static void queue_try_send_more(struct indexer_queue *queue)
 {
-	struct worker_connection *worker;
 	struct indexer_request *request, *first_moved_request = NULL;
 
 	while ((request = indexer_queue_request_peek(queue)) != NULL) {
-		worker = worker_connections_find_user(request->username);
-		if (worker != NULL) {
-			/* There is already a connection handling a request
-			 * for this user. Move the request to the back of the
-			 * queue and handle requests from other users.
+		if (worker_connections_get_user_count(request->username) >=
+		    indexer_set->indexer_max_workers_per_user) {
+			/* There are already enough connections handling
+			 * requests for this user. Move the request to the back
+			 * of the queue and handle requests from other users.
 			 * Terminate if we went through all requests. */
 			if (request == first_moved_request) {
 				/* all requests are waiting for existing users
@@ -114,6 +135,9 @@ int main(int argc, char *argv[])
 	set = master_service_get_service_settings(master_service);
 
 	master_service_init_log(master_service);
+	indexer_set =
+		settings_get_or_fatal(master_service_get_event(master_service),
+				      &indexer_setting_parser_info);
 	restrict_access_by_env(RESTRICT_ACCESS_FLAG_ALLOW_ROOT, NULL);
 	restrict_access_allow_coredumps(TRUE);
 	master_service_set_idle_die_callback(master_service, idle_die);
@@ -129,6 +153,7 @@ int main(int argc, char *argv[])
 	indexer_clients_destroy_all();
 	worker_connections_deinit();
 	indexer_queue_deinit(&queue);
+	settings_free(indexer_set);
 
 	master_service_deinit(&master_service);
         return 0;
@@ -1,6 +1,7 @@
 /* Copyright (c) 2022 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "ioloop.h"
 #include "test-common.h"
 #include "indexer-queue.h"
 
@@ -258,6 +259,82 @@ static void test_indexer_queue_iter(void)
 	test_end();
 }
 
+static void test_indexer_queue_aging(void)
+{
+	struct indexer_queue *queue;
+	struct indexer_request *request;
+
+	test_begin("indexer queue aging");
+	queue = indexer_queue_init(indexer_queue_status_callback);
+
+	ioloop_timeval.tv_sec = 1000;
+	indexer_queue_append(queue, TRUE, "user1", "mailbox1", "session1", 0, NULL);
+	ioloop_timeval.tv_sec += INDEXER_QUEUE_MAX_WAIT_MSECS / 1000 - 1;
+	indexer_queue_append(queue, FALSE, "user2", "mailbox2", "session2", 0, NULL);
+	indexer_queue_append(queue, FALSE, "user3", "mailbox3", "session3", 0, NULL);
+
+	/* prepended requests are preferred */
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox3");
+
+	/* until the appended request has waited too long */
+	ioloop_timeval.tv_sec++;
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox1");
+
+	/* moving it to tail doesn't make it jump to the head again */
+	indexer_queue_move_head_to_tail(queue);
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox3");
+
+	const char *expected[] = { "mailbox3", "mailbox2", "mailbox1" };
+	for (unsigned int i = 0; i < N_ELEMENTS(expected); i++) {
+		request = indexer_queue_request_peek(queue);
+		test_assert_strcmp_idx(request->mailbox, expected[i], i);
+		indexer_queue_request_remove(queue);
+		indexer_queue_request_finish(queue, &request, INDEXER_STATE_COMPLETED);
+	}
+	test_assert(indexer_queue_request_peek(queue) == NULL);
+
+	indexer_queue_deinit(&queue);
+	i_zero(&ioloop_timeval);
+	test_end();
+}
+
+static void test_indexer_queue_aging_busy_user(void)
+{
+	struct indexer_queue *queue;
+	struct indexer_request *request, *first_moved_request = NULL;
+
+	test_begin("indexer queue aging busy user");
+	queue = indexer_queue_init(indexer_queue_status_callback);
+
+	ioloop_timeval.tv_sec = 1000;
+	indexer_queue_append(queue, TRUE, "user1", "mailbox1", "session1", 0, NULL);
+	ioloop_timeval.tv_sec += INDEXER_QUEUE_MAX_WAIT_MSECS / 1000;
+	indexer_queue_append(queue, TRUE, "user2", "mailbox2", "session2", 0, NULL);
+
+	/* user1 is at its worker limit, so its aged request at the head is
+	   moved to the tail like queue_try_send_more() does. user2's request
+	   is still sent. */
+	while ((request = indexer_queue_request_peek(queue)) != NULL) {
+		if (strcmp(request->username, "user1") != 0)
+			break;
+		if (request == first_moved_request)
+			break;
+		if (first_moved_request == NULL)
+			first_moved_request = request;
+		indexer_queue_move_head_to_tail(queue);
+	}
+	test_assert(request != NULL && strcmp(request->mailbox, "mailbox2") == 0);
+
+	indexer_queue_cancel_all(queue);
+	test_assert(indexer_queue_request_peek(queue) == NULL);
+	indexer_queue_deinit(&queue);
+	i_zero(&ioloop_timeval);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
@@ -266,6 +343,8 @@ int main(void)
 		test_indexer_queue_reindex,
 		test_indexer_queue_cancel,
 		test_indexer_queue_iter,
+		test_indexer_queue_aging,
+		test_indexer_queue_aging_busy_user,
 		NULL
 	};
 	return test_run(test_functions);
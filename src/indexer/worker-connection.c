@@ -223,16 +223,32 @@ unsigned int worker_connections_get_count(void)
 	return worker_connections->connections_count;
 }
 
-struct worker_connection *worker_connections_find_user(const char *username)
+struct event *
+worker_connections_get_request_event(const struct indexer_request *request)
 {
 	struct connection *conn;
 
+	for (conn = worker_connections->connections; conn != NULL; conn = conn->next) {
+		struct worker_connection *worker =
+			container_of(conn, struct worker_connection, conn);
+
+		if (worker->request == request)
+			return conn->event;
+	}
+	i_unreached();
+}
+
+unsigned int worker_connections_get_user_count(const char *username)
+{
+	struct connection *conn;
+	unsigned int count = 0;
+
 	for (conn = worker_connections->connections; conn != NULL; conn = conn->next) {
 		struct worker_connection *worker =
 			container_of(conn, struct worker_connection, conn);
 
 		if (strcmp(worker->request_username, username) == 0)
-			return worker;
+			count++;
 	}
-	return NULL;
+	return count;
 }
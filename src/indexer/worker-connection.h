@@ -18,7 +18,11 @@ int worker_connection_try_create(const char *socket_path,
 				 worker_available_callback_t *avail_callback);
 
 unsigned int worker_connections_get_count(void);
-struct worker_connection *worker_connections_find_user(const char *username);
+/* Returns the event of the worker connection handling the request. */
+struct event *
+worker_connections_get_request_event(const struct indexer_request *request);
+/* Returns the number of worker connections handling requests for the user. */
+unsigned int worker_connections_get_user_count(const char *username);
 
 void worker_connections_init(void);
 void worker_connections_deinit(void);
@@ -172,6 +172,7 @@ static const struct password_scheme crypt_schemes[] = {
 		.name = "SHA256-CRYPT",
 		.default_encoding = PW_ENCODING_NONE,
 		.raw_password_len = 0,
+		.slow = TRUE,
 		.password_verify = crypt_verify,
 		.password_generate = crypt_generate_sha256,
 	},
@@ -179,6 +180,7 @@ static const struct password_scheme crypt_schemes[] = {
 		.name = "SHA512-CRYPT",
 		.default_encoding = PW_ENCODING_NONE,
 		.raw_password_len = 0,
+		.slow = TRUE,
 		.password_verify = crypt_verify,
 		.password_generate = crypt_generate_sha512,
 	},
@@ -188,6 +190,7 @@ static const struct password_scheme blf_crypt_scheme = {
 	.name = "BLF-CRYPT",
 	.default_encoding = PW_ENCODING_NONE,
 	.raw_password_len = 0,
+	.slow = TRUE,
 	.password_verify = crypt_verify_blowfish,
 	.password_generate = crypt_generate_blowfish,
 };
@@ -196,6 +199,7 @@ static const struct password_scheme default_crypt_scheme = {
 	.name = "CRYPT",
 	.default_encoding = PW_ENCODING_NONE,
 	.raw_password_len = 0,
+	.slow = TRUE,
 	.password_verify = crypt_verify,
 	.password_generate = crypt_generate_blowfish,
 };
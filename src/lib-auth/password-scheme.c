@@ -287,6 +287,14 @@ bool password_scheme_is_alias(const char *scheme1, const char *scheme2)
 		s1->password_generate == s2->password_generate;
 }
 
+bool password_scheme_is_slow(const char *scheme)
+{
+	const struct password_scheme *s;
+
+	s = hash_table_lookup(password_schemes, t_strcut(scheme, '.'));
+	return s != NULL && s->slow;
+}
+
 const char *
 password_scheme_detect(const char *plain_password, const char *crypted_password,
 		       const struct password_generate_params *params)
@@ -872,6 +880,7 @@ static const struct password_scheme builtin_schemes[] = {
 		.name = "SCRAM-SHA-1",
 		.default_encoding = PW_ENCODING_NONE,
 		.raw_password_len = 0,
+		.slow = TRUE,
 		.password_verify = scram_sha1_verify,
 		.password_generate = scram_sha1_generate,
 	},
@@ -879,6 +888,7 @@ static const struct password_scheme builtin_schemes[] = {
 		.name = "SCRAM-SHA-256",
 		.default_encoding = PW_ENCODING_NONE,
 		.raw_password_len = 0,
+		.slow = TRUE,
 		.password_verify = scram_sha256_verify,
 		.password_generate = scram_sha256_generate,
 	},
@@ -932,6 +942,7 @@ static const struct password_scheme builtin_schemes[] = {
 		.name = "PBKDF2",
 		.default_encoding = PW_ENCODING_NONE,
 		.raw_password_len = 0,
+		.slow = TRUE,
 		.password_verify = pbkdf2_verify,
 		.password_generate = pbkdf2_generate,
 	},
@@ -25,6 +25,8 @@ struct password_scheme {
 	unsigned int raw_password_len;
 	/* If set, then this scheme is weak */
 	bool weak;
+	/* If set, verifying the password is intentionally CPU-expensive */
+	bool slow;
 
 	int (*password_verify)(const char *plaintext,
 			       const struct password_generate_params *params,
@@ -74,6 +76,9 @@ bool password_generate_encoded(const char *plaintext,
 
 /* Returns TRUE if schemes are equivalent. */
 bool password_scheme_is_alias(const char *scheme1, const char *scheme2);
+/* Returns TRUE if verifying passwords with the scheme is intentionally
+   CPU-expensive (e.g. BLF-CRYPT, PBKDF2 or ARGON2). */
+bool password_scheme_is_slow(const char *scheme);
 
 /* Try to detect in which scheme crypted password is. Returns the scheme name
    or NULL if nothing was found. */
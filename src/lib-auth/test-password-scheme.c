@@ -13,6 +13,9 @@ static struct {
 } known_non_aliases[] = {
 	{ "MD5", "DES-CRYPT" },
 	{ "MD5-CRYPT", "DES-CRYPT" },
+	{ "CRYPT", "SHA512-CRYPT" },
+	{ "BLF-CRYPT", "SHA512-CRYPT" },
+	{ "LDAP-MD5", "MD5" },
 	{ "ARGON2ID", "ARGON2I" },
 	{ "ARGON2", "ARGON2I" },
 };
@@ -126,12 +129,27 @@ static void test_password_schemes(void)
 #endif
 }
 
+static void test_password_scheme_is_slow(void)
+{
+	test_begin("password_scheme_is_slow()");
+	test_assert(password_scheme_is_slow("BLF-CRYPT"));
+	test_assert(password_scheme_is_slow("SHA512-CRYPT"));
+	test_assert(password_scheme_is_slow("PBKDF2"));
+	test_assert(password_scheme_is_slow("SCRAM-SHA-256"));
+	test_assert(password_scheme_is_slow("pbkdf2"));
+	test_assert(!password_scheme_is_slow("PLAIN"));
+	test_assert(!password_scheme_is_slow("SSHA512.b64"));
+	test_assert(!password_scheme_is_slow("nonexistent"));
+	test_end();
+}
+
 
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_password_schemes,
 		test_password_failures,
+		test_password_scheme_is_slow,
 		NULL
 	};
 	password_schemes_init();
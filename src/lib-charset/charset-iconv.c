@@ -9,11 +9,79 @@
 #include <iconv.h>
 #include <ctype.h>
 
+/* Number of iconv handles kept open after the translation has ended.
+   iconv_open() is expensive compared to converting a short header, and
+   the same few charsets are usually used over and over again. */
+#define CHARSET_ICONV_CACHE_SIZE 4
+
 struct charset_translation {
 	iconv_t cd;
+	char *charset;
 	normalizer_func_t *normalizer;
 };
 
+struct charset_iconv_cache {
+	char *charset;
+	iconv_t cd;
+};
+
+static struct charset_iconv_cache iconv_cache[CHARSET_ICONV_CACHE_SIZE];
+static unsigned int iconv_cache_next_idx;
+static bool iconv_cache_atexit_registered;
+
+static void charset_iconv_cache_deinit(void)
+{
+	for (unsigned int i = 0; i < N_ELEMENTS(iconv_cache); i++) {
+		if (iconv_cache[i].charset != NULL) {
+			iconv_close(iconv_cache[i].cd);
+			i_free(iconv_cache[i].charset);
+		}
+	}
+}
+
+static iconv_t charset_iconv_cache_take(const char *charset)
+{
+	iconv_t cd;
+
+	for (unsigned int i = 0; i < N_ELEMENTS(iconv_cache); i++) {
+		if (iconv_cache[i].charset != NULL &&
+		    strcasecmp(iconv_cache[i].charset, charset) == 0) {
+			cd = iconv_cache[i].cd;
+			i_free(iconv_cache[i].charset);
+			return cd;
+		}
+	}
+	return (iconv_t)-1;
+}
+
+static void charset_iconv_cache_put(char *charset, iconv_t cd)
+{
+	struct charset_iconv_cache *cache = NULL;
+
+	for (unsigned int i = 0; i < N_ELEMENTS(iconv_cache); i++) {
+		if (iconv_cache[i].charset == NULL) {
+			cache = &iconv_cache[i];
+			break;
+		}
+	}
+	if (cache == NULL) {
+		/* replace the entries in round-robin order */
+		cache = &iconv_cache[iconv_cache_next_idx];
+		iconv_cache_next_idx = (iconv_cache_next_idx + 1) %
+			N_ELEMENTS(iconv_cache);
+		iconv_close(cache->cd);
+		i_free(cache->charset);
+	}
+	if (!iconv_cache_atexit_registered) {
+		lib_atexit(charset_iconv_cache_deinit);
+		iconv_cache_atexit_registered = TRUE;
+	}
+	/* reset the conversion state for the next user */
+	(void)iconv(cd, NULL, NULL, NULL, NULL);
+	cache->charset = charset;
+	cache->cd = cd;
+}
+
 static int
 iconv_charset_to_utf8_begin(const char *charset, normalizer_func_t *normalizer,
 			    struct charset_translation **t_r)
@@ -26,13 +94,17 @@ iconv_charset_to_utf8_begin(const char *charset, normalizer_func_t *normalizer,
 	else {
 		if (strcmp(charset, "UTF-8//TEST") == 0)
 			charset = "UTF-8";
-		cd = iconv_open("UTF-8", charset);
+		cd = charset_iconv_cache_take(charset);
+		if (cd == (iconv_t)-1)
+			cd = iconv_open("UTF-8", charset);
 		if (cd == (iconv_t)-1)
 			return -1;
 	}
 
 	t = i_new(struct charset_translation, 1);
 	t->cd = cd;
+	if (cd != (iconv_t)-1)
+		t->charset = i_strdup(charset);
 	t->normalizer = normalizer;
 	*t_r = t;
 	return 0;
@@ -41,7 +113,7 @@ iconv_charset_to_utf8_begin(const char *charset, normalizer_func_t *normalizer,
 static void iconv_charset_to_utf8_end(struct charset_translation *t)
 {
 	if (t->cd != (iconv_t)-1)
-		iconv_close(t->cd);
+		charset_iconv_cache_put(t->charset, t->cd);
 	i_free(t);
 }
 
@@ -1,6 +1,7 @@
 /* Copyright (c) 2020 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
 #include "buffer.h"
 #include "istream.h"
 #include "ostream.h"
@@ -11,6 +12,8 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <time.h>
 
 /**
@@ -18,8 +21,15 @@
  * remotely and then compresses and decompresses it using each algorithm.
  * It measures the time spent on this giving some estimate how well the data
  * compressed and how long it took.
+ *
+ * With -c the input is instead a mail corpus: a single mail file or a
+ * Maildir (or any directory with one mail per file). Each mail is
+ * compressed and decompressed separately, like mail_compress does.
+ * -t prints the results as tab-separated lines.
  */
 
+ARRAY_DEFINE_TYPE(buffer, buffer_t *);
+
 static void bench_compression_speed(const struct compression_handler *handler,
 				    unsigned int level, unsigned long block_count)
 {
@@ -92,18 +102,237 @@ static void bench_compression_speed(const struct compression_handler *handler,
 
 }
 
+static void corpus_add_file(ARRAY_TYPE(buffer) *mails, const char *path)
+{
+	struct istream *input = i_stream_create_file(path, IO_BLOCK_SIZE);
+	buffer_t *buf = buffer_create_dynamic(default_pool, 4096);
+	const unsigned char *data;
+	size_t size;
+
+	while (i_stream_read_more(input, &data, &size) > 0) {
+		buffer_append(buf, data, size);
+		i_stream_skip(input, size);
+	}
+	if (input->stream_errno != 0)
+		i_fatal("read(%s) failed: %s", path, i_stream_get_error(input));
+	i_stream_unref(&input);
+	array_push_back(mails, &buf);
+}
+
+static void corpus_add_dir(ARRAY_TYPE(buffer) *mails, const char *path)
+{
+	DIR *dir;
+	struct dirent *d;
+	struct stat st;
+	const char *file;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		if (errno == ENOENT)
+			return;
+		i_fatal("opendir(%s) failed: %m", path);
+	}
+	while ((d = readdir(dir)) != NULL) T_BEGIN {
+		if (d->d_name[0] != '.') {
+			file = t_strconcat(path, "/", d->d_name, NULL);
+			if (stat(file, &st) < 0)
+				i_fatal("stat(%s) failed: %m", file);
+			if (S_ISREG(st.st_mode))
+				corpus_add_file(mails, file);
+		}
+	} T_END;
+	if (closedir(dir) < 0)
+		i_fatal("closedir(%s) failed: %m", path);
+}
+
+static void corpus_read(ARRAY_TYPE(buffer) *mails, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		i_fatal("stat(%s) failed: %m", path);
+	if (!S_ISDIR(st.st_mode))
+		corpus_add_file(mails, path);
+	else {
+		corpus_add_dir(mails, path);
+		corpus_add_dir(mails, t_strconcat(path, "/cur", NULL));
+		corpus_add_dir(mails, t_strconcat(path, "/new", NULL));
+	}
+	if (array_count(mails) == 0)
+		i_fatal("No mails found in %s", path);
+}
+
+static void
+bench_compression_corpus(const struct compression_handler *handler,
+			 int level, const ARRAY_TYPE(buffer) *mails,
+			 bool tab_output)
+{
+	buffer_t *const *mailp, *compressed, *decompressed;
+	struct ostream *os, *os_compressed;
+	struct istream *is, *is_decompressed;
+	const unsigned char *data;
+	size_t size;
+	uint64_t ts_0, ts_1, ts_2, ns;
+	uint64_t input_size = 0, output_size = 0;
+	uint64_t compress_ns = 0, decompress_ns = 0, max_compress_ns = 0;
+
+	compressed = buffer_create_dynamic(default_pool, 1024*64);
+	decompressed = buffer_create_dynamic(default_pool, 1024*64);
+	array_foreach(mails, mailp) {
+		buffer_t *mail = *mailp;
+
+		buffer_set_used_size(compressed, 0);
+		buffer_set_used_size(decompressed, 0);
+
+		ts_0 = i_nanoseconds();
+		os = o_stream_create_buffer(compressed);
+		os_compressed = handler->create_ostream(os, level);
+		o_stream_unref(&os);
+		o_stream_nsend(os_compressed, mail->data, mail->used);
+		if (o_stream_finish(os_compressed) < 0) {
+			i_fatal("%s: compression failed: %s", handler->name,
+				o_stream_get_error(os_compressed));
+		}
+		o_stream_unref(&os_compressed);
+		ts_1 = i_nanoseconds();
+
+		is = i_stream_create_from_data(compressed->data,
+					       compressed->used);
+		is_decompressed = handler->create_istream(is);
+		i_stream_unref(&is);
+		while (i_stream_read_more(is_decompressed, &data, &size) > 0) {
+			buffer_append(decompressed, data, size);
+			i_stream_skip(is_decompressed, size);
+		}
+		if (is_decompressed->stream_errno != 0) {
+			i_fatal("%s: decompression failed: %s", handler->name,
+				i_stream_get_error(is_decompressed));
+		}
+		i_stream_unref(&is_decompressed);
+		ts_2 = i_nanoseconds();
+
+		if (!buffer_cmp(mail, decompressed))
+			i_fatal("%s: decompressed mail differs", handler->name);
+
+		ns = ts_1 - ts_0;
+		compress_ns += ns;
+		max_compress_ns = I_MAX(max_compress_ns, ns);
+		decompress_ns += ts_2 - ts_1;
+		input_size += mail->used;
+		output_size += compressed->used;
+	}
+	buffer_free(&compressed);
+	buffer_free(&decompressed);
+
+	/* bytes per nanosecond is the same as GB per second */
+	double ratio = (double)output_size / (double)input_size;
+	double compress_mbs = compress_ns == 0 ? 0 :
+		(double)input_size / (double)compress_ns * 1000.0;
+	double decompress_mbs = decompress_ns == 0 ? 0 :
+		(double)input_size / (double)decompress_ns * 1000.0;
+	unsigned int count = array_count(mails);
+
+	if (tab_output) {
+		printf("%s\t%d\t%u\t%"PRIu64"\t%"PRIu64"\t%.2lf\t%.2lf\t"
+		       "%.2lf\t%.2lf\n", handler->name, level, count,
+		       input_size, output_size, compress_mbs, decompress_mbs,
+		       (double)compress_ns / count / 1000.0,
+		       (double)max_compress_ns / 1000.0);
+		return;
+	}
+	printf("%s (level %d)\n", handler->name, level);
+	printf("\tSpace Saving: %0.02lf%%\n", (1.0-ratio)*100.0);
+	printf("\tCompression: %0.02lf MB/s, %0.02lf us/mail (max %0.02lf us)\n",
+	       compress_mbs, (double)compress_ns / count / 1000.0,
+	       (double)max_compress_ns / 1000.0);
+	printf("\tDecompression: %0.02lf MB/s, %0.02lf us/mail\n\n",
+	       decompress_mbs, (double)decompress_ns / count / 1000.0);
+}
+
+static void bench_corpus(const char *path, int level, bool tab_output)
+{
+	ARRAY_TYPE(buffer) mails;
+	buffer_t **mailp;
+	uint64_t total_size = 0;
+
+	i_array_init(&mails, 1024);
+	corpus_read(&mails, path);
+	array_foreach_modifiable(&mails, mailp)
+		total_size += (*mailp)->used;
+
+	if (tab_output) {
+		printf("handler\tlevel\tmails\tinput_bytes\toutput_bytes\t"
+		       "compress_mbs\tdecompress_mbs\tcompress_avg_usecs\t"
+		       "compress_max_usecs\n");
+	} else {
+		printf("Input data is %u mails, %"PRIu64" bytes\n\n",
+		       array_count(&mails), total_size);
+	}
+	for (unsigned int i = 0; compression_handlers[i].name != NULL; i++) T_BEGIN {
+		const struct compression_handler *handler =
+			&compression_handlers[i];
+
+		if (handler->create_istream != NULL &&
+		    handler->create_ostream != NULL) {
+			bench_compression_corpus(handler, level >= 0 ? level :
+						 handler->get_default_level(),
+						 &mails, tab_output);
+		}
+	} T_END;
+
+	array_foreach_modifiable(&mails, mailp)
+		buffer_free(mailp);
+	array_free(&mails);
+}
+
 static void print_usage(const char *prog)
 {
 	fprintf(stderr, "Usage: %s block_size count level\n", prog);
 	fprintf(stderr, "Runs with 1000 8k blocks using level 6 if nothing given\n");
+	fprintf(stderr, "   or: %s [-t] [-l level] -c <mail file or directory>\n", prog);
+	fprintf(stderr, "Compresses each mail separately, using each handler's "
+			"default level if -l isn't given\n");
 	lib_exit(1);
 }
 
-int main(int argc, const char *argv[])
+int main(int argc, char *argv[])
 {
 	unsigned int level = 6;
+	const char *corpus_path = NULL;
+	int c, corpus_level = -1;
+	bool tab_output = FALSE;
 	lib_init();
 
+	while ((c = getopt(argc, argv, "c:l:t")) > 0) {
+		switch (c) {
+		case 'c':
+			corpus_path = optarg;
+			break;
+		case 'l':
+			if (str_to_int(optarg, &corpus_level) < 0) {
+				fprintf(stderr, "Invalid level\n");
+				print_usage(argv[0]);
+			}
+			break;
+		case 't':
+			tab_output = TRUE;
+			break;
+		default:
+			print_usage(argv[0]);
+		}
+	}
+	if (corpus_path != NULL) {
+		if (optind != argc)
+			print_usage(argv[0]);
+		bench_corpus(corpus_path, corpus_level, tab_output);
+		lib_deinit();
+		return 0;
+	}
+	if (optind > 1) {
+		/* -l and -t are only for the corpus mode */
+		print_usage(argv[0]);
+	}
+
 	unsigned long block_size = 8192UL;
 	unsigned long block_count = 1000UL;
 
@@ -526,6 +526,9 @@ o_stream_encrypt_sendv(struct ostream_private *stream,
 	unsigned char ciphertext[IO_BLOCK_SIZE];
 	buffer_t buf;
 	buffer_create_from_data(&buf, ciphertext, sizeof(ciphertext));
+	/* update can emit up to one cipher block more than its input */
+	size_t max_input = sizeof(ciphertext) -
+		dcrypt_ctx_sym_get_block_size(estream->ctx_sym);
 
 	/* encrypt & send all blocks of data at max ciphertext buffer's
 	   length */
@@ -534,8 +537,7 @@ o_stream_encrypt_sendv(struct ostream_private *stream,
 		const unsigned char *ptr = iov[i].iov_base;
 		while(len > 0) {
 			buffer_clear_safe(&buf);
-			/* update can emite twice the size of input */
-			bl = I_MIN(sizeof(ciphertext)/2, len);
+			bl = I_MIN(max_input, len);
 
 			if (!dcrypt_ctx_sym_update(estream->ctx_sym, ptr + off,
 						   bl, &buf, &error)) {
@@ -618,6 +618,237 @@ static int sql_dict_lookup(struct dict *_dict, const struct dict_op_settings *se
 	return ret;
 }
 
+struct sql_dict_lookup_multi_key {
+	const char *key;
+	/* NULL if the key is looked up alone */
+	const struct dict_sql_map *map;
+	ARRAY_TYPE(const_string) pattern_values;
+	const char *value;
+	bool handled;
+};
+
+static bool
+sql_dict_lookup_multi_can_batch(const struct dict_sql_map *map,
+				const ARRAY_TYPE(const_string) *pattern_values)
+{
+	const struct dict_sql_field *field;
+	unsigned int count = array_count(&map->pattern_fields);
+
+	if (count == 0 || array_count(pattern_values) != count)
+		return FALSE;
+	/* The returned rows are matched back to the keys by the last pattern
+	   field's value. Only strings are returned the same way as they're
+	   written in the key. */
+	field = array_idx(&map->pattern_fields, count - 1);
+	return field->value_type == DICT_SQL_TYPE_STRING;
+}
+
+static bool
+sql_dict_lookup_multi_key_can_join(const struct sql_dict_lookup_multi_key *key1,
+				   const struct sql_dict_lookup_multi_key *key2)
+{
+	const char *const *values1, *const *values2;
+	unsigned int i, count;
+
+	if (key1->map != key2->map ||
+	    (key1->key[0] == DICT_PATH_PRIVATE[0]) !=
+	    (key2->key[0] == DICT_PATH_PRIVATE[0]))
+		return FALSE;
+
+	/* everything except the last pattern field must be the same */
+	values1 = array_get(&key1->pattern_values, &count);
+	values2 = array_front(&key2->pattern_values);
+	for (i = 0; i + 1 < count; i++) {
+		if (strcmp(values1[i], values2[i]) != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static int
+sql_dict_lookup_multi_get_query(struct sql_dict *dict,
+				const struct dict_op_settings *set,
+				struct sql_dict_lookup_multi_key *const *batch,
+				unsigned int batch_count,
+				struct sql_statement **stmt_r,
+				const char **error_r)
+{
+	const struct dict_sql_map *map = batch[0]->map;
+	const struct dict_sql_field *pattern_fields;
+	const char *const *pattern_values;
+	ARRAY_TYPE(sql_dict_param) params;
+	unsigned int i, count;
+	const char *error;
+
+	pattern_fields = array_get(&map->pattern_fields, &count);
+	pattern_values = array_front(&batch[0]->pattern_values);
+
+	string_t *query = t_str_new(256);
+	t_array_init(&params, count + batch_count);
+	str_append(query, "SELECT ");
+	if (map->expire_field != NULL)
+		str_printfa(query, "%s,", map->expire_field);
+	/* the last pattern field is needed to find the row's key */
+	str_printfa(query, "%s,%s FROM %s%s WHERE",
+		    map->value_field, pattern_fields[count-1].name,
+		    sql_db_table_prefix(dict->db), map->table);
+	for (i = 0; i < count - 1; i++) {
+		str_printfa(query, " %s = ? AND", pattern_fields[i].name);
+		if (sql_dict_field_get_value(map, &pattern_fields[i],
+					     pattern_values[i], "",
+					     &params, &error) < 0) {
+			*error_r = t_strdup_printf(
+				"sql dict lookup: Failed to lookup key %s: %s",
+				batch[0]->key, error);
+			return -1;
+		}
+	}
+	str_printfa(query, " %s IN (", pattern_fields[i].name);
+	for (unsigned int j = 0; j < batch_count; j++) {
+		if (j > 0)
+			str_append_c(query, ',');
+		str_append_c(query, '?');
+		pattern_values = array_front(&batch[j]->pattern_values);
+		if (sql_dict_field_get_value(map, &pattern_fields[i],
+					     pattern_values[i], "",
+					     &params, &error) < 0) {
+			*error_r = t_strdup_printf(
+				"sql dict lookup: Failed to lookup key %s: %s",
+				batch[j]->key, error);
+			return -1;
+		}
+	}
+	str_append_c(query, ')');
+	if (batch[0]->key[0] == DICT_PATH_PRIVATE[0]) {
+		struct sql_dict_param *param = array_append_space(&params);
+		str_printfa(query, " AND %s = ?", map->username_field);
+		param->value_type = DICT_SQL_TYPE_STRING;
+		param->value_str = t_strdup(set->username);
+	}
+	*stmt_r = sql_dict_statement_init(dict, str_c(query), &params);
+	return 0;
+}
+
+/* Look up all the keys that differ only by their last pattern field's
+   value with a single "field IN (...)" query. */
+static int
+sql_dict_lookup_multi_batch(struct sql_dict *dict,
+			    const struct dict_op_settings *set, pool_t pool,
+			    struct sql_dict_lookup_multi_key *const *batch,
+			    unsigned int batch_count, const char **error_r)
+{
+	const struct dict_sql_map *map = batch[0]->map;
+	struct sql_statement *stmt;
+	struct sql_result *result;
+	unsigned int i, key_field_idx, last_idx;
+	int ret;
+
+	if (sql_dict_lookup_multi_get_query(dict, set, batch, batch_count,
+					    &stmt, error_r) < 0)
+		return -1;
+
+	last_idx = array_count(&map->pattern_fields) - 1;
+	key_field_idx = (map->expire_field != NULL ? 1 : 0) + map->values_count;
+	result = sql_statement_query_s(&stmt);
+	while ((ret = sql_dict_result_next_row(map, result)) > 0) {
+		const char *key_value =
+			sql_result_get_field_value(result, key_field_idx);
+		const char *const *values = NULL;
+
+		if (key_value == NULL)
+			continue;
+		for (i = 0; i < batch_count; i++) {
+			/* like with single lookups, the first row wins */
+			if (batch[i]->value != NULL ||
+			    strcmp(array_idx_elem(&batch[i]->pattern_values,
+						  last_idx), key_value) != 0)
+				continue;
+			if (values == NULL) {
+				values = sql_dict_result_unescape_values(map,
+					pool, result);
+			}
+			batch[i]->value = values[0];
+		}
+	}
+	if (ret < 0) {
+		*error_r = t_strdup_printf("dict sql lookup failed: %s",
+					   sql_result_get_error(result));
+	}
+	sql_result_unref(result);
+	return ret;
+}
+
+static int
+sql_dict_lookup_multi(struct dict *_dict, const struct dict_op_settings *set,
+		      pool_t pool, const char *const *keys,
+		      const char *const **values_r, const char **error_r)
+{
+	struct sql_dict *dict = (struct sql_dict *)_dict;
+	struct sql_dict_lookup_multi_key *mkeys;
+	ARRAY(struct sql_dict_lookup_multi_key *) batch;
+	const char *const *key_values, **values;
+	unsigned int i, j, count = str_array_length(keys);
+	int ret = 0;
+
+	mkeys = t_new(struct sql_dict_lookup_multi_key, count);
+	for (i = 0; i < count; i++) {
+		mkeys[i].key = keys[i];
+		mkeys[i].map = sql_dict_find_map(dict, keys[i],
+						 &mkeys[i].pattern_values);
+		if (mkeys[i].map != NULL &&
+		    !sql_dict_lookup_multi_can_batch(mkeys[i].map,
+						     &mkeys[i].pattern_values))
+			mkeys[i].map = NULL;
+	}
+
+	t_array_init(&batch, count);
+	for (i = 0; i < count; i++) {
+		if (mkeys[i].handled)
+			continue;
+
+		array_clear(&batch);
+		for (j = i; j < count && mkeys[i].map != NULL; j++) {
+			if (!mkeys[j].handled &&
+			    sql_dict_lookup_multi_key_can_join(&mkeys[i],
+							       &mkeys[j])) {
+				struct sql_dict_lookup_multi_key *mkey =
+					&mkeys[j];
+				array_push_back(&batch, &mkey);
+				mkey->handled = TRUE;
+			}
+		}
+		if (array_count(&batch) > 1) {
+			if (sql_dict_lookup_multi_batch(dict, set, pool,
+							array_front(&batch),
+							array_count(&batch),
+							error_r) < 0)
+				return -1;
+			continue;
+		}
+
+		/* Nothing to batch with. This also fails unmapped keys
+		   with the usual error. */
+		ret = sql_dict_lookup(_dict, set, pool, keys[i],
+				      &key_values, error_r);
+		if (ret < 0)
+			return -1;
+		if (ret > 0)
+			mkeys[i].value = key_values[0];
+		mkeys[i].handled = TRUE;
+	}
+
+	ret = 0;
+
+	values = p_new(pool, const char *, count + 1);
+	for (i = 0; i < count; i++) {
+		values[i] = mkeys[i].value;
+		if (values[i] != NULL)
+			ret = 1;
+	}
+	*values_r = values;
+	return ret;
+}
+
 struct sql_dict_lookup_context {
 	const struct dict_sql_map *map;
 	dict_lookup_callback_t *callback;
@@ -1666,6 +1897,7 @@ static struct dict sql_dict = {
 		.unset = sql_dict_unset,
 		.atomic_inc = sql_dict_atomic_inc,
 		.lookup_async = sql_dict_lookup_async,
+		.lookup_multi = sql_dict_lookup_multi,
 	}
 };
 
@@ -78,6 +78,65 @@ static void test_lookup_one(void)
 	test_end();
 }
 
+static void test_lookup_multi(void)
+{
+	const char *const *values = NULL, *error = NULL;
+	struct test_driver_result_set rset_batch = {
+		.rows = 2,
+		.cols = 2,
+		.col_names = (const char *[]){"value", "b", NULL},
+		.row_data = (const char **[]){
+			(const char*[]){"two", "there", NULL},
+			(const char*[]){"one", "world", NULL},
+		},
+	};
+	struct test_driver_result_set rset_not_found = {
+		.rows = 0,
+		.cols = 1,
+		.col_names = (const char *[]){"value", NULL},
+	};
+	struct test_driver_result res_batch = {
+		.nqueries = 1,
+		.queries = (const char *[]){"SELECT value,b FROM table WHERE a = 'hello' AND b IN ('world','nobody','there')", NULL},
+		.result = &rset_batch,
+	};
+	struct test_driver_result res_not_found = {
+		.nqueries = 1,
+		.queries = (const char *[]){"SELECT value FROM table WHERE a = 'other' AND b = 'world'", NULL},
+		.result = &rset_not_found,
+	};
+	const char *const keys[] = {
+		"shared/dictmap/hello/world",
+		"shared/dictmap/hello/nobody",
+		"shared/dictmap/other/world",
+		"shared/dictmap/hello/there",
+		NULL
+	};
+	const struct dict_op_settings set = {
+		.username = "testuser",
+	};
+	struct dict *dict;
+	pool_t pool = pool_datastack_create();
+
+	test_begin("dict lookup multi");
+	test_setup(&dict);
+
+	/* the keys that differ only by the last field are looked up with
+	   a single query */
+	test_set_expected(dict, &res_batch);
+	test_set_expected(dict, &res_not_found);
+
+	test_assert(dict_lookup_multi(dict, &set, pool, keys, &values, &error) == 1);
+	test_assert(error == NULL);
+	test_assert_strcmp(values[0], "one");
+	test_assert(values[1] == NULL);
+	test_assert(values[2] == NULL);
+	test_assert_strcmp(values[3], "two");
+	test_assert(values[4] == NULL);
+	test_teardown(&dict);
+	test_end();
+}
+
 static void test_atomic_inc(void)
 {
 	const char *error;
@@ -297,6 +356,7 @@ int main(void) {
 
 	static void (*const test_functions[])(void) = {
 		test_lookup_one,
+		test_lookup_multi,
 		test_atomic_inc,
 		test_set,
 		test_unset,
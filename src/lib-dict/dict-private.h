@@ -58,6 +58,10 @@ struct dict_vfuncs {
 			      const struct timespec *ts);
 	void (*set_hide_log_values)(struct dict_transaction_context *ctx,
 			            bool hide_log_values);
+	int (*lookup_multi)(struct dict *dict,
+			    const struct dict_op_settings *set, pool_t pool,
+			    const char *const *keys,
+			    const char *const **values_r, const char **error_r);
 };
 
 struct dict_commit_callback_ctx;
@@ -35,8 +35,14 @@ struct redis_connection {
 
 	string_t *last_reply;
 	unsigned int bytes_left;
-	bool value_not_found;
-	bool value_received;
+
+	/* GET replies are stored here, NULL for not found keys. The replies
+	   are read in ioloop callbacks, so neither the array nor the values
+	   can be allocated from the caller's (possibly data stack) pool. They
+	   are copied to the caller's pool after all the replies are read. */
+	pool_t lookup_pool;
+	const char **lookup_values;
+	unsigned int lookup_values_received;
 };
 
 struct redis_dict_reply {
@@ -233,8 +239,8 @@ static int redis_input_get(struct redis_connection *conn, const char **error_r)
 		if (line == NULL)
 			return 0;
 		if (strcmp(line, "$-1") == 0) {
-			conn->value_received = TRUE;
-			conn->value_not_found = TRUE;
+			i_assert(conn->lookup_values != NULL);
+			conn->lookup_values[conn->lookup_values_received++] = NULL;
 			if (conn->dict->dict.ioloop != NULL)
 				io_loop_stop(conn->dict->dict.ioloop);
 			redis_input_state_remove(conn->dict);
@@ -260,8 +266,11 @@ static int redis_input_get(struct redis_connection *conn, const char **error_r)
 		return 0;
 
 	/* reply fully read - drop trailing CRLF */
-	conn->value_received = TRUE;
 	str_truncate(conn->last_reply, str_len(conn->last_reply)-2);
+	i_assert(conn->lookup_values != NULL);
+	conn->lookup_values[conn->lookup_values_received++] =
+		p_strdup(conn->lookup_pool, str_c(conn->last_reply));
+	str_truncate(conn->last_reply, 0);
 
 	if (conn->dict->dict.ioloop != NULL)
 		io_loop_stop(conn->dict->dict.ioloop);
@@ -643,19 +652,22 @@ static void redis_dict_select_db(struct redis_dict *dict)
 	redis_input_state_add(dict, REDIS_INPUT_STATE_SELECT);
 }
 
-static int redis_dict_lookup(struct dict *_dict,
-			     const struct dict_op_settings *set,
-			     pool_t pool, const char *key,
-			     const char *const **values_r, const char **error_r)
+static int redis_dict_lookup_multi(struct dict *_dict,
+				   const struct dict_op_settings *set,
+				   pool_t pool, const char *const *keys,
+				   const char *const **values_r,
+				   const char **error_r)
 {
 	struct redis_dict *dict = (struct redis_dict *)_dict;
 	struct timeout *to;
-	const char *cmd;
-
-	key = redis_dict_get_full_key(dict, set->username, key);
+	const char *key, **values;
+	unsigned int i, count = str_array_length(keys);
+	int ret = 0;
 
-	dict->conn.value_received = FALSE;
-	dict->conn.value_not_found = FALSE;
+	dict->conn.lookup_pool = pool_alloconly_create("redis lookup", 256);
+	dict->conn.lookup_values =
+		p_new(dict->conn.lookup_pool, const char *, count + 1);
+	dict->conn.lookup_values_received = 0;
 
 	i_assert(dict->dict.ioloop == NULL);
 
@@ -678,12 +690,21 @@ static int redis_dict_lookup(struct dict *_dict,
 
 		if (dict->connected) {
 			redis_dict_select_db(dict);
-			cmd = t_strdup_printf("*2\r\n$3\r\nGET\r\n$%zu\r\n%s\r\n",
-					      strlen(key), key);
-			o_stream_nsend_str(dict->conn.conn.output, cmd);
+			/* pipeline all the GETs */
+			o_stream_cork(dict->conn.conn.output);
+			for (i = 0; i < count; i++) {
+				key = redis_dict_get_full_key(dict,
+					set->username, keys[i]);
+				o_stream_nsend_str(dict->conn.conn.output,
+					t_strdup_printf(
+						"*2\r\n$3\r\nGET\r\n$%zu\r\n%s\r\n",
+						strlen(key), key));
+				redis_input_state_add(dict,
+						      REDIS_INPUT_STATE_GET);
+			}
+			o_stream_uncork(dict->conn.conn.output);
 
 			str_truncate(dict->conn.last_reply, 0);
-			redis_input_state_add(dict, REDIS_INPUT_STATE_GET);
 			do {
 				io_loop_run(dict->dict.ioloop);
 			} while (array_count(&dict->input_states) > 0);
@@ -697,21 +718,39 @@ static int redis_dict_lookup(struct dict *_dict,
 	io_loop_destroy(&dict->dict.ioloop);
 	dict->dict.prev_ioloop = NULL;
 
-	if (!dict->conn.value_received) {
+	if (dict->conn.lookup_values_received != count) {
 		/* we failed in some way. make sure we disconnect since the
 		   connection state isn't known anymore */
 		*error_r = t_strdup_printf("redis: Communication failure (last reply: %s)",
 					   str_c(dict->conn.last_reply));
+		dict->conn.lookup_values = NULL;
+		pool_unref(&dict->conn.lookup_pool);
 		redis_disconnected(&dict->conn, *error_r);
 		return -1;
 	}
-	if (dict->conn.value_not_found)
-		return 0;
-
-	const char **values = p_new(pool, const char *, 2);
-	values[0] = p_strdup(pool, str_c(dict->conn.last_reply));
+	values = p_new(pool, const char *, count + 1);
+	for (i = 0; i < count; i++) {
+		if (dict->conn.lookup_values[i] != NULL) {
+			values[i] = p_strdup(pool, dict->conn.lookup_values[i]);
+			ret = 1;
+		}
+	}
 	*values_r = values;
-	return 1;
+	dict->conn.lookup_values = NULL;
+	pool_unref(&dict->conn.lookup_pool);
+	return ret;
+}
+
+static int redis_dict_lookup(struct dict *_dict,
+			     const struct dict_op_settings *set,
+			     pool_t pool, const char *key,
+			     const char *const **values_r, const char **error_r)
+{
+	const char *const keys[] = { key, NULL };
+
+	/* the returned array is NULL-terminated after the single value */
+	return redis_dict_lookup_multi(_dict, set, pool, keys,
+				       values_r, error_r);
 }
 
 static struct dict_transaction_context *
@@ -767,6 +806,8 @@ redis_transaction_commit(struct dict_transaction_context *_ctx, bool async,
 
 		o_stream_nsend_str(dict->conn.conn.output,
 				   "*1\r\n$4\r\nEXEC\r\n");
+		/* send the whole MULTI .. EXEC in one write */
+		o_stream_uncork(dict->conn.conn.output);
 		reply = array_append_space(&dict->replies);
 		reply->callback = callback;
 		reply->context = context;
@@ -808,6 +849,7 @@ static void redis_transaction_rollback(struct dict_transaction_context *_ctx)
 	} else if (_ctx->changed) {
 		o_stream_nsend_str(dict->conn.conn.output,
 				   "*1\r\n$7\r\nDISCARD\r\n");
+		o_stream_uncork(dict->conn.conn.output);
 		redis_input_state_add(dict, REDIS_INPUT_STATE_DISCARD);
 	}
 	i_free(ctx->error);
@@ -827,6 +869,10 @@ static int redis_check_transaction(struct redis_dict_transaction_context *ctx)
 	if (ctx->ctx.changed)
 		return 0;
 
+	/* Keep the output corked until the transaction is committed or
+	   rolled back, so the commands don't each need a separate write.
+	   Their replies aren't read before the commit anyway. */
+	o_stream_cork(dict->conn.conn.output);
 	redis_input_state_add(dict, REDIS_INPUT_STATE_MULTI);
 	if (o_stream_send_str(dict->conn.conn.output,
 			      "*1\r\n$5\r\nMULTI\r\n") < 0) {
@@ -940,6 +986,7 @@ struct dict dict_driver_redis = {
 		.deinit = redis_dict_deinit,
 		.wait = redis_dict_wait,
 		.lookup = redis_dict_lookup,
+		.lookup_multi = redis_dict_lookup_multi,
 		.transaction_init = redis_transaction_init,
 		.transaction_commit = redis_transaction_commit,
 		.transaction_rollback = redis_transaction_rollback,
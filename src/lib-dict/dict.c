@@ -465,6 +465,47 @@ int dict_lookup_values(struct dict *dict, const struct dict_op_settings *set,
 	return ret;
 }
 
+int dict_lookup_multi(struct dict *dict, const struct dict_op_settings *set,
+		      pool_t pool, const char *const *keys,
+		      const char *const **values_r, const char **error_r)
+{
+	unsigned int i, count = str_array_length(keys);
+	int ret = 0;
+
+	*error_r = NULL;
+	if (dict->v.lookup_multi == NULL) {
+		const char **values = p_new(pool, const char *, count + 1);
+
+		for (i = 0; i < count; i++) {
+			int ret2 = dict_lookup(dict, set, pool, keys[i],
+					       &values[i], error_r);
+			if (ret2 < 0)
+				return -1;
+			if (ret2 > 0)
+				ret = 1;
+		}
+		*values_r = values;
+		return ret;
+	}
+
+	for (i = 0; i < count; i++)
+		i_assert(dict_key_prefix_is_valid(keys[i], set->username));
+	ret = dict->v.lookup_multi(dict, set, pool, keys, values_r, error_r);
+
+	/* send the same events as separate lookups would */
+	for (i = 0; i < count; i++) {
+		struct event *event = dict_event_create(dict, set);
+		event_add_str(event, "key", keys[i]);
+		dict_lookup_finished(event, ret < 0 ? ret :
+				     ((*values_r)[i] != NULL ? 1 : 0),
+				     *error_r);
+		event_unref(&event);
+	}
+	if (ret < 0)
+		*values_r = NULL;
+	return ret;
+}
+
 #undef dict_lookup_async
 void dict_lookup_async(struct dict *dict, const struct dict_op_settings *set,
 		       const char *key, dict_lookup_callback_t *callback,
@@ -139,6 +139,14 @@ int dict_lookup(struct dict *dict, const struct dict_op_settings *set, pool_t po
 int dict_lookup_values(struct dict *dict, const struct dict_op_settings *set,
 		       pool_t pool, const char *key,
 		       const char *const **values_r, const char **error_r);
+/* Lookup the first value for each of the NULL-terminated keys. values_r is
+   set to an array with the same number of elements as keys, containing NULL
+   for the keys that weren't found. Drivers that support it send all the
+   lookups at once, others look up the keys one by one. Returns 1 if at least
+   one key was found, 0 if none were found and -1 if lookup failed. */
+int dict_lookup_multi(struct dict *dict, const struct dict_op_settings *set,
+		      pool_t pool, const char *const *keys,
+		      const char *const **values_r, const char **error_r);
 /* Asynchronously lookup values for the key. */
 void dict_lookup_async(struct dict *dict, const struct dict_op_settings *set,
 		       const char *key, dict_lookup_callback_t *callback,
@@ -0,0 +1,177 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "str.h"
+#include "istream.h"
+#include "strnum.h"
+#include "write-full.h"
+#include "dict-private.h"
+#include "test-common.h"
+#include "test-subprocess.h"
+
+#include <unistd.h>
+
+#define TEST_SOCKET "./test-dict-redis.sock"
+#define SERVER_KILL_TIMEOUT_SECS 20
+
+static const struct dict_op_settings test_dict_op_set = {
+	.username = "testuser",
+};
+
+/* Number of GET commands the server reads before it replies to any of
+   them. If the client didn't pipeline them, the lookup would time out. */
+static const unsigned int test_server_batches[] = { 3, 1 };
+
+static int fd_listen = -1;
+
+static const char *test_server_read_arg(struct istream *input)
+{
+	const char *line;
+	unsigned int len;
+
+	line = i_stream_read_next_line(input);
+	if (line == NULL || line[0] != '$' || str_to_uint(line + 1, &len) < 0)
+		return NULL;
+	line = i_stream_read_next_line(input);
+	if (line == NULL || strlen(line) != len)
+		return NULL;
+	return line;
+}
+
+static const char *test_server_read_get(struct istream *input)
+{
+	const char *line, *key;
+
+	line = i_stream_read_next_line(input);
+	if (line == NULL || strcmp(line, "*2") != 0)
+		return NULL;
+	line = test_server_read_arg(input);
+	if (line == NULL || strcmp(line, "GET") != 0)
+		return NULL;
+	key = test_server_read_arg(input);
+	return key == NULL ? NULL : t_strdup(key);
+}
+
+static void test_server_reply(string_t *str, const char *key)
+{
+	const char *value = NULL;
+
+	if (strcmp(key, "key1") == 0)
+		value = "value1";
+	else if (strcmp(key, "testuser/key2") == 0)
+		value = "value2";
+
+	if (value == NULL)
+		str_append(str, "$-1\r\n");
+	else
+		str_printfa(str, "$%zu\r\n%s\r\n", strlen(value), value);
+}
+
+static int test_server(void *context ATTR_UNUSED)
+{
+	struct istream *input;
+	string_t *reply;
+	const char *key;
+	unsigned int i, j;
+	int fd;
+
+	i_set_failure_prefix("SERVER: ");
+	fd = net_accept(fd_listen, NULL, NULL);
+	if (fd < 0)
+		i_fatal("accept() failed: %m");
+	i_close_fd(&fd_listen);
+
+	input = i_stream_create_fd(fd, SIZE_MAX);
+	reply = t_str_new(128);
+	for (i = 0; i < N_ELEMENTS(test_server_batches); i++) {
+		str_truncate(reply, 0);
+		for (j = 0; j < test_server_batches[i]; j++) {
+			key = test_server_read_get(input);
+			if (key == NULL)
+				i_fatal("Unexpected command");
+			test_server_reply(reply, key);
+		}
+		if (write_full(fd, str_data(reply), str_len(reply)) < 0)
+			i_fatal("write() failed: %m");
+	}
+	i_stream_destroy(&input);
+	i_close_fd(&fd);
+	return 0;
+}
+
+static void test_dict_redis_lookup_multi(void)
+{
+	const char *const keys[] = {
+		"shared/key1",
+		"shared/missing",
+		"priv/key2",
+		NULL
+	};
+	struct dict_legacy_settings set = {
+		.base_dir = ".",
+	};
+	struct ioloop *ioloop;
+	struct dict *dict;
+	const char *const *values, *value, *error;
+
+	test_begin("dict redis lookup multi");
+	i_unlink_if_exists(TEST_SOCKET);
+	fd_listen = net_listen_unix(TEST_SOCKET, 1);
+	if (fd_listen == -1)
+		i_fatal("listen("TEST_SOCKET") failed: %m");
+	test_subprocess_fork(test_server, NULL, FALSE);
+	i_close_fd(&fd_listen);
+
+	ioloop = io_loop_create();
+	if (dict_init_legacy("redis:path="TEST_SOCKET":timeout_msecs=5000",
+			     &set, &dict, &error) < 0)
+		i_fatal("dict_init_legacy() failed: %s", error);
+
+	/* all the GETs are sent before any reply is read */
+	test_assert(dict_lookup_multi(dict, &test_dict_op_set,
+				      pool_datastack_create(), keys,
+				      &values, &error) == 1);
+	test_assert_strcmp(values[0], "value1");
+	test_assert(values[1] == NULL);
+	test_assert_strcmp(values[2], "value2");
+	test_assert(values[3] == NULL);
+
+	/* a single lookup uses the same code path */
+	test_assert(dict_lookup(dict, &test_dict_op_set,
+				pool_datastack_create(), "shared/missing",
+				&value, &error) == 0);
+	test_assert(value == NULL);
+
+	dict_deinit(&dict);
+	io_loop_destroy(&ioloop);
+	test_subprocess_kill_all(SERVER_KILL_TIMEOUT_SECS);
+	i_unlink_if_exists(TEST_SOCKET);
+	test_end();
+}
+
+static void main_cleanup(void)
+{
+	i_unlink_if_exists(TEST_SOCKET);
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_dict_redis_lookup_multi,
+		NULL
+	};
+	int ret;
+
+	lib_init();
+	dict_driver_register(&dict_driver_redis);
+	test_subprocesses_init(FALSE);
+	test_subprocess_set_cleanup_callback(main_cleanup);
+
+	ret = test_run(test_functions);
+
+	test_subprocesses_deinit();
+	dict_driver_unregister(&dict_driver_redis);
+	lib_deinit();
+	return ret;
+}
@@ -0,0 +1,479 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "hash.h"
+#include "llist.h"
+#include "str-parse.h"
+#include "istream.h"
+#include "istream-private.h"
+#include "fs-api-private.h"
+
+#include <sys/stat.h>
+
+#define FS_CACHE_DEFAULT_MAX_SIZE (1024*1024)
+
+/* The cache is kept in memory and it only knows about the changes done via
+   this same fs instance. So it's mainly useful for objects that don't change
+   after they're written, or that are changed only by this process. */
+struct cache_fs_entry {
+	struct cache_fs_entry *prev, *next;
+	char *path;
+
+	/* NULL if only stat is cached */
+	buffer_t *data;
+	struct stat st;
+	bool st_set;
+};
+
+struct cache_fs {
+	struct fs fs;
+	uoff_t max_size, max_object_size;
+
+	uoff_t cur_size;
+	/* Increased every time something is invalidated. Used to avoid
+	   adding stale data to the cache from streams that were opened
+	   before the invalidation. */
+	unsigned int change_counter;
+
+	HASH_TABLE(char *, struct cache_fs_entry *) entries;
+	/* head is the most recently used entry */
+	struct cache_fs_entry *lru_head, *lru_tail;
+};
+
+struct cache_fs_istream {
+	struct istream_private istream;
+	struct cache_fs *fs;
+	char *path;
+	unsigned int change_counter;
+
+	buffer_t *data;
+};
+
+#define CACHE_FS(ptr)	container_of((ptr), struct cache_fs, fs)
+
+static struct fs *fs_cache_alloc(void)
+{
+	struct cache_fs *fs;
+
+	fs = i_new(struct cache_fs, 1);
+	fs->fs = fs_class_cache;
+	fs->max_size = FS_CACHE_DEFAULT_MAX_SIZE;
+	hash_table_create(&fs->entries, default_pool, 0, str_hash, strcmp);
+	return &fs->fs;
+}
+
+static int fs_cache_parse_params(struct cache_fs *fs,
+				 const char *params, const char **error_r)
+{
+	const char *const *tmp;
+	const char *error;
+
+	for (tmp = t_strsplit_spaces(params, ","); *tmp != NULL; tmp++) {
+		const char *key = *tmp;
+		const char *value = strchr(key, '=');
+
+		if (value == NULL) {
+			*error_r = "Missing '='";
+			return -1;
+		}
+		key = t_strdup_until(key, value++);
+		if (strcmp(key, "size") == 0) {
+			if (str_parse_get_size(value, &fs->max_size, &error) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid size: %s", error);
+				return -1;
+			}
+		} else if (strcmp(key, "object_size") == 0) {
+			if (str_parse_get_size(value, &fs->max_object_size,
+					       &error) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid object_size: %s", error);
+				return -1;
+			}
+		} else {
+			*error_r = t_strdup_printf("Unknown key '%s'", key);
+			return -1;
+		}
+	}
+	if (fs->max_object_size == 0 || fs->max_object_size > fs->max_size) {
+		/* by default allow a single object to use up to 1/8 of
+		   the cache */
+		fs->max_object_size = fs->max_size / 8;
+	}
+	return 0;
+}
+
+static int
+fs_cache_init(struct fs *_fs, const char *args,
+	      const struct fs_settings *set, const char **error_r)
+{
+	struct cache_fs *fs = CACHE_FS(_fs);
+	const char *p, *parent_name, *parent_args, *error;
+
+	p = strchr(args, ':');
+	if (p == NULL) {
+		*error_r = "Cache parameters missing";
+		return -1;
+	}
+	if (fs_cache_parse_params(fs, t_strdup_until(args, p++), &error) < 0) {
+		*error_r = t_strdup_printf(
+			"Invalid cache parameters: %s", error);
+		return -1;
+	}
+	args = p;
+
+	if (*args == '\0') {
+		*error_r = "Parent filesystem not given as parameter";
+		return -1;
+	}
+
+	parent_args = strchr(args, ':');
+	if (parent_args == NULL) {
+		parent_name = args;
+		parent_args = "";
+	} else {
+		parent_name = t_strdup_until(args, parent_args);
+		parent_args++;
+	}
+	if (fs_init(parent_name, parent_args, set, &_fs->parent, error_r) < 0)
+		return -1;
+	return 0;
+}
+
+static size_t fs_cache_entry_size(const struct cache_fs_entry *entry)
+{
+	return sizeof(*entry) + strlen(entry->path) +
+		(entry->data == NULL ? 0 : entry->data->used);
+}
+
+static void
+fs_cache_entry_free(struct cache_fs *fs, struct cache_fs_entry *entry)
+{
+	i_assert(fs->cur_size >= fs_cache_entry_size(entry));
+	fs->cur_size -= fs_cache_entry_size(entry);
+
+	hash_table_remove(fs->entries, entry->path);
+	DLLIST2_REMOVE(&fs->lru_head, &fs->lru_tail, entry);
+	buffer_free(&entry->data);
+	i_free(entry->path);
+	i_free(entry);
+}
+
+static void fs_cache_deinit(struct fs *_fs)
+{
+	struct cache_fs *fs = CACHE_FS(_fs);
+
+	while (fs->lru_head != NULL)
+		fs_cache_entry_free(fs, fs->lru_head);
+}
+
+static void fs_cache_free(struct fs *_fs)
+{
+	struct cache_fs *fs = CACHE_FS(_fs);
+
+	hash_table_destroy(&fs->entries);
+	i_free(fs);
+}
+
+static struct cache_fs_entry *
+fs_cache_lookup(struct cache_fs *fs, const char *path)
+{
+	struct cache_fs_entry *entry;
+
+	entry = hash_table_lookup(fs->entries, path);
+	if (entry != NULL && entry != fs->lru_head) {
+		DLLIST2_REMOVE(&fs->lru_head, &fs->lru_tail, entry);
+		DLLIST2_PREPEND(&fs->lru_head, &fs->lru_tail, entry);
+	}
+	return entry;
+}
+
+static struct cache_fs_entry *
+fs_cache_get_entry(struct cache_fs *fs, const char *path)
+{
+	struct cache_fs_entry *entry;
+
+	entry = fs_cache_lookup(fs, path);
+	if (entry == NULL) {
+		entry = i_new(struct cache_fs_entry, 1);
+		entry->path = i_strdup(path);
+		hash_table_insert(fs->entries, entry->path, entry);
+		DLLIST2_PREPEND(&fs->lru_head, &fs->lru_tail, entry);
+		fs->cur_size += fs_cache_entry_size(entry);
+	}
+	return entry;
+}
+
+static void fs_cache_shrink(struct cache_fs *fs)
+{
+	/* never drop the most recently added entry */
+	while (fs->cur_size > fs->max_size && fs->lru_tail != fs->lru_head)
+		fs_cache_entry_free(fs, fs->lru_tail);
+}
+
+static void fs_cache_invalidate(struct cache_fs *fs, const char *path)
+{
+	struct cache_fs_entry *entry;
+
+	fs->change_counter++;
+	entry = hash_table_lookup(fs->entries, path);
+	if (entry != NULL)
+		fs_cache_entry_free(fs, entry);
+}
+
+static void
+fs_cache_add_data(struct cache_fs *fs, const char *path, buffer_t **_data)
+{
+	struct cache_fs_entry *entry;
+	buffer_t *data = *_data;
+
+	*_data = NULL;
+	entry = fs_cache_get_entry(fs, path);
+	if (entry->data != NULL) {
+		fs->cur_size -= entry->data->used;
+		buffer_free(&entry->data);
+	}
+	entry->data = data;
+	fs->cur_size += data->used;
+	fs_cache_shrink(fs);
+}
+
+static enum fs_properties fs_cache_get_properties(struct fs *_fs)
+{
+	return fs_get_properties(_fs->parent);
+}
+
+static struct fs_file *fs_cache_file_alloc(void)
+{
+	struct fs_file *file = i_new(struct fs_file, 1);
+	return file;
+}
+
+static void
+fs_cache_file_init(struct fs_file *file, const char *path,
+		   enum fs_open_mode mode, enum fs_open_flags flags)
+{
+	file->path = i_strdup(path);
+	file->parent = fs_file_init_parent(file, path, mode, flags);
+}
+
+static void fs_cache_file_deinit(struct fs_file *file)
+{
+	fs_file_free(file);
+	i_free(file->path);
+	i_free(file);
+}
+
+static ssize_t i_stream_cache_fs_read(struct istream_private *stream)
+{
+	struct cache_fs_istream *cstream =
+		container_of(stream, struct cache_fs_istream, istream);
+	uoff_t start_offset;
+	size_t skip;
+	ssize_t ret;
+
+	i_stream_seek(stream->parent, stream->parent_start_offset +
+		      stream->istream.v_offset);
+
+	ret = i_stream_read_copy_from_parent(&stream->istream);
+	if (cstream->data == NULL)
+		return ret;
+
+	if (ret > 0) {
+		/* offset where the newly read data begins */
+		start_offset = stream->istream.v_offset +
+			(stream->pos - stream->skip) - ret;
+		if (start_offset > cstream->data->used ||
+		    start_offset + ret > cstream->fs->max_object_size) {
+			/* seeked forward or too large - don't cache */
+			buffer_free(&cstream->data);
+		} else if (start_offset + ret > cstream->data->used) {
+			skip = cstream->data->used - start_offset;
+			buffer_append(cstream->data,
+				      stream->buffer + stream->pos - ret + skip,
+				      ret - skip);
+		}
+	} else if (ret == -1 && stream->istream.stream_errno == 0 &&
+		   stream->istream.v_offset + (stream->pos - stream->skip) ==
+		   cstream->data->used) {
+		/* read the whole object. add it to cache unless it was
+		   modified while being read. */
+		if (cstream->change_counter == cstream->fs->change_counter) {
+			fs_cache_add_data(cstream->fs, cstream->path,
+					  &cstream->data);
+		} else {
+			buffer_free(&cstream->data);
+		}
+	}
+	return ret;
+}
+
+static void i_stream_cache_fs_destroy(struct iostream_private *stream)
+{
+	struct cache_fs_istream *cstream =
+		container_of(stream, struct cache_fs_istream, istream.iostream);
+	struct fs *fs = &cstream->fs->fs;
+
+	buffer_free(&cstream->data);
+	i_free(cstream->path);
+	fs_unref(&fs);
+	i_stream_free_buffer(&cstream->istream);
+}
+
+static struct istream *
+i_stream_create_cache_fs(struct istream *input, struct fs_file *file)
+{
+	struct cache_fs_istream *cstream;
+
+	cstream = i_new(struct cache_fs_istream, 1);
+	cstream->fs = CACHE_FS(file->fs);
+	fs_ref(&cstream->fs->fs);
+	cstream->path = i_strdup(fs_file_path(file));
+	cstream->change_counter = cstream->fs->change_counter;
+	cstream->data = buffer_create_dynamic(default_pool, 1024);
+
+	cstream->istream.max_buffer_size = input->real_stream->max_buffer_size;
+	cstream->istream.stream_size_passthrough = TRUE;
+	cstream->istream.read = i_stream_cache_fs_read;
+	cstream->istream.iostream.destroy = i_stream_cache_fs_destroy;
+	cstream->istream.istream.blocking = input->blocking;
+	cstream->istream.istream.seekable = input->seekable;
+	return i_stream_create(&cstream->istream, input,
+			       i_stream_get_fd(input), 0);
+}
+
+static struct istream *
+fs_cache_read_stream(struct fs_file *file, size_t max_buffer_size)
+{
+	struct cache_fs *fs = CACHE_FS(file->fs);
+	struct cache_fs_entry *entry;
+	struct istream *input, *input2;
+
+	entry = fs_cache_lookup(fs, fs_file_path(file));
+	if (entry != NULL && entry->data != NULL) {
+		input = i_stream_create_copy_from_buffer(entry->data);
+		i_stream_set_name(input, fs_file_path(file));
+		return input;
+	}
+
+	input = fs_read_stream(file->parent, max_buffer_size);
+	if (input->stream_errno != 0)
+		return input;
+	input2 = i_stream_create_cache_fs(input, file);
+	i_stream_unref(&input);
+	return input2;
+}
+
+static int fs_cache_write(struct fs_file *file, const void *data, size_t size)
+{
+	fs_cache_invalidate(CACHE_FS(file->fs), fs_file_path(file));
+	return fs_write(file->parent, data, size);
+}
+
+static int fs_cache_write_stream_finish(struct fs_file *file, bool success)
+{
+	struct cache_fs *fs = CACHE_FS(file->fs);
+	int ret;
+
+	/* invalidate also on failure, since the object may have been
+	   partially overwritten */
+	fs_cache_invalidate(fs, fs_file_path(file));
+	ret = fs_wrapper_write_stream_finish(file, success);
+	/* FS_METADATA_WRITE_FNAME may have changed the path */
+	fs_cache_invalidate(fs, fs_file_path(file));
+	return ret;
+}
+
+static int fs_cache_exists(struct fs_file *file)
+{
+	struct cache_fs *fs = CACHE_FS(file->fs);
+
+	if (fs_cache_lookup(fs, fs_file_path(file)) != NULL)
+		return 1;
+	return fs_exists(file->parent);
+}
+
+static int fs_cache_stat(struct fs_file *file, struct stat *st_r)
+{
+	struct cache_fs *fs = CACHE_FS(file->fs);
+	struct cache_fs_entry *entry;
+
+	entry = fs_cache_lookup(fs, fs_file_path(file));
+	if (entry != NULL && entry->st_set) {
+		*st_r = entry->st;
+		return 0;
+	}
+	if (fs_stat(file->parent, st_r) < 0)
+		return -1;
+
+	entry = fs_cache_get_entry(fs, fs_file_path(file));
+	entry->st = *st_r;
+	entry->st_set = TRUE;
+	fs_cache_shrink(fs);
+	return 0;
+}
+
+static int fs_cache_copy(struct fs_file *src, struct fs_file *dest)
+{
+	struct cache_fs *fs = CACHE_FS(dest->fs);
+	int ret;
+
+	fs_cache_invalidate(fs, fs_file_path(dest));
+	ret = fs_wrapper_copy(src, dest);
+	/* FS_METADATA_WRITE_FNAME may have changed the path */
+	fs_cache_invalidate(fs, fs_file_path(dest));
+	return ret;
+}
+
+static int fs_cache_rename(struct fs_file *src, struct fs_file *dest)
+{
+	fs_cache_invalidate(CACHE_FS(src->fs), fs_file_path(src));
+	fs_cache_invalidate(CACHE_FS(dest->fs), fs_file_path(dest));
+	return fs_wrapper_rename(src, dest);
+}
+
+static int fs_cache_delete(struct fs_file *file)
+{
+	fs_cache_invalidate(CACHE_FS(file->fs), fs_file_path(file));
+	return fs_wrapper_delete(file);
+}
+
+const struct fs fs_class_cache = {
+	.name = "cache",
+	.v = {
+		.alloc = fs_cache_alloc,
+		.init = fs_cache_init,
+		.deinit = fs_cache_deinit,
+		.free = fs_cache_free,
+		.get_properties = fs_cache_get_properties,
+		.file_alloc = fs_cache_file_alloc,
+		.file_init = fs_cache_file_init,
+		.file_deinit = fs_cache_file_deinit,
+		.file_close = fs_wrapper_file_close,
+		.get_path = fs_wrapper_file_get_path,
+		.set_async_callback = fs_wrapper_set_async_callback,
+		.wait_async = fs_wrapper_wait_async,
+		.set_metadata = fs_wrapper_set_metadata,
+		.get_metadata = fs_wrapper_get_metadata,
+		.prefetch = fs_wrapper_prefetch,
+		.read = NULL,
+		.read_stream = fs_cache_read_stream,
+		.write = fs_cache_write,
+		.write_stream = fs_wrapper_write_stream,
+		.write_stream_finish = fs_cache_write_stream_finish,
+		.lock = fs_wrapper_lock,
+		.unlock = fs_wrapper_unlock,
+		.exists = fs_cache_exists,
+		.stat = fs_cache_stat,
+		.copy = fs_cache_copy,
+		.rename = fs_cache_rename,
+		.delete_file = fs_cache_delete,
+		.iter_alloc = fs_wrapper_iter_alloc,
+		.iter_init = fs_wrapper_iter_init,
+		.iter_next = fs_wrapper_iter_next,
+		.iter_deinit = fs_wrapper_iter_deinit,
+		.switch_ioloop = NULL,
+		.get_nlinks = fs_wrapper_get_nlinks,
+	}
+};
@@ -8,6 +8,7 @@
 struct fs_file_istream {
 	struct istream_private istream;
 	struct fs_file *file;
+	struct istream *prefetch_next;
 };
 
 static void i_stream_fs_file_close(struct iostream_private *stream,
@@ -16,6 +17,7 @@ static void i_stream_fs_file_close(struct iostream_private *stream,
 	struct fs_file_istream *fstream = (struct fs_file_istream *)stream;
 
 	i_stream_destroy(&fstream->istream.parent);
+	i_stream_unref(&fstream->prefetch_next);
 	fs_file_deinit(&fstream->file);
 }
 
@@ -29,6 +31,16 @@ static ssize_t i_stream_fs_file_read(struct istream_private *stream)
 			i_stream_get_max_buffer_size(&stream->istream));
 		i_stream_init_parent(stream, input);
 		i_stream_unref(&input);
+
+		if (fstream->prefetch_next != NULL) {
+			struct fs_file_istream *next =
+				(struct fs_file_istream *)
+				fstream->prefetch_next->real_stream;
+
+			if (next->istream.parent == NULL && next->file != NULL)
+				(void)fs_prefetch(next->file, 0);
+			i_stream_unref(&fstream->prefetch_next);
+		}
 	}
 
 	i_stream_seek(stream->parent, stream->parent_start_offset +
@@ -59,3 +71,19 @@ i_stream_create_fs_file(struct fs_file **file, size_t max_buffer_size)
 	*file = NULL;
 	return input;
 }
+
+void i_stream_fs_file_set_prefetch_next(struct istream *input,
+					struct istream *next)
+{
+	struct fs_file_istream *fstream =
+		(struct fs_file_istream *)input->real_stream;
+
+	i_assert(input->real_stream->read == i_stream_fs_file_read);
+	i_assert(next->real_stream->read == i_stream_fs_file_read);
+	i_assert(fstream->prefetch_next == NULL);
+
+	if (fstream->istream.parent == NULL) {
+		fstream->prefetch_next = next;
+		i_stream_ref(next);
+	}
+}
@@ -9,5 +9,11 @@ struct fs_file;
    double-freed). */
 struct istream *
 i_stream_create_fs_file(struct fs_file **file, size_t max_buffer_size);
+/* Start prefetching the next stream's file when the input's file is opened.
+   Both streams must have been created with i_stream_create_fs_file(). This
+   allows reading a sequence of files without waiting for each one of them
+   separately. */
+void i_stream_fs_file_set_prefetch_next(struct istream *input,
+					struct istream *next);
 
 #endif
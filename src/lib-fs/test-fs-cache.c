@@ -0,0 +1,250 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "str.h"
+#include "istream.h"
+#include "fs-test.h"
+#include "safe-mkdir.h"
+#include "test-common.h"
+#include "unlink-directory.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char testdir[] = ".test-fs-cache";
+
+static unsigned int test_fs_cache_parent_reads(struct fs *fs)
+{
+	return fs_get_stats(fs_get_parent(fs))->read_count;
+}
+
+static const char *test_fs_cache_fill(size_t size, char chr)
+{
+	char *str = t_malloc_no0(size + 1);
+
+	memset(str, chr, size);
+	str[size] = '\0';
+	return str;
+}
+
+static void test_fs_cache_write_file(struct fs *fs, const char *path,
+				     const char *data)
+{
+	struct fs_file *file;
+
+	file = fs_file_init(fs, path, FS_OPEN_MODE_REPLACE);
+	test_assert(fs_write(file, data, strlen(data)) == 0);
+	fs_file_deinit(&file);
+}
+
+static const char *test_fs_cache_read_file(struct fs *fs, const char *path)
+{
+	struct fs_file *file;
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+	string_t *str = t_str_new(128);
+
+	file = fs_file_init(fs, path, FS_OPEN_MODE_READONLY);
+	input = fs_read_stream(file, IO_BLOCK_SIZE);
+	while (i_stream_read_more(input, &data, &size) > 0) {
+		str_append_data(str, data, size);
+		i_stream_skip(input, size);
+	}
+	if (input->stream_errno != 0)
+		str_truncate(str, 0);
+	i_stream_unref(&input);
+	fs_file_deinit(&file);
+	return str_c(str);
+}
+
+static void test_fs_cache_init(const char *params, struct fs **fs_r)
+{
+	struct fs_settings fs_set;
+	const char *error;
+
+	if (unlink_directory(testdir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_fatal("unlink_directory(%s) failed: %s", testdir, error);
+	if (safe_mkdir(testdir, 0700, (uid_t)-1, (gid_t)-1) != 1)
+		i_fatal("safe_mkdir(%s) failed", testdir);
+
+	i_zero(&fs_set);
+	if (fs_init("cache", t_strdup_printf("%s:posix:prefix=%s/",
+					     params, testdir),
+		    &fs_set, fs_r, &error) < 0)
+		i_fatal("fs_init() failed: %s", error);
+}
+
+static void test_fs_cache_deinit(struct fs **fs)
+{
+	const char *error;
+
+	fs_deinit(fs);
+	if (unlink_directory(testdir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", testdir, error);
+}
+
+static void test_fs_cache_read(void)
+{
+	struct fs *fs;
+	struct fs_file *file;
+	unsigned int reads;
+
+	test_begin("fs cache read");
+	test_fs_cache_init("", &fs);
+	test_fs_cache_write_file(fs, "foo", "hello world");
+
+	reads = test_fs_cache_parent_reads(fs);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "foo"), "hello world");
+	test_assert(test_fs_cache_parent_reads(fs) == reads + 1);
+
+	/* the second read comes from cache even after the backend file is
+	   gone */
+	test_assert(unlink(t_strdup_printf("%s/foo", testdir)) == 0);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "foo"), "hello world");
+	test_assert(test_fs_cache_parent_reads(fs) == reads + 1);
+
+	file = fs_file_init(fs, "foo", FS_OPEN_MODE_READONLY);
+	test_assert(fs_exists(file) == 1);
+	fs_file_deinit(&file);
+
+	test_fs_cache_deinit(&fs);
+	test_end();
+}
+
+static void test_fs_cache_invalidate(void)
+{
+	struct fs *fs;
+	struct fs_file *file, *dest;
+	struct stat st;
+
+	test_begin("fs cache invalidate");
+	test_fs_cache_init("", &fs);
+
+	/* write */
+	test_fs_cache_write_file(fs, "foo", "first");
+	test_assert_strcmp(test_fs_cache_read_file(fs, "foo"), "first");
+	test_fs_cache_write_file(fs, "foo", "second");
+	test_assert_strcmp(test_fs_cache_read_file(fs, "foo"), "second");
+
+	/* stat */
+	file = fs_file_init(fs, "foo", FS_OPEN_MODE_READONLY);
+	test_assert(fs_stat(file, &st) == 0 && st.st_size == 6);
+	fs_file_deinit(&file);
+	test_fs_cache_write_file(fs, "foo", "third!!");
+	file = fs_file_init(fs, "foo", FS_OPEN_MODE_READONLY);
+	test_assert(fs_stat(file, &st) == 0 && st.st_size == 7);
+	fs_file_deinit(&file);
+
+	/* copy */
+	test_fs_cache_write_file(fs, "bar", "bar");
+	test_assert_strcmp(test_fs_cache_read_file(fs, "bar"), "bar");
+	file = fs_file_init(fs, "foo", FS_OPEN_MODE_READONLY);
+	dest = fs_file_init(fs, "bar", FS_OPEN_MODE_REPLACE);
+	test_assert(fs_copy(file, dest) == 0);
+	fs_file_deinit(&file);
+	fs_file_deinit(&dest);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "bar"), "third!!");
+
+	/* rename */
+	test_fs_cache_write_file(fs, "baz", "baz");
+	test_assert_strcmp(test_fs_cache_read_file(fs, "baz"), "baz");
+	file = fs_file_init(fs, "baz", FS_OPEN_MODE_READONLY);
+	dest = fs_file_init(fs, "bar", FS_OPEN_MODE_REPLACE);
+	test_assert(fs_rename(file, dest) == 0);
+	fs_file_deinit(&file);
+	fs_file_deinit(&dest);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "bar"), "baz");
+	file = fs_file_init(fs, "baz", FS_OPEN_MODE_READONLY);
+	test_assert(fs_exists(file) == 0);
+	fs_file_deinit(&file);
+
+	/* delete */
+	file = fs_file_init(fs, "foo", FS_OPEN_MODE_READONLY);
+	test_assert(fs_delete(file) == 0);
+	test_assert(fs_exists(file) == 0);
+	fs_file_deinit(&file);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "foo"), "");
+
+	file = fs_file_init(fs, "bar", FS_OPEN_MODE_READONLY);
+	test_assert(fs_delete(file) == 0);
+	fs_file_deinit(&file);
+	test_fs_cache_deinit(&fs);
+	test_end();
+}
+
+static void test_fs_cache_limits(void)
+{
+	struct fs *fs;
+	unsigned int reads;
+	const char *large = test_fs_cache_fill(600, 'x');
+
+	test_begin("fs cache limits");
+	test_fs_cache_init("size=2k,object_size=512", &fs);
+
+	/* too large objects aren't cached */
+	test_fs_cache_write_file(fs, "large", large);
+	reads = test_fs_cache_parent_reads(fs);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "large"), large);
+	test_assert_strcmp(test_fs_cache_read_file(fs, "large"), large);
+	test_assert(test_fs_cache_parent_reads(fs) == reads + 2);
+
+	/* the least recently used objects are dropped */
+	test_fs_cache_write_file(fs, "a", test_fs_cache_fill(300, 'a'));
+	test_fs_cache_write_file(fs, "b", test_fs_cache_fill(300, 'b'));
+	test_fs_cache_write_file(fs, "c", test_fs_cache_fill(300, 'c'));
+	test_fs_cache_write_file(fs, "d", test_fs_cache_fill(300, 'd'));
+	test_fs_cache_write_file(fs, "e", test_fs_cache_fill(300, 'e'));
+	reads = test_fs_cache_parent_reads(fs);
+	(void)test_fs_cache_read_file(fs, "a");
+	(void)test_fs_cache_read_file(fs, "b");
+	(void)test_fs_cache_read_file(fs, "c");
+	(void)test_fs_cache_read_file(fs, "d");
+	test_assert(test_fs_cache_parent_reads(fs) == reads + 4);
+	(void)test_fs_cache_read_file(fs, "a");
+	(void)test_fs_cache_read_file(fs, "e");
+	test_assert(test_fs_cache_parent_reads(fs) == reads + 5);
+	/* "b" was dropped to make room for "e" */
+	(void)test_fs_cache_read_file(fs, "a");
+	(void)test_fs_cache_read_file(fs, "b");
+	test_assert(test_fs_cache_parent_reads(fs) == reads + 6);
+
+	test_fs_cache_deinit(&fs);
+	test_end();
+}
+
+static void test_fs_cache_init_errors(void)
+{
+	struct fs_settings fs_set;
+	struct fs *fs;
+	const char *error;
+
+	test_begin("fs cache init errors");
+	i_zero(&fs_set);
+	test_assert(fs_init("cache", "", &fs_set, &fs, &error) < 0);
+	test_assert(fs_init("cache", "size=1k", &fs_set, &fs, &error) < 0);
+	test_assert(fs_init("cache", "size=1k:", &fs_set, &fs, &error) < 0);
+	test_assert(fs_init("cache", "size=foo:posix", &fs_set, &fs, &error) < 0);
+	test_assert(fs_init("cache", "foo=1:posix", &fs_set, &fs, &error) < 0);
+	test_assert(fs_init("cache", "size=1k:posix", &fs_set, &fs, &error) == 0);
+	fs_deinit(&fs);
+	test_end();
+}
+
+static void test_fs_cache_async(void)
+{
+	test_fs_async("cache", 0, "cache", "size=1k:test");
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_fs_cache_read,
+		test_fs_cache_invalidate,
+		test_fs_cache_limits,
+		test_fs_cache_init_errors,
+		test_fs_cache_async,
+		NULL
+	};
+	return test_run(test_functions);
+}
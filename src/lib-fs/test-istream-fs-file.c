@@ -0,0 +1,59 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "str.h"
+#include "istream.h"
+#include "istream-fs-file.h"
+#include "fs-test.h"
+#include "test-common.h"
+
+static void test_istream_fs_file_prefetch_next(void)
+{
+	struct fs_settings fs_set;
+	struct fs *fs;
+	struct fs_file *file;
+	struct test_fs_file *test_files[3];
+	struct istream *inputs[3];
+	const char *error;
+	unsigned int i;
+
+	test_begin("istream fs file prefetch next");
+	i_zero(&fs_set);
+	if (fs_init("test", "", &fs_set, &fs, &error) < 0)
+		i_fatal("fs_init() failed: %s", error);
+
+	for (i = 0; i < N_ELEMENTS(inputs); i++) {
+		const char *path = t_strdup_printf("file%u", i);
+
+		file = fs_file_init(fs, path, FS_OPEN_MODE_READONLY);
+		test_files[i] = test_fs_file_get(fs, path);
+		str_printfa(test_files[i]->contents, "data%u", i);
+		inputs[i] = i_stream_create_fs_file(&file, IO_BLOCK_SIZE);
+		if (i > 0)
+			i_stream_fs_file_set_prefetch_next(inputs[i-1], inputs[i]);
+	}
+
+	test_assert(!test_files[1]->prefetched);
+	test_assert(i_stream_read(inputs[0]) > 0);
+	test_assert(test_files[1]->prefetched);
+	test_assert(!test_files[2]->prefetched);
+
+	/* the previous stream keeps its own reference to the next one */
+	i_stream_unref(&inputs[2]);
+	test_assert(i_stream_read(inputs[1]) > 0);
+	test_assert(test_files[2]->prefetched);
+
+	i_stream_unref(&inputs[0]);
+	i_stream_unref(&inputs[1]);
+	fs_deinit(&fs);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_istream_fs_file_prefetch_next,
+		NULL
+	};
+	return test_run(test_functions);
+}
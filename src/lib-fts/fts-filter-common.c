@@ -8,6 +8,8 @@
 #include "fts-filter-common.h"
 #include "fts-tokenizer-common.h"
 
+#include <ctype.h>
+
 void fts_filter_truncate_token(string_t *token, size_t max_length)
 {
 	if (str_len(token) <= max_length)
@@ -18,3 +20,22 @@ void fts_filter_truncate_token(string_t *token, size_t max_length)
 	str_truncate(token, len);
 	i_assert(len <= max_length);
 }
+
+bool fts_filter_ascii_lcase(string_t *dest, const char *token,
+			    bool remove_spaces)
+{
+	const unsigned char *p = (const unsigned char *)token;
+	size_t i;
+
+	for (i = 0; p[i] != '\0'; i++) {
+		if (p[i] >= 0x80)
+			return FALSE;
+	}
+
+	str_truncate(dest, 0);
+	for (i = 0; p[i] != '\0'; i++) {
+		if (p[i] != ' ' || !remove_spaces)
+			str_append_c(dest, i_tolower(p[i]));
+	}
+	return TRUE;
+}
@@ -2,5 +2,10 @@
 #define FTS_FILTER_COMMON_H
 
 void fts_filter_truncate_token(string_t *token, size_t max_length);
+/* If token is pure ASCII, write it lowercased to dest (optionally with spaces
+   removed) and return TRUE. Otherwise return FALSE. This allows skipping the
+   expensive libicu calls for the most common tokens. */
+bool fts_filter_ascii_lcase(string_t *dest, const char *token,
+			    bool remove_spaces);
 
 #endif
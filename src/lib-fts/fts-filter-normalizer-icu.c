@@ -11,10 +11,16 @@
 #ifdef HAVE_LIBICU
 #include "fts-icu.h"
 
+#define FTS_FILTER_NORMALIZER_ICU_DEFAULT_ID \
+	"Any-Lower; NFKD; [: Nonspacing Mark :] Remove; NFC; [\\x20] Remove"
+
 struct fts_filter_normalizer_icu {
 	struct fts_filter filter;
 	pool_t pool;
 	const char *transliterator_id;
+	/* The default transliterator only lowercases ASCII and removes
+	   spaces from it, so that can be done without libicu */
+	bool ascii_fast_path;
 
 	UTransliterator *transliterator;
 	ARRAY_TYPE(icu_utf16) utf16_token, trans_token;
@@ -40,7 +46,7 @@ fts_filter_normalizer_icu_create(const struct fts_language *lang ATTR_UNUSED,
 	struct fts_filter_normalizer_icu *np;
 	pool_t pp;
 	unsigned int i, max_length = 250;
-	const char *id = "Any-Lower; NFKD; [: Nonspacing Mark :] Remove; NFC; [\\x20] Remove";
+	const char *id = FTS_FILTER_NORMALIZER_ICU_DEFAULT_ID;
 
 	for (i = 0; settings[i] != NULL; i += 2) {
 		const char *key = settings[i], *value = settings[i+1];
@@ -65,6 +71,8 @@ fts_filter_normalizer_icu_create(const struct fts_language *lang ATTR_UNUSED,
 	np->pool = pp;
 	np->filter = *fts_filter_normalizer_icu;
 	np->transliterator_id = p_strdup(pp, id);
+	np->ascii_fast_path =
+		strcmp(id, FTS_FILTER_NORMALIZER_ICU_DEFAULT_ID) == 0;
 	p_array_init(&np->utf16_token, pp, 64);
 	p_array_init(&np->trans_token, pp, 64);
 	np->utf8_token = buffer_create_dynamic(pp, 128);
@@ -80,6 +88,16 @@ fts_filter_normalizer_icu_filter(struct fts_filter *filter, const char **token,
 	struct fts_filter_normalizer_icu *np =
 		(struct fts_filter_normalizer_icu *)filter;
 
+	if (np->ascii_fast_path &&
+	    fts_filter_ascii_lcase(np->utf8_token, *token, TRUE)) {
+		if (str_len(np->utf8_token) == 0)
+			return 0;
+		fts_filter_truncate_token(np->utf8_token,
+					  np->filter.max_length);
+		*token = str_c(np->utf8_token);
+		return 1;
+	}
+
 	if (np->transliterator == NULL)
 		if (fts_icu_transliterator_create(np->transliterator_id,
 		                                  &np->transliterator,
@@ -30,6 +30,9 @@ struct fts_filter {
 	string_t *token;
 	size_t max_length;
 	int refcount;
+	/* Results of the whole filter chain, when filtering is started from
+	   this filter */
+	struct fts_filter_cache *cache;
 };
 
 #endif
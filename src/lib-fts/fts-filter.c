@@ -2,6 +2,8 @@
 
 #include "lib.h"
 #include "array.h"
+#include "hash.h"
+#include "llist.h"
 #include "str.h"
 #include "fts-language.h"
 #include "fts-filter-private.h"
@@ -10,6 +12,25 @@
 #  include "fts-icu.h"
 #endif
 
+/* Maximum number of tokens in each filter chain's result cache */
+#define FTS_FILTER_CACHE_MAX_COUNT 1024
+/* Longer tokens are rarely repeated, so they aren't cached */
+#define FTS_FILTER_CACHE_MAX_TOKEN_LEN 64
+
+struct fts_filter_cache_entry {
+	struct fts_filter_cache_entry *prev, *next;
+	/* NULL if the token was filtered out */
+	const char *result;
+	char token[FLEXIBLE_ARRAY_MEMBER];
+};
+
+struct fts_filter_cache {
+	HASH_TABLE(const char *, struct fts_filter_cache_entry *) hash;
+	/* head is the most recently used entry */
+	struct fts_filter_cache_entry *head, *tail;
+	unsigned int count;
+};
+
 static ARRAY(const struct fts_filter *) fts_filter_classes;
 
 void fts_filters_init(void)
@@ -94,6 +115,20 @@ void fts_filter_ref(struct fts_filter *fp)
 	fp->refcount++;
 }
 
+static void fts_filter_cache_free(struct fts_filter_cache **_cache)
+{
+	struct fts_filter_cache *cache = *_cache;
+	struct fts_filter_cache_entry *entry, *next;
+
+	*_cache = NULL;
+	for (entry = cache->head; entry != NULL; entry = next) {
+		next = entry->next;
+		i_free(entry);
+	}
+	hash_table_destroy(&cache->hash);
+	i_free(cache);
+}
+
 void fts_filter_unref(struct fts_filter **_fpp)
 {
 	struct fts_filter *fp = *_fpp;
@@ -106,6 +141,8 @@ void fts_filter_unref(struct fts_filter **_fpp)
 
 	if (fp->parent != NULL)
 		fts_filter_unref(&fp->parent);
+	if (fp->cache != NULL)
+		fts_filter_cache_free(&fp->cache);
 	if (fp->v.destroy != NULL)
 		fp->v.destroy(fp);
 	else {
@@ -115,8 +152,67 @@ void fts_filter_unref(struct fts_filter **_fpp)
 	}
 }
 
-int fts_filter_filter(struct fts_filter *filter, const char **token,
-		      const char **error_r)
+static struct fts_filter_cache_entry *
+fts_filter_cache_lookup(struct fts_filter *filter, const char *token)
+{
+	struct fts_filter_cache *cache = filter->cache;
+	struct fts_filter_cache_entry *entry;
+
+	if (cache == NULL)
+		return NULL;
+	entry = hash_table_lookup(cache->hash, token);
+	if (entry != NULL && entry != cache->head) {
+		DLLIST2_REMOVE(&cache->head, &cache->tail, entry);
+		DLLIST2_PREPEND(&cache->head, &cache->tail, entry);
+	}
+	return entry;
+}
+
+static struct fts_filter_cache_entry *
+fts_filter_cache_add(struct fts_filter *filter, const char *token,
+		     const char *result)
+{
+	struct fts_filter_cache *cache = filter->cache;
+	struct fts_filter_cache_entry *entry, *old_entry;
+	size_t token_size = strlen(token) + 1;
+	size_t result_size = result == NULL ? 0 : strlen(result) + 1;
+
+	if (cache == NULL) {
+		cache = filter->cache = i_new(struct fts_filter_cache, 1);
+		hash_table_create(&cache->hash, default_pool, 0,
+				  str_hash, strcmp);
+	}
+
+	/* copy the strings before dropping anything, since they may point
+	   to an existing entry */
+	entry = i_malloc(MALLOC_ADD(sizeof(*entry),
+				    MALLOC_ADD(token_size, result_size)));
+	memcpy(entry->token, token, token_size);
+	if (result != NULL) {
+		char *result_dup = entry->token + token_size;
+
+		memcpy(result_dup, result, result_size);
+		entry->result = result_dup;
+	}
+
+	if (cache->count == FTS_FILTER_CACHE_MAX_COUNT) {
+		/* drop the least recently used entry */
+		old_entry = cache->tail;
+		hash_table_remove(cache->hash,
+				  (const char *)old_entry->token);
+		DLLIST2_REMOVE(&cache->head, &cache->tail, old_entry);
+		i_free(old_entry);
+		cache->count--;
+	}
+	hash_table_insert(cache->hash, (const char *)entry->token, entry);
+	DLLIST2_PREPEND(&cache->head, &cache->tail, entry);
+	cache->count++;
+	return entry;
+}
+
+static int
+fts_filter_filter_chain(struct fts_filter *filter, const char **token,
+			const char **error_r)
 {
 	int ret = 0;
 
@@ -124,7 +220,7 @@ int fts_filter_filter(struct fts_filter *filter, const char **token,
 
 	/* Recurse to parent. */
 	if (filter->parent != NULL)
-		ret = fts_filter_filter(filter->parent, token, error_r);
+		ret = fts_filter_filter_chain(filter->parent, token, error_r);
 
 	/* Parent returned token or no parent. */
 	if (ret > 0 || filter->parent == NULL)
@@ -138,3 +234,32 @@ int fts_filter_filter(struct fts_filter *filter, const char **token,
 	}
 	return ret;
 }
+
+int fts_filter_filter(struct fts_filter *filter, const char **token,
+		      const char **error_r)
+{
+	struct fts_filter_cache_entry *entry;
+	const char *orig_token = *token;
+	int ret;
+
+	/* The same words keep repeating, so cache the results of the whole
+	   filter chain. This avoids e.g. repeating the ICU normalization and
+	   stemming for them. */
+	if (strlen(orig_token) > FTS_FILTER_CACHE_MAX_TOKEN_LEN)
+		return fts_filter_filter_chain(filter, token, error_r);
+
+	entry = fts_filter_cache_lookup(filter, orig_token);
+	if (entry != NULL) {
+		*token = entry->result;
+		return entry->result == NULL ? 0 : 1;
+	}
+
+	ret = fts_filter_filter_chain(filter, token, error_r);
+	if (ret < 0)
+		return -1;
+	entry = fts_filter_cache_add(filter, orig_token, *token);
+	/* return the cached copy, so it stays valid the same way as the
+	   cache hits do */
+	*token = entry->result;
+	return ret;
+}
@@ -13,6 +13,10 @@
 #include "word-boundary-data.c"
 #include "word-break-data.c"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 /* see comments below between is_base64() and skip_base64() */
 #define FTS_SKIP_BASE64_MIN_SEQUENCES 1
 #define FTS_SKIP_BASE64_MIN_CHARS 50
@@ -32,6 +36,14 @@ static unsigned char fts_ascii_word_breaks[128] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0  /* 112-127: {|}~ */
 };
 
+/* letter_type() of each ASCII character, so that the common case doesn't need
+   the binary searches. Filled by fts_tokenizer_generic_create(). */
+static enum letter_type fts_ascii_letter_types[128];
+static bool fts_ascii_letter_types_initialized;
+
+static enum letter_type letter_type_lookup(unichar_t c);
+static void fts_ascii_letter_types_init(void);
+
 static int
 fts_tokenizer_generic_create(const char *const *settings,
 			     struct fts_tokenizer **tokenizer_r,
@@ -91,6 +103,8 @@ fts_tokenizer_generic_create(const char *const *settings,
 		return -1;
 	}
 
+	fts_ascii_letter_types_init();
+
 	tok = i_new(struct generic_fts_tokenizer, 1);
 	if (algo == BOUNDARY_ALGORITHM_TR29)
 		tok->tokenizer.v = &generic_tokenizer_vfuncs_tr29;
@@ -339,6 +353,57 @@ skip_base64(const unsigned char *data, size_t size)
 	return matches < FTS_SKIP_BASE64_MIN_SEQUENCES ? 0 : start - data;
 }
 
+#ifdef __SSE2__
+static inline __m128i
+sse2_in_range(__m128i v, unsigned char first, unsigned char last)
+{
+	/* bytes >= 0x80 are negative, so they're never in range */
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(first - 1)),
+			     _mm_cmplt_epi8(v, _mm_set1_epi8(last + 1)));
+}
+
+/* Returns the number of bytes at the beginning of data that are ASCII
+   letters, digits or '_'. Like qp_decoder_skip_text_sse2(), this scans 16
+   bytes at a time with SSE2, which is part of the x86-64 baseline. */
+static size_t
+simple_ascii_word_run_sse2(const unsigned char *data, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const void *)(data + i));
+		__m128i word = _mm_or_si128(
+			_mm_or_si128(sse2_in_range(v, '0', '9'),
+				     sse2_in_range(v, 'A', 'Z')),
+			_mm_or_si128(sse2_in_range(v, 'a', 'z'),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+		int mask = ~_mm_movemask_epi8(word) & 0xffff;
+
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+	return i;
+}
+#endif
+
+/* Returns the number of bytes at the beginning of data that are ASCII
+   characters, which continue a word without any special handling. */
+static size_t
+simple_ascii_word_run(const unsigned char *data, size_t size)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	i = simple_ascii_word_run_sse2(data, size);
+#endif
+	for (; i < size; i++) {
+		if (data[i] >= 0x80 || fts_ascii_word_breaks[data[i]] != 0 ||
+		    data[i] == '\'')
+			break;
+	}
+	return i;
+}
+
 static int
 fts_tokenizer_generic_simple_next(struct fts_tokenizer *_tok,
                                   const unsigned char *data, size_t size,
@@ -355,6 +420,18 @@ fts_tokenizer_generic_simple_next(struct fts_tokenizer *_tok,
 
 	start = tok->token->used > 0 ? 0 : skip_base64(data, size);
 	for (i = start; i < size; i += char_size) {
+		if (tok->prev_type == LETTER_TYPE_ALETTER) {
+			/* Fast path: skip over the rest of an ASCII word at
+			   once. Each of its characters would just have been
+			   handled as FTS_WORD_TO_WORD. */
+			size_t run = simple_ascii_word_run(data + i, size - i);
+			if (run > 0) {
+				shift_prev_type(tok, LETTER_TYPE_ALETTER);
+				i += run;
+				if (i == size)
+					break;
+			}
+		}
 		char_size = uni_utf8_get_char_n(data + i, size - i, &c);
 		i_assert(char_size > 0);
 
@@ -415,7 +492,7 @@ fts_tokenizer_generic_simple_next(struct fts_tokenizer *_tok,
    HYPHEN.
    TODO
 */
-static enum letter_type letter_type(unichar_t c)
+static enum letter_type letter_type_lookup(unichar_t c)
 {
 	unsigned int idx;
 
@@ -458,6 +535,26 @@ static enum letter_type letter_type(unichar_t c)
 	return LETTER_TYPE_OTHER;
 }
 
+static void fts_ascii_letter_types_init(void)
+{
+	unichar_t c;
+
+	if (fts_ascii_letter_types_initialized)
+		return;
+	for (c = 0; c < N_ELEMENTS(fts_ascii_letter_types); c++)
+		fts_ascii_letter_types[c] = letter_type_lookup(c);
+	fts_ascii_letter_types_initialized = TRUE;
+}
+
+static inline enum letter_type letter_type(unichar_t c)
+{
+	if (c < N_ELEMENTS(fts_ascii_letter_types)) {
+		i_assert(fts_ascii_letter_types_initialized);
+		return fts_ascii_letter_types[c];
+	}
+	return letter_type_lookup(c);
+}
+
 static bool letter_panic(struct generic_fts_tokenizer *tok ATTR_UNUSED)
 {
 	i_panic("Letter type should not be used.");
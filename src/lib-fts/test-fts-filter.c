@@ -175,6 +175,63 @@ static void test_fts_filter_lowercase_too_long_utf8(void)
 }
 #endif
 
+static void test_fts_filter_cache(void)
+{
+	struct fts_filter *filter, *filter2;
+	const char *input[] = {
+		"The", "quick", "brown", "fox", "jumps", "over", "the", "lazy",
+		"dog", "The", "fox", NULL
+	};
+	const char *output[] = {
+		NULL, "quick", "brown", "fox", "jumps", "over", NULL, "lazy",
+		"dog", NULL, "fox"
+	};
+	const char *error = NULL, *token;
+	unsigned int i, j;
+	int ret;
+
+	test_begin("fts filter cache");
+	test_assert(fts_filter_create(fts_filter_lowercase, NULL, NULL, NULL, &filter, &error) == 0);
+	test_assert(fts_filter_create(fts_filter_stopwords, filter, &english_language, stopword_settings, &filter2, &error) == 0);
+	/* the second round is answered from the cache */
+	for (j = 0; j < 2; j++) {
+		for (i = 0; input[i] != NULL; i++) {
+			token = input[i];
+			ret = fts_filter_filter(filter2, &token, &error);
+			test_assert_idx(ret == (output[i] == NULL ? 0 : 1), i);
+			test_assert_idx(null_strcmp(token, output[i]) == 0, i);
+		}
+	}
+	/* using the parent directly has its own cache */
+	token = "The";
+	test_assert(fts_filter_filter(filter, &token, &error) == 1);
+	test_assert_strcmp(token, "the");
+	fts_filter_unref(&filter);
+	fts_filter_unref(&filter2);
+	test_end();
+}
+
+static void test_fts_filter_cache_eviction(void)
+{
+	struct fts_filter *filter;
+	const char *error = NULL, *token, *input;
+	unsigned int i;
+
+	test_begin("fts filter cache eviction");
+	test_assert(fts_filter_create(fts_filter_lowercase, NULL, NULL, NULL, &filter, &error) == 0);
+	for (i = 0; i < 5000; i++) {
+		input = t_strdup_printf("Token%u", i % 2500);
+		token = input;
+		test_assert_idx(fts_filter_filter(filter, &token, &error) == 1, i);
+		test_assert_idx(strcmp(token, t_str_lcase(input)) == 0, i);
+		/* feeding the returned token back in must work */
+		test_assert_idx(fts_filter_filter(filter, &token, &error) == 1, i);
+		test_assert_idx(strcmp(token, t_str_lcase(input)) == 0, i);
+	}
+	fts_filter_unref(&filter);
+	test_end();
+}
+
 static void test_fts_filter_stopwords_eng(void)
 {
 	struct fts_filter *filter;
@@ -578,6 +635,35 @@ static void test_fts_filter_normalizer_swedish_short_default_id(void)
 
 /* UDHRDIR comes from Automake AM_CPPFLAGS */
 #define UDHR_FRA_NAME "/udhr_fra.txt"
+static void test_fts_filter_normalizer_ascii(void)
+{
+	struct fts_filter *norm, *norm_icu;
+	const char *input[] = {
+		"Vem", "HELLO world", "a.b-C_d", "Tab\there", "MiXeD123", " ",
+	};
+	/* same as the default, but written differently so that libicu is
+	   used for all the tokens */
+	const char *const settings[] =
+		{"id", "Any-Lower;NFKD;[: Nonspacing Mark :] Remove;NFC;[\\x20] Remove", NULL};
+	const char *error = NULL, *token, *token_icu;
+	unsigned int i;
+	int ret, ret_icu;
+
+	test_begin("fts filter normalizer ASCII fast path");
+	test_assert(fts_filter_create(fts_filter_normalizer_icu, NULL, NULL, NULL, &norm, &error) == 0);
+	test_assert(fts_filter_create(fts_filter_normalizer_icu, NULL, NULL, settings, &norm_icu, &error) == 0);
+	for (i = 0; i < N_ELEMENTS(input); i++) {
+		token = token_icu = input[i];
+		ret = fts_filter_filter(norm, &token, &error);
+		ret_icu = fts_filter_filter(norm_icu, &token_icu, &error);
+		test_assert_idx(ret == ret_icu, i);
+		test_assert_idx(null_strcmp(token, token_icu) == 0, i);
+	}
+	fts_filter_unref(&norm);
+	fts_filter_unref(&norm_icu);
+	test_end();
+}
+
 static void test_fts_filter_normalizer_french(void)
 {
 	struct fts_filter *norm = NULL;
@@ -993,6 +1079,8 @@ int main(void)
 		test_fts_filter_stopwords_no,
 		test_fts_filter_stopwords_fail_lazy_init,
 		test_fts_filter_stopwords_malformed,
+		test_fts_filter_cache,
+		test_fts_filter_cache_eviction,
 #ifdef HAVE_FTS_STEMMER
 		test_fts_filter_stemmer_snowball_stem_english,
 		test_fts_filter_stemmer_snowball_stem_french,
@@ -1001,6 +1089,7 @@ int main(void)
 #ifdef HAVE_LIBICU
 		test_fts_filter_normalizer_swedish_short,
 		test_fts_filter_normalizer_swedish_short_default_id,
+		test_fts_filter_normalizer_ascii,
 		test_fts_filter_normalizer_french,
 		test_fts_filter_normalizer_empty,
 		test_fts_filter_normalizer_baddata,
@@ -462,6 +462,21 @@ imap_msgpart_crlf_seek(struct mail *mail, struct istream *input,
 	return crlf_input;
 }
 
+static void imap_msgpart_try_get_cached_nuls(struct mail *mail)
+{
+	enum mail_lookup_abort orig_lookup_abort;
+	struct message_part *parts;
+
+	/* Looking up the message parts from cache updates the has_nuls and
+	   has_no_nuls fields. Don't parse the mail just for this though. */
+	mail_storage_last_error_push(mail->box->storage);
+	orig_lookup_abort = mail->lookup_abort;
+	mail->lookup_abort = MAIL_LOOKUP_ABORT_NOT_IN_CACHE;
+	(void)mail_get_parts(mail, &parts);
+	mail->lookup_abort = orig_lookup_abort;
+	mail_storage_last_error_pop(mail->box->storage);
+}
+
 static void
 imap_msgpart_get_partial(struct mail *mail, const struct imap_msgpart *msgpart,
 			 bool convert_nuls, bool use_partial_cache,
@@ -502,6 +517,13 @@ imap_msgpart_get_partial(struct mail *mail, const struct imap_msgpart *msgpart,
 		result->size = bytes_left;
 	}
 
+	if (!mail->has_no_nuls && !mail->has_nuls && convert_nuls &&
+	    result->input->readable_fd) {
+		/* The nonuls istream would prevent using sendfile() for
+		   sending the mail. Try to find out from cache whether
+		   it's really needed. */
+		imap_msgpart_try_get_cached_nuls(mail);
+	}
 	if (!mail->has_no_nuls && convert_nuls) {
 		/* IMAP literals must not contain NULs. change them to
 		   0x80 characters. */
@@ -0,0 +1,75 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "istream.h"
+#include "imap-parser.h"
+#include "test-bench.h"
+
+#include <stdio.h>
+
+/**
+ * Micro-benchmark for parsing typical IMAP command lines with imap-parser.
+ * Give a wildcard mask parameter to run only the matching benchmarks.
+ */
+
+static const char bench_commands[] =
+	"a1 UID FETCH 1:* (UID FLAGS INTERNALDATE RFC822.SIZE "
+	"BODY.PEEK[HEADER.FIELDS (FROM TO CC SUBJECT DATE MESSAGE-ID)])\r\n"
+	"a2 UID STORE 1:100,200,300:400 +FLAGS.SILENT (\\Deleted \\Seen)\r\n"
+	"a3 UID SEARCH CHARSET UTF-8 OR SUBJECT \"benchmark subject\" "
+	"FROM \"user@example.com\" SINCE 1-Jan-2026\r\n"
+	"a4 LIST \"\" \"INBOX/*\" RETURN (SUBSCRIBED CHILDREN STATUS "
+	"(MESSAGES UNSEEN))\r\n"
+	"a5 SELECT INBOX (CONDSTORE)\r\n"
+	"a6 IDLE\r\n";
+
+static unsigned int bench_counter;
+
+static void bench_skip_line(struct istream *input)
+{
+	const unsigned char *data, *p;
+	size_t size;
+
+	data = i_stream_get_data(input, &size);
+	p = memchr(data, '\n', size);
+	i_assert(p != NULL);
+	i_stream_skip(input, p - data + 1);
+}
+
+static void bench_imap_parser(void *context ATTR_UNUSED)
+{
+	struct istream *input =
+		i_stream_create_from_data(bench_commands,
+					  sizeof(bench_commands) - 1);
+	struct imap_parser *parser = imap_parser_create(input, NULL, 65536);
+	const struct imap_arg *args;
+
+	(void)i_stream_read(input);
+	while (i_stream_have_bytes_left(input)) {
+		if (imap_parser_read_args(parser, 0, 0, &args) < 0)
+			i_fatal("imap_parser_read_args() failed");
+		bench_counter++;
+		bench_skip_line(input);
+		imap_parser_reset(parser);
+	}
+	imap_parser_unref(&parser);
+	i_stream_unref(&input);
+}
+
+int main(int argc, const char *argv[])
+{
+	lib_init();
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [<benchmark name mask>]\n", argv[0]);
+		lib_exit(1);
+	}
+	test_bench_set_filter(argv[1]);
+
+	test_bench_print_header();
+	test_bench_run("imap_parser_read_args() 6 commands", 100000,
+		       sizeof(bench_commands) - 1, bench_imap_parser, NULL);
+
+	test_bench_set_filter(NULL);
+	lib_deinit();
+	return 0;
+}
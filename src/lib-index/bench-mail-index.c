@@ -0,0 +1,136 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "mail-index.h"
+#include "test-bench.h"
+
+#include <stdio.h>
+
+/**
+ * Micro-benchmarks for in-memory mail index operations: appending mails,
+ * looking up sequences by UID and updating flags. In-memory indexes avoid
+ * measuring the filesystem. Give a wildcard mask parameter to run only the
+ * matching benchmarks.
+ */
+
+#define BENCH_MAIL_COUNT 1000
+#define BENCH_LOOKUP_INDEX_MAIL_COUNT 10000
+
+struct bench_index_context {
+	struct mail_index *index;
+	struct mail_index_view *view;
+	unsigned int counter;
+	bool flag_set;
+};
+
+static struct mail_index *bench_index_open(void)
+{
+	struct mail_index *index = mail_index_alloc(NULL, NULL, "bench");
+
+	if (mail_index_open_or_create(index, MAIL_INDEX_OPEN_FLAG_CREATE) < 0)
+		i_fatal("mail_index_open_or_create() failed");
+	return index;
+}
+
+static void bench_index_append(struct mail_index *index, unsigned int count)
+{
+	struct mail_index_view *view = mail_index_view_open(index);
+	struct mail_index_transaction *trans =
+		mail_index_transaction_begin(view, 0);
+	uint32_t seq, uid_validity = 1;
+
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid_validity, sizeof(uid_validity), TRUE);
+	for (unsigned int i = 1; i <= count; i++)
+		mail_index_append(trans, i, &seq);
+	if (mail_index_transaction_commit(&trans) < 0)
+		i_fatal("mail_index_transaction_commit() failed");
+	mail_index_view_close(&view);
+}
+
+static void bench_append(struct bench_index_context *ctx ATTR_UNUSED)
+{
+	struct mail_index *index = bench_index_open();
+
+	bench_index_append(index, BENCH_MAIL_COUNT);
+	mail_index_close(index);
+	mail_index_free(&index);
+}
+
+static void bench_lookup_seq(struct bench_index_context *ctx)
+{
+	uint32_t seq;
+
+	for (unsigned int i = 0; i < BENCH_MAIL_COUNT; i++) {
+		uint32_t uid = (i * 7919) % BENCH_LOOKUP_INDEX_MAIL_COUNT + 1;
+		if (mail_index_lookup_seq(ctx->view, uid, &seq))
+			ctx->counter++;
+	}
+}
+
+static void bench_update_flags(struct bench_index_context *ctx)
+{
+	struct mail_index_transaction *trans =
+		mail_index_transaction_begin(ctx->view, 0);
+
+	/* toggle the flag, so every commit changes something */
+	ctx->flag_set = !ctx->flag_set;
+	for (uint32_t seq = 1; seq <= BENCH_MAIL_COUNT; seq += 2) {
+		mail_index_update_flags(trans, seq, ctx->flag_set ?
+					MODIFY_ADD : MODIFY_REMOVE, MAIL_SEEN);
+	}
+	if (mail_index_transaction_commit(&trans) < 0)
+		i_fatal("mail_index_transaction_commit() failed");
+}
+
+static void bench_update_flag_single(struct bench_index_context *ctx)
+{
+	struct mail_index_transaction *trans =
+		mail_index_transaction_begin(ctx->view, 0);
+	uint32_t seq = ctx->counter++ % BENCH_MAIL_COUNT + 1;
+
+	/* the common case of a single STORE +FLAGS */
+	ctx->flag_set = !ctx->flag_set;
+	mail_index_update_flags(trans, seq, ctx->flag_set ?
+				MODIFY_ADD : MODIFY_REMOVE, MAIL_FLAGGED);
+	if (mail_index_transaction_commit(&trans) < 0)
+		i_fatal("mail_index_transaction_commit() failed");
+}
+
+int main(int argc, const char *argv[])
+{
+	struct bench_index_context ctx;
+
+	lib_init();
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [<benchmark name mask>]\n", argv[0]);
+		lib_exit(1);
+	}
+	test_bench_set_filter(argv[1]);
+
+	/* index ID is based on ioloop_time */
+	ioloop_time = time(NULL);
+	i_zero(&ctx);
+	ctx.index = bench_index_open();
+	bench_index_append(ctx.index, BENCH_LOOKUP_INDEX_MAIL_COUNT);
+	ctx.view = mail_index_view_open(ctx.index);
+
+	test_bench_print_header();
+	test_bench_run("mail_index_append() x1000 + commit", 1000, 0,
+		       bench_append, &ctx);
+	test_bench_run("mail_index_lookup_seq() x1000", 10000, 0,
+		       bench_lookup_seq, &ctx);
+	test_bench_run("mail_index_update_flags() x500 + commit", 1000, 0,
+		       bench_update_flags, &ctx);
+	test_bench_run("mail_index_update_flags() x1 + commit", 10000, 0,
+		       bench_update_flag_single, &ctx);
+
+	mail_index_view_close(&ctx.view);
+	mail_index_close(ctx.index);
+	mail_index_free(&ctx.index);
+	test_bench_set_filter(NULL);
+	lib_deinit();
+	return 0;
+}
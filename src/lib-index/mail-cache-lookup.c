@@ -237,16 +237,25 @@ mail_cache_lookup_iter_next_record(struct mail_cache_lookup_iterate_ctx *ctx)
 
 static int
 mail_cache_lookup_rec_get_field(struct mail_cache_lookup_iterate_ctx *ctx,
-				unsigned int *field_idx_r)
+				unsigned int *field_idx_r, bool *compressed_r)
 {
 	struct mail_cache *cache = ctx->view->cache;
 	uint32_t file_field;
 
 	file_field = *((const uint32_t *)CONST_PTR_OFFSET(ctx->rec, ctx->pos));
+	*compressed_r = (file_field & MAIL_CACHE_FIELD_IDX_COMPRESSED) != 0;
+	file_field &= ~MAIL_CACHE_FIELD_IDX_COMPRESSED;
 	if (ctx->inmemory_field_idx) {
 		*field_idx_r = file_field;
 		return 0;
 	}
+	if (*compressed_r &&
+	    (cache->hdr->flags & MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS) == 0) {
+		mail_cache_set_corrupted(cache,
+			"compressed field %u without compression header flag",
+			file_field);
+		return -1;
+	}
 
 	if (file_field >= cache->file_fields_count) {
 		/* new field, have to re-read fields header to figure
@@ -279,6 +288,7 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 	struct mail_cache *cache = ctx->view->cache;
 	unsigned int field_idx;
 	unsigned int data_size;
+	bool compressed;
 	int ret;
 
 	i_assert(ctx->remap_counter == cache->remap_counter);
@@ -295,11 +305,17 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 	}
 
 	/* return the next field */
-	if (mail_cache_lookup_rec_get_field(ctx, &field_idx) < 0)
+	if (mail_cache_lookup_rec_get_field(ctx, &field_idx, &compressed) < 0)
 		return -1;
 	ctx->pos += sizeof(uint32_t);
 
 	data_size = cache->fields[field_idx].field.field_size;
+	if (compressed && data_size != UINT_MAX) {
+		mail_cache_set_corrupted(cache,
+			"fixed size field %s is compressed",
+			cache->fields[field_idx].field.name);
+		return -1;
+	}
 	if (data_size == UINT_MAX &&
 	    ctx->pos + sizeof(uint32_t) <= ctx->rec->size) {
 		/* variable size field. get its size from the file. */
@@ -318,12 +334,56 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 	field_r->data = CONST_PTR_OFFSET(ctx->rec, ctx->pos);
 	field_r->size = data_size;
 	field_r->offset = ctx->offset + ctx->pos;
+	field_r->compressed = compressed;
 
 	/* each record begins from 32bit aligned position */
 	ctx->pos += (data_size + sizeof(uint32_t)-1) & ~(sizeof(uint32_t)-1);
 	return 1;
 }
 
+static int
+mail_cache_lookup_decompress_to(struct mail_cache_lookup_iterate_ctx *ctx,
+				const struct mail_cache_iterate_field *field,
+				buffer_t *dest)
+{
+	struct mail_cache *cache = ctx->view->cache;
+	size_t orig_used = dest->used;
+	const char *error;
+
+	i_assert(field->compressed);
+
+	if (cache->compression.decompress == NULL)
+		return 0;
+	if (cache->compression.decompress(&cache->compression, field->data,
+					  field->size, dest, &error) < 0) {
+		buffer_set_used_size(dest, orig_used);
+		mail_cache_set_seq_corrupted_reason(ctx->view, ctx->seq,
+			t_strdup_printf("Failed to decompress field %s: %s",
+				cache->fields[field->field_idx].field.name,
+				error));
+		return -1;
+	}
+	return 1;
+}
+
+int mail_cache_lookup_iter_decompress(struct mail_cache_lookup_iterate_ctx *ctx,
+				      struct mail_cache_iterate_field *field)
+{
+	buffer_t *buf;
+	int ret;
+
+	if (!field->compressed)
+		return 1;
+
+	buf = t_buffer_create(field->size * 4);
+	if ((ret = mail_cache_lookup_decompress_to(ctx, field, buf)) <= 0)
+		return ret;
+	field->data = buf->data;
+	field->size = buf->used;
+	field->compressed = FALSE;
+	return 1;
+}
+
 static int mail_cache_seq(struct mail_cache_view *view, uint32_t seq)
 {
 	struct mail_cache_lookup_iterate_ctx iter;
@@ -340,6 +400,11 @@ static int mail_cache_seq(struct mail_cache_view *view, uint32_t seq)
 
 	mail_cache_lookup_iter_init(view, seq, &iter);
 	while ((ret = mail_cache_lookup_iter_next(&iter, &field)) > 0) {
+		if (field.compressed &&
+		    view->cache->compression.decompress == NULL) {
+			/* can't be accessed without compression */
+			continue;
+		}
 		buffer_write(view->cached_exists_buf, field.field_idx,
 			     &view->cached_exists_value, 1);
 	}
@@ -434,10 +499,15 @@ int mail_cache_lookup_field(struct mail_cache_view *view, buffer_t *dest_buf,
 		/* return the first one that's found. if there are multiple
 		   they're all identical. */
 		while ((ret = mail_cache_lookup_iter_next(&iter, &field)) > 0) {
-			if (field.field_idx == field_idx) {
+			if (field.field_idx != field_idx)
+				continue;
+			if (!field.compressed)
 				buffer_append(dest_buf, field.data, field.size);
-				break;
+			else {
+				ret = mail_cache_lookup_decompress_to(&iter,
+						&field, dest_buf);
 			}
+			break;
 		}
 	}
 	/* NOTE: view->cache->fields may have been reallocated by
@@ -556,10 +626,12 @@ mail_cache_lookup_headers_real(struct mail_cache_view *view, string_t *dest,
 		    field_state[field.field_idx] != HDR_FIELD_STATE_WANT) {
 			/* a) don't want it, b) duplicate */
 		} else {
+			ret = mail_cache_lookup_iter_decompress(&iter, &field);
+			if (ret <= 0)
+				break;
 			field_state[field.field_idx] = HDR_FIELD_STATE_SEEN;
 			header_lines_save(&ctx, &field);
 		}
-
 	}
 	if (ret < 0)
 		return -1;
@@ -16,6 +16,17 @@
 #define MAIL_CACHE_IS_UNUSABLE(cache) \
 	((cache)->hdr == NULL)
 
+enum mail_cache_header_flags {
+	/* Some of the fields may have MAIL_CACHE_FIELD_IDX_COMPRESSED set.
+	   Older versions don't understand these fields and treat the cache
+	   file as corrupted. */
+	MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS	= 0x01,
+};
+
+/* This bit is set in a cache record's file_field index if the field's data
+   is compressed. This is used only for variable sized fields. */
+#define MAIL_CACHE_FIELD_IDX_COMPRESSED 0x80000000U
+
 struct mail_cache_header {
 	/* Major version is increased only when you can't have backwards
 	   compatibility. If the field doesn't match MAIL_CACHE_MAJOR_VERSION,
@@ -27,7 +38,8 @@ struct mail_cache_header {
 	/* Minor version is increased when the file format changes in a
 	   backwards compatible way. */
 	uint8_t minor_version;
-	uint8_t unused;
+	/* enum mail_cache_header_flags */
+	uint8_t flags;
 
 	/* Unique index file ID, which must match the main index's indexid.
 	   See mail_index_header.indexid. */
@@ -196,6 +208,10 @@ struct mail_cache {
 	/* Human-readable reason for purging. Used for debugging and events. */
 	char *need_purge_reason;
 
+	/* mail_cache_set_compression(). compress=NULL if compression isn't
+	   used. */
+	struct mail_cache_compression compression;
+
 	/* Cache has been opened (or it doesn't exist). */
 	bool opened:1;
 	/* Cache has been locked with mail_cache_lock(). */
@@ -281,6 +297,9 @@ struct mail_cache_iterate_field {
 	const void *data;
 	/* Offset to data in cache file */
 	uoff_t offset;
+	/* The data is still compressed. Use
+	   mail_cache_lookup_iter_decompress() before accessing it. */
+	bool compressed;
 };
 
 struct mail_cache_lookup_iterate_ctx {
@@ -368,6 +387,11 @@ void mail_cache_lookup_iter_init(struct mail_cache_view *view, uint32_t seq,
    Note that this may trigger re-reading and reallocating cache fields. */
 int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 				struct mail_cache_iterate_field *field_r);
+/* Decompress field->data if field->compressed=TRUE. The decompressed data is
+   allocated from data stack. Returns 1 if ok, 0 if cache compression isn't
+   set and the field can't be accessed, -1 if the data is corrupted. */
+int mail_cache_lookup_iter_decompress(struct mail_cache_lookup_iterate_ctx *ctx,
+				      struct mail_cache_iterate_field *field);
 const struct mail_cache_record *
 mail_cache_transaction_lookup_rec(struct mail_cache_transaction_ctx *ctx,
 				  unsigned int seq,
@@ -392,7 +416,6 @@ int mail_cache_sync_reset_id(struct mail_cache *cache);
    in the cache file. */
 void mail_cache_decision_state_update(struct mail_cache_view *view,
 				      uint32_t seq, unsigned int field);
-const char *mail_cache_decision_to_string(enum mail_cache_decision_type dec);
 struct event_passthrough *
 mail_cache_decision_changed_event(struct mail_cache *cache, struct event *event,
 				  unsigned int field);
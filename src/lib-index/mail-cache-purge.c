@@ -13,17 +13,53 @@
 #include <stdio.h>
 #include <sys/stat.h>
 
+/* Send a progress event after every this many messages */
+#define MAIL_CACHE_PURGE_PROGRESS_INTERVAL 10000
+
 struct mail_cache_copy_context {
 	struct mail_cache *cache;
 	struct event *event;
 	struct mail_cache_purge_drop_ctx drop_ctx;
+	struct ostream *output;
+	struct mail_cache_header hdr;
 
 	buffer_t *buffer, *field_seen;
 	ARRAY(unsigned int) bitmask_pos;
 	uint32_t *field_file_map;
+	/* Field decisions used for copying the records */
+	enum mail_cache_decision_type *field_decisions;
+	unsigned int orig_fields_count, used_fields_count;
 
 	uint8_t field_seen_value;
 	bool new_msg;
+	/* Copying without locks. Don't change the fields' decisions or send
+	   events about them, because the purge may still be restarted. */
+	bool precopy;
+};
+
+struct mail_cache_purge_precopy_rec {
+	uint32_t uid;
+	/* Record's offset in the old cache file */
+	uint32_t old_offset;
+	/* Record's offset in the new cache file, 0 if nothing was copied */
+	uint32_t new_offset;
+};
+
+/* Records copied to the new cache file before the purging locks are taken.
+   After locking, only the records that have changed since are copied. */
+struct mail_cache_purge_precopy {
+	struct mail_cache_copy_context ctx;
+	struct event *event;
+
+	uint32_t cache_file_seq;
+	/* The view's state when the records were precopied. The records'
+	   forced decisions depend on first_new_seq. */
+	uint32_t first_new_seq, message_count;
+	int fd;
+	char *temp_path;
+
+	ARRAY(struct mail_cache_purge_precopy_rec) recs;
+	unsigned int pos, copied_count;
 };
 
 static void
@@ -69,7 +105,8 @@ mail_cache_purge_field(struct mail_cache_copy_context *ctx,
 	}
 	*field_seen = ctx->field_seen_value;
 
-	dec = cache_field->decision & ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED);
+	dec = ctx->field_decisions[field->field_idx] &
+		ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED);
 	if (ctx->new_msg) {
 		if (dec == MAIL_CACHE_DECISION_NO)
 			return;
@@ -78,6 +115,11 @@ mail_cache_purge_field(struct mail_cache_copy_context *ctx,
 			return;
 	}
 
+	if (field->compressed) {
+		/* copy the compressed data as-is */
+		ctx->hdr.flags |= MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS;
+		file_field_idx |= MAIL_CACHE_FIELD_IDX_COMPRESSED;
+	}
 	buffer_append(ctx->buffer, &file_field_idx, sizeof(file_field_idx));
 
 	if (cache_field->field_size == UINT_MAX) {
@@ -156,11 +198,16 @@ mail_cache_purge_check_field(struct mail_cache_copy_context *ctx,
 {
 	struct mail_cache_field_private *priv = &ctx->cache->fields[field];
 	enum mail_cache_decision_type dec = priv->field.decision;
+	bool drop;
 
 	switch (mail_cache_purge_drop_test(&ctx->drop_ctx, field)) {
 	case MAIL_CACHE_PURGE_DROP_DECISION_NONE:
 		break;
 	case MAIL_CACHE_PURGE_DROP_DECISION_DROP: {
+		dec = MAIL_CACHE_DECISION_NO;
+		if (ctx->precopy)
+			break;
+
 		const char *dec_str = mail_cache_decision_to_string(dec);
 		struct event_passthrough *e =
 			event_create_passthrough(ctx->event)->
@@ -171,10 +218,12 @@ mail_cache_purge_check_field(struct mail_cache_copy_context *ctx,
 		e_debug(e->event(), "Purge dropped field %s "
 			"(decision=%s, last_used=%"PRIdTIME_T")",
 			priv->field.name, dec_str, priv->field.last_used);
-		dec = MAIL_CACHE_DECISION_NO;
 		break;
 	}
 	case MAIL_CACHE_PURGE_DROP_DECISION_TO_TEMP: {
+		dec = MAIL_CACHE_DECISION_TEMP;
+		if (ctx->precopy)
+			break;
 		struct event_passthrough *e =
 			mail_cache_decision_changed_event(
 				ctx->cache, ctx->event, field)->
@@ -184,37 +233,242 @@ mail_cache_purge_check_field(struct mail_cache_copy_context *ctx,
 			"cache decision yes -> temp "
 			"(last_used=%"PRIdTIME_T")",
 			priv->field.name, priv->field.last_used);
-		dec = MAIL_CACHE_DECISION_TEMP;
 		break;
 	}
 	}
-	priv->field.decision = dec;
+	ctx->field_decisions[field] = dec;
 
 	/* drop all fields we don't want */
-	if ((dec & ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED)) == MAIL_CACHE_DECISION_NO) {
+	drop = (dec & ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED)) ==
+		MAIL_CACHE_DECISION_NO;
+	if (ctx->precopy)
+		return priv->used && !drop;
+
+	priv->field.decision = dec;
+	if (drop) {
 		priv->used = FALSE;
 		priv->field.last_used = 0;
 	}
 	return priv->used;
 }
 
+static void
+mail_cache_copy_init(struct mail_cache_copy_context *ctx,
+		     struct mail_cache *cache, struct event *event, int fd)
+{
+	i_zero(ctx);
+	ctx->cache = cache;
+	ctx->event = event;
+	ctx->output = o_stream_create_fd_file(fd, 0, FALSE);
+	ctx->buffer = buffer_create_dynamic(default_pool, 4096);
+	ctx->field_seen = buffer_create_dynamic(default_pool, 64);
+	ctx->field_seen_value = 0;
+	i_array_init(&ctx->bitmask_pos, 32);
+
+	ctx->hdr.major_version = MAIL_CACHE_MAJOR_VERSION;
+	ctx->hdr.minor_version = MAIL_CACHE_MINOR_VERSION;
+	ctx->hdr.compat_sizeof_uoff_t = sizeof(uoff_t);
+	ctx->hdr.indexid = cache->index->indexid;
+	o_stream_nsend(ctx->output, &ctx->hdr, sizeof(ctx->hdr));
+}
+
+static void mail_cache_copy_deinit(struct mail_cache_copy_context *ctx)
+{
+	if (ctx->output != NULL) {
+		o_stream_abort(ctx->output);
+		o_stream_destroy(&ctx->output);
+	}
+	buffer_free(&ctx->buffer);
+	buffer_free(&ctx->field_seen);
+	array_free(&ctx->bitmask_pos);
+	i_free(ctx->field_file_map);
+	i_free(ctx->field_decisions);
+}
+
+static void
+mail_cache_copy_init_fields(struct mail_cache_copy_context *ctx,
+			    struct mail_index_view *view)
+{
+	struct mail_cache *cache = ctx->cache;
+	const struct mail_index_header *idx_hdr;
+	unsigned int i;
+
+	/* @UNSAFE: drop unused fields and create a field mapping for
+	   used fields */
+	idx_hdr = mail_index_get_header(view);
+	mail_cache_purge_drop_init(cache, idx_hdr, &ctx->drop_ctx);
+
+	i_free(ctx->field_file_map);
+	i_free(ctx->field_decisions);
+	ctx->field_file_map = i_new(uint32_t, cache->fields_count + 1);
+	ctx->field_decisions = i_new(enum mail_cache_decision_type,
+				     cache->fields_count + 1);
+	ctx->orig_fields_count = cache->fields_count;
+	if (cache->file_fields_count == 0) {
+		/* creating the initial cache file. add all fields. */
+		for (i = 0; i < ctx->orig_fields_count; i++) {
+			ctx->field_file_map[i] = i;
+			ctx->field_decisions[i] =
+				cache->fields[i].field.decision;
+		}
+		ctx->used_fields_count = i;
+	} else {
+		ctx->used_fields_count = 0;
+		for (i = 0; i < ctx->orig_fields_count; i++) {
+			if (!mail_cache_purge_check_field(ctx, i))
+				ctx->field_file_map[i] = (uint32_t)-1;
+			else
+				ctx->field_file_map[i] = ctx->used_fields_count++;
+		}
+	}
+}
+
+/* Copy the message's cache records to the new file and return the new
+   offset, or 0 if nothing was copied. If stop_offset isn't 0, only the
+   records added after the record at stop_offset are copied, and the new
+   record is linked to prev_offset in the new file. Returns prev_offset if
+   there were no new fields. Sets *stop_offset_found_r to FALSE if
+   stop_offset isn't one of the message's records anymore. */
+static uint32_t
+mail_cache_copy_record(struct mail_cache_copy_context *ctx,
+		       struct mail_cache_view *cache_view, uint32_t seq,
+		       bool new_msg, uint32_t stop_offset, uint32_t prev_offset,
+		       bool *stop_offset_found_r)
+{
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field field;
+	struct mail_cache_record cache_rec;
+	uint32_t ext_offset;
+
+	ctx->new_msg = new_msg;
+	buffer_set_used_size(ctx->buffer, 0);
+
+	ctx->field_seen_value = (ctx->field_seen_value + 1) & UINT8_MAX;
+	if (ctx->field_seen_value == 0) {
+		memset(buffer_get_modifiable_data(ctx->field_seen, NULL),
+		       0, buffer_get_size(ctx->field_seen));
+		ctx->field_seen_value++;
+	}
+	array_clear(&ctx->bitmask_pos);
+
+	i_zero(&cache_rec);
+	buffer_append(ctx->buffer, &cache_rec, sizeof(cache_rec));
+
+	*stop_offset_found_r = stop_offset == 0;
+	mail_cache_lookup_iter_init(cache_view, seq, &iter);
+	while (mail_cache_lookup_iter_next(&iter, &field) > 0) {
+		if (iter.offset == stop_offset && stop_offset != 0) {
+			/* the rest of the records were already copied */
+			*stop_offset_found_r = TRUE;
+			break;
+		}
+		mail_cache_purge_field(ctx, &field);
+	}
+	if (!*stop_offset_found_r)
+		return 0;
+
+	if (ctx->buffer->used == sizeof(cache_rec) ||
+	    ctx->buffer->used > ctx->cache->index->optimization_set.cache.record_max_size) {
+		/* nothing (more) cached */
+		return prev_offset;
+	}
+	cache_rec.size = ctx->buffer->used;
+	cache_rec.prev_offset = prev_offset;
+	if (prev_offset != 0)
+		ctx->hdr.continued_record_count++;
+	ext_offset = ctx->output->offset;
+	buffer_write(ctx->buffer, 0, &cache_rec, sizeof(cache_rec));
+	o_stream_nsend(ctx->output, ctx->buffer->data, cache_rec.size);
+	return ext_offset;
+}
+
+static void
+mail_cache_copy_progress(struct mail_cache_copy_context *ctx,
+			 uint32_t seq, uint32_t message_count)
+{
+	if (seq % MAIL_CACHE_PURGE_PROGRESS_INTERVAL != 0)
+		return;
+
+	struct event_passthrough *e =
+		event_create_passthrough(ctx->event)->
+		set_name("mail_cache_purge_progress")->
+		add_int("messages_done", seq)->
+		add_int("messages_total", message_count);
+	e_debug(e->event(), "Purging progress: %u/%u messages",
+		seq, message_count);
+}
+
+static const struct mail_cache_purge_precopy_rec *
+mail_cache_purge_precopy_find(struct mail_cache_purge_precopy *precopy,
+			      struct mail_index_view *view, uint32_t seq,
+			      uint32_t *cur_offset_r)
+{
+	const struct mail_cache_purge_precopy_rec *recs;
+	unsigned int count;
+	uint32_t uid, reset_id;
+
+	recs = array_get(&precopy->recs, &count);
+	mail_index_lookup_uid(view, seq, &uid);
+	while (precopy->pos < count && recs[precopy->pos].uid < uid)
+		precopy->pos++;
+	if (precopy->pos == count || recs[precopy->pos].uid != uid)
+		return NULL;
+
+	*cur_offset_r = mail_cache_lookup_cur_offset(view, seq, &reset_id);
+	if (*cur_offset_r != 0 && reset_id != precopy->cache_file_seq)
+		return NULL;
+	return &recs[precopy->pos];
+}
+
+static bool
+mail_cache_purge_precopy_is_usable(struct mail_cache_purge_precopy *precopy,
+				   struct mail_index_view *view,
+				   uint32_t first_new_seq,
+				   uint32_t message_count)
+{
+	struct mail_cache_copy_context *ctx = &precopy->ctx;
+	struct mail_cache *cache = ctx->cache;
+	uint32_t *old_field_file_map = ctx->field_file_map;
+	enum mail_cache_decision_type *old_field_decisions =
+		ctx->field_decisions;
+	unsigned int old_fields_count = ctx->orig_fields_count;
+	bool ret;
+
+	if (cache->hdr == NULL ||
+	    cache->hdr->file_seq != precopy->cache_file_seq)
+		return FALSE;
+	if (first_new_seq != precopy->first_new_seq ||
+	    message_count != precopy->message_count)
+		return FALSE;
+
+	/* The field decisions were re-read from the cache file. Make sure
+	   the precopied records were written with the same fields. */
+	ctx->field_file_map = NULL;
+	ctx->field_decisions = NULL;
+	ctx->precopy = FALSE;
+	mail_cache_copy_init_fields(ctx, view);
+	ret = old_fields_count == ctx->orig_fields_count &&
+		memcmp(old_field_file_map, ctx->field_file_map,
+		       sizeof(uint32_t) * old_fields_count) == 0 &&
+		memcmp(old_field_decisions, ctx->field_decisions,
+		       sizeof(*old_field_decisions) * old_fields_count) == 0;
+	i_free(old_field_file_map);
+	i_free(old_field_decisions);
+	return ret;
+}
+
 static int
 mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
-		struct event *event, int fd, const char *reason,
+		struct event *event, struct mail_cache_purge_precopy *precopy,
+		int fd, const char *reason,
 		uint32_t *file_seq_r, uoff_t *file_size_r, uint32_t *max_uid_r,
 		uint32_t *ext_first_seq_r, ARRAY_TYPE(uint32_t) *ext_offsets)
 {
-        struct mail_cache_copy_context ctx;
-	struct mail_cache_lookup_iterate_ctx iter;
-	struct mail_cache_iterate_field field;
+	struct mail_cache_copy_context local_ctx, *ctx;
 	struct mail_index_view *view;
 	struct mail_cache_view *cache_view;
-	const struct mail_index_header *idx_hdr;
-	struct mail_cache_header hdr;
-	struct mail_cache_record cache_rec;
-	struct ostream *output;
 	uint32_t message_count, seq, first_new_seq, ext_offset;
-	unsigned int i, used_fields_count, orig_fields_count, record_count;
+	unsigned int orig_fields_count, record_count, reused_count = 0;
 
 	i_assert(reason != NULL);
 
@@ -227,54 +481,52 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 
 	view = mail_index_transaction_open_updated_view(trans);
 	cache_view = mail_cache_view_open(cache, view);
-	output = o_stream_create_fd_file(fd, 0, FALSE);
 
-	i_zero(&hdr);
-	hdr.major_version = MAIL_CACHE_MAJOR_VERSION;
-	hdr.minor_version = MAIL_CACHE_MINOR_VERSION;
-	hdr.compat_sizeof_uoff_t = sizeof(uoff_t);
-	hdr.indexid = cache->index->indexid;
-	hdr.file_seq = get_next_file_seq(cache);
-	o_stream_nsend(output, &hdr, sizeof(hdr));
-
-	event_add_str(event, "reason", reason);
-	event_add_int(event, "file_seq", hdr.file_seq);
-	event_set_name(event, "mail_cache_purge_started");
-	e_debug(event, "Purging (new file_seq=%u): %s", hdr.file_seq, reason);
-
-	i_zero(&ctx);
-	ctx.cache = cache;
-	ctx.event = event;
-	ctx.buffer = buffer_create_dynamic(default_pool, 4096);
-	ctx.field_seen = buffer_create_dynamic(default_pool, 64);
-	ctx.field_seen_value = 0;
-	ctx.field_file_map = t_new(uint32_t, cache->fields_count + 1);
-	t_array_init(&ctx.bitmask_pos, 32);
-
-	/* @UNSAFE: drop unused fields and create a field mapping for
-	   used fields */
-	idx_hdr = mail_index_get_header(view);
-	mail_cache_purge_drop_init(cache, idx_hdr, &ctx.drop_ctx);
+	/* get sequence of first message which doesn't need its temp fields
+	   removed. */
+	first_new_seq = mail_cache_get_first_new_seq(view);
+	message_count = mail_index_view_get_messages_count(view);
 
-	orig_fields_count = cache->fields_count;
-	if (cache->file_fields_count == 0) {
-		/* creating the initial cache file. add all fields. */
-		for (i = 0; i < orig_fields_count; i++)
-			ctx.field_file_map[i] = i;
-		used_fields_count = i;
+	if (precopy != NULL && !trans->reset &&
+	    mail_cache_purge_precopy_is_usable(precopy, view, first_new_seq,
+					       message_count)) {
+		ctx = &precopy->ctx;
+		ctx->event = event;
 	} else {
-		for (i = used_fields_count = 0; i < orig_fields_count; i++) {
-			if (!mail_cache_purge_check_field(&ctx, i))
-				ctx.field_file_map[i] = (uint32_t)-1;
-			else
-				ctx.field_file_map[i] = used_fields_count++;
+		if (precopy != NULL) {
+			/* start from scratch in the same file. The new
+			   ostream expects the fd to be at the offset it's
+			   created with. */
+			mail_cache_copy_deinit(&precopy->ctx);
+			precopy = NULL;
+			const char *syscall = NULL;
+			if (ftruncate(fd, 0) < 0)
+				syscall = "ftruncate()";
+			else if (lseek(fd, 0, SEEK_SET) < 0)
+				syscall = "lseek()";
+			if (syscall != NULL) {
+				mail_cache_set_syscall_error(cache, syscall);
+				mail_cache_view_close(&cache_view);
+				mail_index_view_close(&view);
+				return -1;
+			}
 		}
+		ctx = &local_ctx;
+		mail_cache_copy_init(ctx, cache, event, fd);
+		mail_cache_copy_init_fields(ctx, view);
 	}
+	ctx->hdr.file_seq = get_next_file_seq(cache);
+
+	event_add_str(event, "reason", reason);
+	event_add_int(event, "file_seq", ctx->hdr.file_seq);
+	if (precopy != NULL) {
+		event_add_int(event, "precopied_records",
+			      precopy->copied_count);
+	}
+	event_set_name(event, "mail_cache_purge_started");
+	e_debug(event, "Purging (new file_seq=%u): %s",
+		ctx->hdr.file_seq, reason);
 
-	/* get sequence of first message which doesn't need its temp fields
-	   removed. */
-	first_new_seq = mail_cache_get_first_new_seq(view);
-	message_count = mail_index_view_get_messages_count(view);
 	if (!trans->reset)
 		seq = 1;
 	else {
@@ -283,6 +535,7 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 	}
 
 	*ext_first_seq_r = seq;
+	orig_fields_count = cache->fields_count;
 	i_array_init(ext_offsets, message_count); record_count = 0;
 	for (; seq <= message_count; seq++) {
 		if (mail_index_transaction_is_expunged(trans, seq)) {
@@ -290,61 +543,76 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 			continue;
 		}
 
-		ctx.new_msg = seq >= first_new_seq;
-		buffer_set_used_size(ctx.buffer, 0);
+		const struct mail_cache_purge_precopy_rec *rec = NULL;
+		uint32_t cur_offset = 0;
+		bool found;
 
-		ctx.field_seen_value = (ctx.field_seen_value + 1) & UINT8_MAX;
-		if (ctx.field_seen_value == 0) {
-			memset(buffer_get_modifiable_data(ctx.field_seen, NULL),
-			       0, buffer_get_size(ctx.field_seen));
-			ctx.field_seen_value++;
+		if (precopy != NULL) {
+			rec = mail_cache_purge_precopy_find(precopy, view,
+							    seq, &cur_offset);
 		}
-		array_clear(&ctx.bitmask_pos);
-
-		i_zero(&cache_rec);
-		buffer_append(ctx.buffer, &cache_rec, sizeof(cache_rec));
-
-		mail_cache_lookup_iter_init(cache_view, seq, &iter);
-		while (mail_cache_lookup_iter_next(&iter, &field) > 0)
-			mail_cache_purge_field(&ctx, &field);
-
-		if (ctx.buffer->used == sizeof(cache_rec) ||
-		    ctx.buffer->used > cache->index->optimization_set.cache.record_max_size) {
-			/* nothing cached */
-			ext_offset = 0;
+		if (rec != NULL && cur_offset == rec->old_offset) {
+			/* Cache records are never modified after they're
+			   written. The message still points to the same
+			   record, so the precopied record is up to date. */
+			ext_offset = rec->new_offset;
+			if (ext_offset != 0)
+				reused_count++;
 		} else {
+			found = FALSE;
+			if (rec != NULL && rec->old_offset != 0) {
+				/* Fields were added to the message after
+				   precopying. Copy only the new records and
+				   link them to the precopied record. */
+				ext_offset = mail_cache_copy_record(ctx,
+					cache_view, seq, seq >= first_new_seq,
+					rec->old_offset, rec->new_offset,
+					&found);
+				if (found && rec->new_offset != 0)
+					reused_count++;
+			}
+			if (!found) {
+				ext_offset = mail_cache_copy_record(ctx,
+					cache_view, seq, seq >= first_new_seq,
+					0, 0, &found);
+			}
+		}
+		if (ext_offset != 0) {
 			mail_index_lookup_uid(view, seq, max_uid_r);
-			cache_rec.size = ctx.buffer->used;
-			ext_offset = output->offset;
-			buffer_write(ctx.buffer, 0, &cache_rec,
-				     sizeof(cache_rec));
-			o_stream_nsend(output, ctx.buffer->data, cache_rec.size);
 			record_count++;
 		}
-
 		array_push_back(ext_offsets, &ext_offset);
+		if (precopy == NULL) {
+			/* with precopying the progress was already sent */
+			mail_cache_copy_progress(ctx, seq, message_count);
+		}
 	}
 	i_assert(orig_fields_count == cache->fields_count);
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
 
+	struct ostream *output = ctx->output;
 	bool file_too_large =
 		output->offset > cache->index->optimization_set.cache.max_size;
 	if (!file_too_large) {
-		hdr.record_count = record_count;
-		hdr.field_header_offset = mail_index_uint32_to_offset(output->offset);
-		mail_cache_purge_get_fields(&ctx, used_fields_count);
-		o_stream_nsend(output, ctx.buffer->data, ctx.buffer->used);
+		ctx->hdr.record_count = record_count;
+		if (precopy != NULL) {
+			/* precopied records of messages that were expunged
+			   or changed since */
+			i_assert(precopy->copied_count >= reused_count);
+			ctx->hdr.deleted_record_count =
+				precopy->copied_count - reused_count;
+		}
+		ctx->hdr.field_header_offset =
+			mail_index_uint32_to_offset(output->offset);
+		mail_cache_purge_get_fields(ctx, ctx->used_fields_count);
+		o_stream_nsend(output, ctx->buffer->data, ctx->buffer->used);
 	}
 
-	hdr.backwards_compat_used_file_size = output->offset;
-	buffer_free(&ctx.buffer);
-	buffer_free(&ctx.field_seen);
-
+	ctx->hdr.backwards_compat_used_file_size = output->offset;
 	*file_size_r = output->offset;
 	(void)o_stream_seek(output, 0);
-	o_stream_nsend(output, &hdr, sizeof(hdr));
-
-	mail_cache_view_close(&cache_view);
-	mail_index_view_close(&view);
+	o_stream_nsend(output, &ctx->hdr, sizeof(ctx->hdr));
 
 	if (file_too_large || o_stream_finish(output) < 0) {
 		if (!file_too_large) {
@@ -358,11 +626,13 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 				cache->filepath);
 			i_unlink(cache->filepath);
 		}
-		o_stream_destroy(&output);
+		mail_cache_copy_deinit(ctx);
 		array_free(ext_offsets);
 		return -1;
 	}
-	o_stream_destroy(&output);
+	o_stream_destroy(&ctx->output);
+	*file_seq_r = ctx->hdr.file_seq;
+	mail_cache_copy_deinit(ctx);
 
 	if (cache->index->set.fsync_mode == FSYNC_MODE_ALWAYS) {
 		if (fdatasync(fd) < 0) {
@@ -371,14 +641,13 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 			return -1;
 		}
 	}
-
-	*file_seq_r = hdr.file_seq;
 	return 0;
 }
 
 static int
 mail_cache_purge_write(struct mail_cache *cache,
 		       struct mail_index_transaction *trans,
+		       struct mail_cache_purge_precopy *precopy,
 		       int fd, const char *temp_path, const char *
 		       reason, bool *unlock)
 {
@@ -404,7 +673,7 @@ mail_cache_purge_write(struct mail_cache *cache,
 	event_add_int(event, "prev_file_size", prev_file_size);
 	event_add_int(event, "prev_deleted_records", prev_deleted_records);
 
-	if (mail_cache_copy(cache, trans, event, fd, reason,
+	if (mail_cache_copy(cache, trans, event, precopy, fd, reason,
 			    &file_seq, &file_size, &max_uid,
 			    &ext_first_seq, &ext_offsets) < 0) {
 		event_unref(&event);
@@ -499,6 +768,7 @@ mail_cache_purge_has_file_changed(struct mail_cache *cache,
 static int mail_cache_purge_locked(struct mail_cache *cache,
 				   uint32_t purge_file_seq,
 				   struct mail_index_transaction *trans,
+				   struct mail_cache_purge_precopy *precopy,
 				   const char *reason, bool *unlock)
 {
 	const char *temp_path;
@@ -528,10 +798,20 @@ static int mail_cache_purge_locked(struct mail_cache *cache,
 	}
 
 	/* we want to recreate the cache. write it first to a temporary file */
-	fd = mail_index_create_tmp_file(cache->index, cache->filepath, &temp_path);
-	if (fd == -1)
-		return -1;
-	if (mail_cache_purge_write(cache, trans, fd, temp_path, reason, unlock) < 0) {
+	if (precopy != NULL) {
+		/* continue writing to the precopied file. it's now owned
+		   by us. */
+		fd = precopy->fd;
+		temp_path = t_strdup(precopy->temp_path);
+		precopy->fd = -1;
+	} else {
+		fd = mail_index_create_tmp_file(cache->index, cache->filepath,
+						&temp_path);
+		if (fd == -1)
+			return -1;
+	}
+	if (mail_cache_purge_write(cache, trans, precopy, fd, temp_path,
+				   reason, unlock) < 0) {
 		i_close_fd(&fd);
 		i_unlink(temp_path);
 		return -1;
@@ -548,9 +828,22 @@ static int mail_cache_purge_locked(struct mail_cache *cache,
 	return 0;
 }
 
+static void mail_cache_purge_disable_read_map(struct mail_cache *cache)
+{
+	/* purging isn't very efficient with small read()s */
+	if (cache->map_with_read) {
+		cache->map_with_read = FALSE;
+		if (cache->read_buf != NULL)
+			buffer_set_used_size(cache->read_buf, 0);
+		cache->hdr = NULL;
+		cache->mmap_length = 0;
+	}
+}
+
 static int
 mail_cache_purge_full(struct mail_cache *cache,
 		      struct mail_index_transaction *trans,
+		      struct mail_cache_purge_precopy *precopy,
 		      uint32_t purge_file_seq, const char *reason)
 {
 	bool unlock = FALSE;
@@ -562,14 +855,7 @@ mail_cache_purge_full(struct mail_cache *cache,
 	if (MAIL_INDEX_IS_IN_MEMORY(cache->index) || cache->index->readonly)
 		return 0;
 
-	/* purging isn't very efficient with small read()s */
-	if (cache->map_with_read) {
-		cache->map_with_read = FALSE;
-		if (cache->read_buf != NULL)
-			buffer_set_used_size(cache->read_buf, 0);
-		cache->hdr = NULL;
-		cache->mmap_length = 0;
-	}
+	mail_cache_purge_disable_read_map(cache);
 
 	/* .log lock already prevents other processes from purging cache at
 	   the same time, but locking the cache file itself prevents other
@@ -588,7 +874,8 @@ mail_cache_purge_full(struct mail_cache *cache,
 		unlock = TRUE;
 	}
 	cache->purging = TRUE;
-	ret = mail_cache_purge_locked(cache, purge_file_seq, trans, reason, &unlock);
+	ret = mail_cache_purge_locked(cache, purge_file_seq, trans, precopy,
+				      reason, &unlock);
 	cache->purging = FALSE;
 	if (unlock)
 		mail_cache_unlock(cache);
@@ -605,12 +892,101 @@ int mail_cache_purge_with_trans(struct mail_cache *cache,
 				struct mail_index_transaction *trans,
 				uint32_t purge_file_seq, const char *reason)
 {
-	return mail_cache_purge_full(cache, trans, purge_file_seq, reason);
+	return mail_cache_purge_full(cache, trans, NULL, purge_file_seq, reason);
+}
+
+static struct mail_cache_purge_precopy *
+mail_cache_purge_precopy(struct mail_cache *cache)
+{
+	struct mail_cache_purge_precopy *precopy;
+	struct mail_cache_purge_precopy_rec *rec;
+	struct mail_index_view *view;
+	struct mail_cache_view *cache_view;
+	const char *temp_path;
+	uint32_t seq, message_count, first_new_seq, reset_id;
+	bool found;
+	int fd;
+
+	if (MAIL_INDEX_IS_IN_MEMORY(cache->index) || cache->index->readonly)
+		return NULL;
+	if (mail_index_refresh(cache->index) < 0)
+		return NULL;
+	if (mail_cache_open_and_verify(cache) <= 0)
+		return NULL;
+
+	mail_cache_purge_disable_read_map(cache);
+	if (mail_cache_map_all(cache) <= 0)
+		return NULL;
+	if (mail_cache_header_fields_read(cache) < 0 ||
+	    MAIL_CACHE_IS_UNUSABLE(cache))
+		return NULL;
+
+	fd = mail_index_create_tmp_file(cache->index, cache->filepath,
+					&temp_path);
+	if (fd == -1)
+		return NULL;
+
+	precopy = i_new(struct mail_cache_purge_precopy, 1);
+	precopy->event = event_create(cache->event);
+	precopy->cache_file_seq = cache->hdr->file_seq;
+	precopy->fd = fd;
+	precopy->temp_path = i_strdup(temp_path);
+
+	view = mail_index_view_open(cache->index);
+	cache_view = mail_cache_view_open(cache, view);
+	mail_cache_copy_init(&precopy->ctx, cache, precopy->event, fd);
+	precopy->ctx.precopy = TRUE;
+	mail_cache_copy_init_fields(&precopy->ctx, view);
+
+	first_new_seq = mail_cache_get_first_new_seq(view);
+	message_count = mail_index_view_get_messages_count(view);
+	precopy->first_new_seq = first_new_seq;
+	precopy->message_count = message_count;
+	i_array_init(&precopy->recs, message_count);
+	for (seq = 1; seq <= message_count; seq++) {
+		uint32_t offset =
+			mail_cache_lookup_cur_offset(view, seq, &reset_id);
+		if (offset != 0 && reset_id != precopy->cache_file_seq) {
+			/* offset isn't for this cache file */
+			continue;
+		}
+
+		rec = array_append_space(&precopy->recs);
+		mail_index_lookup_uid(view, seq, &rec->uid);
+		rec->old_offset = offset;
+		rec->new_offset = mail_cache_copy_record(&precopy->ctx,
+			cache_view, seq, seq >= first_new_seq, 0, 0, &found);
+		if (rec->new_offset != 0)
+			precopy->copied_count++;
+		mail_cache_copy_progress(&precopy->ctx, seq, message_count);
+	}
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
+	return precopy;
+}
+
+static void
+mail_cache_purge_precopy_free(struct mail_cache_purge_precopy **_precopy)
+{
+	struct mail_cache_purge_precopy *precopy = *_precopy;
+
+	*_precopy = NULL;
+	mail_cache_copy_deinit(&precopy->ctx);
+	if (precopy->fd != -1) {
+		/* purging wasn't done after all */
+		i_close_fd(&precopy->fd);
+		i_unlink(precopy->temp_path);
+	}
+	array_free(&precopy->recs);
+	event_unref(&precopy->event);
+	i_free(precopy->temp_path);
+	i_free(precopy);
 }
 
 int mail_cache_purge(struct mail_cache *cache, uint32_t purge_file_seq,
 		     const char *reason)
 {
+	struct mail_cache_purge_precopy *precopy = NULL;
 	struct mail_index_view *view;
 	struct mail_index_transaction *trans;
 	bool lock_log;
@@ -618,13 +994,20 @@ int mail_cache_purge(struct mail_cache *cache, uint32_t purge_file_seq,
 
 	lock_log = !cache->index->log_sync_locked;
 	if (lock_log) {
+		/* Copy most of the records before locking, so other
+		   processes are blocked only while copying the records that
+		   were changed in the meantime. */
+		precopy = mail_cache_purge_precopy(cache);
+
 		uint32_t file_seq;
 		uoff_t file_offset;
-
 		if (mail_transaction_log_sync_lock(cache->index->log,
 						   "mail cache purge",
-						   &file_seq, &file_offset) < 0)
+						   &file_seq, &file_offset) < 0) {
+			if (precopy != NULL)
+				mail_cache_purge_precopy_free(&precopy);
 			return -1;
+		}
 	}
 	/* make sure we see the latest changes in index */
 	ret = mail_index_refresh(cache->index);
@@ -634,8 +1017,8 @@ int mail_cache_purge(struct mail_cache *cache, uint32_t purge_file_seq,
 		MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
 	if (ret < 0)
 		;
-	else if ((ret = mail_cache_purge_full(cache, trans, purge_file_seq,
-					      reason)) < 0)
+	else if ((ret = mail_cache_purge_full(cache, trans, precopy,
+					      purge_file_seq, reason)) < 0)
 		mail_index_transaction_rollback(&trans);
 	else {
 		if (mail_index_transaction_commit(&trans) < 0)
@@ -646,6 +1029,8 @@ int mail_cache_purge(struct mail_cache *cache, uint32_t purge_file_seq,
 		mail_transaction_log_sync_unlock(cache->index->log,
 						 "mail cache purge");
 	}
+	if (precopy != NULL)
+		mail_cache_purge_precopy_free(&precopy);
 	return ret;
 }
 
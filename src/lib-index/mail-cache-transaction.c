@@ -38,6 +38,7 @@ struct mail_cache_transaction_ctx {
 	uint32_t first_new_seq;
 
 	buffer_t *cache_data;
+	buffer_t *compress_buf;
 	ARRAY(uint8_t) cache_field_idx_used;
 	ARRAY(struct mail_cache_transaction_rec) cache_data_seq;
 	ARRAY_TYPE(seq_range) cache_data_wanted_seqs;
@@ -180,6 +181,7 @@ void mail_cache_transaction_rollback(struct mail_cache_transaction_ctx **_ctx)
 
 	mail_index_view_close(&ctx->view->trans_view);
 	buffer_free(&ctx->cache_data);
+	buffer_free(&ctx->compress_buf);
 	if (array_is_created(&ctx->cache_data_seq))
 		array_free(&ctx->cache_data_seq);
 	if (array_is_created(&ctx->cache_data_wanted_seqs))
@@ -461,11 +463,22 @@ mail_cache_transaction_update_fields(struct mail_cache_transaction_ctx *ctx)
 			rec_end = CONST_PTR_OFFSET(p, rec->size);
 			p += sizeof(*rec);
 		}
-		/* replace field_idx */
+		/* replace field_idx, but preserve the compression bit */
 		uint32_t *file_fieldp = (uint32_t *)p;
-		field_idx = *file_fieldp;
+		uint32_t compressed = *file_fieldp &
+			MAIL_CACHE_FIELD_IDX_COMPRESSED;
+		field_idx = *file_fieldp & ~MAIL_CACHE_FIELD_IDX_COMPRESSED;
 		*file_fieldp = ctx->cache->field_file_map[field_idx];
 		i_assert(*file_fieldp != (uint32_t)-1);
+		if (compressed != 0) {
+			*file_fieldp |= compressed;
+			if ((ctx->cache->hdr_copy.flags &
+			     MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS) == 0) {
+				ctx->cache->hdr_copy.flags |=
+					MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS;
+				ctx->cache->hdr_modified = TRUE;
+			}
+		}
 		p += sizeof(field_idx);
 
 		/* Skip to next cache field. Next is <data size> if the field
@@ -774,10 +787,41 @@ mail_cache_transaction_refresh_decisions(struct mail_cache_transaction_ctx *ctx)
 	ctx->decisions_refreshed = TRUE;
 }
 
+static bool
+mail_cache_add_compress(struct mail_cache_transaction_ctx *ctx,
+			unsigned int field_idx, const void **data,
+			size_t *data_size)
+{
+	const struct mail_cache_compression *compression =
+		&ctx->cache->compression;
+	const struct mail_cache_field *field =
+		&ctx->cache->fields[field_idx].field;
+
+	if (compression->compress == NULL ||
+	    field->field_size != UINT_MAX ||
+	    *data_size < compression->min_size || *data_size == 0)
+		return FALSE;
+
+	if (ctx->compress_buf == NULL)
+		ctx->compress_buf = buffer_create_dynamic(default_pool, 1024);
+	else
+		buffer_set_used_size(ctx->compress_buf, 0);
+	if (compression->compress(compression, *data, *data_size,
+				  ctx->compress_buf) < 0)
+		return FALSE;
+	if (ctx->compress_buf->used >= *data_size) {
+		/* compression didn't help */
+		return FALSE;
+	}
+	*data = ctx->compress_buf->data;
+	*data_size = ctx->compress_buf->used;
+	return TRUE;
+}
+
 void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 		    unsigned int field_idx, const void *data, size_t data_size)
 {
-	uint32_t data_size32;
+	uint32_t file_field_idx, data_size32;
 	unsigned int fixed_size;
 	size_t full_size, record_size;
 
@@ -804,8 +848,12 @@ void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 	fixed_size = ctx->cache->fields[field_idx].field.field_size;
 	i_assert(fixed_size == UINT_MAX || fixed_size == data_size);
 
+	file_field_idx = field_idx;
+	if (mail_cache_add_compress(ctx, field_idx, &data, &data_size))
+		file_field_idx |= MAIL_CACHE_FIELD_IDX_COMPRESSED;
+
 	data_size32 = (uint32_t)data_size;
-	full_size = sizeof(field_idx) + ((data_size + 3) & ~3U);
+	full_size = sizeof(file_field_idx) + ((data_size + 3) & ~3U);
 	if (fixed_size == UINT_MAX)
 		full_size += sizeof(data_size32);
 
@@ -870,7 +918,8 @@ void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 		}
 	}
 
-	buffer_append(ctx->cache_data, &field_idx, sizeof(field_idx));
+	buffer_append(ctx->cache_data, &file_field_idx,
+		      sizeof(file_field_idx));
 	if (fixed_size == UINT_MAX) {
 		buffer_append(ctx->cache_data, &data_size32,
 			      sizeof(data_size32));
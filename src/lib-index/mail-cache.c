@@ -562,6 +562,18 @@ int mail_cache_open_and_verify(struct mail_cache *cache)
 	return ret;
 }
 
+void mail_cache_set_compression(struct mail_cache *cache,
+				const struct mail_cache_compression *compression)
+{
+	if (compression == NULL)
+		i_zero(&cache->compression);
+	else {
+		i_assert(compression->compress != NULL);
+		i_assert(compression->decompress != NULL);
+		cache->compression = *compression;
+	}
+}
+
 struct mail_cache *
 mail_cache_open_or_create_path(struct mail_index *index, const char *path)
 {
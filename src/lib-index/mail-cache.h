@@ -45,6 +45,29 @@ enum mail_cache_field_type {
 	MAIL_CACHE_FIELD_COUNT
 };
 
+/* Compression used for large variable-sized cache fields. The handler is
+   implemented outside lib-index, e.g. by the mail_compress plugin. */
+struct mail_cache_compression {
+	/* Compress data and append it to dest. Returns 0 on success, -1 if
+	   the data couldn't be compressed. */
+	int (*compress)(const struct mail_cache_compression *compression,
+			const void *data, size_t size, buffer_t *dest);
+	/* Decompress data and append it to dest. Returns 0 on success, -1 and
+	   error_r on failure. The decompressor must be able to handle data
+	   compressed by any of the supported handlers, since the cache file
+	   may have been written with different settings. */
+	int (*decompress)(const struct mail_cache_compression *compression,
+			  const void *data, size_t size, buffer_t *dest,
+			  const char **error_r);
+	/* Handler-specific context. It must stay valid until the cache is
+	   freed or the compression is changed. */
+	const void *context;
+	/* Compression level passed to the compress() handler */
+	int level;
+	/* Compress only fields that are at least this large. */
+	size_t min_size;
+};
+
 struct mail_cache_field {
 	/* Unique name for the cache field. The field name doesn't matter
 	   internally. */
@@ -116,6 +139,12 @@ bool mail_cache_exists(struct mail_cache *cache);
 /* Open and read cache header. Returns 1 if ok, 0 if cache doesn't exist or it
    was corrupted and just got deleted, -1 if I/O error. */
 int mail_cache_open_and_verify(struct mail_cache *cache);
+/* Compress newly added fields using the given compression, or disable
+   compression if NULL. The struct is copied. Compressed fields can be read
+   only while compression is set. Without it they are treated as if they
+   weren't cached at all. */
+void mail_cache_set_compression(struct mail_cache *cache,
+				const struct mail_cache_compression *compression);
 
 struct mail_cache_view *
 mail_cache_view_open(struct mail_cache *cache, struct mail_index_view *iview);
@@ -166,6 +195,8 @@ bool mail_cache_field_exists_any(struct mail_cache_view *view, uint32_t seq);
 /* Returns current caching decision for given field. */
 enum mail_cache_decision_type
 mail_cache_field_get_decision(struct mail_cache *cache, unsigned int field_idx);
+/* Returns the decision as "no", "temp" or "yes". */
+const char *mail_cache_decision_to_string(enum mail_cache_decision_type dec);
 /* Notify the decision handling code when field is committed to cache.
    If this is the first time the field is added to cache, its caching decision
    is updated to TEMP. Sets rejected to true if header count limit has been
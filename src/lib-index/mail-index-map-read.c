@@ -28,6 +28,43 @@ static void mail_index_map_copy_hdr(struct mail_index_map *map,
 	map->hdr.unused_old_recent_messages_count = 0;
 }
 
+static void *
+mail_index_mmap_reserved(int fd, size_t file_size, size_t *reserved_size_r)
+{
+#ifdef MAP_ANONYMOUS
+	size_t page_size = mmap_get_page_size();
+	size_t size;
+	void *base;
+	int old_errno;
+
+	size = file_size + I_MAX(file_size / 16,
+				 MAIL_INDEX_MMAP_APPEND_RESERVE_MIN_SIZE);
+	size = (size + page_size - 1) / page_size * page_size;
+
+	/* Reserve the address space with an anonymous mapping and map the
+	   file over its beginning. The file pages stay shared with other
+	   processes until they're written to, while the untouched anonymous
+	   pages after it don't use any memory. */
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base != MAP_FAILED) {
+		if (mmap(base, file_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+			*reserved_size_r = size;
+			return base;
+		}
+		old_errno = errno;
+		if (munmap(base, size) < 0)
+			i_error("munmap() failed: %m");
+		errno = old_errno;
+		return MAP_FAILED;
+	}
+#endif
+	*reserved_size_r = file_size;
+	return mmap(NULL, file_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE, fd, 0);
+}
+
 static int mail_index_mmap(struct mail_index_map *map, uoff_t file_size)
 {
 	struct mail_index *index = map->index;
@@ -45,8 +82,8 @@ static int mail_index_mmap(struct mail_index_map *map, uoff_t file_size)
 		return -1;
 	}
 
-	rec_map->mmap_base = mmap(NULL, file_size, PROT_READ | PROT_WRITE,
-				  MAP_PRIVATE, index->fd, 0);
+	rec_map->mmap_base = mail_index_mmap_reserved(index->fd, file_size,
+						&rec_map->mmap_reserved_size);
 	if (rec_map->mmap_base == MAP_FAILED) {
 		rec_map->mmap_base = NULL;
 		if (ioloop_time != index->last_mmap_error_time) {
@@ -15,6 +15,10 @@ struct mail_index_sync_map_ctx;
 
 /* How large index files to mmap() instead of reading to memory. */
 #define MAIL_INDEX_MMAP_MIN_SIZE (1024*64)
+/* Reserve this much (or 1/16 of the file size, if larger) of anonymous memory
+   after the mmap()ed index file. New records can then be appended to the map
+   without first copying all the existing records to memory. */
+#define MAIL_INDEX_MMAP_APPEND_RESERVE_MIN_SIZE (1024*64)
 /* How many times to retry opening index files if read/fstat returns ESTALE.
    This happens with NFS when the file has been deleted (ie. index file was
    rewritten by another computer than us). */
@@ -124,8 +128,12 @@ struct mail_index_modseq_header {
 struct mail_index_record_map {
 	ARRAY(struct mail_index_map *) maps;
 
+	/* The index file is mmap()ed MAP_PRIVATE, so its pages are shared
+	   with other processes until they're modified. mmap_size is the
+	   file size, while mmap_reserved_size is the size of the whole
+	   mapping including the anonymous memory reserved for appends. */
 	void *mmap_base;
-	size_t mmap_size, mmap_used_size;
+	size_t mmap_size, mmap_used_size, mmap_reserved_size;
 
 	buffer_t *buffer;
 
@@ -69,7 +69,7 @@ static void mail_index_sync_replace_map(struct mail_index_sync_map_ctx *ctx,
 }
 
 static struct mail_index_map *
-mail_index_sync_move_to_private_memory(struct mail_index_sync_map_ctx *ctx)
+mail_index_sync_move_to_private(struct mail_index_sync_map_ctx *ctx)
 {
 	struct mail_index_map *map = ctx->view->map;
 
@@ -80,14 +80,49 @@ mail_index_sync_move_to_private_memory(struct mail_index_sync_map_ctx *ctx)
 		mail_index_sync_replace_map(ctx, map);
 		i_assert(ctx->view->map == map);
 	}
+	return map;
+}
+
+static struct mail_index_map *
+mail_index_sync_move_to_private_memory(struct mail_index_sync_map_ctx *ctx)
+{
+	struct mail_index_map *map = mail_index_sync_move_to_private(ctx);
 
-	if (!MAIL_INDEX_MAP_IS_IN_MEMORY(ctx->view->map)) {
+	if (!MAIL_INDEX_MAP_IS_IN_MEMORY(map)) {
 		/* map points to mmap()ed area, copy it into memory. */
-		mail_index_map_move_to_memory(ctx->view->map);
+		mail_index_map_move_to_memory(map);
 	}
 	return map;
 }
 
+static bool mail_index_map_can_append_mmap(struct mail_index_map *map)
+{
+	struct mail_index_record_map *rec_map = map->rec_map;
+	size_t records_offset, end_offset;
+
+	i_assert(rec_map->mmap_base != NULL);
+
+	records_offset = (const char *)rec_map->records -
+		(const char *)rec_map->mmap_base;
+	end_offset = records_offset +
+		(size_t)(rec_map->records_count + 1) * map->hdr.record_size;
+	return end_offset <= rec_map->mmap_reserved_size;
+}
+
+static struct mail_index_map *
+mail_index_sync_get_append_map(struct mail_index_sync_map_ctx *ctx)
+{
+	struct mail_index_map *map = mail_index_sync_move_to_private(ctx);
+
+	/* Appends can be written to the anonymous memory reserved after the
+	   mmap()ed index. Copy the records to memory only after it runs
+	   out. */
+	if (!MAIL_INDEX_MAP_IS_IN_MEMORY(map) &&
+	    !mail_index_map_can_append_mmap(map))
+		mail_index_map_move_to_memory(map);
+	return map;
+}
+
 struct mail_index_map *
 mail_index_sync_get_atomic_map(struct mail_index_sync_map_ctx *ctx)
 {
@@ -303,6 +338,11 @@ static void *sync_append_record(struct mail_index_map *map)
 	void *ret;
 
 	append_pos = map->rec_map->records_count * map->hdr.record_size;
+	if (!MAIL_INDEX_MAP_IS_IN_MEMORY(map)) {
+		/* mail_index_sync_get_append_map() verified that there's
+		   enough space reserved */
+		return PTR_OFFSET(map->rec_map->records, append_pos);
+	}
 	ret = buffer_get_space_unsafe(map->rec_map->buffer, append_pos,
 				      map->hdr.record_size);
 	map->rec_map->records =
@@ -387,9 +427,9 @@ static int sync_append(const struct mail_index_record *rec,
 	}
 
 	/* We'll need to append a new record. If map currently points to
-	   mmap()ed index, it first needs to be moved to memory since we can't
-	   write past the mmap()ed memory area. */
-	map = mail_index_sync_move_to_private_memory(ctx);
+	   mmap()ed index and there's no more space reserved after it, it
+	   first needs to be moved to memory. */
+	map = mail_index_sync_get_append_map(ctx);
 
 	if (rec->uid <= map->rec_map->last_appended_uid) {
 		i_assert(map->hdr.messages_count < map->rec_map->records_count);
@@ -7,6 +7,10 @@
 #include "mail-transaction-log-private.h"
 #include "mail-index-transaction-private.h"
 
+/* Transactions that update only flags of at most this many messages are
+   exported by mail_index_transaction_export_small() */
+#define MAIL_INDEX_TRANSACTION_SMALL_MAX_SEQS 32
+
 struct mail_index_export_context {
 	struct mail_index_transaction *trans;
 	struct mail_transaction_log_append_ctx *append_ctx;
@@ -531,3 +535,108 @@ void mail_index_transaction_export(struct mail_index_transaction *t,
 		(t->view->index->set.fsync_mask & change_mask) != 0 ||
 		(t->flags & MAIL_INDEX_TRANSACTION_FLAG_FSYNC) != 0;
 }
+
+static bool
+mail_index_transaction_is_small(struct mail_index_transaction *t)
+{
+	const struct mail_index_flag_update *u;
+	unsigned int seq_count = 0;
+
+	if (!array_is_created(&t->updates) ||
+	    array_is_created(&t->appends) ||
+	    array_is_created(&t->modseq_updates) ||
+	    array_is_created(&t->expunges) ||
+	    array_is_created(&t->ext_hdr_updates) ||
+	    array_is_created(&t->ext_rec_updates) ||
+	    array_is_created(&t->ext_rec_atomics) ||
+	    array_is_created(&t->ext_resizes) ||
+	    array_is_created(&t->ext_resets) ||
+	    array_is_created(&t->ext_reset_atomic) ||
+	    array_is_created(&t->keyword_updates) ||
+	    t->attribute_updates != NULL)
+		return FALSE;
+	if (t->pre_hdr_changed || t->post_hdr_changed || t->reset ||
+	    t->index_deleted || t->index_undeleted ||
+	    t->max_modseq != 0 || t->min_highest_modseq != 0)
+		return FALSE;
+
+	array_foreach(&t->updates, u) {
+		if (u->uid2 - u->uid1 >=
+		    MAIL_INDEX_TRANSACTION_SMALL_MAX_SEQS - seq_count)
+			return FALSE;
+		seq_count += u->uid2 - u->uid1 + 1;
+	}
+	return TRUE;
+}
+
+bool mail_index_transaction_export_small(struct mail_index_transaction *t,
+					 struct mail_transaction_log_append_ctx *append_ctx,
+					 enum mail_index_transaction_change *changes_r)
+{
+	struct mail_transaction_flag_update
+		log_updates[MAIL_INDEX_TRANSACTION_SMALL_MAX_SEQS];
+	struct mail_transaction_flag_update *log_update;
+	const struct mail_index_flag_update *u;
+	const struct mail_index_record *rec;
+	enum mail_index_fsync_mask change_mask = 0;
+	unsigned int count = 0;
+	uint32_t seq;
+
+	if (!mail_index_transaction_is_small(t))
+		return FALSE;
+
+	/* same as mail_index_transaction_export(): the boundary record
+	   was already added by mail_transaction_log_append_begin() */
+	*changes_r = append_ctx->output->used > 0 ?
+		MAIL_INDEX_TRANSACTION_CHANGE_OTHERS : 0;
+
+	/* Drop the unnecessary updates and convert the sequences to UIDs in
+	   one pass. This produces the same records as
+	   mail_index_transaction_finish() + log_append_flag_updates(). */
+	array_foreach(&t->updates, u) {
+		log_update = NULL;
+		for (seq = u->uid1; seq <= u->uid2; seq++) {
+			i_assert(seq < t->first_new_seq);
+			rec = mail_index_lookup(t->view, seq);
+			if (t->drop_unnecessary_flag_updates &&
+			    (rec->flags & u->add_flags) == u->add_flags &&
+			    (rec->flags & u->remove_flags) == 0) {
+				/* nothing would change */
+				log_update = NULL;
+				continue;
+			}
+			if (log_update != NULL &&
+			    log_update->uid2 + 1 == rec->uid) {
+				/* the previous seq was kept and there are no
+				   expunged UIDs in between. The generic
+				   mail_index_transaction_seq_range_to_uid()
+				   splits the range at expunged UIDs too. */
+				log_update->uid2 = rec->uid;
+				continue;
+			}
+			i_assert(count < N_ELEMENTS(log_updates));
+			log_update = &log_updates[count++];
+			i_zero(log_update);
+			log_update->uid1 = log_update->uid2 = rec->uid;
+			log_update->add_flags = u->add_flags & 0xff;
+			log_update->remove_flags = u->remove_flags & 0xff;
+			if ((u->add_flags & MAIL_INDEX_MAIL_FLAG_UPDATE_MODSEQ) != 0)
+				log_update->modseq_inc_flag = 1;
+		}
+	}
+
+	if (count > 0) {
+		change_mask |= MAIL_INDEX_FSYNC_MASK_FLAGS;
+		*changes_r |= MAIL_INDEX_TRANSACTION_CHANGE_FLAGS;
+		mail_transaction_log_append_add(append_ctx,
+			MAIL_TRANSACTION_FLAG_UPDATE,
+			log_updates, sizeof(log_updates[0]) * count);
+	}
+
+	append_ctx->index_sync_transaction = t->sync_transaction;
+	append_ctx->tail_offset_changed = t->tail_offset_changed;
+	append_ctx->want_fsync =
+		(t->view->index->set.fsync_mask & change_mask) != 0 ||
+		(t->flags & MAIL_INDEX_TRANSACTION_FLAG_FSYNC) != 0;
+	return TRUE;
+}
@@ -151,6 +151,13 @@ void mail_index_transaction_finish(struct mail_index_transaction *t);
 void mail_index_transaction_export(struct mail_index_transaction *t,
 				   struct mail_transaction_log_append_ctx *append_ctx,
 				   enum mail_index_transaction_change *changes_r);
+/* If the transaction contains only flag updates for a few messages, write
+   them directly to the log without going through
+   mail_index_transaction_finish() and mail_index_transaction_export().
+   Returns FALSE without doing anything if the transaction isn't small. */
+bool mail_index_transaction_export_small(struct mail_index_transaction *t,
+					 struct mail_transaction_log_append_ctx *append_ctx,
+					 enum mail_index_transaction_change *changes_r);
 int mail_transaction_expunge_guid_cmp(const struct mail_transaction_expunge_guid *e1,
 				      const struct mail_transaction_expunge_guid *e2);
 unsigned int
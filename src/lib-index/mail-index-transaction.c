@@ -192,8 +192,10 @@ mail_index_transaction_commit_real(struct mail_index_transaction *t,
 		return -1;
 	ret = mail_transaction_log_file_refresh(t, ctx);
 	if (ret > 0) T_BEGIN {
-		mail_index_transaction_finish(t);
-		mail_index_transaction_export(t, ctx, changes_r);
+		if (!mail_index_transaction_export_small(t, ctx, changes_r)) {
+			mail_index_transaction_finish(t);
+			mail_index_transaction_export(t, ctx, changes_r);
+		}
 	} T_END;
 
 	mail_transaction_log_get_head(log, &log_seq1, &log_offset1);
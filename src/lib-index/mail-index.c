@@ -22,9 +22,12 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <ctype.h>
 
+#define MAIL_INDEX_PREFETCH_CACHE_TAIL_SIZE (1024*1024)
+
 struct mail_index_module_register mail_index_module_register = { 0 };
 
 struct event_category event_category_mail_index = {
@@ -124,6 +127,52 @@ void mail_index_set_cache_dir(struct mail_index *index, const char *dir)
 	index->set.cache_dir = i_strdup(dir);
 }
 
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+static void
+mail_index_prefetch_file(struct event *event, const char *path,
+			 uoff_t tail_size)
+{
+	struct stat st;
+	off_t offset = 0;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			e_error(event, "open(%s) failed: %m", path);
+		return;
+	}
+	if (tail_size > 0 && fstat(fd, &st) == 0 &&
+	    (uoff_t)st.st_size > tail_size)
+		offset = st.st_size - tail_size;
+	if ((ret = posix_fadvise(fd, offset, 0, POSIX_FADV_WILLNEED)) != 0) {
+		errno = ret;
+		e_error(event, "posix_fadvise(%s) failed: %m", path);
+	}
+	i_close_fd(&fd);
+}
+#endif
+
+void mail_index_prefetch_files(struct event *event ATTR_UNUSED,
+			       const char *dir ATTR_UNUSED,
+			       const char *cache_dir ATTR_UNUSED,
+			       const char *prefix ATTR_UNUSED)
+{
+/* HAVE_POSIX_FADVISE alone isn't enough for CentOS 4.9 */
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+	const char *path = t_strconcat(dir, "/", prefix, NULL);
+
+	if (cache_dir == NULL)
+		cache_dir = dir;
+	mail_index_prefetch_file(event, path, 0);
+	mail_index_prefetch_file(event, t_strconcat(path,
+		MAIL_TRANSACTION_LOG_SUFFIX, NULL), 0);
+	mail_index_prefetch_file(event, t_strconcat(cache_dir, "/", prefix,
+		MAIL_CACHE_FILE_SUFFIX, NULL),
+		MAIL_INDEX_PREFETCH_CACHE_TAIL_SIZE);
+#endif
+}
+
 void mail_index_set_fsync_mode(struct mail_index *index,
 			       enum fsync_mode mode,
 			       enum mail_index_fsync_mask mask)
@@ -376,6 +376,13 @@ void mail_index_free(struct mail_index **index);
 
 /* Change .cache file's directory. */
 void mail_index_set_cache_dir(struct mail_index *index, const char *dir);
+/* Ask the kernel to start reading the index files into memory in the
+   background, so a following mail_index_open() doesn't have to wait for
+   them. This doesn't require the index to be allocated. Only the end of the
+   .cache file is read, since that's where the newest mails' fields are.
+   cache_dir may be NULL if it's the same as dir. */
+void mail_index_prefetch_files(struct event *event, const char *dir,
+			       const char *cache_dir, const char *prefix);
 /* Specify how often to do fsyncs. If mode is FSYNC_MODE_OPTIMIZED, the mask
    can be used to specify which transaction types to fsync. */
 void mail_index_set_fsync_mode(struct mail_index *index, enum fsync_mode mode,
@@ -59,6 +59,15 @@ log_buffer_move_to_memory(struct mail_transaction_log_append_ctx *ctx)
 	return 0;
 }
 
+static bool
+log_append_want_fsync(const struct mail_transaction_log_append_ctx *ctx)
+{
+	enum fsync_mode fsync_mode = ctx->log->index->set.fsync_mode;
+
+	return (ctx->want_fsync && fsync_mode != FSYNC_MODE_NEVER) ||
+		fsync_mode == FSYNC_MODE_ALWAYS;
+}
+
 static int log_buffer_write(struct mail_transaction_log_append_ctx *ctx)
 {
 	struct mail_transaction_log_file *file = ctx->log->head;
@@ -84,15 +93,19 @@ static int log_buffer_write(struct mail_transaction_log_append_ctx *ctx)
 		return log_buffer_move_to_memory(ctx);
 	}
 
-	if ((ctx->want_fsync &&
-	     file->log->index->set.fsync_mode != FSYNC_MODE_NEVER) ||
-	    file->log->index->set.fsync_mode == FSYNC_MODE_ALWAYS) {
-		if (fdatasync(file->fd) < 0) {
-			mail_index_file_set_syscall_error(ctx->log->index,
-							  file->filepath,
-							  "fdatasync()");
-			return log_buffer_move_to_memory(ctx);
-		}
+	if (!log_append_want_fsync(ctx)) {
+		/* no fsyncing */
+	} else if (!ctx->log->index->log_sync_locked) {
+		/* Do the fdatasync() only after the log is unlocked. This
+		   way concurrent writers aren't serialized behind each
+		   others' fdatasync()s, and the filesystem can flush all of
+		   their writes with a single journal commit. */
+		ctx->fsync_after_unlock = TRUE;
+	} else if (fdatasync(file->fd) < 0) {
+		mail_index_file_set_syscall_error(ctx->log->index,
+						  file->filepath,
+						  "fdatasync()");
+		return log_buffer_move_to_memory(ctx);
 	}
 
 	if (file->mmap_base == NULL && file->buffer != NULL) {
@@ -247,6 +260,16 @@ int mail_transaction_log_append_commit(struct mail_transaction_log_append_ctx **
 	ret = mail_transaction_log_append_locked(ctx);
 	if (!index->log_sync_locked)
 		mail_transaction_log_file_unlock(index->log->head, "appending");
+	if (ret == 0 && ctx->fsync_after_unlock &&
+	    fdatasync(ctx->log->head->fd) < 0) {
+		/* The caller asked for the changes to be on disk, so it must
+		   know they may not be. The records are already visible to
+		   other processes, which may also have appended more after
+		   them, so they can't be removed from the log anymore. */
+		mail_index_file_set_syscall_error(index,
+			ctx->log->head->filepath, "fdatasync()");
+		ret = -1;
+	}
 
 	buffer_free(&ctx->output);
 	i_free(ctx);
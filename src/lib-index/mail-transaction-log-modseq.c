@@ -254,6 +254,21 @@ int mail_transaction_log_file_get_modseq_next_offset(
 		cur_modseq = cache->highest_modseq;
 	}
 
+	/* See if we can use the "modseq" header in dovecot.index to skip
+	   over the records that were already written to the index. Only
+	   records after it can reach the wanted modseq. */
+	const struct mail_index_modseq_header *modseq_hdr =
+		file->log->index->map == NULL ? NULL :
+		&file->log->index->map->modseq_hdr_snapshot;
+	if (modseq_hdr != NULL &&
+	    modseq_hdr->log_seq == file->hdr.file_seq &&
+	    modseq_hdr->highest_modseq < modseq &&
+	    modseq_hdr->log_offset >= cur_offset &&
+	    modseq_hdr->log_offset <= file->sync_offset) {
+		cur_offset = modseq_hdr->log_offset;
+		cur_modseq = modseq_hdr->highest_modseq;
+	}
+
 	if ((ret = get_modseq_next_offset_at(file, modseq, TRUE, &cur_offset,
 					     &cur_modseq, next_offset_r)) <= 0)
 		return ret;
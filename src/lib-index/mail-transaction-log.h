@@ -369,6 +369,9 @@ struct mail_transaction_log_append_ctx {
 	bool sync_includes_this:1;
 	/* fdatasync() after writing the transaction. */
 	bool want_fsync:1;
+	/* The transaction was written, but fdatasync() is delayed until the
+	   log is unlocked. */
+	bool fsync_after_unlock:1;
 };
 
 #define LOG_IS_BEFORE(seq1, offset1, seq2, offset2) \
@@ -163,6 +163,107 @@ static void test_mail_cache_write_during_purge(void)
 	test_end();
 }
 
+static void test_mail_cache_write_during_precopy2(void)
+{
+	i_set_failure_prefix("index2: ");
+
+	/* precopy the records and then wait on the locked .log file */
+	test_mail_cache_purge();
+}
+
+static void
+test_mail_cache_write_during_precopy_full(const char *name, bool new_mail)
+{
+	struct test_mail_cache_ctx ctx;
+	struct mail_index_view *view;
+	struct mail_cache_view *cache_view;
+	string_t *str = t_str_new(16);
+	const char *value;
+	uint32_t seq, message_count = new_mail ? 4 : 3;
+	int status;
+
+	test_begin(name);
+	test_mail_cache_init(test_mail_index_init(TRUE), &ctx);
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, "foo1");
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, "foo2");
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, "foo3");
+
+	uint32_t log_seq;
+	uoff_t log_offset;
+	test_assert(mail_transaction_log_sync_lock(ctx.index->log, "purge", &log_seq, &log_offset) == 0);
+
+	switch (fork()) {
+	case (pid_t)-1:
+		i_fatal("fork() failed: %m");
+	case 0:
+		mail_transaction_log_sync_unlock(ctx.index->log, "purge");
+		test_mail_cache_deinit(&ctx);
+		test_mail_cache_write_during_precopy2();
+		test_exit(test_has_failed() ? 10 : 0);
+	default:
+		break;
+	}
+
+	/* Wait a bit to make sure the child has precopied the records and
+	   is waiting on the locked .log file. Then change one of the
+	   precopied messages and possibly add a new one. */
+	usleep(100000);
+	test_mail_cache_add_field(&ctx, 2, ctx.cache_field2.idx, "bar2");
+	if (new_mail)
+		test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, "foo4");
+	mail_transaction_log_sync_unlock(ctx.index->log, "purge");
+
+	/* wait for child to finish execution */
+	if (wait(&status) == -1)
+		i_error("wait() failed: %m");
+	test_assert(status == 0);
+
+	test_assert(mail_index_refresh(ctx.index) == 0);
+	view = mail_index_view_open(ctx.index);
+	cache_view = mail_cache_view_open(ctx.cache, view);
+	for (seq = 1; seq <= message_count; seq++) {
+		value = t_strdup_printf("foo%u", seq);
+		str_truncate(str, 0);
+		test_assert_idx(mail_cache_lookup_field(cache_view, str, seq,
+					ctx.cache_field.idx) == 1, seq);
+		test_assert_idx(strcmp(str_c(str), value) == 0, seq);
+	}
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 2,
+					    ctx.cache_field2.idx) == 1);
+	test_assert(strcmp(str_c(str), "bar2") == 0);
+	test_assert(ctx.cache->hdr->record_count == message_count);
+	if (!new_mail) {
+		/* only the field added after the precopy was copied for
+		   mail 2 */
+		test_assert(ctx.cache->hdr->continued_record_count == 1);
+	} else {
+		/* the message count changed, so the precopy was discarded
+		   and everything was copied from scratch */
+		test_assert(ctx.cache->hdr->continued_record_count == 0);
+	}
+	test_assert(ctx.cache->hdr->deleted_record_count == 0);
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
+
+	test_assert(test_mail_cache_get_purge_count(&ctx) == 1);
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
+static void test_mail_cache_write_during_precopy(void)
+{
+	test_mail_cache_write_during_precopy_full(
+		"mail cache write during precopy", FALSE);
+}
+
+static void test_mail_cache_new_mail_during_precopy(void)
+{
+	test_mail_cache_write_during_precopy_full(
+		"mail cache new mail during precopy", TRUE);
+}
+
 static void test_mail_cache_purge_while_cache_locked(void)
 {
 	struct test_mail_cache_ctx ctx;
@@ -1085,6 +1186,8 @@ int main(void)
 	static void (*const test_functions[])(void) = {
 		test_mail_cache_read_during_purge,
 		test_mail_cache_write_during_purge,
+		test_mail_cache_write_during_precopy,
+		test_mail_cache_new_mail_during_precopy,
 		test_mail_cache_purge_while_cache_locked,
 		test_mail_cache_write_lost_during_purge,
 		test_mail_cache_write_lost_during_purge2,
@@ -806,6 +806,117 @@ static void test_mail_cache_duplicate_fields(void)
 	test_end();
 }
 
+static int
+test_compress(const struct mail_cache_compression *compression ATTR_UNUSED,
+	      const void *data, size_t size, buffer_t *dest)
+{
+	const unsigned char *p = data;
+	size_t i, j;
+
+	/* simple run-length encoding */
+	buffer_append_c(dest, 'Z');
+	for (i = 0; i < size; i = j) {
+		for (j = i + 1; j < size && j - i < UINT8_MAX; j++) {
+			if (p[j] != p[i])
+				break;
+		}
+		buffer_append_c(dest, j - i);
+		buffer_append_c(dest, p[i]);
+	}
+	return 0;
+}
+
+static int
+test_decompress(const struct mail_cache_compression *compression ATTR_UNUSED,
+		const void *data, size_t size, buffer_t *dest,
+		const char **error_r)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	if (size == 0 || p[0] != 'Z' || size % 2 != 1) {
+		*error_r = "Invalid compressed data";
+		return -1;
+	}
+	for (i = 1; i < size; i += 2) {
+		for (unsigned int j = 0; j < p[i]; j++)
+			buffer_append_c(dest, p[i+1]);
+	}
+	return 0;
+}
+
+static void test_mail_cache_compression(void)
+{
+	const struct mail_cache_compression compression = {
+		.compress = test_compress,
+		.decompress = test_decompress,
+		.min_size = 16,
+	};
+	struct test_mail_cache_ctx ctx;
+	struct mail_cache_view *cache_view;
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field field;
+	string_t *str = t_str_new(1024);
+	char *large_value = t_malloc0(1001);
+
+	memset(large_value, 'x', 1000);
+	test_begin("mail cache compression");
+	test_mail_cache_init(test_mail_index_init(TRUE), &ctx);
+	mail_cache_set_compression(ctx.cache, &compression);
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, large_value);
+	test_mail_cache_add_field(&ctx, 1, ctx.cache_field2.idx, "small");
+	test_assert((ctx.cache->hdr->flags &
+		     MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS) != 0);
+
+	/* only the large field is compressed */
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	mail_cache_lookup_iter_init(cache_view, 1, &iter);
+	while (mail_cache_lookup_iter_next(&iter, &field) > 0) {
+		if (field.field_idx == ctx.cache_field.idx) {
+			test_assert(field.compressed);
+			test_assert(field.size < 100);
+		} else {
+			test_assert(!field.compressed);
+		}
+	}
+	test_assert(mail_cache_lookup_field(cache_view, str, 1,
+					    ctx.cache_field.idx) == 1);
+	test_assert_strcmp(str_c(str), large_value);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1,
+					    ctx.cache_field2.idx) == 1);
+	test_assert_strcmp(str_c(str), "small");
+	mail_cache_view_close(&cache_view);
+
+	/* purging keeps the compressed data */
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+	test_assert((ctx.cache->hdr->flags &
+		     MAIL_CACHE_HDR_FLAG_COMPRESSED_FIELDS) != 0);
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1,
+					    ctx.cache_field.idx) == 1);
+	test_assert_strcmp(str_c(str), large_value);
+	mail_cache_view_close(&cache_view);
+
+	/* without compression the compressed field isn't visible */
+	mail_cache_set_compression(ctx.cache, NULL);
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	test_assert(mail_cache_field_exists(cache_view, 1,
+					    ctx.cache_field.idx) == 0);
+	test_assert(mail_cache_field_exists(cache_view, 1,
+					    ctx.cache_field2.idx) == 1);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1,
+					    ctx.cache_field.idx) == 0);
+	mail_cache_view_close(&cache_view);
+
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
@@ -820,6 +931,7 @@ int main(void)
 		test_mail_cache_in_memory,
 		test_mail_cache_size_corruption,
 		test_mail_cache_duplicate_fields,
+		test_mail_cache_compression,
 		NULL
 	};
 	return test_run(test_functions);
@@ -61,6 +61,22 @@ static void test_mail_index_modseq_get_next_log_offset(void)
 		test_assert_idx(tests[modseq].log_seq == log_seq && tests[modseq].log_offset == log_offset, modseq);
 	}
 
+	/* the modseq header snapshot gives the same results without cache */
+	struct mail_index_modseq_header *modseq_hdr =
+		&index->map->modseq_hdr_snapshot;
+	modseq_hdr->log_seq = 3;
+	modseq_hdr->log_offset = 56;
+	modseq_hdr->highest_modseq = 5;
+	for (uint64_t modseq = 1; modseq <= 7; modseq++) {
+		uint32_t log_seq = 0;
+		uoff_t log_offset;
+
+		memset(index->log->head->modseq_cache, 0,
+		       sizeof(index->log->head->modseq_cache));
+		test_assert_idx(mail_index_modseq_get_next_log_offset(view2, modseq, &log_seq, &log_offset) == (tests[modseq].log_seq != 0), modseq);
+		test_assert_idx(tests[modseq].log_seq == log_seq && tests[modseq].log_offset == log_offset, modseq);
+	}
+
 	mail_index_view_close(&view);
 	mail_index_view_close(&view2);
 	test_mail_index_deinit(&index);
@@ -5,6 +5,7 @@
 #include "test-common.h"
 #include "test-mail-index.h"
 #include "mail-transaction-log-private.h"
+#include "mail-index-transaction-private.h"
 
 static void test_mail_index_rotate(void)
 {
@@ -158,11 +159,258 @@ static void test_mail_index_new_extension(void)
 	test_end();
 }
 
+static void test_mail_index_mmap_append(void)
+{
+	struct mail_index *index, *index2;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	const struct mail_index_record *rec;
+	uint32_t file_seq, seq, uid, count, uid_validity = 1;
+	uoff_t file_offset;
+
+	test_begin("mail index mmap append");
+	index = test_mail_index_init(TRUE);
+	count = MAIL_INDEX_MMAP_MIN_SIZE / sizeof(struct mail_index_record) + 1;
+
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view, 0);
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid_validity, sizeof(uid_validity), TRUE);
+	for (uid = 1; uid <= count; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	test_assert(mail_transaction_log_sync_lock(index->log, "test",
+						   &file_seq, &file_offset) == 0);
+	mail_index_write(index, TRUE, "test");
+	mail_transaction_log_sync_unlock(index->log, "test");
+
+	/* The 2nd index mmap()s the large index file. Appending to it
+	   shouldn't require moving the records to memory. */
+	index2 = test_mail_index_open(FALSE);
+	test_assert(!MAIL_INDEX_MAP_IS_IN_MEMORY(index2->map));
+	view = mail_index_view_open(index2);
+	trans = mail_index_transaction_begin(view, 0);
+	for (uid = count + 1; uid <= count + 100; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(!MAIL_INDEX_MAP_IS_IN_MEMORY(index2->map));
+	test_assert(index2->map->hdr.messages_count == count + 100);
+	for (seq = 1; seq <= count + 100; seq++) {
+		rec = MAIL_INDEX_REC_AT_SEQ(index2->map, seq);
+		test_assert_idx(rec->uid == seq, seq);
+	}
+
+	test_mail_index_close(&index2);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_prefetch_files(void)
+{
+	struct mail_index *index;
+
+	test_begin("mail index prefetch files");
+	index = test_mail_index_init(TRUE);
+	test_mail_index_close(&index);
+
+	/* existing files and missing ones (no .cache file yet) */
+	mail_index_prefetch_files(NULL, TESTDIR_NAME, NULL,
+				  "test.dovecot.index");
+	mail_index_prefetch_files(NULL, TESTDIR_NAME, TESTDIR_NAME"/nonexistent",
+				  "test.dovecot.index");
+	/* the prefetching didn't break opening the index */
+	index = test_mail_index_open(FALSE);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_small_flag_updates(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_index_transaction_commit_result result;
+	const struct mail_index_record *rec;
+	uint32_t seq, uid, uid_validity = 1;
+
+	test_begin("mail index small flag updates");
+	index = test_mail_index_init(TRUE);
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid_validity, sizeof(uid_validity), TRUE);
+	for (uid = 1; uid <= 5; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	/* expunge UID 3 and set \Seen to UID 1 */
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_expunge(trans, 3);
+	mail_index_update_flags(trans, 1, MODIFY_ADD, MAIL_SEEN);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	/* seqs 1..4 are now UIDs 1,2,4,5. UID 1 already has \Seen, so only
+	   UIDs 2 and 4..5 are written. */
+	view = mail_index_view_open(index);
+	test_assert(mail_index_view_get_messages_count(view) == 4);
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_AVOID_FLAG_UPDATES);
+	mail_index_update_flags_range(trans, 1, 4, MODIFY_ADD, MAIL_SEEN);
+	test_assert(mail_index_transaction_commit_full(&trans, &result) == 0);
+	test_assert(result.commit_size ==
+		    sizeof(struct mail_transaction_header) +
+		    2 * sizeof(struct mail_transaction_flag_update));
+	test_assert((result.changes_mask &
+		     MAIL_INDEX_TRANSACTION_CHANGE_FLAGS) != 0);
+	mail_index_view_close(&view);
+
+	view = mail_index_view_open(index);
+	for (seq = 1; seq <= 4; seq++) {
+		rec = mail_index_lookup(view, seq);
+		test_assert_idx(rec->flags == MAIL_SEEN, seq);
+	}
+	/* nothing is written when all the updates are unnecessary */
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_AVOID_FLAG_UPDATES);
+	mail_index_update_flags_range(trans, 1, 4, MODIFY_ADD, MAIL_SEEN);
+	test_assert(mail_index_transaction_commit_full(&trans, &result) == 0);
+	test_assert(result.commit_size == 0);
+	test_assert((result.changes_mask &
+		     MAIL_INDEX_TRANSACTION_CHANGE_FLAGS) == 0);
+	mail_index_view_close(&view);
+
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void
+test_mail_index_small_flag_updates_add(struct mail_index_transaction *t,
+				       unsigned int variant)
+{
+	switch (variant) {
+	case 0:
+		mail_index_update_flags_range(t, 1, 4, MODIFY_ADD, MAIL_SEEN);
+		mail_index_update_flags(t, 6, MODIFY_REPLACE, MAIL_DRAFT);
+		mail_index_update_flags_range(t, 5, 7, MODIFY_REMOVE,
+					      MAIL_FLAGGED);
+		mail_index_update_flags_range(t, 7, 8, MODIFY_ADD,
+			MAIL_ANSWERED | MAIL_INDEX_MAIL_FLAG_UPDATE_MODSEQ);
+		break;
+	case 1:
+		/* all of these are unnecessary */
+		mail_index_update_flags(t, 1, MODIFY_ADD, MAIL_SEEN);
+		mail_index_update_flags_range(t, 2, 4, MODIFY_REMOVE,
+					      MAIL_DELETED);
+		break;
+	case 2:
+		mail_index_update_flags_range(t, 1, 9, MODIFY_REPLACE,
+					      MAIL_DELETED);
+		break;
+	default:
+		i_unreached();
+	}
+}
+
+static buffer_t *
+test_mail_index_small_flag_updates_export(struct mail_index_view *view,
+					  unsigned int variant, bool small,
+					  enum mail_index_transaction_change *changes_r)
+{
+	struct mail_index_transaction *trans;
+	struct mail_transaction_log_append_ctx *ctx;
+	buffer_t *output = buffer_create_dynamic(default_pool, 256);
+
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_AVOID_FLAG_UPDATES);
+	test_mail_index_small_flag_updates_add(trans, variant);
+	test_assert(mail_transaction_log_append_begin(view->index, 0, &ctx) == 0);
+	if (small)
+		test_assert(mail_index_transaction_export_small(trans, ctx,
+								changes_r));
+	else {
+		mail_index_transaction_finish(trans);
+		mail_index_transaction_export(trans, ctx, changes_r);
+	}
+	buffer_append_buf(output, ctx->output, 0, SIZE_MAX);
+	test_assert(mail_transaction_log_append_commit(&ctx) == 0);
+	mail_index_transaction_rollback(&trans);
+	return output;
+}
+
+static void test_mail_index_small_flag_updates_generic(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	enum mail_index_transaction_change changes_small, changes_generic;
+	buffer_t *small, *generic;
+	uint32_t seq, uid, uid_validity = 1;
+	unsigned int variant;
+
+	test_begin("mail index small flag updates match generic export");
+	index = test_mail_index_init(TRUE);
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid_validity, sizeof(uid_validity), TRUE);
+	for (uid = 1; uid <= 12; uid++)
+		mail_index_append(trans, uid, &seq);
+	mail_index_update_flags(trans, 1, MODIFY_ADD, MAIL_SEEN);
+	mail_index_update_flags(trans, 8, MODIFY_ADD, MAIL_FLAGGED);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	/* leave UID gaps in the middle of the updated ranges */
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_expunge(trans, 3);
+	mail_index_expunge(trans, 6);
+	mail_index_expunge(trans, 7);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	view = mail_index_view_open(index);
+	test_assert(mail_index_view_get_messages_count(view) == 9);
+	for (variant = 0; variant <= 2; variant++) {
+		small = test_mail_index_small_flag_updates_export(view,
+			variant, TRUE, &changes_small);
+		generic = test_mail_index_small_flag_updates_export(view,
+			variant, FALSE, &changes_generic);
+		test_assert_idx(buffer_cmp(small, generic), variant);
+		test_assert_idx(changes_small == changes_generic, variant);
+		buffer_free(&small);
+		buffer_free(&generic);
+	}
+	mail_index_view_close(&view);
+
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_rotate,
 		test_mail_index_new_extension,
+		test_mail_index_mmap_append,
+		test_mail_index_prefetch_files,
+		test_mail_index_small_flag_updates,
+		test_mail_index_small_flag_updates_generic,
 		NULL
 	};
 	return test_run(test_functions);
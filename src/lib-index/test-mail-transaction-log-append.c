@@ -7,6 +7,8 @@
 #include "mail-transaction-log-private.h"
 
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 static bool log_lock_failure = FALSE;
 
@@ -121,6 +123,8 @@ static void test_mail_transaction_log_append(void)
 	struct mail_transaction_log *log;
 	struct mail_transaction_log_file *file;
 	struct mail_transaction_log_append_ctx *ctx;
+	const struct mail_transaction_header *hdr;
+	unsigned char data[sizeof(*hdr) + sizeof(int) + 1];
 	struct stat st;
 	int fd;
 
@@ -153,6 +157,42 @@ static void test_mail_transaction_log_append(void)
 	test_assert(mail_transaction_log_append_commit(&ctx) == 0);
 	if (fstat(fd, &st) < 0) i_fatal("fstat() failed: %m");
 	test_assert(st.st_size == 1);
+	test_end();
+
+	test_begin("transaction log append: fsync");
+	log->index->set.fsync_mode = FSYNC_MODE_ALWAYS;
+	test_assert(mail_transaction_log_append_begin(log->index, 0, &ctx) == 0);
+	mail_transaction_log_append_add(ctx, MAIL_TRANSACTION_APPEND,
+					&fd, sizeof(fd));
+	test_assert(mail_transaction_log_append_commit(&ctx) == 0);
+	/* the record was written even though fdatasync() was done only
+	   after unlocking */
+	if (fstat(fd, &st) < 0) i_fatal("fstat() failed: %m");
+	test_assert(st.st_size == (off_t)(sizeof(*hdr) + sizeof(fd)));
+	test_assert(pread(fd, data, sizeof(data), 0) ==
+		    (ssize_t)(sizeof(*hdr) + sizeof(fd)));
+	hdr = (const void *)data;
+	test_assert(hdr->type == MAIL_TRANSACTION_APPEND);
+	test_assert(mail_index_offset_to_uint32(hdr->size) ==
+		    sizeof(*hdr) + sizeof(fd));
+	test_assert(memcmp(hdr + 1, &fd, sizeof(fd)) == 0);
+	test_end();
+
+	/* fdatasync() fails on /dev/null. The records are already written
+	   when it's called after unlocking, but the caller must still be
+	   told that they may not be on disk. */
+	test_begin("transaction log append: deferred fsync failure");
+	int null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd == -1) i_fatal("open(/dev/null) failed: %m");
+	file->fd = null_fd;
+	test_assert(mail_transaction_log_append_begin(log->index, 0, &ctx) == 0);
+	mail_transaction_log_append_add(ctx, MAIL_TRANSACTION_APPEND,
+					&fd, sizeof(fd));
+	test_assert(mail_transaction_log_append_commit(&ctx) == -1);
+	/* the log wasn't moved to memory */
+	test_assert(file->fd == null_fd);
+	i_close_fd(&file->fd);
+	log->index->set.fsync_mode = FSYNC_MODE_OPTIMIZED;
 	file->fd = -1;
 	test_end();
 
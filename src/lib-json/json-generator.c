@@ -652,6 +652,13 @@ int json_generate_number_raw(struct json_generator *generator,
  * string
  */
 
+/* Returns TRUE if the octet is an ASCII character that can be written into
+   a JSON string as-is. */
+static inline bool json_char_is_plain_ascii(unsigned char c)
+{
+	return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
 void json_generate_string_open(struct json_generator *generator)
 {
 	json_generator_value_begin(generator);
@@ -690,6 +697,12 @@ json_generate_string_write_data(struct json_generator *generator,
 
 		poffset = p;
 		while (avail > 0 && p < pend && esc == NULL) {
+			if (json_char_is_plain_ascii(*p)) {
+				/* fast path for the common case */
+				p++;
+				avail--;
+				continue;
+			}
 			octets = uni_utf8_get_char_n(p, (pend - p), &ch);
 			if (octets < 0 || (octets == 0 && last) ||
 			    (octets > 0  && !uni_is_valid_ucs4(ch))) {
@@ -1651,11 +1664,20 @@ void json_append_escaped(string_t *dest, const char *src)
 void json_append_escaped_data(string_t *dest, const unsigned char *src,
 			      size_t size)
 {
-	size_t i;
+	size_t i, start;
 	int bytes = 0;
 	unichar_t chr;
 
 	for (i = 0; i < size;) {
+		/* append runs of characters needing no escaping at once */
+		start = i;
+		while (i < size && json_char_is_plain_ascii(src[i]))
+			i++;
+		if (i > start) {
+			str_append_data(dest, src + start, i - start);
+			continue;
+		}
+
 		bytes = uni_utf8_get_char_n(src+i, size-i, &chr);
 		if (bytes > 0 && uni_is_valid_ucs4(chr)) {
 			json_append_escaped_ucs4(dest, chr);
@@ -0,0 +1,153 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "istream.h"
+#include "istream-crlf.h"
+#include "istream-dot.h"
+#include "ostream.h"
+#include "ostream-dot.h"
+#include "randgen.h"
+#include "time-util.h"
+#include "strnum.h"
+
+#include <stdio.h>
+
+/**
+ * Generates mail-like text with the given line endings and runs it through
+ * the CRLF and dot-stuffing streams used by LMTP delivery and IMAP FETCH.
+ * Prints the throughput of each stream.
+ */
+
+static void
+build_input(buffer_t *buf, size_t size, bool crlf)
+{
+	static const char chars[] =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+
+	while (buf->used < size) {
+		unsigned int line_len = 40 + i_rand_limit(60);
+
+		/* some lines start with a dot that needs to be escaped */
+		if (i_rand_limit(20) == 0)
+			buffer_append_c(buf, '.');
+		for (unsigned int i = 0; i < line_len; i++)
+			buffer_append_c(buf, chars[i_rand_limit(sizeof(chars) - 1)]);
+		if (crlf)
+			buffer_append_c(buf, '\r');
+		buffer_append_c(buf, '\n');
+	}
+}
+
+static void print_speed(const char *name, size_t size, uint64_t nsecs)
+{
+	double secs = (double)nsecs / 1000000000.0;
+
+	printf("%-24s %8.02lf MB/s  %6.03lf s/GB\n", name,
+	       ((double)size / (1024.0*1024.0)) / secs,
+	       secs * ((1024.0*1024.0*1024.0) / (double)size));
+}
+
+static void
+bench_istream(const char *name, const buffer_t *input, unsigned int rounds,
+	      struct istream *(*create)(struct istream *input))
+{
+	const unsigned char *data;
+	size_t size, total = 0;
+	uint64_t ts_0, ts_1;
+
+	ts_0 = i_nanoseconds();
+	for (unsigned int r = 0; r < rounds; r++) {
+		struct istream *is_data =
+			i_stream_create_from_buffer(input);
+		struct istream *is = create(is_data);
+		i_stream_unref(&is_data);
+
+		while (i_stream_read_more(is, &data, &size) > 0) {
+			i_stream_skip(is, size);
+			total += size;
+		}
+		if (is->stream_errno != 0)
+			printf("Error: %s\n", i_stream_get_error(is));
+		i_stream_unref(&is);
+	}
+	ts_1 = i_nanoseconds();
+	print_speed(name, total, ts_1 - ts_0);
+}
+
+static struct istream *create_istream_dot(struct istream *input)
+{
+	return i_stream_create_dot(input, 0);
+}
+
+static void
+bench_ostream_dot(const buffer_t *input, unsigned int rounds)
+{
+	buffer_t *output = buffer_create_dynamic(default_pool,
+						 input->used + input->used/10);
+	size_t total = 0;
+	uint64_t ts_0, ts_1;
+
+	ts_0 = i_nanoseconds();
+	for (unsigned int r = 0; r < rounds; r++) {
+		struct ostream *os_buf = o_stream_create_buffer(output);
+		struct ostream *os = o_stream_create_dot(os_buf, FALSE);
+
+		buffer_set_used_size(output, 0);
+		o_stream_nsend(os, input->data, input->used);
+		i_assert(o_stream_finish(os) == 1);
+		o_stream_unref(&os);
+		o_stream_unref(&os_buf);
+		total += input->used;
+	}
+	ts_1 = i_nanoseconds();
+	print_speed("o_stream_create_dot()", total, ts_1 - ts_0);
+	buffer_free(&output);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [input_size rounds]\n", prog);
+	fprintf(stderr, "Runs with 10 rounds of 16MB if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	unsigned long input_size = 16*1024*1024UL;
+	unsigned int rounds = 10;
+
+	lib_init();
+
+	if (argc == 3) {
+		if (str_to_ulong(argv[1], &input_size) < 0 ||
+		    str_to_uint(argv[2], &rounds) < 0 || rounds == 0) {
+			fprintf(stderr, "Invalid parameters\n");
+			print_usage(argv[0]);
+		}
+	} else if (argc != 1) {
+		print_usage(argv[0]);
+	}
+
+	buffer_t *lf_input = buffer_create_dynamic(default_pool, input_size);
+	buffer_t *crlf_input = buffer_create_dynamic(default_pool, input_size);
+	build_input(lf_input, input_size, FALSE);
+	build_input(crlf_input, input_size, TRUE);
+	/* end with the "." line for the dot istream */
+	buffer_append(crlf_input, ".\r\n", 3);
+
+	printf("Input data is %u rounds of %lu bytes\n\n", rounds, input_size);
+
+	bench_istream("i_stream_create_crlf()", lf_input, rounds,
+		      i_stream_create_crlf);
+	bench_istream("i_stream_create_lf()", crlf_input, rounds,
+		      i_stream_create_lf);
+	bench_istream("i_stream_create_dot()", crlf_input, rounds,
+		      create_istream_dot);
+	bench_ostream_dot(lf_input, rounds);
+
+	buffer_free(&lf_input);
+	buffer_free(&crlf_input);
+	lib_deinit();
+	return 0;
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "istream.h"
+#include "message-address.h"
+#include "message-date.h"
+#include "message-header-parser.h"
+#include "message-parser.h"
+#include "test-bench.h"
+
+#include <stdio.h>
+
+/**
+ * Micro-benchmarks for the mail parsers used when saving and fetching mails:
+ * address and date parsing, header parsing and MIME structure parsing of a
+ * small multipart mail. Give a wildcard mask parameter to run only the
+ * matching benchmarks.
+ */
+
+static const char bench_addresses[] =
+	"\"Example User\" <user@example.com>, other@example.org, "
+	"Group: member1@example.com, \"Member Two\" <member2@example.com>;, "
+	"=?utf-8?q?Encoded_Name?= <encoded@example.net>";
+
+static const char bench_date[] = "Tue, 13 Oct 2026 09:12:44 +0300";
+
+static const char bench_mail[] =
+	"Return-Path: <sender@example.com>\r\n"
+	"Received: from mx.example.com (mx.example.com [192.0.2.1])\r\n"
+	"\tby mail.example.org with LMTP id abcdef\r\n"
+	"\tfor <user@example.org>; Tue, 13 Oct 2026 09:12:45 +0300\r\n"
+	"From: \"Example Sender\" <sender@example.com>\r\n"
+	"To: user@example.org\r\n"
+	"Subject: Benchmark mail with an attachment\r\n"
+	"Date: Tue, 13 Oct 2026 09:12:44 +0300\r\n"
+	"Message-ID: <1234567890.abcdef@example.com>\r\n"
+	"MIME-Version: 1.0\r\n"
+	"Content-Type: multipart/mixed; boundary=\"bench-boundary\"\r\n"
+	"\r\n"
+	"This is a multi-part message in MIME format.\r\n"
+	"--bench-boundary\r\n"
+	"Content-Type: text/plain; charset=utf-8\r\n"
+	"Content-Transfer-Encoding: 7bit\r\n"
+	"\r\n"
+	"Hello,\r\n"
+	"\r\n"
+	"this is the body text of the benchmark mail.\r\n"
+	"--bench-boundary\r\n"
+	"Content-Type: application/octet-stream; name=\"data.bin\"\r\n"
+	"Content-Transfer-Encoding: base64\r\n"
+	"Content-Disposition: attachment; filename=\"data.bin\"\r\n"
+	"\r\n"
+	"QmVuY2htYXJrIGF0dGFjaG1lbnQgZGF0YSBCZW5jaG1hcmsgYXR0YWNobWVudCBkYXRh\r\n"
+	"QmVuY2htYXJrIGF0dGFjaG1lbnQgZGF0YSBCZW5jaG1hcmsgYXR0YWNobWVudCBkYXRh\r\n"
+	"--bench-boundary--\r\n";
+
+static unsigned int bench_counter;
+
+static void bench_address_parse(void *context ATTR_UNUSED)
+{
+	struct message_address *addr;
+
+	addr = message_address_parse(pool_datastack_create(),
+				     (const unsigned char *)bench_addresses,
+				     sizeof(bench_addresses) - 1, UINT_MAX, 0);
+	for (; addr != NULL; addr = addr->next)
+		bench_counter++;
+}
+
+static void bench_date_parse(void *context ATTR_UNUSED)
+{
+	time_t t;
+	int tz;
+
+	if (message_date_parse((const unsigned char *)bench_date,
+			       sizeof(bench_date) - 1, &t, &tz))
+		bench_counter++;
+}
+
+static void bench_header_parse(void *context ATTR_UNUSED)
+{
+	struct istream *input =
+		i_stream_create_from_data(bench_mail, sizeof(bench_mail) - 1);
+	struct message_header_parser_ctx *parser =
+		message_parse_header_init(input, NULL, 0);
+	struct message_header_line *hdr;
+
+	while (message_parse_header_next(parser, &hdr) > 0)
+		bench_counter++;
+	message_parse_header_deinit(&parser);
+	i_stream_unref(&input);
+}
+
+static void bench_message_parse(void *context ATTR_UNUSED)
+{
+	const struct message_parser_settings set = { .flags = 0 };
+	struct istream *input =
+		i_stream_create_from_data(bench_mail, sizeof(bench_mail) - 1);
+	struct message_parser_ctx *parser =
+		message_parser_init(pool_datastack_create(), input, &set);
+	struct message_block block;
+	struct message_part *parts;
+
+	while (message_parser_parse_next_block(parser, &block) > 0)
+		bench_counter++;
+	message_parser_deinit(&parser, &parts);
+	i_stream_unref(&input);
+}
+
+int main(int argc, const char *argv[])
+{
+	lib_init();
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [<benchmark name mask>]\n", argv[0]);
+		lib_exit(1);
+	}
+	test_bench_set_filter(argv[1]);
+
+	test_bench_print_header();
+	test_bench_run("message_address_parse()", 100000,
+		       sizeof(bench_addresses) - 1, bench_address_parse, NULL);
+	test_bench_run("message_date_parse()", 100000,
+		       sizeof(bench_date) - 1, bench_date_parse, NULL);
+	test_bench_run("message_parse_header_next()", 100000,
+		       sizeof(bench_mail) - 1, bench_header_parse, NULL);
+	test_bench_run("message_parser_parse_next_block()", 100000,
+		       sizeof(bench_mail) - 1, bench_message_parse, NULL);
+
+	test_bench_set_filter(NULL);
+	lib_deinit();
+	return 0;
+}
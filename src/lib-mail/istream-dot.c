@@ -154,6 +154,20 @@ static ssize_t i_stream_dot_read(struct istream_private *stream)
 
 	data = i_stream_get_data(stream->parent, &size);
 	for (i = 0; i < size && dest < stream->buffer_size; i++) {
+		if (dstream->state == DOT_STATE_SEEN_NONE) {
+			/* copy everything until the next CR (or LF) */
+			size_t max = I_MIN(size - i, stream->buffer_size - dest);
+			const unsigned char *p = dstream->accept_bare_lf ?
+				i_memchr2(data + i, '\r', '\n', max) :
+				memchr(data + i, '\r', max);
+			size_t len = p == NULL ? max : (size_t)(p - (data + i));
+
+			memcpy(stream->w_buffer + dest, data + i, len);
+			dest += len;
+			i += len;
+			if (p == NULL)
+				break;
+		}
 		switch (dstream->state) {
 		case DOT_STATE_SEEN_NONE:
 			break;
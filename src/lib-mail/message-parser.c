@@ -391,6 +391,26 @@ static int parse_part_finish(struct message_parser_ctx *ctx,
 	return ctx->parse_next_block(ctx, block_r);
 }
 
+static const unsigned char *
+boundary_line_candidate_find(const unsigned char *lf, const unsigned char *end)
+{
+	const unsigned char *p, *dash;
+
+	/* Find the next LF that is followed by "--". The lines before it
+	   can't be boundaries. Searching for '-' is fast, because it's rare
+	   in e.g. base64 encoded bodies. */
+	for (p = lf + 1; (dash = memchr(p, '-', end - p)) != NULL; p = dash + 1) {
+		if (dash[-1] == '\n' && dash + 1 < end && dash[1] == '-')
+			return dash - 1;
+	}
+	/* No more such lines. Return the last LF, unless there's an LF
+	   before it that is followed by less than 2 bytes. */
+	if (end - lf > 2 && end[-2] == '\n')
+		return end - 2;
+	for (p = end - 1; *p != '\n'; p--) ;
+	return p;
+}
+
 static int parse_next_body_to_boundary(struct message_parser_ctx *ctx,
 				       struct message_block *block_r)
 {
@@ -422,6 +442,10 @@ static int parse_next_body_to_boundary(struct message_parser_ctx *ctx,
 	   handled already. */
 	cur = data; end = data + block_r->size;
 	while ((next = memchr(cur, '\n', end - cur)) != NULL) {
+		if (end - next > 3 && (next[1] != '-' || next[2] != '-')) {
+			/* skip over the lines that can't be boundaries */
+			next = boundary_line_candidate_find(next, end);
+		}
 		cur = next + 1;
 
 		boundary_start = next - data;
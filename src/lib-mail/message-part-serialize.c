@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "buffer.h"
+#include "numpack.h"
 #include "message-parser.h"
 #include "message-part-serialize.h"
 
@@ -26,79 +27,93 @@
      (flags & (MESSAGE_PART_FLAG_MULTIPART | MESSAGE_PART_FLAG_MESSAGE_RFC822))
        unsigned int children_count
 
+   The above fields are written as fixed size native integers. With the
+   packed format the data begins with MESSAGE_PART_SERIALIZE_PACKED_PREFIX
+   and the fields are written with numpack. The fixed size format never
+   begins with the prefix, because flags fit into the lowest byte.
+   Deserializing supports both formats.
 */
 
+#define MESSAGE_PART_SERIALIZE_PACKED_PREFIX "\xff\x01"
+#define MESSAGE_PART_SERIALIZE_PACKED_PREFIX_LEN 2
+
 struct deserialize_context {
 	pool_t pool;
 	const unsigned char *data, *end;
 
 	uoff_t pos;
 	const char *error;
+	bool packed;
 };
 
-static void part_serialize(struct message_part *part, buffer_t *dest,
-			   unsigned int *children_count_r)
+static void
+part_write_uint(buffer_t *dest, bool packed, unsigned int num)
 {
-	unsigned int count, children_count;
-	size_t children_offset;
+	if (packed)
+		numpack_encode(dest, num);
+	else
+		buffer_append(dest, &num, sizeof(num));
+}
+
+static void part_write_uoff(buffer_t *dest, bool packed, uoff_t num)
+{
+	if (packed)
+		numpack_encode(dest, num);
+	else
+		buffer_append(dest, &num, sizeof(num));
+}
+
+static void
+part_serialize(struct message_part *part, buffer_t *dest, bool packed)
+{
+	const struct message_part *child;
+	unsigned int children_count;
 	bool root = part->parent == NULL;
 
-	count = 0;
 	while (part != NULL) {
 		/* create serialized part */
-		buffer_append(dest, &part->flags, sizeof(part->flags));
+		part_write_uint(dest, packed, part->flags);
 		if (root)
 			root = FALSE;
-		else {
-			buffer_append(dest, &part->physical_pos,
-				      sizeof(part->physical_pos));
-		}
-		buffer_append(dest, &part->header_size.physical_size,
-			      sizeof(part->header_size.physical_size));
-		buffer_append(dest, &part->header_size.virtual_size,
-			      sizeof(part->header_size.virtual_size));
-		buffer_append(dest, &part->body_size.physical_size,
-			      sizeof(part->body_size.physical_size));
-		buffer_append(dest, &part->body_size.virtual_size,
-			      sizeof(part->body_size.virtual_size));
+		else
+			part_write_uoff(dest, packed, part->physical_pos);
+		part_write_uoff(dest, packed, part->header_size.physical_size);
+		part_write_uoff(dest, packed, part->header_size.virtual_size);
+		part_write_uoff(dest, packed, part->body_size.physical_size);
+		part_write_uoff(dest, packed, part->body_size.virtual_size);
 
 		if ((part->flags & (MESSAGE_PART_FLAG_TEXT |
-				    MESSAGE_PART_FLAG_MESSAGE_RFC822)) != 0) {
-			buffer_append(dest, &part->body_size.lines,
-				      sizeof(part->body_size.lines));
-		}
+				    MESSAGE_PART_FLAG_MESSAGE_RFC822)) != 0)
+			part_write_uint(dest, packed, part->body_size.lines);
 
 		if ((part->flags & (MESSAGE_PART_FLAG_MULTIPART |
 				    MESSAGE_PART_FLAG_MESSAGE_RFC822)) != 0) {
-			children_offset = dest->used;
 			children_count = 0;
-			buffer_append(dest, &children_count,
-				      sizeof(children_count));
+			for (child = part->children; child != NULL;
+			     child = child->next)
+				children_count++;
+			part_write_uint(dest, packed, children_count);
 
-			if (part->children != NULL) {
-				part_serialize(part->children, dest,
-					       &children_count);
-
-				buffer_write(dest, children_offset,
-					     &children_count,
-					     sizeof(children_count));
-			}
+			if (part->children != NULL)
+				part_serialize(part->children, dest, packed);
 		} else {
 			i_assert(part->children == NULL);
 		}
 
-		count++;
 		part = part->next;
 	}
-
-	*children_count_r = count;
 }
 
 void message_part_serialize(struct message_part *part, buffer_t *dest)
 {
-	unsigned int children_count;
+	part_serialize(part, dest, FALSE);
+}
 
-	part_serialize(part, dest, &children_count);
+void message_part_serialize_packed(struct message_part *part, buffer_t *dest)
+{
+	buffer_append(dest, MESSAGE_PART_SERIALIZE_PACKED_PREFIX,
+		      MESSAGE_PART_SERIALIZE_PACKED_PREFIX_LEN);
+	part_serialize(part, dest, TRUE);
 }
 
 static bool read_next(struct deserialize_context *ctx,
@@ -114,6 +129,34 @@ static bool read_next(struct deserialize_context *ctx,
 	return TRUE;
 }
 
+static bool read_next_uint(struct deserialize_context *ctx, unsigned int *num_r)
+{
+	uint32_t num;
+
+	if (!ctx->packed)
+		return read_next(ctx, num_r, sizeof(*num_r));
+	if (numpack_decode32(&ctx->data, ctx->end, &num) < 0) {
+		ctx->error = "Not enough data";
+		return FALSE;
+	}
+	*num_r = num;
+	return TRUE;
+}
+
+static bool read_next_uoff(struct deserialize_context *ctx, uoff_t *num_r)
+{
+	uint64_t num;
+
+	if (!ctx->packed)
+		return read_next(ctx, num_r, sizeof(*num_r));
+	if (numpack_decode(&ctx->data, ctx->end, &num) < 0) {
+		ctx->error = "Not enough data";
+		return FALSE;
+	}
+	*num_r = num;
+	return TRUE;
+}
+
 static bool ATTR_NULL(2)
 message_part_deserialize_part(struct deserialize_context *ctx,
 			      struct message_part *parent,
@@ -121,7 +164,7 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 			      struct message_part **part_r)
 {
 	struct message_part *p, *part, *first_part, **next_part;
-	unsigned int children_count;
+	unsigned int flags, children_count;
 	uoff_t pos;
 	bool root = parent == NULL;
 
@@ -135,14 +178,14 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 		for (p = parent; p != NULL; p = p->parent)
 			p->children_count++;
 
-		if (!read_next(ctx, &part->flags, sizeof(part->flags)))
+		if (!read_next_uint(ctx, &flags))
 			return FALSE;
+		part->flags = flags;
 
 		if (root)
 			root = FALSE;
 		else {
-			if (!read_next(ctx, &part->physical_pos,
-				       sizeof(part->physical_pos)))
+			if (!read_next_uoff(ctx, &part->physical_pos))
 				return FALSE;
 		}
 
@@ -151,12 +194,10 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 			return FALSE;
 		}
 
-		if (!read_next(ctx, &part->header_size.physical_size,
-			       sizeof(part->header_size.physical_size)))
+		if (!read_next_uoff(ctx, &part->header_size.physical_size))
 			return FALSE;
 
-		if (!read_next(ctx, &part->header_size.virtual_size,
-			       sizeof(part->header_size.virtual_size)))
+		if (!read_next_uoff(ctx, &part->header_size.virtual_size))
 			return FALSE;
 
 		if (part->header_size.virtual_size <
@@ -165,18 +206,15 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 			return FALSE;
 		}
 
-		if (!read_next(ctx, &part->body_size.physical_size,
-			       sizeof(part->body_size.physical_size)))
+		if (!read_next_uoff(ctx, &part->body_size.physical_size))
 			return FALSE;
 
-		if (!read_next(ctx, &part->body_size.virtual_size,
-			       sizeof(part->body_size.virtual_size)))
+		if (!read_next_uoff(ctx, &part->body_size.virtual_size))
 			return FALSE;
 
 		if ((part->flags & (MESSAGE_PART_FLAG_TEXT |
 				    MESSAGE_PART_FLAG_MESSAGE_RFC822)) != 0) {
-			if (!read_next(ctx, &part->body_size.lines,
-				       sizeof(part->body_size.lines)))
+			if (!read_next_uint(ctx, &part->body_size.lines))
 				return FALSE;
 		}
 
@@ -188,8 +226,7 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 
 		if ((part->flags & (MESSAGE_PART_FLAG_MULTIPART |
 				    MESSAGE_PART_FLAG_MESSAGE_RFC822)) != 0) {
-			if (!read_next(ctx, &children_count,
-				       sizeof(children_count)))
+			if (!read_next_uint(ctx, &children_count))
 				return FALSE;
 		} else {
                         children_count = 0;
@@ -251,6 +288,12 @@ message_part_deserialize(pool_t pool, const void *data, size_t size,
 	ctx.pool = pool;
 	ctx.data = data;
 	ctx.end = ctx.data + size;
+	if (size >= MESSAGE_PART_SERIALIZE_PACKED_PREFIX_LEN &&
+	    memcmp(data, MESSAGE_PART_SERIALIZE_PACKED_PREFIX,
+		   MESSAGE_PART_SERIALIZE_PACKED_PREFIX_LEN) == 0) {
+		ctx.packed = TRUE;
+		ctx.data += MESSAGE_PART_SERIALIZE_PACKED_PREFIX_LEN;
+	}
 
 	if (!message_part_deserialize_part(&ctx, NULL, 1, &part)) {
 		*error_r = ctx.error;
@@ -6,6 +6,10 @@ struct message_size;
 
 /* Serialize message part. */
 void message_part_serialize(struct message_part *part, buffer_t *dest);
+/* Serialize message part using variable length numbers. The result is much
+   smaller, but only message_part_deserialize() in Dovecot versions that
+   support the packed format can read it. */
+void message_part_serialize_packed(struct message_part *part, buffer_t *dest);
 
 /* Generate struct message_part from serialized data. Returns NULL and sets
    error if any problems are detected. */
@@ -1,6 +1,7 @@
 /* Copyright (c) 2002-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "bits.h"
 #include "buffer.h"
 #include "istream.h"
 #include "str.h"
@@ -42,7 +43,8 @@ void message_search_deinit(struct message_search_context **_ctx)
 	struct message_search_context *ctx = *_ctx;
 
 	*_ctx = NULL;
-	str_find_deinit(&ctx->str_find_ctx);
+	if (ctx->str_find_ctx != NULL)
+		str_find_deinit(&ctx->str_find_ctx);
 	message_decoder_deinit(&ctx->decoder);
 	i_free(ctx);
 }
@@ -115,9 +117,9 @@ bool message_search_more(struct message_search_context *ctx,
 	return message_search_more_get_decoded(ctx, raw_block, &decoded_block);
 }
 
-bool message_search_more_get_decoded(struct message_search_context *ctx,
-				     struct message_block *raw_block,
-				     struct message_block *decoded_block_r)
+static bool message_search_decode(struct message_search_context *ctx,
+				  struct message_block *raw_block,
+				  struct message_block *decoded_block_r)
 {
 	struct message_header_line *hdr = raw_block->hdr;
 	struct message_block decoded_block;
@@ -166,7 +168,16 @@ bool message_search_more_get_decoded(struct message_search_context *ctx,
 	}
 
 	*decoded_block_r = decoded_block;
-	return message_search_more_decoded2(ctx, &decoded_block);
+	return TRUE;
+}
+
+bool message_search_more_get_decoded(struct message_search_context *ctx,
+				     struct message_block *raw_block,
+				     struct message_block *decoded_block_r)
+{
+	if (!message_search_decode(ctx, raw_block, decoded_block_r))
+		return FALSE;
+	return message_search_more_decoded2(ctx, decoded_block_r);
 }
 
 bool message_search_more_decoded(struct message_search_context *ctx,
@@ -187,49 +198,386 @@ void message_search_reset(struct message_search_context *ctx)
 	ctx->content_type_text = TRUE;
 
 	ctx->prev_part = NULL;
-	str_find_reset(ctx->str_find_ctx);
+	if (ctx->str_find_ctx != NULL)
+		str_find_reset(ctx->str_find_ctx);
 	message_decoder_decode_reset(ctx->decoder);
 }
 
-int message_search_msg(struct message_search_context *ctx,
-		       struct istream *input, struct message_part *parts,
-		       const char **error_r)
+static struct message_parser_ctx *
+message_search_parser_init(struct istream *input, struct message_part *parts,
+			   pool_t *pool_r)
 {
 	const struct message_parser_settings parser_set = {
 		.hdr_flags = MESSAGE_HEADER_PARSER_FLAG_CLEAN_ONELINE,
 	};
+
+	if (parts != NULL) {
+		*pool_r = NULL;
+		return message_parser_init_from_parts(parts, input,
+						      &parser_set);
+	}
+	*pool_r = pool_alloconly_create("message search parts", 1024);
+	return message_parser_init(*pool_r, input, &parser_set);
+}
+
+static int
+message_search_parser_deinit(struct message_parser_ctx **parser_ctx,
+			     struct istream *input, pool_t *pool, int ret,
+			     const char **error_r)
+{
+	struct message_part *new_parts;
+
+	i_assert(ret != 0);
+	if (ret < 0 && input->stream_errno == 0) {
+		/* normal exit */
+		ret = 0;
+	}
+	if (message_parser_deinit_from_parts(parser_ctx, &new_parts,
+					     error_r) < 0) {
+		/* broken parts */
+		ret = -1;
+	}
+	pool_unref(pool);
+	return ret;
+}
+
+int message_search_msg(struct message_search_context *ctx,
+		       struct istream *input, struct message_part *parts,
+		       const char **error_r)
+{
 	struct message_parser_ctx *parser_ctx;
 	struct message_block raw_block;
-	struct message_part *new_parts;
-	pool_t pool = NULL;
+	pool_t pool;
 	int ret;
 
 	message_search_reset(ctx);
+	parser_ctx = message_search_parser_init(input, parts, &pool);
+	while ((ret = message_parser_parse_next_block(parser_ctx,
+						      &raw_block)) > 0) {
+		if (message_search_more(ctx, &raw_block)) {
+			ret = 1;
+			break;
+		}
+	}
+	return message_search_parser_deinit(&parser_ctx, input, &pool, ret,
+					    error_r);
+}
 
-	if (parts != NULL) {
-		parser_ctx = message_parser_init_from_parts(parts,
-						input, &parser_set);
-	} else {
-		pool = pool_alloconly_create("message search parts", 1024);
-		parser_ctx = message_parser_init(pool, input, &parser_set);
+int message_search_msg_multi(struct message_search_context *const *ctxs,
+			     unsigned int count, struct istream *input,
+			     struct message_part *parts, bool *matched_r,
+			     const char **error_r)
+{
+	struct message_parser_ctx *parser_ctx;
+	struct message_block raw_block, *decoded_blocks;
+	unsigned int i, *decoder_idx, matched_count = 0;
+	pool_t pool;
+	int ret;
+
+	/* The first search with the given flags decodes the blocks. The
+	   following searches with the same flags use its decoded blocks. */
+	decoder_idx = t_new(unsigned int, count);
+	decoded_blocks = t_new(struct message_block, count);
+	for (i = 0; i < count; i++) {
+		message_search_reset(ctxs[i]);
+		matched_r[i] = FALSE;
+		decoder_idx[i] = i;
+		for (unsigned int j = 0; j < i; j++) {
+			if (ctxs[j]->flags == ctxs[i]->flags) {
+				decoder_idx[i] = j;
+				break;
+			}
+		}
 	}
 
+	parser_ctx = message_search_parser_init(input, parts, &pool);
 	while ((ret = message_parser_parse_next_block(parser_ctx,
 						      &raw_block)) > 0) {
-		if (message_search_more(ctx, &raw_block)) {
+		for (i = 0; i < count; i++) {
+			bool found;
+
+			if (decoder_idx[i] == i) {
+				/* keep decoding even after matching, since
+				   the other searches may need the data */
+				found = message_search_more_get_decoded(ctxs[i],
+					&raw_block, &decoded_blocks[i]);
+			} else if (!matched_r[i]) {
+				found = message_search_more_decoded(ctxs[i],
+					&decoded_blocks[decoder_idx[i]]);
+			} else {
+				continue;
+			}
+			if (found && !matched_r[i]) {
+				matched_r[i] = TRUE;
+				matched_count++;
+			}
+		}
+		if (matched_count == count) {
 			ret = 1;
 			break;
 		}
 	}
-	i_assert(ret != 0);
-	if (ret < 0 && input->stream_errno == 0) {
-		/* normal exit */
-		ret = 0;
+	ret = message_search_parser_deinit(&parser_ctx, input, &pool, ret,
+					   error_r);
+	return ret < 0 ? -1 : 0;
+}
+
+struct message_search_bloom {
+	/* used only for decoding */
+	struct message_search_context *decode_ctx;
+	/* built with the maximum size, and shrunk when it's returned */
+	unsigned char filter[MESSAGE_SEARCH_BLOOM_MAX_SIZE];
+
+	/* set by message_search_bloom_init_stream() */
+	struct istream *input;
+	struct message_parser_ctx *parser_ctx;
+	pool_t parser_pool;
+
+	/* the last bytes of the previously added data */
+	unsigned char prev[MESSAGE_SEARCH_BLOOM_NGRAM_LEN-1];
+	unsigned int prev_len;
+};
+
+/* The filter sizes are powers of two, and each n-gram sets the bits
+   (hash >> 16) and (hash & 0xffff) modulo the filter's bit count. A filter
+   can then be halved by ORing its upper half into the lower half. */
+#if MESSAGE_SEARCH_BLOOM_MAX_SIZE * 8 != 65536
+#  error MESSAGE_SEARCH_BLOOM_MAX_SIZE must match the 16-bit hash halves
+#endif
+
+static uint32_t message_search_bloom_hash(const unsigned char ngram[3])
+{
+	uint32_t hash = (uint32_t)ngram[0] << 16 | ngram[1] << 8 | ngram[2];
+
+	/* murmurhash3 finalizer - all the bits depend on all the input */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static void
+message_search_bloom_set_ngram(unsigned char *filter,
+			       const unsigned char ngram[3])
+{
+	uint32_t hash = message_search_bloom_hash(ngram);
+	unsigned int bit1 = hash >> 16, bit2 = hash & 0xffff;
+
+	filter[bit1 / 8] |= 1 << (bit1 % 8);
+	filter[bit2 / 8] |= 1 << (bit2 % 8);
+}
+
+static unsigned int bloom_bits_set(const unsigned char *data, size_t size)
+{
+	unsigned int count = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		for (unsigned char c = data[i]; c != 0; c &= c - 1)
+			count++;
 	}
-	if (message_parser_deinit_from_parts(&parser_ctx, &new_parts, error_r) < 0) {
-		/* broken parts */
-		ret = -1;
+	return count;
+}
+
+static bool bloom_is_too_full(unsigned int bits_set, size_t size)
+{
+	return bits_set * 100 > size * 8 * MESSAGE_SEARCH_BLOOM_MAX_FILL_PERCENT;
+}
+
+static void
+message_search_bloom_add(struct message_search_bloom *bloom,
+			 const unsigned char *data, size_t size)
+{
+	const unsigned int n = MESSAGE_SEARCH_BLOOM_NGRAM_LEN;
+	unsigned char tmp[(MESSAGE_SEARCH_BLOOM_NGRAM_LEN-1)*2];
+	unsigned int i, tmp_len, head_len;
+
+	if (size == 0)
+		return;
+
+	/* the n-grams that begin in the previous data */
+	head_len = I_MIN(size, n - 1);
+	memcpy(tmp, bloom->prev, bloom->prev_len);
+	memcpy(tmp + bloom->prev_len, data, head_len);
+	tmp_len = bloom->prev_len + head_len;
+	for (i = 0; i < bloom->prev_len && i + n <= tmp_len; i++)
+		message_search_bloom_set_ngram(bloom->filter, tmp + i);
+
+	/* the n-grams inside this data */
+	for (size_t pos = 0; pos + n <= size; pos++)
+		message_search_bloom_set_ngram(bloom->filter, data + pos);
+
+	/* remember the last bytes for the next call */
+	if (size >= n - 1) {
+		memcpy(bloom->prev, data + size - (n - 1), n - 1);
+		bloom->prev_len = n - 1;
+	} else {
+		bloom->prev_len = I_MIN(tmp_len, n - 1);
+		memcpy(bloom->prev, tmp + tmp_len - bloom->prev_len,
+		       bloom->prev_len);
 	}
-	pool_unref(&pool);
-	return ret;
+}
+
+struct message_search_bloom *
+message_search_bloom_init(normalizer_func_t *normalizer)
+{
+	struct message_search_bloom *bloom;
+
+	bloom = i_new(struct message_search_bloom, 1);
+	bloom->decode_ctx = i_new(struct message_search_context, 1);
+	bloom->decode_ctx->normalizer = normalizer;
+	bloom->decode_ctx->decoder = message_decoder_init(normalizer, 0);
+	message_search_reset(bloom->decode_ctx);
+	return bloom;
+}
+
+void message_search_bloom_deinit(struct message_search_bloom **_bloom)
+{
+	struct message_search_bloom *bloom = *_bloom;
+
+	*_bloom = NULL;
+	if (bloom->parser_ctx != NULL) {
+		struct message_part *parts;
+
+		message_parser_deinit(&bloom->parser_ctx, &parts);
+	}
+	pool_unref(&bloom->parser_pool);
+	i_stream_unref(&bloom->input);
+	message_search_deinit(&bloom->decode_ctx);
+	i_free(bloom);
+}
+
+struct message_search_bloom *
+message_search_bloom_init_stream(struct istream *input,
+				 normalizer_func_t *normalizer)
+{
+	struct message_search_bloom *bloom;
+
+	bloom = message_search_bloom_init(normalizer);
+	bloom->input = input;
+	i_stream_ref(input);
+	bloom->parser_ctx = message_search_parser_init(input, NULL,
+						       &bloom->parser_pool);
+	return bloom;
+}
+
+int message_search_bloom_parse_more(struct message_search_bloom *bloom)
+{
+	struct message_block raw_block;
+	int ret;
+
+	i_assert(bloom->parser_ctx != NULL);
+
+	while ((ret = message_parser_parse_next_block(bloom->parser_ctx,
+						      &raw_block)) > 0)
+		message_search_bloom_more(bloom, &raw_block);
+	if (ret == 0)
+		return 0;
+	return bloom->input->stream_errno != 0 ? -1 : 1;
+}
+
+void message_search_bloom_more(struct message_search_bloom *bloom,
+			       struct message_block *raw_block)
+{
+	static const unsigned char crlf[2] = { '\r', '\n' };
+	struct message_block block;
+	const struct message_header_line *hdr;
+
+	if (!message_search_decode(bloom->decode_ctx, raw_block, &block))
+		return;
+
+	/* add the same data in the same order as search_header() and
+	   str_find_more() would see it */
+	hdr = block.hdr;
+	if (hdr == NULL) {
+		message_search_bloom_add(bloom, block.data, block.size);
+		return;
+	}
+	message_search_bloom_add(bloom, (const unsigned char *)hdr->name,
+				 hdr->name_len);
+	message_search_bloom_add(bloom, hdr->middle, hdr->middle_len);
+	message_search_bloom_add(bloom, hdr->full_value, hdr->full_value_len);
+	if (!hdr->no_newline)
+		message_search_bloom_add(bloom, crlf, sizeof(crlf));
+}
+
+void message_search_bloom_get_filter(struct message_search_bloom *bloom,
+				     buffer_t *dest)
+{
+	size_t start = dest->used, size = sizeof(bloom->filter), half;
+	unsigned char *data;
+	unsigned int bits_set;
+
+	if (bloom_is_too_full(bloom_bits_set(bloom->filter, size), size)) {
+		/* too many different n-grams - the filter would match
+		   almost everything */
+		return;
+	}
+
+	buffer_append(dest, bloom->filter, size);
+	data = buffer_get_modifiable_data(dest, NULL);
+	data += start;
+	/* halve the filter as long as it stays sparse enough */
+	while (size > MESSAGE_SEARCH_BLOOM_MIN_SIZE) {
+		half = size / 2;
+		bits_set = 0;
+		for (size_t i = 0; i < half; i++) {
+			for (unsigned char c = data[i] | data[half + i];
+			     c != 0; c &= c - 1)
+				bits_set++;
+		}
+		if (bloom_is_too_full(bits_set, half))
+			break;
+		for (size_t i = 0; i < half; i++)
+			data[i] |= data[half + i];
+		size = half;
+	}
+	buffer_set_used_size(dest, start + size);
+}
+
+int message_search_bloom_build(struct istream *input,
+			       normalizer_func_t *normalizer, buffer_t *dest)
+{
+	struct message_search_bloom *bloom;
+
+	bloom = message_search_bloom_init_stream(input, normalizer);
+	(void)message_search_bloom_parse_more(bloom);
+	message_search_bloom_get_filter(bloom, dest);
+	message_search_bloom_deinit(&bloom);
+	return input->stream_errno != 0 ? -1 : 0;
+}
+
+bool message_search_bloom_is_valid_size(size_t size)
+{
+	return size == 0 ||
+		(size >= MESSAGE_SEARCH_BLOOM_MIN_SIZE &&
+		 size <= MESSAGE_SEARCH_BLOOM_MAX_SIZE &&
+		 bits_is_power_of_two(size));
+}
+
+bool message_search_bloom_may_contain(const unsigned char *filter,
+				      size_t size,
+				      const char *normalized_key_utf8)
+{
+	const unsigned char *key = (const unsigned char *)normalized_key_utf8;
+	size_t i, len = strlen(normalized_key_utf8);
+	unsigned int bit1, bit2, mask = size * 8 - 1;
+	uint32_t hash;
+
+	i_assert(message_search_bloom_is_valid_size(size));
+
+	if (size == 0) {
+		/* the filter was too full to be stored */
+		return TRUE;
+	}
+	for (i = 0; i + MESSAGE_SEARCH_BLOOM_NGRAM_LEN <= len; i++) {
+		hash = message_search_bloom_hash(key + i);
+		bit1 = (hash >> 16) & mask;
+		bit2 = hash & mask;
+		if ((filter[bit1 / 8] & (1 << (bit1 % 8))) == 0 ||
+		    (filter[bit2 / 8] & (1 << (bit2 % 8))) == 0)
+			return FALSE;
+	}
+	return TRUE;
 }
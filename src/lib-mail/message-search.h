@@ -4,6 +4,20 @@
 struct message_block;
 struct message_part;
 struct message_search_context;
+struct message_search_bloom;
+
+/* The n-gram Bloom filter is sized according to the number of different
+   n-grams in the message. Its size in bytes is a power of two between these
+   values, or 0 if the message has too many of them. */
+#define MESSAGE_SEARCH_BLOOM_MIN_SIZE 16
+#define MESSAGE_SEARCH_BLOOM_MAX_SIZE 8192
+/* The filter is made as small as possible while no more than this many
+   percent of its bits are set. With two bits per n-gram, a single n-gram
+   that isn't in the message then matches at most 16% of the time, and
+   each further n-gram of the key lowers that. */
+#define MESSAGE_SEARCH_BLOOM_MAX_FILL_PERCENT 40
+/* Keys shorter than this can't be checked with the Bloom filter */
+#define MESSAGE_SEARCH_BLOOM_NGRAM_LEN 3
 
 enum message_search_flags {
 	/* Skip the main header and all the MIME headers. */
@@ -36,5 +50,50 @@ int message_search_msg(struct message_search_context *ctx,
 		       struct istream *input, struct message_part *parts,
 		       const char **error_r)
 	ATTR_NULL(3);
+/* Search multiple keys from a full message while parsing and reading the
+   message only once. matched_r[i] is set to TRUE if ctxs[i] matched. The
+   searches with the same flags share the decoded data. Returns 0 if the
+   message was fully searched, -1 if error (if stream_error == 0, the parts
+   contained broken data) */
+int message_search_msg_multi(struct message_search_context *const *ctxs,
+			     unsigned int count, struct istream *input,
+			     struct message_part *parts, bool *matched_r,
+			     const char **error_r)
+	ATTR_NULL(4);
+
+/* Build a Bloom filter of the n-grams in the decoded message text. The filter
+   contains all the data that message_search_msg() would search, so if
+   message_search_bloom_may_contain() returns FALSE, the search can't match.
+   The raw blocks must be parsed with MESSAGE_HEADER_PARSER_FLAG_CLEAN_ONELINE
+   the same way as message_search_msg() does. */
+struct message_search_bloom *
+message_search_bloom_init(normalizer_func_t *normalizer);
+void message_search_bloom_deinit(struct message_search_bloom **bloom);
+void message_search_bloom_more(struct message_search_bloom *bloom,
+			       struct message_block *raw_block);
+/* Append the filter to dest. Nothing is appended if the message has too many
+   different n-grams for the filter to be useful. */
+void message_search_bloom_get_filter(struct message_search_bloom *bloom,
+				     buffer_t *dest);
+/* Build the Bloom filter by parsing the input stream. This can be used with
+   a non-blocking stream (e.g. a tee child) to build the filter while the
+   message is being read elsewhere. */
+struct message_search_bloom *
+message_search_bloom_init_stream(struct istream *input,
+				 normalizer_func_t *normalizer);
+/* Parse all the currently available input. Returns 1 when the whole message
+   has been parsed, 0 if more input is needed, -1 on input stream error. */
+int message_search_bloom_parse_more(struct message_search_bloom *bloom);
+/* Build the Bloom filter from the full message and append it to dest.
+   Returns 0 on success, -1 on input stream error. */
+int message_search_bloom_build(struct istream *input,
+			       normalizer_func_t *normalizer, buffer_t *dest);
+/* Returns TRUE if size is a possible filter size. */
+bool message_search_bloom_is_valid_size(size_t size);
+/* Returns FALSE if the message can't contain the key. Keys shorter than
+   MESSAGE_SEARCH_BLOOM_NGRAM_LEN always return TRUE. */
+bool message_search_bloom_may_contain(const unsigned char *filter,
+				      size_t size,
+				      const char *normalized_key_utf8);
 
 #endif
@@ -108,6 +108,17 @@ o_stream_dot_sendv(struct ostream_private *stream,
 		for (; p < pend && (size_t)(p-data)+2 < max_bytes; p++) {
 			char add = 0;
 
+			if (dstream->state == STREAM_STATE_NONE) {
+				/* Only CR and LF change the state. Skip
+				   quickly over everything else. The last
+				   byte is handled by the switch below. */
+				size_t left = I_MIN((size_t)(pend - p),
+					max_bytes - 2 - (size_t)(p - data));
+				const char *crlf =
+					i_memchr2(p, '\r', '\n', left);
+				p = crlf != NULL ? crlf : p + left - 1;
+			}
+
 			switch (dstream->state) {
 			/* none */
 			case STREAM_STATE_NONE:
@@ -5,6 +5,10 @@
 #include "hex-binary.h"
 #include "qp-decoder.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 /* quoted-printable lines can be max 76 characters. if we've seen more than
    that much whitespace, it means there really shouldn't be anything else left
    in the line except trailing whitespace. */
@@ -12,6 +16,9 @@
 
 #define QP_IS_TRAILING_WHITESPACE(c) \
 	((c) == ' ' || (c) == '\t')
+/* Whitespace followed by one of these may be trailing whitespace */
+#define QP_IS_WHITESPACE_OR_NEWLINE(c) \
+	((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
 
 enum qp_state {
 	STATE_TEXT = 0,
@@ -48,6 +55,45 @@ void qp_decoder_deinit(struct qp_decoder **_qp)
 	i_free(qp);
 }
 
+#ifdef __SSE2__
+static inline __m128i qp_sse2_is_space_or_newline(__m128i v)
+{
+	return _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+		_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+			     _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+}
+
+/* Returns the number of bytes at the beginning of src that are plain text,
+   i.e. not '=', CR, LF or whitespace followed by more whitespace or
+   newline. */
+static size_t qp_decoder_skip_text_sse2(const unsigned char *src, size_t size)
+{
+	size_t i;
+
+	/* the following byte is looked at as well */
+	for (i = 0; i + 16 < size; i += 16) {
+		__m128i v = _mm_loadu_si128((const void *)(src + i));
+		__m128i next = _mm_loadu_si128((const void *)(src + i + 1));
+		__m128i ws = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+		__m128i stop = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('=')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+				     _mm_and_si128(ws,
+					qp_sse2_is_space_or_newline(next))));
+		int mask = _mm_movemask_epi8(stop);
+
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+	return i;
+}
+#endif
+
 static size_t
 qp_decoder_more_text(struct qp_decoder *qp, const unsigned char *src,
 		     size_t src_size)
@@ -55,6 +101,11 @@ qp_decoder_more_text(struct qp_decoder *qp, const unsigned char *src,
 	size_t i, start = 0, ret = src_size;
 
 	for (i = 0; i < src_size; i++) {
+#ifdef __SSE2__
+		i += qp_decoder_skip_text_sse2(src + i, src_size - i);
+		if (i == src_size)
+			break;
+#endif
 		if (src[i] > '=') {
 			/* fast path */
 			continue;
@@ -74,6 +125,11 @@ qp_decoder_more_text(struct qp_decoder *qp, const unsigned char *src,
 			continue;
 		case ' ':
 		case '\t':
+			if (i + 1 < src_size &&
+			    !QP_IS_WHITESPACE_OR_NEWLINE(src[i+1])) {
+				/* not trailing whitespace */
+				continue;
+			}
 			i_assert(qp->whitespace->used == 0);
 			qp->state = STATE_WHITESPACE;
 			buffer_append_c(qp->whitespace, src[i]);
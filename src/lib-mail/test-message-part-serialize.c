@@ -135,6 +135,17 @@ static struct test_case {
 		parts = message_part_deserialize(pool, dest->data, dest->used,
 						 &error);
 		test_assert(parts != NULL);
+		if (parts != NULL)
+			test_parsed_parts(is, parts);
+		else
+			i_error("message_part_deserialize: %s", error);
+
+		buffer_set_used_size(dest, 0);
+		if (parts != NULL)
+			message_part_serialize_packed(parts, dest);
+		parts = message_part_deserialize(pool, dest->data, dest->used,
+						 &error);
+		test_assert(parts != NULL);
 		if (parts != NULL)
 			test_parsed_parts(is, parts);
 		else
@@ -213,7 +224,56 @@ static void test_message_deserialize_errors(void)
 		TEST_CASE(dest->data, i, "Not enough data");
 	buffer_append_c(dest, '\x00');
 	TEST_CASE(dest->data, dest->used, "Too much data");
+	buffer_set_used_size(dest, 0);
 
+	message_part_serialize_packed(&part, dest);
+	for (size_t i = 0; i < dest->used - 1; i++)
+		TEST_CASE(dest->data, i, "Not enough data");
+	buffer_append_c(dest, '\x00');
+	TEST_CASE(dest->data, dest->used, "Too much data");
+
+	test_end();
+}
+
+static void test_message_deserialize_old_format(void)
+{
+	test_begin("message part deserialize old format");
+	const char *error = NULL;
+	struct message_part *part;
+	pool_t pool = pool_datastack_create();
+	buffer_t *dest = buffer_create_dynamic(pool, 256);
+	unsigned int flags = MESSAGE_PART_FLAG_TEXT, lines = 3;
+	uoff_t sizes[] = { 10, 12, 100, 103 };
+
+	/* fixed size fields for a single text/plain root part */
+	buffer_append(dest, &flags, sizeof(flags));
+	buffer_append(dest, sizes, sizeof(sizes));
+	buffer_append(dest, &lines, sizeof(lines));
+	part = message_part_deserialize(pool, dest->data, dest->used, &error);
+	test_assert(part != NULL);
+	if (part != NULL) {
+		test_assert(part->flags == MESSAGE_PART_FLAG_TEXT);
+		test_assert(part->header_size.physical_size == 10);
+		test_assert(part->header_size.virtual_size == 12);
+		test_assert(part->body_size.physical_size == 100);
+		test_assert(part->body_size.virtual_size == 103);
+		test_assert(part->body_size.lines == 3);
+		test_assert(part->children == NULL);
+
+		/* the default format is still the fixed size one */
+		buffer_t *buf = buffer_create_dynamic(pool, 256);
+		message_part_serialize(part, buf);
+		test_assert(buffer_cmp(buf, dest));
+
+		/* the packed format is much smaller */
+		buffer_set_used_size(buf, 0);
+		message_part_serialize_packed(part, buf);
+		test_assert(buf->used < dest->used / 2);
+		part = message_part_deserialize(pool, buf->data, buf->used,
+						&error);
+		test_assert(part != NULL && part->body_size.lines == 3 &&
+			    part->body_size.virtual_size == 103);
+	}
 	test_end();
 }
 
@@ -256,6 +316,7 @@ int main(void)
 	static void (*const test_functions[])(void) = {
 		test_message_serialize_deserialize,
 		test_message_deserialize_errors,
+		test_message_deserialize_old_format,
 		NULL
 	};
 	static enum fatal_test_state (*const fatal_functions[])(unsigned int) = {
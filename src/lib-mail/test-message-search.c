@@ -510,11 +510,226 @@ static void test_message_search_more_get_decoded(void)
 	test_end();
 }
 
+static void test_message_search_msg_multi(void)
+{
+	const char input[] =
+		"From: foo@example.com\n"
+		"Subject: header text\n"
+		"Content-Type: multipart/mixed; boundary=\"b\"\n"
+		"\n"
+		"--b\n"
+		"Content-Type: text/plain\n"
+		"Content-Transfer-Encoding: base64\n"
+		"\n"
+		"Ym9keSB0ZXh0\n"
+		"--b\n"
+		"Content-Type: application/octet-stream\n"
+		"\n"
+		"binary text\n"
+		"--b--\n";
+	static const struct {
+		const char *key;
+		enum message_search_flags flags;
+		bool expect_found;
+	} keys[] = {
+		{ "body text", 0, TRUE },
+		{ "header text", 0, TRUE },
+		{ "header text", MESSAGE_SEARCH_FLAG_SKIP_HEADERS, FALSE },
+		{ "body text", MESSAGE_SEARCH_FLAG_SKIP_HEADERS, TRUE },
+		{ "binary", MESSAGE_SEARCH_FLAG_SKIP_HEADERS, FALSE },
+		{ "nonexistent", 0, FALSE },
+	};
+	struct message_search_context *ctxs[N_ELEMENTS(keys)];
+	bool matched[N_ELEMENTS(keys)];
+	struct istream *is;
+	const char *error;
+	unsigned int i;
+
+	test_begin("message_search_msg_multi()");
+	for (i = 0; i < N_ELEMENTS(keys); i++)
+		ctxs[i] = message_search_init(keys[i].key, NULL, keys[i].flags);
+
+	is = test_istream_create_data(input, sizeof(input)-1);
+	test_assert(message_search_msg_multi(ctxs, N_ELEMENTS(ctxs), is, NULL,
+					     matched, &error) == 0);
+	for (i = 0; i < N_ELEMENTS(keys); i++) {
+		test_assert_idx(matched[i] == keys[i].expect_found, i);
+		/* the results must be the same as with separate searches */
+		i_stream_seek(is, 0);
+		test_assert_idx(message_search_msg(ctxs[i], is, NULL, &error) ==
+				(keys[i].expect_found ? 1 : 0), i);
+	}
+
+	/* stops as soon as all the keys have matched */
+	i_stream_seek(is, 0);
+	test_assert(message_search_msg_multi(ctxs, 2, is, NULL,
+					     matched, &error) == 0);
+	test_assert(matched[0] && matched[1]);
+	i_stream_unref(&is);
+
+	for (i = 0; i < N_ELEMENTS(keys); i++)
+		message_search_deinit(&ctxs[i]);
+	test_end();
+}
+
+static void test_message_search_bloom(void)
+{
+	const char input[] =
+		"From: foo@example.com\n"
+		"Subject: =?utf-8?q?p=C3=B6=C3=B6?= header\n"
+		"Content-Type: multipart/mixed; boundary=\"b\"\n"
+		"\n"
+		"--b\n"
+		"Content-Type: text/plain\n"
+		"Content-Transfer-Encoding: base64\n"
+		"\n"
+		"Ym9keSB0ZXh0\n"
+		"--b\n"
+		"Content-Type: application/octet-stream\n"
+		"\n"
+		"binary data\n"
+		"--b--\n";
+	static const char *const found_keys[] = {
+		"body text", "ody", "xt", "p\xC3\xB6\xC3\xB6 header",
+		"Subject: p", "foo@example.com\r\nSubject", "multipart",
+	};
+	static const char *const missing_keys[] = {
+		"binary", "nonexistent", "Ym9k",
+	};
+	buffer_t *filter = t_buffer_create(MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+	buffer_t *filter2 = t_buffer_create(MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+	struct message_search_context *ctx;
+	struct istream *is;
+	const char *error;
+	unsigned int i;
+
+	test_begin("message search bloom filter");
+	is = test_istream_create_data(input, sizeof(input)-1);
+	test_assert(message_search_bloom_build(is, NULL, filter) == 0);
+	/* a small message gets a small filter */
+	test_assert(filter->used > 0 && filter->used <= 256);
+	test_assert(message_search_bloom_is_valid_size(filter->used));
+
+	for (i = 0; i < N_ELEMENTS(found_keys); i++) {
+		ctx = message_search_init(found_keys[i], NULL, 0);
+		i_stream_seek(is, 0);
+		test_assert_idx(message_search_msg(ctx, is, NULL, &error) == 1, i);
+		message_search_deinit(&ctx);
+
+		/* the filter must never reject a key that is found */
+		test_assert_idx(message_search_bloom_may_contain(
+			filter->data, filter->used, found_keys[i]), i);
+	}
+	for (i = 0; i < N_ELEMENTS(missing_keys); i++) {
+		test_assert_idx(!message_search_bloom_may_contain(
+			filter->data, filter->used, missing_keys[i]), i);
+	}
+	i_stream_unref(&is);
+	test_end();
+
+	test_begin("message search bloom filter incremental");
+	struct message_search_bloom *bloom;
+	size_t size = 0;
+	int ret;
+
+	is = test_istream_create_data(input, sizeof(input)-1);
+	test_istream_set_allow_eof(is, FALSE);
+	bloom = message_search_bloom_init_stream(is, NULL);
+	do {
+		test_istream_set_size(is, ++size);
+		ret = message_search_bloom_parse_more(bloom);
+		if (size == sizeof(input)-1)
+			test_istream_set_allow_eof(is, TRUE);
+	} while (ret == 0 && size <= sizeof(input));
+	test_assert(ret == 1);
+	message_search_bloom_get_filter(bloom, filter2);
+	test_assert(buffer_cmp(filter, filter2));
+	message_search_bloom_deinit(&bloom);
+	i_stream_unref(&is);
+	test_end();
+}
+
+static void test_message_search_bloom_false_positives(void)
+{
+	static const char *const sentences[] = {
+		"Hi all,\n\n",
+		"Thanks for the quick reply yesterday. ",
+		"I looked into the issue with the nightly backup job again. ",
+		"It seems that the storage server runs out of disk space ",
+		"around three in the morning, right before the job finishes. ",
+		"We could either move the old archives to the new cluster ",
+		"or ask the vendor for a bigger volume. ",
+		"The second option would probably take a few weeks, ",
+		"so I would prefer to start with the first one. ",
+		"Let me know if you have any objections.\n\n",
+		"Also, the meeting on Thursday has been moved to Friday ",
+		"afternoon because half of the team is travelling. ",
+		"Please update your calendars and bring the quarterly ",
+		"numbers, including the budget forecast for next year. ",
+		"If something is still unclear, just call me or send ",
+		"a message to the support channel.\n\n",
+		"Best regards,\nJohn\n",
+	};
+	buffer_t *filter = t_buffer_create(MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+	string_t *input = t_str_new(4096), *key = t_str_new(16);
+	struct istream *is;
+	unsigned int i, j, len, tested = 0, false_positives = 0;
+
+	test_begin("message search bloom filter false positive rate");
+	str_append(input, "From: john@example.com\n"
+		   "To: team@example.com\n"
+		   "Subject: Backup job and Friday meeting\n\n");
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < N_ELEMENTS(sentences); j++)
+			str_append(input, sentences[j]);
+	}
+	is = test_istream_create_data(str_data(input), str_len(input));
+	test_assert(message_search_bloom_build(is, NULL, filter) == 0);
+	i_stream_unref(&is);
+	test_assert(filter->used > 0 &&
+		    filter->used < MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+
+	/* random lowercase words that aren't in the message */
+	for (i = 0; i < 2000; i++) {
+		str_truncate(key, 0);
+		len = i_rand_minmax(5, 8);
+		for (j = 0; j < len; j++)
+			str_append_c(key, 'a' + i_rand_limit(26));
+		if (strstr(str_c(input), str_c(key)) != NULL)
+			continue;
+		tested++;
+		if (message_search_bloom_may_contain(filter->data, filter->used,
+						     str_c(key)))
+			false_positives++;
+	}
+	test_assert(tested > 1900);
+	test_assert(false_positives * 100 < tested * 2);
+	test_end();
+
+	test_begin("message search bloom filter saturated");
+	str_truncate(input, 0);
+	str_append(input, "Subject: random\n\n");
+	for (i = 0; i < 200000; i++)
+		str_append_c(input, 0x21 + i_rand_limit(0x7f - 0x21));
+	is = test_istream_create_data(str_data(input), str_len(input));
+	buffer_set_used_size(filter, 0);
+	test_assert(message_search_bloom_build(is, NULL, filter) == 0);
+	i_stream_unref(&is);
+	/* the filter matches so many n-grams that it's not stored */
+	test_assert(filter->used == 0);
+	test_assert(message_search_bloom_may_contain(filter->data, 0,
+						     "nonexistent"));
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_message_search,
 		test_message_search_more_get_decoded,
+		test_message_search_msg_multi,
+		test_message_search_bloom,
+		test_message_search_bloom_false_positives,
 		NULL
 	};
 	return test_run(test_functions);
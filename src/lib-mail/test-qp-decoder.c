@@ -178,10 +178,68 @@ static void test_qp_decoder(void)
 	test_end();
 }
 
+static void test_qp_decoder_random(void)
+{
+	static const char chars[] = "aZ09. \t=\r\nF";
+	string_t *input, *str1, *str2;
+	unsigned int i, j, len;
+
+	test_begin("qp-decoder random");
+	input = t_str_new(512);
+	str1 = t_str_new(512);
+	str2 = t_str_new(512);
+	for (i = 0; i < 2000; i++) {
+		struct qp_decoder *qp1 = qp_decoder_init(str1);
+		struct qp_decoder *qp2 = qp_decoder_init(str2);
+		size_t error_pos1, error_pos2;
+		const char *error;
+		int ret1, ret2;
+
+		/* mostly text with some whitespace and encoded bytes */
+		len = i_rand_limit(400);
+		str_truncate(input, 0);
+		for (j = 0; j < len; j++) {
+			if (i_rand_limit(3) != 0)
+				str_append_c(input, 'x');
+			else
+				str_append_c(input, chars[i_rand_limit(
+					sizeof(chars) - 1)]);
+		}
+
+		/* all at once must match byte by byte */
+		ret1 = qp_decoder_more(qp1, str_data(input), str_len(input),
+				       &error_pos1, &error);
+		ret2 = 0;
+		error_pos2 = SIZE_MAX;
+		for (j = 0; j < str_len(input); j++) {
+			size_t pos;
+
+			if (qp_decoder_more(qp2, str_data(input) + j, 1,
+					    &pos, &error) < 0) {
+				if (ret2 == 0)
+					error_pos2 = j + pos;
+				ret2 = -1;
+			}
+		}
+		test_assert_idx(ret1 == ret2, i);
+		test_assert_idx(ret1 == 0 || error_pos1 == error_pos2, i);
+		test_assert_idx(qp_decoder_finish(qp1, &error) ==
+				qp_decoder_finish(qp2, &error), i);
+		test_assert_idx(str_equals(str1, str2), i);
+
+		qp_decoder_deinit(&qp1);
+		qp_decoder_deinit(&qp2);
+		str_truncate(str1, 0);
+		str_truncate(str2, 0);
+	}
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_qp_decoder,
+		test_qp_decoder_random,
 		NULL
 	};
 	return test_run(test_functions);
@@ -28,6 +28,10 @@ struct log_service_handshake {
 	/* unsigned char prefix[]; */
 };
 
+/* Subdirectory of state_dir that master creates for the auth process. It's
+   owned by the auth service's user, so it can save its state there. */
+#define MASTER_AUTH_STATE_DIR_NAME "auth"
+
 enum master_login_state {
 	MASTER_LOGIN_STATE_NONFULL = 0,
 	MASTER_LOGIN_STATE_FULL
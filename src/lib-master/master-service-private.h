@@ -57,6 +57,8 @@ struct master_service {
 	unsigned int last_sent_status_avail_count;
 	time_t last_sent_status_time;
 	struct timeout *to_status;
+	struct timeout *to_ioloop_profile;
+	struct timeout *to_alloc_profile;
 
 	bool (*idle_die_callback)(void);
 	void (*die_callback)(void);
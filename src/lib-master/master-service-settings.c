@@ -53,6 +53,8 @@ static const struct setting_define master_service_setting_defines[] = {
 	DEF(BOOL, version_ignore),
 	DEF(BOOL, shutdown_clients),
 	DEF(BOOL, verbose_proctitle),
+	DEF(TIME, ioloop_profile_interval),
+	DEF(TIME, alloc_profile_interval),
 
 	DEF(STR, haproxy_trusted_networks),
 	DEF(TIME, haproxy_timeout),
@@ -91,6 +93,8 @@ static const struct master_service_settings master_service_default_settings = {
 	.version_ignore = FALSE,
 	.shutdown_clients = TRUE,
 	.verbose_proctitle = FALSE,
+	.ioloop_profile_interval = 0,
+	.alloc_profile_interval = 0,
 
 	.haproxy_trusted_networks = "",
 	.haproxy_timeout = 3
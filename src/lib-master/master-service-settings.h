@@ -22,6 +22,8 @@ struct master_service_settings {
 	bool version_ignore;
 	bool shutdown_clients;
 	bool verbose_proctitle;
+	unsigned int ioloop_profile_interval;
+	unsigned int alloc_profile_interval;
 
 	const char *haproxy_trusted_networks;
 	unsigned int haproxy_timeout;
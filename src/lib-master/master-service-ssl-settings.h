@@ -32,6 +32,7 @@ struct master_service_ssl_settings {
 	struct {
 		bool compression;
 		bool tickets;
+		bool ktls;
 	} parsed_opts;
 };
 
@@ -3,6 +3,7 @@
 #include "lib.h"
 #include "lib-signals.h"
 #include "lib-event-private.h"
+#include "alloc-profile.h"
 #include "event-filter.h"
 #include "ioloop.h"
 #include "hostpid.h"
@@ -13,6 +14,7 @@
 #include "strescape.h"
 #include "env-util.h"
 #include "mmap-util.h"
+#include "sort.h"
 #include "home-expand.h"
 #include "process-title.h"
 #include "time-util.h"
@@ -951,6 +953,94 @@ static void master_status_update_wait(struct master_service *service)
 	io_loop_destroy(&ioloop);
 }
 
+static void master_service_ioloop_profile_send(struct master_service *service)
+{
+	const struct io_loop_callback_profile *const *profiles;
+	unsigned int i, count;
+
+	profiles = io_loop_get_callback_profiles(&count);
+	for (i = 0; i < count; i++) {
+		const struct io_loop_callback_profile *profile = profiles[i];
+		const char *source_filename = profile->source_filename;
+
+		if (profile->call_count == 0)
+			continue;
+		/* drop the build directory's relative path prefix */
+		while (str_begins(source_filename, "../", &source_filename))
+			;
+
+		struct event_passthrough *e =
+			event_create_passthrough(service->event)->
+			set_name("ioloop_callback_profile")->
+			add_str("source_filename", source_filename)->
+			add_int("source_linenum", profile->source_linenum)->
+			add_str("callback_type",
+				profile->timeout ? "timeout" : "io")->
+			add_int("calls", profile->call_count)->
+			add_int("usecs", profile->nsecs / 1000);
+		e_debug(e->event(), "ioloop callback %s:%u: "
+			"%"PRIu64" calls took %"PRIu64" usecs",
+			source_filename, profile->source_linenum,
+			profile->call_count, profile->nsecs / 1000);
+	}
+	io_loop_reset_callback_profiles();
+}
+
+static int
+alloc_profile_cmp(const struct alloc_profile *const *p1,
+		  const struct alloc_profile *const *p2)
+{
+	if ((*p1)->bytes > (*p2)->bytes)
+		return -1;
+	if ((*p1)->bytes < (*p2)->bytes)
+		return 1;
+	return 0;
+}
+
+static void master_service_alloc_profile_send(struct master_service *service)
+{
+	const struct alloc_profile *const *all_profiles;
+	const struct alloc_profile **profiles;
+	unsigned int i, count;
+
+	all_profiles = alloc_profile_get_all(&count);
+	/* copy the profiles, since logging may add new ones */
+	profiles = t_new(const struct alloc_profile *, count + 1);
+	if (count > 0)
+		memcpy(profiles, all_profiles, sizeof(*profiles) * count);
+	/* largest users first */
+	i_qsort(profiles, count, sizeof(*profiles), alloc_profile_cmp);
+	for (i = 0; i < count; i++) {
+		const struct alloc_profile *profile = profiles[i];
+		const char *type =
+			profile->type == ALLOC_PROFILE_TYPE_DATA_STACK ?
+			"data_stack" : "pool";
+		const char *name = profile->name;
+
+		if (profile->count == 0)
+			continue;
+		/* drop the build directory's relative path prefix from
+		   T_BEGIN markers */
+		while (str_begins(name, "../", &name))
+			;
+		struct event_passthrough *e =
+			event_create_passthrough(service->event)->
+			set_name("alloc_profile")->
+			add_str("alloc_type", type)->
+			add_str("alloc_name", name)->
+			add_int("count", profile->count)->
+			add_int("bytes", profile->bytes)->
+			add_int("max_bytes", profile->max_bytes)->
+			add_int("grow_count", profile->grow_count);
+		e_debug(e->event(), "Allocation profile: %s '%s': "
+			"count=%"PRIu64", bytes=%"PRIu64", max_bytes=%"PRIu64
+			", grow_count=%"PRIu64, type, name,
+			profile->count, profile->bytes, profile->max_bytes,
+			profile->grow_count);
+	}
+	alloc_profile_reset();
+}
+
 void master_service_init_finish(struct master_service *service)
 {
 	struct stat st;
@@ -995,6 +1085,18 @@ void master_service_init_finish(struct master_service *service)
 		lib_signals_set_handler(SIGQUIT, 0, sig_close_listeners, service);
 	}
 	master_service_io_listeners_add(service);
+	if (service->set != NULL && service->set->ioloop_profile_interval > 0) {
+		io_loop_set_callback_profiling(TRUE);
+		service->to_ioloop_profile =
+			timeout_add(service->set->ioloop_profile_interval * 1000,
+				    master_service_ioloop_profile_send, service);
+	}
+	if (service->set != NULL && service->set->alloc_profile_interval > 0) {
+		alloc_profile_set_enabled(TRUE);
+		service->to_alloc_profile =
+			timeout_add(service->set->alloc_profile_interval * 1000,
+				    master_service_alloc_profile_send, service);
+	}
 	if (service->want_ssl_server &&
 	    (service->flags & MASTER_SERVICE_FLAG_NO_SSL_INIT) == 0)
 		master_service_ssl_ctx_init(service);
@@ -1599,6 +1701,17 @@ static void master_service_deinit_real(struct master_service *service)
 		io_remove(&service->listeners[i].io);
 	master_service_ssl_ctx_deinit(service);
 
+	if (service->to_ioloop_profile != NULL) {
+		master_service_ioloop_profile_send(service);
+		timeout_remove(&service->to_ioloop_profile);
+		io_loop_set_callback_profiling(FALSE);
+	}
+	if (service->to_alloc_profile != NULL) {
+		T_BEGIN {
+			master_service_alloc_profile_send(service);
+		} T_END;
+		timeout_remove(&service->to_alloc_profile);
+	}
 	if (service->stats_client != NULL)
 		stats_client_deinit(&service->stats_client);
 	timeout_remove(&service->to_overflow_call);
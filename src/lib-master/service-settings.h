@@ -72,6 +72,7 @@ struct service_settings {
 	unsigned int service_count;
 	unsigned int idle_kill;
 	uoff_t vsz_limit;
+	bool process_cpu_affinity;
 
 	ARRAY_TYPE(const_string) unix_listeners;
 	ARRAY_TYPE(const_string) fifo_listeners;
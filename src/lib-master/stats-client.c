@@ -13,6 +13,10 @@
 #define STATS_CLIENT_HANDSHAKE_TIMEOUT_MSECS (5*1000)
 #define STATS_CLIENT_DEINIT_TIMEOUT_MSECS (60*1000)
 #define STATS_CLIENT_RECONNECT_INTERVAL_MSECS (10*1000)
+/* Events are written to the stats process in batches. The output is flushed
+   when this much is buffered, or after the flush interval. */
+#define STATS_CLIENT_FLUSH_SIZE IO_BLOCK_SIZE
+#define STATS_CLIENT_FLUSH_INTERVAL_MSECS 50
 
 enum stats_timeout_type {
 	STATS_CLIENT_HANDSHAKE_WAIT,
@@ -24,6 +28,7 @@ struct stats_client {
 	struct event_filter *filter;
 	struct ioloop *ioloop;
 	struct timeout *to_reconnect;
+	struct timeout *to_flush;
 	struct timeval wait_started;
 	bool handshaked;
 	bool handshake_received_at_least_once;
@@ -107,6 +112,7 @@ static void stats_client_destroy(struct connection *conn)
 		event->sent_to_stats_id = 0;
 
 	client->handshaked = FALSE;
+	timeout_remove(&client->to_flush);
 	connection_disconnect(conn);
 	if (client->ioloop != NULL) {
 		/* waiting for stats handshake to finish */
@@ -148,6 +154,51 @@ static const struct connection_vfuncs stats_client_vfuncs = {
 	.input_args = stats_client_input_args,
 };
 
+static void stats_client_flush(struct stats_client *client)
+{
+	timeout_remove(&client->to_flush);
+	if (o_stream_uncork_flush(client->conn.output) < 0) {
+		e_error(client->conn.event, "write() failed: %s",
+			o_stream_get_error(client->conn.output));
+	}
+}
+
+static void
+stats_client_output_added(struct stats_client *client, bool flush_now)
+{
+	if (flush_now || current_ioloop == NULL ||
+	    o_stream_get_buffer_used_size(client->conn.output) >=
+	    STATS_CLIENT_FLUSH_SIZE) {
+		stats_client_flush(client);
+		return;
+	}
+	if (client->to_flush == NULL) {
+		client->to_flush =
+			timeout_add_short(STATS_CLIENT_FLUSH_INTERVAL_MSECS,
+					  stats_client_flush, client);
+	}
+}
+
+static void
+stats_clients_ioloop_switched(struct ioloop *prev_ioloop ATTR_UNUSED)
+{
+	struct connection *conn;
+
+	/* Follow the current ioloop, so the flush timeout isn't left behind
+	   in a nested ioloop that gets destroyed. */
+	for (conn = stats_clients->connections; conn != NULL; conn = conn->next) {
+		struct stats_client *client =
+			container_of(conn, struct stats_client, conn);
+
+		if (client->to_flush == NULL)
+			continue;
+		if (current_ioloop == NULL)
+			stats_client_flush(client);
+		else
+			client->to_flush = io_loop_move_timeout(&client->to_flush);
+	}
+}
+
 static void
 stats_event_write(struct stats_client *client,
 		  struct event *event, struct event *global_event,
@@ -218,7 +269,7 @@ stats_client_send_event(struct stats_client *client, struct event *event,
 	/* Need to send the event for stats and/or export */
 	string_t *str = t_str_new(256);
 
-	if (++recursion == 0)
+	if (++recursion == 1)
 		o_stream_cork(client->conn.output);
 	struct event *global_event = event_get_global();
 	if (global_event != NULL) {
@@ -233,10 +284,9 @@ stats_client_send_event(struct stats_client *client, struct event *event,
 
 	i_assert(recursion > 0);
 	if (--recursion == 0) {
-		if (o_stream_uncork_flush(client->conn.output) < 0) {
-			e_error(client->conn.event, "write() failed: %s",
-				o_stream_get_error(client->conn.output));
-		}
+		/* Send errors immediately, since the process may be about
+		   to die. */
+		stats_client_output_added(client, ctx->type >= LOG_TYPE_ERROR);
 	}
 }
 
@@ -245,8 +295,10 @@ stats_client_free_event(struct stats_client *client, struct event *event)
 {
 	if (event->sent_to_stats_id == 0)
 		return;
+	o_stream_cork(client->conn.output);
 	o_stream_nsend_str(client->conn.output,
 			   t_strdup_printf("END\t%"PRIu64"\n", event->id));
+	stats_client_output_added(client, FALSE);
 }
 
 static bool
@@ -306,12 +358,14 @@ static void stats_global_init(void)
 					     &stats_client_vfuncs);
 	event_register_callback(stats_event_callback);
 	event_category_register_callback(stats_category_registered);
+	io_loop_add_switch_callback(stats_clients_ioloop_switched);
 }
 
 static void stats_global_deinit(void)
 {
 	event_unregister_callback(stats_event_callback);
 	event_category_unregister_callback(stats_category_registered);
+	io_loop_remove_switch_callback(stats_clients_ioloop_switched);
 	connection_list_deinit(&stats_clients);
 }
 
@@ -446,12 +500,13 @@ void stats_client_deinit(struct stats_client **_client)
 
 	*_client = NULL;
 
+	if (client->conn.output != NULL && !client->conn.output->closed)
+		stats_client_flush(client);
 	if (client->conn.output != NULL && !client->conn.output->closed &&
 	    o_stream_get_buffer_used_size(client->conn.output) > 0) {
 		o_stream_set_flush_callback(client->conn.output,
 					    stats_client_deinit_callback,
 					    &client->conn);
-		o_stream_uncork(client->conn.output);
 		stats_client_wait(client, STATS_CLIENT_DEINIT_WAIT);
 	}
 
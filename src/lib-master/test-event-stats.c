@@ -529,6 +529,34 @@ static void test_global_event(void)
 	test_end();
 }
 
+static void test_flush_timeout_ioloop_switch(void)
+{
+	int l;
+	TST_BEGIN("flush timeout follows ioloop switches");
+	struct ioloop *ioloop = io_loop_create();
+	struct ioloop *nested_ioloop = io_loop_create();
+
+	struct event *single_ev = event_create(NULL);
+	event_add_category(single_ev, &test_cats[0]);
+	event_set_name(single_ev, "evname");
+	e_info(single_ev, "info message");
+	l = __LINE__ - 1;
+	event_unref(&single_ev);
+	test_assert(!io_loop_is_empty(nested_ioloop));
+
+	/* the flush timeout is moved to the parent ioloop */
+	io_loop_destroy(&nested_ioloop);
+	test_assert(!io_loop_is_empty(ioloop));
+	/* and flushed when there's no ioloop left */
+	io_loop_destroy(&ioloop);
+	test_assert(
+		compare_test_stats_to(
+			"EVENT	0	0	1	0	0"
+			"	s"__FILE__"	%d"
+			"	l0	0	nevname	ctest1\n", l));
+	test_end();
+}
+
 static int run_tests(void)
 {
 	int ret;
@@ -543,6 +571,7 @@ static int run_tests(void)
 		test_parent_update_post_send,
 		test_large_event_id,
 		test_global_event,
+		test_flush_timeout_ioloop_switch,
 		NULL
 	};
 	stats_buf = str_new(default_pool, 512);
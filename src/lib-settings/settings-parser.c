@@ -597,6 +597,10 @@ settings_var_expand_info(const struct setting_parser_info *info, void *set,
 				i_assert(**val == SETTING_STRVAR_EXPANDED[0] ||
 					 **val == SETTING_STRVAR_UNEXPANDED[0]);
 				*val += 1;
+			} else if (**val == SETTING_STRVAR_UNEXPANDED[0] &&
+				   strchr(*val + 1, '%') == NULL) {
+				/* nothing to expand */
+				*val += 1;
 			} else if (**val == SETTING_STRVAR_UNEXPANDED[0]) {
 				str_truncate(str, 0);
 				ret = var_expand_with_funcs(str, *val + 1, table,
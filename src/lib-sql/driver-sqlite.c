@@ -6,6 +6,7 @@
 #include "ioloop.h"
 #include "str.h"
 #include "hex-binary.h"
+#include "hash.h"
 #include "sql-api-private.h"
 #include "strfuncs.h"
 #include "str-parse.h"
@@ -29,9 +30,45 @@ struct sqlite_db {
 	int rc;
 };
 
+struct sqlite_prepared_statement {
+	struct sql_prepared_statement api;
+
+	/* Prepared on first use. Reused by all the statements created from
+	   this prepared statement, unless it's already in use by a result. */
+	sqlite3_stmt *handle;
+	bool handle_in_use;
+};
+
+enum sqlite_arg_type {
+	SQLITE_ARG_TYPE_STR,
+	SQLITE_ARG_TYPE_BINARY,
+	SQLITE_ARG_TYPE_INT64,
+	SQLITE_ARG_TYPE_DOUBLE,
+};
+
+struct sqlite_arg {
+	unsigned int column_idx;
+	enum sqlite_arg_type type;
+
+	const void *value;
+	size_t value_size;
+	int64_t value_int64;
+	double value_double;
+};
+
+struct sqlite_statement {
+	struct sql_statement api;
+
+	/* NULL if the statement isn't prepared */
+	struct sqlite_prepared_statement *prep;
+	ARRAY(struct sqlite_arg) args;
+};
+
 struct sqlite_result {
 	struct sql_result api;
 	sqlite3_stmt *stmt;
+	/* non-NULL if stmt is the prepared statement's cached handle */
+	struct sqlite_prepared_statement *prep;
 	unsigned int cols;
 	const char **row;
 };
@@ -51,13 +88,62 @@ static struct event_category event_category_sqlite = {
 	.name = "sqlite"
 };
 
+static void
+driver_sqlite_statement_handle_release(struct sqlite_db *db,
+				       sqlite3_stmt *handle,
+				       struct sqlite_prepared_statement *prep)
+{
+	if (prep == NULL)
+		(void)sqlite3_finalize(handle);
+	else if (sqlite3_db_handle(handle) != db->sqlite) {
+		/* The database was disconnected while the handle was in
+		   use. Finalizing it lets sqlite3_close_v2() finish. */
+		i_assert(prep->handle == handle);
+		(void)sqlite3_finalize(handle);
+		prep->handle = NULL;
+		prep->handle_in_use = FALSE;
+	} else {
+		i_assert(prep->handle == handle);
+		(void)sqlite3_reset(handle);
+		(void)sqlite3_clear_bindings(handle);
+		prep->handle_in_use = FALSE;
+	}
+}
+
+static void driver_sqlite_prepared_statements_finalize(struct sqlite_db *db)
+{
+	struct hash_iterate_context *iter;
+	struct sql_prepared_statement *_prep_stmt;
+	struct sqlite_prepared_statement *prep_stmt;
+	char *query;
+
+	/* The handles can't be used with a new connection. The ones that are
+	   still in use by results are finalized when the results are freed. */
+	iter = hash_table_iterate_init(db->api.prepared_stmt_hash);
+	while (hash_table_iterate(iter, db->api.prepared_stmt_hash,
+				  &query, &_prep_stmt)) {
+		prep_stmt = container_of(_prep_stmt,
+					 struct sqlite_prepared_statement, api);
+		if (prep_stmt->handle != NULL && !prep_stmt->handle_in_use) {
+			(void)sqlite3_finalize(prep_stmt->handle);
+			prep_stmt->handle = NULL;
+		}
+	}
+	hash_table_iterate_deinit(&iter);
+}
+
 static void driver_sqlite_disconnect(struct sql_db *_db)
 {
 	struct sqlite_db *db = container_of(_db, struct sqlite_db, api);
 
 	sql_connection_log_finished(_db);
-	sqlite3_close(db->sqlite);
+	if (hash_table_is_created(_db->prepared_stmt_hash))
+		driver_sqlite_prepared_statements_finalize(db);
+	/* The connection is closed only after all its statements are
+	   finalized. */
+	(void)sqlite3_close_v2(db->sqlite);
 	db->sqlite = NULL;
+	db->connected = FALSE;
 }
 
 static int driver_sqlite_connect(struct sql_db *_db)
@@ -352,7 +438,11 @@ static void driver_sqlite_result_free(struct sql_result *_result)
 	if (_result->callback)
 		return;
 
-	if (result->stmt != NULL) {
+	if (result->prep != NULL) {
+		driver_sqlite_statement_handle_release(db, result->stmt,
+						       result->prep);
+		i_free(result->row);
+	} else if (result->stmt != NULL) {
 		rc = sqlite3_finalize(result->stmt);
 		if (rc == SQLITE_NOMEM) {
 			i_fatal_status(FATAL_OUTOFMEM, "finalize failed: %s (%d)",
@@ -626,6 +716,294 @@ driver_sqlite_update(struct sql_transaction_context *_ctx, const char *query,
 		*affected_rows = sqlite3_changes(db->sqlite);
 }
 
+static struct sql_prepared_statement *
+driver_sqlite_prepared_statement_init(struct sql_db *db,
+				      const char *query_template)
+{
+	struct sqlite_prepared_statement *prep_stmt;
+
+	prep_stmt = i_new(struct sqlite_prepared_statement, 1);
+	prep_stmt->api.db = db;
+	prep_stmt->api.refcount = 1;
+	prep_stmt->api.query_template = i_strdup(query_template);
+	return &prep_stmt->api;
+}
+
+static void
+driver_sqlite_prepared_statement_deinit(struct sql_prepared_statement *_prep_stmt)
+{
+	struct sqlite_prepared_statement *prep_stmt =
+		container_of(_prep_stmt, struct sqlite_prepared_statement, api);
+
+	i_assert(!prep_stmt->handle_in_use);
+	if (prep_stmt->handle != NULL)
+		(void)sqlite3_finalize(prep_stmt->handle);
+	i_free(prep_stmt->api.query_template);
+	i_free(prep_stmt);
+}
+
+static struct sqlite_statement *driver_sqlite_statement_alloc(void)
+{
+	struct sqlite_statement *stmt;
+	pool_t pool;
+
+	pool = pool_alloconly_create("sqlite statement", 1024);
+	stmt = p_new(pool, struct sqlite_statement, 1);
+	stmt->api.pool = pool;
+	p_array_init(&stmt->args, pool, 8);
+	return stmt;
+}
+
+static struct sql_statement *
+driver_sqlite_statement_init(struct sql_db *db ATTR_UNUSED,
+			     const char *query_template ATTR_UNUSED)
+{
+	return &driver_sqlite_statement_alloc()->api;
+}
+
+static struct sql_statement *
+driver_sqlite_statement_init_prepared(struct sql_prepared_statement *_prep_stmt)
+{
+	struct sqlite_prepared_statement *prep_stmt =
+		container_of(_prep_stmt, struct sqlite_prepared_statement, api);
+	struct sqlite_statement *stmt = driver_sqlite_statement_alloc();
+
+	stmt->prep = prep_stmt;
+	stmt->api.query_template =
+		p_strdup(stmt->api.pool, _prep_stmt->query_template);
+	return &stmt->api;
+}
+
+static struct sqlite_arg *
+driver_sqlite_statement_add_arg(struct sql_statement *_stmt,
+				unsigned int column_idx,
+				enum sqlite_arg_type type)
+{
+	struct sqlite_statement *stmt =
+		container_of(_stmt, struct sqlite_statement, api);
+	struct sqlite_arg *arg;
+
+	arg = array_append_space(&stmt->args);
+	arg->column_idx = column_idx;
+	arg->type = type;
+	return arg;
+}
+
+static void
+driver_sqlite_statement_bind_str(struct sql_statement *stmt,
+				 unsigned int column_idx, const char *value)
+{
+	struct sqlite_arg *arg = driver_sqlite_statement_add_arg(
+		stmt, column_idx, SQLITE_ARG_TYPE_STR);
+
+	arg->value = p_strdup(stmt->pool, value);
+}
+
+static void
+driver_sqlite_statement_bind_binary(struct sql_statement *stmt,
+				    unsigned int column_idx, const void *value,
+				    size_t value_size)
+{
+	struct sqlite_arg *arg = driver_sqlite_statement_add_arg(
+		stmt, column_idx, SQLITE_ARG_TYPE_BINARY);
+
+	arg->value = p_memdup(stmt->pool, value, value_size);
+	arg->value_size = value_size;
+}
+
+static void
+driver_sqlite_statement_bind_int64(struct sql_statement *stmt,
+				   unsigned int column_idx, int64_t value)
+{
+	struct sqlite_arg *arg = driver_sqlite_statement_add_arg(
+		stmt, column_idx, SQLITE_ARG_TYPE_INT64);
+
+	arg->value_int64 = value;
+}
+
+static void
+driver_sqlite_statement_bind_double(struct sql_statement *stmt,
+				    unsigned int column_idx, double value)
+{
+	struct sqlite_arg *arg = driver_sqlite_statement_add_arg(
+		stmt, column_idx, SQLITE_ARG_TYPE_DOUBLE);
+
+	arg->value_double = value;
+}
+
+static void
+driver_sqlite_statement_bind_uuid(struct sql_statement *stmt,
+				  unsigned int column_idx,
+				  const guid_128_t uuid)
+{
+	driver_sqlite_statement_bind_str(stmt, column_idx,
+		guid_128_to_uuid_string(uuid, FORMAT_RECORD));
+}
+
+static int
+driver_sqlite_statement_bind_arg(sqlite3_stmt *handle,
+				 const struct sqlite_arg *arg)
+{
+	/* sqlite's parameter indexes begin from 1 */
+	int idx = arg->column_idx + 1;
+
+	switch (arg->type) {
+	case SQLITE_ARG_TYPE_STR:
+		return sqlite3_bind_text(handle, idx, arg->value, -1,
+					 SQLITE_TRANSIENT);
+	case SQLITE_ARG_TYPE_BINARY:
+		return sqlite3_bind_blob(handle, idx, arg->value,
+					 arg->value_size, SQLITE_TRANSIENT);
+	case SQLITE_ARG_TYPE_INT64:
+		return sqlite3_bind_int64(handle, idx, arg->value_int64);
+	case SQLITE_ARG_TYPE_DOUBLE:
+		return sqlite3_bind_double(handle, idx, arg->value_double);
+	}
+	i_unreached();
+}
+
+/* Get a sqlite3_stmt with all the arguments bound. Prepared statements use
+   their cached handle, unless it's already in use. Otherwise the query is
+   compiled only for this one use. */
+static int
+driver_sqlite_statement_handle_get(struct sqlite_statement *stmt,
+				   sqlite3_stmt **handle_r,
+				   struct sqlite_prepared_statement **prep_r)
+{
+	struct sqlite_db *db = container_of(stmt->api.db, struct sqlite_db, api);
+	struct sqlite_prepared_statement *prep = stmt->prep;
+	const struct sqlite_arg *arg;
+	sqlite3_stmt *handle;
+
+	if (prep != NULL && !prep->handle_in_use) {
+		if (prep->handle == NULL) {
+			db->rc = sqlite3_prepare_v2(db->sqlite,
+				prep->api.query_template, -1,
+				&prep->handle, NULL);
+			if (db->rc != SQLITE_OK)
+				return -1;
+		}
+		prep->handle_in_use = TRUE;
+		handle = prep->handle;
+	} else {
+		prep = NULL;
+		db->rc = sqlite3_prepare_v2(db->sqlite,
+					    stmt->api.query_template, -1,
+					    &handle, NULL);
+		if (db->rc != SQLITE_OK)
+			return -1;
+	}
+
+	array_foreach(&stmt->args, arg) {
+		db->rc = driver_sqlite_statement_bind_arg(handle, arg);
+		if (db->rc != SQLITE_OK) {
+			driver_sqlite_statement_handle_release(db, handle, prep);
+			return -1;
+		}
+	}
+	*handle_r = handle;
+	*prep_r = prep;
+	return 0;
+}
+
+static struct sql_result *
+driver_sqlite_statement_query_s(struct sql_statement *_stmt)
+{
+	struct sqlite_statement *stmt =
+		container_of(_stmt, struct sqlite_statement, api);
+	struct sql_db *_db = _stmt->db;
+	const char *query = sql_statement_get_log_query(_stmt);
+	struct sqlite_result *result;
+	struct event *event;
+
+	result = i_new(struct sqlite_result, 1);
+	result->api.db = _db;
+	/* Temporarily store the event since result->api gets
+	 * overwritten later here and we need to reset it. */
+	event = event_create(_db->event);
+	result->api.event = event;
+
+	if (driver_sqlite_connect(_db) < 0 ||
+	    driver_sqlite_statement_handle_get(stmt, &result->stmt,
+					       &result->prep) < 0) {
+		driver_sqlite_result_log(&result->api, query);
+		result->api = driver_sqlite_error_result;
+		result->stmt = NULL;
+		result->prep = NULL;
+		result->cols = 0;
+	} else {
+		driver_sqlite_result_log(&result->api, query);
+		result->api = driver_sqlite_result;
+		result->cols = sqlite3_column_count(result->stmt);
+		result->row = i_new(const char *, result->cols);
+	}
+
+	result->api.db = _db;
+	result->api.refcount = 1;
+	result->api.event = event;
+	pool_unref(&_stmt->pool);
+	return &result->api;
+}
+
+static void
+driver_sqlite_statement_query(struct sql_statement *stmt,
+			      sql_query_callback_t *callback, void *context)
+{
+	struct sql_result *result;
+
+	result = driver_sqlite_statement_query_s(stmt);
+	result->callback = TRUE;
+	callback(result, context);
+	result->callback = FALSE;
+	sql_result_unref(result);
+}
+
+static void
+driver_sqlite_update_stmt(struct sql_transaction_context *_ctx,
+			  struct sql_statement *_stmt,
+			  unsigned int *affected_rows)
+{
+	struct sqlite_transaction_context *ctx =
+		container_of(_ctx, struct sqlite_transaction_context, ctx);
+	struct sqlite_statement *stmt =
+		container_of(_stmt, struct sqlite_statement, api);
+	struct sqlite_db *db = container_of(_ctx->db, struct sqlite_db, api);
+	struct sqlite_prepared_statement *prep;
+	struct sql_result result;
+	sqlite3_stmt *handle;
+	const char *query, *error;
+
+	if (ctx->rc != SQLITE_OK) {
+		pool_unref(&_stmt->pool);
+		return;
+	}
+
+	query = sql_statement_get_log_query(_stmt);
+	i_zero(&result);
+	result.db = &db->api;
+	result.event = event_create(db->api.event);
+	if (driver_sqlite_connect(&db->api) < 0 ||
+	    driver_sqlite_statement_handle_get(stmt, &handle, &prep) < 0)
+		error = driver_sqlite_result_log(&result, query);
+	else {
+		db->rc = sqlite3_step(handle);
+		if (db->rc == SQLITE_DONE || db->rc == SQLITE_ROW)
+			db->rc = SQLITE_OK;
+		if (db->rc == SQLITE_OK && affected_rows != NULL)
+			*affected_rows = sqlite3_changes(db->sqlite);
+		/* log before sqlite3_reset() clears the error */
+		error = driver_sqlite_result_log(&result, query);
+		driver_sqlite_statement_handle_release(db, handle, prep);
+	}
+	if (db->rc != SQLITE_OK) {
+		/* first error in the transaction */
+		ctx->rc = db->rc;
+		ctx->error = i_strdup(error);
+	}
+	event_unref(&result.event);
+	pool_unref(&_stmt->pool);
+}
+
 static const char *
 driver_sqlite_escape_blob(struct sql_db *_db ATTR_UNUSED,
 			  const unsigned char *data, size_t size)
@@ -644,7 +1022,7 @@ const struct sql_db driver_sqlite_db = {
 #if SQLITE_VERSION_NUMBER >= 3024000
 		SQL_DB_FLAG_ON_CONFLICT_DO |
 #endif
-		SQL_DB_FLAG_BLOCKING,
+		SQL_DB_FLAG_BLOCKING | SQL_DB_FLAG_PREP_STATEMENTS,
 
 	.v = {
 		.init_full = driver_sqlite_init_full_v,
@@ -664,6 +1042,19 @@ const struct sql_db driver_sqlite_db = {
 		.update = driver_sqlite_update,
 
 		.escape_blob = driver_sqlite_escape_blob,
+
+		.prepared_statement_init = driver_sqlite_prepared_statement_init,
+		.prepared_statement_deinit = driver_sqlite_prepared_statement_deinit,
+		.statement_init = driver_sqlite_statement_init,
+		.statement_init_prepared = driver_sqlite_statement_init_prepared,
+		.statement_bind_str = driver_sqlite_statement_bind_str,
+		.statement_bind_binary = driver_sqlite_statement_bind_binary,
+		.statement_bind_int64 = driver_sqlite_statement_bind_int64,
+		.statement_bind_double = driver_sqlite_statement_bind_double,
+		.statement_bind_uuid = driver_sqlite_statement_bind_uuid,
+		.statement_query = driver_sqlite_statement_query,
+		.statement_query_s = driver_sqlite_statement_query_s,
+		.update_stmt = driver_sqlite_update_stmt,
 	}
 };
 
@@ -4,6 +4,7 @@
 #include "array.h"
 #include "llist.h"
 #include "ioloop.h"
+#include "time-util.h"
 #include "sql-api-private.h"
 
 #include <time.h>
@@ -16,10 +17,20 @@ static struct event_category event_category_sqlpool = {
 	.name = "sqlpool",
 };
 
+/* Every Nth query is sent using plain round-robin, so the latencies of the
+   slower hosts keep getting updated. */
+#define SQLPOOL_LATENCY_PROBE_INTERVAL 16
+#define SQLPOOL_LATENCY_AVG_WEIGHT 8
+/* Failed queries are counted as taking at least this long. Otherwise a host
+   that fails quickly would look like the fastest one. */
+#define SQLPOOL_LATENCY_FAILURE_USECS (1000*1000)
+
 struct sqlpool_host {
 	char *connect_string;
 
 	unsigned int connection_count;
+	/* moving average of the query latencies, 0 if not known yet */
+	unsigned int avg_query_usecs;
 };
 
 struct sqlpool_connection {
@@ -40,6 +51,7 @@ struct sqlpool_db {
 	/* index of last connection in all_connections that was used to
 	   send a query. */
 	unsigned int last_query_conn_idx;
+	unsigned int query_counter;
 
 	/* queued requests */
 	struct sqlpool_request *requests_head, *requests_tail;
@@ -54,6 +66,7 @@ struct sqlpool_request {
 
 	unsigned int host_idx;
 	unsigned int retry_count;
+	struct timeval send_time;
 
 	struct event *event;
 
@@ -161,6 +174,50 @@ sqlpool_request_handle_transaction(struct sql_db *conndb,
 			       driver_sqlpool_commit_callback, trans);
 }
 
+static void
+sqlpool_request_set_sent(struct sqlpool_request *request,
+			 struct sql_db *conndb)
+{
+	const struct sqlpool_connection *conn;
+
+	array_foreach(&request->db->all_connections, conn) {
+		if (conn->db == conndb) {
+			request->host_idx = conn->host_idx;
+			break;
+		}
+	}
+	i_gettimeofday(&request->send_time);
+}
+
+static void
+sqlpool_host_update_latency(struct sqlpool_db *db,
+			    const struct sqlpool_request *request,
+			    const struct sql_result *result)
+{
+	struct sqlpool_host *host;
+	struct timeval now;
+	long long diff;
+
+	i_gettimeofday(&now);
+	diff = timeval_diff_usecs(&now, &request->send_time);
+	if (diff < 0)
+		diff = 0;
+	if ((result->failed || result->failed_try_retry) &&
+	    diff < SQLPOOL_LATENCY_FAILURE_USECS)
+		diff = SQLPOOL_LATENCY_FAILURE_USECS;
+	else if (diff > UINT_MAX)
+		diff = UINT_MAX;
+
+	host = array_idx_modifiable(&db->hosts, request->host_idx);
+	if (host->avg_query_usecs == 0)
+		host->avg_query_usecs = diff;
+	else {
+		host->avg_query_usecs = (host->avg_query_usecs *
+			(uint64_t)(SQLPOOL_LATENCY_AVG_WEIGHT - 1) + diff) /
+			SQLPOOL_LATENCY_AVG_WEIGHT;
+	}
+}
+
 static void
 sqlpool_request_send_next(struct sqlpool_db *db, struct sql_db *conndb)
 {
@@ -174,6 +231,7 @@ sqlpool_request_send_next(struct sqlpool_db *db, struct sql_db *conndb)
 	timeout_reset(db->request_to);
 
 	if (request->query != NULL) {
+		sqlpool_request_set_sent(request, conndb);
 		sql_query(conndb, request->query,
 			  driver_sqlpool_query_callback, request);
 	} else if (request->trans != NULL) {
@@ -325,10 +383,18 @@ sqlpool_find_available_connection(struct sqlpool_db *db,
 				  bool *all_disconnected_r)
 {
 	const struct sqlpool_connection *conns;
-	unsigned int i, count;
+	const struct sqlpool_host *hosts;
+	unsigned int i, count, hosts_count, best_idx = UINT_MAX;
+	unsigned int best_usecs = 0;
+	bool round_robin;
 
 	*all_disconnected_r = TRUE;
 
+	/* Use the first available connection in round-robin order from the
+	   host with the lowest average query latency. */
+	hosts = array_get(&db->hosts, &hosts_count);
+	round_robin = hosts_count == 1 ||
+		db->query_counter++ % SQLPOOL_LATENCY_PROBE_INTERVAL == 0;
 	conns = array_get(&db->all_connections, &count);
 	for (i = 0; i < count; i++) {
 		unsigned int idx = (i + db->last_query_conn_idx + 1) % count;
@@ -337,19 +403,28 @@ sqlpool_find_available_connection(struct sqlpool_db *db,
 		if (conns[idx].host_idx == unwanted_host_idx)
 			continue;
 
-		if (!SQL_DB_IS_READY(conndb) && conndb->to_reconnect == NULL) {
+		if (!SQL_DB_IS_READY(conndb) && conndb->to_reconnect == NULL &&
+		    best_idx == UINT_MAX) {
 			/* see if we could reconnect to it immediately */
 			(void)sql_connect(conndb);
 		}
 		if (SQL_DB_IS_READY(conndb)) {
-			db->last_query_conn_idx = idx;
 			*all_disconnected_r = FALSE;
-			return &conns[idx];
-		}
-		if (conndb->state != SQL_DB_STATE_DISCONNECTED)
+			unsigned int usecs =
+				hosts[conns[idx].host_idx].avg_query_usecs;
+			if (best_idx == UINT_MAX || usecs < best_usecs) {
+				best_idx = idx;
+				best_usecs = usecs;
+			}
+			if (round_robin || best_usecs == 0)
+				break;
+		} else if (conndb->state != SQL_DB_STATE_DISCONNECTED)
 			*all_disconnected_r = FALSE;
 	}
-	return NULL;
+	if (best_idx == UINT_MAX)
+		return NULL;
+	db->last_query_conn_idx = best_idx;
+	return &conns[best_idx];
 }
 
 static bool
@@ -702,6 +777,10 @@ driver_sqlpool_query_callback(struct sql_result *result,
 	const struct sqlpool_connection *conn = NULL;
 	struct sql_db *conndb;
 
+	/* failures and timeouts count too, with a penalty, so a badly
+	   behaving host gets fewer queries */
+	sqlpool_host_update_latency(db, request, result);
+
 	if (result->failed_try_retry &&
 	    request->retry_count < array_count(&db->hosts)) {
 		e_warning(db->api.event, "Query failed, retrying: %s",
@@ -744,7 +823,7 @@ driver_sqlpool_query(struct sql_db *_db, const char *query,
 	if (!driver_sqlpool_get_connection(db, UINT_MAX, &conn))
 		driver_sqlpool_append_request(db, request);
 	else {
-		request->host_idx = conn->host_idx;
+		sqlpool_request_set_sent(request, conn->db);
 		sql_query(conn->db, query, driver_sqlpool_query_callback,
 			  request);
 	}
@@ -66,9 +66,139 @@ static void test_sql_sqlite(void)
 	test_end();
 }
 
+static void test_sql_sqlite_prepared(void)
+{
+	test_begin("test sql api prepared statements");
+
+	const struct sql_settings set = {
+		.driver = "sqlite",
+		.connect_string = "test-database.db",
+	};
+	struct sql_db *sql = NULL;
+	struct sql_prepared_statement *prep;
+	struct sql_statement *stmt;
+	struct sql_result *result, *result2;
+	const unsigned char *data;
+	const char *error = NULL;
+	unsigned int i, affected_rows = 0;
+	size_t size;
+
+	sql_drivers_init();
+	driver_sqlite_init();
+
+	test_assert(sql_init_full(&set, &sql, &error) == 0);
+	test_assert((sql_get_flags(sql) & SQL_DB_FLAG_PREP_STATEMENTS) != 0);
+	sql_disconnect(sql);
+	i_unlink_if_exists("test-database.db");
+	sql_exec(sql, "CREATE TABLE baz(name VARCHAR(255), num INTEGER, data BLOB)");
+
+	/* insert using the same prepared statement multiple times */
+	struct sql_transaction_context *t = sql_transaction_begin(sql);
+	prep = sql_prepared_statement_init(sql, "INSERT INTO baz VALUES(?, ?, ?)");
+	for (i = 1; i <= 3; i++) {
+		stmt = sql_statement_init_prepared(prep);
+		sql_statement_bind_str(stmt, 0, t_strdup_printf("it's %u", i));
+		sql_statement_bind_int64(stmt, 1, i * 10);
+		sql_statement_bind_binary(stmt, 2, "\0\1", i);
+		sql_update_stmt(t, &stmt);
+	}
+	sql_prepared_statement_unref(&prep);
+	prep = sql_prepared_statement_init(sql,
+		"UPDATE baz SET num = num + ? WHERE num >= ?");
+	stmt = sql_statement_init_prepared(prep);
+	sql_statement_bind_int64(stmt, 0, 1);
+	sql_statement_bind_int64(stmt, 1, 20);
+	sql_update_stmt_get_rows(t, &stmt, &affected_rows);
+	sql_prepared_statement_unref(&prep);
+	test_assert(sql_transaction_commit_s(&t, &error) == 0);
+	test_assert_ucmp(affected_rows, ==, 2);
+
+	/* the second result can't use the cached handle while the first one
+	   is still using it */
+	prep = sql_prepared_statement_init(sql,
+		"SELECT name, data FROM baz WHERE num = ?");
+	stmt = sql_statement_init_prepared(prep);
+	sql_statement_bind_int64(stmt, 0, 10);
+	result = sql_statement_query_s(&stmt);
+	stmt = sql_statement_init_prepared(prep);
+	sql_statement_bind_int64(stmt, 0, 31);
+	result2 = sql_statement_query_s(&stmt);
+
+	test_assert(sql_result_next_row(result) == SQL_RESULT_NEXT_OK);
+	test_assert_strcmp(sql_result_get_field_value(result, 0), "it's 1");
+	data = sql_result_get_field_value_binary(result, 1, &size);
+	test_assert(size == 1 && data[0] == '\0');
+	test_assert(sql_result_next_row(result) == SQL_RESULT_NEXT_LAST);
+	test_assert(sql_result_next_row(result2) == SQL_RESULT_NEXT_OK);
+	test_assert_strcmp(sql_result_get_field_value(result2, 0), "it's 3");
+	data = sql_result_get_field_value_binary(result2, 1, &size);
+	test_assert(size == 3 && data[0] == '\0' && data[1] == '\1' &&
+		    data[2] == '\0');
+	test_assert(sql_result_next_row(result2) == SQL_RESULT_NEXT_LAST);
+	sql_result_unref(result);
+	sql_result_unref(result2);
+
+	/* reuse the cached handle after the results are freed */
+	for (i = 0; i < 2; i++) {
+		stmt = sql_statement_init_prepared(prep);
+		sql_statement_bind_int64(stmt, 0, 21);
+		result = sql_statement_query_s(&stmt);
+		test_assert_idx(sql_result_next_row(result) == SQL_RESULT_NEXT_OK, i);
+		test_assert_strcmp_idx(sql_result_get_field_value(result, 0),
+				       "it's 2", i);
+		sql_result_unref(result);
+	}
+
+	/* disconnect while a result is still using the cached handle */
+	stmt = sql_statement_init_prepared(prep);
+	sql_statement_bind_int64(stmt, 0, 21);
+	result = sql_statement_query_s(&stmt);
+	sql_disconnect(sql);
+	sql_result_unref(result);
+	/* the handle is prepared again for the new connection */
+	stmt = sql_statement_init_prepared(prep);
+	sql_statement_bind_int64(stmt, 0, 21);
+	result = sql_statement_query_s(&stmt);
+	test_assert(sql_result_next_row(result) == SQL_RESULT_NEXT_OK);
+	test_assert_strcmp(sql_result_get_field_value(result, 0), "it's 2");
+	sql_result_unref(result);
+	sql_prepared_statement_unref(&prep);
+
+	/* non-prepared statements bind the values too */
+	stmt = sql_statement_init(sql, "SELECT num FROM baz WHERE name = ?");
+	sql_statement_bind_str(stmt, 0, "it's 3");
+	result = sql_statement_query_s(&stmt);
+	test_assert(sql_result_next_row(result) == SQL_RESULT_NEXT_OK);
+	test_assert_strcmp(sql_result_get_field_value(result, 0), "31");
+	sql_result_unref(result);
+
+	/* errors */
+	prep = sql_prepared_statement_init(sql, "SELECT nonexistent FROM baz");
+	stmt = sql_statement_init_prepared(prep);
+	result = sql_statement_query_s(&stmt);
+	test_assert(sql_result_next_row(result) == SQL_RESULT_NEXT_ERROR);
+	test_assert(strstr(sql_result_get_error(result), "nonexistent") != NULL);
+	sql_result_unref(result);
+
+	t = sql_transaction_begin(sql);
+	stmt = sql_statement_init_prepared(prep);
+	sql_update_stmt(t, &stmt);
+	sql_prepared_statement_unref(&prep);
+	test_assert(sql_transaction_commit_s(&t, &error) < 0);
+	test_assert(error != NULL && strstr(error, "nonexistent") != NULL);
+
+	sql_unref(&sql);
+	driver_sqlite_deinit();
+	sql_drivers_deinit();
+	i_unlink_if_exists("test-database.db");
+
+	test_end();
+}
+
 int main(void) {
 	static void (*const test_functions[])(void) = {
 		test_sql_sqlite,
+		test_sql_sqlite_prepared,
 		NULL
 	};
 	return test_run(test_functions);
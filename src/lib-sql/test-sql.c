@@ -1,8 +1,9 @@
 /* Copyright (c) 2021 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "ioloop.h"
 #include "test-common.h"
-#include "sql-api.h"
+#include "sql-api-private.h"
 #include "driver-test.h"
 
 static struct sql_db *setup_sql(void)
@@ -128,11 +129,165 @@ static void test_sql_stmt_prepared_api(void)
 	test_end();
 }
 
+/* A pooled driver where connections to host=bad fail every query at once,
+   while the other hosts reply successfully after a small delay. */
+struct test_pool_db {
+	struct sql_db api;
+	bool failing;
+	struct timeout *to;
+	sql_query_callback_t *callback;
+	void *context;
+};
+
+static unsigned int test_pool_good_queries, test_pool_bad_queries;
+
+static struct sql_db *test_pool_init(const char *connect_string);
+
+static void test_pool_deinit(struct sql_db *_db)
+{
+	struct test_pool_db *db = (struct test_pool_db *)_db;
+
+	i_assert(db->to == NULL);
+	event_unref(&_db->event);
+	array_free(&_db->module_contexts);
+	i_free(db);
+}
+
+static int test_pool_connect(struct sql_db *_db)
+{
+	sql_db_set_state(_db, SQL_DB_STATE_IDLE);
+	return 1;
+}
+
+static void test_pool_disconnect(struct sql_db *_db ATTR_UNUSED)
+{
+}
+
+static const char *
+test_pool_escape_string(struct sql_db *_db ATTR_UNUSED, const char *string)
+{
+	return string;
+}
+
+static void test_pool_result_free(struct sql_result *result)
+{
+	i_free(result);
+}
+
+static int test_pool_result_next_row(struct sql_result *result ATTR_UNUSED)
+{
+	return SQL_RESULT_NEXT_LAST;
+}
+
+static void test_pool_query_reply(struct test_pool_db *db)
+{
+	struct sql_result *result = i_new(struct sql_result, 1);
+
+	timeout_remove(&db->to);
+	result->v.free = test_pool_result_free;
+	result->v.next_row = test_pool_result_next_row;
+	result->db = &db->api;
+	result->refcount = 1;
+	result->callback = TRUE;
+	db->callback(result, db->context);
+	result->callback = FALSE;
+	sql_result_unref(result);
+}
+
+static void test_pool_query(struct sql_db *_db, const char *query ATTR_UNUSED,
+			    sql_query_callback_t *callback, void *context)
+{
+	struct test_pool_db *db = (struct test_pool_db *)_db;
+
+	if (db->failing) {
+		test_pool_bad_queries++;
+		/* the query is retried on another host with a warning */
+		test_expect_errors(1);
+		callback(&sql_not_connected_result, context);
+		return;
+	}
+	test_pool_good_queries++;
+	i_assert(db->to == NULL);
+	db->callback = callback;
+	db->context = context;
+	db->to = timeout_add_short(2, test_pool_query_reply, db);
+}
+
+static const struct sql_db driver_test_pool_db = {
+	.name = "testpool",
+	.flags = SQL_DB_FLAG_POOLED,
+
+	.v = {
+		.init = test_pool_init,
+		.deinit = test_pool_deinit,
+		.connect = test_pool_connect,
+		.disconnect = test_pool_disconnect,
+		.escape_string = test_pool_escape_string,
+		.query = test_pool_query,
+	}
+};
+
+static struct sql_db *test_pool_init(const char *connect_string)
+{
+	struct test_pool_db *db = i_new(struct test_pool_db, 1);
+
+	db->api = driver_test_pool_db;
+	db->api.event = event_create(NULL);
+	db->failing = str_begins_with(connect_string, "host=bad ");
+	return &db->api;
+}
+
+static void test_sqlpool_query_callback(struct sql_result *result,
+					unsigned int *replies)
+{
+	test_assert(!result->failed);
+	(*replies)++;
+	io_loop_stop(current_ioloop);
+}
+
+static void test_sqlpool_failing_host(void)
+{
+	const struct sql_settings set = {
+		.driver = "testpool",
+		.connect_string = "host=good host=bad maxconns=1",
+	};
+	struct sql_db *sql;
+	const char *error;
+	unsigned int i, replies = 0;
+
+	test_begin("sqlpool failing host");
+	struct ioloop *ioloop = io_loop_create();
+	sql_drivers_init();
+	sql_driver_register(&driver_test_pool_db);
+	test_pool_good_queries = test_pool_bad_queries = 0;
+
+	test_assert(sql_init_full(&set, &sql, &error) == 0);
+	test_assert(sql_connect(sql) > 0);
+	for (i = 0; i < 64; i++) {
+		sql_query(sql, "SELECT 1", test_sqlpool_query_callback,
+			  &replies);
+		io_loop_run(ioloop);
+	}
+	test_assert(replies == 64);
+	test_assert(test_pool_good_queries == 64);
+	/* The failing host replies much faster than the working one. It must
+	   not win the latency comparison: it only gets the periodic
+	   round-robin probes. */
+	test_assert(test_pool_bad_queries <= 64 / 8);
+
+	sql_unref(&sql);
+	sql_driver_unregister(&driver_test_pool_db);
+	sql_drivers_deinit();
+	io_loop_destroy(&ioloop);
+	test_end();
+}
+
 int main(void) {
 	static void (*const test_functions[])(void) = {
 		test_sql_api,
 		test_sql_stmt_api,
 		test_sql_stmt_prepared_api,
+		test_sqlpool_failing_host,
 		NULL
 	};
 	return test_run(test_functions);
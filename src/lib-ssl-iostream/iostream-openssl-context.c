@@ -742,6 +742,10 @@ ssl_iostream_context_init_common(struct ssl_iostream_context *ctx,
 #ifdef SSL_OP_NO_TICKET
 	if (!set->tickets)
 		ssl_ops |= SSL_OP_NO_TICKET;
+#endif
+#ifdef HAVE_SSL_KTLS
+	if (set->ktls)
+		ssl_ops |= SSL_OP_ENABLE_KTLS;
 #endif
 	SSL_CTX_set_options(ctx->ssl_ctx, ssl_ops);
 #ifdef SSL_MODE_RELEASE_BUFFERS
@@ -271,6 +271,28 @@ openssl_iostream_set(struct ssl_iostream *ssl_io,
 	return 0;
 }
 
+static bool
+openssl_iostream_want_socket_bio(struct ssl_iostream_context *ctx,
+				 struct istream *input, struct ostream *output)
+{
+#ifdef HAVE_SSL_KTLS
+	int fd = i_stream_get_fd(input);
+
+	if (!ctx->set.ktls || fd == -1 || o_stream_get_fd(output) != fd)
+		return FALSE;
+	/* OpenSSL can install the session keys to the kernel only when it
+	   does the socket I/O itself. That bypasses the plain streams, so
+	   they must be the fd streams themselves with nothing buffered. */
+	if (i_stream_get_root_io(input) != input ||
+	    output->real_stream->parent != NULL)
+		return FALSE;
+	return i_stream_get_data_size(input) == 0 &&
+		o_stream_get_buffer_used_size(output) == 0;
+#else
+	return FALSE;
+#endif
+}
+
 static int
 openssl_iostream_create(struct ssl_iostream_context *ctx,
 			struct event *event_parent, const char *host,
@@ -281,7 +303,7 @@ openssl_iostream_create(struct ssl_iostream_context *ctx,
 {
 	struct ssl_iostream *ssl_io;
 	SSL *ssl;
-	BIO *bio_int, *bio_ext;
+	BIO *bio_int, *bio_ext = NULL;
 
 	/* Don't allow an existing io_add_istream() to be use on the input.
 	   It would seem to work, but it would also cause hangs. */
@@ -294,12 +316,21 @@ openssl_iostream_create(struct ssl_iostream_context *ctx,
 		return -1;
 	}
 
+	if (openssl_iostream_want_socket_bio(ctx, *input, *output)) {
+		/* kTLS: OpenSSL reads and writes the socket directly */
+		bio_int = BIO_new_socket(i_stream_get_fd(*input), BIO_NOCLOSE);
+		if (bio_int == NULL) {
+			*error_r = t_strdup_printf("BIO_new_socket() failed: %s",
+						   openssl_iostream_error());
+			SSL_free(ssl);
+			return -1;
+		}
 	/* BIO pairs use default buffer sizes (17 kB in OpenSSL 0.9.8e).
 	   Each of the BIOs have one "write buffer". BIO_write() copies data
 	   to them, while BIO_read() reads from the other BIO's write buffer
 	   into the given buffer. The bio_int is used by OpenSSL and bio_ext
 	   is used by this library. */
-	if (BIO_new_bio_pair(&bio_int, 0, &bio_ext, 0) != 1) {
+	} else if (BIO_new_bio_pair(&bio_int, 0, &bio_ext, 0) != 1) {
 		*error_r = t_strdup_printf("BIO_new_bio_pair() failed: %s",
 					   openssl_iostream_error());
 		SSL_free(ssl);
@@ -589,6 +620,23 @@ openssl_iostream_bio_input(struct ssl_iostream *ssl_io,
 	return (bytes_read ? 1 : 0);
 }
 
+static int openssl_iostream_socket_sync(struct ssl_iostream *ssl_io)
+{
+	/* OpenSSL does the socket I/O itself. There's nothing to move
+	   between the BIOs and the plain streams, but the plain_output may
+	   still have something left from before the SSL was started. */
+	if (o_stream_flush(ssl_io->plain_output) < 0) {
+		i_free(ssl_io->plain_stream_errstr);
+		ssl_io->plain_stream_errstr =
+			i_strdup(o_stream_get_error(ssl_io->plain_output));
+		ssl_io->plain_stream_errno =
+			ssl_io->plain_output->stream_errno;
+		ssl_io->closed = TRUE;
+		return -1;
+	}
+	return 0;
+}
+
 int openssl_iostream_bio_sync(struct ssl_iostream *ssl_io,
 			      enum openssl_iostream_sync_type type)
 {
@@ -596,6 +644,9 @@ int openssl_iostream_bio_sync(struct ssl_iostream *ssl_io,
 
 	i_assert(type != OPENSSL_IOSTREAM_SYNC_TYPE_NONE);
 
+	if (ssl_io->bio_ext == NULL)
+		return openssl_iostream_socket_sync(ssl_io);
+
 	ret = openssl_iostream_bio_output(ssl_io);
 	if (ret >= 0 && openssl_iostream_bio_input(ssl_io, type) > 0)
 		ret = 1;
@@ -622,6 +673,16 @@ int openssl_iostream_handle_error(struct ssl_iostream *ssl_io, int ret,
 	int err;
 
 	err = SSL_get_error(ssl_io->ssl, ret);
+	if (ssl_io->bio_ext == NULL &&
+	    (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)) {
+		/* Wait for the socket itself. The istream's io is on the
+		   same fd and the plain_output's flush io notifies about it
+		   becoming writable. */
+		ssl_io->want_read = err == SSL_ERROR_WANT_READ;
+		if (!ssl_io->want_read)
+			o_stream_set_flush_pending(ssl_io->plain_output, TRUE);
+		return 0;
+	}
 	switch (err) {
 	case SSL_ERROR_WANT_WRITE:
 		if (type != OPENSSL_IOSTREAM_SYNC_TYPE_NONE &&
@@ -763,6 +824,15 @@ static int openssl_iostream_handshake(struct ssl_iostream *ssl_io)
 	}
 	i_free_and_null(ssl_io->last_error);
 	ssl_io->handshaked = TRUE;
+#ifdef HAVE_SSL_KTLS
+	if (ssl_io->bio_ext == NULL) {
+		ssl_io->want_read = FALSE;
+		ssl_io->ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl_io->ssl));
+		e_debug(ssl_io->event, "kTLS send=%s recv=%s",
+			ssl_io->ktls_send ? "yes" : "no",
+			BIO_get_ktls_recv(SSL_get_rbio(ssl_io->ssl)) ? "yes" : "no");
+	}
+#endif
 
 	if (ssl_io->ssl_output != NULL)
 		(void)o_stream_flush(ssl_io->ssl_output);
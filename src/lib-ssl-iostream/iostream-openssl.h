@@ -8,6 +8,9 @@
 #ifndef HAVE_ASN1_STRING_GET0_DATA
 #  define ASN1_STRING_get0_data(str) ASN1_STRING_data(str)
 #endif
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#  define HAVE_SSL_KTLS
+#endif
 enum openssl_iostream_sync_type {
 	OPENSSL_IOSTREAM_SYNC_TYPE_NONE,
 	OPENSSL_IOSTREAM_SYNC_TYPE_FIRST_READ,
@@ -33,6 +36,7 @@ struct ssl_iostream {
 	struct ssl_iostream_context *ctx;
 
 	SSL *ssl;
+	/* NULL when OpenSSL reads/writes the socket fd directly (kTLS) */
 	BIO *bio_ext;
 
 	struct istream *plain_input;
@@ -66,6 +70,7 @@ struct ssl_iostream {
 	bool cert_received:1;
 	bool cert_broken:1;
 	bool want_read:1;
+	bool ktls_send:1;
 	bool ostream_flush_waiting_input:1;
 	bool closed:1;
 	bool destroyed:1;
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "istream-private.h"
+#include "ostream.h"
 #include "iostream-openssl.h"
 
 struct ssl_istream {
@@ -105,6 +106,15 @@ static ssize_t i_stream_ssl_read(struct istream_private *stream)
 		stream->pos += ret;
 		total_ret += ret;
 	}
+	if (total_ret > 0 && ssl_io->bio_ext == NULL) {
+		/* OpenSSL reads the socket directly, so there's no BIO sync
+		   that would notice the new input. */
+		ssl_io->want_read = FALSE;
+		if (ssl_io->ostream_flush_waiting_input) {
+			ssl_io->ostream_flush_waiting_input = FALSE;
+			o_stream_set_flush_pending(ssl_io->plain_output, TRUE);
+		}
+	}
 	if (SSL_pending(ssl_io->ssl) > 0)
 		i_stream_set_input_pending(ssl_io->ssl_input, TRUE);
 	return total_ret;
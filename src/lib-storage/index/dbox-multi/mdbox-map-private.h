@@ -44,6 +44,7 @@ struct mdbox_map_append_context {
 	unsigned int files_nonappendable_count;
 
 	bool failed:1;
+	bool files_created:1;
 };
 
 struct mdbox_map_atomic_context {
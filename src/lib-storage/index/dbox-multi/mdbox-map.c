@@ -400,8 +400,10 @@ int mdbox_map_get_file_msgs(struct mdbox_map *map, uint32_t file_id,
 			    ARRAY_TYPE(mdbox_map_file_msg) *recs)
 {
 	const struct mail_index_header *hdr;
+	const struct mdbox_map_mail_index_record *map_rec;
 	struct dbox_mail_lookup_rec rec;
 	struct mdbox_map_file_msg msg;
+	const void *data;
 	uint32_t seq;
 
 	if (mdbox_map_refresh(map) < 0)
@@ -410,15 +412,20 @@ int mdbox_map_get_file_msgs(struct mdbox_map *map, uint32_t file_id,
 
 	i_zero(&msg);
 	for (seq = 1; seq <= hdr->messages_count; seq++) {
+		/* this is called for each purged file, so check the file_id
+		   before looking up the rest of the record */
+		mail_index_lookup_ext(map->view, seq, map->map_ext_id,
+				      &data, NULL);
+		map_rec = data;
+		if (map_rec != NULL && map_rec->file_id != file_id)
+			continue;
+
 		if (mdbox_map_view_lookup_rec(map, map->view, seq, &rec) < 0)
 			return -1;
-
-		if (rec.rec.file_id == file_id) {
-			msg.map_uid = rec.map_uid;
-			msg.offset = rec.rec.offset;
-			msg.refcount = rec.refcount;
-			array_push_back(recs, &msg);
-		}
+		msg.map_uid = rec.map_uid;
+		msg.offset = rec.rec.offset;
+		msg.refcount = rec.refcount;
+		array_push_back(recs, &msg);
 	}
 	return 0;
 }
@@ -1122,6 +1129,7 @@ int mdbox_map_append_next(struct mdbox_map_append_context *ctx,
 			dbox_file_unref(&file);
 			return -1;
 		}
+		ctx->files_created = TRUE;
 	}
 
 	append = array_append_space(&ctx->appends);
@@ -1174,6 +1182,11 @@ void mdbox_map_append_finish(struct mdbox_map_append_context *ctx)
 	mdbox_map_append_close_if_unneeded(ctx->map, last->file_append);
 }
 
+bool mdbox_map_append_created_files(struct mdbox_map_append_context *ctx)
+{
+	return ctx->files_created;
+}
+
 void mdbox_map_append_abort(struct mdbox_map_append_context *ctx)
 {
 	struct mdbox_map_append *appends;
@@ -133,6 +133,8 @@ int mdbox_map_append_move(struct mdbox_map_append_context *ctx,
 int mdbox_map_append_flush(struct mdbox_map_append_context *ctx);
 /* Returns 0 if ok, -1 if error. */
 int mdbox_map_append_commit(struct mdbox_map_append_context *ctx);
+/* Returns TRUE if new m.* files were created for the appends. */
+bool mdbox_map_append_created_files(struct mdbox_map_append_context *ctx);
 void mdbox_map_append_free(struct mdbox_map_append_context **ctx);
 
 /* Returns map's uidvalidity */
@@ -301,6 +301,7 @@ mdbox_file_purge(struct mdbox_purge_context *ctx, struct dbox_file *file,
 	pool_t ext_refs_pool;
 	unsigned int i, count;
 	uoff_t offset;
+	bool records_moved = FALSE;
 	int ret;
 
 	i_assert(ctx->atomic == NULL);
@@ -413,8 +414,12 @@ mdbox_file_purge(struct mdbox_purge_context *ctx, struct dbox_file *file,
 					  &expunged_map_uids) < 0 ||
 		    mdbox_map_append_commit(ctx->append_ctx) < 0)
 			ret = -1;
-		else
+		else {
+			/* all of the file's records were moved or
+			   expunged */
+			records_moved = TRUE;
 			ret = 1;
+		}
 	}
 	if (ctx->append_ctx != NULL)
 		mdbox_map_append_free(&ctx->append_ctx);
@@ -424,7 +429,8 @@ mdbox_file_purge(struct mdbox_purge_context *ctx, struct dbox_file *file,
 	   temporarily vanished */
 	if (ret > 0) {
 		(void)dbox_file_unlink(file);
-		if (mdbox_map_remove_file_id(ctx->storage->map, file_id) < 0)
+		if (!records_moved &&
+		    mdbox_map_remove_file_id(ctx->storage->map, file_id) < 0)
 			ret = -1;
 	} else {
 		dbox_file_unlock(file);
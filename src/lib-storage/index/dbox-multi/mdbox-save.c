@@ -382,6 +382,7 @@ void mdbox_transaction_save_commit_post(struct mail_save_context *_ctx,
 	struct mail_storage *_storage = box->storage;
 	struct mdbox_storage *storage =
 		container_of(_storage, struct mdbox_storage, storage.storage);
+	bool files_created;
 
 	_ctx->transaction = NULL; /* transaction is already freed */
 
@@ -399,12 +400,16 @@ void mdbox_transaction_save_commit_post(struct mail_save_context *_ctx,
 		if (mdbox_map_append_commit(ctx->append_ctx) < 0)
 			mdbox_map_atomic_set_failed(ctx->atomic);
 	}
+	files_created = mdbox_map_append_created_files(ctx->append_ctx);
 	mdbox_map_append_free(&ctx->append_ctx);
 	/* update the sync tail offset, everything else
 	   was already written at this point. */
 	(void)mdbox_map_atomic_finish(&ctx->atomic);
 
-	if (_storage->set->parsed_fsync_mode != FSYNC_MODE_NEVER) {
+	/* the directory needs to be fsynced only for the new m.* files.
+	   appends to existing files were already fdatasync()ed. */
+	if (files_created &&
+	    _storage->set->parsed_fsync_mode != FSYNC_MODE_NEVER) {
 		if (fdatasync_path(storage->storage_dir) < 0) {
 			mailbox_set_critical(box,
 				"fdatasync_path(%s) failed: %m",
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "sort.h"
 #include "index-rebuild.h"
 #include "mail-cache.h"
 #include "sdbox-storage.h"
@@ -26,38 +27,22 @@ static void sdbox_sync_set_uidvalidity(struct index_rebuild_context *ctx)
 
 static void
 sdbox_sync_add_file(struct index_rebuild_context *ctx,
-		    struct mail_index_view *trans_view,
-		    const char *fname, bool primary)
+		    ARRAY_TYPE(uint32_t) *uids, const char *fname)
 {
-	struct sdbox_mailbox *mbox = SDBOX_MAILBOX(ctx->box);
-	struct dbox_file *file;
-	uint32_t seq, uid;
+	uint32_t uid;
 
 	if (!str_begins(fname, SDBOX_MAIL_FILE_PREFIX, &fname))
 		return;
 
 	if (str_to_uint32(fname, &uid) < 0 || uid == 0) {
-		e_warning(mbox->box.event, "Ignoring invalid filename %s", fname);
+		e_warning(ctx->box->event, "Ignoring invalid filename %s", fname);
 		return;
 	}
-
-	file = sdbox_file_init(mbox, uid);
-	if (!primary)
-		file->cur_path = file->alt_path;
-	/* If the UID exists already in the transaction, it means we're trying
-	   to add a file to alt storage that was already found from primary
-	   storage. Just skip it then. */
-	if (!mail_index_lookup_seq(trans_view, uid, &seq)) {
-		mail_index_append(ctx->trans, uid, &seq);
-		T_BEGIN {
-			index_rebuild_index_metadata(ctx, seq, uid);
-		} T_END;
-	}
-	dbox_file_unref(&file);
+	array_push_back(uids, &uid);
 }
 
 static int sdbox_sync_index_rebuild_dir(struct index_rebuild_context *ctx,
-					struct mail_index_view *trans_view,
+					ARRAY_TYPE(uint32_t) *uids,
 					const char *path, bool primary)
 {
 	DIR *dir;
@@ -77,7 +62,7 @@ static int sdbox_sync_index_rebuild_dir(struct index_rebuild_context *ctx,
 		return -1;
 	}
 	for (errno = 0; (d = readdir(dir)) != NULL; errno = 0)
-		sdbox_sync_add_file(ctx, trans_view, d->d_name, primary);
+		sdbox_sync_add_file(ctx, uids, d->d_name);
 	if (errno != 0) {
 		mailbox_set_critical(ctx->box, "readdir(%s) failed: %m", path);
 		ret = -1;
@@ -90,6 +75,29 @@ static int sdbox_sync_index_rebuild_dir(struct index_rebuild_context *ctx,
 	return ret;
 }
 
+static void
+sdbox_sync_index_rebuild_append(struct index_rebuild_context *ctx,
+				ARRAY_TYPE(uint32_t) *uids)
+{
+	const uint32_t *uidp;
+	uint32_t seq, prev_uid = 0;
+
+	/* Append the messages in UID order, so the transaction doesn't need
+	   to look up or sort the appends afterwards. The same UID may exist
+	   both in primary and alt storage - it's added only once. */
+	array_sort(uids, uint32_cmp);
+	array_foreach(uids, uidp) {
+		if (*uidp == prev_uid)
+			continue;
+		prev_uid = *uidp;
+
+		mail_index_append(ctx->trans, *uidp, &seq);
+		T_BEGIN {
+			index_rebuild_index_metadata(ctx, seq, *uidp);
+		} T_END;
+	}
+}
+
 static void sdbox_sync_update_header(struct index_rebuild_context *ctx)
 {
 	struct sdbox_mailbox *mbox = SDBOX_MAILBOX(ctx->box);
@@ -118,21 +126,23 @@ sdbox_sync_index_rebuild_singles(struct index_rebuild_context *ctx)
 				&alt_path) < 0)
 		return -1;
 
-	struct mail_index_view *trans_view =
-		mail_index_transaction_open_updated_view(ctx->trans);
+	ARRAY_TYPE(uint32_t) uids;
+	i_array_init(&uids, 128);
 	sdbox_sync_set_uidvalidity(ctx);
-	if (sdbox_sync_index_rebuild_dir(ctx, trans_view, path, TRUE) < 0) {
+	if (sdbox_sync_index_rebuild_dir(ctx, &uids, path, TRUE) < 0) {
 		mailbox_set_critical(ctx->box, "sdbox: Rebuilding failed");
 		ret = -1;
 	} else if (alt_path != NULL) {
-		if (sdbox_sync_index_rebuild_dir(ctx, trans_view, alt_path, FALSE) < 0) {
+		if (sdbox_sync_index_rebuild_dir(ctx, &uids, alt_path, FALSE) < 0) {
 			mailbox_set_critical(ctx->box,
 				"sdbox: Rebuilding failed on alt path %s",
 				alt_path);
 			ret = -1;
 		}
 	}
-	mail_index_view_close(&trans_view);
+	if (ret == 0)
+		sdbox_sync_index_rebuild_append(ctx, &uids);
+	array_free(&uids);
 	sdbox_sync_update_header(ctx);
 	return ret;
 }
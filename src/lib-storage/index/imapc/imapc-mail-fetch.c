@@ -139,12 +139,40 @@ headers_merge(pool_t pool, const char *const *h1, const char *const *h2)
 	return array_front(&headers);
 }
 
+static void
+imapc_mail_fetch_uidset_append(string_t *cmd, size_t uidset_end, uint32_t uid)
+{
+	const char *data = str_c(cmd);
+	size_t pos = uidset_end;
+	uint32_t last_uid;
+
+	/* Mails are usually prefetched in ascending UID order. Extend the
+	   last UID range instead of listing each UID separately. */
+	while (pos > 0 && data[pos-1] >= '0' && data[pos-1] <= '9')
+		pos--;
+	if (pos < uidset_end &&
+	    str_to_uint32(t_strdup_until(data + pos, data + uidset_end),
+			  &last_uid) == 0 && last_uid + 1 == uid) {
+		if (pos > 0 && data[pos-1] == ':') {
+			/* replace the end of the existing range */
+			str_delete(cmd, pos, uidset_end - pos);
+			str_insert(cmd, pos, dec2str(uid));
+		} else {
+			str_insert(cmd, uidset_end,
+				   t_strdup_printf(":%u", uid));
+		}
+	} else {
+		str_insert(cmd, uidset_end, t_strdup_printf(",%u", uid));
+	}
+}
+
 static bool
 imapc_mail_try_merge_fetch(struct imapc_mailbox *mbox, string_t *str)
 {
 	const char *s1 = str_c(str);
 	const char *s2 = str_c(mbox->pending_fetch_cmd);
 	const char *s1_args, *s2_args, *p1, *p2;
+	uint32_t uid;
 
 	if (!str_begins(s1, "UID FETCH ", &s1_args))
 		i_unreached();
@@ -158,9 +186,10 @@ imapc_mail_try_merge_fetch(struct imapc_mailbox *mbox, string_t *str)
 	if (null_strcmp(p1, p2) != 0)
 		return FALSE;
 	/* append the new UID to the pending FETCH UID range */
-	str_truncate(str, p1-s1);
-	str_insert(mbox->pending_fetch_cmd, p2-s2, ",");
-	str_insert(mbox->pending_fetch_cmd, p2-s2+1, str_c(str) + 10);
+	if (str_to_uint32(t_strdup_until(s1_args, p1), &uid) < 0)
+		i_unreached();
+	imapc_mail_fetch_uidset_append(mbox->pending_fetch_cmd,
+				       p2 - s2, uid);
 	return TRUE;
 }
 
@@ -385,9 +414,23 @@ void imapc_mail_try_init_stream_from_cache(struct imapc_mail *mail)
 {
 	struct mail *_mail = &mail->imail.mail.mail;
 	struct imapc_mailbox *mbox = IMAPC_MAILBOX(_mail->box);
+	struct imapc_mail_cache *cache;
+	unsigned int i, count;
 
-	if (mbox->prev_mail_cache.uid == _mail->uid)
-		imapc_mail_cache_get(mail, &mbox->prev_mail_cache);
+	cache = array_get_modifiable(&mbox->mail_cache, &count);
+	for (i = count; i > 0; i--) {
+		if (cache[i-1].uid != _mail->uid)
+			continue;
+
+		imapc_mail_cache_get(mail, &cache[i-1]);
+		if (cache[i-1].fd == -1 && cache[i-1].buf == NULL) {
+			/* the mail took over the cached body. it's added back
+			   as the most recently used one when it's closed. */
+			mbox->mail_cache_size -= cache[i-1].size;
+			array_delete(&mbox->mail_cache, i-1, 1);
+		}
+		break;
+	}
 }
 
 bool imapc_mail_prefetch(struct mail *_mail)
@@ -454,7 +454,8 @@ static void imapc_mail_close(struct mail *_mail)
 {
 	struct imapc_mail *mail = IMAPC_MAIL(_mail);
 	struct imapc_mailbox *mbox = IMAPC_MAILBOX(_mail->box);
-	struct imapc_mail_cache *cache = &mbox->prev_mail_cache;
+	/* index_mail_close() may clear the UID */
+	uint32_t uid = _mail->uid;
 
 	if (mail->fetch_count > 0) {
 		imapc_mail_fetch_flush(mbox);
@@ -466,15 +467,24 @@ static void imapc_mail_close(struct mail *_mail)
 
 	mail->fetching_headers = NULL;
 	if (mail->body_fetched) {
-		imapc_mail_cache_free(cache);
-		cache->uid = _mail->uid;
+		struct imapc_mail_cache cache = {
+			.uid = uid,
+			.fd = -1,
+		};
+		struct stat st;
+
 		if (mail->fd != -1) {
-			cache->fd = mail->fd;
+			cache.fd = mail->fd;
 			mail->fd = -1;
+			if (fstat(cache.fd, &st) == 0)
+				cache.size = st.st_size;
 		} else {
-			cache->buf = mail->body;
+			cache.buf = mail->body;
 			mail->body = NULL;
+			if (cache.buf != NULL)
+				cache.size = cache.buf->used;
 		}
+		imapc_mailbox_mail_cache_add(mbox, &cache);
 	}
 	i_close_fd(&mail->fd);
 	buffer_free(&mail->body);
@@ -908,7 +908,7 @@ imapc_resp_text_uidvalidity(const struct imapc_untagged_reply *reply,
 
 	if (mbox->sync_uid_validity != uid_validity) {
 		mbox->sync_uid_validity = uid_validity;
-		imapc_mail_cache_free(&mbox->prev_mail_cache);
+		imapc_mailbox_mail_cache_clear(mbox);
 		imapc_sync_uid_validity(mbox);
 	}
 }
@@ -31,6 +31,7 @@ static const struct setting_define imapc_setting_defines[] = {
 	DEF(UINT, imapc_connection_retry_count),
 	DEF(TIME_MSECS, imapc_connection_retry_interval),
 	DEF(SIZE, imapc_max_line_length),
+	DEF(SIZE, imapc_mail_cache_max_size),
 
 	DEF(STR, pop3_deleted_flag),
 
@@ -57,6 +58,7 @@ static const struct imapc_settings imapc_default_settings = {
 	.imapc_connection_retry_count = 1,
 	.imapc_connection_retry_interval = 1000,
 	.imapc_max_line_length = 0,
+	.imapc_mail_cache_max_size = 0,
 
 	.pop3_deleted_flag = ""
 };
@@ -447,7 +447,7 @@ imapc_storage_create(struct mail_storage *_storage,
 	_storage->unique_root_dir = p_strdup_printf(_storage->pool,
 						    "%s%s://(%s|%s):%s@%s:%u/%s mechs:%s features:%s "
 						    "rawlog:%s cmd_timeout:%u maxidle:%u maxline:%zuu "
-						    "pop3delflg:%s root_dir:%s",
+						    "mailcache:%"PRIuUOFF_T" pop3delflg:%s root_dir:%s",
 						    storage->set->imapc_ssl,
 						    storage->set->imapc_ssl_verify ? "(verify)" : "",
 						    storage->set->imapc_user,
@@ -462,6 +462,7 @@ imapc_storage_create(struct mail_storage *_storage,
 						    storage->set->imapc_cmd_timeout,
 						    storage->set->imapc_max_idle_time,
 						    (size_t) storage->set->imapc_max_line_length,
+						    storage->set->imapc_mail_cache_max_size,
 						    storage->set->pop3_deleted_flag,
 						    ns->list->set.root_dir);
 
@@ -555,7 +556,7 @@ imapc_mailbox_alloc(struct mail_storage *storage, struct mailbox_list *list,
 	p_array_init(&mbox->copy_rollback_expunge_uids, pool, 16);
 	mbox->pending_fetch_cmd = str_new(pool, 128);
 	mbox->pending_copy_cmd = str_new(pool, 128);
-	mbox->prev_mail_cache.fd = -1;
+	p_array_init(&mbox->mail_cache, pool, 4);
 	imapc_mailbox_register_callbacks(mbox);
 	return &mbox->box;
 }
@@ -855,6 +856,47 @@ void imapc_mail_cache_free(struct imapc_mail_cache *cache)
 	i_close_fd(&cache->fd);
 	buffer_free(&cache->buf);
 	cache->uid = 0;
+	cache->size = 0;
+}
+
+void imapc_mailbox_mail_cache_add(struct imapc_mailbox *mbox,
+				  struct imapc_mail_cache *new_cache)
+{
+	struct imapc_mail_cache *cache;
+	unsigned int i, count;
+
+	/* replace any older cached body of the same mail */
+	cache = array_get_modifiable(&mbox->mail_cache, &count);
+	for (i = 0; i < count; i++) {
+		if (cache[i].uid == new_cache->uid) {
+			mbox->mail_cache_size -= cache[i].size;
+			imapc_mail_cache_free(&cache[i]);
+			array_delete(&mbox->mail_cache, i, 1);
+			break;
+		}
+	}
+	array_push_back(&mbox->mail_cache, new_cache);
+	mbox->mail_cache_size += new_cache->size;
+
+	/* drop the least recently used bodies, but always keep the latest */
+	while (array_count(&mbox->mail_cache) > 1 &&
+	       mbox->mail_cache_size >
+	       mbox->storage->set->imapc_mail_cache_max_size) {
+		cache = array_front_modifiable(&mbox->mail_cache);
+		mbox->mail_cache_size -= cache->size;
+		imapc_mail_cache_free(cache);
+		array_pop_front(&mbox->mail_cache);
+	}
+}
+
+void imapc_mailbox_mail_cache_clear(struct imapc_mailbox *mbox)
+{
+	struct imapc_mail_cache *cache;
+
+	array_foreach_modifiable(&mbox->mail_cache, cache)
+		imapc_mail_cache_free(cache);
+	array_clear(&mbox->mail_cache);
+	mbox->mail_cache_size = 0;
 }
 
 static void imapc_mailbox_close(struct mailbox *box)
@@ -882,7 +924,7 @@ static void imapc_mailbox_close(struct mailbox *box)
 		mail_index_view_close(&mbox->sync_view);
 	timeout_remove(&mbox->to_idle_delay);
 	timeout_remove(&mbox->to_idle_check);
-	imapc_mail_cache_free(&mbox->prev_mail_cache);
+	imapc_mailbox_mail_cache_clear(mbox);
 	index_storage_mailbox_close(box);
 }
 
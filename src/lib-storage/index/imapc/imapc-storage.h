@@ -104,6 +104,7 @@ struct imapc_mail_cache {
 	/* either fd != -1 or buf != NULL */
 	int fd;
 	buffer_t *buf;
+	uoff_t size;
 };
 
 struct imapc_fetch_request {
@@ -179,9 +180,11 @@ struct imapc_mailbox {
 	uint32_t min_append_uid;
 	char *sync_gmail_pop3_search_tag;
 
-	/* keep the previous fetched message body cached,
-	   mainly for partial IMAP fetches */
-	struct imapc_mail_cache prev_mail_cache;
+	/* keep the recently fetched message bodies cached, mainly for
+	   partial IMAP fetches. The least recently used is first. At least
+	   the previous body is kept, more up to imapc_mail_cache_max_size. */
+	ARRAY(struct imapc_mail_cache) mail_cache;
+	uoff_t mail_cache_size;
 
 	uint32_t prev_skipped_rseq, prev_skipped_uid;
 	struct imapc_sync_context *sync_ctx;
@@ -231,6 +234,9 @@ void imapc_transaction_save_rollback(struct mail_save_context *ctx);
 void imapc_mailbox_run(struct imapc_mailbox *mbox);
 void imapc_mailbox_run_nofetch(struct imapc_mailbox *mbox);
 void imapc_mail_cache_free(struct imapc_mail_cache *cache);
+void imapc_mailbox_mail_cache_add(struct imapc_mailbox *mbox,
+				  struct imapc_mail_cache *cache);
+void imapc_mailbox_mail_cache_clear(struct imapc_mailbox *mbox);
 int imapc_mailbox_select(struct imapc_mailbox *mbox);
 void imap_mailbox_select_finish(struct imapc_mailbox *mbox);
 
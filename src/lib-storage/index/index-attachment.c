@@ -403,7 +403,7 @@ int index_attachment_stream_get(struct fs *fs, const char *attachment_dir,
 	ARRAY_TYPE(mail_attachment_extref) extrefs_arr;
 	const struct mail_attachment_extref *extref;
 	struct istream_attachment_connector *conn;
-	struct istream *input;
+	struct istream *input, *prev_input = NULL;
 	struct fs_file *file;
 	const char *path;
 	int ret;
@@ -434,17 +434,25 @@ int index_attachment_stream_get(struct fs *fs, const char *attachment_dir,
 		}
 		fs_set_metadata(file, FS_METADATA_FILE_SIZE, t_strdup_printf("%"PRIuUOFF_T, raw_size));
 		input = i_stream_create_fs_file(&file, IO_BLOCK_SIZE);
+		/* start fetching this attachment already while the previous
+		   one is being read */
+		if (prev_input != NULL) {
+			i_stream_fs_file_set_prefetch_next(prev_input, input);
+			i_stream_unref(&prev_input);
+		}
 
 		ret = istream_attachment_connector_add(conn, input,
 					extref->start_offset, extref->size,
 					extref->base64_blocks_per_line,
 					extref->base64_have_crlf, error_r);
-		i_stream_unref(&input);
 		if (ret < 0) {
+			i_stream_unref(&input);
 			istream_attachment_connector_abort(&conn);
 			return -1;
 		}
+		prev_input = input;
 	}
+	i_stream_unref(&prev_input);
 
 	input = istream_attachment_connector_finish(&conn);
 	i_stream_set_name(input, t_strdup_printf(
@@ -29,6 +29,12 @@ struct binary_block {
 	bool converted, converted_hdr;
 };
 
+struct binary_part_blocks {
+	uoff_t physical_pos;
+	/* indexes to binary_ctx.blocks */
+	unsigned int hdr_block_idx, body_block_idx, end_block_idx;
+};
+
 struct binary_ctx {
 	struct mail *mail;
 	struct istream *input;
@@ -37,6 +43,8 @@ struct binary_ctx {
 	   body has its own block and the parts between the MIME bodies are
 	   unconverted blocks */
 	ARRAY(struct binary_block) blocks;
+	/* the blocks that each MIME part consists of */
+	ARRAY(struct binary_part_blocks) parts;
 
 	uoff_t copy_start_offset;
 };
@@ -92,8 +100,10 @@ add_binary_part(struct binary_ctx *ctx, const struct message_part *part,
 	struct message_size hdr_size;
 	struct istream *linput;
 	struct binary_block *block;
+	struct binary_part_blocks *part_blocks;
 	enum message_cte cte;
 	uoff_t part_end_offset;
+	unsigned int part_idx;
 	int ret;
 
 	/* first parse the header to find c-t-e. */
@@ -128,12 +138,21 @@ add_binary_part(struct binary_ctx *ctx, const struct message_part *part,
 	}
 
 	i_stream_seek(ctx->input, part->physical_pos);
+	if (include_hdr && ctx->copy_start_offset != 0) {
+		/* start the header in a new block, so its offset in the
+		   decoded stream is known */
+		binary_copy_to(ctx, part->physical_pos);
+		ctx->copy_start_offset = part->physical_pos;
+	}
+	part_idx = array_count(&ctx->parts);
+	part_blocks = array_append_space(&ctx->parts);
+	part_blocks->physical_pos = part->physical_pos;
+	part_blocks->hdr_block_idx = array_count(&ctx->blocks);
+
 	if (!include_hdr) {
 		/* body only */
 	} else if (IS_CONVERTED_CTE(cte)) {
 		/* write header with modified content-type */
-		if (ctx->copy_start_offset != 0)
-			binary_copy_to(ctx, part->physical_pos);
 		block = array_append_space(&ctx->blocks);
 		block->physical_pos = part->physical_pos;
 		block->converted = TRUE;
@@ -155,6 +174,7 @@ add_binary_part(struct binary_ctx *ctx, const struct message_part *part,
 	part_end_offset = part->physical_pos +
 		part->header_size.physical_size +
 		part->body_size.physical_size;
+	part_blocks->body_block_idx = array_count(&ctx->blocks);
 
 	if (part->children != NULL) {
 		/* multipart */
@@ -164,11 +184,14 @@ add_binary_part(struct binary_ctx *ctx, const struct message_part *part,
 		}
 		binary_copy_to(ctx, part_end_offset);
 		ctx->copy_start_offset = part_end_offset;
+		part_blocks = array_idx_modifiable(&ctx->parts, part_idx);
+		part_blocks->end_block_idx = array_count(&ctx->blocks);
 		return 0;
 	}
 	if (part->body_size.physical_size == 0) {
 		/* no body */
 		ctx->copy_start_offset = part_end_offset;
+		part_blocks->end_block_idx = array_count(&ctx->blocks);
 		return 0;
 	}
 
@@ -201,6 +224,7 @@ add_binary_part(struct binary_ctx *ctx, const struct message_part *part,
 	i_stream_unref(&linput);
 
 	ctx->copy_start_offset = part_end_offset;
+	part_blocks->end_block_idx = array_count(&ctx->blocks);
 	return 0;
 }
 
@@ -289,6 +313,57 @@ static void binary_parts_cache(struct binary_ctx *ctx)
 			     buf->data, buf->used);
 }
 
+static void
+binary_cache_add_parts(struct binary_ctx *ctx, struct mail_binary_cache *cache)
+{
+	const struct binary_block *blocks;
+	const struct binary_part_blocks *part_blocks;
+	struct mail_binary_cache_part *cache_part;
+	unsigned int i, count;
+	uoff_t *offsets;
+
+	/* the blocks have all been read, so their v_offsets are their
+	   sizes */
+	blocks = array_get(&ctx->blocks, &count);
+	offsets = t_new(uoff_t, count + 1);
+	for (i = 0; i < count; i++)
+		offsets[i+1] = offsets[i] + blocks[i].input->v_offset;
+
+	i_array_init(&cache->parts, array_count(&ctx->parts));
+	array_foreach(&ctx->parts, part_blocks) {
+		cache_part = array_append_space(&cache->parts);
+		cache_part->physical_pos = part_blocks->physical_pos;
+		cache_part->hdr_offset = offsets[part_blocks->hdr_block_idx];
+		cache_part->body_offset = offsets[part_blocks->body_block_idx];
+		cache_part->end_offset = offsets[part_blocks->end_block_idx];
+		for (i = part_blocks->hdr_block_idx;
+		     i < part_blocks->end_block_idx; i++) {
+			if (!blocks[i].converted)
+				continue;
+			if (i < part_blocks->body_block_idx)
+				cache_part->hdr_converted = TRUE;
+			else
+				cache_part->body_converted = TRUE;
+		}
+	}
+}
+
+static const struct mail_binary_cache_part *
+binary_cache_find_part(struct mail_binary_cache *cache, struct mail *mail,
+		       const struct message_part *part)
+{
+	const struct mail_binary_cache_part *cache_part;
+
+	if (cache->box != mail->box || cache->uid != mail->uid ||
+	    !array_is_created(&cache->parts))
+		return NULL;
+	array_foreach(&cache->parts, cache_part) {
+		if (cache_part->physical_pos == part->physical_pos)
+			return cache_part;
+	}
+	return NULL;
+}
+
 static struct istream **blocks_get_streams(struct binary_ctx *ctx)
 {
 	struct istream **streams;
@@ -374,6 +449,7 @@ index_mail_read_binary_to_cache(struct mail *_mail,
 	i_zero(&ctx);
 	ctx.mail = _mail;
 	t_array_init(&ctx.blocks, 8);
+	t_array_init(&ctx.parts, 8);
 
 	mail_storage_free_binary_cache(_mail->box->storage);
 	if (mail_get_stream_because(_mail, NULL, NULL, reason, &ctx.input) < 0)
@@ -419,6 +495,8 @@ index_mail_read_binary_to_cache(struct mail *_mail,
 		cache->orig_physical_pos = part->physical_pos;
 		cache->include_hdr = include_hdr;
 		cache->input = is;
+		if (part->parent == NULL && include_hdr)
+			binary_cache_add_parts(&ctx, cache);
 	}
 
 	i_assert(!i_stream_have_bytes_left(is));
@@ -553,6 +631,15 @@ index_mail_get_binary_properties(struct mail *_mail,
 	return 0;
 }
 
+static bool
+binary_part_has_crlfs(const struct message_part *part, bool include_hdr)
+{
+	if (include_hdr &&
+	    part->header_size.physical_size != part->header_size.virtual_size)
+		return FALSE;
+	return part->body_size.physical_size == part->body_size.virtual_size;
+}
+
 int index_mail_get_binary_stream(struct mail *_mail,
 				 const struct message_part *part,
 				 bool include_hdr,
@@ -561,7 +648,9 @@ int index_mail_get_binary_stream(struct mail *_mail,
 {
 	struct index_mail *mail = INDEX_MAIL(_mail);
 	struct mail_binary_cache *cache = &_mail->box->storage->binary_cache;
+	const struct mail_binary_cache_part *cache_part;
 	struct istream *input;
+	uoff_t start_offset;
 	bool binary, converted;
 
 	if (stream_r == NULL) {
@@ -578,6 +667,22 @@ int index_mail_get_binary_stream(struct mail *_mail,
 		timeout_reset(cache->to);
 		binary = TRUE;
 		converted = TRUE;
+	} else if ((cache_part = binary_cache_find_part(cache, _mail, part)) != NULL) {
+		/* the whole message is cached already. send the part
+		   from it without decoding it again. */
+		timeout_reset(cache->to);
+		start_offset = include_hdr ? cache_part->hdr_offset :
+			cache_part->body_offset;
+		if (bprops_r != NULL) {
+			bprops_r->size = cache_part->end_offset - start_offset;
+			bprops_r->lines = UINT_MAX;
+			bprops_r->binary = TRUE;
+			bprops_r->converted = cache_part->body_converted ||
+				(include_hdr && cache_part->hdr_converted);
+		}
+		*stream_r = i_stream_create_range(cache->input, start_offset,
+			cache_part->end_offset - start_offset);
+		return 0;
 	} else {
 		if (index_mail_read_binary_to_cache(_mail, part, include_hdr,
 						    "binary stream", &binary, &converted) < 0)
@@ -599,7 +704,15 @@ int index_mail_get_binary_stream(struct mail *_mail,
 		i_stream_seek(mail->data.stream, part->physical_pos +
 			      (include_hdr ? 0 :
 			       part->header_size.physical_size));
-		input = i_stream_create_crlf(mail->data.stream);
+		if (binary_part_has_crlfs(part, include_hdr)) {
+			/* The part is already stored with CRLFs. Avoid the
+			   CRLF conversion, so the stream keeps its fd and
+			   can be sent with sendfile(). */
+			input = mail->data.stream;
+			i_stream_ref(input);
+		} else {
+			input = i_stream_create_crlf(mail->data.stream);
+		}
 		*stream_r = i_stream_create_limit(input, cache->size);
 		i_stream_unref(&input);
 		mail_storage_free_binary_cache(_mail->box->storage);
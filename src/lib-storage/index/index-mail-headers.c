@@ -9,6 +9,7 @@
 #include "message-part-data.h"
 #include "message-parser.h"
 #include "message-header-decode.h"
+#include "message-search.h"
 #include "istream-tee.h"
 #include "istream-header-filter.h"
 #include "imap-envelope.h"
@@ -407,6 +408,16 @@ index_mail_cache_parse_init(struct mail *_mail, struct istream *input)
 	mail->data.tee_stream = tee_i_stream_create(input);
 	input = tee_i_stream_create_child(mail->data.tee_stream);
 	input2 = tee_i_stream_create_child(mail->data.tee_stream);
+	if (index_mail_want_search_bloom(mail)) {
+		/* Build the search bloom filter from the same stream, so the
+		   saved mail doesn't need to be read again afterwards. */
+		struct istream *bloom_input =
+			tee_i_stream_create_child(mail->data.tee_stream);
+		mail->data.save_bloom = message_search_bloom_init_stream(
+			bloom_input,
+			_mail->box->storage->user->default_normalizer);
+		i_stream_unref(&bloom_input);
+	}
 
 	index_mail_parse_header_init(mail, NULL);
 	mail->data.parser_input = input;
@@ -673,8 +684,12 @@ index_mail_get_raw_headers(struct index_mail *mail, const char *field,
 	field_idx = get_header_field_idx(_mail->box, field);
 
 	dest = str_new(mail->mail.data_pool, 128);
-	if (mail_cache_lookup_headers(_mail->transaction->cache_view, dest,
-				      _mail->seq, &field_idx, 1) <= 0) {
+	ret = mail_cache_lookup_headers(_mail->transaction->cache_view, dest,
+					_mail->seq, &field_idx, 1);
+	index_mail_cache_lookup_stats_add(_mail, field_idx, ret);
+	if (ret == 0)
+		_mail->transaction->stats.cache_miss_count++;
+	if (ret <= 0) {
 		/* not in cache / error - first see if it's already parsed */
 		p_free(mail->mail.data_pool, dest);
 		if (mail->data.header_parser_initialized) {
@@ -935,6 +950,7 @@ int index_mail_get_header_stream(struct mail *_mail,
 	struct index_mail *mail = INDEX_MAIL(_mail);
 	struct istream *input;
 	string_t *dest;
+	int ret;
 
 	index_mail_filter_stream_destroy(mail);
 
@@ -948,9 +964,14 @@ int index_mail_get_header_stream(struct mail *_mail,
 	}
 
 	dest = str_new(mail->mail.data_pool, 256);
-	if (mail_cache_lookup_headers(_mail->transaction->cache_view, dest,
-				      _mail->seq, headers->idx,
-				      headers->count) > 0) {
+	ret = mail_cache_lookup_headers(_mail->transaction->cache_view, dest,
+					_mail->seq, headers->idx,
+					headers->count);
+	for (unsigned int i = 0; i < headers->count; i++)
+		index_mail_cache_lookup_stats_add(_mail, headers->idx[i], ret);
+	if (ret == 0)
+		_mail->transaction->stats.cache_miss_count++;
+	else if (ret > 0) {
 		str_append(dest, "\n");
 		_mail->transaction->stats.cache_hit_count++;
 		mail->data.filter_stream =
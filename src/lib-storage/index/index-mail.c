@@ -7,11 +7,13 @@
 #include "istream.h"
 #include "hex-binary.h"
 #include "str.h"
+#include "unichar.h"
 #include "mailbox-recent-flags.h"
 #include "message-date.h"
 #include "message-part-data.h"
 #include "message-part-serialize.h"
 #include "message-parser.h"
+#include "message-search.h"
 #include "message-snippet.h"
 #include "imap-bodystructure.h"
 #include "imap-envelope.h"
@@ -63,6 +65,8 @@ static struct mail_cache_field global_cache_fields[] = {
 	{ .name = "binary.parts",
 	  .type = MAIL_CACHE_FIELD_VARIABLE_SIZE },
 	{ .name = "body.snippet",
+	  .type = MAIL_CACHE_FIELD_VARIABLE_SIZE },
+	{ .name = "search.bloom",
 	  .type = MAIL_CACHE_FIELD_VARIABLE_SIZE }
 	/* FIXME: for now need to update get_metadata_precache_fields() in
 	   index-status.c when adding more fields. those fields should probably
@@ -90,6 +94,9 @@ int index_mail_cache_lookup_field(struct index_mail *mail, buffer_t *buf,
 				      buf, mail->mail.mail.seq, field_idx);
 	if (ret > 0)
 		mail->mail.mail.transaction->stats.cache_hit_count++;
+	else if (ret == 0)
+		mail->mail.mail.transaction->stats.cache_miss_count++;
+	index_mail_cache_lookup_stats_add(_mail, field_idx, ret);
 
 	/* If the request was lazy mark the field as cache wanted. */
 	if (_mail->lookup_abort == MAIL_LOOKUP_ABORT_NOT_IN_CACHE_START_CACHING &&
@@ -382,6 +389,36 @@ int index_mail_get_parts(struct mail *_mail, struct message_part **parts_r)
 	return 0;
 }
 
+static const void *
+index_mail_get_date_ext(struct index_mail *mail, uint32_t ext_id)
+{
+	struct mail *_mail = &mail->mail.mail;
+	const void *idata;
+	bool expunged ATTR_UNUSED;
+
+	mail_index_lookup_ext(_mail->transaction->view, _mail->seq,
+			      ext_id, &idata, &expunged);
+	return idata;
+}
+
+static void
+index_mail_update_date_ext(struct index_mail *mail, uint32_t ext_id,
+			   const void *data, size_t size)
+{
+	struct mail *_mail = &mail->mail.mail;
+	const void *old_data;
+
+	if (!_mail->box->storage->set->mail_index_dates ||
+	    mail->data.no_caching)
+		return;
+
+	old_data = index_mail_get_date_ext(mail, ext_id);
+	if (old_data != NULL && memcmp(old_data, data, size) == 0)
+		return;
+	mail_index_update_ext(_mail->transaction->itrans, _mail->seq,
+			      ext_id, data, NULL);
+}
+
 int index_mail_get_received_date(struct mail *_mail, time_t *date_r)
 {
 	struct index_mail *mail = INDEX_MAIL(_mail);
@@ -389,11 +426,22 @@ int index_mail_get_received_date(struct mail *_mail, time_t *date_r)
 
 	data->cache_fetch_fields |= MAIL_FETCH_RECEIVED_DATE;
 	if (data->received_date == (time_t)-1) {
+		const uint32_t *rdate =
+			index_mail_get_date_ext(mail, _mail->box->mail_rdate_ext_id);
 		uint32_t t;
 
-		if (index_mail_get_fixed_field(mail, MAIL_CACHE_RECEIVED_DATE,
-						&t, sizeof(t)))
+		/* 0 means the date isn't in the index record */
+		if (rdate != NULL && *rdate != 0)
+			data->received_date = *rdate;
+		else if (index_mail_get_fixed_field(mail, MAIL_CACHE_RECEIVED_DATE,
+						    &t, sizeof(t))) {
 			data->received_date = t;
+			if (t != 0) {
+				index_mail_update_date_ext(mail,
+					_mail->box->mail_rdate_ext_id,
+					&t, sizeof(t));
+			}
+		}
 	}
 
 	*date_r = data->received_date;
@@ -442,6 +490,11 @@ static int index_mail_cache_sent_date(struct index_mail *mail)
 	data->sent_date.timezone = tz;
 	index_mail_cache_add(mail, MAIL_CACHE_SENT_DATE,
 			     &data->sent_date, sizeof(data->sent_date));
+	if (data->sent_date.time != 0) {
+		index_mail_update_date_ext(mail,
+			mail->mail.mail.box->mail_sdate_ext_id,
+			&data->sent_date, sizeof(data->sent_date));
+	}
 	return 0;
 }
 
@@ -449,6 +502,7 @@ int index_mail_get_date(struct mail *_mail, time_t *date_r, int *timezone_r)
 {
 	struct index_mail *mail = INDEX_MAIL(_mail);
 	struct index_mail_data *data = &mail->data;
+	const struct mail_sent_date *sdate;
 	struct mail_sent_date sentdate;
 
 	data->cache_fetch_fields |= MAIL_FETCH_DATE;
@@ -458,9 +512,25 @@ int index_mail_get_date(struct mail *_mail, time_t *date_r, int *timezone_r)
 		return 0;
 	}
 
+	/* time=0 means either that the date isn't in the index record or
+	   that the mail has no valid Date header. Use the cache for both. */
+	sdate = index_mail_get_date_ext(mail, _mail->box->mail_sdate_ext_id);
+	if (sdate != NULL && sdate->time != 0) {
+		data->sent_date = *sdate;
+		*timezone_r = data->sent_date.timezone;
+		*date_r = data->sent_date.time;
+		return 0;
+	}
+
 	if (index_mail_get_fixed_field(mail, MAIL_CACHE_SENT_DATE,
-				       &sentdate, sizeof(sentdate)))
+				       &sentdate, sizeof(sentdate))) {
 		data->sent_date = sentdate;
+		if (sentdate.time != 0) {
+			index_mail_update_date_ext(mail,
+				_mail->box->mail_sdate_ext_id,
+				&sentdate, sizeof(sentdate));
+		}
+	}
 
 	if (index_mail_cache_sent_date(mail) < 0)
 		return -1;
@@ -806,7 +876,10 @@ static void index_mail_body_parsed_cache_message_parts(struct index_mail *mail)
 
 	pool_t pool = pool_alloconly_create("mail parts", 2048);
 	buffer = buffer_create_dynamic(pool, 1024);
-	message_part_serialize(mail->data.parts, buffer);
+	if (_mail->box->storage->set->mail_cache_packed_message_parts)
+		message_part_serialize_packed(mail->data.parts, buffer);
+	else
+		message_part_serialize(mail->data.parts, buffer);
 	index_mail_cache_add_idx(mail, cache_field,
 				 buffer->data, buffer->used);
 	pool_unref(&pool);
@@ -969,6 +1042,71 @@ bool index_mail_want_cache(struct index_mail *mail, enum index_cache_field field
 	}
 }
 
+bool index_mail_want_search_bloom(struct index_mail *imail)
+{
+	struct mail *mail = &imail->mail.mail;
+	unsigned int field_idx =
+		imail->ibox->cache_fields[MAIL_CACHE_SEARCH_BLOOM].idx;
+
+	return mail_cache_field_want_add(mail->transaction->cache_trans,
+					 mail->seq, field_idx);
+}
+
+static bool index_mail_cache_save_bloom(struct index_mail *imail)
+{
+	unsigned int field_idx =
+		imail->ibox->cache_fields[MAIL_CACHE_SEARCH_BLOOM].idx;
+	bool ret = FALSE;
+
+	if (message_search_bloom_parse_more(imail->data.save_bloom) > 0) {
+		buffer_t *filter = t_buffer_create(MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+
+		message_search_bloom_get_filter(imail->data.save_bloom, filter);
+		index_mail_cache_add_idx(imail, field_idx,
+					 filter->data, filter->used);
+		ret = TRUE;
+	}
+	message_search_bloom_deinit(&imail->data.save_bloom);
+	return ret;
+}
+
+static void index_mail_cache_search_bloom(struct index_mail *imail)
+{
+	struct mail *mail = &imail->mail.mail;
+	buffer_t *filter;
+	unsigned int field_idx =
+		imail->ibox->cache_fields[MAIL_CACHE_SEARCH_BLOOM].idx;
+	struct istream *input;
+	uoff_t old_offset;
+
+	if (imail->data.save_bloom != NULL) {
+		/* the filter was built while the mail was being saved */
+		if (index_mail_cache_save_bloom(imail))
+			return;
+	}
+	if (!index_mail_want_search_bloom(imail))
+		return;
+
+	old_offset = imail->data.stream == NULL ? 0 :
+		imail->data.stream->v_offset;
+	const char *reason = index_mail_cache_reason(mail, "search bloom");
+	if (mail_get_stream_because(mail, NULL, NULL, reason, &input) < 0)
+		return;
+	i_stream_seek(input, 0);
+	filter = t_buffer_create(MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+	if (message_search_bloom_build(input,
+			mail->box->storage->user->default_normalizer,
+			filter) < 0) {
+		mail_set_critical(mail, "read(%s) failed: %s",
+				  i_stream_get_name(input),
+				  i_stream_get_error(input));
+	} else {
+		index_mail_cache_add_idx(imail, field_idx,
+					 filter->data, filter->used);
+	}
+	i_stream_seek(imail->data.stream, old_offset);
+}
+
 static void index_mail_save_finish_make_snippet(struct index_mail *mail)
 {
 	if (mail->data.save_body_snippet) {
@@ -1055,6 +1193,11 @@ static void index_mail_cache_dates(struct index_mail *mail)
 					     &t, sizeof(t));
 		}
 	}
+	if (dates[0] != (time_t)-1 && dates[0] != 0) {
+		t = time_to_uint32_trunc(dates[0]);
+		index_mail_update_date_ext(mail,
+			mail->mail.mail.box->mail_rdate_ext_id, &t, sizeof(t));
+	}
 
 	if (mail->data.sent_date_parsed &&
 	    index_mail_want_cache(mail, MAIL_CACHE_SENT_DATE))
@@ -1818,6 +1961,8 @@ static void index_mail_close_streams_full(struct index_mail *mail, bool closing)
 		if (mail->data.save_bodystructure_body)
 			mail->data.save_bodystructure_header = TRUE;
 	}
+	if (data->save_bloom != NULL)
+		message_search_bloom_deinit(&data->save_bloom);
 	i_stream_unref(&data->filter_stream);
 	if (data->stream != NULL) {
 		struct istream *orig_stream = data->stream;
@@ -2047,6 +2192,14 @@ void index_mail_update_access_parts_pre(struct mail *_mail)
 		}
 	}
 
+	if ((data->wanted_fields & MAIL_FETCH_DATE) != 0 &&
+	    data->sent_date.time == (uint32_t)-1) {
+		/* avoid the cache lookup if the date is in the index */
+		const struct mail_sent_date *sdate =
+			index_mail_get_date_ext(mail, _mail->box->mail_sdate_ext_id);
+		if (sdate != NULL && sdate->time != 0)
+			data->sent_date = *sdate;
+	}
 	if ((data->wanted_fields & MAIL_FETCH_DATE) != 0 &&
 	    (storage->nonbody_access_fields & MAIL_FETCH_DATE) == 0 &&
 	    data->sent_date.time == (uint32_t)-1) {
@@ -2324,6 +2477,8 @@ void index_mail_cache_parse_continue(struct mail *_mail)
 							block.part, block.hdr);
 		}
 	}
+	if (mail->data.save_bloom != NULL)
+		(void)message_search_bloom_parse_more(mail->data.save_bloom);
 }
 
 void index_mail_cache_parse_deinit(struct mail *_mail, time_t received_date,
@@ -2346,6 +2501,8 @@ void index_mail_cache_parse_deinit(struct mail *_mail, time_t received_date,
 
 	/* This is needed with 0 byte mails to get hdr=NULL call done. */
 	index_mail_cache_parse_continue(_mail);
+	if (!success && mail->data.save_bloom != NULL)
+		message_search_bloom_deinit(&mail->data.save_bloom);
 
 	if (mail->data.received_date == (time_t)-1)
 		mail->data.received_date = received_date;
@@ -2507,6 +2664,8 @@ int index_mail_precache(struct mail *mail)
 	cache = imail->data.wanted_fields;
 	if ((cache & (MAIL_FETCH_STREAM_HEADER | MAIL_FETCH_STREAM_BODY)) != 0)
 		index_mail_parse(mail, (cache & MAIL_FETCH_STREAM_BODY) != 0);
+	if ((cache & MAIL_FETCH_STREAM_BODY) != 0)
+		index_mail_cache_search_bloom(imail);
 	if ((cache & MAIL_FETCH_RECEIVED_DATE) != 0)
 		(void)mail_get_received_date(mail, &date);
 	if ((cache & MAIL_FETCH_SAVE_DATE) != 0)
@@ -2619,6 +2778,7 @@ void index_mail_save_finish(struct mail_save_context *ctx)
 	struct index_mail *imail = INDEX_MAIL(ctx->dest_mail);
 
 	index_mail_save_finish_make_snippet(imail);
+	index_mail_cache_search_bloom(imail);
 
 	if (ctx->data.from_envelope != NULL &&
 	    imail->data.from_envelope == NULL) {
@@ -2627,6 +2787,32 @@ void index_mail_save_finish(struct mail_save_context *ctx)
 	}
 }
 
+void index_mail_cache_lookup_stats_add(struct mail *mail,
+				       unsigned int field_idx, int ret)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(mail->box);
+	struct index_mail_cache_field_stats *stats;
+	enum mail_cache_decision_type dec;
+
+	if (!array_is_created(&ibox->cache_field_stats))
+		i_array_init(&ibox->cache_field_stats, 32);
+	stats = array_idx_get_space(&ibox->cache_field_stats, field_idx);
+	if (ret > 0) {
+		stats->hits++;
+		return;
+	}
+	if (ret < 0) {
+		stats->errors++;
+		return;
+	}
+	dec = mail_cache_field_get_decision(mail->box->cache, field_idx);
+	if ((dec & ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED)) ==
+	    MAIL_CACHE_DECISION_NO)
+		stats->misses_decision_no++;
+	else
+		stats->misses++;
+}
+
 const char *index_mail_cache_reason(struct mail *mail, const char *reason)
 {
 	const char *cache_reason =
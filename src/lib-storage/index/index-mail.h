@@ -24,6 +24,8 @@ enum index_cache_field {
 	MAIL_CACHE_MESSAGE_PARTS,
 	MAIL_CACHE_BINARY_PARTS,
 	MAIL_CACHE_BODY_SNIPPET,
+	/* fixed size, but used only if enabled in cache settings */
+	MAIL_CACHE_SEARCH_BLOOM,
 
 	MAIL_INDEX_CACHE_FIELD_COUNT
 };
@@ -102,6 +104,8 @@ struct index_mail_data {
 	struct message_size hdr_size, body_size;
 	struct istream *parser_input;
 	struct message_parser_ctx *parser_ctx;
+	/* search bloom filter built while saving the mail */
+	struct message_search_bloom *save_bloom;
 	int parsing_count;
 	ARRAY_TYPE(keywords) keywords;
 	ARRAY_TYPE(keyword_indexes) keyword_indexes;
@@ -271,6 +275,7 @@ bool index_mail_get_cached_bodystructure(struct index_mail *mail,
 const uint32_t *index_mail_get_vsize_extension(struct mail *_mail);
 
 bool index_mail_want_cache(struct index_mail *mail, enum index_cache_field field);
+bool index_mail_want_search_bloom(struct index_mail *mail);
 void index_mail_cache_add(struct index_mail *mail, enum index_cache_field field,
 			  const void *data, size_t data_size);
 static inline bool
@@ -297,6 +302,10 @@ void index_mail_cache_parse_deinit(struct mail *mail, time_t received_date,
 
 int index_mail_cache_lookup_field(struct index_mail *mail, buffer_t *buf,
 				  unsigned int field_idx);
+/* Update the mailbox's cache field lookup statistics. ret is the
+   mail_cache_lookup_*() return value. */
+void index_mail_cache_lookup_stats_add(struct mail *mail,
+				       unsigned int field_idx, int ret);
 void index_mail_save_finish(struct mail_save_context *ctx);
 
 const char *index_mail_cache_reason(struct mail *mail, const char *reason);
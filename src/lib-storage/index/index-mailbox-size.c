@@ -15,6 +15,13 @@
    last-indexed-uid are still valid. If they are, add all the missing new
    mails. Unlock.
 
+   With mailbox_list_index=yes the vsize header is also updated right after
+   the saving transaction is committed, so the mailbox list index has an
+   up-to-date vsize for STATUS without the mailbox being synced. This is
+   done only if the vsize lock can be taken immediately and the new mails'
+   vsizes are in the index records, which is normally the case after
+   saving. Otherwise the next sync adds them as above.
+
    Fetching vsize: Lock vsize updates. Check if the message count +
    last-indexed-uid are still valid. If not, set them to zero. Add all
    the missing mails. Unlock.
@@ -500,3 +507,58 @@ void index_mailbox_vsize_update_appends(struct mailbox *box)
 	}
 	index_mailbox_vsize_update_deinit(&update);
 }
+
+static void
+index_mailbox_vsize_hdr_add_saved(struct mailbox_vsize_update *update)
+{
+	struct mailbox_index_vsize *vsize_hdr = &update->vsize_hdr;
+	const struct mail_index_header *hdr;
+	const void *data;
+	uint32_t seq, seq1, seq2, uid, vsize;
+	bool expunged;
+
+	hdr = mail_index_get_header(update->view);
+	if (vsize_hdr->highest_uid + 1 >= hdr->next_uid)
+		return;
+
+	if (mail_index_lookup_seq_range(update->view,
+					vsize_hdr->highest_uid + 1,
+					hdr->next_uid - 1, &seq1, &seq2)) {
+		for (seq = seq1; seq <= seq2; seq++) {
+			mail_index_lookup_ext(update->view, seq,
+					      update->box->mail_vsize_ext_id,
+					      &data, &expunged);
+			if (data == NULL)
+				return;
+			memcpy(&vsize, data, sizeof(vsize));
+			if (vsize == 0) {
+				/* not in index - leave the rest for
+				   syncing */
+				return;
+			}
+			mail_index_lookup_uid(update->view, seq, &uid);
+			vsize_hdr->vsize += vsize - 1;
+			vsize_hdr->highest_uid = uid;
+			vsize_hdr->message_count++;
+		}
+	}
+	vsize_hdr->highest_uid = hdr->next_uid - 1;
+}
+
+void index_mailbox_vsize_update_saves(struct mailbox *box)
+{
+	struct mailbox_vsize_update *update;
+
+	update = index_mailbox_vsize_update_init(box);
+	if (update->rebuild) {
+		/* The vsize header doesn't exist. Don't create it. */
+		update->skip_write = TRUE;
+	}
+
+	index_mailbox_vsize_check_rebuild(update);
+	if (index_mailbox_vsize_want_updates(update) &&
+	    index_mailbox_vsize_update_try_lock(update) &&
+	    index_mailbox_vsize_want_updates(update))
+		index_mailbox_vsize_hdr_add_saved(update);
+	index_mailbox_vsize_update_deinit(&update);
+}
@@ -16,5 +16,8 @@ bool index_mailbox_vsize_update_wait_lock(struct mailbox_vsize_update *update);
 bool index_mailbox_vsize_want_updates(struct mailbox_vsize_update *update);
 
 void index_mailbox_vsize_update_appends(struct mailbox *box);
+/* Add the newly saved mails to the vsize header using the vsizes in their
+   index records, without having to sync the mailbox first. */
+void index_mailbox_vsize_update_saves(struct mailbox *box);
 
 #endif
@@ -23,6 +23,16 @@ struct index_search_context {
 	struct index_mail *cur_imail;
 	struct mail_thread_context *thread_ctx;
 	pool_t temp_pool;
+	/* n-gram filters of BODY/TEXT keys for the search.bloom field */
+	ARRAY(struct index_search_bloom_key) bloom_keys;
+
+	/* Number of mails currently prefetched ahead. Adjusted between
+	   SEARCH_PREFETCH_INITIAL_DEPTH and mail_ctx.max_mails. */
+	unsigned int prefetch_depth, prefetch_depth_max;
+	unsigned int prefetch_idle_count;
+	/* Mails that had to be read to finish the search. Hits had their
+	   prefetch sent before they were needed. */
+	unsigned int prefetch_hits, prefetch_misses;
 
 	struct timeval last_nonblock_timeval;
 	struct timeval interrupt_start_time;
@@ -34,6 +44,7 @@ struct index_search_context {
 	bool have_index_args:1;
 	bool have_mailbox_args:1;
 	bool have_nonmatch_always:1;
+	bool have_body_args:1;
 };
 
 struct mail *index_search_get_mail(struct index_search_context *ctx);
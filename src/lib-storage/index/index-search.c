@@ -36,6 +36,11 @@
 #define SEARCH_INITIAL_MAX_COST 30000
 #define SEARCH_RECALC_MIN_USECS 50000
 
+/* Number of mails to prefetch ahead at first. This is doubled whenever the
+   whole prefetch window is in use by mails that are being read, up to
+   mail_prefetch_count. */
+#define SEARCH_PREFETCH_INITIAL_DEPTH 2
+
 /* If interrupt signal is received and search doesn't finish in this many
    milliseconds, fail the search with MAIL_ERRSTR_INTERRUPTED. */
 #define SEARCH_INTERRUPT_DELAY_MSECS 2000
@@ -55,10 +60,21 @@ struct search_header_context {
 	bool threading:1;
 };
 
+struct index_search_bloom_key {
+	const struct mail_search_arg *arg;
+	/* allocated from the search args pool */
+	const char *normalized_key;
+	/* FALSE if the key is too short for the filter */
+	bool usable;
+};
+
 struct search_body_context {
         struct index_search_context *index_ctx;
 	struct istream *input;
 	struct message_part *part;
+
+	ARRAY(struct mail_search_arg *) args;
+	ARRAY(struct message_search_context *) msg_search_ctxs;
 };
 
 static void search_parse_msgset_args(unsigned int messages_count,
@@ -134,6 +150,10 @@ static void search_init_arg(struct mail_search_arg *arg,
 	case SEARCH_MAILBOX_GLOB:
 		ctx->have_mailbox_args = TRUE;
 		break;
+	case SEARCH_BODY:
+	case SEARCH_TEXT:
+		ctx->have_body_args = TRUE;
+		break;
 	case SEARCH_ALL:
 		if (!arg->match_not)
 			arg->match_always = TRUE;
@@ -702,12 +722,10 @@ static void search_header(struct message_header_line *hdr,
 	}
 }
 
-static void search_body(struct mail_search_arg *arg,
-			struct search_body_context *ctx)
+static void search_body_add(struct mail_search_arg *arg,
+			    struct search_body_context *ctx)
 {
 	struct message_search_context *msg_search_ctx;
-	const char *error;
-	int ret;
 
 	switch (arg->type) {
 	case SEARCH_BODY:
@@ -722,15 +740,51 @@ static void search_body(struct mail_search_arg *arg,
 		ARG_SET_RESULT(arg, 0);
 		return;
 	}
+	array_push_back(&ctx->args, &arg);
+	array_push_back(&ctx->msg_search_ctxs, &msg_search_ctx);
+}
+
+static int
+search_body_msg(struct search_body_context *ctx, struct message_part *part,
+		const char **error_r)
+{
+	struct message_search_context *const *msg_search_ctxs;
+	struct mail_search_arg *const *args;
+	unsigned int i, count;
+	bool *matched;
+	int ret;
+
+	args = array_get(&ctx->args, &count);
+	msg_search_ctxs = array_front(&ctx->msg_search_ctxs);
+	matched = t_new(bool, count);
 
 	i_stream_seek(ctx->input, 0);
-	ret = message_search_msg(msg_search_ctx, ctx->input, ctx->part, &error);
+	ret = message_search_msg_multi(msg_search_ctxs, count, ctx->input,
+				       part, matched, error_r);
+	if (ret == 0) {
+		for (i = 0; i < count; i++)
+			ARG_SET_RESULT(args[i], matched[i] ? 1 : 0);
+	}
+	return ret;
+}
+
+static void search_body(struct search_body_context *ctx)
+{
+	struct mail_search_arg *const *argp;
+	const char *error;
+	int ret;
+
+	if (array_count(&ctx->args) == 0)
+		return;
+
+	/* Search all the BODY and TEXT keys while reading the message only
+	   once. */
+	ret = search_body_msg(ctx, ctx->part, &error);
 	if (ret < 0 && ctx->input->stream_errno == 0) {
 		/* try again without cached parts */
 		index_mail_set_message_parts_corrupted(ctx->index_ctx->cur_mail, error);
 
-		i_stream_seek(ctx->input, 0);
-		ret = message_search_msg(msg_search_ctx, ctx->input, NULL, &error);
+		ret = search_body_msg(ctx, NULL, &error);
 		i_assert(ret >= 0 || ctx->input->stream_errno != 0);
 	}
 	if (ctx->input->stream_errno != 0) {
@@ -738,8 +792,10 @@ static void search_body(struct mail_search_arg *arg,
 			"read(%s) failed: %s", i_stream_get_name(ctx->input),
 			i_stream_get_error(ctx->input));
 	}
-
-	ARG_SET_RESULT(arg, ret);
+	if (ret < 0) {
+		array_foreach(&ctx->args, argp)
+			ARG_SET_RESULT(*argp, -1);
+	}
 }
 
 static int search_arg_match_text(struct mail_search_arg *args,
@@ -874,7 +930,11 @@ static int search_arg_match_text(struct mail_search_arg *args,
 	(void)mail_get_parts(ctx->cur_mail, &body_ctx.part);
 	ctx->cur_mail->lookup_abort = MAIL_LOOKUP_ABORT_NEVER;
 
-	return mail_search_args_foreach(args, search_body, &body_ctx);
+	t_array_init(&body_ctx.args, 4);
+	t_array_init(&body_ctx.msg_search_ctxs, 4);
+	(void)mail_search_args_foreach(args, search_body_add, &body_ctx);
+	search_body(&body_ctx);
+	return mail_search_args_foreach(args, search_none, NULL);
 }
 
 static bool
@@ -1318,6 +1378,9 @@ index_storage_search_init(struct mailbox_transaction_context *t,
 	ctx->mail_ctx.max_mails = t->box->storage->set->mail_prefetch_count + 1;
 	if (ctx->mail_ctx.max_mails == 0)
 		ctx->mail_ctx.max_mails = UINT_MAX;
+	ctx->prefetch_depth = I_MIN(ctx->mail_ctx.max_mails,
+				    SEARCH_PREFETCH_INITIAL_DEPTH);
+	ctx->prefetch_depth_max = ctx->prefetch_depth;
 	ctx->next_time_check_cost = SEARCH_INITIAL_MAX_COST;
 	i_gettimeofday(&ctx->last_nonblock_timeval);
 
@@ -1372,6 +1435,25 @@ search_arg_deinit(struct mail_search_arg *arg,
 	}
 }
 
+static void search_prefetch_finished_event(struct index_search_context *ctx)
+{
+	unsigned int total = ctx->prefetch_hits + ctx->prefetch_misses;
+
+	if (total == 0)
+		return;
+
+	struct event_passthrough *e =
+		event_create_passthrough(ctx->box->event)->
+		set_name("mail_search_prefetch_finished")->
+		add_int("prefetch_depth", ctx->prefetch_depth)->
+		add_int("prefetch_depth_max", ctx->prefetch_depth_max)->
+		add_int("prefetch_hits", ctx->prefetch_hits)->
+		add_int("prefetch_misses", ctx->prefetch_misses);
+	e_debug(e->event(), "Search prefetching finished: "
+		"%u/%u mails prefetched, max depth %u",
+		ctx->prefetch_hits, total, ctx->prefetch_depth_max);
+}
+
 int index_storage_search_deinit(struct mail_search_context *_ctx)
 {
         struct index_search_context *ctx = (struct index_search_context *)_ctx;
@@ -1379,6 +1461,7 @@ int index_storage_search_deinit(struct mail_search_context *_ctx)
 	int ret;
 
 	ret = ctx->failed ? -1 : 0;
+	search_prefetch_finished_event(ctx);
 
 	mail_search_args_reset(ctx->mail_ctx.args->args, FALSE);
 	(void)mail_search_args_foreach(ctx->mail_ctx.args->args,
@@ -1404,6 +1487,8 @@ int index_storage_search_deinit(struct mail_search_context *_ctx)
 	if (ctx->failed)
 		mail_storage_last_error_pop(ctx->box->storage);
 	array_free(&ctx->mail_ctx.mails);
+	if (array_is_created(&ctx->bloom_keys))
+		array_free(&ctx->bloom_keys);
 	pool_unref(&ctx->temp_pool);
 	i_free(ctx);
 	return ret;
@@ -1420,12 +1505,111 @@ search_get_cost(struct mailbox_transaction_context *trans)
 		(trans->stats.files_read_bytes/1024) * SEARCH_COST_KBYTE;
 }
 
+static const struct index_search_bloom_key *
+search_bloom_key_get(struct index_search_context *ctx,
+		     const struct mail_search_arg *arg)
+{
+	struct index_search_bloom_key *key;
+
+	if (!array_is_created(&ctx->bloom_keys))
+		i_array_init(&ctx->bloom_keys, 4);
+	array_foreach_modifiable(&ctx->bloom_keys, key) {
+		if (key->arg == arg)
+			return key;
+	}
+
+	key = array_append_space(&ctx->bloom_keys);
+	key->arg = arg;
+	T_BEGIN {
+		string_t *dtc = t_str_new(128);
+
+		if (ctx->mail_ctx.normalizer(arg->value.str,
+					     strlen(arg->value.str), dtc) < 0)
+			i_panic("search key not utf8: %s", arg->value.str);
+		key->normalized_key = p_strdup(ctx->mail_ctx.args->pool,
+					       str_c(dtc));
+		key->usable = str_len(dtc) >= MESSAGE_SEARCH_BLOOM_NGRAM_LEN;
+	} T_END;
+	return key;
+}
+
+struct search_bloom_context {
+	struct index_search_context *index_ctx;
+	const unsigned char *filter;
+	size_t filter_size;
+};
+
+static void search_bloom_arg(struct mail_search_arg *arg,
+			     struct search_bloom_context *ctx)
+{
+	const struct index_search_bloom_key *key;
+
+	switch (arg->type) {
+	case SEARCH_BODY:
+	case SEARCH_TEXT:
+		break;
+	default:
+		return;
+	}
+	if (arg->value.str[0] == '\0')
+		return;
+
+	key = search_bloom_key_get(ctx->index_ctx, arg);
+	if (key->usable &&
+	    !message_search_bloom_may_contain(ctx->filter, ctx->filter_size,
+					      key->normalized_key)) {
+		/* the mail can't contain the key */
+		ARG_SET_RESULT(arg, 0);
+	}
+}
+
+static int search_arg_match_bloom(struct mail_search_arg *args,
+				  struct index_search_context *ctx)
+{
+	struct search_bloom_context bloom_ctx;
+	struct mail *real_mail;
+	struct index_mail *imail;
+	enum mail_cache_decision_type decision;
+	unsigned int field_idx;
+	buffer_t *buf;
+
+	if (!ctx->have_body_args)
+		return -1;
+	if (mail_get_backend_mail(ctx->cur_mail, &real_mail) < 0)
+		return -1;
+	imail = INDEX_MAIL(real_mail);
+
+	/* The filter is used only if it's enabled in the cache settings.
+	   Looking it up would otherwise start caching it. */
+	field_idx = imail->ibox->cache_fields[MAIL_CACHE_SEARCH_BLOOM].idx;
+	decision = mail_cache_field_get_decision(real_mail->box->cache,
+						 field_idx);
+	if ((decision & ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED)) ==
+	    MAIL_CACHE_DECISION_NO)
+		return -1;
+
+	buf = t_buffer_create(MESSAGE_SEARCH_BLOOM_MAX_SIZE);
+	if (index_mail_cache_lookup_field(imail, buf, field_idx) <= 0)
+		return -1;
+	/* an empty filter means that the mail had too many n-grams */
+	if (buf->used == 0 || !message_search_bloom_is_valid_size(buf->used))
+		return -1;
+
+	i_zero(&bloom_ctx);
+	bloom_ctx.index_ctx = ctx;
+	bloom_ctx.filter = buf->data;
+	bloom_ctx.filter_size = buf->used;
+	return mail_search_args_foreach(args, search_bloom_arg, &bloom_ctx);
+}
+
 static int search_match_once(struct index_search_context *ctx)
 {
 	int ret;
 
 	ret = mail_search_args_foreach(ctx->mail_ctx.args->args,
 				       search_cached_arg, ctx);
+	if (ret < 0)
+		ret = search_arg_match_bloom(ctx->mail_ctx.args->args, ctx);
 	if (ret < 0)
 		ret = search_arg_match_text(ctx->mail_ctx.args->args, ctx);
 	if (ret < 0)
@@ -1687,7 +1871,7 @@ struct mail *index_search_get_mail(struct index_search_context *ctx)
 	struct mail *const *mails, *mail;
 	unsigned int count;
 
-	if (ctx->mail_ctx.unused_mail_idx == ctx->mail_ctx.max_mails)
+	if (ctx->mail_ctx.unused_mail_idx >= ctx->prefetch_depth)
 		return NULL;
 
 	mails = array_get(&ctx->mail_ctx.mails, &count);
@@ -1705,6 +1889,43 @@ struct mail *index_search_get_mail(struct index_search_context *ctx)
 	return mail;
 }
 
+static void search_prefetch_grow(struct index_search_context *ctx)
+{
+	struct mail *const *mails;
+	unsigned int i, count;
+
+	if (ctx->prefetch_depth >= ctx->mail_ctx.max_mails)
+		return;
+
+	/* Grow the window only if all the mails in it are still waiting for
+	   their prefetch to finish. Otherwise the latency is already hidden. */
+	mails = array_get(&ctx->mail_ctx.mails, &count);
+	i_assert(ctx->mail_ctx.unused_mail_idx <= count);
+	for (i = 0; i < ctx->mail_ctx.unused_mail_idx; i++) {
+		struct index_mail *imail = INDEX_MAIL(mails[i]);
+
+		if (!imail->data.prefetch_sent)
+			return;
+	}
+	if (ctx->prefetch_depth > ctx->mail_ctx.max_mails / 2)
+		ctx->prefetch_depth = ctx->mail_ctx.max_mails;
+	else
+		ctx->prefetch_depth *= 2;
+	if (ctx->prefetch_depth > ctx->prefetch_depth_max)
+		ctx->prefetch_depth_max = ctx->prefetch_depth;
+}
+
+static void search_prefetch_idle(struct index_search_context *ctx)
+{
+	/* Shrink the window after a full window's worth of mails didn't need
+	   to be prefetched, e.g. because they were found from cache. */
+	if (++ctx->prefetch_idle_count < ctx->prefetch_depth)
+		return;
+	ctx->prefetch_idle_count = 0;
+	if (ctx->prefetch_depth / 2 >= SEARCH_PREFETCH_INITIAL_DEPTH)
+		ctx->prefetch_depth /= 2;
+}
+
 static int search_more_with_prefetching(struct index_search_context *ctx,
 					struct mail **mail_r)
 {
@@ -1726,10 +1947,15 @@ static int search_more_with_prefetching(struct index_search_context *ctx,
 			*mail_r = mail;
 			return 1;
 		}
-		if (mail_prefetch(mail) && ctx->mail_ctx.unused_mail_idx == 0) {
-			/* no prefetching done, return it immediately */
-			*mail_r = mail;
-			return 1;
+		if (!mail_prefetch(mail))
+			ctx->prefetch_idle_count = 0;
+		else {
+			search_prefetch_idle(ctx);
+			if (ctx->mail_ctx.unused_mail_idx == 0) {
+				/* no prefetching done, return it immediately */
+				*mail_r = mail;
+				return 1;
+			}
 		}
 		ctx->mail_ctx.unused_mail_idx++;
 	}
@@ -1746,6 +1972,7 @@ static int search_more_with_prefetching(struct index_search_context *ctx,
 		}
 	} else {
 		/* prefetch buffer is full. */
+		search_prefetch_grow(ctx);
 	}
 
 	/* return the next message */
@@ -1795,6 +2022,10 @@ static int search_more(struct index_search_context *ctx,
 		if (imail->data.search_results == NULL)
 			break;
 
+		if (imail->data.prefetch_sent)
+			ctx->prefetch_hits++;
+		else
+			ctx->prefetch_misses++;
 		/* prefetch running - searching wasn't finished yet */
 		if (search_finish_prefetch(ctx, imail))
 			break;
@@ -1869,6 +2100,10 @@ bool index_storage_search_next_nonblock(struct mail_search_context *_ctx,
 		/* finished searching the messages. now sort them and start
 		   returning the messages. */
 		ctx->sorted = TRUE;
+		if (_ctx->sort_limit != 0) {
+			index_sort_program_set_limit(_ctx->sort_program,
+						     _ctx->sort_limit);
+		}
 		index_sort_list_finish(_ctx->sort_program);
 	}
 
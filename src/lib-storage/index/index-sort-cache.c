@@ -0,0 +1,211 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+/* Remember the sorted UID order of the last full mailbox sort. When the same
+   sort program is used again, the mails that were already sorted are returned
+   in the remembered order without looking up their sort keys. Only the mails
+   added since then are sorted normally, and then merged into the result. The
+   sort keys of existing mails never change, and expunged mails are simply
+   dropped, so the remembered order stays valid.
+*/
+#include "lib.h"
+#include "array.h"
+#include "buffer.h"
+#include "index-storage.h"
+#include "index-sort-private.h"
+
+struct index_sort_cache {
+	enum mail_sort_type sort_program[MAX_SORT_PROGRAM_SIZE];
+	uint32_t uid_validity;
+	/* All mails with uid <= highest_uid that existed when the cache was
+	   built are in uids[]. */
+	uint32_t highest_uid;
+	/* UIDs in the sorted order */
+	ARRAY_TYPE(uint32_t) uids;
+};
+
+static bool
+index_sort_cache_program_is_usable(const enum mail_sort_type *sort_program)
+{
+	for (unsigned int i = 0; sort_program[i] != MAIL_SORT_END; i++) {
+		switch (sort_program[i] & MAIL_SORT_MASK) {
+		case MAIL_SORT_RELEVANCY:
+			/* depends on the search query */
+		case MAIL_SORT_POP3_ORDER:
+			/* may change after the mail is saved */
+			return FALSE;
+		default:
+			break;
+		}
+	}
+	return TRUE;
+}
+
+static bool
+index_sort_cache_program_equals(const enum mail_sort_type *sort_program1,
+				const enum mail_sort_type *sort_program2)
+{
+	unsigned int i;
+
+	for (i = 0; sort_program1[i] != MAIL_SORT_END; i++) {
+		if (sort_program1[i] != sort_program2[i])
+			return FALSE;
+	}
+	return sort_program2[i] == MAIL_SORT_END;
+}
+
+static uint32_t
+index_sort_cache_uid_validity(struct mailbox_transaction_context *t)
+{
+	return mail_index_get_header(t->view)->uid_validity;
+}
+
+void index_sort_cache_init(struct mail_search_sort_program *program)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(program->t->box);
+	struct index_sort_cache *cache = ibox->sort_cache;
+
+	if (!index_sort_cache_program_is_usable(program->sort_program))
+		return;
+	program->cache_wanted = TRUE;
+
+	if (cache == NULL ||
+	    cache->uid_validity != index_sort_cache_uid_validity(program->t) ||
+	    !index_sort_cache_program_equals(cache->sort_program,
+					     program->sort_program))
+		return;
+
+	program->cache_uids = buffer_create_dynamic(default_pool,
+						    cache->highest_uid / 8 + 1);
+}
+
+bool index_sort_cache_add(struct mail_search_sort_program *program,
+			  struct mail *mail)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(program->t->box);
+	unsigned char *bits;
+
+	program->added_count++;
+	if (program->cache_uids == NULL ||
+	    mail->uid > ibox->sort_cache->highest_uid)
+		return FALSE;
+
+	bits = buffer_get_space_unsafe(program->cache_uids, mail->uid / 8, 1);
+	*bits |= 1 << (mail->uid % 8);
+	return TRUE;
+}
+
+static bool
+index_sort_cache_uid_is_wanted(struct mail_search_sort_program *program,
+			       uint32_t uid)
+{
+	const unsigned char *bits = program->cache_uids->data;
+
+	if (uid / 8 >= program->cache_uids->used)
+		return FALSE;
+	return (bits[uid / 8] & (1 << (uid % 8))) != 0;
+}
+
+static void
+index_sort_cache_merge(struct mail_search_sort_program *program)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(program->t->box);
+	ARRAY_TYPE(uint32_t) cached_seqs, merged_seqs;
+	const uint32_t *uidp, *seqp, *cached;
+	unsigned int i, pos, count, cached_count;
+	uint32_t seq;
+
+	/* get the cached mails' sequences in the sorted order */
+	i_array_init(&cached_seqs, array_count(&ibox->sort_cache->uids));
+	array_foreach(&ibox->sort_cache->uids, uidp) {
+		if (index_sort_cache_uid_is_wanted(program, *uidp) &&
+		    mail_index_lookup_seq(program->t->view, *uidp, &seq))
+			array_push_back(&cached_seqs, &seq);
+	}
+	cached = array_get(&cached_seqs, &cached_count);
+
+	/* The new mails were sorted normally. Since they're sorted, each
+	   one's position in the cached list is after the previous one's. */
+	count = !array_is_created(&program->seqs) ? 0 :
+		array_count(&program->seqs);
+	i_array_init(&merged_seqs, cached_count + count);
+	for (i = pos = 0; i < count; i++) {
+		seqp = array_idx(&program->seqs, i);
+		unsigned int left = pos, right = cached_count;
+		while (left < right) {
+			unsigned int mid = left + (right - left) / 2;
+			if (index_sort_node_cmp_type(program,
+						     program->sort_program,
+						     cached[mid], *seqp) < 0)
+				left = mid + 1;
+			else
+				right = mid;
+		}
+		array_append(&merged_seqs, cached + pos, left - pos);
+		array_push_back(&merged_seqs, seqp);
+		pos = left;
+	}
+	array_append(&merged_seqs, cached + pos, cached_count - pos);
+	array_free(&cached_seqs);
+
+	if (array_is_created(&program->seqs))
+		array_free(&program->seqs);
+	program->seqs = merged_seqs;
+}
+
+static void
+index_sort_cache_update(struct mail_search_sort_program *program)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(program->t->box);
+	struct index_sort_cache *cache = ibox->sort_cache;
+	unsigned int i, count;
+	const uint32_t *seqp;
+	uint32_t uid;
+
+	if (cache == NULL) {
+		cache = ibox->sort_cache = i_new(struct index_sort_cache, 1);
+		i_array_init(&cache->uids, 128);
+	} else {
+		array_clear(&cache->uids);
+	}
+	memcpy(cache->sort_program, program->sort_program,
+	       sizeof(cache->sort_program));
+	cache->uid_validity = index_sort_cache_uid_validity(program->t);
+	cache->highest_uid = 0;
+
+	count = !array_is_created(&program->seqs) ? 0 :
+		array_count(&program->seqs);
+	for (i = 0; i < count; i++) {
+		seqp = array_idx(&program->seqs, i);
+		mail_index_lookup_uid(program->t->view, *seqp, &uid);
+		array_push_back(&cache->uids, &uid);
+		if (uid > cache->highest_uid)
+			cache->highest_uid = uid;
+	}
+}
+
+void index_sort_cache_finish(struct mail_search_sort_program *program)
+{
+	if (program->cache_uids != NULL)
+		index_sort_cache_merge(program);
+
+	/* Remember the result only if it contains all the mails in the fully
+	   sorted order and all their sort keys could be looked up. */
+	if (program->cache_wanted && !program->failed &&
+	    !program->sorted_partially &&
+	    program->added_count > 0 &&
+	    program->added_count ==
+	    mail_index_view_get_messages_count(program->t->view))
+		index_sort_cache_update(program);
+}
+
+void index_sort_cache_free(struct index_sort_cache **_cache)
+{
+	struct index_sort_cache *cache = *_cache;
+
+	if (cache == NULL)
+		return;
+	*_cache = NULL;
+
+	array_free(&cache->uids);
+	i_free(cache);
+}
@@ -8,6 +8,8 @@ struct mail_search_sort_program {
 	enum mail_sort_type sort_program[MAX_SORT_PROGRAM_SIZE];
 	struct mail *temp_mail;
 	unsigned int slow_mails_left;
+	/* If non-zero, only this many first mails need to be sorted */
+	unsigned int sort_limit;
 
 	void (*sort_list_add)(struct mail_search_sort_program *program,
 			      struct mail *mail);
@@ -17,7 +19,14 @@ struct mail_search_sort_program {
 	ARRAY_TYPE(uint32_t) seqs;
 	unsigned int iter_idx;
 
+	/* Bitmap of UIDs whose sorted order is taken from the sort cache */
+	buffer_t *cache_uids;
+	unsigned int added_count;
+
 	bool failed;
+	bool cache_wanted;
+	/* Only the first sort_limit mails were sorted */
+	bool sorted_partially;
 };
 
 /* Returns 1 on success, 0 if mail is already expunged, -1 on other errors. */
@@ -27,6 +36,12 @@ int index_sort_node_cmp_type(struct mail_search_sort_program *program,
 			     const enum mail_sort_type *sort_program,
 			     uint32_t seq1, uint32_t seq2);
 
+void index_sort_cache_init(struct mail_search_sort_program *program);
+/* Returns TRUE if the mail's position is already known by the sort cache. */
+bool index_sort_cache_add(struct mail_search_sort_program *program,
+			  struct mail *mail);
+void index_sort_cache_finish(struct mail_search_sort_program *program);
+
 void index_sort_list_init_string(struct mail_search_sort_program *program);
 void index_sort_list_add_string(struct mail_search_sort_program *program,
 				struct mail *mail);
@@ -36,6 +36,74 @@ struct sort_cmp_context {
 
 static struct sort_cmp_context static_node_cmp_context;
 
+static void
+index_sort_node_swap(unsigned char *n1, unsigned char *n2, size_t size)
+{
+	unsigned char tmp;
+
+	for (size_t i = 0; i < size; i++) {
+		tmp = n1[i];
+		n1[i] = n2[i];
+		n2[i] = tmp;
+	}
+}
+
+static void
+index_sort_heap_sift_down(unsigned char *nodes, size_t size,
+			  unsigned int count, unsigned int idx,
+			  int (*cmp)(const void *, const void *))
+{
+	unsigned int child;
+
+	while ((child = idx * 2 + 1) < count) {
+		if (child + 1 < count &&
+		    cmp(nodes + child * size, nodes + (child + 1) * size) < 0)
+			child++;
+		if (cmp(nodes + idx * size, nodes + child * size) >= 0)
+			break;
+		index_sort_node_swap(nodes + idx * size,
+				     nodes + child * size, size);
+		idx = child;
+	}
+}
+
+static void
+index_sort_array_i(struct mail_search_sort_program *program,
+		   struct array *array,
+		   int (*cmp)(const void *, const void *))
+{
+	unsigned int i, count = array_count_i(array);
+	unsigned int limit = program->sort_limit;
+	size_t size = array->element_size;
+	unsigned char *nodes;
+
+	if (limit == 0 || limit >= count) {
+		array_sort_i(array, cmp);
+		return;
+	}
+
+	/* Only the first limit nodes need to be sorted. Keep the best ones
+	   found so far in a max-heap at the beginning of the array, so the
+	   worst of them is always at the top. The rest of the nodes are
+	   left after them in an unspecified order. */
+	nodes = buffer_get_modifiable_data(array->buffer, NULL);
+	for (i = limit / 2; i > 0; i--)
+		index_sort_heap_sift_down(nodes, size, limit, i - 1, cmp);
+	for (i = limit; i < count; i++) {
+		if (cmp(nodes + i * size, nodes) < 0) {
+			index_sort_node_swap(nodes, nodes + i * size, size);
+			index_sort_heap_sift_down(nodes, size, limit, 0, cmp);
+		}
+	}
+	qsort(nodes, limit, size, cmp);
+	program->sorted_partially = TRUE;
+}
+#define index_sort_array(program, array, cmp) \
+	index_sort_array_i(program, &(array)->arr + \
+		CALLBACK_TYPECHECK(cmp, int (*)(typeof(*(array)->v), \
+						typeof(*(array)->v))), \
+		(int (*)(const void *, const void *))cmp)
+
 static void
 index_sort_program_set_mail_failed(struct mail_search_sort_program *program,
 				   struct mail *mail)
@@ -179,6 +247,9 @@ void index_sort_list_add(struct mail_search_sort_program *program,
 	   doesn't work right. */
 	i_assert(mail->lookup_abort == MAIL_LOOKUP_ABORT_NEVER);
 
+	if (index_sort_cache_add(program, mail))
+		return;
+
 	if (program->slow_mails_left == 0)
 		mail->lookup_abort = MAIL_LOOKUP_ABORT_NOT_IN_CACHE;
 
@@ -216,7 +287,7 @@ index_sort_list_finish_date(struct mail_search_sort_program *program)
 {
 	ARRAY_TYPE(mail_sort_node_date) *nodes = program->context;
 
-	array_sort(nodes, sort_node_date_cmp);
+	index_sort_array(program, nodes, sort_node_date_cmp);
 	memcpy(&program->seqs, nodes, sizeof(program->seqs));
 	i_free(nodes);
 	program->context = NULL;
@@ -242,7 +313,7 @@ index_sort_list_finish_size(struct mail_search_sort_program *program)
 {
 	ARRAY_TYPE(mail_sort_node_size) *nodes = program->context;
 
-	array_sort(nodes, sort_node_size_cmp);
+	index_sort_array(program, nodes, sort_node_size_cmp);
 	memcpy(&program->seqs, nodes, sizeof(program->seqs));
 	i_free(nodes);
 	program->context = NULL;
@@ -271,7 +342,7 @@ index_sort_list_finish_float(struct mail_search_sort_program *program)
 	/* NOTE: higher relevancy is returned first, unlike with all
 	   other number based sort keys, so temporarily reverse the search */
 	static_node_cmp_context.reverse = !static_node_cmp_context.reverse;
-	array_sort(nodes, sort_node_float_cmp);
+	index_sort_array(program, nodes, sort_node_float_cmp);
 	static_node_cmp_context.reverse = !static_node_cmp_context.reverse;
 
 	memcpy(&program->seqs, nodes, sizeof(program->seqs));
@@ -288,9 +359,19 @@ void index_sort_list_finish(struct mail_search_sort_program *program)
 
 	struct event_reason *reason = event_reason_begin("mailbox:sort");
 	program->sort_list_finish(program);
+	index_sort_cache_finish(program);
 	event_reason_end(&reason);
 }
 
+void index_sort_program_set_limit(struct mail_search_sort_program *program,
+				  unsigned int limit)
+{
+	/* Mails looked up from the sort cache are merged with the newly
+	   sorted mails, which requires them to be fully sorted. */
+	if (program->cache_uids == NULL)
+		program->sort_limit = limit;
+}
+
 bool index_sort_list_next(struct mail_search_sort_program *program,
 			  uint32_t *seq_r)
 {
@@ -463,6 +544,7 @@ index_sort_program_init(struct mailbox_transaction_context *t,
 	default:
 		i_unreached();
 	}
+	index_sort_cache_init(program);
 	return program;
 }
 
@@ -476,6 +558,7 @@ int index_sort_program_deinit(struct mail_search_sort_program **_program)
 		index_sort_list_finish(program);
 	mail_free(&program->temp_mail);
 	array_free(&program->seqs);
+	buffer_free(&program->cache_uids);
 
 	int ret = program->failed ? -1 : 0;
 	i_free(program);
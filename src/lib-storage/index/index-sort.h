@@ -2,6 +2,7 @@
 #define INDEX_SORT_H
 
 struct mail_search_sort_program;
+struct index_sort_cache;
 
 struct mail_search_sort_program *
 index_sort_program_init(struct mailbox_transaction_context *t,
@@ -11,8 +12,14 @@ int index_sort_program_deinit(struct mail_search_sort_program **program);
 void index_sort_list_add(struct mail_search_sort_program *program,
 			 struct mail *mail);
 void index_sort_list_finish(struct mail_search_sort_program *program);
+/* Only the first limit mails need to be returned in the sorted order. */
+void index_sort_program_set_limit(struct mail_search_sort_program *program,
+				  unsigned int limit);
 
 bool index_sort_list_next(struct mail_search_sort_program *program,
 			  uint32_t *seq_r);
 
+/* Free the mailbox's remembered sort order. */
+void index_sort_cache_free(struct index_sort_cache **cache);
+
 #endif
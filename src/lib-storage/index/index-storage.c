@@ -19,6 +19,7 @@
 #include "mail-search-build.h"
 #include "index-storage.h"
 #include "index-mail.h"
+#include "index-sort.h"
 #include "index-attachment.h"
 #include "index-thread-private.h"
 #include "index-mailbox-size.h"
@@ -381,6 +382,12 @@ int index_storage_mailbox_open(struct mailbox *box, bool move_to_memory)
 	box->mail_vsize_ext_id = mail_index_ext_register(box->index, "vsize", 0,
 							 sizeof(uint32_t),
 							 sizeof(uint32_t));
+	box->mail_rdate_ext_id = mail_index_ext_register(box->index, "rdate", 0,
+							 sizeof(uint32_t),
+							 sizeof(uint32_t));
+	box->mail_sdate_ext_id = mail_index_ext_register(box->index, "sdate", 0,
+							 sizeof(struct mail_sent_date),
+							 sizeof(uint32_t));
 
 	box->opened = TRUE;
 
@@ -442,10 +449,50 @@ int index_storage_mailbox_enable(struct mailbox *box,
 	return 0;
 }
 
+static void index_storage_mailbox_cache_field_stats_flush(struct mailbox *box)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(box);
+	const struct index_mail_cache_field_stats *stats;
+	const struct mail_cache_field *field;
+	unsigned int field_idx, count;
+
+	if (!array_is_created(&ibox->cache_field_stats))
+		return;
+
+	stats = array_get(&ibox->cache_field_stats, &count);
+	for (field_idx = 0; field_idx < count; field_idx++) {
+		if (stats[field_idx].hits == 0 &&
+		    stats[field_idx].misses == 0 &&
+		    stats[field_idx].misses_decision_no == 0 &&
+		    stats[field_idx].errors == 0)
+			continue;
+
+		field = mail_cache_register_get_field(box->cache, field_idx);
+		struct event_passthrough *e =
+			event_create_passthrough(box->event)->
+			set_name("mail_cache_field_lookups")->
+			add_str("field", field->name)->
+			add_str("decision",
+				mail_cache_decision_to_string(field->decision))->
+			add_int("hits", stats[field_idx].hits)->
+			add_int("misses", stats[field_idx].misses)->
+			add_int("misses_decision_no",
+				stats[field_idx].misses_decision_no)->
+			add_int("errors", stats[field_idx].errors);
+		e_debug(e->event(), "Cache field %s lookups: hits=%u misses=%u "
+			"misses_decision_no=%u errors=%u", field->name,
+			stats[field_idx].hits, stats[field_idx].misses,
+			stats[field_idx].misses_decision_no,
+			stats[field_idx].errors);
+	}
+	array_free(&ibox->cache_field_stats);
+}
+
 void index_storage_mailbox_close(struct mailbox *box)
 {
 	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(box);
 
+	index_storage_mailbox_cache_field_stats_flush(box);
 	mailbox_watch_remove_all(box);
 	i_stream_unref(&box->input);
 
@@ -461,6 +508,7 @@ void index_storage_mailbox_close(struct mailbox *box)
 
 	ibox->keyword_names = NULL;
 	i_free_and_null(ibox->cache_fields);
+	index_sort_cache_free(&ibox->sort_cache);
 
 	ibox->sync_last_check = 0;
 }
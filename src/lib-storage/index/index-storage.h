@@ -27,6 +27,17 @@ enum index_storage_list_change {
 	INDEX_STORAGE_LIST_CHANGE_MTIME_CHANGED
 };
 
+struct index_mail_cache_field_stats {
+	/* field was found from cache */
+	unsigned int hits;
+	/* field wasn't in cache, although its caching decision allows it */
+	unsigned int misses;
+	/* field wasn't in cache, because its caching decision is "no" */
+	unsigned int misses_decision_no;
+	/* cache lookup failed, e.g. because the cache is corrupted */
+	unsigned int errors;
+};
+
 struct index_mailbox_context {
 	union mailbox_module_context module_ctx;
 	enum mail_index_open_flags index_flags;
@@ -38,6 +49,10 @@ struct index_mailbox_context {
 	struct mail_cache_field *cache_fields;
 
 	struct mailbox_vsize_update *vsize_update;
+	struct index_sort_cache *sort_cache;
+	/* Cache lookup statistics indexed by cache field_idx. Sent as
+	   mail_cache_field_lookups events when the mailbox is closed. */
+	ARRAY(struct index_mail_cache_field_stats) cache_field_stats;
 
 	uint32_t recent_flags_prev_first_recent_uid;
 	uint32_t recent_flags_last_check_nextuid;
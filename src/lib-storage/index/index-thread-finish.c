@@ -610,6 +610,59 @@ mail_thread_iterate_children(struct mail_thread_iterate_context *parent_iter,
 	return child_iter;
 }
 
+static void thread_finish_context_unref(struct thread_finish_context **_ctx)
+{
+	struct thread_finish_context *ctx = *_ctx;
+
+	*_ctx = NULL;
+	if (--ctx->refcount > 0)
+		return;
+
+	array_free(&ctx->roots);
+	array_free(&ctx->shadow_nodes);
+	i_free(ctx);
+}
+
+void mail_thread_cache_finish_free(struct mail_thread_cache *cache)
+{
+	if (cache->finish_ctx != NULL)
+		thread_finish_context_unref(&cache->finish_ctx);
+}
+
+static struct thread_finish_context *
+mail_thread_finish_get(struct mail_thread_cache *cache,
+		       struct mail *tmp_mail, bool return_seqs,
+		       enum mail_thread_type thread_type)
+{
+	struct thread_finish_context *ctx = cache->finish_ctx;
+
+	if (ctx != NULL && cache->finish_thread_type == thread_type &&
+	    cache->finish_change_counter == cache->change_counter) {
+		/* Nothing has changed since the previous THREAD. The mail and
+		   return_seqs are used only while iterating, so they can be
+		   different this time. */
+		ctx->refcount++;
+		ctx->tmp_mail = tmp_mail;
+		ctx->return_seqs = return_seqs;
+		return ctx;
+	}
+	mail_thread_cache_finish_free(cache);
+
+	ctx = i_new(struct thread_finish_context, 1);
+	ctx->refcount = 1;
+	ctx->cache = cache;
+	ctx->tmp_mail = tmp_mail;
+	ctx->return_seqs = return_seqs;
+	mail_thread_finish(ctx, thread_type);
+
+	/* keep the finished tree for the following THREAD commands */
+	ctx->refcount++;
+	cache->finish_ctx = ctx;
+	cache->finish_thread_type = thread_type;
+	cache->finish_change_counter = cache->change_counter;
+	return ctx;
+}
+
 struct mail_thread_iterate_context *
 mail_thread_iterate_init_full(struct mail_thread_cache *cache,
 			      struct mail *tmp_mail,
@@ -617,18 +670,12 @@ mail_thread_iterate_init_full(struct mail_thread_cache *cache,
 			      bool return_seqs)
 {
 	struct mail_thread_iterate_context *iter;
-	struct thread_finish_context *ctx;
 
 	iter = i_new(struct mail_thread_iterate_context, 1);
-	ctx = iter->ctx = i_new(struct thread_finish_context, 1);
-	ctx->refcount = 1;
-	ctx->cache = cache;
-	ctx->tmp_mail = tmp_mail;
-	ctx->return_seqs = return_seqs;
 
 	struct event_reason *reason = event_reason_begin("mailbox:thread");
-	mail_thread_finish(ctx, thread_type);
-
+	iter->ctx = mail_thread_finish_get(cache, tmp_mail, return_seqs,
+					   thread_type);
 	mail_thread_iterate_fill_root(iter);
 	if (return_seqs)
 		nodes_change_uids_to_seqs(iter, TRUE);
@@ -671,11 +718,7 @@ int mail_thread_iterate_deinit(struct mail_thread_iterate_context **_iter)
 
 	*_iter = NULL;
 
-	if (--iter->ctx->refcount == 0) {
-		array_free(&iter->ctx->roots);
-		array_free(&iter->ctx->shadow_nodes);
-		i_free(iter->ctx);
-	}
+	thread_finish_context_unref(&iter->ctx);
 	array_free(&iter->children);
 	i_free(iter);
 	return 0;
@@ -153,6 +153,7 @@ void mail_thread_add(struct mail_thread_cache *cache,
 	i_assert(cache->last_uid <= msgid_map->uid);
 
 	cache->last_uid = msgid_map->uid;
+	cache->change_counter++;
 
 	idx = thread_msg_add(cache, msgid_map->uid, msgid_map->str_idx);
 	parent_idx = thread_link_references(cache, msgid_map->uid,
@@ -210,6 +211,7 @@ bool mail_thread_remove(struct mail_thread_cache *cache,
 		*msgid_map_idx += count;
 		return TRUE;
 	}
+	cache->change_counter++;
 
 	node = array_idx_modifiable(&cache->thread_nodes, idx);
 	if (node->expunge_rebuilds) {
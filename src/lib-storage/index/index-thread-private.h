@@ -56,6 +56,14 @@ struct mail_thread_cache {
 
 	/* indexed by mail_index_strmap_rec.str_idx */
 	ARRAY_TYPE(mail_thread_node) thread_nodes;
+	/* Incremented whenever thread_nodes change */
+	unsigned int change_counter;
+
+	/* The last finished thread tree. It's reused as long as
+	   thread_nodes haven't changed. */
+	struct thread_finish_context *finish_ctx;
+	enum mail_thread_type finish_thread_type;
+	unsigned int finish_change_counter;
 };
 
 static inline uint32_t crc32_str_nonzero(const char *str)
@@ -71,6 +79,8 @@ bool mail_thread_remove(struct mail_thread_cache *cache,
 			const struct mail_index_strmap_rec *msgid_map,
 			unsigned int *msgid_map_idx);
 
+void mail_thread_cache_finish_free(struct mail_thread_cache *cache);
+
 struct mail_thread_iterate_context *
 mail_thread_iterate_init_full(struct mail_thread_cache *cache,
 			      struct mail *tmp_mail,
@@ -7,9 +7,12 @@
 #include "index-sync-private.h"
 #include "index-pop3-uidl.h"
 #include "index-mail.h"
+#include "index-mailbox-size.h"
+#include "mailbox-notify-client.h"
 
 static void index_transaction_free(struct mailbox_transaction_context *t)
 {
+	mailbox_transaction_stats_add_total(t);
 	if (t->view_pvt != NULL)
 		mail_index_view_close(&t->view_pvt);
 	mail_cache_view_close(&t->cache_view);
@@ -91,9 +94,16 @@ index_transaction_index_commit(struct mail_index_transaction *index_trans,
 		}
 		index_mailbox_sync_pvt_deinit(&pvt_sync_ctx);
 	}
+	if (ret >= 0 && t->box->storage->set->mailbox_list_index &&
+	    (result_r->changes_mask & MAIL_INDEX_TRANSACTION_CHANGE_APPEND) != 0) {
+		/* keep the list index's vsize up to date for STATUS */
+		index_mailbox_vsize_update_saves(t->box);
+	}
 
 	if (ret < 0)
 		mail_index_set_error_nolog(t->box->index, mailbox_get_last_error(t->box, NULL));
+	else if (result_r->commit_size > 0)
+		mailbox_notify_client_publish(t->box);
 	index_transaction_free(t);
 	return ret;
 }
@@ -89,7 +89,15 @@ maildir_open_mail(struct maildir_mailbox *mbox, struct mail *mail,
 		return NULL;
 	}
 
-	input = i_stream_create_fd_autoclose(&ctx.fd, 0);
+	/* Maildir files aren't normally modified after they're saved, so
+	   they can be mmap()ed to avoid copying them to the istream buffer.
+	   However, if the file is still truncated (e.g. by another MUA, or by
+	   another NFS client) the process gets SIGBUS, so this is optional. */
+	if (mbox->storage->set->maildir_mmap_mails &&
+	    !mbox->box.storage->set->mmap_disable)
+		input = i_stream_create_mmap_autoclose(&ctx.fd, 0);
+	else
+		input = i_stream_create_fd_autoclose(&ctx.fd, 0);
 	if (input->stream_errno == EISDIR) {
 		i_stream_destroy(&input);
 		if (maildir_lose_unexpected_dir(&mbox->storage->storage,
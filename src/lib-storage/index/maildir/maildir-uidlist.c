@@ -1059,16 +1059,13 @@ int maildir_uidlist_lookup(struct maildir_uidlist *uidlist, uint32_t uid,
 	return 1;
 }
 
-const char *
-maildir_uidlist_lookup_ext(struct maildir_uidlist *uidlist, uint32_t uid,
-			   enum maildir_uidlist_rec_ext_key key)
+static const char *
+maildir_uidlist_rec_get_ext(const struct maildir_uidlist_rec *rec,
+			    enum maildir_uidlist_rec_ext_key key)
 {
-	struct maildir_uidlist_rec *rec;
 	const unsigned char *p;
-	int ret;
 
-	ret = maildir_uidlist_lookup_rec(uidlist, uid, &rec);
-	if (ret <= 0 || rec->extensions == NULL)
+	if (rec->extensions == NULL)
 		return NULL;
 
 	p = rec->extensions;
@@ -1082,6 +1079,19 @@ maildir_uidlist_lookup_ext(struct maildir_uidlist *uidlist, uint32_t uid,
 	return NULL;
 }
 
+const char *
+maildir_uidlist_lookup_ext(struct maildir_uidlist *uidlist, uint32_t uid,
+			   enum maildir_uidlist_rec_ext_key key)
+{
+	struct maildir_uidlist_rec *rec;
+	int ret;
+
+	ret = maildir_uidlist_lookup_rec(uidlist, uid, &rec);
+	if (ret <= 0)
+		return NULL;
+	return maildir_uidlist_rec_get_ext(rec, key);
+}
+
 uint32_t maildir_uidlist_get_uid_validity(struct maildir_uidlist *uidlist)
 {
 	return uidlist->uid_validity;
@@ -1197,6 +1207,11 @@ maildir_uidlist_set_ext_internal(struct maildir_uidlist *uidlist, uint32_t uid,
 		}
 	}
 
+	if (null_strcmp(maildir_uidlist_rec_get_ext(rec, key), value) == 0) {
+		/* unchanged - don't rewrite the whole uidlist for it */
+		return;
+	}
+
 	T_BEGIN {
 		maildir_uidlist_rec_set_ext(rec, uidlist->record_pool,
 					    key, value);
@@ -325,8 +325,9 @@ mail_duplicate_read_records(struct mail_duplicate_transaction *trans,
 		i_stream_skip(input, hdr.id_size + hdr.user_size);
 	}
 
-	if (hash_table_count(trans->hash) *
-	    COMPRESS_PERCENTAGE / 100 > change_count)
+	/* rewrite the file only once enough records have expired */
+	if (change_count > hash_table_count(trans->hash) *
+	    COMPRESS_PERCENTAGE / 100)
 		trans->changed = TRUE;
 	return 0;
 }
@@ -467,8 +468,9 @@ mail_duplicate_transaction_begin(struct mail_duplicate_db *db)
 	e_debug(trans->event, "Transaction begin; lock %s", db->path);
 
 	trans->path = p_strdup(pool, db->path);
-	hash_table_create(&trans->hash, pool, 0,
-			  mail_duplicate_hash, mail_duplicate_cmp);
+	hash_table_create_flags(&trans->hash, pool, 0,
+				mail_duplicate_hash, mail_duplicate_cmp,
+				HASH_TABLE_FLAG_OPEN_ADDRESSING);
 
 	mail_duplicate_read(trans);
 
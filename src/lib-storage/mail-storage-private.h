@@ -112,6 +112,13 @@ enum mail_storage_class_flags {
 	MAIL_STORAGE_CLASS_FLAG_SECONDARY_INDEX	= 0x800,
 };
 
+struct mail_binary_cache_part {
+	uoff_t physical_pos;
+	/* offsets in the decoded input */
+	uoff_t hdr_offset, body_offset, end_offset;
+	bool hdr_converted, body_converted;
+};
+
 struct mail_binary_cache {
 	struct timeout *to;
 	struct mailbox *box;
@@ -121,6 +128,10 @@ struct mail_binary_cache {
 	bool include_hdr;
 	struct istream *input;
 	uoff_t size;
+	/* If input contains the whole message, this has the MIME parts'
+	   offsets within it. This allows sending any of the parts without
+	   decoding them again. */
+	ARRAY(struct mail_binary_cache_part) parts;
 };
 
 struct mail_storage_error {
@@ -444,6 +455,10 @@ struct mailbox {
 	uint32_t box_name_hdr_ext_id;
 	uint32_t box_last_rename_stamp_ext_id;
 	uint32_t mail_vsize_ext_id;
+	/* Received date and sent date (struct mail_sent_date) stored directly
+	   in the index records, if mail_index_dates=yes. */
+	uint32_t mail_rdate_ext_id;
+	uint32_t mail_sdate_ext_id;
 
 	/* MAIL_RECENT flags handling */
 	ARRAY_TYPE(seq_range) recent_flags;
@@ -514,6 +529,9 @@ struct mailbox {
 	/* mailbox_alloc() opened a different mailbox than asked (e.g. virtual
 	   plugin opened the backend mailbox). */
 	bool mailbox_not_original:1;
+	/* Changes are notified by the mailbox-notify service instead of
+	   watching the mailbox files. */
+	bool notify_subscribed:1;
 };
 
 struct mail_vfuncs {
@@ -621,18 +639,6 @@ union mailbox_transaction_module_context {
 	struct mail_storage_module_register *reg;
 };
 
-struct mailbox_transaction_stats {
-	unsigned long open_lookup_count;
-	unsigned long stat_lookup_count;
-	unsigned long fstat_lookup_count;
-	/* number of files we've opened and read */
-	unsigned long files_read_count;
-	/* number of bytes we've had to read from files */
-	unsigned long long files_read_bytes;
-	/* number of cache lookup hits */
-	unsigned long cache_hit_count;
-};
-
 struct mail_save_private_changes {
 	/* first saved mail is 0, second is 1, etc. we'll map these to UIDs
 	   using struct mail_transaction_commit_changes. */
@@ -706,6 +712,8 @@ struct mail_search_context {
 
 	uint32_t seq;
 	uint32_t progress_cur, progress_max;
+	/* Only this many first results need to be sorted (0 = all) */
+	unsigned int sort_limit;
 
 	ARRAY(struct mail *) mails;
 	unsigned int unused_mail_idx;
@@ -912,6 +920,10 @@ void mail_storage_free_binary_cache(struct mail_storage *storage);
 enum mail_index_open_flags
 mail_storage_settings_to_index_flags(const struct mail_storage_settings *set);
 void mailbox_save_context_deinit(struct mail_save_context *ctx);
+/* Add the transaction's stats to the totals returned by
+   mailbox_transaction_get_total_stats(). This is called when the transaction
+   is freed, so the stats counted while committing are included. */
+void mailbox_transaction_stats_add_total(struct mailbox_transaction_context *t);
 
 /* Notify that a sync should be done. */
 void mailbox_sync_notify(struct mailbox *box, uint32_t uid,
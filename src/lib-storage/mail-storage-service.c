@@ -4,6 +4,7 @@
 #include "ioloop.h"
 #include "array.h"
 #include "base64.h"
+#include "hash.h"
 #include "hostpid.h"
 #include "module-dir.h"
 #include "restrict-access.h"
@@ -38,6 +39,8 @@
 /* If time moves backwards more than this, kill ourself instead of sleeping. */
 #define MAX_TIME_BACKWARDS_SLEEP_MSECS  (5*1000)
 #define MAX_NOWARN_FORWARD_MSECS        (10*1000)
+/* Maximum number of cached userdb replies */
+#define USERDB_CACHE_MAX_ENTRIES 1000
 
 struct mail_storage_service_privileges {
 	uid_t uid;
@@ -54,10 +57,21 @@ struct mail_storage_service_ctx {
 	struct auth_master_user_list_ctx *auth_list;
 	enum mail_storage_service_flags flags;
 
+	HASH_TABLE(const char *,
+		   struct mail_storage_service_userdb_cache_entry *) userdb_cache;
+
 	bool debug:1;
 	bool log_initialized:1;
 };
 
+struct mail_storage_service_userdb_cache_entry {
+	pool_t pool;
+	const char *key;
+	const char *username;
+	const char *const *fields;
+	time_t expire_time;
+};
+
 struct mail_storage_service_user {
 	pool_t pool;
 	int refcount;
@@ -224,14 +238,126 @@ user_reply_handle(struct mail_storage_service_user *user,
 	return 0;
 }
 
+static const char *
+userdb_cache_get_key(const char *username, const struct auth_user_info *info)
+{
+	string_t *key = t_str_new(128);
+
+	/* The remote port is left out, because it's different for each
+	   connection and userdb lookups don't practically depend on it. */
+	str_printfa(key, "%s\t%s\t%s\t%s\t%u\t%s", username, info->service,
+		    net_ip2addr(&info->local_ip), net_ip2addr(&info->remote_ip),
+		    info->local_port,
+		    info->local_name == NULL ? "" : info->local_name);
+	if (info->forward_fields != NULL) {
+		for (unsigned int i = 0; info->forward_fields[i] != NULL; i++) {
+			str_append_c(key, '\t');
+			str_append(key, info->forward_fields[i]);
+		}
+	}
+	return str_c(key);
+}
+
+static void
+userdb_cache_entry_free(struct mail_storage_service_userdb_cache_entry *entry)
+{
+	pool_unref(&entry->pool);
+}
+
+static void userdb_cache_free(struct mail_storage_service_ctx *ctx)
+{
+	struct hash_iterate_context *iter;
+	struct mail_storage_service_userdb_cache_entry *entry;
+	const char *key;
+
+	if (!hash_table_is_created(ctx->userdb_cache))
+		return;
+
+	iter = hash_table_iterate_init(ctx->userdb_cache);
+	while (hash_table_iterate(iter, ctx->userdb_cache, &key, &entry))
+		userdb_cache_entry_free(entry);
+	hash_table_iterate_deinit(&iter);
+	hash_table_destroy(&ctx->userdb_cache);
+}
+
+static void userdb_cache_drop_expired(struct mail_storage_service_ctx *ctx)
+{
+	struct hash_iterate_context *iter;
+	struct mail_storage_service_userdb_cache_entry *entry;
+	const char *key;
+
+	iter = hash_table_iterate_init(ctx->userdb_cache);
+	while (hash_table_iterate(iter, ctx->userdb_cache, &key, &entry)) {
+		if (entry->expire_time <= ioloop_time) {
+			hash_table_remove(ctx->userdb_cache, key);
+			userdb_cache_entry_free(entry);
+		}
+	}
+	hash_table_iterate_deinit(&iter);
+}
+
+static bool
+userdb_cache_lookup(struct mail_storage_service_ctx *ctx, const char *key,
+		    pool_t pool, const char **user, const char *const **fields_r)
+{
+	struct mail_storage_service_userdb_cache_entry *entry;
+
+	if (!hash_table_is_created(ctx->userdb_cache))
+		return FALSE;
+	entry = hash_table_lookup(ctx->userdb_cache, key);
+	if (entry == NULL)
+		return FALSE;
+	if (entry->expire_time <= ioloop_time) {
+		hash_table_remove(ctx->userdb_cache, entry->key);
+		userdb_cache_entry_free(entry);
+		return FALSE;
+	}
+	*user = p_strdup(pool, entry->username);
+	*fields_r = p_strarray_dup(pool, entry->fields);
+	return TRUE;
+}
+
+static void
+userdb_cache_add(struct mail_storage_service_ctx *ctx, const char *key,
+		 unsigned int ttl_secs, const char *username,
+		 const char *const *fields)
+{
+	struct mail_storage_service_userdb_cache_entry *entry;
+
+	if (!hash_table_is_created(ctx->userdb_cache)) {
+		hash_table_create(&ctx->userdb_cache, default_pool, 0,
+				  str_hash, strcmp);
+	} else if (hash_table_count(ctx->userdb_cache) >=
+		   USERDB_CACHE_MAX_ENTRIES) {
+		userdb_cache_drop_expired(ctx);
+		if (hash_table_count(ctx->userdb_cache) >=
+		    USERDB_CACHE_MAX_ENTRIES) {
+			/* all the entries are still valid - just start over */
+			userdb_cache_free(ctx);
+			hash_table_create(&ctx->userdb_cache, default_pool, 0,
+					  str_hash, strcmp);
+		}
+	}
+
+	pool_t pool = pool_alloconly_create("userdb cache entry", 512);
+	entry = p_new(pool, struct mail_storage_service_userdb_cache_entry, 1);
+	entry->pool = pool;
+	entry->key = p_strdup(pool, key);
+	entry->username = p_strdup(pool, username);
+	entry->fields = p_strarray_dup(pool, fields);
+	entry->expire_time = ioloop_time + ttl_secs;
+	hash_table_insert(ctx->userdb_cache, entry->key, entry);
+}
+
 static int
 service_auth_userdb_lookup(struct mail_storage_service_ctx *ctx,
 			   const struct mail_storage_service_input *input,
+			   const struct mail_user_settings *user_set,
 			   pool_t pool, struct event *event, const char **user,
 			   const char *const **fields_r, const char **error_r)
 {
 	struct auth_user_info info;
-	const char *new_username;
+	const char *new_username, *cache_key = NULL;
 	int ret;
 
 	i_zero(&info);
@@ -245,8 +371,20 @@ service_auth_userdb_lookup(struct mail_storage_service_ctx *ctx,
 	info.local_name = input->local_name;
 	info.debug = input->debug;
 
+	if (user_set->mail_userdb_cache_ttl > 0) {
+		cache_key = userdb_cache_get_key(*user, &info);
+		if (userdb_cache_lookup(ctx, cache_key, pool, user, fields_r)) {
+			e_debug(event, "userdb lookup found from cache");
+			return 1;
+		}
+	}
+
 	ret = auth_master_user_lookup(ctx->conn, *user, &info, pool,
 				      &new_username, fields_r);
+	if (ret > 0 && cache_key != NULL) {
+		userdb_cache_add(ctx, cache_key, user_set->mail_userdb_cache_ttl,
+				 new_username, *fields_r);
+	}
 	if (ret > 0) {
 		if (strcmp(*user, new_username) != 0) {
 			e_debug(event, "changed username to %s", new_username);
@@ -944,6 +1082,31 @@ mail_storage_service_load_modules(struct mail_storage_service_ctx *ctx,
 					   &mod_set, error_r);
 }
 
+void mail_storage_service_preload_modules(struct mail_storage_service_ctx *ctx)
+{
+	const struct mail_user_settings *user_set;
+	const char *error;
+
+	/* There's no user yet, so the %variables can't be expanded. They
+	   aren't used by the settings needed here. */
+	if (settings_get(master_service_get_event(ctx->service),
+			 &mail_user_setting_parser_info,
+			 SETTINGS_GET_FLAG_NO_CHECK |
+			 SETTINGS_GET_FLAG_NO_EXPAND,
+			 &user_set, &error) < 0) {
+		/* the same error is logged again at user lookup */
+		e_debug(master_service_get_event(ctx->service),
+			"Couldn't preload mail_plugins: %s", error);
+		return;
+	}
+	if (user_set->mail_plugins_preload &&
+	    mail_storage_service_load_modules(ctx, user_set, &error) < 0) {
+		e_debug(master_service_get_event(ctx->service),
+			"Couldn't preload mail_plugins: %s", error);
+	}
+	settings_free(user_set);
+}
+
 static int extra_field_key_cmp_p(const char *const *s1, const char *const *s2)
 {
 	const char *p1 = *s1, *p2 = *s2;
@@ -1136,7 +1299,7 @@ mail_storage_service_lookup_real(struct mail_storage_service_ctx *ctx,
 
 	if ((flags & MAIL_STORAGE_SERVICE_FLAG_USERDB_LOOKUP) != 0) {
 		ret = service_auth_userdb_lookup(
-			ctx, input, temp_pool, event,
+			ctx, input, user_set, temp_pool, event,
 			&username, &userdb_fields, error_r);
 		if (ret <= 0) {
 			settings_free(user_set);
@@ -1531,6 +1694,7 @@ void mail_storage_service_deinit(struct mail_storage_service_ctx **_ctx)
 
 	*_ctx = NULL;
 	(void)mail_storage_service_all_iter_deinit(ctx);
+	userdb_cache_free(ctx);
 	if (ctx->conn != NULL) {
 		if (mail_user_auth_master_conn == ctx->conn)
 			mail_user_auth_master_conn = NULL;
@@ -88,6 +88,10 @@ mail_storage_service_get_auth_conn(struct mail_storage_service_ctx *ctx);
 /* Set auth connection (instead of creating a new one automatically). */
 void mail_storage_service_set_auth_conn(struct mail_storage_service_ctx *ctx,
 					struct auth_master_connection *conn);
+/* Load the globally configured mail_plugins immediately if
+   mail_plugins_preload=yes, so the first user lookup in this process doesn't
+   need to do it. */
+void mail_storage_service_preload_modules(struct mail_storage_service_ctx *ctx);
 /* Read settings and initialize context to use them. Do nothing if service is
    already initialized. This is mainly necessary when calling _get_auth_conn()
    or _all_init(). */
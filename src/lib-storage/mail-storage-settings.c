@@ -53,6 +53,7 @@ static const struct setting_define mail_storage_setting_defines[] = {
 	DEF(UINT_HIDDEN, mail_cache_purge_delete_percentage),
 	DEF(UINT_HIDDEN, mail_cache_purge_continued_percentage),
 	DEF(UINT_HIDDEN, mail_cache_purge_header_continue_count),
+	DEF(BOOL, mail_cache_packed_message_parts),
 	DEF(SIZE_HIDDEN, mail_index_rewrite_min_log_bytes),
 	DEF(SIZE_HIDDEN, mail_index_rewrite_max_log_bytes),
 	DEF(SIZE_HIDDEN, mail_index_log_rotate_min_size),
@@ -60,11 +61,13 @@ static const struct setting_define mail_storage_setting_defines[] = {
 	DEF(TIME_HIDDEN, mail_index_log_rotate_min_age),
 	DEF(TIME_HIDDEN, mail_index_log2_max_age),
 	DEF(TIME_HIDDEN, mailbox_idle_check_interval),
+	DEF(BOOL, mailbox_notify_service),
 	DEF(UINT_HIDDEN, mail_max_keyword_length),
 	DEF(TIME, mail_max_lock_timeout),
 	DEF(TIME, mail_temp_scan_interval),
 	DEF(UINT, mail_vsize_bg_after_count),
 	DEF(UINT, mail_sort_max_read_count),
+	DEF(BOOL, mail_index_dates),
 	DEF(BOOL_HIDDEN, mail_save_crlf),
 	DEF(ENUM, mail_fsync),
 	DEF(BOOL, mmap_disable),
@@ -115,6 +118,7 @@ const struct mail_storage_settings mail_storage_default_settings = {
 	.mail_cache_purge_delete_percentage = 20,
 	.mail_cache_purge_continued_percentage = 200,
 	.mail_cache_purge_header_continue_count = 4,
+	.mail_cache_packed_message_parts = FALSE,
 	.mail_index_rewrite_min_log_bytes = 8 * 1024,
 	.mail_index_rewrite_max_log_bytes = 128 * 1024,
 	.mail_index_log_rotate_min_size = 32 * 1024,
@@ -122,11 +126,13 @@ const struct mail_storage_settings mail_storage_default_settings = {
 	.mail_index_log_rotate_min_age = 5 * 60,
 	.mail_index_log2_max_age = 3600 * 24 * 2,
 	.mailbox_idle_check_interval = 30,
+	.mailbox_notify_service = FALSE,
 	.mail_max_keyword_length = 50,
 	.mail_max_lock_timeout = 0,
 	.mail_temp_scan_interval = 7*24*60*60,
 	.mail_vsize_bg_after_count = 0,
 	.mail_sort_max_read_count = 0,
+	.mail_index_dates = FALSE,
 	.mail_save_crlf = FALSE,
 	.mail_fsync = "optimized:never:always",
 	.mmap_disable = FALSE,
@@ -265,6 +271,7 @@ const struct setting_parser_info mail_namespace_setting_parser_info = {
 static const struct setting_define mail_user_setting_defines[] = {
 	DEF(STR_HIDDEN, base_dir),
 	DEF(STR, auth_socket_path),
+	DEF(TIME, mail_userdb_cache_ttl),
 	DEF(STR_VARS, mail_temp_dir),
 	DEF(BOOL, mail_debug),
 
@@ -283,6 +290,7 @@ static const struct setting_define mail_user_setting_defines[] = {
 
 	DEF(STR, mail_plugins),
 	DEF(STR, mail_plugin_dir),
+	DEF(BOOL, mail_plugins_preload),
 
 	DEF(STR_VARS, mail_log_prefix),
 
@@ -295,6 +303,7 @@ static const struct setting_define mail_user_setting_defines[] = {
 static const struct mail_user_settings mail_user_default_settings = {
 	.base_dir = PKG_RUNDIR,
 	.auth_socket_path = "auth-userdb",
+	.mail_userdb_cache_ttl = 0,
 	.mail_temp_dir = "/tmp",
 	.mail_debug = FALSE,
 
@@ -313,6 +322,7 @@ static const struct mail_user_settings mail_user_default_settings = {
 
 	.mail_plugins = "",
 	.mail_plugin_dir = MODULEDIR,
+	.mail_plugins_preload = FALSE,
 
 	.mail_log_prefix = "%s(%u)<%{process:pid}><%{session}>: ",
 
@@ -35,6 +35,7 @@ struct mail_storage_settings {
 	unsigned int mail_cache_purge_delete_percentage;
 	unsigned int mail_cache_purge_continued_percentage;
 	unsigned int mail_cache_purge_header_continue_count;
+	bool mail_cache_packed_message_parts;
 	uoff_t mail_index_rewrite_min_log_bytes;
 	uoff_t mail_index_rewrite_max_log_bytes;
 	uoff_t mail_index_log_rotate_min_size;
@@ -42,11 +43,13 @@ struct mail_storage_settings {
 	unsigned int mail_index_log_rotate_min_age;
 	unsigned int mail_index_log2_max_age;
 	unsigned int mailbox_idle_check_interval;
+	bool mailbox_notify_service;
 	unsigned int mail_max_keyword_length;
 	unsigned int mail_max_lock_timeout;
 	unsigned int mail_temp_scan_interval;
 	unsigned int mail_vsize_bg_after_count;
 	unsigned int mail_sort_max_read_count;
+	bool mail_index_dates;
 	bool mail_save_crlf;
 	const char *mail_fsync;
 	bool mmap_disable;
@@ -122,6 +125,7 @@ struct mail_user_settings {
 	pool_t pool;
 	const char *base_dir;
 	const char *auth_socket_path;
+	unsigned int mail_userdb_cache_ttl;
 	const char *mail_temp_dir;
 	bool mail_debug;
 
@@ -138,6 +142,7 @@ struct mail_user_settings {
 
 	const char *mail_plugins;
 	const char *mail_plugin_dir;
+	bool mail_plugins_preload;
 
 	const char *mail_log_prefix;
 
@@ -34,6 +34,7 @@
 #include "mail-search-mime-register.h"
 #include "mailbox-search-result-private.h"
 #include "mailbox-guid-cache.h"
+#include "mailbox-notify-client.h"
 #include "mail-cache.h"
 #include "utc-mktime.h"
 
@@ -65,6 +66,7 @@ struct mail_storage_mail_index_module mail_storage_mail_index_module =
 ARRAY_TYPE(mail_storage) mail_storage_classes;
 
 static int mail_storage_init_refcount = 0;
+static struct mailbox_transaction_stats total_trans_stats;
 
 void mail_storage_init(void)
 {
@@ -94,6 +96,7 @@ void mail_storage_deinit(void)
 	mail_storage_hooks_deinit();
 	mailbox_lists_deinit();
 	mailbox_attributes_deinit();
+	mailbox_notify_client_deinit();
 	dsasl_clients_deinit();
 }
 
@@ -1732,6 +1735,22 @@ int mailbox_open_stream(struct mailbox *box, struct istream *input)
 	return mailbox_open_full(box, input);
 }
 
+void mailbox_prefetch_index(struct mailbox *box)
+{
+	const char *index_dir, *cache_dir;
+
+	if (box->opened || box->index_prefix == NULL ||
+	    (box->flags & MAILBOX_FLAG_NO_INDEX_FILES) != 0)
+		return;
+	if (mailbox_get_path_to(box, MAILBOX_LIST_PATH_TYPE_INDEX,
+				&index_dir) <= 0 ||
+	    mailbox_get_path_to(box, MAILBOX_LIST_PATH_TYPE_INDEX_CACHE,
+				&cache_dir) <= 0)
+		return;
+	mail_index_prefetch_files(box->event, index_dir, cache_dir,
+				  box->index_prefix);
+}
+
 int mailbox_enable(struct mailbox *box, enum mailbox_feature features)
 {
 	if (mailbox_verify_name(box) < 0)
@@ -1756,6 +1775,7 @@ void mail_storage_free_binary_cache(struct mail_storage *storage)
 
 	timeout_remove(&storage->binary_cache.to);
 	i_stream_destroy(&storage->binary_cache.input);
+	array_free(&storage->binary_cache.parts);
 	i_zero(&storage->binary_cache);
 }
 
@@ -1887,7 +1907,11 @@ int mailbox_create(struct mailbox *box, const struct mailbox_update *update,
 	mailbox_list_unlock(box->list);
 
 	if (ret == 0) {
-		box->list->guid_cache_updated = TRUE;
+		if (directory)
+			box->list->guid_cache_updated = TRUE;
+		else T_BEGIN {
+			mailbox_guid_cache_add_created(box);
+		} T_END;
 		if (!box->inbox_any) T_BEGIN {
 			mailbox_copy_cache_decisions_from_inbox(box);
 		} T_END;
@@ -2527,6 +2551,12 @@ mailbox_search_set_progress_hidden(struct mail_search_context *ctx, bool hidden)
 	ctx->progress_hidden = hidden;
 }
 
+void mailbox_search_set_sort_limit(struct mail_search_context *ctx,
+				   unsigned int limit)
+{
+	ctx->sort_limit = limit;
+}
+
 void mailbox_search_notify(struct mailbox *box, struct mail_search_context *ctx)
 {
 	if (ctx->search_start_time.tv_sec == 0) {
@@ -2648,9 +2678,31 @@ mailbox_transaction_begin(struct mailbox *box,
 		trans = box->v.transaction_begin(box, flags, reason);
 	} T_END;
 	i_assert(trans->reason != NULL);
+	if (box->storage->user->stats_enabled)
+		trans->stats_track = TRUE;
 	return trans;
 }
 
+void mailbox_transaction_stats_add_total(struct mailbox_transaction_context *t)
+{
+	const struct mailbox_transaction_stats *stats = &t->stats;
+
+	if (!t->box->storage->user->trans_stats_enabled)
+		return;
+	total_trans_stats.open_lookup_count += stats->open_lookup_count;
+	total_trans_stats.stat_lookup_count += stats->stat_lookup_count;
+	total_trans_stats.fstat_lookup_count += stats->fstat_lookup_count;
+	total_trans_stats.files_read_count += stats->files_read_count;
+	total_trans_stats.files_read_bytes += stats->files_read_bytes;
+	total_trans_stats.cache_hit_count += stats->cache_hit_count;
+	total_trans_stats.cache_miss_count += stats->cache_miss_count;
+}
+
+void mailbox_transaction_get_total_stats(struct mailbox_transaction_stats *stats_r)
+{
+	*stats_r = total_trans_stats;
+}
+
 int mailbox_transaction_commit(struct mailbox_transaction_context **t)
 {
 	struct mail_transaction_commit_changes changes;
@@ -333,6 +333,19 @@ struct mailbox_update {
 	const struct mailbox_cache_field *cache_updates;
 };
 
+struct mailbox_transaction_stats {
+	unsigned long open_lookup_count;
+	unsigned long stat_lookup_count;
+	unsigned long fstat_lookup_count;
+	/* number of files we've opened and read */
+	unsigned long files_read_count;
+	/* number of bytes we've had to read from files */
+	unsigned long long files_read_bytes;
+	/* number of cache lookup hits and misses */
+	unsigned long cache_hit_count;
+	unsigned long cache_miss_count;
+};
+
 struct mail_transaction_commit_changes {
 	/* Unreference the pool to free memory used by these changes. */
 	pool_t pool;
@@ -572,6 +585,10 @@ int mailbox_exists(struct mailbox *box, bool auto_boxes,
 int mailbox_open(struct mailbox *box);
 /* Open mailbox as read-only using the given stream as input. */
 int mailbox_open_stream(struct mailbox *box, struct istream *input);
+/* Ask the kernel to start reading the mailbox's index files into memory in
+   the background, so a following mailbox_open() is faster. Does nothing if
+   the mailbox is already opened or it has no index files. */
+void mailbox_prefetch_index(struct mailbox *box);
 /* Close mailbox. Same as if mailbox was freed and re-allocated. */
 void mailbox_close(struct mailbox *box);
 /* Close and free the mailbox. */
@@ -708,6 +725,10 @@ int mailbox_transaction_commit_get_changes(
 void mailbox_transaction_rollback(struct mailbox_transaction_context **t);
 /* Return the number of active transactions for the mailbox. */
 unsigned int mailbox_transaction_get_count(const struct mailbox *box) ATTR_PURE;
+/* Return the sum of the stats of all the transactions that have been
+   committed or rolled back by this process for users with
+   trans_stats_enabled. */
+void mailbox_transaction_get_total_stats(struct mailbox_transaction_stats *stats_r);
 /* When committing transaction, drop flag/keyword updates for messages whose
    modseq is larger than max_modseq. Save those messages' sequences to the
    given array. */
@@ -763,6 +784,13 @@ int mailbox_search_deinit(struct mail_search_context **ctx);
 void mailbox_search_set_progress_hidden(struct mail_search_context *ctx,
 					bool hidden);
 void mailbox_search_reset_progress_start(struct mail_search_context *ctx);
+/* Only the first limit results need to be returned in the sort order. The rest
+   are still returned, but in an unspecified order. This allows the sorting to
+   skip fully ordering results that the caller isn't going to use, e.g. with
+   ESORT PARTIAL. 0 means no limit, which is the default. Must be called before
+   the first mailbox_search_next*() call. */
+void mailbox_search_set_sort_limit(struct mail_search_context *ctx,
+				   unsigned int limit);
 /* Search the next message. Returns TRUE if found, FALSE if not. */
 bool mailbox_search_next(struct mail_search_context *ctx, struct mail **mail_r);
 /* Like mailbox_search_next(), but don't spend too much time searching.
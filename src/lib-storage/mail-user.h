@@ -104,8 +104,18 @@ struct mail_user {
 	bool admin:1;
 	/* Enable all statistics gathering */
 	bool stats_enabled:1;
+	/* Add all transactions' mailbox_transaction_stats to the totals of
+	   mailbox_transaction_get_total_stats(). This only sums up the
+	   counters that are always updated, so unlike stats_enabled it doesn't
+	   wrap mail streams (files_read_* are counted only for transactions
+	   tracking their stats) or enable fs timing. */
+	bool trans_stats_enabled:1;
 	/* This session was restored (e.g. IMAP unhibernation) */
 	bool session_restored:1;
+	/* Mails are being delivered to the user (LMTP). The user is
+	   deinitialized soon after the delivery, so plugins may postpone work
+	   triggered by the saved mails until then. */
+	bool delivering:1;
 };
 
 struct mail_user_module_register {
@@ -4,5 +4,8 @@
 int mailbox_guid_cache_find(struct mailbox_list *list, const guid_128_t guid,
 			    const char **vname_r);
 void mailbox_guid_cache_refresh(struct mailbox_list *list);
+/* Add a newly created mailbox to an existing GUID cache, so the next lookup
+   of an unknown GUID doesn't need to refresh the whole cache. */
+void mailbox_guid_cache_add_created(struct mailbox *box);
 
 #endif
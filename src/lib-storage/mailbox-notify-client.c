@@ -0,0 +1,356 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+/* Connection to the mailbox-notify service. All processes share the
+   mailbox changes through it, so IDLEing processes don't need to watch the
+   mailbox files themselves. Each process uses a single connection for all of
+   its subscriptions and publishes. */
+#include "lib.h"
+#include "array.h"
+#include "ioloop.h"
+#include "connection.h"
+#include "ostream.h"
+#include "guid.h"
+#include "mail-storage-private.h"
+#include "mailbox-notify-client.h"
+
+#define MAILBOX_NOTIFY_SOCKET_NAME "mailbox-notify"
+#define MAILBOX_NOTIFY_RECONNECT_MIN_SECS 5
+#define MAILBOX_NOTIFY_INBUF_SIZE 1024
+#define MAILBOX_NOTIFY_OUTBUF_SIZE (1024*64)
+
+struct mailbox_notify_subscription {
+	struct mailbox *box;
+	guid_128_t guid;
+	mailbox_notify_client_callback_t *callback;
+};
+
+struct mailbox_notify_client {
+	struct connection conn;
+
+	/* ioloop where the connection and reconnect timeout are */
+	struct ioloop *ioloop;
+	struct timeout *to_reconnect;
+	time_t last_connect;
+
+	ARRAY(struct mailbox_notify_subscription) subscriptions;
+	bool connected:1;
+};
+
+static struct connection_list *mailbox_notify_connections = NULL;
+static struct mailbox_notify_client *mailbox_notify_client = NULL;
+
+static void mailbox_notify_client_destroy(struct connection *conn);
+static int
+mailbox_notify_client_input_args(struct connection *conn,
+				 const char *const *args);
+
+static const struct connection_vfuncs mailbox_notify_client_vfuncs = {
+	.destroy = mailbox_notify_client_destroy,
+	.input_args = mailbox_notify_client_input_args,
+};
+
+static const struct connection_settings mailbox_notify_client_set = {
+	.service_name_in = "mailbox-notify-server",
+	.service_name_out = "mailbox-notify-client",
+	.major_version = 1,
+	.minor_version = 0,
+	.input_max_size = MAILBOX_NOTIFY_INBUF_SIZE,
+	.output_max_size = MAILBOX_NOTIFY_OUTBUF_SIZE,
+	.client = TRUE,
+};
+
+static int mailbox_get_notify_guid(struct mailbox *box, guid_128_t guid_r)
+{
+	struct mailbox_metadata metadata;
+
+	if (mailbox_get_metadata(box, MAILBOX_METADATA_GUID, &metadata) < 0)
+		return -1;
+	guid_128_copy(guid_r, metadata.guid);
+	return 0;
+}
+
+static bool
+mailbox_notify_client_has_guid(struct mailbox_notify_client *client,
+			       const guid_128_t guid, unsigned int count)
+{
+	const struct mailbox_notify_subscription *subs;
+	unsigned int i, subs_count;
+
+	/* check only the first count subscriptions */
+	subs = array_get(&client->subscriptions, &subs_count);
+	i_assert(count <= subs_count);
+	for (i = 0; i < count; i++) {
+		if (guid_128_equals(subs[i].guid, guid))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+mailbox_notify_client_reconnect(struct mailbox_notify_client *client);
+
+static void
+mailbox_notify_client_send(struct mailbox_notify_client *client,
+			   const char *cmd, const guid_128_t guid)
+{
+	const char *line;
+
+	if (!client->connected)
+		return;
+	line = t_strdup_printf("%s\t%s\n", cmd, guid_128_to_string(guid));
+	if (o_stream_get_buffer_avail_size(client->conn.output) < strlen(line)) {
+		/* The service isn't reading our output. Reconnect later, which
+		   also sends the subscriptions again. */
+		e_error(client->conn.event,
+			"Output buffer full - disconnecting");
+		mailbox_notify_client_destroy(&client->conn);
+		return;
+	}
+	o_stream_nsend_str(client->conn.output, line);
+}
+
+static void
+mailbox_notify_client_reconnect_later(struct mailbox_notify_client *client)
+{
+	if (client->to_reconnect != NULL)
+		return;
+	client->ioloop = current_ioloop;
+	client->to_reconnect = timeout_add(
+		MAILBOX_NOTIFY_RECONNECT_MIN_SECS * 1000,
+		mailbox_notify_client_reconnect, client);
+}
+
+static void mailbox_notify_client_connect(struct mailbox_notify_client *client)
+{
+	const struct mailbox_notify_subscription *subs;
+	unsigned int i, count;
+
+	if (client->connected || client->to_reconnect != NULL)
+		return;
+	if (ioloop_time - client->last_connect <
+	    MAILBOX_NOTIFY_RECONNECT_MIN_SECS) {
+		/* don't retry too often */
+		mailbox_notify_client_reconnect_later(client);
+		return;
+	}
+	client->last_connect = ioloop_time;
+
+	/* the connection's previous ioloop may already be destroyed */
+	connection_switch_ioloop(&client->conn);
+	if (connection_client_connect(&client->conn) < 0) {
+		e_error(client->conn.event, "net_connect_unix(%s) failed: %m",
+			client->conn.name);
+		mailbox_notify_client_reconnect_later(client);
+		return;
+	}
+	client->ioloop = current_ioloop;
+	client->connected = TRUE;
+
+	/* subscribe to the mailboxes again after reconnection */
+	subs = array_get(&client->subscriptions, &count);
+	for (i = 0; i < count; i++) {
+		if (!mailbox_notify_client_has_guid(client, subs[i].guid, i))
+			mailbox_notify_client_send(client, "SUB", subs[i].guid);
+	}
+}
+
+static void
+mailbox_notify_client_reconnect(struct mailbox_notify_client *client)
+{
+	timeout_remove(&client->to_reconnect);
+	if (array_not_empty(&client->subscriptions))
+		mailbox_notify_client_connect(client);
+}
+
+static void
+mailbox_notify_client_switch_ioloop(struct mailbox_notify_client *client)
+{
+	if (client->ioloop == current_ioloop)
+		return;
+	if (client->connected)
+		connection_switch_ioloop(&client->conn);
+	if (client->to_reconnect != NULL)
+		client->to_reconnect = io_loop_move_timeout(&client->to_reconnect);
+	client->ioloop = current_ioloop;
+}
+
+static void mailbox_notify_client_ioloop_destroyed(struct ioloop *ioloop)
+{
+	struct mailbox_notify_client *client = mailbox_notify_client;
+
+	/* The connection was created while a temporary ioloop was running.
+	   Disconnect instead of leaking it. The next use reconnects in the
+	   ioloop that is current then. */
+	if (client == NULL || client->ioloop != ioloop)
+		return;
+	if (client->connected) {
+		connection_disconnect(&client->conn);
+		client->connected = FALSE;
+	}
+	timeout_remove(&client->to_reconnect);
+	client->last_connect = 0;
+	client->ioloop = NULL;
+}
+
+static struct mailbox_notify_client *
+mailbox_notify_client_get(struct mailbox *box, bool subscribing)
+{
+	struct mailbox_notify_client *client = mailbox_notify_client;
+	const char *path;
+
+	if (client == NULL) {
+		mailbox_notify_connections =
+			connection_list_init(&mailbox_notify_client_set,
+					     &mailbox_notify_client_vfuncs);
+		path = t_strconcat(box->storage->user->set->base_dir,
+				   "/"MAILBOX_NOTIFY_SOCKET_NAME, NULL);
+		client = mailbox_notify_client =
+			i_new(struct mailbox_notify_client, 1);
+		i_array_init(&client->subscriptions, 4);
+		connection_init_client_unix(mailbox_notify_connections,
+					    &client->conn, path);
+		io_loop_add_destroy_callback(
+			mailbox_notify_client_ioloop_destroyed);
+	}
+	/* The subscriptions are done in the ioloop where the mailbox changes
+	   are waited for. Publishing can happen in temporary ioloops, so it
+	   doesn't move the connection. */
+	if (subscribing || client->ioloop == NULL)
+		mailbox_notify_client_switch_ioloop(client);
+	mailbox_notify_client_connect(client);
+	return client;
+}
+
+static int
+mailbox_notify_client_input_args(struct connection *conn,
+				 const char *const *args)
+{
+	struct mailbox_notify_client *client =
+		container_of(conn, struct mailbox_notify_client, conn);
+	const struct mailbox_notify_subscription *sub;
+	guid_128_t guid;
+
+	/* CHANGED <mailbox guid> */
+	if (args[0] == NULL || strcmp(args[0], "CHANGED") != 0 ||
+	    args[1] == NULL || guid_128_from_string(args[1], guid) < 0) {
+		e_error(conn->event, "Received invalid input");
+		return -1;
+	}
+
+	/* the callbacks only schedule the mailbox to be checked, so they
+	   don't modify the subscriptions */
+	array_foreach(&client->subscriptions, sub) {
+		if (guid_128_equals(sub->guid, guid))
+			sub->callback(sub->box);
+	}
+	return 1;
+}
+
+static void mailbox_notify_client_destroy(struct connection *conn)
+{
+	struct mailbox_notify_client *client =
+		container_of(conn, struct mailbox_notify_client, conn);
+
+	/* The subscribers still have the mailbox_idle_check_interval
+	   polling until the connection is restored. */
+	connection_disconnect(conn);
+	client->connected = FALSE;
+	if (array_not_empty(&client->subscriptions))
+		mailbox_notify_client_reconnect_later(client);
+}
+
+int mailbox_notify_client_subscribe(struct mailbox *box,
+				    mailbox_notify_client_callback_t *callback)
+{
+	struct mailbox_notify_client *client;
+	struct mailbox_notify_subscription *sub;
+	guid_128_t guid;
+
+	if (mailbox_get_notify_guid(box, guid) < 0)
+		return -1;
+
+	client = mailbox_notify_client_get(box, TRUE);
+	if (!mailbox_notify_client_has_guid(client, guid,
+			array_count(&client->subscriptions)))
+		mailbox_notify_client_send(client, "SUB", guid);
+
+	sub = array_append_space(&client->subscriptions);
+	sub->box = box;
+	guid_128_copy(sub->guid, guid);
+	sub->callback = callback;
+	return 0;
+}
+
+void mailbox_notify_client_unsubscribe(struct mailbox *box)
+{
+	struct mailbox_notify_client *client = mailbox_notify_client;
+	const struct mailbox_notify_subscription *subs;
+	unsigned int i, count;
+	guid_128_t guid;
+
+	if (client == NULL)
+		return;
+
+	subs = array_get(&client->subscriptions, &count);
+	for (i = 0; i < count; i++) {
+		if (subs[i].box == box)
+			break;
+	}
+	if (i == count)
+		return;
+
+	guid_128_copy(guid, subs[i].guid);
+	array_delete(&client->subscriptions, i, 1);
+	if (!mailbox_notify_client_has_guid(client, guid,
+			array_count(&client->subscriptions)))
+		mailbox_notify_client_send(client, "UNSUB", guid);
+}
+
+static void
+mailbox_notify_client_local_changed(struct mailbox_notify_client *client,
+				    struct mailbox *box, const guid_128_t guid)
+{
+	const struct mailbox_notify_subscription *sub;
+
+	/* The service doesn't send the changes back to the publishing
+	   connection, so notify the other mailboxes in this process directly.
+	   The callbacks only schedule the mailbox to be checked. */
+	array_foreach(&client->subscriptions, sub) {
+		if (sub->box != box && guid_128_equals(sub->guid, guid))
+			sub->callback(sub->box);
+	}
+}
+
+void mailbox_notify_client_publish(struct mailbox *box)
+{
+	struct mailbox_notify_client *client;
+	guid_128_t guid;
+
+	if (!box->storage->set->mailbox_notify_service)
+		return;
+	if (mailbox_get_notify_guid(box, guid) < 0) {
+		/* can't notify, the others will see the change with the
+		   mailbox_idle_check_interval polling */
+		return;
+	}
+	client = mailbox_notify_client_get(box, FALSE);
+	mailbox_notify_client_send(client, "CHANGED", guid);
+	mailbox_notify_client_local_changed(client, box, guid);
+}
+
+void mailbox_notify_client_deinit(void)
+{
+	struct mailbox_notify_client *client = mailbox_notify_client;
+
+	if (client == NULL)
+		return;
+	mailbox_notify_client = NULL;
+
+	i_assert(array_is_empty(&client->subscriptions));
+	io_loop_remove_destroy_callback(mailbox_notify_client_ioloop_destroyed);
+	timeout_remove(&client->to_reconnect);
+	connection_deinit(&client->conn);
+	array_free(&client->subscriptions);
+	i_free(client);
+	connection_list_deinit(&mailbox_notify_connections);
+}
@@ -0,0 +1,21 @@
+#ifndef MAILBOX_NOTIFY_CLIENT_H
+#define MAILBOX_NOTIFY_CLIENT_H
+
+struct mailbox;
+
+typedef void mailbox_notify_client_callback_t(struct mailbox *box);
+
+/* Subscribe to the mailbox's change notifications from the mailbox-notify
+   service. The callback is called whenever another process publishes a change
+   to the mailbox. Returns 0 on success, -1 if the mailbox GUID couldn't be
+   looked up. */
+int mailbox_notify_client_subscribe(struct mailbox *box,
+				    mailbox_notify_client_callback_t *callback);
+void mailbox_notify_client_unsubscribe(struct mailbox *box);
+/* Tell the processes subscribed to the mailbox that it has changed. Does
+   nothing unless mailbox_notify_service is enabled. */
+void mailbox_notify_client_publish(struct mailbox *box);
+
+void mailbox_notify_client_deinit(void);
+
+#endif
@@ -3,6 +3,7 @@
 #include "lib.h"
 #include "ioloop.h"
 #include "mail-storage-private.h"
+#include "mailbox-notify-client.h"
 #include "mailbox-watch.h"
 
 #include <unistd.h>
@@ -63,7 +64,15 @@ void mailbox_watch_add(struct mailbox *box, const char *path)
 
 	i_assert(set->mailbox_idle_check_interval > 0);
 
-	(void)io_add_notify(path, notify_callback, box, &io);
+	if (set->mailbox_notify_service && !box->notify_subscribed) {
+		if (mailbox_notify_client_subscribe(box, notify_callback) == 0)
+			box->notify_subscribed = TRUE;
+	}
+	/* The path is remembered even when the mailbox-notify service is
+	   used, so that the polling and mailbox_watch_extract_notify_fd()
+	   still work. */
+	if (!box->notify_subscribed)
+		(void)io_add_notify(path, notify_callback, box, &io);
 
 	file = i_new(struct mailbox_notify_file, 1);
 	file->path = i_strdup(path);
@@ -97,6 +106,10 @@ void mailbox_watch_remove_all(struct mailbox *box)
 		i_free(file);
 	}
 
+	if (box->notify_subscribed) {
+		mailbox_notify_client_unsubscribe(box);
+		box->notify_subscribed = FALSE;
+	}
 	timeout_remove(&box->to_notify_delay);
 	timeout_remove(&box->to_notify);
 }
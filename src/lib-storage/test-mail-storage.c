@@ -5,6 +5,8 @@
 #include "test-common.h"
 #include "master-service.h"
 #include "test-mail-storage-common.h"
+#include "mailbox-list-private.h"
+#include "mailbox-guid-cache.h"
 
 static const struct test_globals {
 	const char *str;
@@ -640,6 +642,44 @@ static void test_mailbox_list_mbox(void)
 	test_end();
 }
 
+static void test_mailbox_guid_cache_created(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mailbox_metadata metadata;
+	struct mailbox_list *list;
+	struct mailbox *box;
+	guid_128_t guid;
+	const char *vname;
+
+	test_begin("mailbox GUID cache with created mailboxes");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+	list = ctx->user->namespaces->list;
+
+	/* initialize the cache */
+	guid_128_generate(guid);
+	test_assert(mailbox_guid_cache_find(list, guid, &vname) == 0);
+	test_assert(vname == NULL);
+
+	box = mailbox_alloc(list, "created", 0);
+	test_assert(mailbox_create(box, NULL, FALSE) == 0);
+	test_assert(mailbox_get_metadata(box, MAILBOX_METADATA_GUID,
+					 &metadata) == 0);
+	mailbox_free(&box);
+
+	/* the created mailbox was added without a refresh */
+	test_assert(!list->guid_cache_updated);
+	test_assert(mailbox_guid_cache_find(list, metadata.guid, &vname) == 0);
+	test_assert_strcmp(vname, "created");
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
 static void test_mail_parse_human_timestamp(void)
 {
 	int ret;
@@ -720,6 +760,7 @@ int main(int argc, char **argv)
 		test_mailbox_verify_name,
 		test_mailbox_list_maildir,
 		test_mailbox_list_mbox,
+		test_mailbox_guid_cache_created,
 		test_mail_parse_human_timestamp,
 		test_mail_parse_human_timestamp_time_interval,
 		test_mail_parse_human_timestamp_fail,
@@ -2,10 +2,22 @@
 
 #include "lib.h"
 #include "test-common.h"
+#include "str.h"
+#include "ioloop.h"
 #include "istream.h"
+#include "ostream.h"
+#include "net.h"
+#include "guid.h"
+#include "lib-event-private.h"
+#include "event-filter.h"
 #include "master-service.h"
+#include "message-part.h"
 #include "message-size.h"
+#include "mail-search-build.h"
+#include "mail-thread.h"
 #include "test-mail-storage-common.h"
+#include "mail-duplicate.h"
+#include "mailbox-notify-client.h"
 
 static struct event *test_event;
 
@@ -724,6 +736,1080 @@ static void test_mail_get_last_internal_error(void)
 	test_mail_storage_deinit(&ctx);
 }
 
+static void test_mail_index_dates(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = (const char *const[]) {
+			"mail_index_dates=yes",
+			NULL
+		},
+	};
+	/* struct mail_sent_date */
+	struct {
+		uint32_t time;
+		int32_t timezone;
+	} sdate;
+	const uint32_t *rdate;
+	uint32_t received_date;
+	const void *data;
+	bool expunged;
+	time_t date;
+	int tz;
+
+	test_begin("mail index dates");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	test_mail_save(box,
+		       "Date: Thu, 01 Jan 2015 10:00:00 +0200\r\n"
+		       "\r\n"
+		       "test body\n");
+
+	/* received date is added while saving */
+	mail_index_lookup_ext(box->view, 1, box->mail_rdate_ext_id,
+			      &data, &expunged);
+	rdate = data;
+	test_assert(rdate != NULL && *rdate != 0);
+	received_date = rdate == NULL ? 0 : *rdate;
+
+	/* sent date is added when it's looked up */
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 1);
+	test_assert(mail_get_date(mail, &date, &tz) == 0);
+	test_assert(date == 1420099200 && tz == 120);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+
+	mail_index_lookup_ext(box->view, 1, box->mail_sdate_ext_id,
+			      &data, &expunged);
+	test_assert(data != NULL);
+	if (data != NULL) {
+		memcpy(&sdate, data, sizeof(sdate));
+		test_assert(sdate.time == 1420099200 && sdate.timezone == 120);
+	}
+
+	/* the dates are returned from the index */
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 1);
+	test_assert(mail_get_date(mail, &date, &tz) == 0);
+	test_assert(date == 1420099200 && tz == 120);
+	test_assert(mail_get_received_date(mail, &date) == 0);
+	test_assert(date == (time_t)received_date);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static const char *test_mail_sort_uids(struct mailbox *box)
+{
+	static const enum mail_sort_type sort_program[] = {
+		MAIL_SORT_SUBJECT, MAIL_SORT_END
+	};
+	struct mailbox_transaction_context *trans;
+	struct mail_search_context *search_ctx;
+	struct mail_search_args *search_args;
+	struct mail *mail;
+	string_t *str = t_str_new(32);
+
+	search_args = mail_search_build_init();
+	mail_search_build_add_all(search_args);
+
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	search_ctx = mailbox_search_init(trans, search_args, sort_program,
+					 0, NULL);
+	mail_search_args_unref(&search_args);
+	while (mailbox_search_next(search_ctx, &mail))
+		str_printfa(str, "%u ", mail->uid);
+	test_assert(mailbox_search_deinit(&search_ctx) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	return str_c(str);
+}
+
+static void test_mail_sort_cache(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+
+	test_begin("mail sort cache");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	test_mail_save(box, "Subject: b\r\n\r\nbody\n");
+	test_mail_save(box, "Subject: d\r\n\r\nbody\n");
+	test_mail_save(box, "Subject: a\r\n\r\nbody\n");
+	test_assert_strcmp(test_mail_sort_uids(box), "3 1 2 ");
+	/* the same result from the sort cache */
+	test_assert_strcmp(test_mail_sort_uids(box), "3 1 2 ");
+
+	/* new mails are merged into the cached order */
+	test_mail_save(box, "Subject: c\r\n\r\nbody\n");
+	test_mail_save(box, "Subject: e\r\n\r\nbody\n");
+	test_mail_save(box, "Subject: 0\r\n\r\nbody\n");
+	test_assert_strcmp(test_mail_sort_uids(box), "6 3 1 4 2 5 ");
+
+	/* expunged mails are dropped */
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 1);
+	mail_expunge(mail);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+	test_assert_strcmp(test_mail_sort_uids(box), "6 3 4 2 5 ");
+
+	test_mail_save(box, "Subject: b\r\n\r\nbody\n");
+	test_assert_strcmp(test_mail_sort_uids(box), "6 3 7 4 2 5 ");
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static const char *
+test_mail_sort_limit_uids(struct mailbox *box, unsigned int limit,
+			  unsigned int *count_r)
+{
+	static const enum mail_sort_type sort_program[] = {
+		MAIL_SORT_SIZE | MAIL_SORT_FLAG_REVERSE, MAIL_SORT_END
+	};
+	struct mailbox_transaction_context *trans;
+	struct mail_search_context *search_ctx;
+	struct mail_search_args *search_args;
+	struct mail *mail;
+	string_t *str = t_str_new(32);
+	unsigned int count = 0;
+
+	search_args = mail_search_build_init();
+	mail_search_build_add_all(search_args);
+
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	search_ctx = mailbox_search_init(trans, search_args, sort_program,
+					 0, NULL);
+	mailbox_search_set_sort_limit(search_ctx, limit);
+	mail_search_args_unref(&search_args);
+	while (mailbox_search_next(search_ctx, &mail)) {
+		if (limit == 0 || count < limit)
+			str_printfa(str, "%u ", mail->uid);
+		count++;
+	}
+	test_assert(mailbox_search_deinit(&search_ctx) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	*count_r = count;
+	return str_c(str);
+}
+
+static void test_mail_sort_limit(void)
+{
+	static const unsigned int body_sizes[] = { 5, 40, 12, 33, 1, 27, 8 };
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	unsigned int count;
+
+	test_begin("mail sort limit");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	for (unsigned int i = 0; i < N_ELEMENTS(body_sizes); i++) T_BEGIN {
+		string_t *input = t_str_new(64);
+
+		str_append(input, "Subject: size\r\n\r\n");
+		for (unsigned int j = 0; j < body_sizes[i]; j++)
+			str_append_c(input, 'x');
+		test_mail_save(box, str_c(input));
+	} T_END;
+
+	/* only the first mails are sorted, but all of them are returned */
+	test_assert_strcmp(test_mail_sort_limit_uids(box, 3, &count), "2 4 6 ");
+	test_assert(count == N_ELEMENTS(body_sizes));
+	test_assert_strcmp(test_mail_sort_limit_uids(box, 1, &count), "2 ");
+	test_assert(count == N_ELEMENTS(body_sizes));
+	/* the partially sorted result wasn't remembered by the sort cache */
+	test_assert_strcmp(test_mail_sort_limit_uids(box, 0, &count),
+			   "2 4 6 3 7 1 5 ");
+	test_assert_strcmp(test_mail_sort_limit_uids(box, 100, &count),
+			   "2 4 6 3 7 1 5 ");
+	test_assert(count == N_ELEMENTS(body_sizes));
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void
+test_mail_thread_append(string_t *str,
+			struct mail_thread_iterate_context *iter)
+{
+	const struct mail_thread_child_node *node;
+	struct mail_thread_iterate_context *child_iter;
+
+	while ((node = mail_thread_iterate_next(iter, &child_iter)) != NULL) {
+		str_printfa(str, "(%u", node->uid);
+		if (child_iter != NULL) {
+			test_mail_thread_append(str, child_iter);
+			test_assert(mail_thread_iterate_deinit(&child_iter) == 0);
+		}
+		str_append_c(str, ')');
+	}
+}
+
+static const char *
+test_mail_thread_str(struct mailbox *box, enum mail_thread_type thread_type,
+		     bool write_seqs)
+{
+	struct mail_thread_context *thread_ctx;
+	struct mail_thread_iterate_context *iter;
+	string_t *str = t_str_new(32);
+
+	test_assert(mail_thread_init(box, NULL, &thread_ctx) == 0);
+	iter = mail_thread_iterate_init(thread_ctx, thread_type, write_seqs);
+	test_mail_thread_append(str, iter);
+	test_assert(mail_thread_iterate_deinit(&iter) == 0);
+	mail_thread_deinit(&thread_ctx);
+	return str_c(str);
+}
+
+static void test_mail_thread_reuse(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+
+	test_begin("mail thread reuse finished tree");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	test_mail_save(box, "Message-ID: <a@test>\r\nSubject: first\r\n"
+		       "\r\nbody\n");
+	test_mail_save(box, "Message-ID: <b@test>\r\nIn-Reply-To: <a@test>\r\n"
+		       "Subject: Re: first\r\n\r\nbody\n");
+	test_mail_save(box, "Message-ID: <c@test>\r\nSubject: second\r\n"
+		       "\r\nbody\n");
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						FALSE), "(1(2))(3)");
+	/* the same result from the kept tree */
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						FALSE), "(1(2))(3)");
+	/* a different thread type isn't taken from the kept tree */
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFS,
+						FALSE), "(1(2))(3)");
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						FALSE), "(1(2))(3)");
+
+	/* new mails are seen */
+	test_mail_save(box, "Message-ID: <d@test>\r\nIn-Reply-To: <c@test>\r\n"
+		       "Subject: Re: second\r\n\r\nbody\n");
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						FALSE), "(1(2))(3(4))");
+
+	/* expunged mails are dropped */
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 2);
+	mail_expunge(mail);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						FALSE), "(1)(3(4))");
+	/* sequences can be returned from the kept tree */
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						TRUE), "(1)(2(3))");
+	test_assert_strcmp(test_mail_thread_str(box, MAIL_THREAD_REFERENCES,
+						FALSE), "(1)(3(4))");
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mail_save_nosync(struct mailbox *box, const char *mail_input)
+{
+	struct mailbox_transaction_context *trans;
+	struct istream *input;
+
+	input = i_stream_create_from_data(mail_input, strlen(mail_input));
+	trans = mailbox_transaction_begin(box,
+			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+	test_assert(test_mail_save_trans(trans, input) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	i_stream_unref(&input);
+}
+
+static void test_mail_vsize_list_index_saves(void)
+{
+	static const char mail1[] = "Subject: first\n\nbody\n";
+	static const char mail2[] = "Subject: second\n\nlonger body\n";
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = (const char *const[]) {
+			"mailbox_list_index=yes",
+			NULL
+		},
+	};
+	struct mailbox_metadata metadata;
+	struct mailbox_status status;
+	struct mailbox *box;
+	uoff_t vsize1;
+
+	test_begin("mail vsize list index saves");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	box = mailbox_alloc(ctx->user->namespaces->list, "Box", 0);
+	test_assert(mailbox_create(box, NULL, FALSE) == 0);
+	test_mail_save(box, mail1);
+	/* start tracking the vsize */
+	test_assert(mailbox_get_metadata(box, MAILBOX_METADATA_VIRTUAL_SIZE,
+					 &metadata) == 0);
+	vsize1 = metadata.virtual_size;
+	test_assert(vsize1 == strlen(mail1) + 3);
+	mailbox_free(&box);
+
+	/* deliver without syncing the mailbox afterwards */
+	box = mailbox_alloc(ctx->user->namespaces->list, "Box", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_mail_save_nosync(box, mail2);
+	mailbox_free(&box);
+
+	/* STATUS MESSAGES SIZE comes from the list index without opening
+	   the mailbox */
+	box = mailbox_alloc(ctx->user->namespaces->list, "Box", 0);
+	test_assert(mailbox_get_status(box, STATUS_MESSAGES, &status) == 0);
+	test_assert(status.messages == 2);
+	test_assert(mailbox_get_metadata(box, MAILBOX_METADATA_VIRTUAL_SIZE,
+					 &metadata) == 0);
+	test_assert(metadata.virtual_size == vsize1 + strlen(mail2) + 3);
+	test_assert(!box->opened);
+	mailbox_free(&box);
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static int test_mail_search_body(struct mailbox *box, const char *key,
+				 unsigned long *files_read_count_r)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail_search_context *search_ctx;
+	struct mail_search_args *search_args;
+	struct mail *mail;
+	int count = 0;
+
+	search_args = mail_search_build_init();
+	struct mail_search_arg *arg =
+		mail_search_build_add(search_args, SEARCH_BODY);
+	arg->value.str = p_strdup(search_args->pool, key);
+
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	trans->stats_track = TRUE;
+	search_ctx = mailbox_search_init(trans, search_args, NULL, 0, NULL);
+	mail_search_args_unref(&search_args);
+	while (mailbox_search_next(search_ctx, &mail))
+		count++;
+	test_assert(mailbox_search_deinit(&search_ctx) == 0);
+	*files_read_count_r = trans->stats.files_read_count;
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	return count;
+}
+
+static void test_mail_search_bloom(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = (const char *const[]) {
+			"mail_always_cache_fields=search.bloom",
+			NULL
+		},
+	};
+	unsigned long files_read_count;
+
+	test_begin("mail search bloom filter");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	test_mail_save(box, "Subject: 1\r\n\r\nfirst body\n");
+	test_mail_save(box, "Subject: 2\r\n\r\nsecond body\n");
+
+	/* the filter is added while saving, so non-matching mails are
+	   skipped without reading them */
+	test_assert(test_mail_search_body(box, "nonexistent",
+					  &files_read_count) == 0);
+	test_assert(files_read_count == 0);
+	test_assert(test_mail_search_body(box, "second body",
+					  &files_read_count) == 1);
+	test_assert(files_read_count == 1);
+	test_assert(test_mail_search_body(box, "body",
+					  &files_read_count) == 2);
+	/* too short keys can't use the filter */
+	test_assert(test_mail_search_body(box, "fi",
+					  &files_read_count) == 1);
+	test_assert(files_read_count == 2);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static struct {
+	unsigned int events;
+	intmax_t depth_max, hits, misses;
+} test_search_prefetch;
+
+static bool
+test_search_prefetch_callback(struct event *event,
+			      enum event_callback_type type,
+			      struct failure_context *ctx ATTR_UNUSED,
+			      const char *fmt ATTR_UNUSED,
+			      va_list args ATTR_UNUSED)
+{
+	const struct event_field *field;
+
+	if (type != EVENT_CALLBACK_TYPE_SEND ||
+	    null_strcmp(event->sending_name,
+			"mail_search_prefetch_finished") != 0)
+		return TRUE;
+
+	test_search_prefetch.events++;
+	field = event_find_field_nonrecursive(event, "prefetch_depth_max");
+	test_assert(field != NULL);
+	if (field != NULL)
+		test_search_prefetch.depth_max = field->value.intmax;
+	field = event_find_field_nonrecursive(event, "prefetch_hits");
+	test_assert(field != NULL);
+	if (field != NULL)
+		test_search_prefetch.hits = field->value.intmax;
+	field = event_find_field_nonrecursive(event, "prefetch_misses");
+	test_assert(field != NULL);
+	if (field != NULL)
+		test_search_prefetch.misses = field->value.intmax;
+	return FALSE;
+}
+
+static void test_mail_search_prefetch(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = (const char *const[]) {
+			"mail_prefetch_count=8",
+			NULL
+		},
+	};
+	struct mailbox_transaction_context *trans;
+	struct mail_search_context *search_ctx;
+	struct mail_search_args *search_args;
+	struct mail *mail;
+	const char *error;
+	string_t *uids = t_str_new(64), *expected = t_str_new(64);
+
+	test_begin("mail search prefetch");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct event_filter *filter = event_filter_create();
+	test_assert(event_filter_parse("event=mail_search_prefetch_finished",
+				       filter, &error) == 0);
+	event_set_global_debug_log_filter(filter);
+	event_filter_unref(&filter);
+	event_register_callback(test_search_prefetch_callback);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	for (unsigned int i = 1; i <= 20; i++) T_BEGIN {
+		test_mail_save(box, t_strdup_printf(
+			"Subject: prefetch\r\n\r\n%s body\n",
+			i % 3 == 0 ? "wanted" : "other"));
+		if (i % 3 == 0)
+			str_printfa(expected, "%u ", i);
+	} T_END;
+
+	search_args = mail_search_build_init();
+	struct mail_search_arg *arg =
+		mail_search_build_add(search_args, SEARCH_BODY);
+	arg->value.str = p_strdup(search_args->pool, "wanted");
+
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	search_ctx = mailbox_search_init(trans, search_args, NULL, 0, NULL);
+	mail_search_args_unref(&search_args);
+	while (mailbox_search_next(search_ctx, &mail))
+		str_printfa(uids, "%u ", mail->uid);
+	test_assert(mailbox_search_deinit(&search_ctx) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+
+	/* prefetching doesn't change the results or their order */
+	test_assert_strcmp(str_c(uids), str_c(expected));
+	/* every mail had to be read, and the window grew since all of them
+	   were waiting for their prefetch */
+	test_assert(test_search_prefetch.events == 1);
+	test_assert(test_search_prefetch.hits +
+		    test_search_prefetch.misses == 20);
+	test_assert(test_search_prefetch.hits > 0);
+	test_assert(test_search_prefetch.depth_max > 2 &&
+		    test_search_prefetch.depth_max <= 8 + 1);
+
+	event_unregister_callback(test_search_prefetch_callback);
+	event_unset_global_debug_log_filter();
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mail_transaction_total_stats(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mailbox_transaction_stats start, end;
+	struct istream *input;
+	const char *value;
+
+	test_begin("mailbox transaction total stats");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+	ctx->user->trans_stats_enabled = TRUE;
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_mail_save(box,
+		       "From: <test1@example.com>\r\n"
+		       "Subject: stats\r\n"
+		       "\r\n"
+		       "test body\n");
+
+	mailbox_transaction_get_total_stats(&start);
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 1);
+	test_assert(mail_get_first_header(mail, "Subject", &value) == 1);
+	test_assert(mail_get_stream(mail, NULL, NULL, &input) == 0);
+	while (i_stream_read(input) > 0)
+		i_stream_skip(input, i_stream_get_data_size(input));
+	mail_free(&mail);
+
+	/* stats are added to the totals only when the transaction ends */
+	mailbox_transaction_get_total_stats(&end);
+	test_assert(end.open_lookup_count == start.open_lookup_count);
+	mailbox_transaction_rollback(&trans);
+	mailbox_transaction_get_total_stats(&end);
+	test_assert(end.open_lookup_count > start.open_lookup_count);
+	test_assert(end.cache_hit_count + end.cache_miss_count >
+		    start.cache_hit_count + start.cache_miss_count);
+	/* mail streams aren't wrapped without stats_enabled */
+	test_assert(end.files_read_bytes == start.files_read_bytes);
+
+	/* with stats_enabled the read bytes are counted as well */
+	ctx->user->stats_enabled = TRUE;
+	mailbox_transaction_get_total_stats(&start);
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 1);
+	test_assert(mail_get_stream(mail, NULL, NULL, &input) == 0);
+	while (i_stream_read(input) > 0)
+		i_stream_skip(input, i_stream_get_data_size(input));
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	mailbox_transaction_get_total_stats(&end);
+	test_assert(end.files_read_count > start.files_read_count);
+	test_assert(end.files_read_bytes > start.files_read_bytes);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static unsigned int test_cache_field_lookups;
+
+static bool
+test_cache_field_lookups_callback(struct event *event,
+				  enum event_callback_type type,
+				  struct failure_context *ctx ATTR_UNUSED,
+				  const char *fmt ATTR_UNUSED,
+				  va_list args ATTR_UNUSED)
+{
+	const struct event_field *field;
+
+	if (type != EVENT_CALLBACK_TYPE_SEND ||
+	    null_strcmp(event->sending_name, "mail_cache_field_lookups") != 0)
+		return TRUE;
+
+	field = event_find_field_nonrecursive(event, "field");
+	test_assert(field != NULL &&
+		    field->value_type == EVENT_FIELD_VALUE_TYPE_STR);
+	if (field == NULL || strcmp(field->value.str, "hdr.Subject") != 0)
+		return FALSE;
+
+	/* The first lookup is done while the field's decision is still "no".
+	   Parsing the header adds it to cache, which changes the decision to
+	   "temp" for the second lookup. */
+	test_cache_field_lookups++;
+	field = event_find_field_nonrecursive(event, "decision");
+	test_assert(field != NULL && strcmp(field->value.str, "temp") == 0);
+	field = event_find_field_nonrecursive(event, "hits");
+	test_assert(field != NULL && field->value.intmax == 0);
+	field = event_find_field_nonrecursive(event, "misses_decision_no");
+	test_assert(field != NULL && field->value.intmax == 1);
+	field = event_find_field_nonrecursive(event, "misses");
+	test_assert(field != NULL && field->value.intmax == 1);
+	return FALSE;
+}
+
+static void test_mail_cache_field_lookups_event(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	const char *value, *error;
+
+	test_begin("mail_cache_field_lookups event");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct event_filter *filter = event_filter_create();
+	test_assert(event_filter_parse("event=mail_cache_field_lookups",
+				       filter, &error) == 0);
+	event_set_global_debug_log_filter(filter);
+	event_filter_unref(&filter);
+	event_register_callback(test_cache_field_lookups_callback);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_mail_save(box,
+		       "From: <test1@example.com>\r\n"
+		       "Subject: lookups\r\n"
+		       "\r\n"
+		       "test body\n");
+	test_mail_save(box,
+		       "From: <test2@example.com>\r\n"
+		       "Subject: lookups\r\n"
+		       "\r\n"
+		       "test body\n");
+
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	for (uint32_t seq = 1; seq <= 2; seq++) {
+		mail_set_seq(mail, seq);
+		test_assert(mail_get_first_header(mail, "Subject", &value) == 1);
+	}
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+
+	/* the event is sent when the mailbox is closed */
+	test_assert(test_cache_field_lookups == 0);
+	mailbox_free(&box);
+	test_assert(test_cache_field_lookups == 1);
+
+	event_unregister_callback(test_cache_field_lookups_callback);
+	event_unset_global_debug_log_filter();
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mail_duplicate_check_no_rewrite(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mail_duplicate_db *db;
+	struct mail_duplicate_transaction *trans;
+	const char *home, *path, *id;
+	struct stat st1, st2;
+	unsigned int i;
+
+	test_begin("mail duplicate check without changes");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+	test_assert(mail_user_get_home(ctx->user, &home) > 0);
+	path = t_strconcat(home, "/.dovecot.test-duplicate", NULL);
+
+	db = mail_duplicate_db_init(ctx->user, "test-duplicate");
+	trans = mail_duplicate_transaction_begin(db);
+	for (i = 0; i < 20; i++) {
+		id = t_strdup_printf("id%u", i);
+		test_assert(mail_duplicate_check(trans, id, strlen(id), "user") ==
+			    MAIL_DUPLICATE_CHECK_RESULT_NOT_FOUND);
+		mail_duplicate_mark(trans, id, strlen(id), "user",
+				    ioloop_time + 3600);
+	}
+	mail_duplicate_transaction_commit(&trans);
+	test_assert(stat(path, &st1) == 0);
+
+	/* only checking IDs doesn't rewrite the file */
+	trans = mail_duplicate_transaction_begin(db);
+	test_assert(mail_duplicate_check(trans, "id1", 3, "user") ==
+		    MAIL_DUPLICATE_CHECK_RESULT_EXISTS);
+	mail_duplicate_transaction_commit(&trans);
+	test_assert(stat(path, &st2) == 0);
+	test_assert(st1.st_ino == st2.st_ino);
+
+	mail_duplicate_db_deinit(&db);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static const char *
+test_mail_binary_read(struct mail *mail, const struct message_part *part,
+		      bool include_hdr)
+{
+	struct mail_binary_properties bprops;
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+	string_t *str = t_str_new(256);
+
+	if (mail_get_binary_stream(mail, part, include_hdr,
+				   &bprops, &input) < 0)
+		i_fatal("mail_get_binary_stream() failed: %s",
+			mailbox_get_last_internal_error(mail->box, NULL));
+	while (i_stream_read_more(input, &data, &size) > 0) {
+		str_append_data(str, data, size);
+		i_stream_skip(input, size);
+	}
+	test_assert(input->stream_errno == 0);
+	test_assert(bprops.size == str_len(str));
+	i_stream_unref(&input);
+	return str_c(str);
+}
+
+static void test_mail_binary_parts_from_cache(void)
+{
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mail_binary_properties bprops;
+	struct message_part *parts, *part;
+	const char *expected[3];
+	unsigned int i, count;
+
+	test_begin("mail binary parts from cached message");
+	struct test_mail_storage_ctx *ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_mail_save(box,
+		"From: <test1@example.com>\n"
+		"Content-Type: multipart/mixed; boundary=\"b\"\n"
+		"\n"
+		"--b\n"
+		"Content-Type: text/plain\n"
+		"\n"
+		"plain text\n"
+		"--b\n"
+		"Content-Type: application/octet-stream\n"
+		"Content-Transfer-Encoding: base64\n"
+		"\n"
+		"aGVsbG8gd29ybGQ=\n"
+		"--b\n"
+		"Content-Type: message/rfc822\n"
+		"\n"
+		"Subject: attached\n"
+		"Content-Transfer-Encoding: quoted-printable\n"
+		"\n"
+		"foo=3Dbar\n"
+		"--b--\n");
+
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 1);
+	test_assert(mail_get_parts(mail, &parts) == 0);
+
+	/* decode each part separately */
+	count = 0;
+	for (part = parts->children; part != NULL; part = part->next) {
+		i_assert(count < N_ELEMENTS(expected));
+		expected[count++] = test_mail_binary_read(mail, part, FALSE);
+	}
+	test_assert(count == 3);
+	test_assert_strcmp(expected[1], "hello world");
+
+	/* BINARY.SIZE decodes and caches the whole message. The parts are
+	   then sent from it without decoding them again. */
+	mail_storage_free_binary_cache(box->storage);
+	test_assert(mail_get_binary_properties(mail, parts->children, FALSE,
+					       &bprops) == 0);
+	test_assert(array_is_created(&box->storage->binary_cache.parts));
+	i = 0;
+	for (part = parts->children; part != NULL; part = part->next, i++) {
+		test_assert_strcmp_idx(test_mail_binary_read(mail, part, FALSE),
+				       expected[i], i);
+		test_assert_idx(box->storage->binary_cache.orig_physical_pos == 0, i);
+	}
+
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+/* A mailbox-notify service that records the lines it receives */
+struct test_notify_server {
+	int listen_fd, fd;
+	struct io *io_listen, *io;
+	struct istream *input;
+	struct ostream *output;
+	string_t *received;
+	unsigned int connect_count;
+};
+
+static struct mailbox *test_notify_boxes[2];
+static unsigned int test_notify_changes[2];
+static bool test_notify_timed_out;
+
+static void test_notify_server_disconnect(struct test_notify_server *server)
+{
+	io_remove(&server->io);
+	i_stream_destroy(&server->input);
+	o_stream_destroy(&server->output);
+	i_close_fd(&server->fd);
+}
+
+static void test_notify_server_input(struct test_notify_server *server)
+{
+	const char *line;
+
+	while ((line = i_stream_read_next_line(server->input)) != NULL) {
+		str_append(server->received, line);
+		str_append_c(server->received, '\n');
+	}
+	if (server->input->eof)
+		test_notify_server_disconnect(server);
+	io_loop_stop(current_ioloop);
+}
+
+static void test_notify_server_accept(struct test_notify_server *server)
+{
+	int fd;
+
+	fd = net_accept(server->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+	test_assert(server->fd == -1);
+	if (server->fd != -1)
+		test_notify_server_disconnect(server);
+	fd_set_nonblock(fd, TRUE);
+	server->connect_count++;
+	server->fd = fd;
+	server->input = i_stream_create_fd(fd, SIZE_MAX);
+	server->output = o_stream_create_fd(fd, SIZE_MAX);
+	o_stream_set_no_error_handling(server->output, TRUE);
+	o_stream_nsend_str(server->output,
+			   "VERSION\tmailbox-notify-server\t1\t0\n");
+	server->io = io_add(fd, IO_READ, test_notify_server_input, server);
+}
+
+static void test_notify_callback(struct mailbox *box)
+{
+	for (unsigned int i = 0; i < N_ELEMENTS(test_notify_boxes); i++) {
+		if (test_notify_boxes[i] == box)
+			test_notify_changes[i]++;
+	}
+	io_loop_stop(current_ioloop);
+}
+
+static void test_notify_timeout(void *context ATTR_UNUSED)
+{
+	test_notify_timed_out = TRUE;
+	io_loop_stop(current_ioloop);
+}
+
+static void test_notify_server_wait_line(struct test_notify_server *server,
+					 const char *line)
+{
+	struct timeout *to;
+
+	/* the client reconnects after 5 seconds */
+	to = timeout_add(10*1000, test_notify_timeout, NULL);
+	while (strstr(str_c(server->received), line) == NULL &&
+	       !test_notify_timed_out)
+		io_loop_run(current_ioloop);
+	timeout_remove(&to);
+	test_assert(!test_notify_timed_out);
+	str_truncate(server->received, 0);
+}
+
+static void
+test_notify_server_wait_disconnect(struct test_notify_server *server)
+{
+	struct timeout *to;
+
+	to = timeout_add(10*1000, test_notify_timeout, NULL);
+	while (server->fd != -1 && !test_notify_timed_out)
+		io_loop_run(current_ioloop);
+	timeout_remove(&to);
+	test_assert(server->fd == -1);
+}
+
+static void test_notify_wait_changes(unsigned int idx, unsigned int count)
+{
+	struct timeout *to;
+
+	to = timeout_add(10*1000, test_notify_timeout, NULL);
+	while (test_notify_changes[idx] < count && !test_notify_timed_out)
+		io_loop_run(current_ioloop);
+	timeout_remove(&to);
+	test_assert(test_notify_changes[idx] == count);
+}
+
+static void test_mailbox_notify_client(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_notify_server server = {
+		.listen_fd = -1,
+		.fd = -1,
+	};
+	struct mailbox_metadata metadata;
+	const char *path, *changed_line, *sub_line;
+
+	test_begin("mailbox notify client");
+	ctx = test_mail_storage_init();
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = (const char *const[]) {
+			"mailbox_notify_service=yes",
+			t_strconcat("base_dir=", ctx->home_root, NULL),
+			NULL
+		},
+	};
+	test_mail_storage_init_user(ctx, &set);
+	test_notify_timed_out = FALSE;
+	i_zero(&test_notify_changes);
+
+	path = t_strconcat(ctx->home_root, "mailbox-notify", NULL);
+	server.listen_fd = net_listen_unix(path, 16);
+	if (server.listen_fd == -1)
+		i_fatal("net_listen_unix(%s) failed: %m", path);
+	server.io_listen = io_add(server.listen_fd, IO_READ,
+				  test_notify_server_accept, &server);
+	server.received = str_new(default_pool, 128);
+
+	struct mailbox *box1 =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	struct mailbox *box2 =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box1) == 0);
+	test_assert(mailbox_open(box2) == 0);
+	test_notify_boxes[0] = box1;
+	test_notify_boxes[1] = box2;
+	test_assert(mailbox_get_metadata(box1, MAILBOX_METADATA_GUID,
+					 &metadata) == 0);
+	sub_line = t_strdup_printf("SUB\t%s\n",
+				   guid_128_to_string(metadata.guid));
+	changed_line = t_strdup_printf("CHANGED\t%s\n",
+				       guid_128_to_string(metadata.guid));
+
+	/* subscribing connects to the service */
+	test_assert(mailbox_notify_client_subscribe(box1,
+						    test_notify_callback) == 0);
+	test_notify_server_wait_line(&server, sub_line);
+	test_assert(server.connect_count == 1);
+
+	/* changes from other processes */
+	o_stream_nsend_str(server.output, changed_line);
+	test_notify_wait_changes(0, 1);
+
+	/* changes in the same process are seen by the other mailboxes
+	   without going through the service */
+	test_mail_save(box2, "Subject: notify\n\nbody\n");
+	test_assert(test_notify_changes[0] == 2);
+	test_assert(test_notify_changes[1] == 0);
+	test_notify_server_wait_line(&server, changed_line);
+
+	/* the client reconnects and subscribes again after the service
+	   disconnects */
+	test_notify_server_disconnect(&server);
+	test_notify_server_wait_line(&server, sub_line);
+	test_assert(server.connect_count == 2);
+
+	/* subscribing in another ioloop moves the connection there */
+	struct ioloop *ioloop = io_loop_create();
+	test_assert(mailbox_notify_client_subscribe(box2,
+						    test_notify_callback) == 0);
+	o_stream_nsend_str(server.output, changed_line);
+	test_notify_wait_changes(0, 3);
+	test_notify_wait_changes(1, 1);
+	/* destroying the ioloop disconnects */
+	io_loop_destroy(&ioloop);
+	test_notify_server_wait_disconnect(&server);
+
+	/* the next use reconnects in the current ioloop */
+	mailbox_notify_client_publish(box1);
+	test_assert(test_notify_changes[1] == 2);
+	test_notify_server_wait_line(&server, changed_line);
+	test_assert(server.connect_count == 3);
+
+	mailbox_notify_client_unsubscribe(box1);
+	mailbox_notify_client_unsubscribe(box2);
+	mailbox_free(&box1);
+	mailbox_free(&box2);
+	test_notify_server_disconnect(&server);
+	io_remove(&server.io_listen);
+	i_close_fd(&server.listen_fd);
+	str_free(&server.received);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
 int main(int argc, char **argv)
 {
 	void (*const tests[])(void) = {
@@ -734,6 +1820,18 @@ int main(int argc, char **argv)
 		test_mail_set_critical,
 		test_mail_set_critical_different_mailboxes,
 		test_mail_get_last_internal_error,
+		test_mail_index_dates,
+		test_mail_sort_cache,
+		test_mail_sort_limit,
+		test_mail_thread_reuse,
+		test_mail_vsize_list_index_saves,
+		test_mail_search_bloom,
+		test_mail_search_prefetch,
+		test_mail_transaction_total_stats,
+		test_mail_cache_field_lookups_event,
+		test_mail_duplicate_check_no_rewrite,
+		test_mail_binary_parts_from_cache,
+		test_mailbox_notify_client,
 		NULL
 	};
 	int ret;
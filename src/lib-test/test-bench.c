@@ -0,0 +1,67 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "time-util.h"
+#include "wildcard-match.h"
+#include "test-bench.h"
+
+#include <stdio.h>
+
+static char *test_bench_filter = NULL;
+
+void test_bench_set_filter(const char *mask)
+{
+	i_free(test_bench_filter);
+	test_bench_filter = i_strdup(mask);
+}
+
+void test_bench_print_header(void)
+{
+	printf("%-40s %12s %10s %10s\n", "benchmark", "ns/op", "MB/s", "ds/op");
+}
+
+#undef test_bench_run
+void test_bench_run(const char *name, unsigned int iterations,
+		    size_t bytes_per_op, test_bench_callback_t *callback,
+		    void *context)
+{
+	unsigned int i, warmup = iterations / 10 + 1;
+	size_t ds_used = 0;
+	uint64_t ts_0, ts_1;
+
+	i_assert(iterations > 0);
+
+	if (test_bench_filter != NULL &&
+	    !wildcard_match(name, test_bench_filter))
+		return;
+
+	for (i = 0; i < warmup; i++) T_BEGIN {
+		callback(context);
+	} T_END;
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < iterations; i++) T_BEGIN {
+		callback(context);
+	} T_END;
+	ts_1 = i_nanoseconds();
+
+	/* Measure the data stack usage separately, so it doesn't affect the
+	   timing. */
+	T_BEGIN {
+		size_t ds_start = data_stack_get_used_size();
+		callback(context);
+		ds_used = data_stack_get_used_size() - ds_start;
+	} T_END;
+
+	double nsecs_per_op = (double)(ts_1 - ts_0) / iterations;
+	if (bytes_per_op == 0) {
+		printf("%-40s %12.1lf %10s %10zu\n", name, nsecs_per_op, "-",
+		       ds_used);
+	} else {
+		double mb_per_sec = ((double)bytes_per_op / (1024.0*1024.0)) /
+			(nsecs_per_op / 1000000000.0);
+		printf("%-40s %12.1lf %10.2lf %10zu\n", name, nsecs_per_op,
+		       mb_per_sec, ds_used);
+	}
+	fflush(stdout);
+}
@@ -0,0 +1,26 @@
+#ifndef TEST_BENCH_H
+#define TEST_BENCH_H
+
+typedef void test_bench_callback_t(void *context);
+
+/* Run only the benchmarks whose name matches the wildcard mask.
+   NULL runs all of them. */
+void test_bench_set_filter(const char *mask);
+
+/* Print the header line for test_bench_run() results. */
+void test_bench_print_header(void);
+
+/* Call the callback iterations times after a short warmup, and print the
+   average time per call. If bytes_per_op is non-zero, the throughput is
+   printed as well. Each call runs in its own data stack frame. The data stack
+   memory that one call leaves allocated in its frame is printed as ds/op. */
+void test_bench_run(const char *name, unsigned int iterations,
+		    size_t bytes_per_op, test_bench_callback_t *callback,
+		    void *context);
+#define test_bench_run(name, iterations, bytes_per_op, callback, context) \
+	test_bench_run(name, iterations, bytes_per_op, \
+		(test_bench_callback_t *)callback, \
+		(TRUE ? context : \
+		 CALLBACK_TYPECHECK(callback, void (*)(typeof(context)))))
+
+#endif
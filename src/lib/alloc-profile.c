@@ -0,0 +1,94 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "hash.h"
+#include "alloc-profile.h"
+
+bool alloc_profiling = FALSE;
+
+/* The profiles are allocated with malloc() instead of data stack or pools,
+   because they're updated while allocating from them. */
+static HASH_TABLE(const char *, struct alloc_profile *)
+	alloc_profiles[ALLOC_PROFILE_TYPE_POOL + 1];
+static ARRAY(struct alloc_profile *) alloc_profile_list;
+
+void alloc_profile_set_enabled(bool enable)
+{
+	alloc_profiling = enable;
+	if (enable && !array_is_created(&alloc_profile_list)) {
+		for (unsigned int i = 0; i < N_ELEMENTS(alloc_profiles); i++) {
+			hash_table_create(&alloc_profiles[i], default_pool, 0,
+					  str_hash, strcmp);
+		}
+		i_array_init(&alloc_profile_list, 64);
+	}
+}
+
+struct alloc_profile *
+alloc_profile_get(enum alloc_profile_type type, const char *name)
+{
+	struct alloc_profile *profile;
+
+	i_assert(array_is_created(&alloc_profile_list));
+
+	profile = hash_table_lookup(alloc_profiles[type], name);
+	if (profile == NULL) {
+		size_t name_size = strlen(name) + 1;
+
+		/* allocate the name together with the profile */
+		profile = i_malloc(sizeof(*profile) + name_size);
+		memcpy(profile + 1, name, name_size);
+		profile->type = type;
+		profile->name = (const char *)(profile + 1);
+		hash_table_insert(alloc_profiles[type], profile->name, profile);
+		array_push_back(&alloc_profile_list, &profile);
+	}
+	return profile;
+}
+
+void alloc_profile_add(struct alloc_profile *profile, size_t bytes)
+{
+	profile->count++;
+	profile->bytes += bytes;
+	if (profile->max_bytes < bytes)
+		profile->max_bytes = bytes;
+}
+
+const struct alloc_profile *const *alloc_profile_get_all(unsigned int *count_r)
+{
+	if (!array_is_created(&alloc_profile_list)) {
+		*count_r = 0;
+		return NULL;
+	}
+	return (const void *)array_get(&alloc_profile_list, count_r);
+}
+
+void alloc_profile_reset(void)
+{
+	struct alloc_profile *profile;
+
+	if (!array_is_created(&alloc_profile_list))
+		return;
+	array_foreach_elem(&alloc_profile_list, profile) {
+		profile->count = 0;
+		profile->bytes = 0;
+		profile->max_bytes = 0;
+		profile->grow_count = 0;
+	}
+}
+
+void alloc_profile_deinit(void)
+{
+	struct alloc_profile *profile;
+
+	alloc_profiling = FALSE;
+	if (!array_is_created(&alloc_profile_list))
+		return;
+
+	for (unsigned int i = 0; i < N_ELEMENTS(alloc_profiles); i++)
+		hash_table_destroy(&alloc_profiles[i]);
+	array_foreach_elem(&alloc_profile_list, profile)
+		i_free(profile);
+	array_free(&alloc_profile_list);
+}
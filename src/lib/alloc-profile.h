@@ -0,0 +1,50 @@
+#ifndef ALLOC_PROFILE_H
+#define ALLOC_PROFILE_H
+
+/* Optional profiling of data stack frames and memory pools. When enabled,
+   data stack usage is grouped by the t_push() marker and alloconly pool
+   allocations are grouped by the pool name. */
+
+enum alloc_profile_type {
+	/* Data stack frames, grouped by the frame marker */
+	ALLOC_PROFILE_TYPE_DATA_STACK,
+	/* Alloconly pools, grouped by the pool name */
+	ALLOC_PROFILE_TYPE_POOL,
+};
+
+struct alloc_profile {
+	enum alloc_profile_type type;
+	const char *name;
+
+	/* Number of popped data stack frames / created pools */
+	uint64_t count;
+	/* Data stack bytes allocated by the frames at t_pop() time / bytes
+	   allocated for the pools' memory blocks */
+	uint64_t bytes;
+	/* Largest single frame / pool memory block */
+	uint64_t max_bytes;
+	/* Number of times the data stack had to get a new block / a pool had
+	   to allocate a new memory block after the initial one */
+	uint64_t grow_count;
+};
+
+extern bool alloc_profiling;
+
+/* Enable/disable allocation profiling. Disabling doesn't free the existing
+   measurements, because pools may still refer to them. */
+void alloc_profile_set_enabled(bool enable);
+/* Returns the profile for the given type and name, creating it if needed. */
+struct alloc_profile *
+alloc_profile_get(enum alloc_profile_type type, const char *name);
+/* Add a new data stack frame / pool allocation to the profile. */
+void alloc_profile_add(struct alloc_profile *profile, size_t bytes);
+
+/* Returns the measurements so far. The array is valid until the next
+   allocation. */
+const struct alloc_profile *const *alloc_profile_get_all(unsigned int *count_r);
+/* Reset the measurements to zero. */
+void alloc_profile_reset(void);
+
+void alloc_profile_deinit(void);
+
+#endif
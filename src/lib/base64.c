@@ -4,6 +4,188 @@
 #include "base64.h"
 #include "buffer.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+/* SSSE3 isn't part of the x86-64 baseline, so it's enabled only for the
+   functions that need it and selected at runtime. */
+#  define HAVE_BASE64_SSSE3
+#  include <tmmintrin.h>
+#  define BASE64_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+/*
+ * SIMD helpers
+ */
+
+#ifdef HAVE_BASE64_SSSE3
+static bool base64_have_ssse3(void)
+{
+	static int have_ssse3 = -1;
+
+	if (unlikely(have_ssse3 < 0))
+		have_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+	return have_ssse3 == 1;
+}
+
+/* Encode 12 byte blocks of input into 16 characters using the algorithm by
+   Wojciech Muła. Only schemes whose first 62 characters are the standard
+   "A-Za-z0-9" are supported. Returns the number of input bytes consumed. */
+static BASE64_SSSE3 size_t
+base64_encode_ssse3(const struct base64_scheme *b64,
+		    const unsigned char *src, size_t src_size,
+		    unsigned char **_dst, const unsigned char *dst_end)
+{
+	const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+					  4, 5, 3, 4, 1, 2, 0, 1);
+	/* offsets to add to the 6-bit values for each character range */
+	const __m128i lut = _mm_setr_epi8(
+		'A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		(char)(b64->encmap[62] - 62), (char)(b64->encmap[63] - 63),
+		0, 0);
+	unsigned char *dst = *_dst;
+	size_t src_pos = 0;
+
+	/* 16 bytes are loaded, but only 12 are used */
+	while (src_size - src_pos >= 16 && dst_end - dst >= 16) {
+		__m128i in, t0, t1, t2, t3, idx, mask;
+
+		in = _mm_loadu_si128((const void *)(src + src_pos));
+		in = _mm_shuffle_epi8(in, shuf);
+		t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+		t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+		t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		in = _mm_or_si128(t1, t3);
+
+		/* 0..25 -> 0, 26..51 -> 1, 52..61 -> 2..11, 62 -> 12,
+		   63 -> 13 */
+		idx = _mm_subs_epu8(in, _mm_set1_epi8(51));
+		mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+		idx = _mm_sub_epi8(idx, mask);
+		in = _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx));
+
+		_mm_storeu_si128((void *)dst, in);
+		src_pos += 12;
+		dst += 16;
+	}
+	*_dst = dst;
+	return src_pos;
+}
+
+/* Decode 16 character blocks of the standard base64 scheme into 12 bytes.
+   Stops at the first block containing anything else than base64
+   characters, so whitespace, padding and errors are left to the caller.
+   Returns the number of input bytes consumed. */
+static BASE64_SSSE3 size_t
+base64_decode_ssse3(const unsigned char *src, size_t src_size,
+		    unsigned char *dst, size_t dst_size)
+{
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+	const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+					   14, 13, 12, -1, -1, -1, -1);
+	size_t src_pos = 0, dst_pos = 0;
+
+	while (src_size - src_pos >= 16 && dst_size - dst_pos >= 16) {
+		__m128i in, hi_nibbles, lo_nibbles, hi, lo, roll;
+
+		in = _mm_loadu_si128((const void *)(src + src_pos));
+		hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+		lo_nibbles = _mm_and_si128(in, mask_2f);
+		hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+						     _mm_setzero_si128())) != 0)
+			break;
+
+		/* translate characters to 6-bit values */
+		roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(
+			_mm_cmpeq_epi8(in, mask_2f), hi_nibbles));
+		in = _mm_add_epi8(in, roll);
+
+		/* pack 4x 6-bit values into 3 bytes */
+		in = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+		in = _mm_madd_epi16(in, _mm_set1_epi32(0x00011000));
+		in = _mm_shuffle_epi8(in, shuf);
+
+		/* 16 bytes are written, but only 12 are used */
+		_mm_storeu_si128((void *)(dst + dst_pos), in);
+		src_pos += 16;
+		dst_pos += 12;
+	}
+	return src_pos;
+}
+
+/* Same as base64_decode_ssse3(), but for any scheme whose first 62
+   characters are the standard "A-Za-z0-9", such as the URL-safe scheme.
+   The characters are classified with range comparisons, which is a bit
+   slower than the lookup tables specific to the standard scheme. */
+static BASE64_SSSE3 size_t
+base64_decode_ranges_ssse3(const struct base64_scheme *b64,
+			   const unsigned char *src, size_t src_size,
+			   unsigned char *dst, size_t dst_size)
+{
+	const __m128i c62 = _mm_set1_epi8((char)b64->encmap[62]);
+	const __m128i c63 = _mm_set1_epi8((char)b64->encmap[63]);
+	const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+					   14, 13, 12, -1, -1, -1, -1);
+	size_t src_pos = 0, dst_pos = 0;
+
+	while (src_size - src_pos >= 16 && dst_size - dst_pos >= 16) {
+		__m128i in, upper, lower, digit, is62, is63, roll;
+
+		in = _mm_loadu_si128((const void *)(src + src_pos));
+		/* bytes >= 0x80 are negative, so they fall outside all of
+		   the ranges */
+		upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)),
+				      _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+		lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)),
+				      _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+		digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)),
+				      _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+		is62 = _mm_cmpeq_epi8(in, c62);
+		is63 = _mm_cmpeq_epi8(in, c63);
+		if (_mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(upper, lower),
+			_mm_or_si128(digit, _mm_or_si128(is62, is63)))) != 0xffff)
+			break;
+
+		/* translate characters to 6-bit values */
+		roll = _mm_or_si128(
+			_mm_or_si128(
+				_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+				_mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+			_mm_or_si128(
+				_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+				_mm_or_si128(
+					_mm_and_si128(is62, _mm_sub_epi8(
+						_mm_set1_epi8(62), c62)),
+					_mm_and_si128(is63, _mm_sub_epi8(
+						_mm_set1_epi8(63), c63)))));
+		in = _mm_add_epi8(in, roll);
+
+		/* pack 4x 6-bit values into 3 bytes */
+		in = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+		in = _mm_madd_epi16(in, _mm_set1_epi32(0x00011000));
+		in = _mm_shuffle_epi8(in, shuf);
+
+		/* 16 bytes are written, but only 12 are used */
+		_mm_storeu_si128((void *)(dst + dst_pos), in);
+		src_pos += 16;
+		dst_pos += 12;
+	}
+	return src_pos;
+}
+#endif
+
 /*
  * Low-level Base64 encoder
  */
@@ -307,6 +489,13 @@ base64_encode_more_data(struct base64_encoder *enc,
 	}
 
 	/* Convert the bulk */
+#ifdef HAVE_BASE64_SSSE3
+	if ((b64 == &base64_scheme || b64 == &base64url_scheme) &&
+	    base64_have_ssse3()) {
+		src_pos += base64_encode_ssse3(b64, src_c + src_pos,
+					       src_size - src_pos, &ptr, end);
+	}
+#endif
 	for (; src_size - src_pos > 2 && &ptr[3] < end;
 	     src_pos += 3, ptr += 4) {
 		ptr[0] = b64enc[src_c[src_pos] >> 2];
@@ -584,6 +773,9 @@ bool base64_encode_finish(struct base64_encoder *enc, buffer_t *dest)
  * Low-level Base64 decoder
  */
 
+/* Maximum number of input characters decoded at a time by the bulk code */
+#define BASE64_DECODE_BULK_SIZE 1024
+
 #define IS_EMPTY(c) \
 	((c) == '\n' || (c) == '\r' || (c) == ' ' || (c) == '\t')
 
@@ -599,6 +791,60 @@ base64_skip_whitespace(struct base64_decoder *dec, const unsigned char *src_c,
 		(*src_pos)++;
 }
 
+/* Decode as many complete 4-character groups as possible, stopping at the
+   first character that isn't in the alphabet. Returns the number of input
+   bytes consumed. */
+static size_t
+base64_decode_bulk(const struct base64_scheme *b64,
+		   const unsigned char *src, size_t src_size,
+		   buffer_t *dest, size_t *dst_avail)
+{
+	/* decode via a small stack buffer so that the destination buffer
+	   doesn't need to be grown more than necessary. Leave some extra
+	   space for the SIMD code's full-width stores. */
+	unsigned char dst[BASE64_DECODE_BULK_SIZE / 4 * 3 + 4];
+	size_t total = 0, src_pos, dst_pos, dst_size;
+
+	do {
+		src_pos = 0;
+		dst_pos = 0;
+		dst_size = I_MIN(sizeof(dst), *dst_avail);
+#ifdef HAVE_BASE64_SSSE3
+		if (b64 == &base64_scheme && base64_have_ssse3()) {
+			src_pos = base64_decode_ssse3(src, src_size,
+						      dst, dst_size);
+			dst_pos = src_pos / 4 * 3;
+		} else if (b64 == &base64url_scheme && base64_have_ssse3()) {
+			src_pos = base64_decode_ranges_ssse3(b64, src, src_size,
+							     dst, dst_size);
+			dst_pos = src_pos / 4 * 3;
+		}
+#endif
+		while (src_size - src_pos >= 4 && dst_size - dst_pos >= 3) {
+			unsigned char d0 = b64->decmap[src[src_pos]];
+			unsigned char d1 = b64->decmap[src[src_pos + 1]];
+			unsigned char d2 = b64->decmap[src[src_pos + 2]];
+			unsigned char d3 = b64->decmap[src[src_pos + 3]];
+
+			/* valid characters decode to 0..63, others to 0xff */
+			if (((d0 | d1 | d2 | d3) & 0xc0) != 0)
+				break;
+			dst[dst_pos] = (d0 << 2) | (d1 >> 4);
+			dst[dst_pos + 1] = ((d1 & 0x0f) << 4) | (d2 >> 2);
+			dst[dst_pos + 2] = ((d2 & 0x03) << 6) | d3;
+			src_pos += 4;
+			dst_pos += 3;
+		}
+		buffer_append(dest, dst, dst_pos);
+		*dst_avail -= dst_pos;
+		src += src_pos;
+		src_size -= src_pos;
+		total += src_pos;
+		/* continue only if the stack buffer became full */
+	} while (dst_size - dst_pos < 3 && src_size >= 4 && *dst_avail >= 3);
+	return total;
+}
+
 int base64_decode_more(struct base64_decoder *dec,
 		       const void *src, size_t src_size, size_t *src_pos_r,
 		       buffer_t *dest)
@@ -661,6 +907,16 @@ int base64_decode_more(struct base64_decoder *dec,
 	}
 
 	for (; !dec->seen_padding && src_pos < src_size; src_pos++) {
+		if (dec->sub_pos == 0 && src_size - src_pos >= 4 &&
+		    dst_avail >= 3 && b64->decmap[src_c[src_pos]] != 0xff) {
+			/* fast path for the bulk of the data */
+			src_pos += base64_decode_bulk(b64, src_c + src_pos,
+						      src_size - src_pos,
+						      dest, &dst_avail);
+			if (src_pos == src_size)
+				break;
+		}
+
 		unsigned char in = src_c[src_pos];
 		unsigned char dm = b64->decmap[in];
 
@@ -0,0 +1,113 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "event-filter.h"
+#include "strnum.h"
+#include "time-util.h"
+
+#include <stdio.h>
+
+/**
+ * Measures the cost of creating events and sending debug events through
+ * e_debug() when a stats-like debug send filter is set, but nothing is
+ * interested in the event. The filter has one query per metric, each of them
+ * for a specific event name. Compares this to a filter where one of the
+ * queries uses a wildcard event name, which can't skip the events by name.
+ */
+
+#define METRIC_COUNT 50
+
+static struct event_filter *bench_filter_create(bool wildcard)
+{
+	struct event_filter *filter = event_filter_create();
+	const char *error;
+
+	for (unsigned int i = 0; i < METRIC_COUNT; i++) {
+		const char *query = t_strdup_printf(
+			"event=metric_event_%u AND user=user%u", i, i);
+		if (event_filter_parse(query, filter, &error) < 0)
+			i_fatal("event_filter_parse(%s) failed: %s", query, error);
+	}
+	if (wildcard &&
+	    event_filter_parse("event=other_event_* AND user=nobody",
+			       filter, &error) < 0)
+		i_fatal("event_filter_parse() failed: %s", error);
+	return filter;
+}
+
+static void bench_event_create(unsigned int count)
+{
+	struct event *event;
+	uint64_t ts_0, ts_1;
+
+	ts_0 = i_nanoseconds();
+	for (unsigned int i = 0; i < count; i++) {
+		event = event_create(NULL);
+		event_set_name(event, "bench_event");
+		event_unref(&event);
+	}
+	ts_1 = i_nanoseconds();
+	printf("%-36s %5"PRIu64" ns/event\n", "event_create() + event_unref()",
+	       (ts_1 - ts_0) / count);
+}
+
+static void
+bench_e_debug(const char *name, struct event_filter *filter,
+	      unsigned int count)
+{
+	struct event *event;
+	uint64_t ts_0, ts_1;
+
+	if (filter != NULL)
+		event_set_global_debug_send_filter(filter);
+	ts_0 = i_nanoseconds();
+	for (unsigned int i = 0; i < count; i++) {
+		event = event_create(NULL);
+		event_add_str(event, "user", "user1");
+		e_debug(event_create_passthrough(event)->
+			set_name("bench_event")->event(), "debug %u", i);
+		event_unref(&event);
+	}
+	ts_1 = i_nanoseconds();
+	event_unset_global_debug_send_filter();
+	printf("%-36s %5"PRIu64" ns/event\n", name, (ts_1 - ts_0) / count);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [event_count]\n", prog);
+	fprintf(stderr, "Runs with 1000000 events if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	struct event_filter *filter;
+	unsigned int count = 1000000;
+
+	lib_init();
+
+	if (argc == 2) {
+		if (str_to_uint(argv[1], &count) < 0 || count == 0) {
+			fprintf(stderr, "Invalid parameters\n");
+			print_usage(argv[0]);
+		}
+	} else if (argc != 1) {
+		print_usage(argv[0]);
+	}
+
+	printf("%u events, %u metrics\n\n", count, METRIC_COUNT);
+	bench_event_create(count);
+	bench_e_debug("e_debug() without filters", NULL, count);
+
+	filter = bench_filter_create(FALSE);
+	bench_e_debug("e_debug() with event name filters", filter, count);
+	event_filter_unref(&filter);
+
+	filter = bench_filter_create(TRUE);
+	bench_e_debug("e_debug() with a wildcard name filter", filter, count);
+	event_filter_unref(&filter);
+
+	lib_deinit();
+	return 0;
+}
@@ -0,0 +1,234 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "hash.h"
+#include "crc32.h"
+#include "primes.h"
+#include "str.h"
+#include "strnum.h"
+#include "time-util.h"
+
+#include <stdio.h>
+
+/**
+ * Compares the speed of the hash and CRC32 functions against the previous
+ * bytewise implementations. Also counts how many hash table buckets are used
+ * for typical keys, which shows how well the hashes work with
+ * hash_table_create(), and compares the chained and open addressing hash
+ * tables.
+ */
+
+static const uint32_t crc32_poly = 0xedb88320;
+
+/* the previous str_hash() and crc32_data() implementations */
+static unsigned int ATTR_NO_SANITIZE_INTEGER
+old_mem_hash(const void *p, unsigned int size)
+{
+	const unsigned char *s = p;
+	unsigned int i, g, h = 0;
+
+	for (i = 0; i < size; i++) {
+		h = (h << 4) + *s;
+		if ((g = h & 0xf0000000UL) != 0) {
+			h = h ^ (g >> 24);
+			h = h ^ g;
+		}
+		s++;
+	}
+	return h;
+}
+
+static unsigned int old_str_hash(const char *p)
+{
+	return old_mem_hash(p, strlen(p));
+}
+
+static uint32_t old_crc32tab[256];
+
+static void old_crc32_init(void)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t crc = i;
+
+		for (unsigned int j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) != 0 ? crc32_poly : 0);
+		old_crc32tab[i] = crc;
+	}
+}
+
+static uint32_t old_crc32_data(const void *data, size_t size)
+{
+	const uint8_t *p = data, *end = p + size;
+	uint32_t crc = 0xffffffff;
+
+	for (; p != end; p++)
+		crc = (crc >> 8) ^ old_crc32tab[((crc ^ *p) & 0xff)];
+	return crc ^ 0xffffffff;
+}
+
+static void print_speed(const char *name, size_t size, uint64_t nsecs)
+{
+	double secs = (double)nsecs / 1000000000.0;
+
+	printf("%-28s %8.02lf MB/s\n", name,
+	       ((double)size / (1024.0*1024.0)) / secs);
+}
+
+static void
+bench_str_hash(const char *name, ARRAY_TYPE(const_string) *keys,
+	       unsigned int rounds, unsigned int (*hash)(const char *p))
+{
+	const char *key;
+	unsigned int table_size, *buckets, used = 0, max = 0, sum = 0;
+	size_t total = 0;
+	uint64_t ts_0, ts_1;
+
+	ts_0 = i_nanoseconds();
+	for (unsigned int r = 0; r < rounds; r++) {
+		array_foreach_elem(keys, key) {
+			sum += hash(key);
+			total += strlen(key);
+		}
+	}
+	ts_1 = i_nanoseconds();
+	print_speed(name, total, ts_1 - ts_0);
+
+	/* same bucket count as hash_table_create() would grow to */
+	table_size = primes_closest(array_count(keys));
+	buckets = i_new(unsigned int, table_size);
+	array_foreach_elem(keys, key) {
+		unsigned int idx = hash(key) % table_size;
+
+		if (buckets[idx]++ == 0)
+			used++;
+		max = I_MAX(max, buckets[idx]);
+	}
+	printf("%-28s %u/%u buckets used, longest chain %u (%x)\n", "",
+	       used, table_size, max, sum);
+	i_free(buckets);
+}
+
+static void bench_crc32(size_t size, unsigned int rounds)
+{
+	unsigned char *data = i_malloc(size);
+	uint32_t crc = 0, old_crc = 0;
+	uint64_t ts_0, ts_1;
+
+	for (size_t i = 0; i < size; i++)
+		data[i] = i * 7 + (i >> 5);
+
+	ts_0 = i_nanoseconds();
+	for (unsigned int r = 0; r < rounds; r++) {
+		data[0] = r;
+		old_crc += old_crc32_data(data, size);
+	}
+	ts_1 = i_nanoseconds();
+	print_speed("bytewise crc32", size * rounds, ts_1 - ts_0);
+
+	ts_0 = i_nanoseconds();
+	for (unsigned int r = 0; r < rounds; r++) {
+		/* keep the pure function from being called only once */
+		data[0] = r;
+		crc += crc32_data(data, size);
+	}
+	ts_1 = i_nanoseconds();
+	print_speed("crc32_data()", size * rounds, ts_1 - ts_0);
+	if (crc != old_crc)
+		printf("Error: crc32 mismatch\n");
+	i_free(data);
+}
+
+static void
+bench_table(const char *name, ARRAY_TYPE(const_string) *keys,
+	    unsigned int rounds, enum hash_table_flags flags)
+{
+	HASH_TABLE(const char *, void *) hash;
+	const char *key;
+	unsigned int found = 0;
+	uint64_t ts_0, ts_1, ts_2;
+
+	ts_0 = i_nanoseconds();
+	hash_table_create_flags(&hash, default_pool, 0, str_hash, strcmp,
+				flags);
+	array_foreach_elem(keys, key)
+		hash_table_insert(hash, key, POINTER_CAST(1));
+	ts_1 = i_nanoseconds();
+	for (unsigned int r = 0; r < rounds; r++) {
+		array_foreach_elem(keys, key) {
+			if (hash_table_lookup(hash, key) != NULL)
+				found++;
+		}
+	}
+	ts_2 = i_nanoseconds();
+	hash_table_destroy(&hash);
+
+	printf("%-28s insert %5"PRIu64" ns/key, lookup %5"PRIu64" ns/key\n",
+	       name, (ts_1 - ts_0) / array_count(keys),
+	       (ts_2 - ts_1) / (array_count(keys) * rounds));
+	i_assert(found == array_count(keys) * rounds);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [key_count rounds]\n", prog);
+	fprintf(stderr, "Runs with 10 rounds of 100000 keys if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	ARRAY_TYPE(const_string) keys;
+	unsigned int key_count = 100000, rounds = 10;
+	pool_t pool;
+
+	lib_init();
+
+	if (argc == 3) {
+		if (str_to_uint(argv[1], &key_count) < 0 || key_count == 0 ||
+		    str_to_uint(argv[2], &rounds) < 0 || rounds == 0) {
+			fprintf(stderr, "Invalid parameters\n");
+			print_usage(argv[0]);
+		}
+	} else if (argc != 1) {
+		print_usage(argv[0]);
+	}
+
+	/* keys similar to usernames, mailbox names and header names */
+	pool = pool_alloconly_create("bench keys", 1024*1024);
+	p_array_init(&keys, pool, key_count);
+	for (unsigned int i = 0; i < key_count; i++) {
+		const char *key;
+
+		switch (i % 3) {
+		case 0:
+			key = p_strdup_printf(pool, "user%u@example.com", i);
+			break;
+		case 1:
+			key = p_strdup_printf(pool, "INBOX/Folder %u", i);
+			break;
+		default:
+			key = p_strdup_printf(pool, "X-Header-%x", i);
+			break;
+		}
+		array_push_back(&keys, &key);
+	}
+
+	printf("%u keys, %u rounds\n\n", key_count, rounds);
+	bench_str_hash("old str_hash", &keys, rounds, old_str_hash);
+	bench_str_hash("str_hash()", &keys, rounds, str_hash);
+	bench_str_hash("strcase_hash()", &keys, rounds, strcase_hash);
+	printf("\n");
+
+	bench_table("chained hash table", &keys, rounds, 0);
+	bench_table("open addressing hash table", &keys, rounds,
+		    HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	printf("\n");
+
+	old_crc32_init();
+	bench_crc32(1024*1024, rounds * 10);
+
+	pool_unref(&pool);
+	lib_deinit();
+	return 0;
+}
@@ -0,0 +1,175 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "hash.h"
+#include "istream.h"
+#include "seq-range-array.h"
+#include "str.h"
+#include "unichar.h"
+#include "test-bench.h"
+
+#include <stdio.h>
+
+/**
+ * Micro-benchmarks for commonly used lib functionality: string building,
+ * seq-range arrays, reading lines from istreams, hash table lookups and
+ * titlecasing of subject-like strings.
+ * Give a wildcard mask parameter to run only the matching benchmarks.
+ */
+
+#define BENCH_KEY_COUNT 10000
+#define BENCH_RANGE_COUNT 1000
+#define BENCH_ISTREAM_SIZE (64*1024)
+
+struct bench_context {
+	pool_t pool;
+	ARRAY_TYPE(const_string) keys;
+	HASH_TABLE(const char *, void *) hash;
+	ARRAY_TYPE(seq_range) ranges;
+	buffer_t *text;
+	unsigned int counter;
+};
+
+static void bench_str_append(struct bench_context *ctx)
+{
+	string_t *str = t_str_new(128);
+
+	for (unsigned int i = 0; i < 64; i++) {
+		str_append(str, "header-value ");
+		str_append_c(str, 'x');
+	}
+	ctx->counter += str_len(str);
+}
+
+static void bench_str_printfa(struct bench_context *ctx)
+{
+	string_t *str = t_str_new(128);
+
+	for (unsigned int i = 0; i < 16; i++)
+		str_printfa(str, "%u %s ", i, "value");
+	ctx->counter += str_len(str);
+}
+
+static void bench_seq_range_add(struct bench_context *ctx)
+{
+	ARRAY_TYPE(seq_range) ranges;
+
+	t_array_init(&ranges, 16);
+	/* every third UID, added in random-ish order */
+	for (unsigned int i = 0; i < BENCH_RANGE_COUNT; i++)
+		seq_range_array_add(&ranges, ((i * 7919) % BENCH_RANGE_COUNT) * 3 + 1);
+	ctx->counter += array_count(&ranges);
+}
+
+static void bench_seq_range_exists(struct bench_context *ctx)
+{
+	for (unsigned int i = 0; i < BENCH_RANGE_COUNT; i++) {
+		if (seq_range_exists(&ctx->ranges, i * 3 + 1))
+			ctx->counter++;
+	}
+}
+
+static void bench_istream_lines(struct bench_context *ctx)
+{
+	struct istream *input =
+		i_stream_create_from_data(ctx->text->data, ctx->text->used);
+	const char *line;
+
+	while ((line = i_stream_read_next_line(input)) != NULL)
+		ctx->counter++;
+	i_stream_unref(&input);
+}
+
+static void bench_hash_lookup(struct bench_context *ctx)
+{
+	const char *key;
+
+	array_foreach_elem(&ctx->keys, key) {
+		if (hash_table_lookup(ctx->hash, key) != NULL)
+			ctx->counter++;
+	}
+}
+
+static const char *bench_subjects[] = {
+	"Re: Fwd: Quarterly report for the project meeting",
+	"[list-name] Re: Patch: fix crash when the mailbox is deleted",
+	"Re: Tr\xc3\xa4""ffen n\xc3\xa4""chste Woche?",
+	"\xd0\x9e\xd1\x82\xd1\x87\xd0\xb5\xd1\x82 \xd0\xb7\xd0\xb0 "
+		"\xd0\xbc\xd0\xb5\xd1\x81\xd1\x8f\xd1\x86",
+};
+
+static void bench_titlecase(struct bench_context *ctx)
+{
+	buffer_t *output = t_buffer_create(128);
+
+	for (unsigned int i = 0; i < N_ELEMENTS(bench_subjects); i++) {
+		buffer_set_used_size(output, 0);
+		(void)uni_utf8_to_decomposed_titlecase(bench_subjects[i],
+			strlen(bench_subjects[i]), output);
+		ctx->counter += output->used;
+	}
+}
+
+static void bench_init(struct bench_context *ctx)
+{
+	i_zero(ctx);
+	ctx->pool = pool_alloconly_create("bench lib", 1024*1024);
+
+	p_array_init(&ctx->keys, ctx->pool, BENCH_KEY_COUNT);
+	hash_table_create(&ctx->hash, ctx->pool, 0, str_hash, strcmp);
+	for (unsigned int i = 0; i < BENCH_KEY_COUNT; i++) {
+		const char *key = p_strdup_printf(ctx->pool,
+						  "user%u@example.com", i);
+		array_push_back(&ctx->keys, &key);
+		hash_table_insert(ctx->hash, key, POINTER_CAST(1));
+	}
+
+	p_array_init(&ctx->ranges, ctx->pool, BENCH_RANGE_COUNT);
+	for (unsigned int i = 0; i < BENCH_RANGE_COUNT; i++)
+		seq_range_array_add(&ctx->ranges, i * 3 + 1);
+
+	ctx->text = buffer_create_dynamic(ctx->pool, BENCH_ISTREAM_SIZE);
+	while (ctx->text->used < BENCH_ISTREAM_SIZE) {
+		str_printfa(ctx->text, "Line %zu of some mail-like text\n",
+			    ctx->text->used);
+	}
+}
+
+static void bench_deinit(struct bench_context *ctx)
+{
+	hash_table_destroy(&ctx->hash);
+	pool_unref(&ctx->pool);
+}
+
+int main(int argc, const char *argv[])
+{
+	struct bench_context ctx;
+
+	lib_init();
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [<benchmark name mask>]\n", argv[0]);
+		lib_exit(1);
+	}
+	test_bench_set_filter(argv[1]);
+	bench_init(&ctx);
+
+	test_bench_print_header();
+	test_bench_run("str_append()", 100000, 0, bench_str_append, &ctx);
+	test_bench_run("str_printfa()", 100000, 0, bench_str_printfa, &ctx);
+	test_bench_run("seq_range_array_add() x1000", 1000, 0,
+		       bench_seq_range_add, &ctx);
+	test_bench_run("seq_range_exists() x1000", 1000, 0,
+		       bench_seq_range_exists, &ctx);
+	test_bench_run("i_stream_read_next_line() 64k", 1000,
+		       ctx.text->used, bench_istream_lines, &ctx);
+	test_bench_run("hash_table_lookup() x10000", 100, 0,
+		       bench_hash_lookup, &ctx);
+	test_bench_run("uni_utf8_to_decomposed_titlecase() subjects", 100000,
+		       0, bench_titlecase, &ctx);
+
+	bench_deinit(&ctx);
+	test_bench_set_filter(NULL);
+	lib_deinit();
+	return 0;
+}
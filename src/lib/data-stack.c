@@ -5,6 +5,7 @@
 #include "lib.h"
 #include "backtrace-string.h"
 #include "str.h"
+#include "alloc-profile.h"
 #include "data-stack.h"
 
 
@@ -276,6 +277,25 @@ static void t_pop_verify(void)
 }
 #endif
 
+static void data_stack_profile_frame(void)
+{
+	struct stack_block *block = current_frame->block;
+	size_t block_start_left = current_frame->block_space_left;
+	size_t used_size = 0;
+
+	/* count only the used part of each block. The ones before
+	   current_block may have some unused space left at the end. */
+	for (;;) {
+		used_size += block_start_left - block->left;
+		if (block == current_block)
+			break;
+		block = block->next;
+		block_start_left = block->size;
+	}
+	alloc_profile_add(alloc_profile_get(ALLOC_PROFILE_TYPE_DATA_STACK,
+					    current_frame->marker), used_size);
+}
+
 void t_pop_last_unsafe(void)
 {
 	size_t block_space_left;
@@ -287,6 +307,8 @@ void t_pop_last_unsafe(void)
 #ifdef DEBUG
 	t_pop_verify();
 #endif
+	if (unlikely(alloc_profiling))
+		data_stack_profile_frame();
 
 	/* Usually the block doesn't change. If it doesn't, the next pointer
 	   must also be NULL. */
@@ -495,6 +517,11 @@ static void *t_malloc_real(size_t size, bool permanent)
 			warn = TRUE;
 		}
 
+		if (unlikely(alloc_profiling)) {
+			alloc_profile_get(ALLOC_PROFILE_TYPE_DATA_STACK,
+					  current_frame->marker)->grow_count++;
+		}
+
 		/* The newly allocated block will replace the current_block,
 		   i.e. current_block always points to the last element in
 		   the linked list. */
@@ -1,6 +1,7 @@
 #ifndef EVENT_FILTER_PRIVATE_H
 #define EVENT_FILTER_PRIVATE_H
 
+#include "hash.h"
 #include "event-filter.h"
 
 enum event_filter_node_op {
@@ -24,8 +25,14 @@ struct event_filter {
 	int refcount;
 	ARRAY(struct event_filter_query_internal) queries;
 
+	/* If all queries match only specific event names, these are the
+	   names. Other events can't match any of the queries. */
+	HASH_TABLE(const char *, void *) event_names;
+
 	bool fragment;
 	bool named_queries_only;
+	/* Some query can match an event name that isn't in event_names */
+	bool event_names_unbounded;
 };
 
 enum event_filter_node_type {
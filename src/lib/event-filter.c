@@ -93,6 +93,7 @@ void event_filter_unref(struct event_filter **_filter)
 
 	if (!filter->fragment) {
 		DLLIST_REMOVE(&event_filters, filter);
+		hash_table_destroy(&filter->event_names);
 
 		/* fragments' pools are freed by the consumer */
 		pool_unref(&filter->pool);
@@ -184,6 +185,64 @@ static bool filter_node_requires_event_name(struct event_filter_node *node)
 	}
 }
 
+static bool
+filter_node_get_event_names(struct event_filter_node *node,
+			    ARRAY_TYPE(const_string) *names)
+{
+	/* Any extra names added by a failed child are harmless: the names
+	   only need to be a superset of the names that can match. */
+	switch (node->op) {
+	case EVENT_FILTER_OP_AND:
+		return filter_node_get_event_names(node->children[0], names) ||
+			filter_node_get_event_names(node->children[1], names);
+	case EVENT_FILTER_OP_OR:
+		return filter_node_get_event_names(node->children[0], names) &&
+			filter_node_get_event_names(node->children[1], names);
+	case EVENT_FILTER_OP_CMP_EQ:
+		if (node->type != EVENT_FILTER_NODE_TYPE_EVENT_NAME_EXACT)
+			return FALSE;
+		array_push_back(names, &node->field.value.str);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void
+event_filter_add_event_names(struct event_filter *filter,
+			     struct event_filter_node *expr)
+{
+	const char *name;
+
+	/* Fragments are only used for merging into other filters, and their
+	   pool is owned by the consumer, so they don't track names. */
+	if (filter->fragment || filter->event_names_unbounded)
+		return;
+
+	T_BEGIN {
+		ARRAY_TYPE(const_string) names;
+
+		t_array_init(&names, 4);
+		if (!filter_node_get_event_names(expr, &names))
+			filter->event_names_unbounded = TRUE;
+		else {
+			if (!hash_table_is_created(filter->event_names)) {
+				/* not using filter->pool, because the hash
+				   table would keep a reference to it */
+				hash_table_create(&filter->event_names,
+						  default_pool, 0,
+						  str_hash, strcmp);
+			}
+			/* the names point to the expr, which is allocated
+			   from the filter's pool */
+			array_foreach_elem(&names, name) {
+				hash_table_update(filter->event_names,
+						  name, POINTER_CAST(1));
+			}
+		}
+	} T_END;
+}
+
 static int
 event_filter_parse_real(const char *str, struct event_filter *filter,
 			bool case_sensitive, const char **error_r)
@@ -217,6 +276,7 @@ event_filter_parse_real(const char *str, struct event_filter *filter,
 
 		filter->named_queries_only = filter->named_queries_only &&
 			filter_node_requires_event_name(state.output);
+		event_filter_add_event_names(filter, state.output);
 	} else if (ret != 0) {
 		/* error */
 		i_assert(state.error != NULL);
@@ -403,11 +463,12 @@ event_filter_merge_with_context_internal(struct event_filter *dest,
 
 		new = event_filter_get_or_alloc_internal_query(dest, context);
 
-		add_node(dest->pool, &new->expr,
-			 clone_expr(dest->pool, int_query->expr),
-			 EVENT_FILTER_OP_OR);
+		struct event_filter_node *expr =
+			clone_expr(dest->pool, int_query->expr);
+		add_node(dest->pool, &new->expr, expr, EVENT_FILTER_OP_OR);
 		dest->named_queries_only = dest->named_queries_only &&
 			filter_node_requires_event_name(int_query->expr);
+		event_filter_add_event_names(dest, expr);
 	} T_END;
 }
 
@@ -1046,6 +1107,14 @@ event_filter_match_fastpath(struct event_filter *filter, struct event *event)
 		   to check any further. */
 		return FALSE;
 	}
+	if (hash_table_is_created(filter->event_names) &&
+	    !filter->event_names_unbounded &&
+	    (event->sending_name == NULL ||
+	     hash_table_lookup(filter->event_names,
+			       (const char *)event->sending_name) == NULL)) {
+		/* None of the queries want this event name */
+		return FALSE;
+	}
 	return TRUE;
 }
 
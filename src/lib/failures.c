@@ -60,6 +60,9 @@ static char *log_prefix = NULL;
 static char *log_stamp_format = NULL, *log_stamp_format_suffix = NULL;
 static bool failure_ignore_errors = FALSE, log_prefix_sent = FALSE;
 static bool coredump_on_error = FALSE;
+static buffer_t *log_write_buffer = NULL;
+static int log_write_buffer_fd = -1;
+static bool log_write_buffering = FALSE;
 static void log_timestamp_add(const struct failure_context *ctx, string_t *str);
 static void log_prefix_add(const struct failure_context *ctx, string_t *str);
 static int i_failure_send_option_forced(const char *key, const char *value);
@@ -76,6 +79,46 @@ static const char *log_prefix_sanitize(const char *str)
 	return t_str_replace(str, '\n', ' ');
 }
 
+static int log_write_buffer_flush(void)
+{
+	int ret;
+
+	if (log_write_buffer == NULL || log_write_buffer->used == 0)
+		return 0;
+
+	/* Steal the buffer while writing, so that if the write fails, logging
+	   the error won't try to write the same lines again. */
+	buffer_t *buf = log_write_buffer;
+	log_write_buffer = NULL;
+	ret = log_fd_write(log_write_buffer_fd, buf->data, buf->used);
+	buffer_set_used_size(buf, 0);
+	log_write_buffer = buf;
+	return ret;
+}
+
+static int default_write_line(enum log_type type, int fd,
+			      const unsigned char *data, size_t len)
+{
+	if (!log_write_buffering ||
+	    type == LOG_TYPE_FATAL || type == LOG_TYPE_PANIC ||
+	    len > PIPE_BUF) {
+		if (log_write_buffer_flush() < 0)
+			return -1;
+		return log_fd_write(fd, data, len);
+	}
+
+	/* Write at most PIPE_BUF bytes at a time, so the lines stay atomic
+	   even if the log fd is a pipe shared with other processes. */
+	if (log_write_buffer_fd != fd ||
+	    log_write_buffer->used + len > PIPE_BUF) {
+		if (log_write_buffer_flush() < 0)
+			return -1;
+		log_write_buffer_fd = fd;
+	}
+	buffer_append(log_write_buffer, data, len);
+	return 0;
+}
+
 static int ATTR_FORMAT(2, 0)
 default_write(const struct failure_context *ctx,
 	      const char *format, va_list args)
@@ -104,14 +147,15 @@ default_write(const struct failure_context *ctx,
 	const char *p;
 	while ((p = strchr(str_c(data), '\n')) != NULL) {
 		size_t line_len = p - str_c(data) + 1;
-		if (log_fd_write(fd, str_data(data), line_len) < 0)
+		if (default_write_line(ctx->type, fd,
+				       str_data(data), line_len) < 0)
 			return -1;
 		/* delete the written line, not including the log prefix */
 		str_delete(data, prefix_len, line_len - prefix_len);
 	}
 
 	str_append_c(data, '\n');
-	return log_fd_write(fd, str_data(data), str_len(data));
+	return default_write_line(ctx->type, fd, str_data(data), str_len(data));
 }
 
 static void default_on_handler_failure(const struct failure_context *ctx)
@@ -698,6 +742,7 @@ static void open_log_file(int *fd, const char *path)
 
 void i_set_failure_file(const char *path, const char *prefix)
 {
+	i_set_failure_write_buffering(FALSE);
 	i_set_failure_prefix("%s", prefix);
 
 	if (log_fd_can_close(log_info_fd) && log_info_fd != log_fd) {
@@ -922,6 +967,7 @@ void i_set_failure_ignore_errors(bool ignore)
 
 void i_set_info_file(const char *path)
 {
+	i_set_failure_write_buffering(FALSE);
 	if (log_info_fd == log_fd)
 		log_info_fd = STDERR_FILENO;
 
@@ -935,6 +981,7 @@ void i_set_info_file(const char *path)
 
 void i_set_debug_file(const char *path)
 {
+	i_set_failure_write_buffering(FALSE);
 	if (log_debug_fd == log_fd || log_debug_fd == log_info_fd)
 		log_debug_fd = STDERR_FILENO;
 
@@ -942,6 +989,24 @@ void i_set_debug_file(const char *path)
 	debug_handler = default_error_handler;
 }
 
+void i_set_failure_write_buffering(bool enable)
+{
+	if (enable) {
+		if (log_write_buffer == NULL) {
+			log_write_buffer =
+				buffer_create_dynamic(default_pool, PIPE_BUF);
+		}
+		log_write_buffering = TRUE;
+		return;
+	}
+	log_write_buffering = FALSE;
+	if (log_write_buffer_flush() < 0) {
+		failure_handler.v->on_handler_failure(
+			log_write_buffer_fd == log_fd ?
+			&failure_ctx_error : &failure_ctx_info);
+	}
+}
+
 bool i_failure_have_stdout_logs(void)
 {
 	return log_fd == STDOUT_FILENO ||
@@ -982,6 +1047,9 @@ void i_set_failure_exit_callback(void (*callback)(int *status))
 
 void failures_deinit(void)
 {
+	i_set_failure_write_buffering(FALSE);
+	buffer_free(&log_write_buffer);
+
 	if (log_debug_fd == log_info_fd || log_debug_fd == log_fd)
 		log_debug_fd = STDERR_FILENO;
 
@@ -149,6 +149,11 @@ void i_set_failure_exit_callback(void (*callback)(int *status));
 /* Call the exit callback and exit() */
 void failure_exit(int status) ATTR_NORETURN ATTR_COLD;
 
+/* Buffer the lines written to log files and write them with fewer write()
+   syscalls. Fatal and panic messages are always written immediately.
+   Disabling the buffering writes out the buffered lines. */
+void i_set_failure_write_buffering(bool enable);
+
 /* Returns TRUE if any of the logging is configured to /dev/stdout. */
 bool i_failure_have_stdout_logs(void);
 
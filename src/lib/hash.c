@@ -3,15 +3,18 @@
 /* @UNSAFE: whole file */
 
 #include "lib.h"
+#include "byteorder.h"
 #include "hash.h"
 #include "primes.h"
 
-#include <ctype.h>
-
 #define HASH_TABLE_MIN_SIZE 67
+/* Open addressing tables have power of two sizes, minimum 16 */
+#define HASH_TABLE_OPEN_MIN_SIZE_BITS 4
 
 #undef hash_table_create
 #undef hash_table_create_direct
+#undef hash_table_create_flags
+#undef hash_table_create_direct_flags
 #undef hash_table_destroy
 #undef hash_table_clear
 #undef hash_table_lookup
@@ -32,8 +35,16 @@ struct hash_node {
 	void *value;
 };
 
+/* Slot in an open addressing table. key=NULL is an empty slot. */
+struct hash_slot {
+	void *key;
+	void *value;
+	unsigned int hash;
+};
+
 struct hash_table {
 	pool_t node_pool;
+	enum hash_table_flags flags;
 
 	int frozen;
 	unsigned int initial_size, nodes_count, removed_count;
@@ -42,6 +53,14 @@ struct hash_table {
 	struct hash_node *nodes;
 	struct hash_node *free_nodes;
 
+	/* HASH_TABLE_FLAG_OPEN_ADDRESSING: */
+	struct hash_slot *slots;
+	/* size = 1 << size_bits */
+	unsigned int size_bits;
+	/* Number of active iterators. The slots can't be moved while
+	   these exist. */
+	unsigned int iter_count;
+
 	hash_callback_t *hash_cb;
 	hash_cmp_callback_t *key_compare_cb;
 };
@@ -58,28 +77,53 @@ enum hash_table_operation{
 	HASH_TABLE_OP_RESIZE
 };
 
+/* Removed slot in an open addressing table. Used while the table is frozen,
+   so that the iterators don't skip or repeat any keys. */
+static char hash_slot_removed;
+#define HASH_SLOT_REMOVED ((void *)&hash_slot_removed)
+
+#define HASH_TABLE_IS_OPEN(table) \
+	(((table)->flags & HASH_TABLE_FLAG_OPEN_ADDRESSING) != 0)
+
 static bool hash_table_resize(struct hash_table *table, bool grow);
+static void hash_open_init(struct hash_table *table);
 
-void hash_table_create(struct hash_table **table_r, pool_t node_pool,
-		       unsigned int initial_size, hash_callback_t *hash_cb,
-		       hash_cmp_callback_t *key_compare_cb)
+void hash_table_create_flags(struct hash_table **table_r, pool_t node_pool,
+			     unsigned int initial_size,
+			     hash_callback_t *hash_cb,
+			     hash_cmp_callback_t *key_compare_cb,
+			     enum hash_table_flags flags)
 {
 	struct hash_table *table;
 
 	pool_ref(node_pool);
 	table = i_new(struct hash_table, 1);
 	table->node_pool = node_pool;
-	table->initial_size =
-		I_MAX(primes_closest(initial_size), HASH_TABLE_MIN_SIZE);
+	table->flags = flags;
 
 	table->hash_cb = hash_cb;
 	table->key_compare_cb = key_compare_cb;
 
-	table->size = table->initial_size;
-	table->nodes = i_new(struct hash_node, table->size);
+	if (HASH_TABLE_IS_OPEN(table)) {
+		table->initial_size = initial_size;
+		hash_open_init(table);
+	} else {
+		table->initial_size = I_MAX(primes_closest(initial_size),
+					    HASH_TABLE_MIN_SIZE);
+		table->size = table->initial_size;
+		table->nodes = i_new(struct hash_node, table->size);
+	}
 	*table_r = table;
 }
 
+void hash_table_create(struct hash_table **table_r, pool_t node_pool,
+		       unsigned int initial_size, hash_callback_t *hash_cb,
+		       hash_cmp_callback_t *key_compare_cb)
+{
+	hash_table_create_flags(table_r, node_pool, initial_size,
+				hash_cb, key_compare_cb, 0);
+}
+
 static unsigned int direct_hash(const void *p)
 {
 	/* NOTE: may truncate the value, but that doesn't matter. */
@@ -98,6 +142,189 @@ void hash_table_create_direct(struct hash_table **table_r, pool_t node_pool,
 			  direct_hash, direct_cmp);
 }
 
+void hash_table_create_direct_flags(struct hash_table **table_r,
+				    pool_t node_pool,
+				    unsigned int initial_size,
+				    enum hash_table_flags flags)
+{
+	hash_table_create_flags(table_r, node_pool, initial_size,
+				direct_hash, direct_cmp, flags);
+}
+
+/*
+ * Open addressing implementation
+ *
+ * Linear probing with each slot storing the key's hash, so that the
+ * comparison callback is called only for likely matches. When the table
+ * isn't frozen, removal shifts the following slots backwards, so there are
+ * no tombstones. While frozen, removed slots are marked with
+ * HASH_SLOT_REMOVED and the table is rehashed when thawed.
+ */
+
+static inline unsigned int
+hash_open_home(const struct hash_table *table, unsigned int hash)
+{
+	/* Fibonacci hashing spreads also weak hashes (e.g. aligned
+	   pointers) over the power of two sized table */
+	return (uint32_t)(hash * 2654435769U) >> (32 - table->size_bits);
+}
+
+static unsigned int hash_open_get_size_bits(unsigned int count)
+{
+	unsigned int bits = HASH_TABLE_OPEN_MIN_SIZE_BITS;
+
+	/* keep the load factor at most 50% after resizing */
+	while ((1U << bits) / 2 < count) {
+		if (bits == 31)
+			i_panic("hash table: Too many keys");
+		bits++;
+	}
+	return bits;
+}
+
+static void hash_open_init(struct hash_table *table)
+{
+	table->size_bits = hash_open_get_size_bits(table->initial_size);
+	table->size = 1U << table->size_bits;
+	table->slots = i_new(struct hash_slot, table->size);
+}
+
+static void hash_open_rehash(struct hash_table *table, unsigned int count)
+{
+	struct hash_slot *old_slots = table->slots;
+	unsigned int i, idx, mask, old_size = table->size;
+
+	i_assert(table->iter_count == 0);
+
+	table->size_bits = hash_open_get_size_bits(
+		I_MAX(count, table->initial_size));
+	table->size = 1U << table->size_bits;
+	table->slots = i_new(struct hash_slot, table->size);
+	table->removed_count = 0;
+
+	mask = table->size - 1;
+	for (i = 0; i < old_size; i++) {
+		if (old_slots[i].key == NULL ||
+		    old_slots[i].key == HASH_SLOT_REMOVED)
+			continue;
+		idx = hash_open_home(table, old_slots[i].hash);
+		while (table->slots[idx].key != NULL)
+			idx = (idx + 1) & mask;
+		table->slots[idx] = old_slots[i];
+	}
+	i_free(old_slots);
+}
+
+static void hash_open_try_shrink(struct hash_table *table)
+{
+	unsigned int count = I_MAX(table->nodes_count, table->initial_size);
+
+	if (table->frozen == 0 && table->nodes_count < table->size / 8 &&
+	    hash_open_get_size_bits(count) < table->size_bits)
+		hash_open_rehash(table, table->nodes_count);
+}
+
+static struct hash_slot *
+hash_open_lookup_slot(const struct hash_table *table,
+		      const void *key, unsigned int hash)
+{
+	unsigned int idx, mask = table->size - 1;
+	struct hash_slot *slot;
+
+	idx = hash_open_home(table, hash);
+	for (;;) {
+		slot = &table->slots[idx];
+		if (slot->key == NULL)
+			return NULL;
+		if (slot->hash == hash && slot->key != HASH_SLOT_REMOVED &&
+		    table->key_compare_cb(slot->key, key) == 0)
+			return slot;
+		idx = (idx + 1) & mask;
+	}
+}
+
+static void
+hash_open_insert(struct hash_table *table, void *key, void *value,
+		 bool update)
+{
+	struct hash_slot *slot;
+	unsigned int idx, hash, mask;
+
+	i_assert(table->nodes_count < UINT_MAX);
+	i_assert(key != NULL);
+
+	hash = table->hash_cb(key);
+	slot = hash_open_lookup_slot(table, key, hash);
+	if (slot != NULL) {
+		i_assert(update);
+		slot->value = value;
+		return;
+	}
+
+	/* keep the load factor (including removed slots) at most 75% */
+	if ((table->nodes_count + table->removed_count + 1) * 4ULL >
+	    table->size * 3ULL) {
+		if (table->iter_count == 0)
+			hash_open_rehash(table, table->nodes_count + 1);
+		else if (table->nodes_count + table->removed_count + 1 >=
+			 table->size) {
+			/* at least one slot must be left empty */
+			i_panic("hash table: Too many keys inserted while "
+				"iterating");
+		}
+	}
+
+	mask = table->size - 1;
+	idx = hash_open_home(table, hash);
+	while (table->slots[idx].key != NULL &&
+	       table->slots[idx].key != HASH_SLOT_REMOVED)
+		idx = (idx + 1) & mask;
+	slot = &table->slots[idx];
+	if (slot->key == HASH_SLOT_REMOVED)
+		table->removed_count--;
+	slot->key = key;
+	slot->value = value;
+	slot->hash = hash;
+	table->nodes_count++;
+}
+
+static void hash_open_remove_slot(struct hash_table *table, unsigned int idx)
+{
+	unsigned int next, home, mask = table->size - 1;
+
+	table->nodes_count--;
+	if (table->frozen != 0) {
+		table->slots[idx].key = HASH_SLOT_REMOVED;
+		table->slots[idx].value = NULL;
+		table->removed_count++;
+		return;
+	}
+
+	/* move back the following slots that would otherwise become
+	   unreachable */
+	for (next = (idx + 1) & mask; table->slots[next].key != NULL;
+	     next = (next + 1) & mask) {
+		home = hash_open_home(table, table->slots[next].hash);
+		if (((next - home) & mask) >= ((next - idx) & mask)) {
+			table->slots[idx] = table->slots[next];
+			idx = next;
+		}
+	}
+	i_zero(&table->slots[idx]);
+	hash_open_try_shrink(table);
+}
+
+static bool hash_open_try_remove(struct hash_table *table, const void *key)
+{
+	struct hash_slot *slot;
+
+	slot = hash_open_lookup_slot(table, key, table->hash_cb(key));
+	if (slot == NULL)
+		return FALSE;
+	hash_open_remove_slot(table, slot - table->slots);
+	return TRUE;
+}
+
 static void free_node(struct hash_table *table, struct hash_node *node)
 {
 	if (!table->node_pool->alloconly_pool)
@@ -139,13 +366,14 @@ void hash_table_destroy(struct hash_table **_table)
 
 	i_assert(table->frozen == 0);
 
-	if (!table->node_pool->alloconly_pool) {
+	if (!table->node_pool->alloconly_pool && !HASH_TABLE_IS_OPEN(table)) {
 		hash_table_destroy_nodes(table);
 		destroy_node_list(table, table->free_nodes);
 	}
 
 	pool_unref(&table->node_pool);
 	i_free(table->nodes);
+	i_free(table->slots);
 	i_free(table);
 }
 
@@ -153,6 +381,13 @@ void hash_table_clear(struct hash_table *table, bool free_nodes)
 {
 	i_assert(table->frozen == 0);
 
+	if (HASH_TABLE_IS_OPEN(table)) {
+		memset(table->slots, 0, sizeof(struct hash_slot) * table->size);
+		table->nodes_count = 0;
+		table->removed_count = 0;
+		return;
+	}
+
 	if (!table->node_pool->alloconly_pool)
 		hash_table_destroy_nodes(table);
 
@@ -191,6 +426,12 @@ void *hash_table_lookup(const struct hash_table *table, const void *key)
 {
 	struct hash_node *node;
 
+	if (HASH_TABLE_IS_OPEN(table)) {
+		struct hash_slot *slot =
+			hash_open_lookup_slot(table, key, table->hash_cb(key));
+		return slot != NULL ? slot->value : NULL;
+	}
+
 	node = hash_table_lookup_node(table, key, table->hash_cb(key));
 	return node != NULL ? node->value : NULL;
 }
@@ -201,6 +442,17 @@ bool hash_table_lookup_full(const struct hash_table *table,
 {
 	struct hash_node *node;
 
+	if (HASH_TABLE_IS_OPEN(table)) {
+		struct hash_slot *slot =
+			hash_open_lookup_slot(table, lookup_key,
+					      table->hash_cb(lookup_key));
+		if (slot == NULL)
+			return FALSE;
+		*orig_key = slot->key;
+		*value = slot->value;
+		return TRUE;
+	}
+
 	node = hash_table_lookup_node(table, lookup_key,
 				      table->hash_cb(lookup_key));
 	if (node == NULL)
@@ -297,12 +549,18 @@ hash_table_insert_node(struct hash_table *table, void *key, void *value,
 
 void hash_table_insert(struct hash_table *table, void *key, void *value)
 {
-	hash_table_insert_node(table, key, value, HASH_TABLE_OP_INSERT);
+	if (HASH_TABLE_IS_OPEN(table))
+		hash_open_insert(table, key, value, FALSE);
+	else
+		hash_table_insert_node(table, key, value, HASH_TABLE_OP_INSERT);
 }
 
 void hash_table_update(struct hash_table *table, void *key, void *value)
 {
-	hash_table_insert_node(table, key, value, HASH_TABLE_OP_UPDATE);
+	if (HASH_TABLE_IS_OPEN(table))
+		hash_open_insert(table, key, value, TRUE);
+	else
+		hash_table_insert_node(table, key, value, HASH_TABLE_OP_UPDATE);
 }
 
 static void
@@ -347,6 +605,9 @@ bool hash_table_try_remove(struct hash_table *table, const void *key)
 	struct hash_node *node;
 	unsigned int hash;
 
+	if (HASH_TABLE_IS_OPEN(table))
+		return hash_open_try_remove(table, key);
+
 	hash = table->hash_cb(key);
 
 	node = hash_table_lookup_node(table, key, hash);
@@ -373,10 +634,12 @@ struct hash_iterate_context *hash_table_iterate_init(struct hash_table *table)
 	struct hash_iterate_context *ctx;
 
 	hash_table_freeze(table);
+	table->iter_count++;
 
 	ctx = i_new(struct hash_iterate_context, 1);
 	ctx->table = table;
-	ctx->next = &table->nodes[0];
+	if (!HASH_TABLE_IS_OPEN(table))
+		ctx->next = &table->nodes[0];
 	return ctx;
 }
 
@@ -403,6 +666,24 @@ bool hash_table_iterate(struct hash_iterate_context *ctx,
 {
 	struct hash_node *node;
 
+	if (HASH_TABLE_IS_OPEN(ctx->table)) {
+		const struct hash_table *table = ctx->table;
+
+		for (; ctx->pos < table->size; ctx->pos++) {
+			const struct hash_slot *slot = &table->slots[ctx->pos];
+
+			if (slot->key != NULL &&
+			    slot->key != HASH_SLOT_REMOVED) {
+				*key_r = slot->key;
+				*value_r = slot->value;
+				ctx->pos++;
+				return TRUE;
+			}
+		}
+		*key_r = *value_r = NULL;
+		return FALSE;
+	}
+
 	node = ctx->next;
 	if (node != NULL && node->key == NULL)
 		node = hash_table_iterate_next(ctx, node);
@@ -425,6 +706,8 @@ void hash_table_iterate_deinit(struct hash_iterate_context **_ctx)
 		return;
 
 	*_ctx = NULL;
+	i_assert(ctx->table->iter_count > 0);
+	ctx->table->iter_count--;
 	hash_table_thaw(ctx->table);
 	i_free(ctx);
 }
@@ -441,6 +724,11 @@ void hash_table_thaw(struct hash_table *table)
 	if (--table->frozen > 0)
 		return;
 
+	if (HASH_TABLE_IS_OPEN(table)) {
+		if (table->removed_count > 0)
+			hash_open_rehash(table, table->nodes_count);
+		return;
+	}
 	if (table->removed_count > 0) {
 		if (!hash_table_resize(table, FALSE))
 			hash_table_compress_removed(table);
@@ -519,75 +807,86 @@ void hash_table_copy(struct hash_table *dest, struct hash_table *src)
 	hash_table_thaw(dest);
 }
 
-/* a char* hash function from ASU -- from glib */
-unsigned int ATTR_NO_SANITIZE_INTEGER
-str_hash(const char *p)
-{
-        const unsigned char *s = (const unsigned char *)p;
-	unsigned int g, h = 0;
+enum hash_case {
+	HASH_CASE_SENSITIVE,
+	/* uppercase ASCII a-z */
+	HASH_CASE_ASCII,
+	/* drop 0x20 from all bytes */
+	HASH_CASE_FAST,
+};
 
-	while (*s != '\0') {
-		h = (h << 4) + *s;
-		if ((g = h & 0xf0000000UL) != 0) {
-			h = h ^ (g >> 24);
-			h = h ^ g;
-		}
-		s++;
-	}
+#define HASH_ONES UINT64_C(0x0101010101010101)
+
+static inline uint64_t hash_ascii_toupper64(uint64_t w)
+{
+	uint64_t heptets = w & (0x7f * HASH_ONES);
+	/* bit 7 of each byte is set if the byte is >= 'a' or > 'z' */
+	uint64_t ge_a = heptets + (0x80 - 'a') * HASH_ONES;
+	uint64_t gt_z = heptets + (0x80 - 'z' - 1) * HASH_ONES;
+	uint64_t lower = ge_a & ~gt_z & ~w & (0x80 * HASH_ONES);
 
-	return h;
+	return w ^ (lower >> 2);
 }
 
-/* a char* hash function from ASU -- from glib */
-unsigned int ATTR_NO_SANITIZE_INTEGER
-strcase_hash(const char *p)
+static inline uint64_t ATTR_NO_SANITIZE_INTEGER
+hash_mix64(uint64_t h, uint64_t w, enum hash_case hash_case)
 {
-        const unsigned char *s = (const unsigned char *)p;
-	unsigned int g, h = 0;
-
-	while (*s != '\0') {
-		h = (h << 4) + i_toupper(*s);
-		if ((g = h & 0xf0000000UL) != 0) {
-			h = h ^ (g >> 24);
-			h = h ^ g;
-		}
-		s++;
+	switch (hash_case) {
+	case HASH_CASE_SENSITIVE:
+		break;
+	case HASH_CASE_ASCII:
+		w = hash_ascii_toupper64(w);
+		break;
+	case HASH_CASE_FAST:
+		w &= ~(0x20 * HASH_ONES);
+		break;
 	}
-
-	return h;
+	h = (h ^ w) * UINT64_C(0x9e3779b97f4a7c15);
+	return h ^ (h >> 29);
 }
 
-unsigned int ATTR_NO_SANITIZE_INTEGER
-mem_hash(const void *p, unsigned int size)
+/* Multiply-xorshift hash over little-endian 64-bit words with the
+   MurmurHash3 64-bit finalizer. */
+static inline unsigned int ATTR_NO_SANITIZE_INTEGER
+hash_mem_case(const void *p, size_t size, enum hash_case hash_case)
 {
 	const unsigned char *s = p;
-	unsigned int i, g, h = 0;
+	uint64_t w, h = size;
 
-	for (i = 0; i < size; i++) {
-		h = (h << 4) + *s;
-		if ((g = h & 0xf0000000UL) != 0) {
-			h = h ^ (g >> 24);
-			h = h ^ g;
-		}
-		s++;
+	for (; size >= sizeof(w); size -= sizeof(w), s += sizeof(w)) {
+		memcpy(&w, s, sizeof(w));
+		h = hash_mix64(h, le64_to_cpu(w), hash_case);
+	}
+	if (size > 0) {
+		w = 0;
+		memcpy(&w, s, size);
+		/* the tail gets zero-padded in its little-endian form */
+		h = hash_mix64(h, le64_to_cpu(w), hash_case);
 	}
-	return h;
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	h *= UINT64_C(0xc4ceb9fe1a85ec53);
+	h ^= h >> 33;
+	return (unsigned int)h;
 }
 
-unsigned int ATTR_NO_SANITIZE_INTEGER
-strfastcase_hash(const char *p)
+unsigned int str_hash(const char *p)
 {
-	const unsigned char *s = (const unsigned char *)p;
-	unsigned int g, h = 0;
+	return hash_mem_case(p, strlen(p), HASH_CASE_SENSITIVE);
+}
 
-	while (*s != '\0') {
-		h = (h << 4) + ((*s) & ~0x20U);
-		if ((g = h & 0xf0000000UL) != 0) {
-			h = h ^ (g >> 24);
-			h = h ^ g;
-		}
-		s++;
-	}
+unsigned int strcase_hash(const char *p)
+{
+	return hash_mem_case(p, strlen(p), HASH_CASE_ASCII);
+}
 
-	return h;
+unsigned int mem_hash(const void *p, unsigned int size)
+{
+	return hash_mem_case(p, size, HASH_CASE_SENSITIVE);
+}
+
+unsigned int strfastcase_hash(const char *p)
+{
+	return hash_mem_case(p, strlen(p), HASH_CASE_FAST);
 }
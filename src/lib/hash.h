@@ -9,6 +9,15 @@ struct hash_table;
 #  define HASH_VALUE_CAST(table)
 #endif
 
+enum hash_table_flags {
+	/* Store the keys in a single open addressing array instead of
+	   chained nodes. This avoids a node allocation for each key and is
+	   faster for large tables. The node_pool isn't used. The table can't
+	   grow while it's being iterated, so it panics if too many keys are
+	   inserted during iteration. */
+	HASH_TABLE_FLAG_OPEN_ADDRESSING = BIT(0),
+};
+
 /* Returns hash code. */
 typedef unsigned int hash_callback_t(const void *p);
 /* Returns 0 if the pointers are equal. */
@@ -22,8 +31,7 @@ void hash_table_create(struct hash_table **table_r, pool_t node_pool,
 		       unsigned int initial_size,
 		       hash_callback_t *hash_cb,
 		       hash_cmp_callback_t *key_compare_cb);
-#define hash_table_create(table, pool, size, hash_cb, key_cmp_cb) \
-	TYPE_CHECKS(void, \
+#define HASH_TABLE_CREATE_CHECKS(table, hash_cb, key_cmp_cb) \
 	COMPILE_ERROR_IF_TRUE( \
 		sizeof((*table)._key) != sizeof(void *) || \
 		sizeof((*table)._value) != sizeof(void *)) || \
@@ -36,10 +44,25 @@ void hash_table_create(struct hash_table **table_r, pool_t node_pool,
 		!__builtin_types_compatible_p(typeof(&hash_cb), \
 			unsigned int (*)(typeof((*table)._key))) && \
 		!__builtin_types_compatible_p(typeof(&hash_cb), \
-		unsigned int (*)(typeof((*table)._const_key)))), \
+		unsigned int (*)(typeof((*table)._const_key))))
+#define hash_table_create(table, pool, size, hash_cb, key_cmp_cb) \
+	TYPE_CHECKS(void, \
+	HASH_TABLE_CREATE_CHECKS(table, hash_cb, key_cmp_cb), \
 	hash_table_create(&(*table)._table, pool, size, \
 		(hash_callback_t *)hash_cb, \
 		(hash_cmp_callback_t *)key_cmp_cb))
+/* Same as hash_table_create(), but with flags. */
+void hash_table_create_flags(struct hash_table **table_r, pool_t node_pool,
+			     unsigned int initial_size,
+			     hash_callback_t *hash_cb,
+			     hash_cmp_callback_t *key_compare_cb,
+			     enum hash_table_flags flags);
+#define hash_table_create_flags(table, pool, size, hash_cb, key_cmp_cb, flags) \
+	TYPE_CHECKS(void, \
+	HASH_TABLE_CREATE_CHECKS(table, hash_cb, key_cmp_cb), \
+	hash_table_create_flags(&(*table)._table, pool, size, \
+		(hash_callback_t *)hash_cb, \
+		(hash_cmp_callback_t *)key_cmp_cb, flags))
 
 /* Create hash table where comparisons are done directly with the pointers. */
 void hash_table_create_direct(struct hash_table **table_r, pool_t node_pool,
@@ -50,6 +73,16 @@ void hash_table_create_direct(struct hash_table **table_r, pool_t node_pool,
 		sizeof((*table)._key) != sizeof(void *) || \
 		sizeof((*table)._value) != sizeof(void *)), \
 	hash_table_create_direct(&(*table)._table, pool, size))
+void hash_table_create_direct_flags(struct hash_table **table_r,
+				    pool_t node_pool,
+				    unsigned int initial_size,
+				    enum hash_table_flags flags);
+#define hash_table_create_direct_flags(table, pool, size, flags) \
+	TYPE_CHECKS(void, \
+	COMPILE_ERROR_IF_TRUE( \
+		sizeof((*table)._key) != sizeof(void *) || \
+		sizeof((*table)._value) != sizeof(void *)), \
+	hash_table_create_direct_flags(&(*table)._table, pool, size, flags))
 
 #define hash_table_is_created(table) \
 	((table)._table != NULL)
@@ -160,7 +193,8 @@ void hash_table_copy(struct hash_table *dest, struct hash_table *src);
 #define hash_table_copy(table1, table2) \
 	hash_table_copy((table1)._table, (table2)._table)
 
-/* hash function for strings */
+/* hash function for strings. The hash values are meant only for in-memory
+   use and may change between versions. */
 unsigned int str_hash(const char *p) ATTR_PURE;
 unsigned int strcase_hash(const char *p) ATTR_PURE;
 
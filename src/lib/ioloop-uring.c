@@ -0,0 +1,553 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+/* Linux io_uring based ioloop handler. Each fd has a single one-shot
+   IORING_OP_POLL_ADD request in flight, which is re-armed after its events
+   have been handled. All poll add/remove changes done by the I/O callbacks
+   are queued into the submission ring and submitted with the same
+   io_uring_enter() call that waits for the next events, so a loop iteration
+   costs a single syscall regardless of how many fds changed. */
+
+#include "lib.h"
+#include "array.h"
+#include "sleep.h"
+#include "ioloop-private.h"
+#include "ioloop-iolist.h"
+
+#ifdef IOLOOP_URING
+
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* user_data for requests whose completions are always ignored */
+#define URING_USER_DATA_IGNORE ((uint64_t)-1)
+#define URING_USER_DATA(fd, gen) (((uint64_t)(gen) << 32) | (uint32_t)(fd))
+
+#define IO_URING_ERROR (POLLERR | POLLHUP)
+#define IO_URING_INPUT (POLLIN | POLLPRI | IO_URING_ERROR)
+#define IO_URING_OUTPUT (POLLOUT | IO_URING_ERROR)
+
+#define IO_URING_MIN_ENTRIES 64
+#define IO_URING_MAX_ENTRIES 4096
+
+struct uring_fd {
+	struct io_list list;
+
+	/* incremented whenever the poll request is replaced, so stale
+	   completions of cancelled requests can be recognized */
+	uint32_t gen;
+	/* events the currently in-flight poll request is waiting for */
+	unsigned int armed_mask;
+
+	bool armed:1;
+	bool dirty:1;
+};
+
+struct uring_event {
+	uint64_t user_data;
+	int32_t res;
+};
+
+struct ioloop_handler_context {
+	int ring_fd;
+
+	void *sq_ptr, *cq_ptr;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* number of SQEs queued, but not yet submitted */
+	unsigned int sq_pending;
+	unsigned int armed_count;
+
+	ARRAY(struct uring_fd *) fd_index;
+	ARRAY_TYPE(uint32_t) dirty_fds;
+	ARRAY(struct uring_event) events;
+};
+
+static int
+io_uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+	       unsigned int flags, const void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, arg, argsz);
+}
+
+static void *
+io_uring_mmap(struct ioloop_handler_context *ctx, size_t size, off_t offset)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ctx->ring_fd, offset);
+	if (ptr == MAP_FAILED)
+		i_fatal("mmap(io_uring, offset=0x%llx) failed: %m",
+			(unsigned long long)offset);
+	return ptr;
+}
+
+static void
+io_uring_ring_init(struct ioloop_handler_context *ctx,
+		   unsigned int initial_fd_count)
+{
+	struct io_uring_params params;
+	unsigned int entries;
+
+	entries = I_MAX(initial_fd_count, IO_URING_MIN_ENTRIES);
+	entries = I_MIN(entries, IO_URING_MAX_ENTRIES);
+
+	i_zero(&params);
+	ctx->ring_fd = io_uring_setup(entries, &params);
+	if (ctx->ring_fd < 0) {
+		if (errno == ENOSYS || errno == EPERM) {
+			i_fatal("io_uring_setup() failed: %m "
+				"(kernel doesn't support io_uring or it's "
+				"disabled - rebuild using --with-ioloop=epoll)");
+		}
+		i_fatal("io_uring_setup() failed: %m");
+	}
+	fd_close_on_exec(ctx->ring_fd, TRUE);
+	/* FEAT_NODROP guarantees that completions aren't lost if the CQ ring
+	   overflows, and FEAT_EXT_ARG allows waiting with a timeout without
+	   submitting extra timeout requests. Both exist since Linux 5.11. */
+	if ((params.features & IORING_FEAT_NODROP) == 0 ||
+	    (params.features & IORING_FEAT_EXT_ARG) == 0) {
+		i_fatal("io_uring: Kernel is too old (Linux v5.11+ required) - "
+			"rebuild using --with-ioloop=epoll");
+	}
+
+	ctx->sq_ring_size = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned int);
+	ctx->cq_ring_size = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+		ctx->sq_ring_size = ctx->cq_ring_size =
+			I_MAX(ctx->sq_ring_size, ctx->cq_ring_size);
+	}
+	ctx->sq_ptr = io_uring_mmap(ctx, ctx->sq_ring_size, IORING_OFF_SQ_RING);
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+		ctx->cq_ptr = ctx->sq_ptr;
+	else {
+		ctx->cq_ptr = io_uring_mmap(ctx, ctx->cq_ring_size,
+					    IORING_OFF_CQ_RING);
+	}
+	ctx->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = io_uring_mmap(ctx, ctx->sqes_size, IORING_OFF_SQES);
+
+	ctx->sq_head = PTR_OFFSET(ctx->sq_ptr, params.sq_off.head);
+	ctx->sq_tail = PTR_OFFSET(ctx->sq_ptr, params.sq_off.tail);
+	ctx->sq_mask = PTR_OFFSET(ctx->sq_ptr, params.sq_off.ring_mask);
+	ctx->sq_array = PTR_OFFSET(ctx->sq_ptr, params.sq_off.array);
+	ctx->cq_head = PTR_OFFSET(ctx->cq_ptr, params.cq_off.head);
+	ctx->cq_tail = PTR_OFFSET(ctx->cq_ptr, params.cq_off.tail);
+	ctx->cq_mask = PTR_OFFSET(ctx->cq_ptr, params.cq_off.ring_mask);
+	ctx->cqes = PTR_OFFSET(ctx->cq_ptr, params.cq_off.cqes);
+	ctx->sq_pending = 0;
+}
+
+static void io_uring_ring_deinit(struct ioloop_handler_context *ctx)
+{
+	if (munmap(ctx->sqes, ctx->sqes_size) < 0)
+		i_error("munmap(io_uring sqes) failed: %m");
+	if (ctx->cq_ptr != ctx->sq_ptr) {
+		if (munmap(ctx->cq_ptr, ctx->cq_ring_size) < 0)
+			i_error("munmap(io_uring cq) failed: %m");
+	}
+	if (munmap(ctx->sq_ptr, ctx->sq_ring_size) < 0)
+		i_error("munmap(io_uring sq) failed: %m");
+	if (close(ctx->ring_fd) < 0)
+		i_error("close(io_uring) failed: %m");
+	ctx->ring_fd = -1;
+}
+
+void io_loop_handler_init(struct ioloop *ioloop, unsigned int initial_fd_count)
+{
+	struct ioloop_handler_context *ctx;
+
+	ioloop->handler_context = ctx = i_new(struct ioloop_handler_context, 1);
+
+	i_array_init(&ctx->fd_index, initial_fd_count);
+	i_array_init(&ctx->dirty_fds, initial_fd_count);
+	i_array_init(&ctx->events, initial_fd_count);
+	io_uring_ring_init(ctx, initial_fd_count);
+}
+
+void io_loop_handler_deinit(struct ioloop *ioloop)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct uring_fd **fds;
+	unsigned int i, count;
+
+	fds = array_get_modifiable(&ctx->fd_index, &count);
+	for (i = 0; i < count; i++)
+		i_free(fds[i]);
+
+	/* closing the ring cancels all the pending poll requests */
+	io_uring_ring_deinit(ctx);
+	array_free(&ctx->fd_index);
+	array_free(&ctx->dirty_fds);
+	array_free(&ctx->events);
+	i_free(ioloop->handler_context);
+}
+
+static unsigned int
+io_uring_submit(struct ioloop_handler_context *ctx, unsigned int min_complete,
+		int msecs)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int flags = 0;
+	int ret;
+
+	i_zero(&arg);
+	arg.sigmask_sz = _NSIG / 8;
+	if (min_complete > 0) {
+		flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		if (msecs >= 0) {
+			ts.tv_sec = msecs / 1000;
+			ts.tv_nsec = (msecs % 1000) * 1000000LL;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+		}
+	}
+
+	ret = io_uring_enter(ctx->ring_fd, ctx->sq_pending, min_complete,
+			     flags, flags == 0 ? NULL : &arg,
+			     flags == 0 ? 0 : sizeof(arg));
+	if (ret < 0) {
+		if (errno != EINTR && errno != ETIME && errno != EBUSY &&
+		    errno != EAGAIN)
+			i_fatal("io_uring_enter() failed: %m");
+	}
+	/* the kernel may have consumed only some of the SQEs */
+	ctx->sq_pending = *ctx->sq_tail -
+		__atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+	return ret < 0 ? 0 : ret;
+}
+
+static struct io_uring_sqe *io_uring_get_sqe(struct ioloop_handler_context *ctx)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head, tail, idx;
+
+	tail = *ctx->sq_tail;
+	head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head > *ctx->sq_mask) {
+		/* submission ring is full - flush it */
+		(void)io_uring_submit(ctx, 0, 0);
+		head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head > *ctx->sq_mask)
+			i_panic("io_uring: Submission queue stays full");
+	}
+
+	idx = tail & *ctx->sq_mask;
+	sqe = &ctx->sqes[idx];
+	i_zero(sqe);
+	ctx->sq_array[idx] = idx;
+	__atomic_store_n(ctx->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ctx->sq_pending++;
+	return sqe;
+}
+
+static void
+io_uring_queue_poll_add(struct ioloop_handler_context *ctx, int fd,
+			struct uring_fd *ufd, unsigned int mask)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ctx);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	sqe->poll32_events = (mask << 16) | (mask >> 16);
+#else
+	sqe->poll32_events = mask;
+#endif
+	sqe->user_data = URING_USER_DATA(fd, ufd->gen);
+
+	ufd->armed = TRUE;
+	ufd->armed_mask = mask;
+	ctx->armed_count++;
+}
+
+static void
+io_uring_queue_poll_remove(struct ioloop_handler_context *ctx, int fd,
+			   struct uring_fd *ufd)
+{
+	struct io_uring_sqe *sqe;
+
+	i_assert(ufd->armed);
+
+	sqe = io_uring_get_sqe(ctx);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = URING_USER_DATA(fd, ufd->gen);
+	sqe->user_data = URING_USER_DATA_IGNORE;
+
+	ufd->armed = FALSE;
+	ufd->gen++;
+	i_assert(ctx->armed_count > 0);
+	ctx->armed_count--;
+}
+
+static unsigned int io_uring_event_mask(const struct io_list *list)
+{
+	unsigned int events = 0;
+	struct io_file *io;
+	int i;
+
+	for (i = 0; i < IOLOOP_IOLIST_IOS_PER_FD; i++) {
+		io = list->ios[i];
+
+		if (io == NULL)
+			continue;
+
+		if ((io->io.condition & IO_READ) != 0)
+			events |= IO_URING_INPUT;
+		if ((io->io.condition & IO_WRITE) != 0)
+			events |= IO_URING_OUTPUT;
+		if ((io->io.condition & IO_ERROR) != 0)
+			events |= IO_URING_ERROR;
+	}
+	return events;
+}
+
+static void
+io_uring_fd_set_dirty(struct ioloop_handler_context *ctx, int fd,
+		      struct uring_fd *ufd)
+{
+	uint32_t fd32 = fd;
+
+	if (ufd->dirty)
+		return;
+	ufd->dirty = TRUE;
+	array_push_back(&ctx->dirty_fds, &fd32);
+}
+
+static void io_uring_update_fd(struct ioloop_handler_context *ctx, int fd)
+{
+	struct uring_fd *ufd;
+	unsigned int mask;
+
+	ufd = array_idx_elem(&ctx->fd_index, fd);
+	i_assert(ufd->dirty);
+	ufd->dirty = FALSE;
+
+	mask = io_uring_event_mask(&ufd->list);
+	if (ufd->armed) {
+		if (ufd->armed_mask == mask)
+			return;
+		io_uring_queue_poll_remove(ctx, fd, ufd);
+	}
+	if (mask != 0)
+		io_uring_queue_poll_add(ctx, fd, ufd, mask);
+}
+
+static void io_uring_update_dirty_fds(struct ioloop_handler_context *ctx)
+{
+	const uint32_t *fds;
+	unsigned int count;
+
+	/* Polls for fds that are already ready complete in the submission
+	   order. Submit the most recently changed fds first, which matches
+	   the newest-first io_files ordering of the poll and select
+	   handlers. */
+	fds = array_get(&ctx->dirty_fds, &count);
+	while (count > 0)
+		io_uring_update_fd(ctx, fds[--count]);
+	array_clear(&ctx->dirty_fds);
+}
+
+void io_loop_handle_add(struct io_file *io)
+{
+	struct ioloop_handler_context *ctx = io->io.ioloop->handler_context;
+	struct uring_fd **ufdp;
+
+	ufdp = array_idx_get_space(&ctx->fd_index, io->fd);
+	if (*ufdp == NULL)
+		*ufdp = i_new(struct uring_fd, 1);
+
+	(void)ioloop_iolist_add(&(*ufdp)->list, io);
+	/* the poll request is (re)armed lazily just before waiting */
+	io_uring_fd_set_dirty(ctx, io->fd, *ufdp);
+}
+
+void io_loop_handle_remove(struct io_file *io, bool closed ATTR_UNUSED)
+{
+	struct ioloop_handler_context *ctx = io->io.ioloop->handler_context;
+	struct uring_fd *ufd;
+	bool last;
+
+	ufd = array_idx_elem(&ctx->fd_index, io->fd);
+	last = ioloop_iolist_del(&ufd->list, io);
+
+	if (last && ufd->armed) {
+		/* Unlike with epoll, a poll request keeps a reference to the
+		   file even after the fd is closed, so it always needs to be
+		   cancelled. Do it immediately, since the fd number may get
+		   reused before the next loop iteration. */
+		io_uring_queue_poll_remove(ctx, io->fd, ufd);
+	} else if (!last) {
+		io_uring_fd_set_dirty(ctx, io->fd, ufd);
+	}
+	i_free(io);
+}
+
+void io_loop_recreate(struct ioloop *ioloop)
+{
+	if (ioloop == NULL ||
+	    ioloop->handler_context == NULL)
+		return;
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct uring_fd **fds;
+	unsigned int i, count;
+
+	/* The rings are shared with the parent process after fork().
+	   Create a new ring and re-add all the fds to it. */
+	io_uring_ring_deinit(ctx);
+	io_uring_ring_init(ctx, array_count(&ctx->fd_index));
+	ctx->armed_count = 0;
+	array_clear(&ctx->dirty_fds);
+
+	fds = array_get_modifiable(&ctx->fd_index, &count);
+	for (i = 0; i < count; i++) {
+		if (fds[i] == NULL)
+			continue;
+		fds[i]->armed = FALSE;
+		fds[i]->dirty = FALSE;
+		fds[i]->gen++;
+		io_uring_fd_set_dirty(ctx, i, fds[i]);
+	}
+}
+
+static void io_uring_read_events(struct ioloop_handler_context *ctx)
+{
+	const struct io_uring_cqe *cqe;
+	struct uring_event *event;
+	unsigned int head, tail;
+
+	array_clear(&ctx->events);
+	head = *ctx->cq_head;
+	tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &ctx->cqes[head & *ctx->cq_mask];
+		if (cqe->user_data == URING_USER_DATA_IGNORE)
+			continue;
+		event = array_append_space(&ctx->events);
+		event->user_data = cqe->user_data;
+		event->res = cqe->res;
+	}
+	__atomic_store_n(ctx->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void
+io_uring_handle_event(struct ioloop *ioloop, const struct uring_event *event)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct uring_fd *ufd;
+	struct io_file *io;
+	unsigned int revents;
+	int fd = (int)(event->user_data & 0xffffffff);
+	uint32_t gen = event->user_data >> 32;
+	bool call;
+	int j;
+
+	if (event->res == -ECANCELED)
+		return;
+	if ((unsigned int)fd >= array_count(&ctx->fd_index))
+		return;
+	ufd = array_idx_elem(&ctx->fd_index, fd);
+	if (ufd == NULL || !ufd->armed || ufd->gen != gen) {
+		/* completion of an already cancelled request */
+		return;
+	}
+
+	/* the one-shot poll request is now consumed */
+	ufd->armed = FALSE;
+	ufd->gen++;
+	i_assert(ctx->armed_count > 0);
+	ctx->armed_count--;
+	io_uring_fd_set_dirty(ctx, fd, ufd);
+
+	revents = event->res < 0 ? POLLERR : (unsigned int)event->res;
+	for (j = 0; j < IOLOOP_IOLIST_IOS_PER_FD; j++) {
+		io = ufd->list.ios[j];
+		if (io == NULL)
+			continue;
+
+		call = FALSE;
+		if ((revents & (POLLHUP | POLLERR | POLLNVAL)) != 0)
+			call = TRUE;
+		else if ((io->io.condition & IO_READ) != 0)
+			call = (revents & (POLLIN | POLLPRI)) != 0;
+		else if ((io->io.condition & IO_WRITE) != 0)
+			call = (revents & POLLOUT) != 0;
+		else if ((io->io.condition & IO_ERROR) != 0)
+			call = (revents & IO_URING_ERROR) != 0;
+
+		if (call) {
+			io_loop_call_io(&io->io);
+			if (!ioloop->running)
+				return;
+		}
+	}
+}
+
+void io_loop_handler_run_internal(struct ioloop *ioloop)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	const struct uring_event *event;
+	struct timeval tv;
+	unsigned int i, count;
+	int msecs;
+
+	i_assert(ctx != NULL);
+
+	/* get the time left for next timeout task */
+	msecs = io_loop_run_get_wait_time(ioloop, &tv);
+
+	io_uring_update_dirty_fds(ctx);
+	if (ioloop->io_files != NULL && ctx->armed_count > 0) {
+		/* submit all the queued changes and wait for events with
+		   a single syscall */
+		(void)io_uring_submit(ctx, 1, msecs);
+	} else {
+		/* no I/Os, but we should have some timeouts.
+		   just wait for them. */
+		if (ctx->sq_pending > 0)
+			(void)io_uring_submit(ctx, 0, 0);
+		i_assert(msecs >= 0);
+		i_sleep_intr_msecs(msecs);
+	}
+	io_uring_read_events(ctx);
+
+	/* execute timeout handlers */
+	io_loop_handle_timeouts(ioloop);
+
+	if (!ioloop->running)
+		return;
+
+	/* the callbacks may run the ioloop recursively, which can cause
+	   events array reallocation, so we have use array_idx() */
+	count = array_count(&ctx->events);
+	for (i = 0; i < count; i++) {
+		event = array_idx(&ctx->events, i);
+		io_uring_handle_event(ioloop, event);
+		if (!ioloop->running)
+			return;
+	}
+}
+
+#endif	/* IOLOOP_URING */
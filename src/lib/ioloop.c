@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "hash.h"
 #include "backtrace-string.h"
 #include "llist.h"
 #include "time-util.h"
@@ -29,6 +30,11 @@ struct timeval ioloop_timeval;
 struct ioloop *current_ioloop = NULL;
 uint64_t ioloop_global_wait_usecs = 0;
 
+static bool ioloop_callback_profiling = FALSE;
+static HASH_TABLE(struct io_loop_callback_profile *,
+		  struct io_loop_callback_profile *) ioloop_callback_profiles;
+static ARRAY(struct io_loop_callback_profile *) ioloop_callback_profile_list;
+
 static ARRAY(io_switch_callback_t *) io_switch_callbacks = ARRAY_INIT;
 static ARRAY(io_destroy_callback_t *) io_destroy_callbacks = ARRAY_INIT;
 static bool panic_on_leak = FALSE, panic_on_leak_set = FALSE;
@@ -640,6 +646,96 @@ static void ioloop_add_wait_time(struct ioloop *ioloop)
 		timer->usecs += diff;
 }
 
+static unsigned int
+io_loop_callback_profile_hash(const struct io_loop_callback_profile *profile)
+{
+	return str_hash(profile->source_filename) ^ profile->source_linenum;
+}
+
+static int
+io_loop_callback_profile_cmp(const struct io_loop_callback_profile *profile1,
+			     const struct io_loop_callback_profile *profile2)
+{
+	if (profile1->source_linenum != profile2->source_linenum)
+		return 1;
+	return strcmp(profile1->source_filename, profile2->source_filename);
+}
+
+static void
+io_loop_callback_profile_add(const char *source_filename,
+			     unsigned int source_linenum, bool timeout,
+			     uint64_t start_nsecs)
+{
+	struct io_loop_callback_profile lookup, *profile;
+
+	/* the callback may have disabled profiling */
+	if (!ioloop_callback_profiling)
+		return;
+
+	i_zero(&lookup);
+	lookup.source_filename = source_filename;
+	lookup.source_linenum = source_linenum;
+	profile = hash_table_lookup(ioloop_callback_profiles, &lookup);
+	if (profile == NULL) {
+		size_t name_size = strlen(source_filename) + 1;
+
+		/* Copy the filename together with the profile. It may point to
+		   a plugin that is unloaded before the profile is sent. */
+		profile = i_malloc(sizeof(*profile) + name_size);
+		memcpy(profile + 1, source_filename, name_size);
+		profile->source_filename = (const char *)(profile + 1);
+		profile->source_linenum = source_linenum;
+		profile->timeout = timeout;
+		hash_table_insert(ioloop_callback_profiles, profile, profile);
+		array_push_back(&ioloop_callback_profile_list, &profile);
+	}
+	profile->call_count++;
+	profile->nsecs += i_nanoseconds() - start_nsecs;
+}
+
+void io_loop_set_callback_profiling(bool enable)
+{
+	struct io_loop_callback_profile *profile;
+
+	if (enable == ioloop_callback_profiling)
+		return;
+	ioloop_callback_profiling = enable;
+
+	if (enable) {
+		hash_table_create(&ioloop_callback_profiles, default_pool, 0,
+				  io_loop_callback_profile_hash,
+				  io_loop_callback_profile_cmp);
+		i_array_init(&ioloop_callback_profile_list, 32);
+	} else {
+		hash_table_destroy(&ioloop_callback_profiles);
+		array_foreach_elem(&ioloop_callback_profile_list, profile)
+			i_free(profile);
+		array_free(&ioloop_callback_profile_list);
+	}
+}
+
+const struct io_loop_callback_profile *const *
+io_loop_get_callback_profiles(unsigned int *count_r)
+{
+	if (!ioloop_callback_profiling) {
+		*count_r = 0;
+		return NULL;
+	}
+	return (const void *)array_get(&ioloop_callback_profile_list, count_r);
+}
+
+void io_loop_reset_callback_profiles(void)
+{
+	struct io_loop_callback_profile *profile;
+
+	if (!ioloop_callback_profiling)
+		return;
+	array_foreach_elem(&ioloop_callback_profile_list, profile) {
+		profile->call_count = 0;
+		profile->nsecs = 0;
+	}
+}
+
 static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 {
 	struct priorityq_item *item;
@@ -699,7 +795,19 @@ static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 			io_loop_context_activate(timeout->ctx);
 		t_id = t_push_named("ioloop timeout handler %p",
 				    (void *)timeout->callback);
-		timeout->callback(timeout->context);
+		if (unlikely(ioloop_callback_profiling)) {
+			/* the timeout may be freed by the callback */
+			const char *source_filename = timeout->source_filename;
+			unsigned int source_linenum = timeout->source_linenum;
+			uint64_t start_nsecs = i_nanoseconds();
+
+			timeout->callback(timeout->context);
+			io_loop_callback_profile_add(source_filename,
+						     source_linenum, TRUE,
+						     start_nsecs);
+		} else {
+			timeout->callback(timeout->context);
+		}
 		if (!t_pop(&t_id)) {
 			i_panic("Leaked a t_pop() call in timeout handler %p",
 				(void *)timeout->callback);
@@ -732,6 +840,10 @@ void io_loop_call_io(struct io *io)
 {
 	struct ioloop *ioloop = io->ioloop;
 	data_stack_frame_t t_id;
+	/* the io may be freed by the callback */
+	const char *source_filename = io->source_filename;
+	unsigned int source_linenum = io->source_linenum;
+	uint64_t start_nsecs = 0;
 
 	if (io->pending) {
 		i_assert(ioloop->io_pending_count > 0);
@@ -743,7 +855,13 @@ void io_loop_call_io(struct io *io)
 		io_loop_context_activate(io->ctx);
 	t_id = t_push_named("ioloop handler %p",
 			    (void *)io->callback);
+	if (unlikely(ioloop_callback_profiling))
+		start_nsecs = i_nanoseconds();
 	io->callback(io->context);
+	if (unlikely(start_nsecs != 0)) {
+		io_loop_callback_profile_add(source_filename, source_linenum,
+					     FALSE, start_nsecs);
+	}
 	if (!t_pop(&t_id)) {
 		i_panic("Leaked a t_pop() call in I/O handler %p",
 			(void *)io->callback);
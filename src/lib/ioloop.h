@@ -321,7 +321,29 @@ uint64_t io_loop_get_wait_usecs(struct ioloop *ioloop);
    all the file ios in the ioloop. */
 enum io_condition io_loop_find_fd_conditions(struct ioloop *ioloop, int fd);
 
-#ifdef IOLOOP_KQUEUE
+struct io_loop_callback_profile {
+	/* Where the io or timeout was added */
+	const char *source_filename;
+	unsigned int source_linenum;
+	/* TRUE for timeout callbacks, FALSE for I/O callbacks */
+	bool timeout;
+
+	uint64_t call_count;
+	uint64_t nsecs;
+};
+
+/* Enable/disable measuring the time spent in each I/O and timeout callback in
+   all ioloops. The callbacks are grouped by the source location where the
+   io or timeout was added. Disabling frees the measurements. */
+void io_loop_set_callback_profiling(bool enable);
+/* Returns the measurements so far. The array is valid until the next
+   callback is run. */
+const struct io_loop_callback_profile *const *
+io_loop_get_callback_profiles(unsigned int *count_r);
+/* Reset the measurements to zero. */
+void io_loop_reset_callback_profiles(void);
+
+#if defined(IOLOOP_KQUEUE) || defined(IOLOOP_URING)
 void io_loop_recreate(struct ioloop *ioloop);
 #else
 #  define io_loop_recreate(x)
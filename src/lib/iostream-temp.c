@@ -340,6 +340,24 @@ struct ostream *iostream_temp_create_sized(const char *temp_path_prefix,
 	return output;
 }
 
+void o_stream_temp_set_size_hint(struct ostream *output, uoff_t size)
+{
+	struct temp_ostream *tstream =
+		container_of(output->real_stream, struct temp_ostream, ostream);
+
+	i_assert(output->offset == 0);
+	i_assert(tstream->buf != NULL && tstream->buf->used == 0);
+
+	if (size > tstream->max_mem_size) {
+		/* if creating the temp file fails, the data is kept in
+		   memory */
+		(void)o_stream_temp_move_to_fd(tstream);
+	} else if (size > buffer_get_size(tstream->buf)) {
+		buffer_free(&tstream->buf);
+		tstream->buf = buffer_create_dynamic(default_pool, size);
+	}
+}
+
 static void iostream_temp_buf_destroyed(buffer_t *buf)
 {
 	buffer_free(&buf);
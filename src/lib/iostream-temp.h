@@ -19,6 +19,11 @@ struct ostream *iostream_temp_create_sized(const char *temp_path_prefix,
 					   enum iostream_temp_flags flags,
 					   const char *name,
 					   size_t max_mem_size);
+/* Tell how large the written data is expected to become. This must be called
+   before anything is written. If the data won't fit to memory, it's written
+   directly to the temporary file. Otherwise the memory buffer is allocated
+   large enough upfront. */
+void o_stream_temp_set_size_hint(struct ostream *output, uoff_t size);
 /* Finished writing to stream. Return input stream for it and free the
    output stream. (It's also possible to abort iostream-temp by simply
    destroying the ostream.) */
@@ -0,0 +1,109 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "mmap-util.h"
+#include "istream-private.h"
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Smaller files are cheaper to read() than to mmap() */
+#define ISTREAM_MMAP_MIN_SIZE (32*1024)
+
+struct mmap_istream {
+	struct istream_private istream;
+
+	void *mmap_base;
+	size_t mmap_size;
+};
+
+static void i_stream_mmap_close(struct iostream_private *stream,
+				bool close_parent ATTR_UNUSED)
+{
+	struct istream_private *_stream =
+		container_of(stream, struct istream_private, iostream);
+	struct mmap_istream *mstream =
+		container_of(_stream, struct mmap_istream, istream);
+
+	if (mstream->mmap_base != NULL) {
+		if (munmap(mstream->mmap_base, mstream->mmap_size) < 0) {
+			i_error("mmap_istream.munmap(%s) failed: %m",
+				i_stream_get_name(&_stream->istream));
+		}
+		mstream->mmap_base = NULL;
+		_stream->buffer = NULL;
+		_stream->pos = _stream->skip = 0;
+	}
+	if (_stream->fd != -1) {
+		if (close(_stream->fd) < 0) {
+			i_error("mmap_istream.close(%s) failed: %m",
+				i_stream_get_name(&_stream->istream));
+		}
+	}
+	_stream->fd = -1;
+}
+
+static ssize_t i_stream_mmap_read(struct istream_private *stream)
+{
+	/* the whole file is already in the buffer */
+	stream->istream.eof = TRUE;
+	return -1;
+}
+
+static void i_stream_mmap_seek(struct istream_private *stream, uoff_t v_offset,
+			       bool mark ATTR_UNUSED)
+{
+	if (v_offset > stream->pos) {
+		/* seeking past the end of the file */
+		v_offset = stream->pos;
+		stream->istream.eof = TRUE;
+	}
+	stream->skip = v_offset;
+	stream->istream.v_offset = v_offset;
+}
+
+struct istream *i_stream_create_mmap_autoclose(int *fd, size_t max_buffer_size)
+{
+	struct mmap_istream *mstream;
+	struct istream *input;
+	struct stat st;
+	void *mmap_base;
+
+	i_assert(*fd != -1);
+
+	if (fstat(*fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    st.st_size < ISTREAM_MMAP_MIN_SIZE)
+		return i_stream_create_fd_autoclose(fd, max_buffer_size);
+#if OFF_T_MAX > SSIZE_T_MAX
+	if (st.st_size > SSIZE_T_MAX)
+		return i_stream_create_fd_autoclose(fd, max_buffer_size);
+#endif
+	mmap_base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+			 *fd, 0);
+	if (mmap_base == MAP_FAILED) {
+		/* e.g. the filesystem doesn't support mmap() */
+		return i_stream_create_fd_autoclose(fd, max_buffer_size);
+	}
+	(void)madvise(mmap_base, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	mstream = i_new(struct mmap_istream, 1);
+	mstream->mmap_base = mmap_base;
+	mstream->mmap_size = (size_t)st.st_size;
+
+	mstream->istream.iostream.close = i_stream_mmap_close;
+	mstream->istream.buffer = mmap_base;
+	mstream->istream.pos = mstream->mmap_size;
+	mstream->istream.max_buffer_size = SIZE_MAX;
+	mstream->istream.read = i_stream_mmap_read;
+	mstream->istream.seek = i_stream_mmap_seek;
+
+	mstream->istream.istream.readable_fd = TRUE;
+	mstream->istream.istream.blocking = TRUE;
+	mstream->istream.istream.seekable = TRUE;
+	input = i_stream_create(&mstream->istream, NULL, *fd,
+				ISTREAM_CREATE_FLAG_NOOP_SNAPSHOT);
+	mstream->istream.statbuf = st;
+	i_stream_set_name(input, "(mmap)");
+	*fd = -1;
+	return input;
+}
@@ -41,6 +41,13 @@ typedef void istream_callback_t(void *context);
 struct istream *i_stream_create_fd(int fd, size_t max_buffer_size);
 /* The fd is set to -1 immediately to avoid accidentally closing it twice. */
 struct istream *i_stream_create_fd_autoclose(int *fd, size_t max_buffer_size);
+/* Like i_stream_create_fd_autoclose(), but mmap() the whole regular file and
+   return data directly from the mapping without copying it. Small files and
+   files that can't be mmap()ed fall back to i_stream_create_fd_autoclose().
+   max_buffer_size is used only by the fallback stream, since the mapping
+   always covers the whole file. The file must not be truncated while the
+   stream exists. */
+struct istream *i_stream_create_mmap_autoclose(int *fd, size_t max_buffer_size);
 /* Open the given path only when something is actually tried to be read from
    the stream. */
 struct istream *i_stream_create_file(const char *path, size_t max_buffer_size);
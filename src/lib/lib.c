@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "dovecot-version.h"
+#include "alloc-profile.h"
 #include "array.h"
 #include "event-filter.h"
 #include "env-util.h"
@@ -197,6 +198,7 @@ void lib_deinit(void)
 	lib_event_deinit();
 	restrict_access_deinit();
 	i_close_fd(&dev_null_fd);
+	alloc_profile_deinit();
 	data_stack_deinit();
 	failures_deinit();
 	process_title_deinit();
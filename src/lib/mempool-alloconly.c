@@ -2,6 +2,7 @@
 
 /* @UNSAFE: whole file */
 #include "lib.h"
+#include "alloc-profile.h"
 #include "safe-memset.h"
 #include "mempool.h"
 
@@ -125,6 +126,8 @@ struct alloconly_pool {
 	int refcount;
 
 	struct pool_block *block;
+	/* non-NULL if allocation profiling was enabled at creation */
+	struct alloc_profile *profile;
 #ifdef DEBUG
 	const char *name;
 	size_t base_size;
@@ -225,7 +228,7 @@ static void check_sentries(struct pool_block *block)
 }
 #endif
 
-pool_t pool_alloconly_create(const char *name ATTR_UNUSED, size_t size)
+pool_t pool_alloconly_create(const char *name, size_t size)
 {
 	struct alloconly_pool apool, *new_apool;
 	size_t min_alloc = SIZEOF_POOLBLOCK +
@@ -243,6 +246,13 @@ pool_t pool_alloconly_create(const char *name ATTR_UNUSED, size_t size)
 	i_zero(&apool);
 	apool.pool = static_alloconly_pool;
 	apool.refcount = 1;
+	if (unlikely(alloc_profiling)) {
+		const char *profile_name = name;
+
+		(void)str_begins(name, MEMPOOL_GROWING, &profile_name);
+		apool.profile = alloc_profile_get(ALLOC_PROFILE_TYPE_POOL,
+						  profile_name);
+	}
 
 	if (size < min_alloc)
 		size = nearest_power(size + min_alloc);
@@ -391,6 +401,17 @@ static void block_alloc(struct alloconly_pool *apool, size_t size)
 
 	block->size = size - SIZEOF_POOLBLOCK;
 	block->left = block->size;
+
+	if (unlikely(alloc_profiling) && apool->profile != NULL) {
+		if (block->prev == NULL)
+			alloc_profile_add(apool->profile, size);
+		else {
+			apool->profile->bytes += size;
+			if (apool->profile->max_bytes < size)
+				apool->profile->max_bytes = size;
+			apool->profile->grow_count++;
+		}
+	}
 }
 
 static void *pool_alloconly_malloc(pool_t pool, size_t size)
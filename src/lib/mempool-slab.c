@@ -0,0 +1,515 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+/* @UNSAFE: whole file */
+#include "lib.h"
+#include "mempool.h"
+#include "llist.h"
+
+/*
+ * Slab pools support both allocating and freeing memory, like allocfree
+ * pools, but small allocations are served from per-size-class slabs instead
+ * of one malloc() per allocation.
+ *
+ * Implementation
+ * ==============
+ *
+ * Allocations up to the largest size class are rounded up to the nearest
+ * size class. Each size class has a list of slabs with free chunks and a
+ * list of full slabs. A slab is a single malloc()ed area containing the
+ * struct slab header followed by a fixed number of equally sized chunks:
+ *
+ * +------+--------+--------+--------+-----+
+ * | slab | header | header | header | ... |
+ * |      |  data  |  data  |  data  |     |
+ * +------+--------+--------+--------+-----+
+ *
+ * Each chunk's header points to its slab, so p_free() finds the slab (and
+ * the size class) directly from the pointer. Freed chunks are added to the
+ * slab's free list, which is stored inside the freed chunks' data. Chunks
+ * that haven't been used yet are taken from the end of the slab.
+ *
+ * When a slab becomes empty it's free()d, unless it's the only slab in its
+ * size class with free chunks. This way alternating allocations and frees
+ * don't keep malloc()ing and free()ing the same slab.
+ *
+ * Allocations larger than the largest size class are malloc()ed separately
+ * and kept in a doubly-linked list, similar to allocfree pools. Their
+ * header's slab pointer is NULL.
+ *
+ * Clearing and destruction free all the slabs and large allocations.
+ */
+
+#define SLAB_MIN_SIZE 4096
+#define SLAB_MIN_CHUNK_COUNT 8
+
+static const size_t slab_chunk_sizes[] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+#define SLAB_CLASS_COUNT N_ELEMENTS(slab_chunk_sizes)
+#define SLAB_MAX_CHUNK_SIZE slab_chunk_sizes[SLAB_CLASS_COUNT-1]
+
+struct slab {
+	struct slab *prev, *next;
+	struct slab_class *class;
+
+	/* Linked list of freed chunks' data */
+	void *free_list;
+	/* Number of chunks that have never been allocated, at the end of
+	   the slab */
+	unsigned int unused_count;
+	unsigned int used_count;
+	/* unsigned char chunks[]; */
+};
+
+struct slab_chunk_header {
+	/* NULL for large allocations */
+	struct slab *slab;
+};
+
+struct slab_large {
+	struct slab_large *prev, *next;
+	size_t size;
+	/* Must be the last field, so it's at the same position as
+	   struct slab_chunk_header's slab. Always NULL. */
+	struct slab *slab;
+};
+
+struct slab_class {
+	/* Slabs with free chunks */
+	struct slab *partial_slabs;
+	/* Slabs without free chunks */
+	struct slab *full_slabs;
+
+	struct pool_slab_stats stats;
+};
+
+struct slab_pool {
+	struct pool pool;
+	int refcount;
+
+	struct slab_class classes[SLAB_CLASS_COUNT];
+	struct slab_large *large_allocs;
+	struct pool_slab_stats large_stats;
+#ifdef DEBUG
+	char *name;
+#endif
+};
+
+#define SIZEOF_SLAB MEM_ALIGN(sizeof(struct slab))
+#define SIZEOF_SLAB_CHUNK_HEADER MEM_ALIGN(sizeof(struct slab_chunk_header))
+#define SIZEOF_SLAB_LARGE MEM_ALIGN(sizeof(struct slab_large))
+
+#define SLAB_CHUNK_DATA(chunk) \
+	PTR_OFFSET(chunk, SIZEOF_SLAB_CHUNK_HEADER)
+
+static const char *pool_slab_get_name(pool_t pool);
+static void pool_slab_ref(pool_t pool);
+static void pool_slab_unref(pool_t *pool);
+static void *pool_slab_malloc(pool_t pool, size_t size);
+static void pool_slab_free(pool_t pool, void *mem);
+static void *pool_slab_realloc(pool_t pool, void *mem,
+			       size_t old_size, size_t new_size);
+static void pool_slab_clear(pool_t pool);
+static size_t pool_slab_get_max_easy_alloc_size(pool_t pool);
+
+static const struct pool_vfuncs static_slab_pool_vfuncs = {
+	pool_slab_get_name,
+
+	pool_slab_ref,
+	pool_slab_unref,
+
+	pool_slab_malloc,
+	pool_slab_free,
+
+	pool_slab_realloc,
+
+	pool_slab_clear,
+	pool_slab_get_max_easy_alloc_size
+};
+
+static const struct pool static_slab_pool = {
+	.v = &static_slab_pool_vfuncs,
+
+	.alloconly_pool = FALSE,
+	.datastack_pool = FALSE
+};
+
+pool_t pool_slab_create(const char *name ATTR_UNUSED)
+{
+	struct slab_pool *spool;
+
+	(void) COMPILE_ERROR_IF_TRUE(SIZEOF_SLAB_LARGE >
+				     (SSIZE_T_MAX - POOL_MAX_ALLOC_SIZE));
+	(void) COMPILE_ERROR_IF_TRUE(offsetof(struct slab_large, slab) +
+				     sizeof(struct slab *) !=
+				     sizeof(struct slab_large));
+
+	spool = calloc(1, sizeof(*spool));
+	if (spool == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "calloc(1, %zu): Out of memory",
+			       sizeof(*spool));
+#ifdef DEBUG
+	spool->name = strdup(name);
+#endif
+	spool->pool = static_slab_pool;
+	spool->refcount = 1;
+	for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++)
+		spool->classes[i].stats.chunk_size = slab_chunk_sizes[i];
+	return &spool->pool;
+}
+
+static void pool_slab_destroy(struct slab_pool *spool)
+{
+	pool_slab_clear(&spool->pool);
+#ifdef DEBUG
+	free(spool->name);
+#endif
+	free(spool);
+}
+
+static const char *pool_slab_get_name(pool_t pool ATTR_UNUSED)
+{
+#ifdef DEBUG
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	return spool->name;
+#else
+	return "slab";
+#endif
+}
+
+static void pool_slab_ref(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	i_assert(spool->refcount > 0);
+
+	spool->refcount++;
+}
+
+static void pool_slab_unref(pool_t *_pool)
+{
+	pool_t pool = *_pool;
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	i_assert(spool->refcount > 0);
+
+	/* erase the pointer before freeing anything, as the pointer may
+	   exist inside the pool's memory area */
+	*_pool = NULL;
+
+	if (--spool->refcount > 0)
+		return;
+
+	pool_slab_destroy(spool);
+}
+
+static struct slab_class *
+slab_class_find(struct slab_pool *spool, size_t size)
+{
+	for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		if (size <= slab_chunk_sizes[i])
+			return &spool->classes[i];
+	}
+	return NULL;
+}
+
+static unsigned int slab_class_chunk_count(const struct slab_class *class)
+{
+	size_t chunk_alloc_size =
+		SIZEOF_SLAB_CHUNK_HEADER + class->stats.chunk_size;
+
+	return I_MAX(SLAB_MIN_CHUNK_COUNT,
+		     (SLAB_MIN_SIZE - SIZEOF_SLAB) / chunk_alloc_size);
+}
+
+static struct slab *slab_alloc(struct slab_class *class)
+{
+	struct slab *slab;
+	unsigned int chunk_count = slab_class_chunk_count(class);
+	size_t size = SIZEOF_SLAB + chunk_count *
+		(SIZEOF_SLAB_CHUNK_HEADER + class->stats.chunk_size);
+
+	slab = malloc(size);
+	if (slab == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "malloc(%zu): Out of memory",
+			       size);
+	slab->prev = slab->next = NULL;
+	slab->class = class;
+	slab->free_list = NULL;
+	slab->unused_count = chunk_count;
+	slab->used_count = 0;
+
+	DLLIST_PREPEND(&class->partial_slabs, slab);
+	class->stats.slab_count++;
+	class->stats.alloc_size += size;
+	return slab;
+}
+
+static void slab_free(struct slab_class *class, struct slab *slab)
+{
+	i_assert(slab->used_count == 0);
+
+	DLLIST_REMOVE(&class->partial_slabs, slab);
+	class->stats.slab_count--;
+	class->stats.alloc_size -= SIZEOF_SLAB + slab_class_chunk_count(class) *
+		(SIZEOF_SLAB_CHUNK_HEADER + class->stats.chunk_size);
+	free(slab);
+}
+
+static void *slab_chunk_alloc(struct slab_class *class)
+{
+	struct slab *slab = class->partial_slabs;
+	struct slab_chunk_header *chunk;
+	void *mem;
+
+	if (slab == NULL)
+		slab = slab_alloc(class);
+
+	if (slab->free_list != NULL) {
+		mem = slab->free_list;
+		slab->free_list = *(void **)mem;
+	} else {
+		unsigned int chunk_idx;
+
+		i_assert(slab->unused_count > 0);
+		chunk_idx = slab_class_chunk_count(class) - slab->unused_count;
+		chunk = PTR_OFFSET(slab, SIZEOF_SLAB + chunk_idx *
+			(SIZEOF_SLAB_CHUNK_HEADER + class->stats.chunk_size));
+		chunk->slab = slab;
+		mem = SLAB_CHUNK_DATA(chunk);
+		slab->unused_count--;
+	}
+	slab->used_count++;
+
+	if (slab->free_list == NULL && slab->unused_count == 0) {
+		/* slab is full */
+		DLLIST_REMOVE(&class->partial_slabs, slab);
+		DLLIST_PREPEND(&class->full_slabs, slab);
+	}
+	class->stats.used_count++;
+	class->stats.total_alloc_count++;
+	return mem;
+}
+
+static void slab_chunk_free(struct slab *slab, void *mem)
+{
+	struct slab_class *class = slab->class;
+
+	i_assert(slab->used_count > 0);
+
+	if (slab->free_list == NULL && slab->unused_count == 0) {
+		/* slab was full */
+		DLLIST_REMOVE(&class->full_slabs, slab);
+		DLLIST_PREPEND(&class->partial_slabs, slab);
+	}
+	*(void **)mem = slab->free_list;
+	slab->free_list = mem;
+	slab->used_count--;
+	class->stats.used_count--;
+
+	if (slab->used_count == 0 &&
+	    (slab->prev != NULL || slab->next != NULL)) {
+		/* keep the last partial slab to avoid malloc()ing it again
+		   immediately, but free the other empty slabs */
+		slab_free(class, slab);
+	}
+}
+
+static void *slab_large_attach(struct slab_pool *spool,
+			       struct slab_large *large, size_t size)
+{
+	large->size = size;
+	large->slab = NULL;
+	DLLIST_PREPEND(&spool->large_allocs, large);
+	spool->large_stats.used_count++;
+	spool->large_stats.alloc_size += SIZEOF_SLAB_LARGE + size;
+	return PTR_OFFSET(large, SIZEOF_SLAB_LARGE);
+}
+
+static void slab_large_detach(struct slab_pool *spool,
+			      struct slab_large *large)
+{
+	i_assert(spool->large_stats.used_count > 0);
+
+	DLLIST_REMOVE(&spool->large_allocs, large);
+	spool->large_stats.used_count--;
+	spool->large_stats.alloc_size -= SIZEOF_SLAB_LARGE + large->size;
+}
+
+static void *slab_large_alloc(struct slab_pool *spool, size_t size)
+{
+	struct slab_large *large = calloc(1, SIZEOF_SLAB_LARGE + size);
+
+	if (large == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "calloc(1, %zu): Out of memory",
+			       SIZEOF_SLAB_LARGE + size);
+	spool->large_stats.total_alloc_count++;
+	return slab_large_attach(spool, large, size);
+}
+
+static struct slab *slab_mem_get_slab(void *mem)
+{
+	/* cannot use PTR_OFFSET because of negative value */
+	i_assert((uintptr_t)mem >= SIZEOF_SLAB_CHUNK_HEADER);
+	struct slab_chunk_header *chunk = (struct slab_chunk_header *)
+		((unsigned char *)mem - SIZEOF_SLAB_CHUNK_HEADER);
+	return chunk->slab;
+}
+
+static struct slab_large *slab_mem_get_large(void *mem)
+{
+	i_assert((uintptr_t)mem >= SIZEOF_SLAB_LARGE);
+	return (struct slab_large *)((unsigned char *)mem - SIZEOF_SLAB_LARGE);
+}
+
+static void *pool_slab_malloc(pool_t pool, size_t size)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab_class *class;
+	void *mem;
+
+	class = slab_class_find(spool, size);
+	if (class == NULL)
+		return slab_large_alloc(spool, size);
+
+	mem = slab_chunk_alloc(class);
+	memset(mem, 0, size);
+	return mem;
+}
+
+static void pool_slab_free(pool_t pool, void *mem)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab *slab = slab_mem_get_slab(mem);
+
+	if (slab != NULL) {
+		slab_chunk_free(slab, mem);
+		return;
+	}
+
+	struct slab_large *large = slab_mem_get_large(mem);
+	slab_large_detach(spool, large);
+	free(large);
+}
+
+static void *pool_slab_realloc(pool_t pool, void *mem,
+			       size_t old_size, size_t new_size)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab *slab = slab_mem_get_slab(mem);
+	void *new_mem;
+
+	if (slab != NULL) {
+		if (new_size <= slab->class->stats.chunk_size) {
+			/* fits into the same chunk */
+			if (new_size > old_size) {
+				memset(PTR_OFFSET(mem, old_size), 0,
+				       new_size - old_size);
+			}
+			return mem;
+		}
+	} else if (new_size > SLAB_MAX_CHUNK_SIZE) {
+		/* large allocation stays large */
+		struct slab_large *large = slab_mem_get_large(mem);
+		unsigned char *new_large;
+
+		slab_large_detach(spool, large);
+		new_large = realloc(large, SIZEOF_SLAB_LARGE + new_size);
+		if (new_large == NULL) {
+			i_fatal_status(FATAL_OUTOFMEM, "realloc(block, %zu)",
+				       SIZEOF_SLAB_LARGE + new_size);
+		}
+		/* zero out new memory */
+		if (new_size > old_size) {
+			memset(new_large + SIZEOF_SLAB_LARGE + old_size, 0,
+			       new_size - old_size);
+		}
+		return slab_large_attach(spool, (struct slab_large *)new_large,
+					 new_size);
+	}
+
+	/* moves between size classes */
+	new_mem = pool_slab_malloc(pool, new_size);
+	memcpy(new_mem, mem, I_MIN(old_size, new_size));
+	pool_slab_free(pool, mem);
+	return new_mem;
+}
+
+static void slab_list_free(struct slab *slab)
+{
+	struct slab *next;
+
+	for (; slab != NULL; slab = next) {
+		next = slab->next;
+		free(slab);
+	}
+}
+
+static void pool_slab_clear(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab_large *large, *next;
+
+	for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		struct slab_class *class = &spool->classes[i];
+
+		slab_list_free(class->partial_slabs);
+		slab_list_free(class->full_slabs);
+		class->partial_slabs = NULL;
+		class->full_slabs = NULL;
+		class->stats.slab_count = 0;
+		class->stats.used_count = 0;
+		class->stats.alloc_size = 0;
+	}
+	for (large = spool->large_allocs; large != NULL; large = next) {
+		next = large->next;
+		free(large);
+	}
+	spool->large_allocs = NULL;
+	spool->large_stats.used_count = 0;
+	spool->large_stats.alloc_size = 0;
+}
+
+static size_t pool_slab_get_max_easy_alloc_size(pool_t pool ATTR_UNUSED)
+{
+	return 0;
+}
+
+const struct pool_slab_stats *
+pool_slab_get_stats(pool_t pool, unsigned int *count_r)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct pool_slab_stats *stats;
+
+	i_assert(pool->v == &static_slab_pool_vfuncs);
+
+	stats = t_new(struct pool_slab_stats, SLAB_CLASS_COUNT + 1);
+	for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++)
+		stats[i] = spool->classes[i].stats;
+	stats[SLAB_CLASS_COUNT] = spool->large_stats;
+	*count_r = SLAB_CLASS_COUNT + 1;
+	return stats;
+}
+
+size_t pool_slab_get_total_used_size(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab_large *large;
+	size_t size = 0;
+
+	for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		size += spool->classes[i].stats.chunk_size *
+			spool->classes[i].stats.used_count;
+	}
+	for (large = spool->large_allocs; large != NULL; large = large->next)
+		size += large->size;
+	return size;
+}
+
+size_t pool_slab_get_total_alloc_size(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	size_t size = sizeof(*spool) + spool->large_stats.alloc_size;
+
+	for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++)
+		size += spool->classes[i].stats.alloc_size;
+	return size;
+}
@@ -82,6 +82,12 @@ pool_t pool_allocfree_create(const char *name);
    See pool_alloconly_create_clean. */
 pool_t pool_allocfree_create_clean(const char *name);
 
+/* Create a new slab pool. It supports freeing memory like alloc pool, but
+   allocations up to 2 kB are rounded up to a size class and served from
+   per-size-class slabs, reusing freed chunks. This is intended for long-lived
+   pools with many similarly sized allocations and frees. */
+pool_t pool_slab_create(const char *name);
+
 /* Similar to nearest_power(), but try not to exceed buffer's easy
    allocation size. If you don't have any explicit minimum size, use
    old_size + 1. */
@@ -178,6 +184,30 @@ size_t pool_allocfree_get_total_used_size(pool_t pool);
 /* Returns how much system memory has been allocated for this pool. */
 size_t pool_allocfree_get_total_alloc_size(pool_t pool);
 
+struct pool_slab_stats {
+	/* Size class's chunk size, or 0 for allocations larger than
+	   the largest size class */
+	size_t chunk_size;
+	/* Number of slabs currently allocated (0 for large allocations) */
+	unsigned int slab_count;
+	/* Number of allocations currently in use */
+	unsigned int used_count;
+	/* System memory currently allocated */
+	size_t alloc_size;
+	/* Total number of allocations ever done */
+	uint64_t total_alloc_count;
+};
+
+/* Returns how much memory has been allocated from this pool. The allocations
+   are counted with their size class's chunk size. */
+size_t pool_slab_get_total_used_size(pool_t pool);
+/* Returns how much system memory has been allocated for this pool. */
+size_t pool_slab_get_total_alloc_size(pool_t pool);
+/* Returns statistics for each size class, followed by the statistics for the
+   large allocations. The returned array is allocated from data stack. */
+const struct pool_slab_stats *
+pool_slab_get_stats(pool_t pool, unsigned int *count_r);
+
 /* private: */
 void pool_system_free(pool_t pool, void *mem);
 void pool_external_refs_unref(pool_t pool);
@@ -11,6 +11,8 @@ struct file_ostream {
 		 unsigned int iov_count, const char **error_r);
 
 	int fd;
+	/* pipe used for splice()ing data from sockets */
+	int splice_fds[2];
 	struct io *io;
 	uoff_t buffer_offset;
 	uoff_t real_offset;
@@ -27,6 +29,7 @@ struct file_ostream {
 	bool no_socket_nodelay:1;
 	bool no_socket_quickack:1;
 	bool no_sendfile:1;
+	bool no_splice:1;
 	bool autoclose_fd:1;
 };
 
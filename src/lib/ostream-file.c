@@ -2,6 +2,7 @@
 
 /* @UNSAFE: whole file */
 
+#define _GNU_SOURCE /* for splice() */
 #include "lib.h"
 #include "ioloop.h"
 #include "write-full.h"
@@ -29,6 +30,10 @@
 #define MAX_SSIZE_T(size) \
 	((size) < SSIZE_T_MAX ? (size_t)(size) : SSIZE_T_MAX)
 
+/* Maximum amount of data to move through the splice() pipe at once. This is
+   the default Linux pipe capacity. */
+#define MAX_SPLICE_SIZE (64*1024)
+
 static void stream_send_io(struct file_ostream *fstream);
 static struct ostream * o_stream_create_fd_common(int fd,
 		size_t max_buffer_size, bool autoclose_fd);
@@ -36,6 +41,8 @@ static struct ostream * o_stream_create_fd_common(int fd,
 static void stream_closed(struct file_ostream *fstream)
 {
 	io_remove(&fstream->io);
+	i_close_fd(&fstream->splice_fds[0]);
+	i_close_fd(&fstream->splice_fds[1]);
 
 	if (fstream->autoclose_fd && fstream->fd != -1) {
 		/* Ignore ECONNRESET because we don't really care about it here,
@@ -65,6 +72,8 @@ static void o_stream_file_destroy(struct iostream_private *stream)
 	struct file_ostream *fstream =
 		container_of(stream, struct file_ostream, ostream.iostream);
 
+	i_close_fd(&fstream->splice_fds[0]);
+	i_close_fd(&fstream->splice_fds[1]);
 	i_free(fstream->buffer);
 }
 
@@ -604,6 +613,41 @@ static size_t o_stream_add(struct file_ostream *fstream,
 	return sent;
 }
 
+/* Write the buffered data followed by the given iovec with a single
+   writev(). Returns how many bytes of the iovec were written, or -1 on
+   error. */
+static ssize_t
+o_stream_file_writev_gather(struct file_ostream *fstream,
+			    const struct const_iovec *iov,
+			    unsigned int iov_count)
+{
+	struct const_iovec *full_iov;
+	size_t used;
+	int buf_iov_count;
+	ssize_t ret;
+
+	T_BEGIN {
+		full_iov = t_new(struct const_iovec, iov_count + 2);
+		buf_iov_count = o_stream_fill_iovec(fstream, full_iov);
+		memcpy(full_iov + buf_iov_count, iov,
+		       sizeof(*iov) * iov_count);
+		ret = o_stream_file_writev_full(fstream, full_iov,
+						buf_iov_count + iov_count);
+	} T_END;
+	if (ret < 0)
+		return -1;
+
+	used = file_buffer_get_used_size(fstream);
+	if ((size_t)ret < used) {
+		/* couldn't even write all of the buffered data */
+		update_buffer(fstream, ret);
+		return 0;
+	}
+	update_buffer(fstream, used);
+	i_assert(IS_STREAM_EMPTY(fstream));
+	return ret - used;
+}
+
 ssize_t o_stream_file_sendv(struct ostream_private *stream,
 				   const struct const_iovec *iov,
 				   unsigned int iov_count)
@@ -613,25 +657,34 @@ ssize_t o_stream_file_sendv(struct ostream_private *stream,
 	size_t size, total_size, added, optimal_size;
 	unsigned int i;
 	ssize_t ret = 0;
+	bool written = FALSE;
 
 	for (i = 0, size = 0; i < iov_count; i++)
 		size += iov[i].iov_len;
 	total_size = size;
 
-	if (size > get_unused_space(fstream) && !IS_STREAM_EMPTY(fstream)) {
-		if (o_stream_file_flush(stream) < 0)
-			return -1;
-	}
-
 	optimal_size = I_MIN(fstream->optimal_block_size,
 			     fstream->ostream.max_buffer_size);
-	if (IS_STREAM_EMPTY(fstream) &&
-	    (!stream->corked || size >= optimal_size)) {
+	if (size > get_unused_space(fstream) && !IS_STREAM_EMPTY(fstream)) {
+		/* The data doesn't fit into the buffer. Instead of flushing
+		   the buffer and then writing the data separately, send
+		   both of them with the same writev(). This avoids an extra
+		   syscall when e.g. a large literal follows small protocol
+		   fragments in a corked stream. */
+		ret = o_stream_file_writev_gather(fstream, iov, iov_count);
+		if (ret < 0)
+			return -1;
+		written = TRUE;
+	} else if (IS_STREAM_EMPTY(fstream) &&
+		   (!stream->corked || size >= optimal_size)) {
 		/* send immediately */
 		ret = o_stream_file_writev_full(fstream, iov, iov_count);
 		if (ret < 0)
 			return -1;
+		written = TRUE;
+	}
 
+	if (written) {
 		size = ret;
 		while (size > 0 && iov_count > 0 && size >= iov[0].iov_len) {
 			size -= iov[0].iov_len;
@@ -856,6 +909,133 @@ io_stream_sendfile(struct ostream_private *outstream,
 	return TRUE;
 }
 
+#ifdef HAVE_SPLICE
+static int o_stream_file_splice_pipe_drain(struct file_ostream *fstream,
+					   size_t size)
+{
+	unsigned char buf[IO_BLOCK_SIZE];
+	size_t added;
+	ssize_t ret;
+
+	/* The output would block. Move the rest of the data from the pipe
+	   to our buffer, so the pipe is always empty between calls and the
+	   buffer keeps the data in the right order. */
+	while (size > 0) {
+		ret = read(fstream->splice_fds[0], buf, I_MIN(size, sizeof(buf)));
+		if (ret <= 0) {
+			i_assert(ret < 0);
+			if (errno == EINTR)
+				continue;
+			io_stream_set_error(&fstream->ostream.iostream,
+					    "read(splice pipe) failed: %m");
+			fstream->ostream.ostream.stream_errno = errno;
+			return -1;
+		}
+		added = o_stream_add(fstream, buf, ret);
+		i_assert(added == (size_t)ret);
+		fstream->ostream.ostream.offset += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+static bool
+io_stream_splice(struct ostream_private *outstream,
+		 struct istream *instream, int in_fd,
+		 enum ostream_send_istream_result *res_r)
+{
+	struct file_ostream *foutstream =
+		container_of(outstream, struct file_ostream, ostream);
+	const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+	size_t max_size, left;
+	ssize_t ret;
+
+	/* flush out any data in buffer */
+	if ((ret = buffer_flush(foutstream)) < 0) {
+		*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT;
+		return TRUE;
+	} else if (ret == 0) {
+		*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT;
+		return TRUE;
+	}
+	if (i_stream_get_data_size(instream) > 0) {
+		/* send the already buffered input the usual way first */
+		return FALSE;
+	}
+	if (foutstream->splice_fds[0] == -1) {
+		if (pipe(foutstream->splice_fds) < 0) {
+			foutstream->splice_fds[0] = -1;
+			foutstream->splice_fds[1] = -1;
+			return FALSE;
+		}
+		fd_close_on_exec(foutstream->splice_fds[0], TRUE);
+		fd_close_on_exec(foutstream->splice_fds[1], TRUE);
+	}
+
+	/* Don't move more at once than fits to the buffer in case the
+	   output ends up blocking. */
+	max_size = I_MIN(outstream->max_buffer_size, MAX_SPLICE_SIZE);
+	for (;;) {
+		ret = splice(in_fd, NULL, foutstream->splice_fds[1], NULL,
+			     max_size, flags);
+		if (ret <= 0) {
+			if (ret == 0) {
+				/* EOF - let the regular read path notice it */
+				return FALSE;
+			}
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT;
+				return TRUE;
+			}
+			if (errno == EINVAL) {
+				/* splice() not supported with these fds */
+				foutstream->no_splice = TRUE;
+				return FALSE;
+			}
+			io_stream_set_error(&instream->real_stream->iostream,
+					    "splice() failed: %m");
+			instream->stream_errno = errno;
+			instream->eof = TRUE;
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_INPUT;
+			return TRUE;
+		}
+		instream->v_offset += ret;
+
+		left = ret;
+		while (left > 0) {
+			ret = splice(foutstream->splice_fds[0], NULL,
+				     foutstream->fd, NULL, left, flags);
+			if (ret > 0) {
+				left -= ret;
+				foutstream->real_offset += ret;
+				foutstream->buffer_offset += ret;
+				outstream->ostream.offset += ret;
+			} else if (ret < 0 && errno == EINTR) {
+				continue;
+			} else if (ret < 0 && errno == EAGAIN) {
+				if (o_stream_file_splice_pipe_drain(foutstream,
+								    left) < 0) {
+					*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT;
+					return TRUE;
+				}
+				*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT;
+				return TRUE;
+			} else {
+				i_assert(ret < 0);
+				io_stream_set_error(&outstream->iostream,
+						    "splice() failed: %m");
+				outstream->ostream.stream_errno = errno;
+				stream_closed(foutstream);
+				*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT;
+				return TRUE;
+			}
+		}
+	}
+}
+#endif
+
 static enum ostream_send_istream_result
 io_stream_copy_backwards(struct ostream_private *outstream,
 			 struct istream *instream, uoff_t in_size)
@@ -997,6 +1177,16 @@ o_stream_file_send_istream(struct ostream_private *outstream,
 		   regular sending. */
 		foutstream->no_sendfile = TRUE;
 	}
+#ifdef HAVE_SPLICE
+	/* Socket to socket (e.g. proxying): move the data inside the kernel.
+	   This bypasses the istream, so it must not be wrapped by anything. */
+	if (!foutstream->no_splice && in_fd != -1 && !instream->seekable &&
+	    !foutstream->file && foutstream->writev == o_stream_file_writev &&
+	    i_stream_get_root_io(instream) == instream) {
+		if (io_stream_splice(outstream, instream, in_fd, &res))
+			return res;
+	}
+#endif
 
 	same_stream = i_stream_get_fd(instream) == foutstream->fd &&
 		foutstream->fd != -1;
@@ -1022,6 +1212,7 @@ o_stream_create_file_common(struct file_ostream *fstream,
 	struct ostream *ostream;
 
 	fstream->fd = fd;
+	fstream->splice_fds[0] = fstream->splice_fds[1] = -1;
 	fstream->autoclose_fd = autoclose_fd;
 	fstream->optimal_block_size = DEFAULT_OPTIMAL_BLOCK_SIZE;
 
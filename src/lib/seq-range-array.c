@@ -4,6 +4,10 @@
 #include "array.h"
 #include "seq-range-array.h"
 
+/* Merge and intersect are done with a single pass over both arrays when
+   the source array has more ranges than this. */
+#define SEQ_RANGE_LINEAR_MIN_COUNT 8
+
 static bool seq_range_is_overflowed(const ARRAY_TYPE(seq_range) *array)
 {
 	const struct seq_range *range;
@@ -221,6 +225,44 @@ unsigned int seq_range_array_add_range_count(ARRAY_TYPE(seq_range) *array,
 	return count;
 }
 
+static void
+seq_range_array_merge_linear(ARRAY_TYPE(seq_range) *dest,
+			     const ARRAY_TYPE(seq_range) *src)
+{
+	const struct seq_range *src_range, *dest_range, *next;
+	struct seq_range *dest_copy, *last = NULL;
+	unsigned int src_count, dest_count, i = 0, j = 0;
+
+	src_range = array_get(src, &src_count);
+	dest_range = array_get(dest, &dest_count);
+	/* dest may be allocated from the data stack, so the old ranges can't
+	   be copied into a new data stack frame: growing dest there would
+	   reallocate it in the wrong frame. */
+	dest_copy = i_memdup(dest_range,
+			     MALLOC_MULTIPLY(sizeof(*dest_range), dest_count));
+	dest_range = dest_copy;
+	array_clear(dest);
+
+	while (i < dest_count || j < src_count) {
+		if (j == src_count ||
+		    (i < dest_count && dest_range[i].seq1 <= src_range[j].seq1))
+			next = &dest_range[i++];
+		else
+			next = &src_range[j++];
+
+		if (last != NULL &&
+		    (last->seq2 == (uint32_t)-1 || next->seq1 <= last->seq2 + 1)) {
+			if (next->seq2 > last->seq2)
+				last->seq2 = next->seq2;
+		} else {
+			array_push_back(dest, next);
+			last = array_back_modifiable(dest);
+		}
+	}
+	i_free(dest_copy);
+	i_assert(!seq_range_is_overflowed(dest));
+}
+
 void seq_range_array_merge(ARRAY_TYPE(seq_range) *dest,
 			   const ARRAY_TYPE(seq_range) *src)
 {
@@ -231,6 +273,12 @@ void seq_range_array_merge(ARRAY_TYPE(seq_range) *dest,
 		return;
 	}
 
+	if (array_count(src) > SEQ_RANGE_LINEAR_MIN_COUNT) {
+		/* Adding each range separately would move the following
+		   ranges in dest every time. */
+		seq_range_array_merge_linear(dest, src);
+		return;
+	}
 	array_foreach(src, range)
 		seq_range_array_add_range(dest, range->seq1, range->seq2);
 }
@@ -409,6 +457,53 @@ void seq_range_array_remove_nth(ARRAY_TYPE(seq_range) *array,
 	seq_range_array_remove_range(array, seq1, seq2);
 }
 
+static unsigned int
+seq_range_array_intersect_linear(ARRAY_TYPE(seq_range) *dest,
+				 const ARRAY_TYPE(seq_range) *src)
+{
+	const struct seq_range *src_range, *dest_range;
+	struct seq_range *dest_copy, value;
+	unsigned int src_count, dest_count, i, j = 0;
+	unsigned int kept_count, full_count = 0;
+
+	src_range = array_get(src, &src_count);
+	dest_range = array_get(dest, &dest_count);
+	if (dest_count == 0)
+		return 0;
+	/* see seq_range_array_merge_linear() */
+	dest_copy = i_memdup(dest_range,
+			     MALLOC_MULTIPLY(sizeof(*dest_range), dest_count));
+	dest_range = dest_copy;
+	array_clear(dest);
+
+	for (i = 0; i < dest_count; i++) {
+		/* skip over src ranges that are fully before this one */
+		while (j < src_count && src_range[j].seq2 < dest_range[i].seq1)
+			j++;
+		kept_count = 0;
+		for (; j < src_count; j++) {
+			if (src_range[j].seq1 > dest_range[i].seq2)
+				break;
+			value.seq1 = I_MAX(src_range[j].seq1,
+					   dest_range[i].seq1);
+			value.seq2 = I_MIN(src_range[j].seq2,
+					   dest_range[i].seq2);
+			array_push_back(dest, &value);
+			kept_count += value.seq2 - value.seq1 + 1;
+			if (src_range[j].seq2 > dest_range[i].seq2) {
+				/* this src range may overlap the next one */
+				break;
+			}
+		}
+		unsigned int remove_count =
+			dest_range[i].seq2 - dest_range[i].seq1 + 1 - kept_count;
+		i_assert(UINT_MAX - full_count >= remove_count);
+		full_count += remove_count;
+	}
+	i_free(dest_copy);
+	return full_count;
+}
+
 unsigned int seq_range_array_intersect(ARRAY_TYPE(seq_range) *dest,
 				       const ARRAY_TYPE(seq_range) *src)
 {
@@ -416,6 +511,12 @@ unsigned int seq_range_array_intersect(ARRAY_TYPE(seq_range) *dest,
 	unsigned int i, count, remove_count, full_count = 0;
 	uint32_t last_seq = 0;
 
+	if (array_count(src) > SEQ_RANGE_LINEAR_MIN_COUNT) {
+		/* Removing each gap separately would move the following
+		   ranges in dest every time. */
+		return seq_range_array_intersect_linear(dest, src);
+	}
+
 	src_range = array_get(src, &count);
 	for (i = 0; i < count; i++) {
 		if (last_seq + 1 < src_range[i].seq1) {
@@ -1,6 +1,7 @@
 /* Copyright (c) 2015-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "bits.h"
 #include "stats-dist.h"
 #include "sort.h"
 
@@ -8,13 +9,25 @@
    more than 20 in your subsample. */
 #define TIMING_DEFAULT_SUBSAMPLING_BUFFER (20*24) /* 20*24 fits in a page */
 
+/* The sketch has log-linear buckets: each power of two range is split into
+   2^STATS_DIST_SKETCH_SUB_BITS equally sized buckets. Values below that are
+   counted exactly. A bucket's relative width is at most
+   1/2^STATS_DIST_SKETCH_SUB_BITS, so using its midpoint has a relative error
+   of at most 1/2^(STATS_DIST_SKETCH_SUB_BITS+1) (1.6%). */
+#define STATS_DIST_SKETCH_SUB_BITS 5
+#define STATS_DIST_SKETCH_SUB_COUNT (1U << STATS_DIST_SKETCH_SUB_BITS)
+
 struct stats_dist {
 	unsigned int sample_count;
 	unsigned int count;
 	bool     sorted;
+	bool     sketch;
 	uint64_t min;
 	uint64_t max;
 	uint64_t sum;
+	/* Sketch buckets [bucket_first..bucket_first+bucket_count-1] */
+	uint32_t *buckets;
+	unsigned int bucket_first, bucket_count;
 	uint64_t samples[];
 };
 
@@ -34,21 +47,107 @@ struct stats_dist *stats_dist_init_with_size(unsigned int sample_count)
 	return stats;
 }
 
+struct stats_dist *stats_dist_init_sketch(void)
+{
+	struct stats_dist *stats = i_new(struct stats_dist, 1);
+	stats->sketch = TRUE;
+	return stats;
+}
+
 void stats_dist_deinit(struct stats_dist **_stats)
 {
-	i_free_and_null(*_stats);
+	struct stats_dist *stats = *_stats;
+
+	if (stats == NULL)
+		return;
+	*_stats = NULL;
+
+	i_free(stats->buckets);
+	i_free(stats);
 }
 
 void stats_dist_reset(struct stats_dist *stats)
 {
 	unsigned int sample_count = stats->sample_count;
+	bool sketch = stats->sketch;
+
+	i_free(stats->buckets);
 	i_zero(stats);
 	stats->sample_count = sample_count;
+	stats->sketch = sketch;
+}
+
+static unsigned int stats_dist_sketch_bucket_idx(uint64_t value)
+{
+	if (value < STATS_DIST_SKETCH_SUB_COUNT)
+		return value;
+
+	unsigned int shift = bits_required64(value) - 1 -
+		STATS_DIST_SKETCH_SUB_BITS;
+	/* the highest bit is always set, so it's dropped from the
+	   sub-bucket number */
+	unsigned int sub_idx = (value >> shift) - STATS_DIST_SKETCH_SUB_COUNT;
+	return (shift + 1) * STATS_DIST_SKETCH_SUB_COUNT + sub_idx;
+}
+
+static uint64_t
+stats_dist_sketch_bucket_value(const struct stats_dist *stats,
+			       unsigned int idx)
+{
+	uint64_t value;
+
+	if (idx < STATS_DIST_SKETCH_SUB_COUNT)
+		value = idx;
+	else {
+		unsigned int shift = idx / STATS_DIST_SKETCH_SUB_COUNT - 1;
+		uint64_t sub_idx = idx % STATS_DIST_SKETCH_SUB_COUNT;
+		uint64_t start = (STATS_DIST_SKETCH_SUB_COUNT + sub_idx) << shift;
+		/* return the midpoint of the bucket */
+		value = start + ((UINT64_C(1) << shift) - 1) / 2;
+	}
+	/* the min and max are exact */
+	if (value < stats->min)
+		return stats->min;
+	if (value > stats->max)
+		return stats->max;
+	return value;
+}
+
+static void stats_dist_sketch_add(struct stats_dist *stats, uint64_t value)
+{
+	unsigned int idx = stats_dist_sketch_bucket_idx(value);
+
+	if (stats->bucket_count == 0) {
+		stats->buckets = i_new(uint32_t, 1);
+		stats->bucket_first = idx;
+		stats->bucket_count = 1;
+	} else if (idx < stats->bucket_first) {
+		/* grow downwards */
+		unsigned int extra = stats->bucket_first - idx;
+		stats->buckets = i_realloc_type(stats->buckets, uint32_t,
+			stats->bucket_count, stats->bucket_count + extra);
+		memmove(stats->buckets + extra, stats->buckets,
+			sizeof(uint32_t) * stats->bucket_count);
+		memset(stats->buckets, 0, sizeof(uint32_t) * extra);
+		stats->bucket_first = idx;
+		stats->bucket_count += extra;
+	} else if (idx >= stats->bucket_first + stats->bucket_count) {
+		/* grow upwards */
+		unsigned int new_count = idx - stats->bucket_first + 1;
+		stats->buckets = i_realloc_type(stats->buckets, uint32_t,
+			stats->bucket_count, new_count);
+		stats->bucket_count = new_count;
+	}
+	stats->buckets[idx - stats->bucket_first]++;
 }
 
 void stats_dist_add(struct stats_dist *stats, uint64_t value)
 {
-	if (stats->count < stats->sample_count) {
+	if (stats->sketch) {
+		stats_dist_sketch_add(stats, value);
+		if (stats->count == 0)
+			stats->min = stats->max = value;
+	} else if (stats->count < stats->sample_count) {
 		stats->samples[stats->count] = value;
 		if (stats->count == 0)
 			stats->min = stats->max = value;
@@ -108,10 +207,33 @@ static void stats_dist_ensure_sorted(struct stats_dist *stats)
 	stats->sorted = TRUE;
 }
 
+static uint64_t
+stats_dist_sketch_get_nth(const struct stats_dist *stats, unsigned int n)
+{
+	unsigned int i, seen = 0;
+
+	i_assert(n < stats->count);
+	if (n == 0)
+		return stats->min;
+	if (n == stats->count - 1)
+		return stats->max;
+	for (i = 0; i < stats->bucket_count; i++) {
+		seen += stats->buckets[i];
+		if (seen > n)
+			break;
+	}
+	i_assert(i < stats->bucket_count);
+	return stats_dist_sketch_bucket_value(stats, stats->bucket_first + i);
+}
+
 uint64_t stats_dist_get_median(struct stats_dist *stats)
 {
 	if (stats->count == 0)
 		return 0;
+	if (stats->sketch) {
+		return (stats_dist_sketch_get_nth(stats, (stats->count-1)/2) +
+			stats_dist_sketch_get_nth(stats, stats->count/2)) / 2;
+	}
 	/* cast-away const - reading requires sorting */
 	stats_dist_ensure_sorted(stats);
 	unsigned int count = (stats->count < stats->sample_count)
@@ -128,6 +250,14 @@ double stats_dist_get_variance(const struct stats_dist *stats)
 		return 0;
 
 	double avg = stats_dist_get_avg(stats);
+	if (stats->sketch) {
+		for (unsigned int i = 0; i < stats->bucket_count; i++) {
+			double value = stats_dist_sketch_bucket_value(stats,
+				stats->bucket_first + i);
+			sum += stats->buckets[i] * (value - avg) * (value - avg);
+		}
+		return sum / stats->count;
+	}
 	double count = (stats->count < stats->sample_count)
 		? stats->count
 		: stats->sample_count;
@@ -165,6 +295,10 @@ uint64_t stats_dist_get_percentile(struct stats_dist *stats, double fraction)
 {
 	if (stats->count == 0)
 		return 0;
+	if (stats->sketch) {
+		return stats_dist_sketch_get_nth(stats,
+			stats_dist_get_index(stats->count, fraction));
+	}
 	stats_dist_ensure_sorted(stats);
 	unsigned int count = (stats->count < stats->sample_count)
 		? stats->count
@@ -11,6 +11,11 @@
 #include <stdio.h>
 #include <limits.h>
 #include <ctype.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
 
 /* Disable our memcpy() safety wrapper. This file is very performance sensitive
    and it's been checked to work correctly with memcpy(). */
@@ -697,6 +702,11 @@ size_t i_memcspn(const void *data, size_t data_len,
 	/* nothing to reject */
 	if (reject_len == 0 || data_len == 0)
 		return data_len;
+	if (reject_len == 2) {
+		const unsigned char *kand =
+			i_memchr2(start, r[0], r[1], data_len);
+		return kand == NULL ? data_len : (size_t)(kand - start);
+	}
 	/* Doing repeated memchr's over the data is faster than
 	   going over it once byte by byte, as long as reject
 	   is reasonably short. */
@@ -709,6 +719,45 @@ size_t i_memcspn(const void *data, size_t data_len,
 	return ptr - start;
 }
 
+const void *i_memchr2(const void *data, int c1, int c2, size_t size)
+{
+	const unsigned char *p = data, *end = p + size;
+	const unsigned char b1 = c1, b2 = c2;
+
+	i_assert(data != NULL || size == 0);
+
+#ifdef __SSE2__
+	const __m128i v1 = _mm_set1_epi8((char)b1);
+	const __m128i v2 = _mm_set1_epi8((char)b2);
+
+	for (; end - p >= 16; p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned int mask = _mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(v, v1),
+				     _mm_cmpeq_epi8(v, v2)));
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	const uint8x16_t v1 = vdupq_n_u8(b1), v2 = vdupq_n_u8(b2);
+
+	for (; end - p >= 16; p += 16) {
+		uint8x16_t v = vld1q_u8(p);
+		uint8x16_t match = vorrq_u8(vceqq_u8(v, v1), vceqq_u8(v, v2));
+		if (vmaxvq_u8(match) != 0) {
+			/* the scalar loop below finds the exact position */
+			end = p + 16;
+			break;
+		}
+	}
+#endif
+	for (; p < end; p++) {
+		if (*p == b1 || *p == b2)
+			return p;
+	}
+	return NULL;
+}
+
 bool t_split_key_value(const char *arg, char separator,
 		       const char **key_r, const char **value_r)
 {
@@ -144,6 +144,9 @@ size_t i_memspn(const void *data, size_t data_len,
 */
 size_t i_memcspn(const void *data, size_t data_len,
 		 const void *reject, size_t reject_len);
+/* Like memchr(), but find the first byte that is either c1 or c2. Uses
+   SSE2/NEON when available. */
+const void *i_memchr2(const void *data, int c1, int c2, size_t size) ATTR_PURE;
 
 static inline char *i_strchr_to_next(const char *str, char chr)
 {
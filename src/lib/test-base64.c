@@ -126,6 +126,84 @@ static void test_base64_random(void)
 	test_end();
 }
 
+static void
+test_base64_random_long_scheme(const struct base64_scheme *b64,
+			       const char *name)
+{
+	const struct base64_scheme *other = b64 == &base64_scheme ?
+		&base64url_scheme : &base64_scheme;
+	buffer_t *buf, *enc, *ref, *dest;
+	unsigned int i, j, max;
+
+	buf = t_buffer_create(512);
+	enc = t_buffer_create(1024);
+	ref = t_buffer_create(1024);
+	dest = t_buffer_create(512);
+
+	/* long enough inputs to go through the bulk code paths */
+	test_begin(t_strdup_printf("%s encode/decode with long random input",
+				   name));
+	for (i = 0; i < 2000; i++) {
+		max = i_rand_limit(400);
+		buffer_set_used_size(buf, 0);
+		for (j = 0; j < max; j++)
+			buffer_append_c(buf, i_rand_uchar());
+		const unsigned char *data = buf->data;
+
+		buffer_set_used_size(ref, 0);
+		for (j = 0; j + 3 <= max; j += 3) {
+			buffer_append_c(ref, b64->encmap[data[j] >> 2]);
+			buffer_append_c(ref, b64->encmap[
+				((data[j] & 0x03) << 4) | (data[j+1] >> 4)]);
+			buffer_append_c(ref, b64->encmap[
+				((data[j+1] & 0x0f) << 2) | (data[j+2] >> 6)]);
+			buffer_append_c(ref, b64->encmap[data[j+2] & 0x3f]);
+		}
+
+		buffer_set_used_size(enc, 0);
+		base64_scheme_encode(b64, 0, SIZE_MAX, buf->data, buf->used,
+				     enc);
+		test_assert_idx(enc->used == MAX_BASE64_ENCODED_SIZE(max), i);
+		test_assert_idx(memcmp(enc->data, ref->data, ref->used) == 0, i);
+
+		buffer_set_used_size(dest, 0);
+		test_assert_idx(base64_scheme_decode(b64, 0, enc->data,
+						     enc->used, dest) >= 0, i);
+		test_assert_idx(buffer_cmp(buf, dest), i);
+
+		if (enc->used == 0)
+			continue;
+		/* whitespace anywhere is skipped */
+		j = i_rand_limit(enc->used);
+		buffer_insert(enc, j, "\r\n", 2);
+		buffer_set_used_size(dest, 0);
+		test_assert_idx(base64_scheme_decode(b64, 0, enc->data,
+						     enc->used, dest) >= 0, i);
+		test_assert_idx(buffer_cmp(buf, dest), i);
+
+		/* the other scheme's characters are invalid */
+		j = i_rand_limit(enc->used);
+		buffer_write(enc, j, &other->encmap[62 + i % 2], 1);
+		buffer_set_used_size(dest, 0);
+		test_assert_idx(base64_scheme_decode(b64, 0, enc->data,
+						     enc->used, dest) < 0, i);
+
+		/* invalid characters are detected */
+		j = i_rand_limit(enc->used);
+		buffer_write(enc, j, "!", 1);
+		buffer_set_used_size(dest, 0);
+		test_assert_idx(base64_scheme_decode(b64, 0, enc->data,
+						     enc->used, dest) < 0, i);
+	}
+	test_end();
+}
+
+static void test_base64_random_long(void)
+{
+	test_base64_random_long_scheme(&base64_scheme, "base64");
+	test_base64_random_long_scheme(&base64url_scheme, "base64url");
+}
+
 static void test_base64url_encode(void)
 {
 	const struct {
@@ -1314,4 +1392,5 @@ void test_base64(void)
 	test_base64_decode_lowlevel();
 	test_base64_random_lowlevel();
 	test_base64_encode_lines();
+	test_base64_random_long();
 }
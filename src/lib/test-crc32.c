@@ -10,5 +10,28 @@ void test_crc32(void)
 	test_begin("crc32");
 	test_assert(crc32_str(str) == 0x8c736521);
 	test_assert(crc32_data(str, sizeof(str)) == 0x32c9723d);
+	test_assert(crc32_str("123456789") == 0xcbf43926);
+	test_end();
+
+	test_begin("crc32 long input");
+	unsigned char data[1024 + 1];
+	uint32_t crc;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7 + (i >> 3);
+	/* the result must be the same however the input is split and
+	   aligned */
+	crc = crc32_data(data + 1, sizeof(data) - 1);
+	for (i = 0; i < 40; i++) {
+		uint32_t crc2 = crc32_data(data + 1, i);
+		crc2 = crc32_data_more(crc2, data + 1 + i,
+				       sizeof(data) - 1 - i);
+		test_assert_idx(crc2 == crc, i);
+	}
+	crc = 0;
+	for (i = 1; i < sizeof(data); i++)
+		crc = crc32_data_more(crc, data + i, 1);
+	test_assert(crc == crc32_data(data + 1, sizeof(data) - 1));
 	test_end();
 }
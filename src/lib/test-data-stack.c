@@ -3,6 +3,7 @@
 #include "test-lib.h"
 #include "lib-event-private.h"
 #include "event-filter.h"
+#include "alloc-profile.h"
 #include "data-stack.h"
 
 static int ds_grow_event_count = 0;
@@ -343,6 +344,43 @@ static void test_ds_pass_str(void)
 	test_end();
 }
 
+static void test_ds_profile(void)
+{
+	const struct alloc_profile *profile;
+
+	test_begin("data-stack profiling");
+	alloc_profile_set_enabled(TRUE);
+	alloc_profile_reset();
+	for (unsigned int i = 0; i < 2; i++) {
+		data_stack_frame_t t_id = t_push("test profile");
+		(void)t_malloc_no0(100);
+		(void)t_malloc_no0(200);
+		/* cause the data stack to grow */
+		(void)t_malloc_no0(data_stack_get_alloc_size() + 1);
+		test_assert(t_pop(&t_id));
+	}
+	alloc_profile_set_enabled(FALSE);
+
+	profile = alloc_profile_get(ALLOC_PROFILE_TYPE_DATA_STACK,
+				    "test profile");
+	test_assert(profile->count == 2);
+	test_assert(profile->bytes > 2 * 300);
+	test_assert(profile->max_bytes > 300 &&
+		    profile->max_bytes <= profile->bytes / 2);
+	test_assert(profile->grow_count == 2);
+
+	/* disabled profiling doesn't update the profile */
+	T_BEGIN {
+		data_stack_frame_t t_id = t_push("test profile");
+		(void)t_malloc_no0(100);
+		test_assert(t_pop(&t_id));
+	} T_END;
+	test_assert(profile->count == 2);
+	alloc_profile_reset();
+	test_assert(profile->count == 0 && profile->bytes == 0);
+	test_end();
+}
+
 void test_data_stack(void)
 {
 	void (*tests[])(void) = {
@@ -354,6 +392,7 @@ void test_data_stack(void)
 		test_ds_realloc,
 		test_ds_recursive,
 		test_ds_pass_str,
+		test_ds_profile,
 	};
 	for (unsigned int i = 0; i < N_ELEMENTS(tests); i++) {
 		ds_grow_event_count = 0;
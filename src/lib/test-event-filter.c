@@ -639,6 +639,67 @@ static void test_event_filter_named_separate_from_str(void)
 	test_end();
 }
 
+static void test_event_filter_event_names(void)
+{
+	struct event_filter *filter;
+	const char *error;
+	const struct failure_context failure_ctx = {
+		.type = LOG_TYPE_DEBUG
+	};
+
+	test_begin("event filter: event names");
+
+	struct event *e_foo = event_create(NULL);
+	event_set_name(e_foo, "foo");
+	event_add_str(e_foo, "str", "str");
+	struct event *e_bar = event_create(NULL);
+	event_set_name(e_bar, "bar");
+	event_add_str(e_bar, "str", "str");
+	struct event *e_baz = event_create(NULL);
+	event_set_name(e_baz, "baz");
+	event_add_str(e_baz, "str", "str");
+
+	/* all queries match only specific names */
+	filter = event_filter_create();
+	test_assert(event_filter_parse("(event=foo OR event=bar) AND str=str",
+				       filter, &error) == 0);
+	test_assert(event_filter_parse("event=baz AND str=wrong",
+				       filter, &error) == 0);
+	test_assert(!filter->event_names_unbounded);
+	test_assert(hash_table_count(filter->event_names) == 3);
+	test_assert(event_filter_match(filter, e_foo, &failure_ctx));
+	test_assert(event_filter_match(filter, e_bar, &failure_ctx));
+	test_assert(!event_filter_match(filter, e_baz, &failure_ctx));
+
+	/* merging keeps the names */
+	struct event_filter *filter2 = event_filter_create();
+	event_filter_merge(filter2, filter);
+	test_assert(!filter2->event_names_unbounded);
+	test_assert(hash_table_count(filter2->event_names) == 3);
+	test_assert(event_filter_match(filter2, e_foo, &failure_ctx));
+	test_assert(!event_filter_match(filter2, e_baz, &failure_ctx));
+	event_filter_unref(&filter2);
+
+	/* a query that doesn't limit the names */
+	test_assert(event_filter_parse("event=b* AND str=str",
+				       filter, &error) == 0);
+	test_assert(filter->event_names_unbounded);
+	test_assert(event_filter_match(filter, e_baz, &failure_ctx));
+	event_filter_unref(&filter);
+
+	filter = event_filter_create();
+	test_assert(event_filter_parse("NOT event=foo", filter, &error) == 0);
+	test_assert(filter->event_names_unbounded);
+	test_assert(!event_filter_match(filter, e_foo, &failure_ctx));
+	test_assert(event_filter_match(filter, e_bar, &failure_ctx));
+	event_filter_unref(&filter);
+
+	event_unref(&e_foo);
+	event_unref(&e_bar);
+	event_unref(&e_baz);
+	test_end();
+}
+
 static void test_event_filter_duration(void)
 {
 	struct event_filter *filter;
@@ -1138,6 +1199,7 @@ void test_event_filter(void)
 	test_event_filter_named_and_str();
 	test_event_filter_named_or_str();
 	test_event_filter_named_separate_from_str();
+	test_event_filter_event_names();
 	test_event_filter_duration();
 	test_event_filter_numbers();
 	test_event_filter_ips();
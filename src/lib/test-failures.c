@@ -5,6 +5,7 @@
 #include "test-lib.h"
 #include "hostpid.h"
 #include "istream.h"
+#include "fd-util.h"
 #include "failures.h"
 
 #include <unistd.h>
@@ -165,10 +166,64 @@ static void test_internal_split(void)
 	test_end();
 }
 
+static void test_write_buffering(void)
+{
+	failure_callback_t *handlers[4];
+	char buf[1024];
+	int fd[2], old_stderr_fd;
+	ssize_t ret;
+
+	test_begin("log write buffering");
+	if (pipe(fd) < 0)
+		i_fatal("pipe() failed: %m");
+	fd_set_nonblock(fd[0], TRUE);
+	old_stderr_fd = dup(STDERR_FILENO);
+	if (old_stderr_fd < 0)
+		i_fatal("dup() failed: %m");
+	if (dup2(fd[1], STDERR_FILENO) < 0)
+		i_fatal("dup2() failed: %m");
+
+	i_get_failure_handlers(handlers, handlers+1, handlers+2, handlers+3);
+	i_set_info_handler(default_error_handler);
+
+	/* lines are buffered until buffering is disabled */
+	i_set_failure_write_buffering(TRUE);
+	i_info("buffered line 1");
+	i_info("buffered line 2");
+	test_assert(read(fd[0], buf, sizeof(buf)) < 0 && errno == EAGAIN);
+	i_set_failure_write_buffering(FALSE);
+	ret = read(fd[0], buf, sizeof(buf)-1);
+	test_assert(ret > 0);
+	if (ret > 0) {
+		buf[ret] = '\0';
+		const char *p = strstr(buf, "buffered line 1\n");
+		test_assert(p != NULL &&
+			    strstr(p, "buffered line 2\n") != NULL);
+	}
+
+	/* without buffering lines are written immediately */
+	i_info("unbuffered line");
+	ret = read(fd[0], buf, sizeof(buf)-1);
+	test_assert(ret > 0);
+	if (ret > 0) {
+		buf[ret] = '\0';
+		test_assert(strstr(buf, "unbuffered line\n") != NULL);
+	}
+
+	i_set_info_handler(handlers[2]);
+	if (dup2(old_stderr_fd, STDERR_FILENO) < 0)
+		i_fatal("dup2() failed: %m");
+	i_close_fd(&old_stderr_fd);
+	i_close_fd(&fd[0]);
+	i_close_fd(&fd[1]);
+	test_end();
+}
+
 void test_failures(void)
 {
 	test_get_set_handlers();
 	test_expected();
 	test_expected_str();
 	test_internal_split();
+	test_write_buffering();
 }
@@ -3,8 +3,10 @@
 #include "test-lib.h"
 #include "hash.h"
 
+#include <ctype.h>
 
-static void test_hash_random_pool(pool_t pool)
+static void
+test_hash_random_pool(pool_t pool, enum hash_table_flags flags)
 {
 #define KEYMAX 100000
 	HASH_TABLE(void *, void *) hash;
@@ -12,7 +14,7 @@ static void test_hash_random_pool(pool_t pool)
 	unsigned int i, key, keyidx, delidx;
 
 	keys = i_new(unsigned int, KEYMAX); keyidx = 0;
-	hash_table_create_direct(&hash, pool, 0);
+	hash_table_create_direct_flags(&hash, pool, 0, flags);
 	for (i = 0; i < KEYMAX; i++) {
 		key = (i_rand_limit(KEYMAX)) + 1;
 		if (i_rand_limit(5) > 0) {
@@ -29,19 +31,140 @@ static void test_hash_random_pool(pool_t pool)
 			keyidx--;
 		}
 	}
+	test_assert(hash_table_count(hash) == keyidx);
+	for (i = 0; i < keyidx; i++)
+		test_assert_idx(hash_table_lookup(hash, POINTER_CAST(keys[i])) != NULL, i);
 	for (i = 0; i < keyidx; i++)
 		hash_table_remove(hash, POINTER_CAST(keys[i]));
+	test_assert(hash_table_count(hash) == 0);
 	hash_table_destroy(&hash);
 	i_free(keys);
 }
 
+static void test_hash_iterate(enum hash_table_flags flags)
+{
+#define ITER_KEYMAX 1000
+	HASH_TABLE(char *, void *) hash;
+	struct hash_iterate_context *iter;
+	unsigned char seen[ITER_KEYMAX*2+1];
+	char *key;
+	void *value;
+	unsigned int i, n;
+
+	hash_table_create_flags(&hash, default_pool, 0, str_hash, strcmp,
+				flags);
+	for (i = 1; i <= ITER_KEYMAX; i++) {
+		hash_table_insert(hash, i_strdup(dec2str(i)),
+				  POINTER_CAST(i));
+	}
+	/* updating an existing key keeps the original key */
+	key = i_strdup("1");
+	hash_table_update(hash, key, POINTER_CAST(1));
+	test_assert(hash_table_count(hash) == ITER_KEYMAX);
+	i_free(key);
+	test_assert(hash_table_count(hash) == ITER_KEYMAX);
+
+	/* remove the even keys and add some new keys while iterating.
+	   all the original keys must be seen exactly once. */
+	memset(seen, 0, sizeof(seen));
+	n = 0;
+	iter = hash_table_iterate_init(hash);
+	while (hash_table_iterate(iter, hash, &key, &value)) {
+		i = POINTER_CAST_TO(value, unsigned int);
+		test_assert_idx(i > 0 && i <= ITER_KEYMAX*2, i);
+		test_assert_idx(seen[i]++ == 0, i);
+		if (i > ITER_KEYMAX)
+			continue;
+		if (i % 2 == 0) {
+			hash_table_remove(hash, key);
+			i_free(key);
+		}
+		if (i % 10 == 0 && n < ITER_KEYMAX/10) {
+			n++;
+			hash_table_insert(hash,
+				i_strdup(dec2str(ITER_KEYMAX + n)),
+				POINTER_CAST(ITER_KEYMAX + n));
+		}
+	}
+	hash_table_iterate_deinit(&iter);
+	for (i = 1; i <= ITER_KEYMAX; i++)
+		test_assert_idx(seen[i] == 1, i);
+	test_assert(hash_table_count(hash) == ITER_KEYMAX/2 + n);
+
+	for (i = 1; i <= ITER_KEYMAX + n; i++) {
+		bool exists = i > ITER_KEYMAX || i % 2 != 0;
+		test_assert_idx((hash_table_lookup(hash, dec2str(i)) != NULL) ==
+				exists, i);
+	}
+
+	iter = hash_table_iterate_init(hash);
+	while (hash_table_iterate(iter, hash, &key, &value)) {
+		hash_table_remove(hash, key);
+		i_free(key);
+	}
+	hash_table_iterate_deinit(&iter);
+	test_assert(hash_table_count(hash) == 0);
+	hash_table_destroy(&hash);
+}
+
+static void test_hash_str_functions(void)
+{
+	static const char *const words[] = {
+		"", "a", "INBOX", "inbox.Sent Messages",
+		"user@example.com", "Message-ID", "x-Some-Long-Header-Name",
+	};
+	char buf[64];
+	unsigned int i, j;
+
+	test_begin("hash string functions");
+	for (i = 0; i < N_ELEMENTS(words); i++) {
+		const char *word = words[i];
+		size_t len = strlen(word);
+
+		/* unaligned input gives the same result */
+		i_assert(len + 2 <= sizeof(buf));
+		memcpy(buf + 1, word, len + 1);
+		test_assert_idx(str_hash(word) == str_hash(buf + 1), i);
+		test_assert_idx(str_hash(word) == mem_hash(word, len), i);
+
+		/* case-insensitive variants ignore the case */
+		for (j = 0; j <= len; j++)
+			buf[j] = i_toupper(word[j]);
+		test_assert_idx(strcase_hash(word) == strcase_hash(buf), i);
+		test_assert_idx(strfastcase_hash(word) ==
+				strfastcase_hash(buf), i);
+		for (j = 0; j <= len; j++)
+			buf[j] = i_tolower(word[j]);
+		test_assert_idx(strcase_hash(word) == strcase_hash(buf), i);
+		test_assert_idx(strfastcase_hash(word) ==
+				strfastcase_hash(buf), i);
+	}
+	/* bytes outside a-z are left alone by strcase_hash() */
+	test_assert(strcase_hash("[foo]") != strcase_hash("{foo}"));
+	test_assert(strcase_hash("@") != strcase_hash("`"));
+	/* a byte after the end must not matter */
+	test_assert(mem_hash("abcdefghij", 9) == mem_hash("abcdefghiX", 9));
+	test_assert(mem_hash("abcdefghij", 9) != mem_hash("abcdefghij", 10));
+	test_end();
+}
+
 void test_hash(void)
 {
 	pool_t pool;
 
-	test_hash_random_pool(default_pool);
+	test_hash_str_functions();
+
+	test_begin("hash table");
+	test_hash_random_pool(default_pool, 0);
 
 	pool = pool_alloconly_create("test hash", 1024);
-	test_hash_random_pool(pool);
+	test_hash_random_pool(pool, 0);
 	pool_unref(&pool);
+	test_hash_iterate(0);
+	test_end();
+
+	test_begin("hash table open addressing");
+	test_hash_random_pool(default_pool, HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	test_hash_iterate(HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	test_end();
 }
@@ -296,6 +296,61 @@ static void test_ioloop_pending_io(void)
 	test_end();
 }
 
+static void test_ioloop_callback_profiling_timeout(unsigned int *counter)
+{
+	if (++*counter == 3)
+		io_loop_stop(current_ioloop);
+}
+
+static void test_ioloop_callback_profiling(void)
+{
+	const struct io_loop_callback_profile *const *profiles;
+	const char *source_filename = __FILE__;
+	unsigned int count, counter = 0, timeout_line, io_line;
+
+	test_begin("ioloop callback profiling");
+	io_loop_set_callback_profiling(TRUE);
+
+	struct istream *is = i_stream_create_from_data("data", 4);
+	struct ioloop *ioloop = io_loop_create();
+	struct timeout *to = timeout_add_short(0,
+		test_ioloop_callback_profiling_timeout, &counter);
+	timeout_line = __LINE__ - 2;
+	struct io *io = io_add_istream(is, io_callback_pending_io, NULL);
+	io_line = __LINE__ - 1;
+	io_set_pending(io);
+	io_loop_run(ioloop);
+	io_remove(&io);
+	io_loop_run(ioloop);
+	timeout_remove(&to);
+	i_stream_unref(&is);
+	io_loop_destroy(&ioloop);
+
+	profiles = io_loop_get_callback_profiles(&count);
+	test_assert(count == 2);
+	for (unsigned int i = 0; i < count; i++) {
+		test_assert_strcmp(profiles[i]->source_filename, __FILE__);
+		/* the filename is copied, since it may point to a plugin */
+		test_assert(profiles[i]->source_filename != source_filename);
+		if (profiles[i]->timeout) {
+			test_assert(profiles[i]->source_linenum == timeout_line);
+			test_assert(profiles[i]->call_count == 3);
+		} else {
+			test_assert(profiles[i]->source_linenum == io_line);
+			test_assert(profiles[i]->call_count == 1);
+		}
+	}
+
+	io_loop_reset_callback_profiles();
+	profiles = io_loop_get_callback_profiles(&count);
+	test_assert(count == 2 && profiles[0]->call_count == 0 &&
+		    profiles[0]->nsecs == 0);
+
+	io_loop_set_callback_profiling(FALSE);
+	test_assert(io_loop_get_callback_profiles(&count) == NULL && count == 0);
+	test_end();
+}
+
 static void test_ioloop_context_callback(struct ioloop_context *ctx)
 {
 	test_assert(io_loop_get_current_context(current_ioloop) == ctx);
@@ -391,6 +446,80 @@ static void test_ioloop_context_events(void)
 	test_end();
 }
 
+#ifdef IOLOOP_URING
+#define TEST_IOLOOP_URING_FD_COUNT 300
+
+struct test_many_fds_ctx {
+	struct io *ios[TEST_IOLOOP_URING_FD_COUNT];
+	int fds[TEST_IOLOOP_URING_FD_COUNT][2];
+	unsigned int callback_count;
+};
+
+static void test_ioloop_uring_many_fds_cb(struct test_many_fds_ctx *ctx)
+{
+	if (++ctx->callback_count == TEST_IOLOOP_URING_FD_COUNT)
+		io_loop_stop(current_ioloop);
+}
+
+static void test_ioloop_uring_many_fds(void)
+{
+	struct test_many_fds_ctx ctx;
+	struct ioloop *ioloop;
+	unsigned int i;
+
+	test_begin("ioloop uring many fds");
+	i_zero(&ctx);
+	ioloop = io_loop_create();
+	/* more fds than the initial ring size, all of them becoming readable
+	   at the same time */
+	for (i = 0; i < TEST_IOLOOP_URING_FD_COUNT; i++) {
+		if (pipe(ctx.fds[i]) < 0)
+			i_fatal("pipe() failed: %m");
+		ctx.ios[i] = io_add(ctx.fds[i][0], IO_READ,
+				    test_ioloop_uring_many_fds_cb, &ctx);
+	}
+	for (i = 0; i < TEST_IOLOOP_URING_FD_COUNT; i++) {
+		if (write(ctx.fds[i][1], "", 1) != 1)
+			i_fatal("write(pipe) failed: %m");
+	}
+	io_loop_run(ioloop);
+	test_assert_ucmp(ctx.callback_count, >=, TEST_IOLOOP_URING_FD_COUNT);
+
+	for (i = 0; i < TEST_IOLOOP_URING_FD_COUNT; i++) {
+		io_remove(&ctx.ios[i]);
+		i_close_fd(&ctx.fds[i][0]);
+		i_close_fd(&ctx.fds[i][1]);
+	}
+	io_loop_destroy(&ioloop);
+	test_end();
+}
+
+static void test_ioloop_uring_recreate(void)
+{
+	struct ioloop *ioloop;
+	struct io *io;
+	int fd[2];
+
+	test_begin("ioloop uring recreate");
+	ioloop = io_loop_create();
+	if (pipe(fd) < 0)
+		i_fatal("pipe() failed: %m");
+	io = io_add(fd[0], IO_READ, io_loop_stop, ioloop);
+
+	/* the existing io must keep working with the new ring */
+	io_loop_recreate(ioloop);
+	if (write(fd[1], "", 1) != 1)
+		i_fatal("write(pipe) failed: %m");
+	io_loop_run(ioloop);
+
+	io_remove(&io);
+	i_close_fd(&fd[0]);
+	i_close_fd(&fd[1]);
+	io_loop_destroy(&ioloop);
+	test_end();
+}
+#endif
+
 void test_ioloop(void)
 {
 	test_ioloop_timeout();
@@ -398,7 +527,12 @@ void test_ioloop(void)
 	test_ioloop_zero_timeout_recreate();
 	test_ioloop_find_fd_conditions();
 	test_ioloop_pending_io();
+	test_ioloop_callback_profiling();
 	test_ioloop_fd();
 	test_ioloop_context();
 	test_ioloop_context_events();
+#ifdef IOLOOP_URING
+	test_ioloop_uring_many_fds();
+	test_ioloop_uring_recreate();
+#endif
 }
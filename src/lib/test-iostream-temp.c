@@ -48,6 +48,32 @@ static void test_iostream_temp_create_sized_disk(void)
 	test_end();
 }
 
+static void test_iostream_temp_size_hint(void)
+{
+	struct ostream *output;
+
+	test_begin("iostream-temp size hint");
+	output = iostream_temp_create_sized(".", 0, "test", 4);
+	o_stream_temp_set_size_hint(output, 4);
+	test_assert(o_stream_send(output, "1234", 4) == 4);
+	test_assert(o_stream_get_fd(output) == -1);
+	o_stream_destroy(&output);
+
+	output = iostream_temp_create_sized(".", 0, "test", 4);
+	o_stream_temp_set_size_hint(output, 5);
+	test_assert(o_stream_get_fd(output) != -1);
+	test_assert(o_stream_send(output, "12", 2) == 2);
+	test_assert(output->offset == 2);
+
+	const unsigned char *data;
+	size_t size;
+	struct istream *input = iostream_temp_finish(&output, 128);
+	test_assert(i_stream_read_bytes(input, &data, &size, 2) == 1 &&
+		    memcmp(data, "12", 2) == 0);
+	i_stream_destroy(&input);
+	test_end();
+}
+
 static void test_iostream_temp_create_write_error(void)
 {
 	struct ostream *output;
@@ -145,6 +171,7 @@ void test_iostream_temp(void)
 {
 	test_iostream_temp_create_sized_memory();
 	test_iostream_temp_create_sized_disk();
+	test_iostream_temp_size_hint();
 	test_iostream_temp_create_write_error();
 	test_iostream_temp_istream();
 }
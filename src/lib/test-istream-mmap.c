@@ -0,0 +1,98 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+#include "istream.h"
+#include "ostream.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TEST_FILENAME ".test_istream_mmap"
+
+static void test_istream_mmap_create_file(size_t size)
+{
+	struct ostream *os = o_stream_create_file(TEST_FILENAME, 0, 0600, 0);
+	for (size_t i = 0; i < size; i++) {
+		unsigned char c = 'a' + i % 26;
+		o_stream_nsend(os, &c, 1);
+	}
+	test_assert(o_stream_finish(os) == 1);
+	o_stream_destroy(&os);
+}
+
+static void test_istream_mmap_read(void)
+{
+	const size_t file_size = 100*1024;
+	const unsigned char *data;
+	size_t i, size;
+	uoff_t stream_size;
+
+	test_begin("istream mmap read");
+	test_istream_mmap_create_file(file_size);
+
+	int fd = open(TEST_FILENAME, O_RDONLY);
+	i_assert(fd != -1);
+	struct istream *input =
+		i_stream_create_mmap_autoclose(&fd, IO_BLOCK_SIZE);
+	test_assert(fd == -1);
+	test_assert_strcmp(i_stream_get_name(input), "(mmap)");
+	test_assert(i_stream_get_fd(input) != -1);
+	test_assert(i_stream_get_size(input, TRUE, &stream_size) == 1);
+	test_assert(stream_size == file_size);
+
+	/* everything is available at once */
+	test_assert(i_stream_read_more(input, &data, &size) == 1);
+	test_assert(size == file_size);
+	for (i = 0; i < size; i++) {
+		if (data[i] != 'a' + i % 26)
+			break;
+	}
+	test_assert(i == size);
+
+	i_stream_seek(input, 1000);
+	test_assert(i_stream_read_more(input, &data, &size) == 1);
+	test_assert(size == file_size - 1000 && data[0] == 'a' + 1000 % 26);
+	i_stream_skip(input, size);
+	test_assert(i_stream_read(input) == -1);
+	test_assert(input->eof && input->stream_errno == 0);
+
+	/* seeking past the end doesn't go outside the mapping */
+	i_stream_seek(input, file_size + 1000);
+	test_assert(input->v_offset == file_size);
+	test_assert(i_stream_read_more(input, &data, &size) == -1);
+	test_assert(size == 0);
+	test_assert(input->eof && input->stream_errno == 0);
+
+	i_stream_destroy(&input);
+	i_unlink(TEST_FILENAME);
+	test_end();
+}
+
+static void test_istream_mmap_small_file(void)
+{
+	const unsigned char *data;
+	size_t size;
+
+	test_begin("istream mmap small file");
+	test_istream_mmap_create_file(100);
+
+	int fd = open(TEST_FILENAME, O_RDONLY);
+	i_assert(fd != -1);
+	struct istream *input =
+		i_stream_create_mmap_autoclose(&fd, IO_BLOCK_SIZE);
+	test_assert(fd == -1);
+	/* falls back to reading the file */
+	test_assert_strcmp(i_stream_get_name(input), "(file)");
+	test_assert(i_stream_read_more(input, &data, &size) == 1);
+	test_assert(size == 100 && data[0] == 'a');
+
+	i_stream_destroy(&input);
+	i_unlink(TEST_FILENAME);
+	test_end();
+}
+
+void test_istream_mmap(void)
+{
+	test_istream_mmap_read();
+	test_istream_mmap_small_file();
+}
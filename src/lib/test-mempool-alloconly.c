@@ -1,6 +1,7 @@
 /* Copyright (c) 2007-2018 Dovecot authors, see the included COPYING file */
 
 #include "test-lib.h"
+#include "alloc-profile.h"
 
 static bool mem_has_bytes(const void *mem, size_t size, uint8_t b)
 {
@@ -51,6 +52,22 @@ void test_mempool_alloconly(void)
 		}
 	}
 	test_end();
+
+	test_begin("mempool_alloconly profiling");
+	alloc_profile_set_enabled(TRUE);
+	for (i = 0; i < 2; i++) {
+		pool = pool_alloconly_create(MEMPOOL_GROWING"test profile", 64);
+		(void)p_malloc(pool, 1024);
+		pool_unref(&pool);
+	}
+	alloc_profile_set_enabled(FALSE);
+	const struct alloc_profile *profile =
+		alloc_profile_get(ALLOC_PROFILE_TYPE_POOL, "test profile");
+	test_assert(profile->count == 2);
+	test_assert(profile->grow_count == 2);
+	test_assert(profile->bytes >= 2 * (64 + 1024));
+	test_assert(profile->max_bytes >= 1024);
+	test_end();
 }
 
 enum fatal_test_state fatal_mempool_alloconly(unsigned int stage)
@@ -0,0 +1,139 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+
+#define SENSE 0xAB
+
+static bool mem_has_bytes(const void *mem, size_t size, uint8_t b)
+{
+	const uint8_t *bytes = mem;
+
+	for (size_t i = 0; i < size; i++) {
+		if (bytes[i] != b)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void test_mempool_slab_alloc_free(void)
+{
+#define TEST_ALLOC_COUNT 1000
+	void *mem[TEST_ALLOC_COUNT];
+	size_t sizes[TEST_ALLOC_COUNT];
+	size_t used = 0;
+	pool_t pool;
+	unsigned int i;
+
+	test_begin("mempool_slab alloc and free");
+	pool = pool_slab_create("test");
+	for (i = 0; i < TEST_ALLOC_COUNT; i++) {
+		/* mixed sizes, including large allocations */
+		sizes[i] = 1 + (i * 37) % 3000;
+		mem[i] = p_malloc(pool, sizes[i]);
+		test_assert_idx(mem_has_bytes(mem[i], sizes[i], 0), i);
+		memset(mem[i], i % 256, sizes[i]);
+	}
+	/* free every other allocation and reallocate them */
+	for (i = 0; i < TEST_ALLOC_COUNT; i += 2)
+		p_free(pool, mem[i]);
+	for (i = 0; i < TEST_ALLOC_COUNT; i += 2) {
+		mem[i] = p_malloc(pool, sizes[i]);
+		test_assert_idx(mem_has_bytes(mem[i], sizes[i], 0), i);
+		memset(mem[i], i % 256, sizes[i]);
+	}
+	for (i = 0; i < TEST_ALLOC_COUNT; i++) {
+		test_assert_idx(mem_has_bytes(mem[i], sizes[i], i % 256), i);
+		used += sizes[i];
+	}
+	test_assert(pool_slab_get_total_used_size(pool) >= used);
+	test_assert(pool_slab_get_total_alloc_size(pool) >=
+		    pool_slab_get_total_used_size(pool));
+
+	for (i = 0; i < TEST_ALLOC_COUNT; i++)
+		p_free(pool, mem[i]);
+	test_assert(pool_slab_get_total_used_size(pool) == 0);
+	pool_unref(&pool);
+	test_end();
+}
+
+static void test_mempool_slab_realloc(void)
+{
+	pool_t pool;
+	void *mem = NULL;
+	unsigned int i;
+
+	test_begin("mempool_slab realloc");
+	pool = pool_slab_create("test");
+	/* grow through all the size classes into a large allocation */
+	for (i = 1; i < 5000; i++) {
+		mem = p_realloc(pool, mem, i-1, i);
+		test_assert_idx(mem_has_bytes(mem, i-1, SENSE), i);
+		test_assert_idx(mem_has_bytes(PTR_OFFSET(mem, i-1), 1, 0), i);
+		memset(mem, SENSE, i);
+	}
+	/* and shrink back */
+	for (i = 4999; i > 8; i -= 7) {
+		mem = p_realloc(pool, mem, i, i-7);
+		test_assert_idx(mem_has_bytes(mem, i-7, SENSE), i);
+	}
+	p_free(pool, mem);
+	test_assert(pool_slab_get_total_used_size(pool) == 0);
+	pool_unref(&pool);
+	test_end();
+}
+
+static void test_mempool_slab_stats(void)
+{
+	const struct pool_slab_stats *stats;
+	void *mem[300], *large;
+	unsigned int i, count;
+	pool_t pool;
+
+	test_begin("mempool_slab stats");
+	pool = pool_slab_create("test");
+	for (i = 0; i < N_ELEMENTS(mem); i++)
+		mem[i] = p_malloc(pool, 20);
+	large = p_malloc(pool, 10000);
+
+	stats = pool_slab_get_stats(pool, &count);
+	test_assert(count > 2);
+	test_assert(stats[0].chunk_size == 16 && stats[0].used_count == 0);
+	test_assert(stats[1].chunk_size == 32);
+	test_assert(stats[1].used_count == N_ELEMENTS(mem));
+	test_assert(stats[1].total_alloc_count == N_ELEMENTS(mem));
+	test_assert(stats[1].slab_count >= 1);
+	test_assert(stats[count-1].chunk_size == 0);
+	test_assert(stats[count-1].used_count == 1);
+	test_assert(stats[count-1].alloc_size > 10000);
+	unsigned int slab_count = stats[1].slab_count;
+
+	/* freeing everything keeps only one empty slab */
+	for (i = 0; i < N_ELEMENTS(mem); i++)
+		p_free(pool, mem[i]);
+	p_free(pool, large);
+	stats = pool_slab_get_stats(pool, &count);
+	test_assert(stats[1].used_count == 0);
+	test_assert(stats[1].slab_count == 1 && slab_count > 1);
+	test_assert(stats[count-1].used_count == 0);
+	test_assert(stats[count-1].alloc_size == 0);
+
+	/* p_clear() frees everything */
+	for (i = 0; i < N_ELEMENTS(mem); i++)
+		mem[i] = p_malloc(pool, 1 + i * 50);
+	p_clear(pool);
+	stats = pool_slab_get_stats(pool, &count);
+	for (i = 0; i < count; i++) {
+		test_assert_idx(stats[i].used_count == 0, i);
+		test_assert_idx(stats[i].slab_count == 0, i);
+	}
+	test_assert(pool_slab_get_total_used_size(pool) == 0);
+	pool_unref(&pool);
+	test_end();
+}
+
+void test_mempool_slab(void)
+{
+	test_mempool_slab_alloc_free();
+	test_mempool_slab_realloc();
+	test_mempool_slab_stats();
+}
@@ -6,6 +6,7 @@
 #include "randgen.h"
 #include "istream.h"
 #include "ostream.h"
+#include "ostream-file-private.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -176,6 +177,58 @@ static void test_ostream_file_send_istream_sendfile(void)
 	test_end();
 }
 
+static void test_ostream_file_send_istream_splice(void)
+{
+	struct istream *input;
+	struct ostream *output;
+	char buf[32];
+	int in_fd[2], out_fd[2];
+
+	test_begin("ostream file send istream splice()");
+
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, in_fd) == 0);
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, out_fd) == 0);
+	fd_set_nonblock(in_fd[0], TRUE);
+	fd_set_nonblock(out_fd[0], TRUE);
+	input = i_stream_create_fd(in_fd[0], 1024);
+	output = o_stream_create_fd(out_fd[0], 1024);
+
+	/* socket to socket */
+	test_assert(write(in_fd[1], "hello", 5) == 5);
+	test_assert(o_stream_send_istream(output, input) == OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT);
+	test_assert(input->v_offset == 5);
+	test_assert(output->offset == 5);
+	test_assert(read(out_fd[1], buf, sizeof(buf)) == 5 &&
+		    memcmp(buf, "hello", 5) == 0);
+#ifdef HAVE_SPLICE
+	struct file_ostream *fstream =
+		container_of(output->real_stream, struct file_ostream, ostream);
+	test_assert(fstream->splice_fds[0] != -1);
+#endif
+
+	/* already buffered input is sent first */
+	test_assert(write(in_fd[1], "world", 5) == 5);
+	test_assert(i_stream_read(input) == 5);
+	test_assert(write(in_fd[1], "!", 1) == 1);
+	test_assert(o_stream_send_istream(output, input) == OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT);
+	test_assert(input->v_offset == 11);
+	test_assert(output->offset == 11);
+	test_assert(read(out_fd[1], buf, sizeof(buf)) == 6 &&
+		    memcmp(buf, "world!", 6) == 0);
+
+	/* EOF */
+	i_close_fd(&in_fd[1]);
+	test_assert(o_stream_send_istream(output, input) == OSTREAM_SEND_ISTREAM_RESULT_FINISHED);
+	test_assert(input->eof);
+
+	i_stream_destroy(&input);
+	o_stream_destroy(&output);
+	i_close_fd(&in_fd[0]);
+	i_close_fd(&out_fd[0]);
+	i_close_fd(&out_fd[1]);
+	test_end();
+}
+
 static void test_ostream_file_send_over_iov_max(void)
 {
 	test_begin("ostream file send over IOV_MAX");
@@ -208,12 +261,78 @@ static void test_ostream_file_send_over_iov_max(void)
 	test_end();
 }
 
+static unsigned int test_writev_count;
+
+static ssize_t
+test_ostream_file_counting_writev(struct file_ostream *fstream,
+				  const struct const_iovec *iov,
+				  unsigned int iov_count, const char **error_r)
+{
+	test_writev_count++;
+	return o_stream_file_writev(fstream, iov, iov_count, error_r);
+}
+
+#define TEST_GATHER_PREFIX "* 1 FETCH (BODY[] {32768}\r\n"
+#define TEST_GATHER_SUFFIX ")\r\n"
+
+static void test_ostream_file_send_gather(void)
+{
+	struct file_ostream *fstream;
+	struct ostream *output;
+	unsigned char data[IO_BLOCK_SIZE * 4], readbuf[sizeof(data) + 100];
+	size_t prefix_len = strlen(TEST_GATHER_PREFIX);
+	size_t suffix_len = strlen(TEST_GATHER_SUFFIX);
+	int fd;
+
+	test_begin("ostream file send gather");
+
+	fd = open(".temp.ostream", O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("creat(.temp.ostream) failed: %m");
+	output = o_stream_create_fd(fd, IO_BLOCK_SIZE);
+	fstream = container_of(output->real_stream,
+			       struct file_ostream, ostream);
+	fstream->writev = test_ostream_file_counting_writev;
+	random_fill(data, sizeof(data));
+
+	/* small writes are buffered while corked */
+	test_writev_count = 0;
+	o_stream_cork(output);
+	o_stream_nsend_str(output, TEST_GATHER_PREFIX);
+	test_assert(test_writev_count == 0);
+
+	/* the buffered prefix and the large write are sent together */
+	o_stream_nsend(output, data, sizeof(data));
+	test_assert(test_writev_count == 1);
+	test_assert(o_stream_get_buffer_used_size(output) == 0);
+
+	o_stream_nsend_str(output, TEST_GATHER_SUFFIX);
+	o_stream_uncork(output);
+	test_assert(test_writev_count == 2);
+	test_assert(o_stream_finish(output) > 0);
+	test_assert(output->offset == prefix_len + sizeof(data) + suffix_len);
+	o_stream_destroy(&output);
+
+	test_assert(pread(fd, readbuf, sizeof(readbuf), 0) ==
+		    (ssize_t)(prefix_len + sizeof(data) + suffix_len));
+	test_assert(memcmp(readbuf, TEST_GATHER_PREFIX, prefix_len) == 0);
+	test_assert(memcmp(readbuf + prefix_len, data, sizeof(data)) == 0);
+	test_assert(memcmp(readbuf + prefix_len + sizeof(data),
+			   TEST_GATHER_SUFFIX, suffix_len) == 0);
+	i_close_fd(&fd);
+
+	i_unlink(".temp.ostream");
+	test_end();
+}
+
 void test_ostream_file(void)
 {
 	test_ostream_file_random();
 	test_ostream_file_send_istream_file();
 	test_ostream_file_send_istream_sendfile();
+	test_ostream_file_send_istream_splice();
 	test_ostream_file_send_over_iov_max();
+	test_ostream_file_send_gather();
 }
 
 enum fatal_test_state fatal_ostream_file(unsigned int stage)
@@ -361,6 +361,138 @@ static void test_seq_range_array_have_common(void)
 	test_out("seq_range_array_have_common()", success);
 }
 
+static void
+test_seq_range_create_mask(ARRAY_TYPE(seq_range) *array, uint32_t mask)
+{
+	unsigned int i;
+
+	array_clear(array);
+	for (i = 0; i < 32; i++) {
+		if ((mask & (1U << i)) != 0)
+			seq_range_array_add(array, i + 1);
+	}
+}
+
+static uint32_t test_seq_range_get_mask(const ARRAY_TYPE(seq_range) *array)
+{
+	const struct seq_range *range;
+	uint32_t seq, mask = 0;
+
+	array_foreach(array, range) {
+		for (seq = range->seq1; seq <= range->seq2; seq++)
+			mask |= 1U << (seq - 1);
+	}
+	return mask;
+}
+
+static bool test_seq_range_array_equal(const ARRAY_TYPE(seq_range) *array1,
+				       const ARRAY_TYPE(seq_range) *array2)
+{
+	return array_count(array1) == array_count(array2) &&
+		(array_count(array1) == 0 ||
+		 memcmp(array_front(array1), array_front(array2),
+			array_count(array1) * sizeof(struct seq_range)) == 0);
+}
+
+static unsigned int test_bitcount(uint32_t mask)
+{
+	unsigned int count = 0;
+
+	for (; mask != 0; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+static void test_seq_range_array_merge_intersect(void)
+{
+	ARRAY_TYPE(seq_range) dest, src, expected;
+	const struct seq_range *range;
+	unsigned int i, count, removed;
+	uint32_t mask1, mask2;
+
+	test_begin("seq_range_array_merge() and intersect()");
+	t_array_init(&dest, 16);
+	t_array_init(&src, 16);
+	t_array_init(&expected, 16);
+	for (i = 0; i < 10000; i++) {
+		mask1 = i_rand();
+		mask2 = i_rand();
+		if (i % 3 == 0)
+			mask2 &= i_rand();
+
+		test_seq_range_create_mask(&dest, mask1);
+		test_seq_range_create_mask(&src, mask2);
+		seq_range_array_merge(&dest, &src);
+		test_seq_range_create_mask(&expected, mask1 | mask2);
+		test_assert_idx(test_seq_range_array_equal(&dest, &expected), i);
+
+		test_seq_range_create_mask(&dest, mask1);
+		removed = seq_range_array_intersect(&dest, &src);
+		test_assert_idx(removed == test_bitcount(mask1 & ~mask2), i);
+		test_assert_idx(test_seq_range_get_mask(&dest) == (mask1 & mask2), i);
+		test_seq_range_create_mask(&expected, mask1 & mask2);
+		test_assert_idx(test_seq_range_array_equal(&dest, &expected), i);
+	}
+
+	/* ranges touching the end of the sequence space */
+	array_clear(&dest);
+	array_clear(&src);
+	seq_range_array_add_range(&dest, 1, 3);
+	seq_range_array_add_range(&dest, (uint32_t)-10, (uint32_t)-1);
+	for (i = 0; i < 10; i++)
+		seq_range_array_add(&src, i * 2 + 2);
+	seq_range_array_add_range(&src, (uint32_t)-20, (uint32_t)-5);
+	removed = seq_range_array_intersect(&dest, &src);
+	test_assert(removed == 2 + 4);
+	range = array_get(&dest, &count);
+	test_assert(count == 2);
+	test_assert(range[0].seq1 == 2 && range[0].seq2 == 2);
+	test_assert(range[1].seq1 == (uint32_t)-10 &&
+		    range[1].seq2 == (uint32_t)-5);
+	seq_range_array_add_range(&src, (uint32_t)-2, (uint32_t)-1);
+	seq_range_array_merge(&dest, &src);
+	range = array_get(&dest, &count);
+	test_assert(count == 12);
+	test_assert(range[10].seq1 == (uint32_t)-20 &&
+		    range[10].seq2 == (uint32_t)-5);
+	test_assert(range[11].seq1 == (uint32_t)-2 &&
+		    range[11].seq2 == (uint32_t)-1);
+	test_end();
+}
+
+static void test_seq_range_array_merge_intersect_grow(void)
+{
+	ARRAY_TYPE(seq_range) dest, src;
+	const struct seq_range *range;
+	unsigned int i, count;
+
+	test_begin("seq_range_array_merge() and intersect() growing dest");
+	/* The result has more ranges than dest has space for, so dest is
+	   reallocated while the ranges are combined. */
+	t_array_init(&dest, 8);
+	t_array_init(&src, 8);
+	seq_range_array_add_range(&dest, 1, 100);
+	for (i = 0; i < 20; i++)
+		seq_range_array_add(&src, i * 2 + 1);
+	test_assert(seq_range_array_intersect(&dest, &src) == 100 - 20);
+	range = array_get(&dest, &count);
+	test_assert(count == 20);
+	for (i = 0; i < count; i++)
+		test_assert_idx(range[i].seq1 == i * 2 + 1 &&
+				range[i].seq2 == i * 2 + 1, i);
+
+	array_clear(&src);
+	for (i = 0; i < 20; i++)
+		seq_range_array_add(&src, i * 2 + 101);
+	seq_range_array_merge(&dest, &src);
+	range = array_get(&dest, &count);
+	test_assert(count == 40);
+	for (i = 0; i < count; i++)
+		test_assert_idx(range[i].seq1 == i * 2 + 1 + (i < 20 ? 0 : 60) &&
+				range[i].seq2 == range[i].seq1, i);
+	test_end();
+}
+
 void test_seq_range_array(void)
 {
 	test_seq_range_array_add_boundaries();
@@ -371,6 +503,8 @@ void test_seq_range_array(void)
 	test_seq_range_array_invert();
 	test_seq_range_array_invert_edges();
 	test_seq_range_array_have_common();
+	test_seq_range_array_merge_intersect();
+	test_seq_range_array_merge_intersect_grow();
 	test_seq_range_array_random();
 }
 
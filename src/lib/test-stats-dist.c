@@ -79,6 +79,66 @@ static void test_stats_dist_get_variance(void)
 	test_end();
 }
 
+static bool test_stats_dist_sketch_near(uint64_t value, uint64_t expected)
+{
+	/* the relative error is at most 1/64 */
+	uint64_t diff = value > expected ? value - expected : expected - value;
+	return diff * 64 <= expected;
+}
+
+static void test_stats_dist_sketch(void)
+{
+	struct stats_dist *t;
+	unsigned int count;
+	uint64_t i, value;
+
+	test_begin("stats_dist sketch small values");
+	t = stats_dist_init_sketch();
+	for (i = 1; i <= 10; i++)
+		stats_dist_add(t, i);
+	test_assert(stats_dist_get_count(t) == 10);
+	test_assert(stats_dist_get_sum(t) == 55);
+	test_assert(stats_dist_get_min(t) == 1);
+	test_assert(stats_dist_get_max(t) == 10);
+	/* small values are exact */
+	test_assert(stats_dist_get_median(t) == 5);
+	test_assert(stats_dist_get_percentile(t, 0.9) == 9);
+	test_assert(stats_dist_get_percentile(t, 1.0) == 10);
+	test_assert(DBL_EQ(stats_dist_get_variance(t), 8.25));
+	test_assert(stats_dist_get_samples(t, &count) != NULL || count == 0);
+	test_assert(count == 0);
+	stats_dist_reset(t);
+	test_assert(stats_dist_get_count(t) == 0);
+	test_assert(stats_dist_get_median(t) == 0);
+	stats_dist_add(t, 7);
+	test_assert(stats_dist_get_median(t) == 7);
+	stats_dist_deinit(&t);
+	test_end();
+
+	test_begin("stats_dist sketch large values");
+	t = stats_dist_init_sketch();
+	/* add in descending order to grow the buckets downwards */
+	for (i = 100000; i > 0; i--)
+		stats_dist_add(t, i * 1000);
+	test_assert(stats_dist_get_count(t) == 100000);
+	test_assert(stats_dist_get_min(t) == 1000);
+	test_assert(stats_dist_get_max(t) == 100000000);
+	test_assert(stats_dist_get_percentile(t, 0.0) == 1000);
+	test_assert(stats_dist_get_percentile(t, 1.0) == 100000000);
+	test_assert(test_stats_dist_sketch_near(stats_dist_get_median(t),
+						50000000));
+	value = stats_dist_get_percentile(t, 0.9);
+	test_assert(test_stats_dist_sketch_near(value, 90000000));
+	value = stats_dist_get_percentile(t, 0.99);
+	test_assert(test_stats_dist_sketch_near(value, 99000000));
+	value = stats_dist_get_percentile(t, 0.001);
+	test_assert(test_stats_dist_sketch_near(value, 100000));
+	stats_dist_add(t, UINT64_MAX);
+	test_assert(stats_dist_get_percentile(t, 1.0) == UINT64_MAX);
+	stats_dist_deinit(&t);
+	test_end();
+}
+
 void test_stats_dist(void)
 {
 	static int64_t test_input1[] = {
@@ -129,4 +189,5 @@ void test_stats_dist(void)
 	test_end();
 
 	test_stats_dist_get_variance();
+	test_stats_dist_sketch();
 }
@@ -721,6 +721,36 @@ static void test_memcspn(void)
 	test_end();
 }
 
+static void test_memchr2(void)
+{
+	unsigned char buf[100];
+	const unsigned char *p;
+
+	test_begin("i_memchr2");
+	test_assert(i_memchr2(NULL, 'a', 'b', 0) == NULL);
+	memset(buf, 'x', sizeof(buf));
+	test_assert(i_memchr2(buf, '\r', '\n', sizeof(buf)) == NULL);
+	/* every position and both bytes, with and without the SIMD part */
+	for (unsigned int i = 0; i < sizeof(buf); i++) {
+		buf[i] = (i % 2) == 0 ? '\r' : '\n';
+		p = i_memchr2(buf, '\r', '\n', sizeof(buf));
+		test_assert_idx(p == buf + i, i);
+		p = i_memchr2(buf, '\n', '\r', i + 1);
+		test_assert_idx(p == buf + i, i);
+		test_assert_idx(i_memchr2(buf, '\r', '\n', i) == NULL, i);
+		buf[i] = 'x';
+	}
+	/* the first match wins */
+	buf[40] = '\n';
+	buf[20] = '\r';
+	test_assert(i_memchr2(buf, '\r', '\n', sizeof(buf)) == buf + 20);
+	test_assert(i_memchr2(buf + 21, '\r', '\n', sizeof(buf) - 21) == buf + 40);
+	/* high bytes */
+	buf[30] = 0xff;
+	test_assert(i_memchr2(buf, 0xff, 0x80, sizeof(buf)) == buf + 30);
+	test_end();
+}
+
 void test_strfuncs(void)
 {
 	test_p_strdup();
@@ -745,6 +775,7 @@ void test_strfuncs(void)
 	test_str_match_icase();
 	test_memspn();
 	test_memcspn();
+	test_memchr2();
 }
 
 enum fatal_test_state fatal_strfuncs(unsigned int stage)
@@ -121,6 +121,34 @@ static void test_unichar_surrogates(void)
 	test_end();
 }
 
+static void test_unichar_ascii_titlecase(void)
+{
+	static const char mixed_in[] = "re: \xc3\xa4""bc def \xff g";
+	static const char mixed_exp[] = "RE: A\xcc\x88""BC DEF "
+		UNICODE_REPLACEMENT_CHAR_UTF8" G";
+	unsigned char ascii[127];
+	buffer_t *output = t_buffer_create(256);
+	unsigned int i;
+
+	test_begin("uni_utf8_to_decomposed_titlecase() US-ASCII");
+	for (i = 0; i < sizeof(ascii); i++)
+		ascii[i] = i + 1;
+	test_assert(uni_utf8_to_decomposed_titlecase(ascii, sizeof(ascii),
+						     output) == 0);
+	test_assert(output->used == sizeof(ascii));
+	for (i = 0; i < sizeof(ascii) && i < output->used; i++) {
+		test_assert_idx(((const unsigned char *)output->data)[i] ==
+				uni_ucs4_to_titlecase(ascii[i]), i);
+	}
+
+	buffer_set_used_size(output, 0);
+	test_assert(uni_utf8_to_decomposed_titlecase(mixed_in,
+			strlen(mixed_in), output) == -1);
+	test_assert(output->used == strlen(mixed_exp) &&
+		    memcmp(output->data, mixed_exp, output->used) == 0);
+	test_end();
+}
+
 void test_unichar(void)
 {
 	static const char overlong_utf8[] = "\xf8\x80\x95\x81\xa1";
@@ -182,4 +210,5 @@ void test_unichar(void)
 	test_unichar_uni_utf8_partial_strlen_n();
 	test_unichar_valid_unicode();
 	test_unichar_surrogates();
+	test_unichar_ascii_titlecase();
 }
@@ -346,6 +346,22 @@ int uni_utf8_to_decomposed_titlecase(const void *_input, size_t size,
 	int ret = 0;
 
 	while (size > 0) {
+		if (*input < 0x80) {
+			/* fast path for US-ASCII: titlecasing maps it to
+			   US-ASCII and it has no decompositions */
+			size_t i, len = 1;
+			unsigned char *dest;
+
+			while (len < size && input[len] < 0x80)
+				len++;
+			dest = buffer_append_space_unsafe(output, len);
+			for (i = 0; i < len; i++)
+				dest[i] = titlecase8_map[input[i]];
+			input += len;
+			size -= len;
+			continue;
+		}
+
 		int bytes = uni_utf8_get_char_n(input, size, &chr);
 		if (bytes <= 0) {
 			/* invalid input. try the next byte. */
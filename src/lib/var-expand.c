@@ -73,9 +73,28 @@ m_str_reverse(const char *str, struct var_expand_context *ctx ATTR_UNUSED)
 	return rev;
 }
 
+/* The original str_hash() algorithm. %H is used e.g. for directory
+   hashing, so its output must stay the same. */
+static unsigned int ATTR_NO_SANITIZE_INTEGER
+m_str_hash_value(const char *str)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	unsigned int g, h = 0;
+
+	while (*s != '\0') {
+		h = (h << 4) + *s;
+		if ((g = h & 0xf0000000UL) != 0) {
+			h = h ^ (g >> 24);
+			h = h ^ g;
+		}
+		s++;
+	}
+	return h;
+}
+
 static const char *m_str_hash(const char *str, struct var_expand_context *ctx)
 {
-	unsigned int value = str_hash(str);
+	unsigned int value = m_str_hash_value(str);
 	string_t *hash = t_str_new(20);
 
 	if (ctx->width != 0) {
@@ -540,9 +559,12 @@ int var_expand_with_funcs(string_t *dest, const char *str,
 	ctx.context = context;
 
 	for (; *str != '\0'; str++) {
-		if (*str != '%')
-			str_append_c(dest, *str);
-		else {
+		if (*str != '%') {
+			/* append the whole literal text up to the next % */
+			len = strcspn(str, "%");
+			str_append_data(dest, str, len);
+			str += len - 1;
+		} else {
 			int sign = 1;
 
 			str++;
@@ -251,7 +251,7 @@ int cmd_data_continue(void *conn_ctx, struct smtp_server_cmd_ctx *cmd,
 
 int cmd_data_begin(void *conn_ctx,
 		   struct smtp_server_cmd_ctx *cmd ATTR_UNUSED,
-		   struct smtp_server_transaction *trans ATTR_UNUSED,
+		   struct smtp_server_transaction *trans,
 		   struct istream *data_input)
 {
 	struct client *client = (struct client *)conn_ctx;
@@ -263,6 +263,12 @@ int cmd_data_begin(void *conn_ctx,
 	mail_user_set_get_temp_prefix(path, client->raw_mail_user->set);
 	client->state.mail_data_output =
 		iostream_temp_create_named(str_c(path), 0, "(lmtp data)");
+	if (trans->params.size > 0) {
+		/* Use the SIZE parameter from MAIL FROM to decide upfront
+		   whether the mail will be buffered in memory. */
+		o_stream_temp_set_size_hint(client->state.mail_data_output,
+					    trans->params.size);
+	}
 
 	client->state.data_input = data_input;
 	return 0;
@@ -489,6 +489,7 @@ lmtp_local_deliver(struct lmtp_local *local,
 		return -1;
 	}
 	local->rcpt_user = rcpt_user;
+	rcpt_user->delivering = TRUE;
 
 	/* Set the log prefix for the user. The default log prefix is
 	   automatically restored later when user context gets deactivated. */
@@ -394,7 +394,7 @@ static int log_connection_handshake(struct log_connection *log)
 	return 0;
 }
 
-static void log_connection_input(struct log_connection *log)
+static void log_connection_input_real(struct log_connection *log)
 {
 	const char *line;
 	ssize_t ret;
@@ -473,6 +473,15 @@ static void log_connection_input(struct log_connection *log)
 	}
 }
 
+static void log_connection_input(struct log_connection *log)
+{
+	/* Each read() may return many lines. Buffer them, so they are written
+	   with a few write() syscalls instead of one per line. */
+	i_set_failure_write_buffering(TRUE);
+	log_connection_input_real(log);
+	i_set_failure_write_buffering(FALSE);
+}
+
 void log_connection_create(struct log_error_buffer *errorbuf,
 			   int fd, int listen_fd)
 {
@@ -880,8 +880,11 @@ int client_get_plaintext_fd(struct client *client, int *fd_r, bool *close_fd_r)
 	}
 
 	/* We'll have to start proxying from now on until either side
-	   disconnects. Create a socketpair where login process is proxying on
-	   one side and the other side is sent to the post-login process. */
+	   disconnects. This is done even with kTLS: the kernel still passes
+	   TLS control records (alerts, KeyUpdate) to userspace, and they can
+	   only be handled with the OpenSSL state. Create a socketpair where
+	   login process is proxying on one side and the other side is sent
+	   to the post-login process. */
 	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
 		e_error(client->event, "socketpair() failed: %m");
 		return -1;
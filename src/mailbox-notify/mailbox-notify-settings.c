@@ -0,0 +1,42 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "settings-parser.h"
+#include "service-settings.h"
+
+struct service_settings mailbox_notify_service_settings = {
+	.name = "mailbox-notify",
+	.protocol = "",
+	.type = "",
+	.executable = "mailbox-notify",
+	.user = "$default_internal_user",
+	.group = "",
+	.privileged_group = "",
+	.extra_groups = "",
+	.chroot = "",
+
+	.drop_priv_before_exec = FALSE,
+
+	.process_min_avail = 0,
+	.process_limit = 1,
+	.client_limit = 0,
+	.service_count = 0,
+	.idle_kill = 0,
+	.vsz_limit = UOFF_T_MAX,
+
+	.unix_listeners = ARRAY_INIT,
+	.fifo_listeners = ARRAY_INIT,
+	.inet_listeners = ARRAY_INIT,
+
+	.process_limit_1 = TRUE
+};
+
+const struct setting_keyvalue mailbox_notify_service_settings_defaults[] = {
+	{ "unix_listener", "mailbox-notify" },
+
+	{ "unix_listener/mailbox-notify/path", "mailbox-notify" },
+	{ "unix_listener/mailbox-notify/mode", "0600" },
+
+	{ NULL, NULL }
+};
@@ -0,0 +1,43 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "restrict-access.h"
+#include "master-service.h"
+#include "master-service-settings.h"
+#include "notify-subscriptions.h"
+#include "notify-connection.h"
+
+static struct notify_subscriptions *subs;
+
+static void client_connected(struct master_service_connection *conn)
+{
+	master_service_client_connection_accept(conn);
+	notify_connection_create(conn, subs);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *error;
+
+	master_service = master_service_init("mailbox-notify", 0,
+					     &argc, &argv, "");
+	if (master_getopt(master_service) > 0)
+		return FATAL_DEFAULT;
+
+	if (master_service_settings_read_simple(master_service, &error) < 0)
+		i_fatal("%s", error);
+
+	master_service_init_log(master_service);
+	restrict_access_by_env(RESTRICT_ACCESS_FLAG_ALLOW_ROOT, NULL);
+	restrict_access_allow_coredumps(TRUE);
+
+	subs = notify_subscriptions_init();
+	master_service_init_finish(master_service);
+
+	master_service_run(master_service, client_connected);
+
+	notify_connections_destroy_all();
+	notify_subscriptions_deinit(&subs);
+	master_service_deinit(&master_service);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "connection.h"
+#include "ostream.h"
+#include "master-service.h"
+#include "notify-subscriptions.h"
+#include "notify-connection.h"
+
+#define MAILBOX_NOTIFY_PROTOCOL_MAJOR_VERSION 1
+#define MAILBOX_NOTIFY_PROTOCOL_MINOR_VERSION 0
+
+#define MAX_INBUF_SIZE 1024
+/* Disconnect clients that have this much unread output */
+#define MAX_OUTBUF_SIZE (1024*128)
+
+struct notify_connection {
+	struct connection conn;
+
+	struct notify_subscriptions *subs;
+	/* Mailbox GUIDs this connection is subscribed to */
+	ARRAY(guid_128_t) guids;
+};
+
+static struct connection_list *notify_connections = NULL;
+
+static void notify_connection_destroy(struct connection *conn);
+
+static void
+notify_connection_subscribe(struct notify_connection *nconn,
+			    const guid_128_t guid)
+{
+	guid_128_t *dest;
+
+	if (notify_subscriptions_add(nconn->subs, guid, nconn)) {
+		dest = array_append_space(&nconn->guids);
+		guid_128_copy(*dest, guid);
+	}
+}
+
+static void
+notify_connection_unsubscribe(struct notify_connection *nconn,
+			      const guid_128_t guid)
+{
+	const guid_128_t *guids;
+	unsigned int i, count;
+
+	if (!notify_subscriptions_remove(nconn->subs, guid, nconn))
+		return;
+
+	guids = array_get(&nconn->guids, &count);
+	for (i = 0; i < count; i++) {
+		if (guid_128_equals(guids[i], guid)) {
+			array_delete(&nconn->guids, i, 1);
+			break;
+		}
+	}
+}
+
+static void
+notify_connection_changed(struct notify_connection *nconn,
+			  const guid_128_t guid)
+{
+	struct notify_connection *subscriber, *const *overflowp;
+	ARRAY(struct notify_connection *) overflows;
+	void *const *subscribers;
+	unsigned int i, count;
+	const char *line;
+	size_t line_len;
+
+	subscribers = notify_subscriptions_get(nconn->subs, guid, &count);
+	if (count == 0)
+		return;
+
+	line = t_strdup_printf("CHANGED\t%s\n", guid_128_to_string(guid));
+	line_len = strlen(line);
+	t_array_init(&overflows, 4);
+	for (i = 0; i < count; i++) {
+		subscriber = subscribers[i];
+		/* the publisher already knows about its own changes */
+		if (subscriber == nconn)
+			continue;
+		if (o_stream_get_buffer_avail_size(subscriber->conn.output) <
+		    line_len)
+			array_push_back(&overflows, &subscriber);
+		else
+			o_stream_nsend_str(subscriber->conn.output, line);
+	}
+	/* Destroying modifies the subscriptions, so do it only after the
+	   loop. The client reconnects and subscribes again. */
+	array_foreach(&overflows, overflowp) {
+		subscriber = *overflowp;
+		e_error(subscriber->conn.event,
+			"Client isn't reading its input - disconnecting");
+		notify_connection_destroy(&subscriber->conn);
+	}
+}
+
+static int
+notify_connection_input_args(struct connection *conn, const char *const *args)
+{
+	struct notify_connection *nconn =
+		container_of(conn, struct notify_connection, conn);
+	const char *cmd = args[0];
+	guid_128_t guid;
+
+	/* <command> <mailbox guid> */
+	if (cmd == NULL || args[1] == NULL ||
+	    guid_128_from_string(args[1], guid) < 0) {
+		e_error(conn->event, "Client sent invalid input");
+		return -1;
+	}
+
+	if (strcmp(cmd, "SUB") == 0)
+		notify_connection_subscribe(nconn, guid);
+	else if (strcmp(cmd, "UNSUB") == 0)
+		notify_connection_unsubscribe(nconn, guid);
+	else if (strcmp(cmd, "CHANGED") == 0)
+		notify_connection_changed(nconn, guid);
+	else {
+		e_error(conn->event, "Client sent unknown command: %s", cmd);
+		return -1;
+	}
+	return 1;
+}
+
+static const struct connection_vfuncs notify_connection_vfuncs = {
+	.destroy = notify_connection_destroy,
+	.input_args = notify_connection_input_args,
+};
+
+static const struct connection_settings notify_connection_set = {
+	.service_name_in = "mailbox-notify-client",
+	.service_name_out = "mailbox-notify-server",
+	.major_version = MAILBOX_NOTIFY_PROTOCOL_MAJOR_VERSION,
+	.minor_version = MAILBOX_NOTIFY_PROTOCOL_MINOR_VERSION,
+	.input_max_size = MAX_INBUF_SIZE,
+	.output_max_size = MAX_OUTBUF_SIZE,
+};
+
+void notify_connection_create(struct master_service_connection *conn,
+			      struct notify_subscriptions *subs)
+{
+	struct notify_connection *nconn;
+
+	if (notify_connections == NULL) {
+		notify_connections =
+			connection_list_init(&notify_connection_set,
+					     &notify_connection_vfuncs);
+	}
+
+	nconn = i_new(struct notify_connection, 1);
+	nconn->subs = subs;
+	i_array_init(&nconn->guids, 4);
+	connection_init_server(notify_connections, &nconn->conn,
+			       conn->name, conn->fd, conn->fd);
+}
+
+static void notify_connection_destroy(struct connection *conn)
+{
+	struct notify_connection *nconn =
+		container_of(conn, struct notify_connection, conn);
+	const guid_128_t *guid;
+
+	array_foreach(&nconn->guids, guid)
+		(void)notify_subscriptions_remove(nconn->subs, *guid, nconn);
+	array_free(&nconn->guids);
+
+	connection_deinit(&nconn->conn);
+	master_service_client_connection_destroyed(master_service);
+	i_free(nconn);
+}
+
+void notify_connections_destroy_all(void)
+{
+	if (notify_connections != NULL)
+		connection_list_deinit(&notify_connections);
+}
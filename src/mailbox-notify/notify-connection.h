@@ -0,0 +1,12 @@
+#ifndef NOTIFY_CONNECTION_H
+#define NOTIFY_CONNECTION_H
+
+struct master_service_connection;
+struct notify_subscriptions;
+
+void notify_connection_create(struct master_service_connection *conn,
+			      struct notify_subscriptions *subs);
+
+void notify_connections_destroy_all(void);
+
+#endif
@@ -0,0 +1,126 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "hash.h"
+#include "notify-subscriptions.h"
+
+struct notify_subscription_mailbox {
+	guid_128_t guid;
+	ARRAY(void *) subscribers;
+};
+
+struct notify_subscriptions {
+	/* mailbox GUID => struct notify_subscription_mailbox */
+	HASH_TABLE(const uint8_t *, struct notify_subscription_mailbox *) mailboxes;
+};
+
+struct notify_subscriptions *notify_subscriptions_init(void)
+{
+	struct notify_subscriptions *subs;
+
+	subs = i_new(struct notify_subscriptions, 1);
+	hash_table_create(&subs->mailboxes, default_pool, 0,
+			  guid_128_hash, guid_128_cmp);
+	return subs;
+}
+
+static void
+notify_subscription_mailbox_free(struct notify_subscription_mailbox *mailbox)
+{
+	array_free(&mailbox->subscribers);
+	i_free(mailbox);
+}
+
+void notify_subscriptions_deinit(struct notify_subscriptions **_subs)
+{
+	struct notify_subscriptions *subs = *_subs;
+	struct hash_iterate_context *iter;
+	const uint8_t *guid;
+	struct notify_subscription_mailbox *mailbox;
+
+	*_subs = NULL;
+
+	iter = hash_table_iterate_init(subs->mailboxes);
+	while (hash_table_iterate(iter, subs->mailboxes, &guid, &mailbox))
+		notify_subscription_mailbox_free(mailbox);
+	hash_table_iterate_deinit(&iter);
+	hash_table_destroy(&subs->mailboxes);
+	i_free(subs);
+}
+
+static bool
+notify_subscription_mailbox_find(struct notify_subscription_mailbox *mailbox,
+				 void *subscriber, unsigned int *idx_r)
+{
+	void *const *subscribers;
+	unsigned int i, count;
+
+	subscribers = array_get(&mailbox->subscribers, &count);
+	for (i = 0; i < count; i++) {
+		if (subscribers[i] == subscriber) {
+			*idx_r = i;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+bool notify_subscriptions_add(struct notify_subscriptions *subs,
+			      const guid_128_t guid, void *subscriber)
+{
+	struct notify_subscription_mailbox *mailbox;
+	unsigned int idx;
+
+	mailbox = hash_table_lookup(subs->mailboxes, guid);
+	if (mailbox == NULL) {
+		mailbox = i_new(struct notify_subscription_mailbox, 1);
+		guid_128_copy(mailbox->guid, guid);
+		i_array_init(&mailbox->subscribers, 4);
+		const uint8_t *guid_p = mailbox->guid;
+		hash_table_insert(subs->mailboxes, guid_p, mailbox);
+	} else if (notify_subscription_mailbox_find(mailbox, subscriber, &idx)) {
+		return FALSE;
+	}
+	array_push_back(&mailbox->subscribers, &subscriber);
+	return TRUE;
+}
+
+bool notify_subscriptions_remove(struct notify_subscriptions *subs,
+				 const guid_128_t guid, void *subscriber)
+{
+	struct notify_subscription_mailbox *mailbox;
+	unsigned int idx;
+
+	mailbox = hash_table_lookup(subs->mailboxes, guid);
+	if (mailbox == NULL ||
+	    !notify_subscription_mailbox_find(mailbox, subscriber, &idx))
+		return FALSE;
+
+	array_delete(&mailbox->subscribers, idx, 1);
+	if (array_is_empty(&mailbox->subscribers)) {
+		const uint8_t *guid_p = mailbox->guid;
+		hash_table_remove(subs->mailboxes, guid_p);
+		notify_subscription_mailbox_free(mailbox);
+	}
+	return TRUE;
+}
+
+void *const *notify_subscriptions_get(struct notify_subscriptions *subs,
+				      const guid_128_t guid,
+				      unsigned int *count_r)
+{
+	struct notify_subscription_mailbox *mailbox;
+
+	mailbox = hash_table_lookup(subs->mailboxes, guid);
+	if (mailbox == NULL) {
+		*count_r = 0;
+		return NULL;
+	}
+	return array_get(&mailbox->subscribers, count_r);
+}
+
+unsigned int notify_subscriptions_count(struct notify_subscriptions *subs)
+{
+	return hash_table_count(subs->mailboxes);
+}
@@ -0,0 +1,24 @@
+#ifndef NOTIFY_SUBSCRIPTIONS_H
+#define NOTIFY_SUBSCRIPTIONS_H
+
+#include "guid.h"
+
+struct notify_subscriptions *notify_subscriptions_init(void);
+void notify_subscriptions_deinit(struct notify_subscriptions **subs);
+
+/* Subscribe to the changes of the mailbox GUID. Returns FALSE if the
+   subscriber was already subscribed to it. */
+bool notify_subscriptions_add(struct notify_subscriptions *subs,
+			      const guid_128_t guid, void *subscriber);
+/* Returns FALSE if the subscriber wasn't subscribed to the mailbox GUID. */
+bool notify_subscriptions_remove(struct notify_subscriptions *subs,
+				 const guid_128_t guid, void *subscriber);
+/* Returns the subscribers of the mailbox GUID, or NULL with count_r=0 if
+   there are none. */
+void *const *notify_subscriptions_get(struct notify_subscriptions *subs,
+				      const guid_128_t guid,
+				      unsigned int *count_r);
+/* Returns the number of mailboxes that have subscribers. */
+unsigned int notify_subscriptions_count(struct notify_subscriptions *subs);
+
+#endif
@@ -0,0 +1,63 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "test-common.h"
+#include "notify-subscriptions.h"
+
+static guid_128_t mailbox1_guid = {
+	0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xf1
+};
+static guid_128_t mailbox2_guid = {
+	0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xf2
+};
+
+static void test_notify_subscriptions(void)
+{
+	struct notify_subscriptions *subs;
+	void *const *subscribers;
+	unsigned int count;
+	int sub1, sub2;
+
+	test_begin("notify subscriptions");
+	subs = notify_subscriptions_init();
+
+	test_assert(notify_subscriptions_get(subs, mailbox1_guid, &count) == NULL);
+	test_assert(count == 0);
+
+	test_assert(notify_subscriptions_add(subs, mailbox1_guid, &sub1));
+	test_assert(!notify_subscriptions_add(subs, mailbox1_guid, &sub1));
+	test_assert(notify_subscriptions_add(subs, mailbox1_guid, &sub2));
+	test_assert(notify_subscriptions_add(subs, mailbox2_guid, &sub2));
+	test_assert(notify_subscriptions_count(subs) == 2);
+
+	subscribers = notify_subscriptions_get(subs, mailbox1_guid, &count);
+	test_assert(count == 2);
+	test_assert(subscribers[0] == &sub1 && subscribers[1] == &sub2);
+	subscribers = notify_subscriptions_get(subs, mailbox2_guid, &count);
+	test_assert(count == 1 && subscribers[0] == &sub2);
+
+	test_assert(notify_subscriptions_remove(subs, mailbox1_guid, &sub1));
+	test_assert(!notify_subscriptions_remove(subs, mailbox1_guid, &sub1));
+	test_assert(!notify_subscriptions_remove(subs, mailbox2_guid, &sub1));
+	subscribers = notify_subscriptions_get(subs, mailbox1_guid, &count);
+	test_assert(count == 1 && subscribers[0] == &sub2);
+
+	/* the mailbox is dropped when its last subscriber is removed */
+	test_assert(notify_subscriptions_remove(subs, mailbox1_guid, &sub2));
+	test_assert(notify_subscriptions_get(subs, mailbox1_guid, &count) == NULL);
+	test_assert(notify_subscriptions_count(subs) == 1);
+
+	/* deinit frees the remaining subscriptions */
+	notify_subscriptions_deinit(&subs);
+	test_assert(subs == NULL);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_notify_subscriptions,
+		NULL
+	};
+	return test_run(test_functions);
+}
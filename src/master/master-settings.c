@@ -133,6 +133,7 @@ static const struct setting_define service_setting_defines[] = {
 	DEF(UINT, service_count),
 	DEF(TIME, idle_kill),
 	DEF(SIZE, vsz_limit),
+	DEF(BOOL, process_cpu_affinity),
 
 	{ .type = SET_FILTER_ARRAY, .key = "unix_listener",
 	  .offset = offsetof(struct service_settings, unix_listeners),
@@ -166,6 +167,7 @@ static const struct service_settings service_default_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.process_cpu_affinity = FALSE,
 
 	.unix_listeners = ARRAY_INIT,
 	.fifo_listeners = ARRAY_INIT,
@@ -548,6 +550,9 @@ master_settings_ext_check(struct event *event, void *_set,
 			  pool_t pool, const char **error_r)
 {
 	static bool warned_auth = FALSE, warned_anvil = FALSE;
+#ifndef HAVE_SCHED_GETAFFINITY
+	static bool warned_cpu_affinity = FALSE;
+#endif
 	struct master_settings *set = _set;
 	struct service_settings *const *services;
 	const char *const *strings;
@@ -692,6 +697,13 @@ master_settings_ext_check(struct event *event, void *_set,
 				"vsz_limit is too low", service->name);
 			return FALSE;
 		}
+#ifndef HAVE_SCHED_GETAFFINITY
+		if (service->process_cpu_affinity && !warned_cpu_affinity) {
+			warned_cpu_affinity = TRUE;
+			i_warning("service(%s): process_cpu_affinity isn't "
+				  "supported on this OS", service->name);
+		}
+#endif
 
 #ifdef CONFIG_BINARY
 		default_service =
@@ -1004,6 +1016,31 @@ static void mkdir_listener_subdirs(const struct master_settings *set)
 	}
 }
 
+static void mkdir_auth_state_dir(const struct master_settings *set)
+{
+	struct service_settings *service;
+	const char *dir, *error;
+	uid_t uid;
+	gid_t gid;
+
+	array_foreach_elem(&set->parsed_services, service) {
+		if (strcmp(service->name, "auth") != 0)
+			continue;
+		if (get_uidgid(service->user, &uid, &gid, &error) < 0) {
+			i_error("%s (for creating auth state directory)",
+				error);
+			return;
+		}
+		dir = t_strconcat(set->state_dir,
+				  "/"MASTER_AUTH_STATE_DIR_NAME, NULL);
+		if (safe_mkdir(dir, 0700, uid, gid) == 0) {
+			i_warning("Corrected permissions for auth state "
+				  "directory %s", dir);
+		}
+		return;
+	}
+}
+
 void master_settings_do_fixes(const struct master_settings *set)
 {
 	const char *empty_dir;
@@ -1028,6 +1065,7 @@ void master_settings_do_fixes(const struct master_settings *set)
 	/* Make sure our permanent state directory exists */
 	if (mkdir_parents(set->state_dir, 0755) < 0 && errno != EEXIST)
 		i_fatal("mkdir(%s) failed: %m", set->state_dir);
+	mkdir_auth_state_dir(set);
 
 	mkdir_login_dir(set, t_strconcat(set->base_dir, "/login", NULL));
 	mkdir_login_dir(set, t_strconcat(set->base_dir, "/token-login", NULL));
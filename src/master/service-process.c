@@ -1,5 +1,6 @@
 /* Copyright (c) 2005-2018 Dovecot authors, see the included COPYING file */
 
+#define _GNU_SOURCE /* sched_setaffinity() */
 #include "common.h"
 #include "array.h"
 #include "aqueue.h"
@@ -33,6 +34,9 @@
 #include <syslog.h>
 #include <signal.h>
 #include <sys/wait.h>
+#ifdef HAVE_SCHED_GETAFFINITY
+#  include <sched.h>
+#endif
 
 static void service_reopen_inet_listeners(struct service *service)
 {
@@ -52,6 +56,44 @@ static void service_reopen_inet_listeners(struct service *service)
 	}
 }
 
+static void
+service_process_set_cpu_affinity(struct service *service,
+				 unsigned int process_idx)
+{
+#ifdef HAVE_SCHED_GETAFFINITY
+	cpu_set_t allowed, cpu;
+	unsigned int i, cpu_count;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+		e_error(service->event, "sched_getaffinity() failed: %m");
+		return;
+	}
+	cpu_count = CPU_COUNT(&allowed);
+	if (cpu_count <= 1)
+		return;
+
+	/* pin the processes round-robin to the CPUs master is allowed to
+	   run on. Together with inet_listener { reuse_port } this gives each
+	   CPU its own processes and listener sockets. */
+	process_idx %= cpu_count;
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, &allowed))
+			continue;
+		if (process_idx-- == 0)
+			break;
+	}
+	i_assert(i < CPU_SETSIZE);
+	CPU_ZERO(&cpu);
+	CPU_SET(i, &cpu);
+	if (sched_setaffinity(0, sizeof(cpu), &cpu) < 0)
+		e_error(service->event, "sched_setaffinity(%u) failed: %m", i);
+#else
+	/* master_settings_ext_check() already warned about this */
+	(void)service;
+	(void)process_idx;
+#endif
+}
+
 static int
 service_unix_pid_listener_get_path(struct service_listener *l, pid_t pid,
 				   string_t *path, const char **error_r)
@@ -410,6 +452,10 @@ struct service_process *service_process_create(struct service *service)
 	if (pid == 0) {
 		/* child */
 		service_process_setup_environment(service, uid, hostdomain);
+		if (service->set->process_cpu_affinity) {
+			service_process_set_cpu_affinity(service,
+				service->process_count_total);
+		}
 		service_reopen_inet_listeners(service);
 		service_dup_fds(service);
 		drop_privileges(service);
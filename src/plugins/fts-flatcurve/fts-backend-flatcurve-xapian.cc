@@ -156,6 +156,7 @@ struct flatcurve_xapian {
 	/* List of mailboxes to optimize at shutdown. */
 	HASH_TABLE(char *, char *) optimize;
 
+	bool bulk:1;
 	bool deinit:1;
 };
 
@@ -229,6 +230,12 @@ void fts_flatcurve_xapian_init(struct flatcurve_fts_backend *backend)
 			  4, str_hash, strcmp);
 }
 
+void fts_flatcurve_xapian_set_bulk(struct flatcurve_fts_backend *backend,
+				   bool bulk)
+{
+	backend->xapian->bulk = bulk;
+}
+
 void fts_flatcurve_xapian_deinit(struct flatcurve_fts_backend *backend)
 {
 	struct flatcurve_xapian *x = backend->xapian;
@@ -1398,7 +1405,8 @@ fts_flatcurve_xapian_close_db(struct flatcurve_fts_backend *backend,
 
 		if (xdb->type == FLATCURVE_XAPIAN_DB_TYPE_CURRENT) {
 			if (HAS_ALL_BITS(opts, FLATCURVE_XAPIAN_DB_CLOSE_ROTATE) ||
-				(backend->fuser->set.rotate_time > 0 &&
+				(!x->bulk &&
+				 backend->fuser->set.rotate_time > 0 &&
 				 elapsed > backend->fuser->set.rotate_time))
 				rotate = TRUE;
 		}
@@ -1616,20 +1624,25 @@ fts_flatcurve_xapian_init_msg(struct flatcurve_fts_backend_update_context *ctx,
 		/* error or x->dbw_current == NULL */
 		return ret;
 	try {
-		(void)xdb->dbw->get_document(ctx->uid);
-		/* document already existed */
-		return 0;
+		/* New mails are indexed in ascending UID order, so usually
+		 * the UID is larger than anything in the DB. Avoid the
+		 * lookup (and the DocNotFoundError) in that case. */
+		if (ctx->uid <= xdb->dbw->get_lastdocid()) {
+			(void)xdb->dbw->get_document(ctx->uid);
+			/* document already existed */
+			return 0;
+		}
 	} catch (Xapian::DocNotFoundError &e) {
-		x->doc = new Xapian::Document();
-		x->doc_created = TRUE;
-		x->doc_uid = ctx->uid;
 		/* document did not exist */
-		return 1;
 	} catch (Xapian::Error &e) {
 		ctx->ctx.failed = TRUE;
 		*error_r = t_strdup(e.get_description().c_str());
 		return -1;
 	}
+	x->doc = new Xapian::Document();
+	x->doc_created = TRUE;
+	x->doc_uid = ctx->uid;
+	return 1;
 }
 
 int
@@ -2121,6 +2134,15 @@ void fts_flatcurve_xapian_build_query(struct flatcurve_fts_query *query)
 		fts_flatcurve_build_query_arg(query, args);
 }
 
+static Xapian::docid
+fts_flatcurve_xapian_unique_docid(struct flatcurve_fts_backend *backend,
+				  Xapian::docid docid)
+{
+	unsigned int shards = backend->xapian->shards;
+
+	return shards <= 1 ? docid : (docid - 1) / shards + 1;
+}
+
 struct fts_flatcurve_xapian_query_iter *
 fts_flatcurve_xapian_query_iter_init(struct flatcurve_fts_query *query)
 {
@@ -2184,9 +2206,11 @@ fts_flatcurve_xapian_query_iter_next(struct fts_flatcurve_xapian_query_iter *ite
 	iter->result->score = iter->mset_iter.get_weight();
 	/* MSet docid can be an "interleaved" docid generated by
 	 * Xapian::Database when handling multiple DBs at once. Instead, we
-	 * want the "unique docid", which is obtained by looking at the
-	 * doc id from the Document object itself. */
-	iter->result->uid = iter->mset_iter.get_document().get_docid();
+	 * want the "unique docid". Xapian interleaves the docids of N shards
+	 * as (docid - 1) * N + shard + 1, so it can be calculated directly
+	 * without loading each matching Document from disk. */
+	iter->result->uid = fts_flatcurve_xapian_unique_docid(
+		iter->query->backend, *iter->mset_iter);
 	++iter->mset_iter;
 
 	*result_r = iter->result;
@@ -30,6 +30,10 @@ int fts_flatcurve_xapian_refresh(struct flatcurve_fts_backend *backend,
 int fts_flatcurve_xapian_close(struct flatcurve_fts_backend *backend,
 			       const char **error_r);
 void fts_flatcurve_xapian_deinit(struct flatcurve_fts_backend *backend);
+/* Bulk indexing mode: the current shard isn't rotated because of slow
+   commits, since there are no interactive users waiting for them. */
+void fts_flatcurve_xapian_set_bulk(struct flatcurve_fts_backend *backend,
+				   bool bulk);
 
 int fts_flatcurve_xapian_get_last_uid(struct flatcurve_fts_backend *backend,
 				      uint32_t *last_uid_r, const char **error_r);
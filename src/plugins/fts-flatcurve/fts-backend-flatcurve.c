@@ -13,6 +13,10 @@
 #include "fts-backend-flatcurve.h"
 #include "fts-backend-flatcurve-xapian.h"
 
+/* Switch to bulk indexing mode after this many mails have been indexed within
+   the same update transaction, i.e. doveadm index / indexer-worker. */
+#define FTS_FLATCURVE_BULK_INDEX_MIN_MSGS 1000
+
 enum fts_backend_flatcurve_action {
 	FTS_BACKEND_FLATCURVE_ACTION_OPTIMIZE,
 	FTS_BACKEND_FLATCURVE_ACTION_RESCAN
@@ -189,9 +193,17 @@ fts_backend_flatcurve_update_deinit(struct fts_backend_update_context *_ctx)
 		i_gettimeofday(&now);
 		diff = timeval_diff_msecs(&now, &ctx->start);
 
-		e_debug(ctx->backend->event, "Update transaction completed in "
-			"%lld.%03lld secs", diff/1000, diff%1000);
+		e_debug(event_create_passthrough(ctx->backend->event)->
+			set_name("fts_flatcurve_update_finished")->
+			add_int("indexed_count", ctx->indexed_count)->
+			add_int("duration_msecs", diff)->
+			add_int("mails_per_sec", diff == 0 ? ctx->indexed_count :
+				ctx->indexed_count * 1000LL / diff)->event(),
+			"Update transaction completed in %lld.%03lld secs "
+			"(indexed %u mails)", diff/1000, diff%1000,
+			ctx->indexed_count);
 	}
+	fts_flatcurve_xapian_set_bulk(ctx->backend, FALSE);
 
 	str_free(&ctx->hdr_name);
 	p_free(ctx->backend->pool, ctx);
@@ -269,6 +281,11 @@ fts_backend_flatcurve_update_set_build_key(struct fts_backend_update_context *_c
 			return FALSE;
 		}
 
+		if (++ctx->indexed_count == FTS_FLATCURVE_BULK_INDEX_MIN_MSGS) {
+			e_debug(ctx->backend->event,
+				"Switching to bulk indexing mode");
+			fts_flatcurve_xapian_set_bulk(ctx->backend, TRUE);
+		}
 		e_debug(event_create_passthrough(ctx->backend->event)->
 			set_name("fts_flatcurve_index")->
 			add_str("mailbox", str_c(ctx->backend->boxname))->
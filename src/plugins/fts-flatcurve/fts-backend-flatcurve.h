@@ -32,6 +32,7 @@ struct flatcurve_fts_backend_update_context {
 	string_t *hdr_name;
 	uint32_t uid;
 	struct timeval start;
+	unsigned int indexed_count;
 
 	bool indexed_hdr:1;
 	bool skip_uid:1;
@@ -1,6 +1,11 @@
 /* Copyright (c) 2014-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "buffer.h"
+#include "hash.h"
+#include "hex-binary.h"
+#include "llist.h"
+#include "sha2.h"
 #include "ioloop.h"
 #include "istream.h"
 #include "module-context.h"
@@ -14,6 +19,15 @@
 #define TIKA_USER_CONTEXT(obj) \
 	MODULE_CONTEXT(obj, fts_parser_tika_user_module)
 
+/* Attachments up to this size are buffered in memory before they're sent to
+   Tika, so their extracted text can be looked up from the cache first. Larger
+   attachments are streamed to Tika and never cached. */
+#define TIKA_CACHE_MAX_INPUT_SIZE (4*1024*1024)
+/* Maximum total size of the cached extracted texts */
+#define TIKA_CACHE_MAX_TOTAL_SIZE (16*1024*1024)
+/* Maximum size of a single cached extracted text */
+#define TIKA_CACHE_MAX_TEXT_SIZE (TIKA_CACHE_MAX_TOTAL_SIZE / 4)
+
 struct fts_parser_tika_user {
 	union mail_user_module_context module_ctx;
 	struct http_url *http_url;
@@ -28,10 +42,36 @@ struct tika_fts_parser {
 	struct io *io;
 	struct istream *payload;
 
+	/* Buffered attachment input, or NULL if it's being streamed to Tika */
+	buffer_t *input;
+	struct sha256_ctx input_hash;
+	/* Cache key and the text extracted so far, if the result is going to
+	   be added to the cache */
+	char *cache_key;
+	buffer_t *output;
+
 	bool failed;
 };
 
+struct tika_cache_entry {
+	struct tika_cache_entry *prev, *next;
+
+	char *key;
+	buffer_t *text;
+};
+
+/* Process-wide LRU cache of extracted texts, keyed by a hash of the
+   attachment's Content-Type and body. The same attachment is often delivered
+   to many recipients, and indexer-worker processes index many users. */
+struct tika_cache {
+	HASH_TABLE(const char *, struct tika_cache_entry *) entries;
+	/* head is the most recently used entry */
+	struct tika_cache_entry *head, *tail;
+	size_t text_size;
+};
+
 static struct http_client *tika_http_client = NULL;
+static struct tika_cache *tika_cache = NULL;
 static MODULE_CONTEXT_DEFINE_INIT(fts_parser_tika_user_module,
 				  &mail_user_module_register);
 
@@ -89,6 +129,74 @@ tika_get_http_client_url(struct fts_parser_context *parser_context, struct http_
 	return 0;
 }
 
+static void tika_cache_entry_free(struct tika_cache_entry *entry)
+{
+	buffer_free(&entry->text);
+	i_free(entry->key);
+	i_free(entry);
+}
+
+static struct tika_cache_entry *tika_cache_lookup(const char *key)
+{
+	struct tika_cache_entry *entry;
+
+	if (tika_cache == NULL)
+		return NULL;
+	entry = hash_table_lookup(tika_cache->entries, key);
+	if (entry != NULL && entry != tika_cache->head) {
+		DLLIST2_REMOVE(&tika_cache->head, &tika_cache->tail, entry);
+		DLLIST2_PREPEND(&tika_cache->head, &tika_cache->tail, entry);
+	}
+	return entry;
+}
+
+static void tika_cache_add(const char *key, buffer_t **_text)
+{
+	struct tika_cache_entry *entry, *old_entry;
+
+	if (tika_cache == NULL) {
+		tika_cache = i_new(struct tika_cache, 1);
+		hash_table_create(&tika_cache->entries, default_pool, 0,
+				  str_hash, strcmp);
+	}
+	if (hash_table_lookup(tika_cache->entries, key) != NULL) {
+		buffer_free(_text);
+		return;
+	}
+
+	entry = i_new(struct tika_cache_entry, 1);
+	entry->key = i_strdup(key);
+	entry->text = *_text;
+	*_text = NULL;
+
+	tika_cache->text_size += entry->text->used;
+	while (tika_cache->text_size > TIKA_CACHE_MAX_TOTAL_SIZE) {
+		old_entry = tika_cache->tail;
+		i_assert(old_entry != NULL);
+		hash_table_remove(tika_cache->entries,
+				  (const char *)old_entry->key);
+		DLLIST2_REMOVE(&tika_cache->head, &tika_cache->tail, old_entry);
+		tika_cache->text_size -= old_entry->text->used;
+		tika_cache_entry_free(old_entry);
+	}
+	hash_table_insert(tika_cache->entries, (const char *)entry->key, entry);
+	DLLIST2_PREPEND(&tika_cache->head, &tika_cache->tail, entry);
+}
+
+static void tika_cache_deinit(void)
+{
+	struct tika_cache_entry *entry;
+
+	if (tika_cache == NULL)
+		return;
+	while ((entry = tika_cache->head) != NULL) {
+		DLLIST2_REMOVE(&tika_cache->head, &tika_cache->tail, entry);
+		tika_cache_entry_free(entry);
+	}
+	hash_table_destroy(&tika_cache->entries);
+	i_free(tika_cache);
+}
+
 static void
 fts_tika_parser_response(const struct http_response *response,
 			 struct tika_fts_parser *parser)
@@ -175,9 +283,50 @@ fts_parser_tika_try_init(struct fts_parser_context *parser_context)
 	http_client_request_add_header(http_req, "Accept", "text/plain");
 
 	parser->http_req = http_req;
+
+	parser->input = buffer_create_dynamic(default_pool, 4096);
+	sha256_init(&parser->input_hash);
+	if (parser_context->content_type != NULL) {
+		sha256_loop(&parser->input_hash, parser_context->content_type,
+			    strlen(parser_context->content_type) + 1);
+	}
 	return &parser->parser;
 }
 
+static void fts_parser_tika_send_input(struct tika_fts_parser *parser)
+{
+	if (!parser->failed && parser->input->used > 0 &&
+	    http_client_request_send_payload(&parser->http_req,
+					     parser->input->data,
+					     parser->input->used) < 0)
+		parser->failed = TRUE;
+	buffer_free(&parser->input);
+}
+
+static void fts_parser_tika_finish_input(struct tika_fts_parser *parser)
+{
+	struct tika_cache_entry *entry;
+	unsigned char digest[SHA256_RESULTLEN];
+	const char *key;
+
+	sha256_result(&parser->input_hash, digest);
+	key = binary_to_hex(digest, sizeof(digest));
+
+	entry = tika_cache_lookup(key);
+	if (entry != NULL) {
+		/* the same attachment was already extracted */
+		e_debug(parser->user->event,
+			"fts_tika: Using cached text for %s", key);
+		parser->payload = i_stream_create_copy_from_buffer(entry->text);
+		http_client_request_abort(&parser->http_req);
+		buffer_free(&parser->input);
+		return;
+	}
+	fts_parser_tika_send_input(parser);
+	parser->cache_key = i_strdup(key);
+	parser->output = buffer_create_dynamic(default_pool, 4096);
+}
+
 static void fts_parser_tika_more(struct fts_parser *_parser,
 				 struct message_block *block)
 {
@@ -189,6 +338,18 @@ static void fts_parser_tika_more(struct fts_parser *_parser,
 	ssize_t ret;
 
 	if (block->size > 0) {
+		if (parser->input != NULL) {
+			sha256_loop(&parser->input_hash, block->data, block->size);
+			if (parser->input->used + block->size <=
+			    TIKA_CACHE_MAX_INPUT_SIZE) {
+				buffer_append(parser->input, block->data,
+					      block->size);
+				block->size = 0;
+				return;
+			}
+			/* too large to be cached */
+			fts_parser_tika_send_input(parser);
+		}
 		/* first we'll send everything to Tika */
 		if (!parser->failed &&
 		    http_client_request_send_payload(&parser->http_req,
@@ -199,6 +360,8 @@ static void fts_parser_tika_more(struct fts_parser *_parser,
 		return;
 	}
 
+	if (parser->payload == NULL && parser->input != NULL)
+		fts_parser_tika_finish_input(parser);
 	if (parser->payload == NULL) {
 		/* read the result from Tika */
 		if (!parser->failed &&
@@ -235,6 +398,14 @@ static void fts_parser_tika_more(struct fts_parser *_parser,
 		block->data = data;
 		block->size = size;
 		i_stream_skip(parser->payload, size);
+		if (parser->output != NULL) {
+			/* too large texts aren't cached */
+			if (parser->output->used + size >
+			    TIKA_CACHE_MAX_TEXT_SIZE)
+				buffer_free(&parser->output);
+			else
+				buffer_append(parser->output, data, size);
+		}
 	} else {
 		/* finished */
 		i_assert(ret == -1);
@@ -243,6 +414,9 @@ static void fts_parser_tika_more(struct fts_parser *_parser,
 				i_stream_get_name(parser->payload),
 				i_stream_get_error(parser->payload));
 			parser->failed = TRUE;
+		} else if (parser->output != NULL &&
+			   !parser->parser.may_need_retry) {
+			tika_cache_add(parser->cache_key, &parser->output);
 		}
 	}
 }
@@ -266,6 +440,9 @@ static int fts_parser_tika_deinit(struct fts_parser *_parser, const char **retri
 		io_loop_set_current(parser->ioloop);
 		io_loop_destroy(&parser->ioloop);
 	}
+	buffer_free(&parser->input);
+	buffer_free(&parser->output);
+	i_free(parser->cache_key);
 	i_free(parser);
 	return ret;
 }
@@ -274,6 +451,7 @@ static void fts_parser_tika_unload(void)
 {
 	if (tika_http_client != NULL)
 		http_client_deinit(&tika_http_client);
+	tika_cache_deinit();
 }
 
 struct fts_parser_vfuncs fts_parser_tika = {
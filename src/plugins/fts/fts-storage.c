@@ -40,6 +40,8 @@ struct fts_mailbox_list {
 	const char *backend_name;
 	struct fts_backend_update_context *update_ctx;
 	unsigned int update_ctx_refcount;
+	/* Mailboxes whose indexing is queued when the list is deinitialized */
+	ARRAY_TYPE(const_string) index_queue_vnames;
 
 	bool failed:1;
 };
@@ -663,18 +665,19 @@ static void fts_transaction_rollback(struct mailbox_transaction_context *t)
 	fbox->module_ctx.super.transaction_rollback(t);
 }
 
-static void fts_queue_index(struct mailbox *box)
+static void
+fts_queue_index_send(struct mail_user *user, struct event *event,
+		     const char *const *vnames, unsigned int count)
 {
-	struct mail_user *user = box->storage->user;
 	string_t *str = t_str_new(256);
 	const char *path, *value;
-	unsigned int max_recent_msgs;
+	unsigned int i, max_recent_msgs;
 	int fd;
 
 	path = t_strconcat(user->set->base_dir, "/"INDEXER_SOCKET_NAME, NULL);
 	fd = net_connect_unix(path);
 	if (fd == -1) {
-		e_error(box->event, "net_connect_unix(%s) failed: %m", path);
+		e_error(event, "net_connect_unix(%s) failed: %m", path);
 		return;
 	}
 
@@ -683,19 +686,43 @@ static void fts_queue_index(struct mailbox *box)
 		max_recent_msgs = 0;
 
 	str_append(str, INDEXER_HANDSHAKE);
-	str_append(str, "APPEND\t0\t");
-	str_append_tabescaped(str, user->username);
-	str_append_c(str, '\t');
-	str_append_tabescaped(str, box->vname);
-	str_printfa(str, "\t%u", max_recent_msgs);
-	str_append_c(str, '\t');
-	str_append_tabescaped(str, box->storage->user->session_id);
-	str_append_c(str, '\n');
+	for (i = 0; i < count; i++) {
+		str_append(str, "APPEND\t0\t");
+		str_append_tabescaped(str, user->username);
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, vnames[i]);
+		str_printfa(str, "\t%u", max_recent_msgs);
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, user->session_id);
+		str_append_c(str, '\n');
+	}
 	if (write_full(fd, str_data(str), str_len(str)) < 0)
-		e_error(box->event, "write(%s) failed: %m", path);
+		e_error(event, "write(%s) failed: %m", path);
 	i_close_fd(&fd);
 }
 
+static void fts_queue_index(struct mailbox *box)
+{
+	struct fts_mailbox_list *flist = FTS_LIST_CONTEXT_REQUIRE(box->list);
+
+	if (!box->storage->user->delivering) {
+		fts_queue_index_send(box->storage->user, box->event,
+				     &box->vname, 1);
+		return;
+	}
+
+	/* Mail delivery: queue all the mailboxes delivered to at once when
+	   the user is deinitialized. The indexer then indexes only the
+	   newly delivered mails while they're still in the page cache. */
+	if (!array_is_created(&flist->index_queue_vnames))
+		p_array_init(&flist->index_queue_vnames, box->list->pool, 4);
+	else if (array_lsearch(&flist->index_queue_vnames, &box->vname,
+			       i_strcmp_p) != NULL)
+		return;
+	const char *vname = p_strdup(box->list->pool, box->vname);
+	array_push_back(&flist->index_queue_vnames, &vname);
+}
+
 static int
 fts_transaction_commit(struct mailbox_transaction_context *t,
 		       struct mail_transaction_commit_changes *changes_r)
@@ -878,6 +905,14 @@ static void fts_mailbox_list_deinit(struct mailbox_list *list)
 {
 	struct fts_mailbox_list *flist = FTS_LIST_CONTEXT_REQUIRE(list);
 
+	if (array_is_created(&flist->index_queue_vnames)) T_BEGIN {
+		const char *const *vnames;
+		unsigned int count;
+
+		vnames = array_get(&flist->index_queue_vnames, &count);
+		fts_queue_index_send(list->ns->user, list->event,
+				     vnames, count);
+	} T_END;
 	if (flist->backend != NULL)
 		fts_backend_deinit(&flist->backend);
 	flist->module_ctx.super.deinit(list);
@@ -6,6 +6,7 @@
 #include "istream-seekable.h"
 #include "ostream.h"
 #include "str.h"
+#include "mail-cache.h"
 #include "mail-user.h"
 #include "index-storage.h"
 #include "index-mail.h"
@@ -23,6 +24,7 @@
 
 #define MAX_INBUF_SIZE (1024*1024)
 #define MAIL_COMPRESS_MAIL_CACHE_EXPIRE_MSECS (60*1000)
+#define MAIL_COMPRESS_CACHE_DEFAULT_MIN_SIZE 256
 
 struct mail_compress_mail {
 	union mail_module_context module_ctx;
@@ -44,6 +46,9 @@ struct mail_compress_user {
 
 	const struct compression_handler *save_handler;
 	int save_level;
+
+	/* mail_compress_cache: compression for dovecot.index.cache fields */
+	struct mail_cache_compression cache_compression;
 };
 
 const char *mail_compress_plugin_version = DOVECOT_ABI_VERSION;
@@ -286,16 +291,72 @@ static void mail_compress_mailbox_open_input(struct mailbox *box)
 	}
 }
 
+static int
+mail_compress_cache_compress(const struct mail_cache_compression *compression,
+			     const void *data, size_t size, buffer_t *dest)
+{
+	const struct compression_handler *handler = compression->context;
+	struct ostream *output, *zoutput;
+	int ret = 0;
+
+	output = o_stream_create_buffer(dest);
+	zoutput = handler->create_ostream(output, compression->level);
+	o_stream_unref(&output);
+
+	o_stream_nsend(zoutput, data, size);
+	if (o_stream_finish(zoutput) < 0) {
+		i_error("Failed to compress cache field: %s",
+			o_stream_get_error(zoutput));
+		ret = -1;
+	}
+	o_stream_destroy(&zoutput);
+	return ret;
+}
+
+static int
+mail_compress_cache_decompress(const struct mail_cache_compression *compression ATTR_UNUSED,
+			       const void *data, size_t size, buffer_t *dest,
+			       const char **error_r)
+{
+	struct istream *input, *zinput;
+	const unsigned char *p;
+	size_t p_size;
+	int ret = 0;
+
+	/* autodetect the compression format, in case the cache file was
+	   written with a different mail_compress_cache setting */
+	input = i_stream_create_from_data(data, size);
+	zinput = i_stream_create_decompress(input, 0);
+	i_stream_unref(&input);
+
+	while (i_stream_read_more(zinput, &p, &p_size) > 0) {
+		buffer_append(dest, p, p_size);
+		i_stream_skip(zinput, p_size);
+	}
+	if (zinput->stream_errno != 0) {
+		*error_r = t_strdup(i_stream_get_error(zinput));
+		ret = -1;
+	}
+	i_stream_destroy(&zinput);
+	return ret;
+}
+
 static int mail_compress_mailbox_open(struct mailbox *box)
 {
 	union mailbox_module_context *zbox = MAIL_COMPRESS_CONTEXT(box);
+	struct mail_compress_user *zuser =
+		MAIL_COMPRESS_USER_CONTEXT(box->storage->user);
 
 	if (box->input == NULL &&
 	    (box->storage->class_flags &
 	     MAIL_STORAGE_CLASS_FLAG_OPEN_STREAMS) != 0)
 		mail_compress_mailbox_open_input(box);
 
-	return zbox->super.open(box);
+	if (zbox->super.open(box) < 0)
+		return -1;
+	if (zuser->cache_compression.compress != NULL && box->cache != NULL)
+		mail_cache_set_compression(box->cache, &zuser->cache_compression);
+	return 0;
 }
 
 static void mail_compress_mailbox_close(struct mailbox *box)
@@ -333,6 +394,46 @@ static void mail_compress_mail_user_deinit(struct mail_user *user)
 	zuser->module_ctx.super.deinit(user);
 }
 
+static void
+mail_compress_mail_user_init_cache(struct mail_user *user,
+				   struct mail_compress_user *zuser)
+{
+	struct mail_cache_compression *comp = &zuser->cache_compression;
+	const struct compression_handler *handler;
+	const char *name;
+	unsigned int min_size;
+	int ret;
+
+	name = mail_user_plugin_getenv(user, "mail_compress_cache");
+	if (name == NULL || *name == '\0')
+		return;
+	ret = compression_lookup_handler(name, &handler);
+	if (ret <= 0) {
+		e_error(user->event,
+			"mail_compress_cache: %s: %s", ret == 0 ?
+			"Support not compiled in for handler" :
+			"Unknown handler", name);
+		return;
+	}
+
+	min_size = MAIL_COMPRESS_CACHE_DEFAULT_MIN_SIZE;
+	name = mail_user_plugin_getenv(user, "mail_compress_cache_min_size");
+	if (name != NULL && name[0] != '\0' &&
+	    str_to_uint(name, &min_size) < 0) {
+		e_error(user->event,
+			"mail_compress_cache_min_size: Invalid size: %s", name);
+		min_size = MAIL_COMPRESS_CACHE_DEFAULT_MIN_SIZE;
+	}
+	comp->min_size = min_size;
+
+	comp->compress = mail_compress_cache_compress;
+	comp->decompress = mail_compress_cache_decompress;
+	/* the handlers are static, so this stays valid even if the cache
+	   outlives the user */
+	comp->context = handler;
+	comp->level = handler->get_default_level();
+}
+
 static void mail_compress_mail_user_created(struct mail_user *user)
 {
 	struct mail_user_vfuncs *v = user->vlast;
@@ -372,6 +473,7 @@ static void mail_compress_mail_user_created(struct mail_user *user)
 	} else if (zuser->save_handler != NULL) {
 		zuser->save_level = zuser->save_handler->get_default_level();
 	}
+	mail_compress_mail_user_init_cache(user, zuser);
 	MODULE_CONTEXT_SET(user, mail_compress_user_module, zuser);
 }
 
@@ -55,6 +55,12 @@ struct push_notification_driver_ox_config {
 /* This is data specific to an OX driver transaction. */
 struct push_notification_driver_ox_txn {
 	const char *unsafe_user;
+
+	/* Mailbox status looked up for the first message. It's the same for
+	   all the messages in the transaction. */
+	struct mailbox_status box_status;
+	bool box_status_looked_up:1;
+	bool box_status_failed:1;
 };
 
 static void
@@ -369,18 +375,18 @@ push_notification_driver_ox_process_msg(
 	struct push_notification_driver_ox_txn *txn =
 		(struct push_notification_driver_ox_txn *)dtxn->context;
 	struct mail_user *user = dtxn->ptxn->muser;
-	struct mailbox_status box_status;
-	bool status_success = TRUE;
-
-	if (push_notification_driver_ox_get_mailbox_status(
-		dtxn, &box_status) < 0) {
-		status_success = FALSE;
-	}
 
 	messagenew = push_notification_txn_msg_get_eventdata(msg, "MessageNew");
 	if (messagenew == NULL)
 		return;
 
+	if (!txn->box_status_looked_up) {
+		txn->box_status_looked_up = TRUE;
+		if (push_notification_driver_ox_get_mailbox_status(
+			dtxn, &txn->box_status) < 0)
+			txn->box_status_failed = TRUE;
+	}
+
 	push_notification_driver_ox_init_global(user, dconfig);
 
 	http_req = http_client_request_url(
@@ -413,9 +419,9 @@ push_notification_driver_ox_process_msg(
 		json_ostream_nwrite_string(json_output, "snippet",
 					   messagenew->snippet);
 	}
-	if (status_success) {
+	if (!txn->box_status_failed) {
 		json_ostream_nwrite_number(json_output, "unseen",
-					   box_status.unseen);
+					   txn->box_status.unseen);
 	}
 	json_ostream_nascend_object(json_output);
 	json_ostream_nfinish_destroy(&json_output);
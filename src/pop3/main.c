@@ -445,6 +445,8 @@ int main(int argc, char *argv[])
 	storage_service =
 		mail_storage_service_init(master_service,
 					  storage_service_flags);
+	if (!IS_STANDALONE())
+		mail_storage_service_preload_modules(storage_service);
 	master_service_init_finish(master_service);
 	/* NOTE: login_set.*_socket_path are now invalid due to data stack
 	   having been freed */
@@ -95,6 +95,8 @@ static bool exporter_file_open_unix(struct exporter_file *node)
 		return FALSE;
 	}
 	node->output = o_stream_create_unix(node->fd, IO_BLOCK_SIZE);
+	/* the transport queue size is checked before sending */
+	o_stream_set_max_buffer_size(node->output, SIZE_MAX);
 	return TRUE;
 }
 
@@ -125,13 +127,19 @@ static bool exporter_file_open(struct exporter_file *node)
 	return TRUE;
 }
 
-static void event_export_transport_file_write(struct exporter_file *node,
+static void event_export_transport_file_write(const struct exporter *exporter,
+					      struct exporter_file *node,
 					      const buffer_t *buf)
 {
 	const struct const_iovec vec[] = {
 		{ .iov_base = buf->data, .iov_len = buf->used },
 		{ .iov_base = "\n", .iov_len = 1 }
 	};
+	/* Don't let a slow reader grow the buffer without limits */
+	if (event_export_transport_queue_full(exporter,
+			o_stream_get_buffer_used_size(node->output),
+			buf->used + 1))
+		return;
 	if (o_stream_sendv(node->output, vec, N_ELEMENTS(vec)) < 0) {
 		if (ioloop_time - node->last_error > EXPORTER_LAST_ERROR_DELAY) {
 			i_error("write(%s): %s", o_stream_get_name(node->output),
@@ -150,7 +158,7 @@ void event_export_transport_file(const struct exporter *exporter,
 		node = exporter_file_init(exporter, FALSE);
 	if (!exporter_file_open(node))
 		return;
-	event_export_transport_file_write(node, buf);
+	event_export_transport_file_write(exporter, node, buf);
 }
 
 void event_export_transport_unix(const struct exporter *exporter,
@@ -161,7 +169,7 @@ void event_export_transport_unix(const struct exporter *exporter,
 		node = exporter_file_init(exporter, TRUE);
 	if (!exporter_file_open(node))
 		return;
-	event_export_transport_file_write(node, buf);
+	event_export_transport_file_write(exporter, node, buf);
 }
 
 void event_export_transport_file_reopen(void)
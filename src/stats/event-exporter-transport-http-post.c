@@ -1,6 +1,7 @@
 /* Copyright (c) 2019 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
 #include "ioloop.h"
 #include "str.h"
 #include "event-exporter.h"
@@ -11,13 +12,61 @@
 #include "master-service-ssl-settings.h"
 #include "stats-common.h"
 
+struct exporter_http_post {
+	char *exporter_name;
+	/* Bytes of payload in requests that haven't finished yet */
+	size_t queued_size;
+};
+
+struct exporter_http_post_request {
+	struct exporter_http_post *node;
+	size_t size;
+};
+
 /* the http client used to export all events with exporter=http-post */
 static struct http_client *exporter_http_client;
+/* Contexts are freed only after all the requests are destroyed. An
+   exporter with the same name reuses the existing context, so the pending
+   requests are still counted after the exporters are recreated. */
+static ARRAY(struct exporter_http_post *) exporter_http_post_nodes;
 
 void event_export_transport_http_post_deinit(void)
 {
+	struct exporter_http_post *node;
+
 	if (exporter_http_client != NULL)
 		http_client_deinit(&exporter_http_client);
+	if (array_is_created(&exporter_http_post_nodes)) {
+		array_foreach_elem(&exporter_http_post_nodes, node) {
+			i_free(node->exporter_name);
+			i_free(node);
+		}
+		array_free(&exporter_http_post_nodes);
+	}
+}
+
+static void request_destroyed(struct exporter_http_post_request *hreq)
+{
+	i_assert(hreq->node->queued_size >= hreq->size);
+	hreq->node->queued_size -= hreq->size;
+	i_free(hreq);
+}
+
+static struct exporter_http_post *
+exporter_http_post_get(const struct exporter *exporter)
+{
+	struct exporter_http_post *node;
+
+	if (!array_is_created(&exporter_http_post_nodes))
+		i_array_init(&exporter_http_post_nodes, 4);
+	array_foreach_elem(&exporter_http_post_nodes, node) {
+		if (strcmp(node->exporter_name, exporter->name) == 0)
+			return node;
+	}
+	node = i_new(struct exporter_http_post, 1);
+	node->exporter_name = i_strdup(exporter->name);
+	array_push_back(&exporter_http_post_nodes, &node);
+	return node;
 }
 
 static void response_fxn(const struct http_response *response,
@@ -48,8 +97,18 @@ static void response_fxn(const struct http_response *response,
 void event_export_transport_http_post(const struct exporter *exporter,
 				      const buffer_t *buf)
 {
+	struct exporter_http_post *node = exporter->transport_context;
+	struct exporter_http_post_request *hreq;
 	struct http_client_request *req;
 
+	if (node == NULL) {
+		node = exporter_http_post_get(exporter);
+		event_export_transport_assign_context(exporter, node);
+	}
+	if (event_export_transport_queue_full(exporter, node->queued_size,
+					      buf->used))
+		return;
+
 	if (exporter_http_client == NULL) {
 		struct ssl_iostream_settings ssl_set;
 
@@ -72,5 +131,11 @@ void event_export_transport_http_post(const struct exporter *exporter,
 	http_client_request_set_payload_data(req, buf->data, buf->used);
 
 	http_client_request_set_timeout_msecs(req, exporter->transport_timeout);
+
+	hreq = i_new(struct exporter_http_post_request, 1);
+	hreq->node = node;
+	hreq->size = buf->used;
+	node->queued_size += buf->used;
+	http_client_request_set_destroy_callback(req, request_destroyed, hreq);
 	http_client_request_submit(req);
 }
@@ -34,5 +34,10 @@ void event_export_helper_fmt_categories(string_t *dest,
 /* assign transport context to a event exporter */
 void event_export_transport_assign_context(const struct exporter *exporter,
 					   void *context);
+/* Returns TRUE if adding size bytes to the queued_size bytes already waiting
+   to be sent would exceed the exporter's transport_queue_size. The event is
+   then counted as dropped. */
+bool event_export_transport_queue_full(const struct exporter *exporter,
+				       size_t queued_size, size_t size);
 
 #endif
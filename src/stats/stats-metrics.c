@@ -2,6 +2,7 @@
 
 #include "stats-common.h"
 #include "array.h"
+#include "ioloop.h"
 #include "str.h"
 #include "str-sanitize.h"
 #include "stats-dist.h"
@@ -18,6 +19,7 @@
 
 #define LOG_EXPORTER_LONG_FIELD_TRUNCATE_LEN 1000
 #define STATS_SUB_METRIC_MAX_LENGTH 256
+#define EXPORTER_DROPPED_LOG_INTERVAL_SECS 60
 
 struct stats_metrics {
 	pool_t pool;
@@ -42,6 +44,8 @@ static void stats_exporters_add_set(struct stats_metrics *metrics,
 	exporter->name = p_strdup(metrics->pool, set->name);
 	exporter->transport_args = p_strdup(metrics->pool, set->transport_args);
 	exporter->transport_timeout = set->transport_timeout;
+	exporter->transport_queue_size = set->transport_queue_size;
+	exporter->sample_rate = set->sample_rate;
 	exporter->time_format = set->parsed_time_format;
 
 	/* TODO: The following should be plugable.
@@ -95,6 +99,28 @@ void event_export_transport_assign_context(const struct exporter *exporter,
 	ptr->transport_context = context;
 }
 
+bool event_export_transport_queue_full(const struct exporter *exporter,
+				       size_t queued_size, size_t size)
+{
+	struct exporter *ptr = (struct exporter *)exporter;
+
+	if (exporter->transport_queue_size == 0 ||
+	    queued_size + size <= exporter->transport_queue_size)
+		return FALSE;
+
+	ptr->dropped_count++;
+	ptr->dropped_count_unlogged++;
+	if (ioloop_time - exporter->last_dropped_log >=
+	    EXPORTER_DROPPED_LOG_INTERVAL_SECS) {
+		i_warning("Event exporter %s: Transport queue is full - "
+			  "dropped %u events", exporter->name,
+			  exporter->dropped_count_unlogged);
+		ptr->dropped_count_unlogged = 0;
+		ptr->last_dropped_log = ioloop_time;
+	}
+	return TRUE;
+}
+
 static int stats_exporters_add_filter(struct stats_metrics *metrics,
 				      const char *filter_name,
 				      const char **error_r)
@@ -125,7 +151,10 @@ stats_metric_alloc(pool_t pool, const char *name,
 	struct metric *metric = p_new(pool, struct metric, 1);
 	metric->name = p_strdup(pool, name);
 	metric->set = set;
-	metric->duration_stats = stats_dist_init();
+	if (array_is_created(&set->parsed_quantiles))
+		metric->duration_stats = stats_dist_init_sketch();
+	else
+		metric->duration_stats = stats_dist_init();
 	metric->fields_count = str_array_length(fields);
 	if (metric->fields_count > 0) {
 		metric->fields = p_new(pool, struct metric_field,
@@ -245,6 +274,7 @@ stats_metric_settings_dup(pool_t pool, const struct stats_metric_settings *src)
 	set->fields = p_strdup(pool, src->fields);
 	set->group_by = p_strdup(pool, src->group_by);
 	set->filter = p_strdup(pool, src->filter);
+	set->quantiles = p_strdup(pool, src->quantiles);
 	set->exporter = p_strdup(pool, src->exporter);
 	set->exporter_include = p_strdup(pool, src->exporter_include);
 
@@ -387,6 +417,17 @@ int stats_metrics_init(struct event *event,
 	return 0;
 }
 
+struct exporter *const *
+stats_metrics_get_exporters(struct stats_metrics *metrics,
+			    unsigned int *count_r)
+{
+	if (!array_is_created(&metrics->exporters)) {
+		*count_r = 0;
+		return NULL;
+	}
+	return array_get(&metrics->exporters, count_r);
+}
+
 static void stats_metric_free(struct metric *metric)
 {
 	struct metric *sub_metric;
@@ -844,6 +885,12 @@ stats_export_event(struct metric *metric, struct event *oldevent)
 
 	i_assert(exporter != NULL);
 
+	if (exporter->sample_rate > 1 &&
+	    i_rand_limit(exporter->sample_rate) != 0) {
+		/* sampled out - skip also formatting the event */
+		return;
+	}
+
 	event = event_flatten(oldevent);
 
 	T_BEGIN {
@@ -35,8 +35,18 @@ struct exporter {
 	 */
 	const char *transport_args;
 	unsigned int transport_timeout;
+	/* Max bytes of exported events waiting to be sent, 0 = unlimited */
+	size_t transport_queue_size;
 	void *transport_context;
 
+	/* Export only a random 1/sample_rate of the events */
+	unsigned int sample_rate;
+
+	/* Number of events dropped because the queue was full */
+	uint64_t dropped_count;
+	unsigned int dropped_count_unlogged;
+	time_t last_dropped_log;
+
 	/* function to send the event */
 	void (*transport)(const struct exporter *, const buffer_t *);
 };
@@ -131,6 +141,11 @@ stats_metrics_get_event_filter(struct stats_metrics *metrics);
 void stats_metrics_event(struct stats_metrics *metrics, struct event *event,
 			 const struct failure_context *ctx);
 
+/* Returns all the configured exporters. */
+struct exporter *const *
+stats_metrics_get_exporters(struct stats_metrics *metrics,
+			    unsigned int *count_r);
+
 /* Iterate through all the tracked metrics. */
 struct stats_metrics_iter *
 stats_metrics_iterate_init(struct stats_metrics *metrics);
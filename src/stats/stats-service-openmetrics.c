@@ -28,6 +28,7 @@
 enum openmetrics_metric_type {
 	OPENMETRICS_METRIC_TYPE_COUNT,
 	OPENMETRICS_METRIC_TYPE_DURATION,
+	OPENMETRICS_METRIC_TYPE_QUANTILES,
 	OPENMETRICS_METRIC_TYPE_FIELD,
 	OPENMETRICS_METRIC_TYPE_HISTOGRAM,
 };
@@ -109,6 +110,24 @@ static void openmetrics_export_dovecot(string_t *out)
 			"Dovecot build information\n");
 	str_append(out, "# TYPE dovecot_build info\n");
 	str_append(out, "dovecot_build_info{"OPENMETRICS_BUILD_INFO"} 1\n");
+
+	struct exporter *const *exporters;
+	unsigned int i, count;
+
+	exporters = stats_metrics_get_exporters(stats_metrics, &count);
+	if (count == 0)
+		return;
+	str_append(out, "# HELP dovecot_exporter_dropped_events "
+			"Events dropped because the exporter's transport "
+			"queue was full\n");
+	str_append(out, "# TYPE dovecot_exporter_dropped_events counter\n");
+	for (i = 0; i < count; i++) {
+		str_append(out, "dovecot_exporter_dropped_events_total"
+				"{exporter=\"");
+		json_append_escaped(out, exporters[i]->name);
+		str_printfa(out, "\"} %"PRIu64"\n",
+			    exporters[i]->dropped_count);
+	}
 }
 
 static void openmetrics_export_eof(string_t *out)
@@ -144,6 +163,7 @@ openmetrics_export_metric_value(struct openmetrics_request *req, string_t *out,
 		else
 			str_printfa(out, "_%s_total", field->field_key);
 		break;
+	case OPENMETRICS_METRIC_TYPE_QUANTILES:
 	case OPENMETRICS_METRIC_TYPE_HISTOGRAM:
 		i_unreached();
 	}
@@ -169,11 +189,41 @@ openmetrics_export_metric_value(struct openmetrics_request *req, string_t *out,
 		str_printfa(out, " %"PRIu64"\n",
 			    stats_dist_get_sum(field->stats));
 		break;
+	case OPENMETRICS_METRIC_TYPE_QUANTILES:
 	case OPENMETRICS_METRIC_TYPE_HISTOGRAM:
 		i_unreached();
 	}
 }
 
+static void
+openmetrics_export_quantiles(struct openmetrics_request *req, string_t *out,
+			     const struct metric *metric)
+{
+	double quantile;
+
+	/* Nothing to report without any events */
+	if (stats_dist_get_count(metric->duration_stats) == 0)
+		return;
+
+	array_foreach_elem(&req->metric->set->parsed_quantiles, quantile) {
+		/* Metric name */
+		str_append(out, "dovecot_");
+		str_append(out, req->metric->name);
+		str_append(out, "_duration_quantiles_seconds");
+		/* Labels */
+		str_append_c(out, '{');
+		if (str_len(req->labels) > 0) {
+			str_append_str(out, req->labels);
+			str_append_c(out, ',');
+		}
+		str_printfa(out, "quantile=\"%g\"}", quantile);
+		/* Value - convert from microseconds to seconds */
+		str_printfa(out, " %.6f\n",
+			    stats_dist_get_percentile(metric->duration_stats,
+						      quantile) / 1e6F);
+	}
+}
+
 static const struct metric *
 openmetrics_find_histogram_bucket(const struct metric *metric,
 				 unsigned int index)
@@ -296,6 +346,9 @@ openmetrics_export_metric_header(struct openmetrics_request *req, string_t *out)
 	case OPENMETRICS_METRIC_TYPE_DURATION:
 		str_append(out, "_duration_seconds Total duration of all events of this kind");
 		break;
+	case OPENMETRICS_METRIC_TYPE_QUANTILES:
+		str_append(out, "_duration_quantiles_seconds Duration quantiles of events of this kind");
+		break;
 	case OPENMETRICS_METRIC_TYPE_FIELD:
 		field = &metric->fields[req->field_pos];
 		str_printfa(out, "_%s Total of field value for events of this kind",
@@ -320,6 +373,9 @@ openmetrics_export_metric_header(struct openmetrics_request *req, string_t *out)
 	case OPENMETRICS_METRIC_TYPE_DURATION:
 		str_append(out, "_duration_seconds counter\n");
 		break;
+	case OPENMETRICS_METRIC_TYPE_QUANTILES:
+		str_append(out, "_duration_quantiles_seconds summary\n");
+		break;
 	case OPENMETRICS_METRIC_TYPE_FIELD:
 		field = &metric->fields[req->field_pos];
 		str_printfa(out, "_%s counter\n", field->field_key);
@@ -351,7 +407,10 @@ openmetrics_export_submetric(struct openmetrics_request *req, string_t *out,
 		return;
 	}
 
-	openmetrics_export_metric_value(req, out, metric);
+	if (req->metric_type == OPENMETRICS_METRIC_TYPE_QUANTILES)
+		openmetrics_export_quantiles(req, out, metric);
+	else
+		openmetrics_export_metric_value(req, out, metric);
 
 	req->has_submetric = TRUE;
 }
@@ -560,6 +619,14 @@ static void openmetrics_export_next(struct openmetrics_request *req)
 		req->state = OPENMETRICS_REQUEST_STATE_METRIC_HEADER;
 		break;
 	case OPENMETRICS_METRIC_TYPE_DURATION:
+		if (array_is_created(&req->metric->set->parsed_quantiles)) {
+			/* Continue with quantiles output for this metric. */
+			req->metric_type = OPENMETRICS_METRIC_TYPE_QUANTILES;
+			req->state = OPENMETRICS_REQUEST_STATE_METRIC_HEADER;
+			break;
+		}
+		/* fall through */
+	case OPENMETRICS_METRIC_TYPE_QUANTILES:
 		if (openmetrics_export_has_histogram(req)) {
 			/* Continue with histogram output for this metric. */
 			req->metric_type = OPENMETRICS_METRIC_TYPE_HISTOGRAM;
@@ -659,6 +726,8 @@ openmetrics_export_continue(struct openmetrics_request *req, string_t *out)
 		str_truncate(req->labels, req->labels_pos);
 		if (req->metric_type == OPENMETRICS_METRIC_TYPE_HISTOGRAM)
 			openmetrics_export_histogram(req, out, req->metric);
+		else if (req->metric_type == OPENMETRICS_METRIC_TYPE_QUANTILES)
+			openmetrics_export_quantiles(req, out, req->metric);
 		else
 			openmetrics_export_metric_body(req, out);
 		openmetrics_export_next(req);
@@ -76,6 +76,8 @@ static const struct setting_define stats_exporter_setting_defines[] = {
 	DEF(STR, transport),
 	DEF(STR, transport_args),
 	DEF(TIME_MSECS, transport_timeout),
+	DEF(SIZE, transport_queue_size),
+	DEF(UINT, sample_rate),
 	DEF(STR, format),
 	DEF(STR, format_args),
 	SETTING_DEFINE_LIST_END
@@ -86,6 +88,8 @@ static const struct stats_exporter_settings stats_exporter_default_settings = {
 	.transport = "",
 	.transport_args = "",
 	.transport_timeout = 250, /* ms */
+	.transport_queue_size = 1024*1024,
+	.sample_rate = 1,
 	.format = "",
 	.format_args = "",
 };
@@ -114,6 +118,7 @@ static const struct setting_define stats_metric_setting_defines[] = {
 	DEF(STR, fields),
 	DEF(STR, group_by),
 	DEF(STR, filter),
+	DEF(STR, quantiles),
 	DEF(STR, exporter),
 	DEF(STR, exporter_include),
 	DEF(STR, description),
@@ -126,6 +131,7 @@ static const struct stats_metric_settings stats_metric_default_settings = {
 	.filter = "",
 	.exporter = "",
 	.group_by = "",
+	.quantiles = "",
 	.exporter_include = STATS_METRIC_SETTINGS_DEFAULT_EXPORTER_INCLUDE,
 	.description = "",
 };
@@ -507,6 +513,32 @@ static bool parse_metric_group_by(struct stats_metric_settings *set,
 	return TRUE;
 }
 
+static bool parse_metric_quantiles(struct stats_metric_settings *set,
+				   pool_t pool, const char **error_r)
+{
+	const char *const *tmp;
+	double quantile;
+
+	if (set->quantiles == NULL)
+		return TRUE;
+	tmp = t_strsplit_spaces(set->quantiles, " ");
+	if (tmp[0] == NULL)
+		return TRUE;
+
+	p_array_init(&set->parsed_quantiles, pool, str_array_length(tmp));
+	for (; *tmp != NULL; tmp++) {
+		if (str_to_double(*tmp, &quantile) < 0 ||
+		    quantile < 0 || quantile > 1) {
+			*error_r = t_strdup_printf("metric %s { quantiles } has "
+				"invalid quantile '%s' - must be between 0 and 1",
+				set->name, *tmp);
+			return FALSE;
+		}
+		array_push_back(&set->parsed_quantiles, &quantile);
+	}
+	return TRUE;
+}
+
 static bool stats_metric_settings_check(void *_set, pool_t pool, const char **error_r)
 {
 	struct stats_metric_settings *set = _set;
@@ -526,6 +558,8 @@ static bool stats_metric_settings_check(void *_set, pool_t pool, const char **er
 
 	if (!parse_metric_group_by(set, pool, error_r))
 		return FALSE;
+	if (!parse_metric_quantiles(set, pool, error_r))
+		return FALSE;
 
 	return TRUE;
 }
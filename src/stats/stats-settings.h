@@ -67,6 +67,8 @@ struct stats_exporter_settings {
 	const char *transport;
 	const char *transport_args;
 	unsigned int transport_timeout;
+	uoff_t transport_queue_size;
+	unsigned int sample_rate;
 	const char *format;
 	const char *format_args;
 
@@ -108,9 +110,14 @@ struct stats_metric_settings {
 	const char *fields;
 	const char *group_by;
 	const char *filter;
+	const char *quantiles;
 
 	ARRAY(struct stats_metric_settings_group_by) parsed_group_by;
 	struct event_filter *parsed_filter;
+	/* Quantiles (0..1) of the duration to export. If non-empty, the
+	   durations are counted in fixed-memory sketches instead of
+	   subsampling them. */
+	ARRAY(double) parsed_quantiles;
 
 	/* exporter related fields */
 	const char *exporter;
@@ -2,6 +2,8 @@
 
 #include "test-stats-common.h"
 #include "array.h"
+#include "ioloop.h"
+#include "event-exporter.h"
 
 bool test_stats_callback(struct event *event,
 			 enum event_callback_type type ATTR_UNUSED,
@@ -92,6 +94,75 @@ static void test_stats_metrics_filter(void)
 	test_end();
 }
 
+static const char *const settings_blob_3[] = {
+	"metric=test",
+	"metric/test/metric_name=test",
+	"metric/test/filter=event=test",
+	"metric/test/metric_quantiles=0.5 0.9 0.99",
+	NULL
+};
+
+static void test_stats_metrics_quantiles(void)
+{
+	unsigned int count;
+
+	test_begin("stats metrics (quantiles)");
+
+	test_init(settings_blob_3);
+
+	for (unsigned int i = 0; i < 10; i++) {
+		struct event *event = event_create(NULL);
+		event_add_category(event, &test_category);
+		event_set_name(event, "test");
+		test_event_send(event);
+		event_unref(&event);
+	}
+
+	struct stats_metrics_iter *iter = stats_metrics_iterate_init(stats_metrics);
+	const struct metric *metric = stats_metrics_iterate(iter);
+	stats_metrics_iterate_deinit(&iter);
+
+	test_assert(array_count(&metric->set->parsed_quantiles) == 3);
+	test_assert(stats_dist_get_count(metric->duration_stats) == 10);
+	/* durations are counted in a sketch, which has no samples */
+	(void)stats_dist_get_samples(metric->duration_stats, &count);
+	test_assert(count == 0);
+	uint64_t median = stats_dist_get_median(metric->duration_stats);
+	uint64_t p99 = stats_dist_get_percentile(metric->duration_stats, 0.99);
+	test_assert(stats_dist_get_min(metric->duration_stats) <= median);
+	test_assert(median <= p99);
+	test_assert(p99 <= stats_dist_get_max(metric->duration_stats));
+
+	test_deinit();
+	test_end();
+}
+
+static void test_stats_metrics_exporter_queue(void)
+{
+	struct exporter exporter = {
+		.name = "test",
+		.transport_queue_size = 100,
+	};
+
+	test_begin("stats metrics (exporter queue)");
+	ioloop_time = time(NULL);
+	test_assert(!event_export_transport_queue_full(&exporter, 0, 100));
+	test_assert(!event_export_transport_queue_full(&exporter, 50, 50));
+	test_expect_error_string("Transport queue is full - dropped 1 events");
+	test_assert(event_export_transport_queue_full(&exporter, 50, 51));
+	test_expect_no_more_errors();
+	/* the following drops aren't logged immediately */
+	test_assert(event_export_transport_queue_full(&exporter, 100, 1));
+	test_assert(exporter.dropped_count == 2);
+	test_assert(exporter.dropped_count_unlogged == 1);
+
+	/* unlimited */
+	exporter.transport_queue_size = 0;
+	test_assert(!event_export_transport_queue_full(&exporter, SIZE_MAX/2, 1));
+	test_assert(exporter.dropped_count == 2);
+	test_end();
+}
+
 static void test_stats_metrics_group_by_check_one(const struct metric *metric,
 						  const char *sub_name,
 						  unsigned int total_count,
@@ -447,6 +518,8 @@ int main(void) {
 	void (*const test_functions[])(void) = {
 		test_stats_metrics,
 		test_stats_metrics_filter,
+		test_stats_metrics_quantiles,
+		test_stats_metrics_exporter_queue,
 		test_stats_metrics_group_by_discrete,
 		test_stats_metrics_group_by_quantized,
 		NULL
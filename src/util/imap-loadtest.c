@@ -0,0 +1,465 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "ioloop.h"
+#include "net.h"
+#include "istream.h"
+#include "str.h"
+#include "llist.h"
+#include "time-util.h"
+#include "stats-dist.h"
+#include "master-service.h"
+#include "imapc-client.h"
+
+#include <stdio.h>
+
+#define DEFAULT_CLIENT_COUNT 10
+#define DEFAULT_DURATION_SECS 10
+#define DEFAULT_IMAP_PORT 143
+/* Same as the imapc_max_idle_time default */
+#define IMAPC_MAX_IDLE_TIME_SECS (29*60)
+#define STATS_INTERVAL_MSECS (5*1000)
+#define APPEND_BODY_SIZE 4096
+
+enum loadtest_scenario {
+	/* Mix of NOOP, FETCH, SEARCH, SORT and STATUS commands */
+	LOADTEST_SCENARIO_MIX,
+	/* Connect, login, logout and reconnect as fast as possible */
+	LOADTEST_SCENARIO_LOGIN,
+	/* Login, SELECT and IDLE until the test ends */
+	LOADTEST_SCENARIO_IDLE,
+	/* Keep APPENDing messages to the mailbox */
+	LOADTEST_SCENARIO_APPEND,
+};
+
+static const char *loadtest_scenario_names[] = {
+	"mix", "login", "idle", "append"
+};
+static_assert_array_size(loadtest_scenario_names,
+			 LOADTEST_SCENARIO_APPEND + 1);
+
+struct loadtest_mix_command {
+	const char *name;
+	/* NULL for STATUS, which needs the mailbox name */
+	const char *cmd;
+};
+
+static const struct loadtest_mix_command loadtest_mix_commands[] = {
+	{ "NOOP", "NOOP" },
+	{ "FETCH", "FETCH 1:* (UID FLAGS)" },
+	{ "FETCH-HEADERS",
+	  "FETCH 1:10 (BODY.PEEK[HEADER.FIELDS (FROM SUBJECT DATE)])" },
+	{ "SEARCH", "UID SEARCH ALL" },
+	{ "SEARCH-TEXT", "UID SEARCH SUBJECT loadtest" },
+	{ "SORT", "UID SORT (REVERSE DATE) UTF-8 ALL" },
+	{ "STATUS", NULL },
+};
+
+struct loadtest_cmd_stats {
+	const char *name;
+	struct stats_dist *usecs;
+	unsigned int failures;
+};
+
+struct loadtest_client;
+
+struct loadtest_cmd {
+	struct loadtest_client *client;
+	struct loadtest_cmd_stats *stats;
+	struct timeval start_time;
+};
+
+struct loadtest_client {
+	struct loadtest_client *prev, *next;
+	struct loadtest_ctx *ctx;
+	unsigned int idx;
+
+	struct imapc_client *client;
+	struct imapc_client_mailbox *box;
+	struct timeval login_start_time;
+	struct timeout *to;
+
+	bool destroying:1;
+};
+
+struct loadtest_ctx {
+	struct imapc_client_settings set;
+	enum loadtest_scenario scenario;
+	const char *mailbox;
+	unsigned int client_count;
+
+	struct loadtest_client *clients;
+	ARRAY(struct loadtest_cmd_stats *) stats;
+	struct timeval start_time;
+	bool stopping;
+};
+
+static void client_start(struct loadtest_ctx *ctx, unsigned int idx);
+static void client_next_cmd(struct loadtest_client *lclient);
+
+static struct loadtest_cmd_stats *
+loadtest_stats_get(struct loadtest_ctx *ctx, const char *name)
+{
+	struct loadtest_cmd_stats *stats;
+
+	array_foreach_elem(&ctx->stats, stats) {
+		if (strcmp(stats->name, name) == 0)
+			return stats;
+	}
+	stats = i_new(struct loadtest_cmd_stats, 1);
+	stats->name = name;
+	stats->usecs = stats_dist_init_sketch();
+	array_push_back(&ctx->stats, &stats);
+	return stats;
+}
+
+static void
+loadtest_stats_add(struct loadtest_cmd_stats *stats,
+		   const struct timeval *start_time,
+		   enum imapc_command_state state)
+{
+	struct timeval now;
+
+	if (state != IMAPC_COMMAND_STATE_OK) {
+		stats->failures++;
+		return;
+	}
+	i_gettimeofday(&now);
+	stats_dist_add(stats->usecs, timeval_diff_usecs(&now, start_time));
+}
+
+static void client_destroy(struct loadtest_client **_lclient)
+{
+	struct loadtest_client *lclient = *_lclient;
+
+	*_lclient = NULL;
+
+	/* closing the mailbox and the connection aborts any pending commands,
+	   which calls their callbacks. */
+	lclient->destroying = TRUE;
+	DLLIST_REMOVE(&lclient->ctx->clients, lclient);
+	timeout_remove(&lclient->to);
+	if (lclient->box != NULL)
+		imapc_client_mailbox_close(&lclient->box);
+	imapc_client_deinit(&lclient->client);
+	i_free(lclient);
+}
+
+static void client_restart(struct loadtest_client *lclient)
+{
+	struct loadtest_ctx *ctx = lclient->ctx;
+	unsigned int idx = lclient->idx;
+
+	client_destroy(&lclient);
+	if (!ctx->stopping)
+		client_start(ctx, idx);
+}
+
+static void client_restart_delayed(struct loadtest_client *lclient)
+{
+	/* the imapc client can't be destroyed from within its own callback */
+	timeout_remove(&lclient->to);
+	lclient->to = timeout_add_short(0, client_restart, lclient);
+}
+
+static void client_cmd_callback(const struct imapc_command_reply *reply,
+				void *context)
+{
+	struct loadtest_cmd *cmd = context;
+	struct loadtest_client *lclient = cmd->client;
+
+	if (!lclient->destroying)
+		loadtest_stats_add(cmd->stats, &cmd->start_time, reply->state);
+	i_free(cmd);
+
+	if (lclient->destroying || lclient->ctx->stopping)
+		return;
+	if (reply->state == IMAPC_COMMAND_STATE_DISCONNECTED ||
+	    lclient->ctx->scenario == LOADTEST_SCENARIO_LOGIN)
+		client_restart_delayed(lclient);
+	else
+		client_next_cmd(lclient);
+}
+
+static struct imapc_command *
+client_cmd(struct loadtest_client *lclient, const char *name)
+{
+	struct loadtest_cmd *cmd;
+
+	cmd = i_new(struct loadtest_cmd, 1);
+	cmd->client = lclient;
+	cmd->stats = loadtest_stats_get(lclient->ctx, name);
+	i_gettimeofday(&cmd->start_time);
+	if (lclient->box != NULL) {
+		return imapc_client_mailbox_cmd(lclient->box,
+						client_cmd_callback, cmd);
+	}
+	return imapc_client_cmd(lclient->client, client_cmd_callback, cmd);
+}
+
+static void client_send_append(struct loadtest_client *lclient)
+{
+	struct imapc_command *cmd;
+	struct istream *input;
+	string_t *msg;
+
+	msg = t_str_new(APPEND_BODY_SIZE + 256);
+	str_printfa(msg, "From: loadtest-%u@example.com\r\n"
+		    "To: loadtest@example.com\r\n"
+		    "Subject: loadtest message\r\n"
+		    "Message-ID: <%u.%ld.%u@loadtest>\r\n"
+		    "\r\n", lclient->idx, lclient->idx,
+		    (long)ioloop_time, i_rand());
+	while (str_len(msg) < APPEND_BODY_SIZE)
+		str_append(msg, "This is a load test message body line.\r\n");
+	input = i_stream_create_copy_from_string(msg);
+
+	cmd = client_cmd(lclient, "APPEND");
+	imapc_command_sendf(cmd, "APPEND %s %p", lclient->ctx->mailbox, input);
+	i_stream_unref(&input);
+}
+
+static void client_next_cmd(struct loadtest_client *lclient)
+{
+	const struct loadtest_mix_command *mix;
+	struct imapc_command *cmd;
+
+	switch (lclient->ctx->scenario) {
+	case LOADTEST_SCENARIO_MIX:
+		mix = &loadtest_mix_commands[
+			i_rand_limit(N_ELEMENTS(loadtest_mix_commands))];
+		cmd = client_cmd(lclient, mix->name);
+		if (mix->cmd != NULL)
+			imapc_command_send(cmd, mix->cmd);
+		else {
+			imapc_command_sendf(cmd,
+				"STATUS %s (MESSAGES UIDNEXT UNSEEN)",
+				lclient->ctx->mailbox);
+		}
+		break;
+	case LOADTEST_SCENARIO_LOGIN:
+		cmd = client_cmd(lclient, "LOGOUT");
+		imapc_command_set_flags(cmd, IMAPC_COMMAND_FLAG_LOGOUT);
+		imapc_command_send(cmd, "LOGOUT");
+		break;
+	case LOADTEST_SCENARIO_IDLE:
+		/* nothing more to do - the connection stays in IDLE */
+		imapc_client_mailbox_idle(lclient->box);
+		break;
+	case LOADTEST_SCENARIO_APPEND:
+		T_BEGIN {
+			client_send_append(lclient);
+		} T_END;
+		break;
+	}
+}
+
+static void client_select(struct loadtest_client *lclient)
+{
+	struct imapc_command *cmd;
+
+	lclient->box = imapc_client_mailbox_open(lclient->client, NULL);
+	cmd = client_cmd(lclient, "SELECT");
+	imapc_command_set_flags(cmd, IMAPC_COMMAND_FLAG_SELECT);
+	imapc_command_sendf(cmd, "SELECT %s", lclient->ctx->mailbox);
+}
+
+static void client_login_callback(const struct imapc_command_reply *reply,
+				  void *context)
+{
+	struct loadtest_client *lclient = context;
+	struct loadtest_ctx *ctx = lclient->ctx;
+
+	if (lclient->destroying)
+		return;
+	loadtest_stats_add(loadtest_stats_get(ctx, "LOGIN"),
+			   &lclient->login_start_time, reply->state);
+	if (ctx->stopping)
+		return;
+	if (reply->state != IMAPC_COMMAND_STATE_OK) {
+		if (reply->state == IMAPC_COMMAND_STATE_AUTH_FAILED)
+			i_fatal("Authentication failed: %s", reply->text_full);
+		client_restart_delayed(lclient);
+		return;
+	}
+
+	switch (ctx->scenario) {
+	case LOADTEST_SCENARIO_MIX:
+	case LOADTEST_SCENARIO_IDLE:
+		client_select(lclient);
+		break;
+	case LOADTEST_SCENARIO_LOGIN:
+	case LOADTEST_SCENARIO_APPEND:
+		client_next_cmd(lclient);
+		break;
+	}
+}
+
+static void client_start(struct loadtest_ctx *ctx, unsigned int idx)
+{
+	struct loadtest_client *lclient;
+
+	lclient = i_new(struct loadtest_client, 1);
+	lclient->ctx = ctx;
+	lclient->idx = idx;
+	lclient->client = imapc_client_init(&ctx->set,
+					    master_service_get_event(master_service));
+	DLLIST_PREPEND(&ctx->clients, lclient);
+
+	i_gettimeofday(&lclient->login_start_time);
+	imapc_client_set_login_callback(lclient->client,
+					client_login_callback, lclient);
+	imapc_client_login(lclient->client);
+}
+
+static void loadtest_stats_output(struct loadtest_ctx *ctx)
+{
+	struct loadtest_cmd_stats *stats;
+	struct loadtest_client *lclient;
+	unsigned int client_count = 0;
+	struct timeval now;
+	double secs;
+
+	i_gettimeofday(&now);
+	secs = timeval_diff_usecs(&now, &ctx->start_time) / 1000000.0;
+	if (secs <= 0)
+		secs = 1;
+
+	printf("%-14s %8s %6s %8s %8s %8s %8s %8s %8s\n", "command",
+	       "count", "fail", "cmd/s", "avg_ms", "p50_ms", "p90_ms",
+	       "p99_ms", "max_ms");
+	array_foreach_elem(&ctx->stats, stats) {
+		unsigned int count = stats_dist_get_count(stats->usecs);
+
+		printf("%-14s %8u %6u %8.1f", stats->name, count,
+		       stats->failures, count / secs);
+		if (count == 0) {
+			printf("\n");
+			continue;
+		}
+		printf(" %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+		       stats_dist_get_avg(stats->usecs) / 1000.0,
+		       stats_dist_get_median(stats->usecs) / 1000.0,
+		       stats_dist_get_percentile(stats->usecs, 0.90) / 1000.0,
+		       stats_dist_get_percentile(stats->usecs, 0.99) / 1000.0,
+		       stats_dist_get_max(stats->usecs) / 1000.0);
+	}
+	for (lclient = ctx->clients; lclient != NULL; lclient = lclient->next)
+		client_count++;
+	printf("%u/%u clients running\n", client_count, ctx->client_count);
+	fflush(stdout);
+}
+
+static void loadtest_stop(struct loadtest_ctx *ctx)
+{
+	ctx->stopping = TRUE;
+	io_loop_stop(current_ioloop);
+}
+
+static int loadtest_scenario_parse(const char *str,
+				   enum loadtest_scenario *scenario_r)
+{
+	for (unsigned int i = 0; i < N_ELEMENTS(loadtest_scenario_names); i++) {
+		if (strcmp(loadtest_scenario_names[i], str) == 0) {
+			*scenario_r = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct loadtest_ctx ctx;
+	struct loadtest_cmd_stats *stats;
+	unsigned int duration_secs = DEFAULT_DURATION_SECS;
+	struct timeout *to_stop, *to_stats = NULL;
+	unsigned int i;
+	int c;
+
+	i_zero(&ctx);
+	ctx.client_count = DEFAULT_CLIENT_COUNT;
+	ctx.mailbox = "INBOX";
+	ctx.set.port = DEFAULT_IMAP_PORT;
+	ctx.set.password = getenv("IMAP_LOADTEST_PASSWORD");
+
+	master_service = master_service_init("imap-loadtest",
+					     MASTER_SERVICE_FLAG_STANDALONE,
+					     &argc, &argv, "Dm:n:p:s:t:");
+	while ((c = master_getopt(master_service)) > 0) {
+		switch (c) {
+		case 'D':
+			ctx.set.debug = TRUE;
+			break;
+		case 'm':
+			ctx.mailbox = optarg;
+			break;
+		case 'n':
+			if (str_to_uint(optarg, &ctx.client_count) < 0 ||
+			    ctx.client_count == 0)
+				i_fatal("Invalid -n parameter: %s", optarg);
+			break;
+		case 'p':
+			if (net_str2port(optarg, &ctx.set.port) < 0)
+				i_fatal("Invalid -p parameter: %s", optarg);
+			break;
+		case 's':
+			if (loadtest_scenario_parse(optarg, &ctx.scenario) < 0)
+				i_fatal("Invalid -s parameter: %s", optarg);
+			break;
+		case 't':
+			if (str_to_uint(optarg, &duration_secs) < 0)
+				i_fatal("Invalid -t parameter: %s", optarg);
+			break;
+		default:
+			return FATAL_DEFAULT;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2) {
+		i_fatal("Usage: [-D] [-n <clients>] [-t <secs>] [-p <port>] "
+			"[-m <mailbox>] [-s mix|login|idle|append] "
+			"<host> <user> (password in $IMAP_LOADTEST_PASSWORD)");
+	}
+	if (ctx.set.password == NULL)
+		i_fatal("IMAP_LOADTEST_PASSWORD environment not set");
+	ctx.set.host = argv[0];
+	ctx.set.username = argv[1];
+	ctx.set.dns_client_socket_path = "";
+	ctx.set.rawlog_dir = "";
+	ctx.set.temp_path_prefix = "/tmp/imap-loadtest";
+	ctx.set.no_qresync = TRUE;
+	ctx.set.max_idle_time = IMAPC_MAX_IDLE_TIME_SECS;
+
+	master_service_init_finish(master_service);
+	i_array_init(&ctx.stats, 16);
+
+	i_gettimeofday(&ctx.start_time);
+	for (i = 0; i < ctx.client_count; i++)
+		client_start(&ctx, i);
+
+	to_stop = timeout_add(duration_secs * 1000, loadtest_stop, &ctx);
+	if (duration_secs * 1000 > STATS_INTERVAL_MSECS) {
+		to_stats = timeout_add(STATS_INTERVAL_MSECS,
+				       loadtest_stats_output, &ctx);
+	}
+	io_loop_run(current_ioloop);
+	timeout_remove(&to_stats);
+	timeout_remove(&to_stop);
+
+	loadtest_stats_output(&ctx);
+	while (ctx.clients != NULL) {
+		struct loadtest_client *lclient = ctx.clients;
+		client_destroy(&lclient);
+	}
+	array_foreach_elem(&ctx.stats, stats) {
+		stats_dist_deinit(&stats->usecs);
+		i_free(stats);
+	}
+	array_free(&ctx.stats);
+	master_service_deinit(&master_service);
+	return 0;
+}